@@ -0,0 +1,430 @@
+/*
+ * PROJECT:         ReactOS Windows-Compatible Session Manager
+ * LICENSE:         BSD 2-Clause License
+ * FILE:            base/system/smss/impcache.c
+ * PURPOSE:         Known DLL Import Resolution Cache
+ */
+
+/* INCLUDES *******************************************************************/
+
+#include "smss.h"
+
+#include <ndk/sefuncs.h>
+#include <ldrcache.h>
+
+#define NDEBUG
+#include <debug.h>
+
+/* GLOBALS ********************************************************************/
+
+typedef struct _SMP_CACHE_IMAGE
+{
+    PUNICODE_STRING Name;
+    PVOID ViewBase;
+    PIMAGE_NT_HEADERS NtHeaders;
+    PIMAGE_EXPORT_DIRECTORY ExportDirectory;
+    ULONG ExportSize;
+} SMP_CACHE_IMAGE, *PSMP_CACHE_IMAGE;
+
+/* FUNCTIONS ******************************************************************/
+
+static
+PSMP_CACHE_IMAGE
+SmpFindCacheImage(IN PSMP_CACHE_IMAGE Images,
+                  IN ULONG ImageCount,
+                  IN PCHAR ImportName)
+{
+    ANSI_STRING AnsiName;
+    UNICODE_STRING Name;
+    WCHAR NameBuffer[64];
+    ULONG i;
+
+    /* Known DLLs are imported by their file name */
+    RtlInitAnsiString(&AnsiName, ImportName);
+    Name.Buffer = NameBuffer;
+    Name.Length = 0;
+    Name.MaximumLength = sizeof(NameBuffer);
+    if (!NT_SUCCESS(RtlAnsiStringToUnicodeString(&Name, &AnsiName, FALSE))) return NULL;
+
+    for (i = 0; i < ImageCount; i++)
+    {
+        if (RtlEqualUnicodeString(Images[i].Name, &Name, TRUE)) return &Images[i];
+    }
+
+    return NULL;
+}
+
+static
+ULONG
+SmpResolveCacheThunk(IN PSMP_CACHE_IMAGE Export,
+                     IN PVOID ImportBase,
+                     IN PIMAGE_THUNK_DATA OriginalThunk)
+{
+    PIMAGE_EXPORT_DIRECTORY ExportDirectory = Export->ExportDirectory;
+    PIMAGE_IMPORT_BY_NAME AddressOfData;
+    PULONG NameTable, AddressOfFunctions;
+    PUSHORT OrdinalTable;
+    LONG Low, Mid, High, Result;
+    USHORT Ordinal;
+    ULONG Rva, ExportRva;
+
+    NameTable = (PULONG)((ULONG_PTR)Export->ViewBase + ExportDirectory->AddressOfNames);
+    OrdinalTable = (PUSHORT)((ULONG_PTR)Export->ViewBase + ExportDirectory->AddressOfNameOrdinals);
+    AddressOfFunctions = (PULONG)((ULONG_PTR)Export->ViewBase + ExportDirectory->AddressOfFunctions);
+
+    /* This must find exactly what LdrpSnapThunk would */
+    if (IMAGE_SNAP_BY_ORDINAL(OriginalThunk->u1.Ordinal))
+    {
+        Ordinal = (USHORT)(IMAGE_ORDINAL(OriginalThunk->u1.Ordinal) - ExportDirectory->Base);
+    }
+    else
+    {
+        AddressOfData = (PIMAGE_IMPORT_BY_NAME)
+                        ((ULONG_PTR)ImportBase +
+                        ((ULONG_PTR)OriginalThunk->u1.AddressOfData & 0xffffffff));
+
+        if (((ULONG)AddressOfData->Hint < ExportDirectory->NumberOfNames) &&
+            !(strcmp((PCHAR)AddressOfData->Name,
+                     (PCHAR)((ULONG_PTR)Export->ViewBase + NameTable[AddressOfData->Hint]))))
+        {
+            Ordinal = OrdinalTable[AddressOfData->Hint];
+        }
+        else
+        {
+            Ordinal = (USHORT)-1;
+            Low = 0;
+            High = ExportDirectory->NumberOfNames - 1;
+            while (High >= Low)
+            {
+                Mid = (Low + High) >> 1;
+                Result = strcmp((PCHAR)AddressOfData->Name,
+                                (PCHAR)((ULONG_PTR)Export->ViewBase + NameTable[Mid]));
+                if (Result < 0)
+                {
+                    High = Mid - 1;
+                }
+                else if (Result > 0)
+                {
+                    Low = Mid + 1;
+                }
+                else
+                {
+                    Ordinal = OrdinalTable[Mid];
+                    break;
+                }
+            }
+        }
+    }
+
+    /* Missing exports are reported by the loader, leave them to it */
+    if ((ULONG)Ordinal >= ExportDirectory->NumberOfFunctions) return 0;
+    Rva = AddressOfFunctions[Ordinal];
+
+    /* So are forwarders, they depend on another DLL */
+    ExportRva = (ULONG)((ULONG_PTR)ExportDirectory - (ULONG_PTR)Export->ViewBase);
+    if ((Rva >= ExportRva) && (Rva < ExportRva + Export->ExportSize)) return 0;
+
+    return Rva;
+}
+
+static
+VOID
+SmpCollectImportCache(IN PSMP_CACHE_IMAGE Images,
+                      IN ULONG ImageCount,
+                      IN PLDR_IMPORT_CACHE_HEADER Header OPTIONAL,
+                      OUT PULONG DescriptorCount,
+                      OUT PULONG ThunkCount)
+{
+    PIMAGE_IMPORT_DESCRIPTOR ImportDescriptor;
+    PIMAGE_THUNK_DATA OriginalThunk;
+    PLDR_IMPORT_CACHE_DESCRIPTOR Descriptor;
+    PSMP_CACHE_IMAGE Import, Export;
+    ULONG i, Size, Thunks;
+
+    /* Without a header, only count what we would write */
+    *DescriptorCount = 0;
+    *ThunkCount = 0;
+
+    for (i = 0; i < ImageCount; i++)
+    {
+        Import = &Images[i];
+        if (Header)
+        {
+            /* The section starts out zeroed, so the name is terminated */
+            RtlCopyMemory(Header->Images[i].BaseDllName, Import->Name->Buffer, Import->Name->Length);
+            Header->Images[i].TimeDateStamp = Import->NtHeaders->FileHeader.TimeDateStamp;
+            Header->Images[i].CheckSum = Import->NtHeaders->OptionalHeader.CheckSum;
+            Header->Images[i].SizeOfImage = Import->NtHeaders->OptionalHeader.SizeOfImage;
+            Header->Images[i].FirstDescriptor = *DescriptorCount;
+            Header->Images[i].DescriptorCount = 0;
+        }
+
+        ImportDescriptor = RtlImageDirectoryEntryToData(Import->ViewBase,
+                                                        TRUE,
+                                                        IMAGE_DIRECTORY_ENTRY_IMPORT,
+                                                        &Size);
+        if (!ImportDescriptor) continue;
+
+        for (; ImportDescriptor->Name; ImportDescriptor++)
+        {
+            /* Only imports from other known DLLs can be resolved up front */
+            Export = SmpFindCacheImage(Images,
+                                       ImageCount,
+                                       (PCHAR)((ULONG_PTR)Import->ViewBase + ImportDescriptor->Name));
+            if (!(Export) || !(Export->ExportDirectory)) continue;
+
+            /* The loader snaps odd images through their IAT, skip those */
+            if (!(ImportDescriptor->FirstThunk) ||
+                (ImportDescriptor->OriginalFirstThunk < Import->NtHeaders->OptionalHeader.SizeOfHeaders) ||
+                (ImportDescriptor->OriginalFirstThunk >= Import->NtHeaders->OptionalHeader.SizeOfImage))
+            {
+                continue;
+            }
+
+            OriginalThunk = (PIMAGE_THUNK_DATA)((ULONG_PTR)Import->ViewBase +
+                                                ImportDescriptor->OriginalFirstThunk);
+            for (Thunks = 0; OriginalThunk[Thunks].u1.AddressOfData; Thunks++)
+            {
+                if (Header)
+                {
+                    LDR_IMPORT_CACHE_THUNKS(Header)[*ThunkCount + Thunks] =
+                        SmpResolveCacheThunk(Export, Import->ViewBase, &OriginalThunk[Thunks]);
+                }
+            }
+
+            if (Header)
+            {
+                Descriptor = &LDR_IMPORT_CACHE_DESCRIPTORS(Header)[*DescriptorCount];
+                Descriptor->FirstThunkRva = ImportDescriptor->FirstThunk;
+                Descriptor->ExportImage = (ULONG)(Export - Images);
+                Descriptor->FirstThunk = *ThunkCount;
+                Descriptor->ThunkCount = Thunks;
+                Header->Images[i].DescriptorCount++;
+            }
+
+            (*DescriptorCount)++;
+            *ThunkCount += Thunks;
+        }
+    }
+}
+
+static
+NTSTATUS
+SmpCreateImportCacheSection(IN HANDLE DirectoryHandle,
+                            IN ULONG Size,
+                            OUT PHANDLE SectionHandle)
+{
+    SID_IDENTIFIER_AUTHORITY WorldAuthority = {SECURITY_WORLD_SID_AUTHORITY};
+    SID_IDENTIFIER_AUTHORITY NtAuthority = {SECURITY_NT_AUTHORITY};
+    PSID WorldSid = NULL, RestrictedSid = NULL, SystemSid = NULL;
+    SECURITY_DESCRIPTOR SecurityDescriptor;
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    UNICODE_STRING CacheName;
+    LARGE_INTEGER MaximumSize;
+    PACL Acl = NULL;
+    ULONG AclLength;
+    NTSTATUS Status;
+
+    /* Build the world, restricted and system SIDs */
+    Status = RtlAllocateAndInitializeSid(&WorldAuthority, 1,
+                                         SECURITY_WORLD_RID,
+                                         0, 0, 0, 0, 0, 0, 0,
+                                         &WorldSid);
+    if (!NT_SUCCESS(Status)) goto Quickie;
+    Status = RtlAllocateAndInitializeSid(&NtAuthority, 1,
+                                         SECURITY_RESTRICTED_CODE_RID,
+                                         0, 0, 0, 0, 0, 0, 0,
+                                         &RestrictedSid);
+    if (!NT_SUCCESS(Status)) goto Quickie;
+    Status = RtlAllocateAndInitializeSid(&NtAuthority, 1,
+                                         SECURITY_LOCAL_SYSTEM_RID,
+                                         0, 0, 0, 0, 0, 0, 0,
+                                         &SystemSid);
+    if (!NT_SUCCESS(Status)) goto Quickie;
+
+    /*
+     * Unlike the known DLL sections this isn't an image, so whoever could
+     * write to it would decide where other processes' imports go. Only we
+     * get to write it, everybody else may just map it for reading.
+     */
+    AclLength = sizeof(ACL) + 3 * sizeof(ACCESS_ALLOWED_ACE) +
+                RtlLengthSid(WorldSid) + RtlLengthSid(RestrictedSid) + RtlLengthSid(SystemSid);
+    Acl = RtlAllocateHeap(RtlGetProcessHeap(), 0, AclLength);
+    if (!Acl)
+    {
+        Status = STATUS_NO_MEMORY;
+        goto Quickie;
+    }
+
+    Status = RtlCreateAcl(Acl, AclLength, ACL_REVISION2);
+    ASSERT(NT_SUCCESS(Status));
+    Status = RtlAddAccessAllowedAce(Acl, ACL_REVISION2, SECTION_QUERY | SECTION_MAP_READ, WorldSid);
+    ASSERT(NT_SUCCESS(Status));
+    Status = RtlAddAccessAllowedAce(Acl, ACL_REVISION2, SECTION_QUERY | SECTION_MAP_READ, RestrictedSid);
+    ASSERT(NT_SUCCESS(Status));
+    Status = RtlAddAccessAllowedAce(Acl, ACL_REVISION2, SECTION_ALL_ACCESS, SystemSid);
+    ASSERT(NT_SUCCESS(Status));
+
+    Status = RtlCreateSecurityDescriptor(&SecurityDescriptor, SECURITY_DESCRIPTOR_REVISION);
+    ASSERT(NT_SUCCESS(Status));
+    Status = RtlSetDaclSecurityDescriptor(&SecurityDescriptor, TRUE, Acl, FALSE);
+    ASSERT(NT_SUCCESS(Status));
+
+    /* Create it next to the known DLL sections, for the lifetime of the boot */
+    RtlInitUnicodeString(&CacheName, LDR_IMPORT_CACHE_NAME);
+    InitializeObjectAttributes(&ObjectAttributes,
+                               &CacheName,
+                               OBJ_PERMANENT,
+                               DirectoryHandle,
+                               &SecurityDescriptor);
+    MaximumSize.QuadPart = Size;
+    Status = NtCreateSection(SectionHandle,
+                             SECTION_ALL_ACCESS,
+                             &ObjectAttributes,
+                             &MaximumSize,
+                             PAGE_READWRITE,
+                             SEC_COMMIT,
+                             NULL);
+
+Quickie:
+    if (Acl) RtlFreeHeap(RtlGetProcessHeap(), 0, Acl);
+    if (SystemSid) RtlFreeSid(SystemSid);
+    if (RestrictedSid) RtlFreeSid(RestrictedSid);
+    if (WorldSid) RtlFreeSid(WorldSid);
+    return Status;
+}
+
+NTSTATUS
+NTAPI
+SmpCreateImportCache(IN HANDLE DirectoryHandle,
+                     IN PLIST_ENTRY KnownDllsList)
+{
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    PLIST_ENTRY NextEntry;
+    PSMP_REGISTRY_VALUE RegEntry;
+    PSMP_CACHE_IMAGE Images, Image;
+    PLDR_IMPORT_CACHE_HEADER Header;
+    HANDLE SectionHandle;
+    PVOID ViewBase;
+    SIZE_T ViewSize;
+    ULONG ImageCount, MaxImages, DescriptorCount, ThunkCount, Size, i;
+    NTSTATUS Status;
+
+    /* Count the known DLLs, some of them may not have made it */
+    MaxImages = 0;
+    for (NextEntry = KnownDllsList->Flink; NextEntry != KnownDllsList; NextEntry = NextEntry->Flink)
+    {
+        MaxImages++;
+    }
+    if (!MaxImages) return STATUS_SUCCESS;
+
+    Images = RtlAllocateHeap(RtlGetProcessHeap(), HEAP_ZERO_MEMORY, MaxImages * sizeof(SMP_CACHE_IMAGE));
+    if (!Images) return STATUS_NO_MEMORY;
+
+    /* Map the section of every known DLL we created */
+    ImageCount = 0;
+    for (NextEntry = KnownDllsList->Flink; NextEntry != KnownDllsList; NextEntry = NextEntry->Flink)
+    {
+        RegEntry = CONTAINING_RECORD(NextEntry, SMP_REGISTRY_VALUE, Entry);
+
+        /* The loader matches images by name too, which must fit the cache */
+        if (RegEntry->Value.Length >= LDR_IMPORT_CACHE_MAX_NAME * sizeof(WCHAR)) continue;
+
+        InitializeObjectAttributes(&ObjectAttributes,
+                                   &RegEntry->Value,
+                                   OBJ_CASE_INSENSITIVE,
+                                   DirectoryHandle,
+                                   NULL);
+        Status = NtOpenSection(&SectionHandle,
+                               SECTION_MAP_READ | SECTION_MAP_EXECUTE | SECTION_MAP_WRITE,
+                               &ObjectAttributes);
+        if (!NT_SUCCESS(Status)) continue;
+
+        ViewBase = NULL;
+        ViewSize = 0;
+        Status = NtMapViewOfSection(SectionHandle,
+                                    NtCurrentProcess(),
+                                    &ViewBase,
+                                    0,
+                                    0,
+                                    NULL,
+                                    &ViewSize,
+                                    ViewShare,
+                                    0,
+                                    PAGE_READWRITE);
+        NtClose(SectionHandle);
+        if (!NT_SUCCESS(Status)) continue;
+
+        /* Export and import tables are RVA based, so any base will do */
+        Image = &Images[ImageCount];
+        Image->NtHeaders = RtlImageNtHeader(ViewBase);
+        if (!Image->NtHeaders)
+        {
+            NtUnmapViewOfSection(NtCurrentProcess(), ViewBase);
+            continue;
+        }
+
+        Image->Name = &RegEntry->Value;
+        Image->ViewBase = ViewBase;
+        Image->ExportDirectory = RtlImageDirectoryEntryToData(ViewBase,
+                                                              TRUE,
+                                                              IMAGE_DIRECTORY_ENTRY_EXPORT,
+                                                              &Image->ExportSize);
+        ImageCount++;
+    }
+
+    /* Size the cache and create it */
+    SmpCollectImportCache(Images, ImageCount, NULL, &DescriptorCount, &ThunkCount);
+    Size = FIELD_OFFSET(LDR_IMPORT_CACHE_HEADER, Images) +
+           ImageCount * sizeof(LDR_IMPORT_CACHE_IMAGE) +
+           DescriptorCount * sizeof(LDR_IMPORT_CACHE_DESCRIPTOR) +
+           ThunkCount * sizeof(ULONG);
+    Status = SmpCreateImportCacheSection(DirectoryHandle, Size, &SectionHandle);
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("SMSS: Unable to create the known DLL import cache - Status == %lx\n", Status);
+        goto Quickie;
+    }
+
+    ViewBase = NULL;
+    ViewSize = 0;
+    Status = NtMapViewOfSection(SectionHandle,
+                                NtCurrentProcess(),
+                                &ViewBase,
+                                0,
+                                0,
+                                NULL,
+                                &ViewSize,
+                                ViewShare,
+                                0,
+                                PAGE_READWRITE);
+    if (NT_SUCCESS(Status))
+    {
+        /* Fill it in, the signature goes last so a partial cache is never used */
+        Header = ViewBase;
+        Header->Size = Size;
+        Header->ImageCount = ImageCount;
+        Header->DescriptorCount = DescriptorCount;
+        Header->ThunkCount = ThunkCount;
+        SmpCollectImportCache(Images, ImageCount, Header, &DescriptorCount, &ThunkCount);
+        Header->Signature = LDR_IMPORT_CACHE_SIGNATURE;
+
+        DPRINT("SMSS: Cached %lu imports of %lu known DLLs\n", ThunkCount, ImageCount);
+        NtUnmapViewOfSection(NtCurrentProcess(), ViewBase);
+    }
+    else
+    {
+        /* Get rid of the empty cache again */
+        DPRINT1("SMSS: Unable to map the known DLL import cache - Status == %lx\n", Status);
+        NtMakeTemporaryObject(SectionHandle);
+    }
+    NtClose(SectionHandle);
+
+Quickie:
+    for (i = 0; i < ImageCount; i++)
+    {
+        NtUnmapViewOfSection(NtCurrentProcess(), Images[i].ViewBase);
+    }
+    RtlFreeHeap(RtlGetProcessHeap(), 0, Images);
+    return Status;
+}
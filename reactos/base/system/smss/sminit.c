@@ -1595,6 +1595,9 @@ SmpInitializeKnownDllsInternal(IN PUNICODE_STRING Directory,
         ASSERT(NT_SUCCESS(Status1));
     }
 
+    /* Resolve the imports between the known DLLs once for everybody */
+    SmpCreateImportCache(DirHandle, &SmpKnownDllsList);
+
 Quickie:
     /* Close both handles and free the NT path buffer */
     if (DirHandle)
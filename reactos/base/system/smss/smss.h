@@ -111,6 +111,13 @@ SmpCreateSecurityDescriptors(
     IN BOOLEAN InitialCall
 );
 
+NTSTATUS
+NTAPI
+SmpCreateImportCache(
+    IN HANDLE DirectoryHandle,
+    IN PLIST_ENTRY KnownDllsList
+);
+
 NTSTATUS
 NTAPI
 SmpInit(
@@ -23,12 +23,34 @@
 /* Page heap flags */
 #define DPH_FLAG_DLL_NOTIFY 0x40
 
+/* Loader worker threads mapping imports in parallel, unless overridden by MaxLoaderThreads */
+#define LDRP_DEFAULT_LOADER_THREADS 4
+
 typedef struct _LDRP_TLS_DATA
 {
     LIST_ENTRY TlsLinks;
     IMAGE_TLS_DIRECTORY TlsDirectory;
 } LDRP_TLS_DATA, *PLDRP_TLS_DATA;
 
+typedef struct _LDRP_MAP_WORK
+{
+    LIST_ENTRY WorkLinks;
+    LIST_ENTRY MappedLinks;
+    PVOID Owner;
+    PWSTR DllPath;
+    PVOID ActivationContext;
+    UNICODE_STRING DllName;
+    UNICODE_STRING FullDllName;
+    UNICODE_STRING BaseDllName;
+    HANDLE SectionHandle;
+    PVOID ViewBase;
+    SIZE_T ViewSize;
+    NTSTATUS Status;
+    ULONG State;
+    BOOLEAN KnownDll;
+    BOOLEAN Relocated;
+} LDRP_MAP_WORK, *PLDRP_MAP_WORK;
+
 /* Global data */
 extern RTL_CRITICAL_SECTION LdrpLoaderLock;
 extern BOOLEAN LdrpInLdrInit;
@@ -54,6 +76,7 @@ extern PVOID g_pfnSE_DllUnloaded;
 extern PVOID g_pfnSE_InstallBeforeInit;
 extern PVOID g_pfnSE_InstallAfterInit;
 extern PVOID g_pfnSE_ProcessDying;
+extern ULONG LdrpMaxLoaderThreads;
 
 /* ldrinit.c */
 NTSTATUS NTAPI LdrpRunInitializeRoutines(IN PCONTEXT Context OPTIONAL);
@@ -84,6 +107,12 @@ NTSTATUS NTAPI
 LdrpWalkImportDescriptor(IN LPWSTR DllPath OPTIONAL,
                          IN PLDR_DATA_TABLE_ENTRY LdrEntry);
 
+VOID NTAPI
+LdrpFreeExportCache(IN PVOID DllBase);
+
+VOID NTAPI
+LdrpMapImportCache(VOID);
+
 
 /* ldrutils.c */
 NTSTATUS NTAPI
@@ -158,6 +187,33 @@ LdrpLoadShimEngine(IN PWSTR ImageName,
 VOID NTAPI
 LdrpUnloadShimEngine();
 
+BOOLEAN NTAPI
+LdrpResolveDllName(PWSTR DllPath,
+                   PWSTR DllName,
+                   PUNICODE_STRING FullDllName,
+                   PUNICODE_STRING BaseDllName);
+
+NTSTATUS NTAPI
+LdrpCheckForKnownDll(PWSTR DllName,
+                     PUNICODE_STRING FullDllName,
+                     PUNICODE_STRING BaseDllName,
+                     HANDLE *SectionHandle);
+
+/* ldrwork.c */
+VOID NTAPI LdrpInitializeWorkQueue(VOID);
+BOOLEAN NTAPI LdrpIsLoaderWorkerThread(VOID);
+VOID NTAPI LdrpFlushMappedDlls(IN PLDR_DATA_TABLE_ENTRY LdrEntry);
+
+VOID NTAPI
+LdrpQueueImportMapping(IN PWSTR DllPath OPTIONAL,
+                       IN PLDR_DATA_TABLE_ENTRY LdrEntry,
+                       IN PIMAGE_BOUND_IMPORT_DESCRIPTOR BoundEntry OPTIONAL,
+                       IN PIMAGE_IMPORT_DESCRIPTOR ImportEntry OPTIONAL);
+
+PLDRP_MAP_WORK NTAPI
+LdrpGetMappedDll(IN PWSTR DllPath OPTIONAL,
+                 IN PWSTR DllName);
+
 
 /* FIXME: Cleanup this mess */
 typedef NTSTATUS (NTAPI *PEPFUNC)(PPEB);
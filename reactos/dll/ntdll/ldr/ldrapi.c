@@ -1535,6 +1535,9 @@ LdrUnloadDll(IN PVOID BaseAddress)
         /* Unload the alternate resource module, if any */
         LdrUnloadAlternateResourceModule(CurrentEntry->DllBase);
 
+        /* Forget its export names */
+        LdrpFreeExportCache(CurrentEntry->DllBase);
+
         /* FIXME: Send shutdown notification */
         //LdrpSendDllNotifications(CurrentEntry, 2, LdrpShutdownInProgress);
 
@@ -1397,6 +1397,13 @@ LdrpInitializeExecutionOptions(PUNICODE_STRING ImagePathName, PPEB Peb, PHANDLE
                                    sizeof(RtlpShutdownProcessFlags),
                                    NULL);
 
+        LdrQueryImageFileKeyOption(KeyHandle,
+                                   L"MaxLoaderThreads",
+                                   REG_DWORD,
+                                   &LdrpMaxLoaderThreads,
+                                   sizeof(LdrpMaxLoaderThreads),
+                                   NULL);
+
         LdrQueryImageFileKeyOption(KeyHandle,
                                    L"MinimumStackCommitInBytes",
                                    REG_DWORD,
@@ -1660,6 +1667,9 @@ LdrpInitializeProcess(IN PCONTEXT Context,
     RtlInitializeCriticalSection(&LdrpLoaderLock);
     LdrpLoaderLockInit = TRUE;
 
+    /* Initialize the queue of the loader worker threads */
+    LdrpInitializeWorkQueue();
+
     /* Check if User Stack Trace Database support was requested */
     if (Peb->NtGlobalFlag & FLG_USER_STACK_TRACE_DB)
     {
@@ -1772,6 +1782,9 @@ LdrpInitializeProcess(IN PCONTEXT Context,
                 DPRINT1("LDR: %s - failed call to ZwQuerySymbolicLinkObject with status %x\n", "", Status);
                 return Status;
             }
+
+            /* Pick up the imports SMSS resolved between the known DLLs */
+            LdrpMapImportCache();
         }
     }
 
@@ -2218,6 +2231,9 @@ LdrpInit(PCONTEXT Context,
         Teb->DeallocationStack = MemoryBasicInfo.AllocationBase;
     }
 
+    /* Loader workers only map images, they must not wait for the initialization */
+    if (LdrpIsLoaderWorkerThread()) return;
+
     /* Now check if the process is already being initialized */
     while (_InterlockedCompareExchange(&LdrpProcessInitialized,
                                       1,
@@ -9,6 +9,7 @@
 /* INCLUDES *****************************************************************/
 
 #include <ntdll.h>
+#include <ldrcache.h>
 
 #define NDEBUG
 #include <debug.h>
@@ -18,6 +19,25 @@
 PLDR_MANIFEST_PROBER_ROUTINE LdrpManifestProberRoutine;
 ULONG LdrpNormalSnap;
 
+/* Export name hash tables, for exporters whose import hints keep missing */
+#define LDRP_EXPORT_CACHE_MIN_NAMES 64
+#define LDRP_EXPORT_CACHE_MISSES    4
+
+typedef struct _LDRP_EXPORT_CACHE
+{
+    LIST_ENTRY Links;
+    PVOID DllBase;
+    ULONG Misses;
+    ULONG HashMask;
+    PULONG HashTable;
+} LDRP_EXPORT_CACHE, *PLDRP_EXPORT_CACHE;
+
+LIST_ENTRY LdrpExportCacheList = {&LdrpExportCacheList, &LdrpExportCacheList};
+PLDRP_EXPORT_CACHE LdrpLastExportCache;
+
+/* Imports between the known DLLs, resolved by SMSS */
+PLDR_IMPORT_CACHE_HEADER LdrpImportCache;
+
 /* FUNCTIONS *****************************************************************/
 
 VOID
@@ -32,6 +52,158 @@ AVrfPageHeapDllNotification(IN PLDR_DATA_TABLE_ENTRY LdrEntry)
     UNIMPLEMENTED;
 }
 
+VOID
+NTAPI
+LdrpMapImportCache(VOID)
+{
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    UNICODE_STRING CacheName;
+    HANDLE SectionHandle;
+    PLDR_IMPORT_CACHE_HEADER Header = NULL;
+    PLDR_IMPORT_CACHE_DESCRIPTOR Descriptors;
+    SIZE_T ViewSize = 0;
+    ULONG i;
+    NTSTATUS Status;
+
+    /* SMSS creates it along with the known DLL sections */
+    RtlInitUnicodeString(&CacheName, LDR_IMPORT_CACHE_NAME);
+    InitializeObjectAttributes(&ObjectAttributes,
+                               &CacheName,
+                               OBJ_CASE_INSENSITIVE,
+                               LdrpKnownDllObjectDirectory,
+                               NULL);
+    Status = NtOpenSection(&SectionHandle, SECTION_MAP_READ, &ObjectAttributes);
+    if (!NT_SUCCESS(Status)) return;
+
+    Status = NtMapViewOfSection(SectionHandle,
+                                NtCurrentProcess(),
+                                (PVOID*)&Header,
+                                0,
+                                0,
+                                NULL,
+                                &ViewSize,
+                                ViewShare,
+                                0,
+                                PAGE_READONLY);
+    NtClose(SectionHandle);
+    if (!NT_SUCCESS(Status)) return;
+
+    /* Only use it if it's complete and consistent */
+    if ((ViewSize < sizeof(LDR_IMPORT_CACHE_HEADER)) ||
+        (Header->Signature != LDR_IMPORT_CACHE_SIGNATURE) ||
+        (Header->Size > ViewSize) ||
+        (Header->ImageCount > Header->Size / sizeof(LDR_IMPORT_CACHE_IMAGE)) ||
+        (Header->DescriptorCount > Header->Size / sizeof(LDR_IMPORT_CACHE_DESCRIPTOR)) ||
+        (Header->ThunkCount > Header->Size / sizeof(ULONG)) ||
+        (FIELD_OFFSET(LDR_IMPORT_CACHE_HEADER, Images) +
+         Header->ImageCount * sizeof(LDR_IMPORT_CACHE_IMAGE) +
+         Header->DescriptorCount * sizeof(LDR_IMPORT_CACHE_DESCRIPTOR) +
+         Header->ThunkCount * sizeof(ULONG) != Header->Size))
+    {
+        goto Invalid;
+    }
+
+    for (i = 0; i < Header->ImageCount; i++)
+    {
+        if ((Header->Images[i].FirstDescriptor > Header->DescriptorCount) ||
+            (Header->Images[i].DescriptorCount > Header->DescriptorCount - Header->Images[i].FirstDescriptor) ||
+            (Header->Images[i].BaseDllName[LDR_IMPORT_CACHE_MAX_NAME - 1] != UNICODE_NULL))
+        {
+            goto Invalid;
+        }
+    }
+
+    Descriptors = LDR_IMPORT_CACHE_DESCRIPTORS(Header);
+    for (i = 0; i < Header->DescriptorCount; i++)
+    {
+        if ((Descriptors[i].ExportImage >= Header->ImageCount) ||
+            (Descriptors[i].FirstThunk > Header->ThunkCount) ||
+            (Descriptors[i].ThunkCount > Header->ThunkCount - Descriptors[i].FirstThunk))
+        {
+            goto Invalid;
+        }
+    }
+
+    LdrpImportCache = Header;
+    return;
+
+Invalid:
+    DPRINT1("LDR: Ignoring invalid known DLL import cache\n");
+    NtUnmapViewOfSection(NtCurrentProcess(), Header);
+}
+
+static
+BOOLEAN
+LdrpIsCachedImage(IN PLDR_DATA_TABLE_ENTRY LdrEntry,
+                  IN PIMAGE_NT_HEADERS NtHeaders,
+                  IN PLDR_IMPORT_CACHE_IMAGE Image)
+{
+    UNICODE_STRING CachedName, Directory;
+
+    if ((Image->TimeDateStamp != NtHeaders->FileHeader.TimeDateStamp) ||
+        (Image->CheckSum != NtHeaders->OptionalHeader.CheckSum) ||
+        (Image->SizeOfImage != NtHeaders->OptionalHeader.SizeOfImage))
+    {
+        return FALSE;
+    }
+
+    /* Another DLL may well have the same version stamps */
+    RtlInitUnicodeString(&CachedName, Image->BaseDllName);
+    if (!RtlEqualUnicodeString(&LdrEntry->BaseDllName, &CachedName, TRUE)) return FALSE;
+
+    /* And a copy of a known DLL elsewhere isn't the one SMSS looked at */
+    if (LdrEntry->FullDllName.Length != LdrpKnownDllPath.Length + sizeof(WCHAR) + LdrEntry->BaseDllName.Length)
+        return FALSE;
+    Directory.Buffer = LdrEntry->FullDllName.Buffer;
+    Directory.Length = Directory.MaximumLength = LdrpKnownDllPath.Length;
+    if (!RtlEqualUnicodeString(&Directory, &LdrpKnownDllPath, TRUE)) return FALSE;
+
+    return (LdrEntry->FullDllName.Buffer[LdrpKnownDllPath.Length / sizeof(WCHAR)] == L'\\');
+}
+
+static
+PULONG
+LdrpFindCachedImports(IN PLDR_DATA_TABLE_ENTRY ExportLdrEntry,
+                      IN PLDR_DATA_TABLE_ENTRY ImportLdrEntry,
+                      IN PIMAGE_IMPORT_DESCRIPTOR IatEntry,
+                      OUT PULONG ThunkCount)
+{
+    PLDR_IMPORT_CACHE_HEADER Cache = LdrpImportCache;
+    PLDR_IMPORT_CACHE_DESCRIPTOR Descriptor;
+    PIMAGE_NT_HEADERS ImportHeaders, ExportHeaders;
+    ULONG i, j;
+
+    *ThunkCount = 0;
+    if (!Cache) return NULL;
+
+    ImportHeaders = RtlImageNtHeader(ImportLdrEntry->DllBase);
+    ExportHeaders = RtlImageNtHeader(ExportLdrEntry->DllBase);
+    if (!(ImportHeaders) || !(ExportHeaders)) return NULL;
+
+    /* The results are only good for the exact images SMSS resolved them for */
+    for (i = 0; i < Cache->ImageCount; i++)
+    {
+        if (!LdrpIsCachedImage(ImportLdrEntry, ImportHeaders, &Cache->Images[i])) continue;
+
+        Descriptor = &LDR_IMPORT_CACHE_DESCRIPTORS(Cache)[Cache->Images[i].FirstDescriptor];
+        for (j = 0; j < Cache->Images[i].DescriptorCount; j++, Descriptor++)
+        {
+            if (Descriptor->FirstThunkRva != IatEntry->FirstThunk) continue;
+
+            /* SxS or the search path may have given us another exporter */
+            if (!LdrpIsCachedImage(ExportLdrEntry, ExportHeaders, &Cache->Images[Descriptor->ExportImage]))
+                return NULL;
+
+            *ThunkCount = Descriptor->ThunkCount;
+            return &LDR_IMPORT_CACHE_THUNKS(Cache)[Descriptor->FirstThunk];
+        }
+
+        return NULL;
+    }
+
+    return NULL;
+}
+
 NTSTATUS
 NTAPI
 LdrpSnapIAT(IN PLDR_DATA_TABLE_ENTRY ExportLdrEntry,
@@ -47,6 +219,8 @@ LdrpSnapIAT(IN PLDR_DATA_TABLE_ENTRY ExportLdrEntry,
     PIMAGE_EXPORT_DIRECTORY ExportDirectory;
     LPSTR ImportName;
     ULONG ForwarderChain, i, Rva, OldProtect, IatSize, ExportSize;
+    PULONG CachedThunks;
+    ULONG CachedCount, ThunkIndex;
     SIZE_T ImportSize;
     DPRINT("LdrpSnapIAT(%wZ %wZ %p %u)\n", &ExportLdrEntry->BaseDllName, &ImportLdrEntry->BaseDllName, IatEntry, EntriesValid);
 
@@ -222,9 +396,25 @@ LdrpSnapIAT(IN PLDR_DATA_TABLE_ENTRY ExportLdrEntry,
         ImportName = (LPSTR)((ULONG_PTR)ImportLdrEntry->DllBase +
                              IatEntry->Name);
 
+        /* Check if SMSS already resolved these imports for us */
+        CachedThunks = (OriginalThunk != FirstThunk) ?
+                       LdrpFindCachedImports(ExportLdrEntry, ImportLdrEntry, IatEntry, &CachedCount) :
+                       NULL;
+        ThunkIndex = 0;
+
         /* Loop while it's valid */
         while (OriginalThunk->u1.AddressOfData)
         {
+            /* Take the cached export, unless it has to be snapped the long way */
+            if ((CachedThunks) && (ThunkIndex < CachedCount) && (CachedThunks[ThunkIndex]))
+            {
+                FirstThunk->u1.Function = (ULONG_PTR)ExportLdrEntry->DllBase + CachedThunks[ThunkIndex];
+                OriginalThunk++;
+                FirstThunk++;
+                ThunkIndex++;
+                continue;
+            }
+
             /* Snap the Thunk */
             _SEH2_TRY
             {
@@ -240,6 +430,7 @@ LdrpSnapIAT(IN PLDR_DATA_TABLE_ENTRY ExportLdrEntry,
                 /* Next thunks */
                 OriginalThunk++;
                 FirstThunk++;
+                ThunkIndex++;
             } _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
             {
                 /* Fail with the SEH error */
@@ -676,6 +867,140 @@ LdrpNameToOrdinal(IN LPSTR ImportName,
     return OrdinalTable[Next];
 }
 
+static
+ULONG
+LdrpHashExportName(IN LPSTR Name)
+{
+    ULONG Hash = 2166136261UL;
+
+    /* FNV-1a, export names are case sensitive */
+    while (*Name) Hash = (Hash ^ (UCHAR)*Name++) * 16777619UL;
+
+    return Hash;
+}
+
+static
+VOID
+LdrpBuildExportCache(IN PLDRP_EXPORT_CACHE Cache,
+                     IN ULONG NumberOfNames,
+                     IN PVOID ExportBase,
+                     IN PULONG NameTable)
+{
+    ULONG Size, i, j;
+
+    /* Keep the table at most half full */
+    for (Size = 2 * LDRP_EXPORT_CACHE_MIN_NAMES; Size < 2 * NumberOfNames; Size <<= 1);
+
+    Cache->HashTable = RtlAllocateHeap(RtlGetProcessHeap(),
+                                       HEAP_ZERO_MEMORY,
+                                       Size * sizeof(ULONG));
+    if (!Cache->HashTable) return;
+    Cache->HashMask = Size - 1;
+
+    /* Slots hold the index in the name table plus one, zero is free */
+    for (i = 0; i < NumberOfNames; i++)
+    {
+        j = LdrpHashExportName((PCHAR)((ULONG_PTR)ExportBase + NameTable[i])) & Cache->HashMask;
+        while (Cache->HashTable[j]) j = (j + 1) & Cache->HashMask;
+        Cache->HashTable[j] = i + 1;
+    }
+}
+
+static
+USHORT
+LdrpLookupExportName(IN LPSTR ImportName,
+                     IN ULONG NumberOfNames,
+                     IN PVOID ExportBase,
+                     IN PULONG NameTable,
+                     IN PUSHORT OrdinalTable)
+{
+    PLDRP_EXPORT_CACHE Cache = LdrpLastExportCache;
+    PLIST_ENTRY NextEntry;
+    ULONG i;
+
+    /* Snapping mostly goes exporter by exporter, so check the last one first */
+    if (!(Cache) || (Cache->DllBase != ExportBase))
+    {
+        Cache = NULL;
+        for (NextEntry = LdrpExportCacheList.Flink;
+             NextEntry != &LdrpExportCacheList;
+             NextEntry = NextEntry->Flink)
+        {
+            if (CONTAINING_RECORD(NextEntry, LDRP_EXPORT_CACHE, Links)->DllBase == ExportBase)
+            {
+                Cache = CONTAINING_RECORD(NextEntry, LDRP_EXPORT_CACHE, Links);
+                break;
+            }
+        }
+
+        /* Small export tables are searched quickly enough */
+        if (!(Cache) && (NumberOfNames >= LDRP_EXPORT_CACHE_MIN_NAMES))
+        {
+            Cache = RtlAllocateHeap(RtlGetProcessHeap(),
+                                    HEAP_ZERO_MEMORY,
+                                    sizeof(LDRP_EXPORT_CACHE));
+            if (Cache)
+            {
+                Cache->DllBase = ExportBase;
+                InsertHeadList(&LdrpExportCacheList, &Cache->Links);
+            }
+        }
+
+        if (!Cache) return LdrpNameToOrdinal(ImportName, NumberOfNames, ExportBase, NameTable, OrdinalTable);
+        LdrpLastExportCache = Cache;
+    }
+
+    /* Only pay for the table once the hints have proven to be stale */
+    if (!Cache->HashTable)
+    {
+        if (++Cache->Misses >= LDRP_EXPORT_CACHE_MISSES)
+        {
+            LdrpBuildExportCache(Cache, NumberOfNames, ExportBase, NameTable);
+        }
+
+        if (!Cache->HashTable)
+        {
+            return LdrpNameToOrdinal(ImportName, NumberOfNames, ExportBase, NameTable, OrdinalTable);
+        }
+    }
+
+    for (i = LdrpHashExportName(ImportName) & Cache->HashMask;
+         Cache->HashTable[i];
+         i = (i + 1) & Cache->HashMask)
+    {
+        if (!strcmp(ImportName, (PCHAR)((ULONG_PTR)ExportBase + NameTable[Cache->HashTable[i] - 1])))
+        {
+            return OrdinalTable[Cache->HashTable[i] - 1];
+        }
+    }
+
+    /* Not exported */
+    return -1;
+}
+
+VOID
+NTAPI
+LdrpFreeExportCache(IN PVOID DllBase)
+{
+    PLIST_ENTRY NextEntry;
+    PLDRP_EXPORT_CACHE Cache;
+
+    for (NextEntry = LdrpExportCacheList.Flink;
+         NextEntry != &LdrpExportCacheList;
+         NextEntry = NextEntry->Flink)
+    {
+        Cache = CONTAINING_RECORD(NextEntry, LDRP_EXPORT_CACHE, Links);
+        if (Cache->DllBase != DllBase) continue;
+
+        /* The next image mapped here may well be a different one */
+        RemoveEntryList(&Cache->Links);
+        if (LdrpLastExportCache == Cache) LdrpLastExportCache = NULL;
+        if (Cache->HashTable) RtlFreeHeap(RtlGetProcessHeap(), 0, Cache->HashTable);
+        RtlFreeHeap(RtlGetProcessHeap(), 0, Cache);
+        break;
+    }
+}
+
 NTSTATUS
 NTAPI
 LdrpWalkImportDescriptor(IN LPWSTR DllPath OPTIONAL,
@@ -761,6 +1086,9 @@ LdrpWalkImportDescriptor(IN LPWSTR DllPath OPTIONAL,
     /* Check if we got at least one */
     if ((BoundEntry) || (ImportEntry))
     {
+        /* Let the loader workers map the dependencies while we walk them */
+        LdrpQueueImportMapping(DllPath, LdrEntry, BoundEntry, ImportEntry);
+
         /* Do we have a Bound IAT */
         if (BoundEntry)
         {
@@ -777,6 +1105,9 @@ LdrpWalkImportDescriptor(IN LPWSTR DllPath OPTIONAL,
                                                           ImportEntry);
         }
 
+        /* Drop anything that was mapped for us but not used */
+        LdrpFlushMappedDlls(LdrEntry);
+
         /* Check the status of the handlers */
         if (NT_SUCCESS(Status))
         {
@@ -1035,7 +1366,7 @@ LdrpSnapThunk(IN PVOID ExportBase,
         else
         {
             /* Well bummer, hint didn't work, do it the long way */
-            Ordinal = LdrpNameToOrdinal(ImportName,
+            Ordinal = LdrpLookupExportName(ImportName,
                                         ExportEntry->NumberOfNames,
                                         ExportBase,
                                         NameTable,
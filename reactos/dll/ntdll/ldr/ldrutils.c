@@ -1027,6 +1027,8 @@ LdrpMapDll(IN PWSTR SearchPath OPTIONAL,
     UNICODE_STRING IllegalDll;
     PVOID RelocData;
     ULONG RelocDataSize = 0;
+    PLDRP_MAP_WORK MapWork;
+    BOOLEAN Relocated = FALSE;
 
     // FIXME: AppCompat stuff is missing
 
@@ -1037,6 +1039,32 @@ LdrpMapDll(IN PWSTR SearchPath OPTIONAL,
                 SearchPath ? SearchPath : L"");
     }
 
+    /* Check if a loader worker already mapped this import for us */
+    if ((Static) && !(DllCharacteristics))
+    {
+        MapWork = LdrpGetMappedDll(SearchPath, DllName);
+        if (MapWork)
+        {
+            /* Take over everything it did */
+            FullDllName = MapWork->FullDllName;
+            BaseDllName = MapWork->BaseDllName;
+            SectionHandle = MapWork->SectionHandle;
+            ViewBase = MapWork->ViewBase;
+            ViewSize = MapWork->ViewSize;
+            Status = MapWork->Status;
+            KnownDll = MapWork->KnownDll;
+            Relocated = MapWork->Relocated;
+            RtlFreeHeap(RtlGetProcessHeap(), 0, MapWork);
+
+            if (ShowSnaps)
+            {
+                DPRINT1("LDR: Loading (STATIC, PARALLEL) %wZ\n", &FullDllName);
+            }
+
+            goto Mapped;
+        }
+    }
+
     /* Check if we have a known dll directory */
     if (LdrpKnownDllObjectDirectory)
     {
@@ -1186,6 +1214,7 @@ SkipCheck:
         return Status;
     }
 
+Mapped:
     /* Get the NT Header */
     if (!(NtHeaders = RtlImageNtHeader(ViewBase)))
     {
@@ -1409,6 +1438,13 @@ SkipCheck:
                 goto FailRelocate;
             }
 
+            /* Check if a loader worker already applied the fixups */
+            if (Relocated)
+            {
+                Status = STATUS_SUCCESS;
+                goto FailRelocate;
+            }
+
             /* Change the protection to prepare for relocation */
             Status = LdrpSetProtection(ViewBase, FALSE);
 
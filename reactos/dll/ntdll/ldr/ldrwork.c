@@ -0,0 +1,747 @@
+/*
+ * COPYRIGHT:       See COPYING in the top level directory
+ * PROJECT:         ReactOS NT User-Mode Library
+ * FILE:            dll/ntdll/ldr/ldrwork.c
+ * PURPOSE:         Loader worker threads for parallel mapping of imports
+ * PROGRAMMERS:     ReactOS Portable Systems Group
+ */
+
+/* INCLUDES *****************************************************************/
+
+#include <ntdll.h>
+
+#define NDEBUG
+#include <debug.h>
+
+/* GLOBALS *******************************************************************/
+
+#define LDRP_MAX_WORKER_THREADS 16
+
+typedef enum _LDRP_MAP_WORK_STATE
+{
+    LdrpMapWorkQueued,
+    LdrpMapWorkRunning,
+    LdrpMapWorkDone
+} LDRP_MAP_WORK_STATE;
+
+ULONG LdrpMaxLoaderThreads = LDRP_DEFAULT_LOADER_THREADS;
+
+RTL_CRITICAL_SECTION LdrpWorkQueueLock;
+LIST_ENTRY LdrpWorkQueue;
+LIST_ENTRY LdrpMappedDllList;
+HANDLE LdrpWorkSemaphore;
+HANDLE LdrpWorkCompleteEvent;
+HANDLE LdrpWorkerThreadIds[LDRP_MAX_WORKER_THREADS];
+ULONG LdrpWorkerThreadCount;
+
+/* FUNCTIONS *****************************************************************/
+
+static
+VOID
+LdrpDiscardMapWork(IN PLDRP_MAP_WORK Work)
+{
+    /* Release whatever the worker managed to set up */
+    if (Work->ViewBase) NtUnmapViewOfSection(NtCurrentProcess(), Work->ViewBase);
+    if (Work->SectionHandle) NtClose(Work->SectionHandle);
+    if (Work->FullDllName.Buffer) RtlFreeHeap(RtlGetProcessHeap(), 0, Work->FullDllName.Buffer);
+    if (Work->BaseDllName.Buffer) RtlFreeHeap(RtlGetProcessHeap(), 0, Work->BaseDllName.Buffer);
+
+    RtlFreeHeap(RtlGetProcessHeap(), 0, Work);
+}
+
+static
+NTSTATUS
+LdrpOpenDllSection(IN PUNICODE_STRING NtPathDllName,
+                   OUT PHANDLE SectionHandle)
+{
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    IO_STATUS_BLOCK IoStatusBlock;
+    HANDLE FileHandle;
+    NTSTATUS Status;
+
+    /*
+     * Same as LdrpCreateDllSection, minus the hard errors. If anything goes
+     * wrong the serial path will redo the work and report it properly.
+     */
+    InitializeObjectAttributes(&ObjectAttributes,
+                               NtPathDllName,
+                               OBJ_CASE_INSENSITIVE,
+                               NULL,
+                               NULL);
+
+    Status = NtOpenFile(&FileHandle,
+                        SYNCHRONIZE | FILE_EXECUTE | FILE_READ_DATA,
+                        &ObjectAttributes,
+                        &IoStatusBlock,
+                        FILE_SHARE_READ | FILE_SHARE_DELETE,
+                        FILE_NON_DIRECTORY_FILE | FILE_SYNCHRONOUS_IO_NONALERT);
+    if (!NT_SUCCESS(Status))
+    {
+        Status = NtOpenFile(&FileHandle,
+                            SYNCHRONIZE | FILE_EXECUTE,
+                            &ObjectAttributes,
+                            &IoStatusBlock,
+                            FILE_SHARE_READ | FILE_SHARE_DELETE,
+                            FILE_NON_DIRECTORY_FILE | FILE_SYNCHRONOUS_IO_NONALERT);
+        if (!NT_SUCCESS(Status)) return Status;
+    }
+
+    Status = NtCreateSection(SectionHandle,
+                             SECTION_MAP_READ | SECTION_MAP_EXECUTE |
+                             SECTION_MAP_WRITE | SECTION_QUERY,
+                             NULL,
+                             NULL,
+                             PAGE_EXECUTE,
+                             SEC_IMAGE,
+                             FileHandle);
+    if (!NT_SUCCESS(Status)) *SectionHandle = NULL;
+
+    NtClose(FileHandle);
+    return Status;
+}
+
+static
+VOID
+LdrpProcessMapWork(IN PLDRP_MAP_WORK Work)
+{
+    RTL_CALLER_ALLOCATED_ACTIVATION_CONTEXT_STACK_FRAME_EXTENDED ActCtx;
+    PTEB Teb = NtCurrentTeb();
+    UNICODE_STRING NtPathDllName;
+    PIMAGE_NT_HEADERS NtHeaders;
+    PVOID ArbitraryUserPointer, RelocData;
+    ULONG RelocDataSize = 0;
+    BOOLEAN Found;
+    NTSTATUS Status;
+
+    /* Known DLLs already come with a section */
+    if (!Work->KnownDll)
+    {
+        /* Search for the DLL in the activation context of the importing module */
+        RtlZeroMemory(&ActCtx, sizeof(ActCtx));
+        ActCtx.Size = sizeof(ActCtx);
+        ActCtx.Format = RTL_CALLER_ALLOCATED_ACTIVATION_CONTEXT_STACK_FRAME_FORMAT_WHISTLER;
+        RtlActivateActivationContextUnsafeFast(&ActCtx, Work->ActivationContext);
+
+        Found = LdrpResolveDllName(Work->DllPath,
+                                   Work->DllName.Buffer,
+                                   &Work->FullDllName,
+                                   &Work->BaseDllName);
+
+        RtlDeactivateActivationContextUnsafeFast(&ActCtx);
+
+        if (!Found)
+        {
+            /* The resolver doesn't always clean up after itself */
+            RtlZeroMemory(&Work->FullDllName, sizeof(UNICODE_STRING));
+            RtlZeroMemory(&Work->BaseDllName, sizeof(UNICODE_STRING));
+            Work->Status = STATUS_DLL_NOT_FOUND;
+            return;
+        }
+
+        if (!RtlDosPathNameToNtPathName_U(Work->FullDllName.Buffer,
+                                          &NtPathDllName,
+                                          NULL,
+                                          NULL))
+        {
+            Work->Status = STATUS_OBJECT_PATH_SYNTAX_BAD;
+            return;
+        }
+
+        Status = LdrpOpenDllSection(&NtPathDllName, &Work->SectionHandle);
+        RtlFreeHeap(RtlGetProcessHeap(), 0, NtPathDllName.Buffer);
+        if (!NT_SUCCESS(Status))
+        {
+            Work->Status = Status;
+            return;
+        }
+    }
+
+    /* Stuff the image name in the TIB, for the debugger */
+    ArbitraryUserPointer = Teb->NtTib.ArbitraryUserPointer;
+    Teb->NtTib.ArbitraryUserPointer = Work->FullDllName.Buffer;
+
+    Status = NtMapViewOfSection(Work->SectionHandle,
+                                NtCurrentProcess(),
+                                &Work->ViewBase,
+                                0,
+                                0,
+                                NULL,
+                                &Work->ViewSize,
+                                ViewShare,
+                                0,
+                                PAGE_READWRITE);
+
+    Teb->NtTib.ArbitraryUserPointer = ArbitraryUserPointer;
+
+    Work->Status = Status;
+    if (!NT_SUCCESS(Status))
+    {
+        Work->ViewBase = NULL;
+        return;
+    }
+
+    /*
+     * Apply the fixups now if the DLL didn't get its preferred base. Known
+     * DLLs and anything unusual are left to LdrpMapDll, which knows how to
+     * complain about them.
+     */
+    if ((Status != STATUS_IMAGE_NOT_AT_BASE) || (Work->KnownDll)) return;
+
+    NtHeaders = RtlImageNtHeader(Work->ViewBase);
+    if (!(NtHeaders) ||
+        !(NtHeaders->FileHeader.Characteristics & IMAGE_FILE_DLL) ||
+        (NtHeaders->FileHeader.Characteristics & IMAGE_FILE_RELOCS_STRIPPED))
+    {
+        return;
+    }
+
+    RelocData = RtlImageDirectoryEntryToData(Work->ViewBase,
+                                             TRUE,
+                                             IMAGE_DIRECTORY_ENTRY_BASERELOC,
+                                             &RelocDataSize);
+    if (!(RelocData) || !(RelocDataSize)) return;
+
+    Status = LdrpSetProtection(Work->ViewBase, FALSE);
+    if (!NT_SUCCESS(Status)) return;
+
+    Status = LdrRelocateImageWithBias(Work->ViewBase, 0LL, NULL, STATUS_SUCCESS,
+        STATUS_CONFLICTING_ADDRESSES, STATUS_INVALID_IMAGE_FORMAT);
+    if (NT_SUCCESS(Status)) Status = LdrpSetProtection(Work->ViewBase, TRUE);
+
+    /* A half relocated view is of no use to anybody */
+    if (NT_SUCCESS(Status))
+        Work->Relocated = TRUE;
+    else
+        Work->Status = Status;
+}
+
+static
+ULONG
+NTAPI
+LdrpWorkerThread(IN PVOID Parameter)
+{
+    PLDRP_MAP_WORK Work;
+    LARGE_INTEGER Timeout;
+    NTSTATUS Status;
+    ULONG i;
+
+    UNREFERENCED_PARAMETER(Parameter);
+
+    /* We skipped LdrpInitializeThread, so set up what we need ourselves */
+    RtlAllocateActivationContextStack(&NtCurrentTeb()->ActivationContextStackPointer);
+
+    /* Go away after 30 seconds without work */
+    Timeout.QuadPart = Int32x32To64(30000, -10000);
+
+    for (;;)
+    {
+        Status = NtWaitForSingleObject(LdrpWorkSemaphore, FALSE, &Timeout);
+
+        RtlEnterCriticalSection(&LdrpWorkQueueLock);
+
+        if (IsListEmpty(&LdrpWorkQueue))
+        {
+            /* Either we timed out or the work was taken back by the loader */
+            if (Status != STATUS_TIMEOUT)
+            {
+                RtlLeaveCriticalSection(&LdrpWorkQueueLock);
+                continue;
+            }
+
+            for (i = 0; i < LDRP_MAX_WORKER_THREADS; i++)
+            {
+                if (LdrpWorkerThreadIds[i] == NtCurrentTeb()->ClientId.UniqueThread)
+                {
+                    LdrpWorkerThreadIds[i] = NULL;
+                    break;
+                }
+            }
+            LdrpWorkerThreadCount--;
+
+            RtlLeaveCriticalSection(&LdrpWorkQueueLock);
+            break;
+        }
+
+        Work = CONTAINING_RECORD(RemoveHeadList(&LdrpWorkQueue),
+                                 LDRP_MAP_WORK,
+                                 WorkLinks);
+        Work->State = LdrpMapWorkRunning;
+
+        RtlLeaveCriticalSection(&LdrpWorkQueueLock);
+
+        LdrpProcessMapWork(Work);
+
+        RtlEnterCriticalSection(&LdrpWorkQueueLock);
+        Work->State = LdrpMapWorkDone;
+        RtlLeaveCriticalSection(&LdrpWorkQueueLock);
+
+        /* Wake up the loader in case it is waiting for this one */
+        NtSetEvent(LdrpWorkCompleteEvent, NULL);
+    }
+
+    RtlFreeActivationContextStack(NtCurrentTeb()->ActivationContextStackPointer);
+    NtCurrentTeb()->ActivationContextStackPointer = NULL;
+
+    /* Don't use RtlExitUserThread, DLLs never heard of us */
+    NtCurrentTeb()->FreeStackOnTermination = TRUE;
+    NtTerminateThread(NtCurrentThread(), STATUS_SUCCESS);
+    return 0;
+}
+
+static
+VOID
+LdrpStartWorkerThreads(IN ULONG Count)
+{
+    HANDLE ThreadHandle;
+    CLIENT_ID ClientId;
+    NTSTATUS Status;
+    ULONG i;
+
+    /* Must be called with the work queue lock held */
+    for (i = 0; (i < LDRP_MAX_WORKER_THREADS) && (Count); i++)
+    {
+        if (LdrpWorkerThreadCount >= min(LdrpMaxLoaderThreads, LDRP_MAX_WORKER_THREADS)) break;
+        if (LdrpWorkerThreadIds[i]) continue;
+
+        /* Create it suspended so that it can recognize itself in LdrpInit */
+        Status = RtlCreateUserThread(NtCurrentProcess(),
+                                     NULL,
+                                     TRUE,
+                                     0,
+                                     0,
+                                     0,
+                                     LdrpWorkerThread,
+                                     NULL,
+                                     &ThreadHandle,
+                                     &ClientId);
+        if (!NT_SUCCESS(Status))
+        {
+            /* Not fatal, the loader will do the work itself */
+            DPRINT1("LDR: Failed to create a loader worker thread: 0x%08lx\n", Status);
+            break;
+        }
+
+        LdrpWorkerThreadIds[i] = ClientId.UniqueThread;
+        LdrpWorkerThreadCount++;
+        Count--;
+
+        NtResumeThread(ThreadHandle, NULL);
+        NtClose(ThreadHandle);
+    }
+}
+
+static
+PLDRP_MAP_WORK
+LdrpFindMapWork(IN PWSTR DllPath OPTIONAL,
+                IN PUNICODE_STRING DllName)
+{
+    PLIST_ENTRY ListHead, NextEntry;
+    PLDRP_MAP_WORK Work;
+
+    /* Must be called with the work queue lock held */
+    ListHead = &LdrpMappedDllList;
+    for (NextEntry = ListHead->Flink; NextEntry != ListHead; NextEntry = NextEntry->Flink)
+    {
+        Work = CONTAINING_RECORD(NextEntry, LDRP_MAP_WORK, MappedLinks);
+
+        if ((Work->DllPath == DllPath) &&
+            RtlEqualUnicodeString(&Work->DllName, DllName, TRUE))
+        {
+            return Work;
+        }
+    }
+
+    return NULL;
+}
+
+static
+PLDRP_MAP_WORK
+LdrpAllocateMapWork(IN PWSTR DllPath OPTIONAL,
+                    IN PLDR_DATA_TABLE_ENTRY LdrEntry,
+                    IN LPSTR ImportName)
+{
+    ANSI_STRING AnsiString;
+    UNICODE_STRING ImportNameU;
+    PLDRP_MAP_WORK Work;
+    PWCHAR p;
+    USHORT MaximumLength;
+    BOOLEAN GotExtension = FALSE;
+    NTSTATUS Status;
+
+    RtlInitAnsiString(&AnsiString, ImportName);
+    Status = RtlAnsiStringToUnicodeString(&ImportNameU, &AnsiString, TRUE);
+    if (!NT_SUCCESS(Status)) return NULL;
+
+    /* Find the extension, if present, the same way LdrpLoadImportModule does */
+    p = ImportNameU.Buffer + ImportNameU.Length / sizeof(WCHAR);
+    while (p-- > ImportNameU.Buffer)
+    {
+        if (*p == L'.')
+        {
+            GotExtension = TRUE;
+            break;
+        }
+        if (*p == L'\\') break;
+    }
+
+    MaximumLength = ImportNameU.Length + sizeof(UNICODE_NULL);
+    if (!GotExtension) MaximumLength += LdrApiDefaultExtension.Length;
+
+    /* Name lives right after the work item */
+    Work = RtlAllocateHeap(RtlGetProcessHeap(),
+                           HEAP_ZERO_MEMORY,
+                           sizeof(LDRP_MAP_WORK) + MaximumLength);
+    if (Work)
+    {
+        Work->DllPath = DllPath;
+        Work->Owner = LdrEntry;
+        Work->ActivationContext = LdrEntry->EntryPointActivationContext;
+        Work->DllName.Buffer = (PWSTR)(Work + 1);
+        Work->DllName.MaximumLength = MaximumLength;
+
+        RtlCopyUnicodeString(&Work->DllName, &ImportNameU);
+        if (!GotExtension) RtlAppendUnicodeStringToString(&Work->DllName, &LdrApiDefaultExtension);
+    }
+
+    RtlFreeUnicodeString(&ImportNameU);
+    return Work;
+}
+
+static
+VOID
+LdrpPrepareMapWork(IN PWSTR DllPath OPTIONAL,
+                   IN PLDR_DATA_TABLE_ENTRY LdrEntry,
+                   IN LPSTR ImportName,
+                   IN OUT PLIST_ENTRY WorkList,
+                   IN OUT PULONG WorkCount)
+{
+    PLDR_DATA_TABLE_ENTRY ImportEntry;
+    PLIST_ENTRY NextEntry;
+    PLDRP_MAP_WORK Work;
+    PWCHAR p;
+    NTSTATUS Status;
+
+    Work = LdrpAllocateMapWork(DllPath, LdrEntry, ImportName);
+    if (!Work) return;
+
+    /* Nothing to do if it's already loaded */
+    if (LdrpCheckForLoadedDll(DllPath, &Work->DllName, TRUE, FALSE, &ImportEntry))
+        goto Skip;
+
+    /*
+     * Leave SxS redirected imports to LdrpLoadImportModule. The owner's
+     * activation context is active while we're called, so this sees the
+     * same redirection LdrpMapDll would, and the plain name we key the
+     * work on would never be asked for.
+     */
+    Status = RtlFindActivationContextSectionString(0,
+                                                   NULL,
+                                                   ACTIVATION_CONTEXT_SECTION_DLL_REDIRECTION,
+                                                   &Work->DllName,
+                                                   NULL);
+    if ((Status != STATUS_SXS_SECTION_NOT_FOUND) &&
+        (Status != STATUS_SXS_KEY_NOT_FOUND))
+    {
+        goto Skip;
+    }
+
+    /* Or if somebody already queued it */
+    for (NextEntry = WorkList->Flink; NextEntry != WorkList; NextEntry = NextEntry->Flink)
+    {
+        if (RtlEqualUnicodeString(&CONTAINING_RECORD(NextEntry, LDRP_MAP_WORK, MappedLinks)->DllName,
+                                  &Work->DllName,
+                                  TRUE))
+        {
+            goto Skip;
+        }
+    }
+
+    RtlEnterCriticalSection(&LdrpWorkQueueLock);
+    if (LdrpFindMapWork(DllPath, &Work->DllName))
+    {
+        RtlLeaveCriticalSection(&LdrpWorkQueueLock);
+        goto Skip;
+    }
+    RtlLeaveCriticalSection(&LdrpWorkQueueLock);
+
+    /* Known DLLs must be taken from the known DLL directory, just like LdrpMapDll does */
+    if (LdrpKnownDllObjectDirectory)
+    {
+        for (p = Work->DllName.Buffer; *p; p++)
+        {
+            if ((*p == L'\\') || (*p == L'/')) break;
+        }
+
+        if (!*p)
+        {
+            Status = LdrpCheckForKnownDll(Work->DllName.Buffer,
+                                          &Work->FullDllName,
+                                          &Work->BaseDllName,
+                                          &Work->SectionHandle);
+            if (!NT_SUCCESS(Status))
+            {
+                /* Let LdrpMapDll deal with it */
+                RtlZeroMemory(&Work->FullDllName, sizeof(UNICODE_STRING));
+                RtlZeroMemory(&Work->BaseDllName, sizeof(UNICODE_STRING));
+                goto Skip;
+            }
+
+            if (Work->SectionHandle)
+            {
+                Work->KnownDll = TRUE;
+            }
+            else
+            {
+                /* Not a known DLL, the names were freed */
+                RtlZeroMemory(&Work->FullDllName, sizeof(UNICODE_STRING));
+                RtlZeroMemory(&Work->BaseDllName, sizeof(UNICODE_STRING));
+            }
+        }
+    }
+
+    InsertTailList(WorkList, &Work->MappedLinks);
+    (*WorkCount)++;
+    return;
+
+Skip:
+    LdrpDiscardMapWork(Work);
+}
+
+VOID
+NTAPI
+LdrpQueueImportMapping(IN PWSTR DllPath OPTIONAL,
+                       IN PLDR_DATA_TABLE_ENTRY LdrEntry,
+                       IN PIMAGE_BOUND_IMPORT_DESCRIPTOR BoundEntry OPTIONAL,
+                       IN PIMAGE_IMPORT_DESCRIPTOR ImportEntry OPTIONAL)
+{
+    PIMAGE_BOUND_IMPORT_DESCRIPTOR FirstEntry = BoundEntry;
+    LIST_ENTRY WorkList;
+    PLDRP_MAP_WORK Work;
+    ULONG WorkCount = 0;
+    NTSTATUS Status;
+
+    /* Check the Loader Lock */
+    LdrpEnsureLoaderLockIsHeld();
+
+    if (!(LdrpMaxLoaderThreads) || (LdrpShutdownInProgress)) return;
+
+    InitializeListHead(&WorkList);
+
+    /* Collect the direct dependencies that still have to be mapped */
+    if (BoundEntry)
+    {
+        while (BoundEntry->OffsetModuleName)
+        {
+            LdrpPrepareMapWork(DllPath,
+                               LdrEntry,
+                               (LPSTR)FirstEntry + BoundEntry->OffsetModuleName,
+                               &WorkList,
+                               &WorkCount);
+
+            /* Skip over the forwarder references too */
+            BoundEntry = (PIMAGE_BOUND_IMPORT_DESCRIPTOR)
+                ((PIMAGE_BOUND_FORWARDER_REF)(BoundEntry + 1) +
+                 BoundEntry->NumberOfModuleForwarderRefs);
+        }
+    }
+    else if (ImportEntry)
+    {
+        while ((ImportEntry->Name) && (ImportEntry->FirstThunk))
+        {
+            LdrpPrepareMapWork(DllPath,
+                               LdrEntry,
+                               (LPSTR)((ULONG_PTR)LdrEntry->DllBase + ImportEntry->Name),
+                               &WorkList,
+                               &WorkCount);
+            ImportEntry++;
+        }
+    }
+
+    /* A single dependency has nothing to overlap with */
+    if (WorkCount < 2)
+    {
+        while (!IsListEmpty(&WorkList))
+        {
+            LdrpDiscardMapWork(CONTAINING_RECORD(RemoveHeadList(&WorkList),
+                                                 LDRP_MAP_WORK,
+                                                 MappedLinks));
+        }
+        return;
+    }
+
+    /* Create the synchronization objects the first time around */
+    if (!LdrpWorkSemaphore)
+    {
+        Status = NtCreateSemaphore(&LdrpWorkSemaphore,
+                                   SEMAPHORE_ALL_ACCESS,
+                                   NULL,
+                                   0,
+                                   MAXLONG);
+        if (NT_SUCCESS(Status))
+        {
+            Status = NtCreateEvent(&LdrpWorkCompleteEvent,
+                                   EVENT_ALL_ACCESS,
+                                   NULL,
+                                   SynchronizationEvent,
+                                   FALSE);
+            if (!NT_SUCCESS(Status))
+            {
+                NtClose(LdrpWorkSemaphore);
+                LdrpWorkSemaphore = NULL;
+            }
+        }
+
+        if (!NT_SUCCESS(Status))
+        {
+            /* Fall back to loading everything serially */
+            LdrpMaxLoaderThreads = 0;
+            while (!IsListEmpty(&WorkList))
+            {
+                LdrpDiscardMapWork(CONTAINING_RECORD(RemoveHeadList(&WorkList),
+                                                     LDRP_MAP_WORK,
+                                                     MappedLinks));
+            }
+            return;
+        }
+    }
+
+    if (ShowSnaps)
+    {
+        DPRINT1("LDR: Mapping %lu imports of %wZ in parallel\n",
+                WorkCount,
+                &LdrEntry->BaseDllName);
+    }
+
+    /* Hand the work over to the workers */
+    RtlEnterCriticalSection(&LdrpWorkQueueLock);
+    while (!IsListEmpty(&WorkList))
+    {
+        Work = CONTAINING_RECORD(RemoveHeadList(&WorkList), LDRP_MAP_WORK, MappedLinks);
+        Work->State = LdrpMapWorkQueued;
+        InsertTailList(&LdrpMappedDllList, &Work->MappedLinks);
+        InsertTailList(&LdrpWorkQueue, &Work->WorkLinks);
+    }
+    LdrpStartWorkerThreads(WorkCount);
+    RtlLeaveCriticalSection(&LdrpWorkQueueLock);
+
+    NtReleaseSemaphore(LdrpWorkSemaphore, WorkCount, NULL);
+}
+
+static
+PLDRP_MAP_WORK
+LdrpTakeMapWork(IN PLDRP_MAP_WORK Work)
+{
+    /* Must be called with the work queue lock held, which it may drop */
+    if (Work->State == LdrpMapWorkQueued)
+    {
+        /* Nobody picked it up yet, so we're better off doing it ourselves */
+        RemoveEntryList(&Work->WorkLinks);
+        RemoveEntryList(&Work->MappedLinks);
+        return NULL;
+    }
+
+    /* Somebody is working on it, that's at least as fast as starting over */
+    while (Work->State == LdrpMapWorkRunning)
+    {
+        RtlLeaveCriticalSection(&LdrpWorkQueueLock);
+        NtWaitForSingleObject(LdrpWorkCompleteEvent, FALSE, NULL);
+        RtlEnterCriticalSection(&LdrpWorkQueueLock);
+    }
+
+    RemoveEntryList(&Work->MappedLinks);
+    return Work;
+}
+
+PLDRP_MAP_WORK
+NTAPI
+LdrpGetMappedDll(IN PWSTR DllPath OPTIONAL,
+                 IN PWSTR DllName)
+{
+    UNICODE_STRING DllNameU;
+    PLDRP_MAP_WORK Work, Result;
+
+    /* Check the Loader Lock */
+    LdrpEnsureLoaderLockIsHeld();
+
+    if (!LdrpWorkSemaphore) return NULL;
+
+    RtlInitUnicodeString(&DllNameU, DllName);
+
+    RtlEnterCriticalSection(&LdrpWorkQueueLock);
+    Work = LdrpFindMapWork(DllPath, &DllNameU);
+    Result = Work ? LdrpTakeMapWork(Work) : NULL;
+    RtlLeaveCriticalSection(&LdrpWorkQueueLock);
+
+    if (!Work) return NULL;
+
+    /* Only hand out views that LdrpMapDll can continue with */
+    if (!(Result) || !NT_SUCCESS(Result->Status))
+    {
+        LdrpDiscardMapWork(Work);
+        return NULL;
+    }
+
+    return Result;
+}
+
+VOID
+NTAPI
+LdrpFlushMappedDlls(IN PLDR_DATA_TABLE_ENTRY LdrEntry)
+{
+    PLIST_ENTRY NextEntry;
+    PLDRP_MAP_WORK Work;
+    LIST_ENTRY DiscardList;
+
+    if (!LdrpWorkSemaphore) return;
+
+    InitializeListHead(&DiscardList);
+
+    /* Take back whatever the import walk of this entry didn't use */
+    RtlEnterCriticalSection(&LdrpWorkQueueLock);
+    NextEntry = LdrpMappedDllList.Flink;
+    while (NextEntry != &LdrpMappedDllList)
+    {
+        Work = CONTAINING_RECORD(NextEntry, LDRP_MAP_WORK, MappedLinks);
+        NextEntry = NextEntry->Flink;
+
+        if (Work->Owner != LdrEntry) continue;
+
+        /* This may drop the lock, so start over afterwards */
+        LdrpTakeMapWork(Work);
+        InsertTailList(&DiscardList, &Work->MappedLinks);
+        NextEntry = LdrpMappedDllList.Flink;
+    }
+    RtlLeaveCriticalSection(&LdrpWorkQueueLock);
+
+    while (!IsListEmpty(&DiscardList))
+    {
+        LdrpDiscardMapWork(CONTAINING_RECORD(RemoveHeadList(&DiscardList),
+                                             LDRP_MAP_WORK,
+                                             MappedLinks));
+    }
+}
+
+BOOLEAN
+NTAPI
+LdrpIsLoaderWorkerThread(VOID)
+{
+    ULONG i;
+
+    for (i = 0; i < LDRP_MAX_WORKER_THREADS; i++)
+    {
+        if (LdrpWorkerThreadIds[i] == NtCurrentTeb()->ClientId.UniqueThread) return TRUE;
+    }
+
+    return FALSE;
+}
+
+VOID
+NTAPI
+LdrpInitializeWorkQueue(VOID)
+{
+    RtlInitializeCriticalSection(&LdrpWorkQueueLock);
+    InitializeListHead(&LdrpWorkQueue);
+    InitializeListHead(&LdrpMappedDllList);
+}
+
+/* EOF */
@@ -337,6 +337,19 @@ static HRESULT push_instr_uint(compiler_ctx_t *ctx, jsop_t op, unsigned arg)
     return S_OK;
 }
 
+static HRESULT push_instr_uint_uint(compiler_ctx_t *ctx, jsop_t op, unsigned arg1, unsigned arg2)
+{
+    unsigned instr;
+
+    instr = push_instr(ctx, op);
+    if(!instr)
+        return E_OUTOFMEMORY;
+
+    instr_ptr(ctx, instr)->u.arg[0].uint = arg1;
+    instr_ptr(ctx, instr)->u.arg[1].uint = arg2;
+    return S_OK;
+}
+
 static HRESULT compile_binary_expression(compiler_ctx_t *ctx, binary_expression_t *expr, jsop_t op)
 {
     HRESULT hres;
@@ -363,6 +376,11 @@ static HRESULT compile_unary_expression(compiler_ctx_t *ctx, unary_expression_t
     return push_instr(ctx, op) ? S_OK : E_OUTOFMEMORY;
 }
 
+static inline unsigned alloc_prop_cache(compiler_ctx_t *ctx)
+{
+    return ctx->code->prop_cache_cnt++;
+}
+
 /* ECMA-262 3rd Edition    11.2.1 */
 static HRESULT compile_member_expression(compiler_ctx_t *ctx, member_expression_t *expr)
 {
@@ -372,7 +390,7 @@ static HRESULT compile_member_expression(compiler_ctx_t *ctx, member_expression_
     if(FAILED(hres))
         return hres;
 
-    return push_instr_bstr(ctx, OP_member, expr->identifier);
+    return push_instr_bstr_uint(ctx, OP_member, expr->identifier, alloc_prop_cache(ctx));
 }
 
 #define LABEL_FLAG 0x80000000
@@ -465,7 +483,7 @@ static HRESULT compile_memberid_expression(compiler_ctx_t *ctx, expression_t *ex
         if(FAILED(hres))
             return hres;
 
-        hres = push_instr_uint(ctx, OP_memberid, flags);
+        hres = push_instr_uint_uint(ctx, OP_memberid, flags, NO_PROP_CACHE);
         break;
     }
     case EXPR_MEMBER: {
@@ -480,7 +498,8 @@ static HRESULT compile_memberid_expression(compiler_ctx_t *ctx, expression_t *ex
         if(FAILED(hres))
             return hres;
 
-        hres = push_instr_uint(ctx, OP_memberid, flags);
+        /* The name is constant, so the property lookup can be cached. */
+        hres = push_instr_uint_uint(ctx, OP_memberid, flags, alloc_prop_cache(ctx));
         break;
     }
     DEFAULT_UNREACHABLE;
@@ -2231,6 +2250,7 @@ void release_bytecode(bytecode_t *code)
     heap_pool_free(&code->heap);
     heap_free(code->bstr_pool);
     heap_free(code->str_pool);
+    heap_free(code->prop_caches);
     heap_free(code->instrs);
     heap_free(code);
 }
@@ -2484,6 +2504,11 @@ HRESULT compile_script(script_ctx_t *ctx, const WCHAR *code, const WCHAR *args,
     hres = compile_function(&compiler, compiler.parser->source, NULL, from_eval, &compiler.code->global_code);
     heap_pool_free(&compiler.heap);
     parser_release(compiler.parser);
+    if(SUCCEEDED(hres) && compiler.code->prop_cache_cnt) {
+        compiler.code->prop_caches = heap_alloc_zero(compiler.code->prop_cache_cnt * sizeof(*compiler.code->prop_caches));
+        if(!compiler.code->prop_caches)
+            hres = E_OUTOFMEMORY;
+    }
     if(FAILED(hres)) {
         release_bytecode(compiler.code);
         return hres;
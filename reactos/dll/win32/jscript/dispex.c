@@ -875,6 +875,8 @@ jsdisp_t *to_jsdisp(IDispatch *disp)
     return disp->lpVtbl == (IDispatchVtbl*)&DispatchExVtbl ? impl_from_IDispatchEx((IDispatchEx*)disp) : NULL;
 }
 
+static LONG jsdisp_serial;
+
 HRESULT init_dispex(jsdisp_t *dispex, script_ctx_t *ctx, const builtin_info_t *builtin_info, jsdisp_t *prototype)
 {
     TRACE("%p (%p)\n", dispex, prototype);
@@ -902,6 +904,8 @@ HRESULT init_dispex(jsdisp_t *dispex, script_ctx_t *ctx, const builtin_info_t *b
     script_addref(ctx);
     dispex->ctx = ctx;
 
+    dispex->serial = InterlockedIncrement(&jsdisp_serial);
+
     return S_OK;
 }
 
@@ -1033,6 +1037,28 @@ HRESULT jsdisp_get_id(jsdisp_t *jsdisp, const WCHAR *name, DWORD flags, DISPID *
     return DISP_E_UNKNOWNNAME;
 }
 
+HRESULT jsdisp_get_id_cached(jsdisp_t *jsdisp, const WCHAR *name, DWORD flags, property_cache_t *cache, DISPID *id)
+{
+    HRESULT hres;
+
+    /* A deleted property may come back through the prototype or be recreated,
+     * leave that to the full lookup. */
+    if(cache->obj == jsdisp && cache->serial == jsdisp->serial
+       && jsdisp->props[cache->id].type != PROP_DELETED) {
+        *id = cache->id;
+        return S_OK;
+    }
+
+    hres = jsdisp_get_id(jsdisp, name, flags, id);
+    if(SUCCEEDED(hres)) {
+        cache->obj = jsdisp;
+        cache->serial = jsdisp->serial;
+        cache->id = *id;
+    }
+
+    return hres;
+}
+
 HRESULT jsdisp_call_value(jsdisp_t *jsfunc, IDispatch *jsthis, WORD flags, unsigned argc, jsval_t *argv, jsval_t *r)
 {
     HRESULT hres;
@@ -471,6 +471,18 @@ static HRESULT disp_get_id(script_ctx_t *ctx, IDispatch *disp, const WCHAR *name
     return hres;
 }
 
+/* Like disp_get_id, but lookups on our own objects go through a property cache. */
+static HRESULT disp_get_id_cached(script_ctx_t *ctx, IDispatch *disp, const WCHAR *name, BSTR name_bstr, DWORD flags,
+        property_cache_t *cache, DISPID *id)
+{
+    jsdisp_t *jsdisp;
+
+    if(cache && (jsdisp = to_jsdisp(disp)))
+        return jsdisp_get_id_cached(jsdisp, name, flags, cache, id);
+
+    return disp_get_id(ctx, disp, name, name_bstr, flags, id);
+}
+
 static HRESULT disp_cmp(IDispatch *disp1, IDispatch *disp2, BOOL *ret)
 {
     IObjectIdentity *identity;
@@ -733,6 +745,13 @@ static inline double get_op_double(script_ctx_t *ctx)
     return frame->bytecode->instrs[frame->ip].u.dbl;
 }
 
+static inline property_cache_t *get_op_prop_cache(script_ctx_t *ctx, int i)
+{
+    call_frame_t *frame = ctx->call_ctx;
+    unsigned idx = frame->bytecode->instrs[frame->ip].u.arg[i].uint;
+    return idx != NO_PROP_CACHE ? frame->bytecode->prop_caches + idx : NULL;
+}
+
 static inline void jmp_next(script_ctx_t *ctx)
 {
     ctx->call_ctx->ip++;
@@ -1055,6 +1074,7 @@ static HRESULT interp_array(script_ctx_t *ctx)
 static HRESULT interp_member(script_ctx_t *ctx)
 {
     const BSTR arg = get_op_bstr(ctx, 0);
+    property_cache_t *cache = get_op_prop_cache(ctx, 1);
     IDispatch *obj;
     jsval_t v;
     DISPID id;
@@ -1066,7 +1086,7 @@ static HRESULT interp_member(script_ctx_t *ctx)
     if(FAILED(hres))
         return hres;
 
-    hres = disp_get_id(ctx, obj, arg, arg, 0, &id);
+    hres = disp_get_id_cached(ctx, obj, arg, arg, 0, cache, &id);
     if(SUCCEEDED(hres)) {
         hres = disp_propget(ctx, obj, id, &v);
     }else if(hres == DISP_E_UNKNOWNNAME) {
@@ -1084,6 +1104,7 @@ static HRESULT interp_member(script_ctx_t *ctx)
 static HRESULT interp_memberid(script_ctx_t *ctx)
 {
     const unsigned arg = get_op_uint(ctx, 0);
+    property_cache_t *cache = get_op_prop_cache(ctx, 1);
     jsval_t objv, namev;
     const WCHAR *name;
     jsstr_t *name_str;
@@ -1108,7 +1129,7 @@ static HRESULT interp_memberid(script_ctx_t *ctx)
     if(FAILED(hres))
         return hres;
 
-    hres = disp_get_id(ctx, obj, name, NULL, arg, &id);
+    hres = disp_get_id_cached(ctx, obj, name, NULL, arg, cache, &id);
     jsstr_release(name_str);
     if(SUCCEEDED(hres)) {
         ref.type = EXPRVAL_IDREF;
@@ -56,8 +56,8 @@
     X(lshift,     1, 0,0)                  \
     X(lt,         1, 0,0)                  \
     X(lteq,       1, 0,0)                  \
-    X(member,     1, ARG_BSTR,   0)        \
-    X(memberid,   1, ARG_UINT,   0)        \
+    X(member,     1, ARG_BSTR,   ARG_UINT) \
+    X(memberid,   1, ARG_UINT,   ARG_UINT) \
     X(minus,      1, 0,0)                  \
     X(mod,        1, 0,0)                  \
     X(mul,        1, 0,0)                  \
@@ -135,6 +135,9 @@ typedef struct {
     int ref;
 } local_ref_t;
 
+/* Property cache index of member instructions that don't use one */
+#define NO_PROP_CACHE (~0u)
+
 typedef struct _function_code_t {
     BSTR name;
     int local_ref;
@@ -180,6 +183,9 @@ typedef struct _bytecode_t {
     unsigned str_pool_size;
     unsigned str_cnt;
 
+    property_cache_t *prop_caches;
+    unsigned prop_cache_cnt;
+
     struct _bytecode_t *next;
 } bytecode_t;
 
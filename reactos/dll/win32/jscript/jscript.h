@@ -247,8 +247,22 @@ struct jsdisp_t {
     jsdisp_t *prototype;
 
     const builtin_info_t *builtin_info;
+
+    /* unique for the lifetime of the process, see property_cache_t */
+    unsigned serial;
 };
 
+/*
+ * Remembers the property a member instruction found last time. DISPIDs of a
+ * jsdisp_t never change, so the result can be reused as long as the
+ * instruction sees the same object again.
+ */
+typedef struct {
+    jsdisp_t *obj;
+    unsigned serial;
+    DISPID id;
+} property_cache_t;
+
 static inline IDispatch *to_disp(jsdisp_t *jsdisp)
 {
     return (IDispatch*)&jsdisp->IDispatchEx_iface;
@@ -305,6 +319,7 @@ HRESULT jsdisp_propput_idx(jsdisp_t*,DWORD,jsval_t) DECLSPEC_HIDDEN;
 HRESULT jsdisp_propget_name(jsdisp_t*,LPCWSTR,jsval_t*) DECLSPEC_HIDDEN;
 HRESULT jsdisp_get_idx(jsdisp_t*,DWORD,jsval_t*) DECLSPEC_HIDDEN;
 HRESULT jsdisp_get_id(jsdisp_t*,const WCHAR*,DWORD,DISPID*) DECLSPEC_HIDDEN;
+HRESULT jsdisp_get_id_cached(jsdisp_t*,const WCHAR*,DWORD,property_cache_t*,DISPID*) DECLSPEC_HIDDEN;
 HRESULT disp_delete(IDispatch*,DISPID,BOOL*) DECLSPEC_HIDDEN;
 HRESULT disp_delete_name(script_ctx_t*,IDispatch*,jsstr_t*,BOOL*) DECLSPEC_HIDDEN;
 HRESULT jsdisp_delete_idx(jsdisp_t*,DWORD) DECLSPEC_HIDDEN;
@@ -0,0 +1,79 @@
+
+#include "k32_vista.h"
+
+#include <ndk/rtlfuncs.h>
+#include <ndk/iofuncs.h>
+
+/*
+ * @implemented
+ */
+BOOL
+WINAPI
+GetQueuedCompletionStatusEx(IN HANDLE CompletionPort,
+                            OUT LPOVERLAPPED_ENTRY lpCompletionPortEntries,
+                            IN ULONG ulCount,
+                            OUT PULONG ulNumEntriesRemoved,
+                            IN DWORD dwMilliseconds,
+                            IN BOOL fAlertable)
+{
+    NTSTATUS Status;
+    LARGE_INTEGER Time;
+    PLARGE_INTEGER TimePtr;
+
+    /* There must be room for at least one entry */
+    if (!ulCount)
+    {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+
+    /* Convert the timeout */
+    if (dwMilliseconds == INFINITE)
+    {
+        TimePtr = NULL;
+    }
+    else
+    {
+        Time.QuadPart = (LONGLONG)dwMilliseconds * -10000;
+        TimePtr = &Time;
+    }
+
+    /* OVERLAPPED_ENTRY has the layout of FILE_IO_COMPLETION_INFORMATION */
+    Status = NtRemoveIoCompletionEx(CompletionPort,
+                                    (PFILE_IO_COMPLETION_INFORMATION)lpCompletionPortEntries,
+                                    ulCount,
+                                    ulNumEntriesRemoved,
+                                    TimePtr,
+                                    (BOOLEAN)fAlertable);
+    if (!(NT_SUCCESS(Status)) ||
+        (Status == STATUS_TIMEOUT) ||
+        (Status == STATUS_USER_APC) ||
+        (Status == STATUS_ALERTED))
+    {
+        /* Nothing was dequeued */
+        *ulNumEntriesRemoved = 0;
+
+        /* Check what kind of error we got */
+        if (Status == STATUS_TIMEOUT)
+        {
+            /* Timeout error is set directly since there's no conversion */
+            SetLastError(WAIT_TIMEOUT);
+        }
+        else if ((Status == STATUS_USER_APC) || (Status == STATUS_ALERTED))
+        {
+            /* An APC ran or the thread was alerted during the alertable wait */
+            SetLastError(WAIT_IO_COMPLETION);
+        }
+        else
+        {
+            /* Any other error gets converted */
+            SetLastError(RtlNtStatusToDosError(Status));
+        }
+
+        /* This is a failure case */
+        return FALSE;
+    }
+
+    /* Return success */
+    return TRUE;
+}
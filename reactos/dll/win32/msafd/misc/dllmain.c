@@ -30,6 +30,12 @@ HANDLE SockAsyncHelperAfdHandle;
 HANDLE SockAsyncCompletionPort = NULL;
 BOOLEAN SockAsyncSelectCalled;
 
+/* Extension functions handed out through SIO_GET_EXTENSION_FUNCTION_POINTER */
+static const GUID TransmitFileGuid = WSAID_TRANSMITFILE;
+static const GUID AcceptExGuid = WSAID_ACCEPTEX;
+static const GUID GetAcceptExSockaddrsGuid = WSAID_GETACCEPTEXSOCKADDRS;
+static const GUID ConnectExGuid = WSAID_CONNECTEX;
+
 
 
 /*
@@ -2064,6 +2070,299 @@ notify:
 
     return MsafdReturnWithErrno(Status, lpErrno, 0, NULL);
 }
+
+/*
+ * AcceptEx: AFD connects the pre-created accept socket on its own and, if
+ * the caller asked for it, waits for the first data. The buffer receives
+ * that data followed by the local and the remote address, each of them
+ * stored as a ULONG length and the sockaddr.
+ */
+BOOL
+WSPAPI
+WSPAcceptEx(IN SOCKET ListenHandle,
+            IN SOCKET AcceptHandle,
+            IN PVOID lpOutputBuffer,
+            IN DWORD dwReceiveDataLength,
+            IN DWORD dwLocalAddressLength,
+            IN DWORD dwRemoteAddressLength,
+            OUT LPDWORD lpdwBytesReceived,
+            IN LPOVERLAPPED lpOverlapped)
+{
+    PIO_STATUS_BLOCK        IOSB;
+    IO_STATUS_BLOCK         DummyIOSB;
+    AFD_SUPER_ACCEPT_INFO   AcceptInfo;
+    AFD_WSABUF              Buffer;
+    PSOCKET_INFORMATION     Socket;
+    NTSTATUS                Status;
+    HANDLE                  Event;
+    HANDLE                  SockEvent;
+    INT                     Errno;
+
+    TRACE("Called (%lx, %lx)\n", ListenHandle, AcceptHandle);
+
+    /* Get the Socket Structure associate to this Socket*/
+    Socket = GetSocketStructure(ListenHandle);
+    if (!Socket || !GetSocketStructure(AcceptHandle))
+    {
+        WSASetLastError(WSAENOTSOCK);
+        return FALSE;
+    }
+
+    if (!lpOutputBuffer || !lpdwBytesReceived)
+    {
+        WSASetLastError(WSAEFAULT);
+        return FALSE;
+    }
+
+    Status = NtCreateEvent(&SockEvent,
+                           EVENT_ALL_ACCESS,
+                           NULL,
+                           1,
+                           FALSE);
+
+    if (!NT_SUCCESS(Status))
+    {
+        WSASetLastError(WSAENOBUFS);
+        return FALSE;
+    }
+
+    Buffer.buf = lpOutputBuffer;
+    Buffer.len = dwReceiveDataLength + dwLocalAddressLength + dwRemoteAddressLength;
+
+    AcceptInfo.BufferArray = &Buffer;
+    AcceptInfo.BufferCount = 1;
+    AcceptInfo.AcceptHandle = (HANDLE)AcceptHandle;
+    AcceptInfo.ReceiveDataLength = dwReceiveDataLength;
+    AcceptInfo.LocalAddressLength = dwLocalAddressLength;
+    AcceptInfo.RemoteAddressLength = dwRemoteAddressLength;
+
+    /* Verify if we should wait for it */
+    if (lpOverlapped == NULL)
+    {
+        Event = SockEvent;
+        IOSB = &DummyIOSB;
+    }
+    else
+    {
+        Event = lpOverlapped->hEvent;
+        IOSB = (PIO_STATUS_BLOCK)&lpOverlapped->Internal;
+    }
+
+    IOSB->Status = STATUS_PENDING;
+    IOSB->Information = 0;
+
+    /* Send IOCTL */
+    Status = NtDeviceIoControlFile((HANDLE)ListenHandle,
+                                   Event,
+                                   NULL,
+                                   lpOverlapped,
+                                   IOSB,
+                                   IOCTL_AFD_SUPER_ACCEPT,
+                                   &AcceptInfo,
+                                   sizeof(AcceptInfo),
+                                   NULL,
+                                   0);
+
+    /* Wait for completion of not overlapped */
+    if (Status == STATUS_PENDING && lpOverlapped == NULL)
+    {
+        WaitForSingleObject(SockEvent, INFINITE);
+        Status = IOSB->Status;
+    }
+
+    NtClose(SockEvent);
+
+    if (Status != STATUS_PENDING)
+    {
+        /* Re-enable Async Event */
+        SockReenableAsyncSelectEvent(Socket, FD_ACCEPT);
+    }
+
+    TRACE("Leaving (%lx, %d)\n", Status, IOSB->Information);
+
+    if (MsafdReturnWithErrno(Status, &Errno, IOSB->Information, lpdwBytesReceived) != NO_ERROR)
+    {
+        WSASetLastError(Errno);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+VOID
+WSPAPI
+WSPGetAcceptExSockaddrs(IN PVOID lpOutputBuffer,
+                        IN DWORD dwReceiveDataLength,
+                        IN DWORD dwLocalAddressLength,
+                        IN DWORD dwRemoteAddressLength,
+                        OUT struct sockaddr **LocalSockaddr,
+                        OUT LPINT LocalSockaddrLength,
+                        OUT struct sockaddr **RemoteSockaddr,
+                        OUT LPINT RemoteSockaddrLength)
+{
+    PCHAR Slot = (PCHAR)lpOutputBuffer + dwReceiveDataLength;
+
+    UNREFERENCED_PARAMETER(dwRemoteAddressLength);
+
+    /* See WSPAcceptEx for the layout */
+    *LocalSockaddrLength = *(PULONG)Slot;
+    *LocalSockaddr = (struct sockaddr *)(Slot + sizeof(ULONG));
+
+    Slot += dwLocalAddressLength;
+    *RemoteSockaddrLength = *(PULONG)Slot;
+    *RemoteSockaddr = (struct sockaddr *)(Slot + sizeof(ULONG));
+}
+
+/*
+ * ConnectEx: the socket must be bound already. The send data is queued as
+ * soon as the connection is up, the request completes with the amount of
+ * it AFD took.
+ */
+BOOL
+WSPAPI
+WSPConnectEx(IN SOCKET Handle,
+             IN const struct sockaddr *SocketAddress,
+             IN int SocketAddressLength,
+             IN PVOID lpSendBuffer,
+             IN DWORD dwSendDataLength,
+             OUT LPDWORD lpdwBytesSent,
+             IN LPOVERLAPPED lpOverlapped)
+{
+    PIO_STATUS_BLOCK        IOSB;
+    IO_STATUS_BLOCK         DummyIOSB;
+    PAFD_SUPER_CONNECT_INFO ConnectInfo;
+    AFD_WSABUF              Buffer;
+    PSOCKET_INFORMATION     Socket;
+    NTSTATUS                Status;
+    HANDLE                  Event;
+    HANDLE                  SockEvent;
+    INT                     Errno;
+    ULONG                   ConnectInfoLength;
+    int                     SocketDataLength;
+
+    TRACE("Called (%lx)\n", Handle);
+
+    /* Get the Socket Structure associate to this Socket*/
+    Socket = GetSocketStructure(Handle);
+    if (!Socket)
+    {
+        WSASetLastError(WSAENOTSOCK);
+        return FALSE;
+    }
+
+    /* Unlike connect, ConnectEx doesn't bind for the caller */
+    if (Socket->SharedData->State != SocketBound)
+    {
+        WSASetLastError(Socket->SharedData->State == SocketConnected ? WSAEISCONN : WSAEINVAL);
+        return FALSE;
+    }
+
+    if (!SocketAddress ||
+        SocketAddressLength < (int)FIELD_OFFSET(struct sockaddr, sa_data))
+    {
+        WSASetLastError(WSAEFAULT);
+        return FALSE;
+    }
+
+    /* Calculate the size of SocketAddress->sa_data */
+    SocketDataLength = SocketAddressLength - FIELD_OFFSET(struct sockaddr, sa_data);
+
+    ConnectInfoLength = FIELD_OFFSET(AFD_SUPER_CONNECT_INFO,
+                                     ConnectInfo.RemoteAddress.Address[0].Address[SocketDataLength]);
+    ConnectInfo = HeapAlloc(GetProcessHeap(), 0, ConnectInfoLength);
+    if (!ConnectInfo)
+    {
+        WSASetLastError(WSAENOBUFS);
+        return FALSE;
+    }
+
+    Status = NtCreateEvent(&SockEvent,
+                           EVENT_ALL_ACCESS,
+                           NULL,
+                           1,
+                           FALSE);
+
+    if (!NT_SUCCESS(Status))
+    {
+        HeapFree(GetProcessHeap(), 0, ConnectInfo);
+        WSASetLastError(WSAENOBUFS);
+        return FALSE;
+    }
+
+    Buffer.buf = lpSendBuffer;
+    Buffer.len = dwSendDataLength;
+
+    ConnectInfo->BufferArray = &Buffer;
+    ConnectInfo->BufferCount = (lpSendBuffer && dwSendDataLength) ? 1 : 0;
+
+    /* Set up Address in TDI Format */
+    ConnectInfo->ConnectInfo.Root = 0;
+    ConnectInfo->ConnectInfo.UseSAN = FALSE;
+    ConnectInfo->ConnectInfo.Unknown = 0;
+    ConnectInfo->ConnectInfo.RemoteAddress.TAAddressCount = 1;
+    ConnectInfo->ConnectInfo.RemoteAddress.Address[0].AddressLength = SocketDataLength;
+    ConnectInfo->ConnectInfo.RemoteAddress.Address[0].AddressType = SocketAddress->sa_family;
+    RtlCopyMemory(ConnectInfo->ConnectInfo.RemoteAddress.Address[0].Address,
+                  SocketAddress->sa_data,
+                  SocketDataLength);
+
+    /* Verify if we should wait for it */
+    if (lpOverlapped == NULL)
+    {
+        Event = SockEvent;
+        IOSB = &DummyIOSB;
+    }
+    else
+    {
+        Event = lpOverlapped->hEvent;
+        IOSB = (PIO_STATUS_BLOCK)&lpOverlapped->Internal;
+    }
+
+    IOSB->Status = STATUS_PENDING;
+    IOSB->Information = 0;
+
+    /* Send IOCTL */
+    Status = NtDeviceIoControlFile((HANDLE)Handle,
+                                   Event,
+                                   NULL,
+                                   lpOverlapped,
+                                   IOSB,
+                                   IOCTL_AFD_SUPER_CONNECT,
+                                   ConnectInfo,
+                                   ConnectInfoLength,
+                                   NULL,
+                                   0);
+
+    /* Wait for completion of not overlapped */
+    if (Status == STATUS_PENDING && lpOverlapped == NULL)
+    {
+        WaitForSingleObject(SockEvent, INFINITE);
+        Status = IOSB->Status;
+    }
+
+    /* AFD has its own copy of the request by now */
+    HeapFree(GetProcessHeap(), 0, ConnectInfo);
+    NtClose(SockEvent);
+
+    if (Status != STATUS_PENDING)
+    {
+        Socket->SharedData->SocketLastError = TranslateNtStatusError(Status);
+
+        /* Re-enable Async Event */
+        SockReenableAsyncSelectEvent(Socket, FD_WRITE);
+    }
+
+    TRACE("Leaving (%lx, %d)\n", Status, IOSB->Information);
+
+    if (MsafdReturnWithErrno(Status, &Errno, IOSB->Information, lpdwBytesSent) != NO_ERROR)
+    {
+        WSASetLastError(Errno);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
 int
 WSPAPI
 WSPShutdown(SOCKET Handle,
@@ -2464,7 +2763,45 @@ WSPIoctl(IN  SOCKET Handle,
             Ret = NO_ERROR;
             break;
         case SIO_GET_EXTENSION_FUNCTION_POINTER:
-            Errno = WSAEINVAL;
+            if (IS_INTRESOURCE(lpvInBuffer) || cbInBuffer < sizeof(GUID) ||
+                IS_INTRESOURCE(lpvOutBuffer) || cbOutBuffer < sizeof(PVOID))
+            {
+                Errno = WSAEFAULT;
+                break;
+            }
+
+            if (IsEqualGUID(lpvInBuffer, &TransmitFileGuid))
+            {
+                *((LPFN_TRANSMITFILE*)lpvOutBuffer) = WSPTransmitFile;
+                cbRet = sizeof(PVOID);
+                Errno = NO_ERROR;
+                Ret = NO_ERROR;
+            }
+            else if (IsEqualGUID(lpvInBuffer, &AcceptExGuid))
+            {
+                *((LPFN_ACCEPTEX*)lpvOutBuffer) = WSPAcceptEx;
+                cbRet = sizeof(PVOID);
+                Errno = NO_ERROR;
+                Ret = NO_ERROR;
+            }
+            else if (IsEqualGUID(lpvInBuffer, &GetAcceptExSockaddrsGuid))
+            {
+                *((LPFN_GETACCEPTEXSOCKADDRS*)lpvOutBuffer) = WSPGetAcceptExSockaddrs;
+                cbRet = sizeof(PVOID);
+                Errno = NO_ERROR;
+                Ret = NO_ERROR;
+            }
+            else if (IsEqualGUID(lpvInBuffer, &ConnectExGuid))
+            {
+                *((LPFN_CONNECTEX*)lpvOutBuffer) = WSPConnectEx;
+                cbRet = sizeof(PVOID);
+                Errno = NO_ERROR;
+                Ret = NO_ERROR;
+            }
+            else
+            {
+                Errno = WSAEINVAL;
+            }
             break;
         case SIO_ADDRESS_LIST_QUERY:
             if (IS_INTRESOURCE(lpvOutBuffer) || cbOutBuffer == 0)
@@ -2849,6 +3186,29 @@ WSPSetSockOpt(
                             sizeof(DWORD));
               return NO_ERROR;
 
+           case SO_UPDATE_ACCEPT_CONTEXT:
+              if (optlen < sizeof(SOCKET))
+              {
+                  if (lpErrno) *lpErrno = WSAEFAULT;
+                  return SOCKET_ERROR;
+              }
+              if (!GetSocketStructure(*(const SOCKET*)optval))
+              {
+                  if (lpErrno) *lpErrno = WSAENOTSOCK;
+                  return SOCKET_ERROR;
+              }
+
+              /* AcceptEx connected the socket behind our back */
+              Socket->SharedData->State = SocketConnected;
+              Socket->SharedData->ConnectTime = GetCurrentTimeInSeconds();
+              return NO_ERROR;
+
+           case SO_UPDATE_CONNECT_CONTEXT:
+              /* Same for ConnectEx */
+              Socket->SharedData->State = SocketConnected;
+              Socket->SharedData->ConnectTime = GetCurrentTimeInSeconds();
+              return NO_ERROR;
+
            case SO_KEEPALIVE:
            case SO_DONTROUTE:
               /* These go directly to the helper dll */
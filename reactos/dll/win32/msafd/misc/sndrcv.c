@@ -917,6 +917,144 @@ WSPSendTo(SOCKET Handle,
     return MsafdReturnWithErrno(Status, lpErrno, IOSB->Information, lpNumberOfBytesSent);
 }
 
+BOOL
+WSPAPI
+WSPTransmitFile(IN SOCKET Handle,
+                IN HANDLE hFile,
+                IN DWORD nNumberOfBytesToWrite,
+                IN DWORD nNumberOfBytesPerSend,
+                IN LPOVERLAPPED lpOverlapped,
+                IN LPTRANSMIT_FILE_BUFFERS lpTransmitBuffers,
+                IN DWORD dwFlags)
+{
+    PIO_STATUS_BLOCK        IOSB;
+    IO_STATUS_BLOCK         DummyIOSB;
+    AFD_TRANSMIT_FILE_INFO  TransmitInfo;
+    AFD_TRANSMIT_RANGE      Range;
+    FILE_POSITION_INFORMATION FilePosition;
+    NTSTATUS                Status;
+    HANDLE                  Event = NULL;
+    HANDLE                  SockEvent;
+    PSOCKET_INFORMATION     Socket;
+    INT                     Errno;
+
+    TRACE("Called\n");
+
+    /* Get the Socket Structure associate to this Socket*/
+    Socket = GetSocketStructure(Handle);
+    if (!Socket)
+    {
+        WSASetLastError(WSAENOTSOCK);
+        return FALSE;
+    }
+
+    /* The data is sent from where the caller says, or from the file pointer */
+    if (hFile)
+    {
+        if (lpOverlapped)
+        {
+            Range.Offset.LowPart = lpOverlapped->Offset;
+            Range.Offset.HighPart = lpOverlapped->OffsetHigh;
+        }
+        else
+        {
+            Status = NtQueryInformationFile(hFile,
+                                            &DummyIOSB,
+                                            &FilePosition,
+                                            sizeof(FilePosition),
+                                            FilePositionInformation);
+            if (!NT_SUCCESS(Status))
+            {
+                MsafdReturnWithErrno(Status, &Errno, 0, NULL);
+                WSASetLastError(Errno);
+                return FALSE;
+            }
+            Range.Offset = FilePosition.CurrentByteOffset;
+        }
+
+        /* Zero sends the rest of the file */
+        Range.Length = nNumberOfBytesToWrite;
+    }
+
+    Status = NtCreateEvent( &SockEvent, EVENT_ALL_ACCESS,
+                            NULL, 1, FALSE );
+
+    if( !NT_SUCCESS(Status) )
+    {
+        WSASetLastError(WSAENOBUFS);
+        return FALSE;
+    }
+
+    /* Set up the Transmit Structure, AFD reads the file itself */
+    RtlZeroMemory(&TransmitInfo, sizeof(TransmitInfo));
+    TransmitInfo.FileHandle = hFile;
+    TransmitInfo.Ranges = hFile ? &Range : NULL;
+    TransmitInfo.RangeCount = hFile ? 1 : 0;
+    TransmitInfo.SendSize = nNumberOfBytesPerSend;
+    if (lpTransmitBuffers)
+    {
+        TransmitInfo.Head.buf = lpTransmitBuffers->Head;
+        TransmitInfo.Head.len = lpTransmitBuffers->HeadLength;
+        TransmitInfo.Tail.buf = lpTransmitBuffers->Tail;
+        TransmitInfo.Tail.len = lpTransmitBuffers->TailLength;
+    }
+    if (dwFlags & (TF_DISCONNECT | TF_REUSE_SOCKET))
+    {
+        TransmitInfo.Flags |= AFD_TF_DISCONNECT;
+    }
+
+    /* Verify if we should wait for it */
+    if (lpOverlapped == NULL)
+    {
+        Event = SockEvent;
+        IOSB = &DummyIOSB;
+    }
+    else
+    {
+        Event = lpOverlapped->hEvent;
+        IOSB = (PIO_STATUS_BLOCK)&lpOverlapped->Internal;
+    }
+
+    IOSB->Status = STATUS_PENDING;
+
+    /* Send IOCTL */
+    Status = NtDeviceIoControlFile((HANDLE)Handle,
+                                    Event,
+                                    NULL,
+                                    lpOverlapped,
+                                    IOSB,
+                                    IOCTL_AFD_TRANSMIT_FILE,
+                                    &TransmitInfo,
+                                    sizeof(TransmitInfo),
+                                    NULL,
+                                    0);
+
+    /* Wait for completion of not overlapped */
+    if (Status == STATUS_PENDING && lpOverlapped == NULL)
+    {
+        WaitForSingleObject(SockEvent, INFINITE);
+        Status = IOSB->Status;
+    }
+
+    NtClose( SockEvent );
+
+    if (Status != STATUS_PENDING)
+    {
+        /* Re-enable Async Event */
+        SockReenableAsyncSelectEvent(Socket, FD_WRITE);
+    }
+
+    TRACE("Leaving (%lx, %d)\n", Status, IOSB->Information);
+
+    if (MsafdReturnWithErrno(Status, &Errno, 0, NULL) != NO_ERROR)
+    {
+        WSASetLastError(Errno);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
 INT
 WSPAPI
 WSPRecvDisconnect(IN  SOCKET s,
@@ -146,6 +146,30 @@ WSPAccept(
     IN      DWORD dwCallbackData,
     OUT     LPINT lpErrno);
 
+BOOL
+WSPAPI
+WSPAcceptEx(
+    IN  SOCKET sListenSocket,
+    IN  SOCKET sAcceptSocket,
+    IN  PVOID lpOutputBuffer,
+    IN  DWORD dwReceiveDataLength,
+    IN  DWORD dwLocalAddressLength,
+    IN  DWORD dwRemoteAddressLength,
+    OUT LPDWORD lpdwBytesReceived,
+    IN  LPOVERLAPPED lpOverlapped);
+
+VOID
+WSPAPI
+WSPGetAcceptExSockaddrs(
+    IN  PVOID lpOutputBuffer,
+    IN  DWORD dwReceiveDataLength,
+    IN  DWORD dwLocalAddressLength,
+    IN  DWORD dwRemoteAddressLength,
+    OUT struct sockaddr **LocalSockaddr,
+    OUT LPINT LocalSockaddrLength,
+    OUT struct sockaddr **RemoteSockaddr,
+    OUT LPINT RemoteSockaddrLength);
+
 INT
 WSPAPI
 WSPAddressToString(
@@ -200,6 +224,17 @@ WSPConnect(
     IN  LPQOS lpGQOS,
     OUT LPINT lpErrno);
 
+BOOL
+WSPAPI
+WSPConnectEx(
+    IN  SOCKET s,
+    IN  const struct sockaddr *name,
+    IN  int namelen,
+    IN  PVOID lpSendBuffer,
+    IN  DWORD dwSendDataLength,
+    OUT LPDWORD lpdwBytesSent,
+    IN  LPOVERLAPPED lpOverlapped);
+
 INT
 WSPAPI
 WSPDuplicateSocket(
@@ -361,6 +396,17 @@ WSPSend(
     IN  LPWSATHREADID lpThreadId,
     OUT LPINT lpErrno);
 
+BOOL
+WSPAPI
+WSPTransmitFile(
+    IN SOCKET s,
+    IN HANDLE hFile,
+    IN DWORD nNumberOfBytesToWrite,
+    IN DWORD nNumberOfBytesPerSend,
+    IN LPOVERLAPPED lpOverlapped,
+    IN LPTRANSMIT_FILE_BUFFERS lpTransmitBuffers,
+    IN DWORD dwFlags);
+
 INT
 WSPAPI
 WSPSendDisconnect(
@@ -187,6 +187,7 @@ typedef struct _xmldoc_priv {
     LONG refs;
     struct list orphans;
     domdoc_properties* properties;
+    LONG version;
 } xmldoc_priv;
 
 typedef struct _orphan_entry {
@@ -259,6 +260,7 @@ static xmldoc_priv * create_priv(void)
         priv->refs = 0;
         list_init( &priv->orphans );
         priv->properties = NULL;
+        priv->version = 0;
     }
 
     return priv;
@@ -356,7 +358,11 @@ static void release_namespaces(domdoc *This)
 void xmldoc_link_xmldecl(xmlDocPtr doc, xmlNodePtr node)
 {
     assert(doc != NULL);
-    if (doc->standalone != -1) xmlAddPrevSibling( doc->children, node );
+    if (doc->standalone != -1)
+    {
+        xmlAddPrevSibling( doc->children, node );
+        xmldoc_modified( doc );
+    }
 }
 
 /* unlinks a first "<?xml" child if it was created */
@@ -374,6 +380,7 @@ xmlNodePtr xmldoc_unlink_xmldecl(xmlDocPtr doc)
     {
         node = first_child;
         xmlUnlinkNode( node );
+        xmldoc_modified( doc );
     }
     else
         node = NULL;
@@ -615,6 +622,23 @@ LONG xmldoc_release(xmlDocPtr doc)
     return xmldoc_release_refs(doc, 1);
 }
 
+/* Has to be called whenever nodes are linked, unlinked or replaced in the tree,
+   node lists use the version to tell if their cached lookups are still valid. */
+void xmldoc_modified(xmlDocPtr doc)
+{
+    xmldoc_priv *priv = priv_from_xmlDocPtr(doc);
+
+    /* during parsing the xmlDoc._private stuff is not there */
+    if (priv)
+        InterlockedIncrement(&priv->version);
+}
+
+LONG xmldoc_get_version(xmlDocPtr doc)
+{
+    xmldoc_priv *priv = priv_from_xmlDocPtr(doc);
+    return priv ? priv->version : 0;
+}
+
 HRESULT xmldoc_add_orphan(xmlDocPtr doc, xmlNodePtr node)
 {
     xmldoc_priv *priv = priv_from_xmlDocPtr(doc);
@@ -1600,7 +1624,9 @@ static HRESULT WINAPI domdoc_put_documentElement(
     /* old root is still orphaned by its document, update refcount from new root */
     if (refcount) xmldoc_add_refs(get_doc(This), refcount);
     oldRoot = xmlDocSetRootElement( get_doc(This), xmlNode->node);
+    xmldoc_modified(old_doc);
     if (refcount) xmldoc_release_refs(old_doc, refcount);
+    xmldoc_modified(get_doc(This));
     IXMLDOMNode_Release( elementNode );
 
     if(oldRoot)
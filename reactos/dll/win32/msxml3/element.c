@@ -1035,6 +1035,7 @@ static HRESULT WINAPI domelem_put_dataType(
                 if (attr)
                 {
                     attr = xmlSetNsProp(get_element(This), attr->ns, DT_prefix, dt_to_str(dt));
+                    xmldoc_modified(get_element(This)->doc);
                     hr = S_OK;
                 }
                 else
@@ -1046,6 +1047,7 @@ static HRESULT WINAPI domelem_put_dataType(
                         if (attr)
                         {
                             xmlAddChild(get_element(This), (xmlNodePtr)attr);
+                            xmldoc_modified(get_element(This)->doc);
                             hr = S_OK;
                         }
                         else
@@ -1296,6 +1298,7 @@ static HRESULT WINAPI domelem_setAttribute(
 
     if (!xmlSetNsProp(element, NULL, xml_name, xml_value))
         hr = E_FAIL;
+    xmldoc_modified(element->doc);
 
     heap_free(xml_value);
     heap_free(xml_name);
@@ -1453,6 +1456,7 @@ static HRESULT WINAPI domelem_setAttributeNode(
     }
 
     attr = xmlSetNsProp(get_element(This), NULL, name, value);
+    xmldoc_modified(get_element(This)->doc);
     if (attr)
         attr_node->parent = (IXMLDOMNode*)iface;
 
@@ -1669,6 +1673,7 @@ static HRESULT domelem_set_named_item(xmlNodePtr node, IXMLDOMNode *newItem, IXM
             WARN("%p is not an orphan of %p\n", ThisNew->node, ThisNew->node->doc);
 
     nodeNew = xmlAddChild(node, ThisNew->node);
+    xmldoc_modified(node->doc);
 
     if(namedItem)
         *namedItem = create_node( nodeNew );
@@ -1721,6 +1726,7 @@ static HRESULT domelem_remove_qualified_item(xmlNodePtr node, BSTR name, BSTR ur
         if (xmlRemoveProp(attr) == -1)
             ERR("xmlRemoveProp failed\n");
     }
+    xmldoc_modified(node->doc);
 
     return S_OK;
 }
@@ -243,6 +243,7 @@ HRESULT node_set_content(xmlnode *This, LPCWSTR value)
         return E_OUTOFMEMORY;
 
     xmlNodeSetContent(This->node, str);
+    xmldoc_modified(This->node->doc);
     heap_free(str);
     return S_OK;
 }
@@ -264,6 +265,7 @@ static HRESULT node_set_content_escaped(xmlnode *This, LPCWSTR value)
     }
 
     xmlNodeSetContent(This->node, escaped);
+    xmldoc_modified(This->node->doc);
 
     heap_free(str);
     xmlFree(escaped);
@@ -500,8 +502,11 @@ HRESULT node_insert_before(xmlnode *This, IXMLDOMNode *new_child, const VARIANT
             xmlnode_add_ref(new_node);
             node_obj->node = new_node;
         }
+        /* the leaving document may go away with its last refs */
+        xmldoc_modified(doc);
         if (refcount) xmldoc_release_refs(doc, refcount);
         node_obj->parent = This->parent;
+        xmldoc_modified(before_node_obj->node->doc);
     }
     else
     {
@@ -521,8 +526,10 @@ HRESULT node_insert_before(xmlnode *This, IXMLDOMNode *new_child, const VARIANT
             xmlnode_add_ref(new_node);
             node_obj->node = new_node;
         }
+        xmldoc_modified(doc);
         if (refcount) xmldoc_release_refs(doc, refcount);
         node_obj->parent = This->iface;
+        xmldoc_modified(This->node->doc);
     }
 
     if(ret)
@@ -585,7 +592,9 @@ HRESULT node_replace_child(xmlnode *This, IXMLDOMNode *newChild, IXMLDOMNode *ol
 
     if (refcount) xmldoc_add_refs(old_child->node->doc, refcount);
     xmlReplaceNode(old_child->node, new_child->node);
+    xmldoc_modified(leaving_doc);
     if (refcount) xmldoc_release_refs(leaving_doc, refcount);
+    xmldoc_modified(old_child->node->doc);
     new_child->parent = old_child->parent;
     old_child->parent = NULL;
 
@@ -619,6 +628,7 @@ HRESULT node_remove_child(xmlnode *This, IXMLDOMNode* child, IXMLDOMNode** oldCh
     }
 
     xmlUnlinkNode(child_node->node);
+    xmldoc_modified(child_node->node->doc);
     child_node->parent = NULL;
     xmldoc_add_orphan(child_node->node->doc, child_node->node);
 
@@ -872,6 +882,7 @@ HRESULT node_put_text(xmlnode *This, BSTR text)
     heap_free(str);
 
     xmlNodeSetContent(This->node, str2);
+    xmldoc_modified(This->node->doc);
     xmlFree(str2);
 
     return S_OK;
@@ -33,6 +33,9 @@
 
 #ifdef HAVE_LIBXML2
 
+/* item() calls that would walk further than this build a child index instead */
+#define NODELIST_WALK_LIMIT 32
+
 typedef struct
 {
     DispatchEx dispex;
@@ -41,6 +44,13 @@ typedef struct
     xmlNodePtr parent;
     xmlNodePtr current;
     IEnumVARIANT *enumvariant;
+
+    /* lookup cache, valid as long as the document version doesn't change */
+    LONG version;
+    LONG length;            /* -1 if not counted yet */
+    xmlNodePtr cursor;      /* last node returned by item(), or NULL */
+    LONG cursor_index;
+    xmlNodePtr *index;      /* all children, built on demand */
 } xmlnodelist;
 
 static HRESULT nodelist_get_item(IUnknown *iface, LONG index, VARIANT *item)
@@ -131,6 +141,7 @@ static ULONG WINAPI xmlnodelist_Release(
     {
         xmldoc_release( This->parent->doc );
         if (This->enumvariant) IEnumVARIANT_Release(This->enumvariant);
+        heap_free( This->index );
         heap_free( This );
     }
 
@@ -185,6 +196,104 @@ static HRESULT WINAPI xmlnodelist_Invoke(
         dispIdMember, riid, lcid, wFlags, pDispParams, pVarResult, pExcepInfo, puArgErr);
 }
 
+static void xmlnodelist_check_cache(xmlnodelist *This)
+{
+    LONG version = xmldoc_get_version(This->parent->doc);
+
+    if (This->version == version)
+        return;
+
+    heap_free(This->index);
+    This->index = NULL;
+    This->cursor = NULL;
+    This->length = -1;
+    This->version = version;
+}
+
+static LONG xmlnodelist_count(xmlnodelist *This)
+{
+    xmlNodePtr curr;
+    LONG count = 0;
+
+    xmlnodelist_check_cache(This);
+    if (This->length >= 0)
+        return This->length;
+
+    for (curr = This->parent->children; curr; curr = curr->next)
+        count++;
+
+    return This->length = count;
+}
+
+static BOOL xmlnodelist_build_index(xmlnodelist *This)
+{
+    LONG count = xmlnodelist_count(This), i = 0;
+    xmlNodePtr curr;
+
+    if (!count) return FALSE;
+
+    This->index = heap_alloc(count * sizeof(*This->index));
+    if (!This->index) return FALSE;
+
+    for (curr = This->parent->children; curr; curr = curr->next)
+        This->index[i++] = curr;
+
+    return TRUE;
+}
+
+static xmlNodePtr xmlnodelist_lookup(xmlnodelist *This, LONG index)
+{
+    LONG pos = 0, distance = index;
+    xmlNodePtr curr = This->parent->children;
+
+    xmlnodelist_check_cache(This);
+
+    if (This->length >= 0 && index >= This->length)
+        return NULL;
+    if (This->index)
+        return This->index[index];
+
+    /* start walking from the closest known node */
+    if (This->cursor)
+    {
+        LONG d = index > This->cursor_index ? index - This->cursor_index : This->cursor_index - index;
+        if (d < distance)
+        {
+            curr = This->cursor;
+            pos = This->cursor_index;
+            distance = d;
+        }
+    }
+    if (This->length >= 0 && This->length - 1 - index < distance)
+    {
+        curr = This->parent->last;
+        pos = This->length - 1;
+        distance = pos - index;
+    }
+
+    if (distance > NODELIST_WALK_LIMIT && xmlnodelist_build_index(This))
+        return index < This->length ? This->index[index] : NULL;
+
+    while (curr && pos < index)
+    {
+        curr = curr->next;
+        pos++;
+    }
+    while (curr && pos > index)
+    {
+        curr = curr->prev;
+        pos--;
+    }
+
+    if (curr)
+    {
+        This->cursor = curr;
+        This->cursor_index = pos;
+    }
+
+    return curr;
+}
+
 static HRESULT WINAPI xmlnodelist_get_item(
         IXMLDOMNodeList* iface,
         LONG index,
@@ -192,7 +301,6 @@ static HRESULT WINAPI xmlnodelist_get_item(
 {
     xmlnodelist *This = impl_from_IXMLDOMNodeList( iface );
     xmlNodePtr curr;
-    LONG nodeIndex = 0;
 
     TRACE("(%p)->(%d %p)\n", This, index, listItem);
 
@@ -204,12 +312,7 @@ static HRESULT WINAPI xmlnodelist_get_item(
     if (index < 0)
         return S_FALSE;
 
-    curr = This->parent->children;
-    while(curr)
-    {
-        if(nodeIndex++ == index) break;
-        curr = curr->next;
-    }
+    curr = xmlnodelist_lookup(This, index);
     if(!curr) return S_FALSE;
 
     *listItem = create_node( curr );
@@ -221,10 +324,6 @@ static HRESULT WINAPI xmlnodelist_get_length(
         IXMLDOMNodeList* iface,
         LONG* listLength)
 {
-
-    xmlNodePtr curr;
-    LONG nodeCount = 0;
-
     xmlnodelist *This = impl_from_IXMLDOMNodeList( iface );
 
     TRACE("(%p)->(%p)\n", This, listLength);
@@ -232,14 +331,7 @@ static HRESULT WINAPI xmlnodelist_get_length(
     if(!listLength)
         return E_INVALIDARG;
 
-    curr = This->parent->children;
-    while (curr)
-    {
-        nodeCount++;
-        curr = curr->next;
-    }
-
-    *listLength = nodeCount;
+    *listLength = xmlnodelist_count(This);
     return S_OK;
 }
 
@@ -412,6 +504,11 @@ IXMLDOMNodeList* create_children_nodelist( xmlNodePtr node )
     This->parent = node;
     This->current = node->children;
     This->enumvariant = NULL;
+    This->version = xmldoc_get_version( node->doc );
+    This->length = -1;
+    This->cursor = NULL;
+    This->cursor_index = 0;
+    This->index = NULL;
     xmldoc_add_ref( node->doc );
 
     init_dispex(&This->dispex, (IUnknown*)&This->IXMLDOMNodeList_iface, &xmlnodelist_dispex);
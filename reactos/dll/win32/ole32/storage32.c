@@ -3526,27 +3526,212 @@ static ULONGLONG StorageImpl_GetBigBlockOffset(StorageImpl* This, ULONG index)
     return (ULONGLONG)(index+1) * This->bigBlockSize;
 }
 
-static HRESULT StorageImpl_ReadBigBlock(
-  StorageImpl* This,
-  ULONG          blockIndex,
-  void*          buffer,
-  ULONG*         out_read)
+/* Writes a cached block back to the file, if it was modified. */
+static HRESULT StorageImpl_WriteBackSector(StorageImpl *This, SectorCacheEntry *entry)
 {
   ULARGE_INTEGER ulOffset;
-  DWORD  read=0;
+  DWORD wrote = 0;
   HRESULT hr;
 
-  ulOffset.QuadPart = StorageImpl_GetBigBlockOffset(This, blockIndex);
+  if (!entry->dirty)
+    return S_OK;
+
+  ulOffset.QuadPart = StorageImpl_GetBigBlockOffset(This, entry->sector);
+
+  hr = StorageImpl_WriteAt(This, ulOffset, entry->data, This->bigBlockSize, &wrote);
+  if (SUCCEEDED(hr) && wrote != This->bigBlockSize)
+    hr = STG_E_WRITEFAULT;
+
+  if (SUCCEEDED(hr))
+    entry->dirty = FALSE;
+
+  return hr;
+}
+
+/******************************************************************************
+ *      StorageImpl_GetCachedSector
+ *
+ * Returns the cache entry of a big block, evicting the least recently used
+ * one if the cache is full. If read is FALSE the caller is going to
+ * overwrite the whole block, and a block that isn't cached yet is not read
+ * from the file.
+ */
+static HRESULT StorageImpl_GetCachedSector(
+  StorageImpl*       This,
+  ULONG              sector,
+  BOOL               read,
+  SectorCacheEntry** result)
+{
+  SectorCacheEntry *entry;
+  HRESULT hr;
+
+  LIST_FOR_EACH_ENTRY(entry, &This->sectorCache, SectorCacheEntry, entry)
+  {
+    if (entry->sector == sector)
+    {
+      list_remove(&entry->entry);
+      list_add_head(&This->sectorCache, &entry->entry);
+      *result = entry;
+      return S_OK;
+    }
+  }
+
+  if (This->sectorCacheCount < SECTOR_CACHE_SIZE)
+  {
+    entry = HeapAlloc(GetProcessHeap(), 0,
+                      FIELD_OFFSET(SectorCacheEntry, data[This->bigBlockSize]));
+    if (!entry)
+      return E_OUTOFMEMORY;
+    This->sectorCacheCount++;
+  }
+  else
+  {
+    entry = LIST_ENTRY(list_tail(&This->sectorCache), SectorCacheEntry, entry);
+
+    hr = StorageImpl_WriteBackSector(This, entry);
+    if (FAILED(hr))
+      return hr;
+
+    list_remove(&entry->entry);
+  }
 
-  hr = StorageImpl_ReadAt(This, ulOffset, buffer, This->bigBlockSize, &read);
+  entry->sector = sector;
+  entry->dirty  = FALSE;
 
-  if (SUCCEEDED(hr) &&  read < This->bigBlockSize)
+  if (read)
   {
+    ULARGE_INTEGER ulOffset;
+    DWORD bytesRead = 0;
+
+    ulOffset.QuadPart = StorageImpl_GetBigBlockOffset(This, sector);
+
+    hr = StorageImpl_ReadAt(This, ulOffset, entry->data, This->bigBlockSize, &bytesRead);
+
+    if (!bytesRead)
+    {
+      HeapFree(GetProcessHeap(), 0, entry);
+      This->sectorCacheCount--;
+      return FAILED(hr) ? hr : STG_E_READFAULT;
+    }
+
     /* File ends during this block; fill the rest with 0's. */
-    memset((LPBYTE)buffer+read, 0, This->bigBlockSize-read);
+    if (bytesRead < This->bigBlockSize)
+      memset(entry->data + bytesRead, 0, This->bigBlockSize - bytesRead);
   }
 
-  if (out_read) *out_read = read;
+  list_add_head(&This->sectorCache, &entry->entry);
+  *result = entry;
+  return S_OK;
+}
+
+/******************************************************************************
+ *      StorageImpl_SyncSectorCache
+ *
+ * Writes back the cached blocks in the range [first, first+count). If discard
+ * is TRUE they are also removed from the cache, because the caller is going
+ * to write to the file directly.
+ */
+static HRESULT StorageImpl_SyncSectorCache(
+  StorageImpl* This,
+  ULONG        first,
+  ULONG        count,
+  BOOL         discard)
+{
+  SectorCacheEntry *entry, *next;
+  HRESULT hr = S_OK;
+
+  LIST_FOR_EACH_ENTRY_SAFE(entry, next, &This->sectorCache, SectorCacheEntry, entry)
+  {
+    if (entry->sector - first >= count)
+      continue;
+
+    hr = StorageImpl_WriteBackSector(This, entry);
+    if (FAILED(hr))
+      break;
+
+    if (discard)
+    {
+      list_remove(&entry->entry);
+      HeapFree(GetProcessHeap(), 0, entry);
+      This->sectorCacheCount--;
+    }
+  }
+
+  return hr;
+}
+
+/******************************************************************************
+ *      StorageImpl_ReadSectors
+ *
+ * Reads size bytes, starting offset bytes into the given big block, from
+ * physically contiguous big blocks in a single call to the ILockBytes.
+ */
+static HRESULT StorageImpl_ReadSectors(
+  StorageImpl* This,
+  ULONG        sector,
+  ULONG        offset,
+  void*        buffer,
+  ULONG        size,
+  ULONG*       bytesRead)
+{
+  ULARGE_INTEGER ulOffset;
+  ULONG count = (offset + size + This->bigBlockSize - 1) / This->bigBlockSize;
+  HRESULT hr;
+
+  *bytesRead = 0;
+
+  hr = StorageImpl_SyncSectorCache(This, sector, count, FALSE);
+  if (FAILED(hr))
+    return hr;
+
+  ulOffset.QuadPart = StorageImpl_GetBigBlockOffset(This, sector) + offset;
+
+  return StorageImpl_ReadAt(This, ulOffset, buffer, size, bytesRead);
+}
+
+/******************************************************************************
+ *      StorageImpl_WriteSectors
+ *
+ * Counterpart of StorageImpl_ReadSectors.
+ */
+static HRESULT StorageImpl_WriteSectors(
+  StorageImpl* This,
+  ULONG        sector,
+  ULONG        offset,
+  const void*  buffer,
+  ULONG        size,
+  ULONG*       bytesWritten)
+{
+  ULARGE_INTEGER ulOffset;
+  ULONG count = (offset + size + This->bigBlockSize - 1) / This->bigBlockSize;
+  HRESULT hr;
+
+  *bytesWritten = 0;
+
+  hr = StorageImpl_SyncSectorCache(This, sector, count, TRUE);
+  if (FAILED(hr))
+    return hr;
+
+  ulOffset.QuadPart = StorageImpl_GetBigBlockOffset(This, sector) + offset;
+
+  return StorageImpl_WriteAt(This, ulOffset, buffer, size, bytesWritten);
+}
+
+static HRESULT StorageImpl_ReadBigBlock(
+  StorageImpl* This,
+  ULONG          blockIndex,
+  void*          buffer,
+  ULONG*         out_read)
+{
+  SectorCacheEntry *entry;
+  HRESULT hr;
+
+  hr = StorageImpl_GetCachedSector(This, blockIndex, TRUE, &entry);
+
+  if (SUCCEEDED(hr))
+    memcpy(buffer, entry->data, This->bigBlockSize);
+
+  if (out_read) *out_read = SUCCEEDED(hr) ? This->bigBlockSize : 0;
 
   return hr;
 }
@@ -3557,16 +3742,13 @@ static BOOL StorageImpl_ReadDWordFromBigBlock(
   ULONG         offset,
   DWORD*        value)
 {
-  ULARGE_INTEGER ulOffset;
-  DWORD  read;
-  DWORD  tmp;
+  SectorCacheEntry *entry;
 
-  ulOffset.QuadPart = StorageImpl_GetBigBlockOffset(This, blockIndex);
-  ulOffset.QuadPart += offset;
+  if (FAILED(StorageImpl_GetCachedSector(This, blockIndex, TRUE, &entry)))
+    return FALSE;
 
-  StorageImpl_ReadAt(This, ulOffset, &tmp, sizeof(DWORD), &read);
-  *value = lendian32toh(tmp);
-  return (read == sizeof(DWORD));
+  StorageUtl_ReadDWord(entry->data, offset, value);
+  return TRUE;
 }
 
 static BOOL StorageImpl_WriteBigBlock(
@@ -3574,13 +3756,14 @@ static BOOL StorageImpl_WriteBigBlock(
   ULONG         blockIndex,
   const void*   buffer)
 {
-  ULARGE_INTEGER ulOffset;
-  DWORD  wrote;
+  SectorCacheEntry *entry;
 
-  ulOffset.QuadPart = StorageImpl_GetBigBlockOffset(This, blockIndex);
+  if (FAILED(StorageImpl_GetCachedSector(This, blockIndex, FALSE, &entry)))
+    return FALSE;
 
-  StorageImpl_WriteAt(This, ulOffset, buffer, This->bigBlockSize, &wrote);
-  return (wrote == This->bigBlockSize);
+  memcpy(entry->data, buffer, This->bigBlockSize);
+  entry->dirty = TRUE;
+  return TRUE;
 }
 
 static BOOL StorageImpl_WriteDWordToBigBlock(
@@ -3589,15 +3772,14 @@ static BOOL StorageImpl_WriteDWordToBigBlock(
   ULONG         offset,
   DWORD         value)
 {
-  ULARGE_INTEGER ulOffset;
-  DWORD  wrote;
+  SectorCacheEntry *entry;
 
-  ulOffset.QuadPart = StorageImpl_GetBigBlockOffset(This, blockIndex);
-  ulOffset.QuadPart += offset;
+  if (FAILED(StorageImpl_GetCachedSector(This, blockIndex, TRUE, &entry)))
+    return FALSE;
 
-  value = htole32(value);
-  StorageImpl_WriteAt(This, ulOffset, &value, sizeof(DWORD), &wrote);
-  return (wrote == sizeof(DWORD));
+  StorageUtl_WriteDWord(entry->data, offset, value);
+  entry->dirty = TRUE;
+  return TRUE;
 }
 
 /******************************************************************************
@@ -3809,6 +3991,50 @@ static SmallBlockChainStream* Storage32Impl_BigBlocksToSmallBlocks(
     return SmallBlockChainStream_Construct(This, NULL, streamEntryRef);
 }
 
+/******************************************************************************
+ *      StorageImpl_GrowDepotMirror
+ *
+ * Makes room for depotCount depot blocks in the in-memory copy of the big
+ * block depot.
+ */
+static HRESULT StorageImpl_GrowDepotMirror(StorageImpl* This, ULONG depotCount)
+{
+  ULONG blocksPerDepot = This->bigBlockSize / sizeof(ULONG);
+  ULONG *new_mirror;
+  BYTE *new_loaded;
+  ULONG new_size;
+
+  if (depotCount <= This->blockDepotMirrorSize)
+    return S_OK;
+
+  new_size = max(depotCount, This->blockDepotMirrorSize * 2);
+
+  new_mirror = HeapAlloc(GetProcessHeap(), 0, sizeof(ULONG) * blocksPerDepot * new_size);
+  new_loaded = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, new_size);
+  if (!new_mirror || !new_loaded)
+  {
+    HeapFree(GetProcessHeap(), 0, new_mirror);
+    HeapFree(GetProcessHeap(), 0, new_loaded);
+    return E_OUTOFMEMORY;
+  }
+
+  if (This->blockDepotMirrorSize)
+  {
+    memcpy(new_mirror, This->blockDepotMirror,
+           sizeof(ULONG) * blocksPerDepot * This->blockDepotMirrorSize);
+    memcpy(new_loaded, This->blockDepotLoaded, This->blockDepotMirrorSize);
+  }
+
+  HeapFree(GetProcessHeap(), 0, This->blockDepotMirror);
+  HeapFree(GetProcessHeap(), 0, This->blockDepotLoaded);
+
+  This->blockDepotMirror     = new_mirror;
+  This->blockDepotLoaded     = new_loaded;
+  This->blockDepotMirrorSize = new_size;
+
+  return S_OK;
+}
+
 /******************************************************************************
  *      Storage32Impl_AddBlockDepot
  *
@@ -3834,6 +4060,18 @@ static void Storage32Impl_AddBlockDepot(StorageImpl* This, ULONG blockIndex, ULO
   }
 
   StorageImpl_WriteBigBlock(This, blockIndex, blockBuffer);
+
+  /* The new block is known, there is no need to read it back. */
+  if (SUCCEEDED(StorageImpl_GrowDepotMirror(This, depotIndex + 1)))
+  {
+    ULONG *entries = This->blockDepotMirror + depotIndex * blocksPerDepot;
+    ULONG index;
+
+    for (index = 0; index < blocksPerDepot; index++)
+      StorageUtl_ReadDWord(blockBuffer, index*sizeof(ULONG), &entries[index]);
+
+    This->blockDepotLoaded[depotIndex] = TRUE;
+  }
 }
 
 /******************************************************************************
@@ -3848,37 +4086,13 @@ static ULONG Storage32Impl_GetExtDepotBlock(StorageImpl* This, ULONG depotIndex)
   ULONG depotBlocksPerExtBlock = (This->bigBlockSize / sizeof(ULONG)) - 1;
   ULONG numExtBlocks           = depotIndex - COUNT_BBDEPOTINHEADER;
   ULONG extBlockCount          = numExtBlocks / depotBlocksPerExtBlock;
-  ULONG extBlockOffset         = numExtBlocks % depotBlocksPerExtBlock;
-  ULONG blockIndex             = BLOCK_UNUSED;
-  ULONG extBlockIndex;
-  BYTE depotBuffer[MAX_BIG_BLOCK_SIZE];
-  int index, num_blocks;
 
   assert(depotIndex >= COUNT_BBDEPOTINHEADER);
 
   if (extBlockCount >= This->extBigBlockDepotCount)
     return BLOCK_UNUSED;
 
-  if (This->indexExtBlockDepotCached != extBlockCount)
-  {
-    extBlockIndex = This->extBigBlockDepotLocations[extBlockCount];
-
-    StorageImpl_ReadBigBlock(This, extBlockIndex, depotBuffer, NULL);
-
-    num_blocks = This->bigBlockSize / 4;
-
-    for (index = 0; index < num_blocks; index++)
-    {
-      StorageUtl_ReadDWord(depotBuffer, index*sizeof(ULONG), &blockIndex);
-      This->extBlockDepotCached[index] = blockIndex;
-    }
-
-    This->indexExtBlockDepotCached = extBlockCount;
-  }
-
-  blockIndex = This->extBlockDepotCached[extBlockOffset];
-
-  return blockIndex;
+  return This->extBlockDepotMirror[numExtBlocks];
 }
 
 /******************************************************************************
@@ -3909,10 +4123,7 @@ static void Storage32Impl_SetExtDepotBlock(StorageImpl* This, ULONG depotIndex,
                         blockIndex);
   }
 
-  if (This->indexExtBlockDepotCached == extBlockCount)
-  {
-    This->extBlockDepotCached[extBlockOffset] = blockIndex;
-  }
+  This->extBlockDepotMirror[numExtBlocks] = blockIndex;
 }
 
 /******************************************************************************
@@ -3929,6 +4140,7 @@ static ULONG Storage32Impl_AddExtBlockDepot(StorageImpl* This)
   ULONG nextBlockOffset        = This->bigBlockSize - sizeof(ULONG);
   ULONG blocksPerDepotBlock    = This->bigBlockSize / sizeof(ULONG);
   ULONG depotBlocksPerExtBlock = blocksPerDepotBlock - 1;
+  ULONG i;
 
   index = (COUNT_BBDEPOTINHEADER + (numExtBlocks * depotBlocksPerExtBlock)) *
           blocksPerDepotBlock;
@@ -3965,18 +4177,71 @@ static ULONG Storage32Impl_AddExtBlockDepot(StorageImpl* This)
   {
     ULONG new_cache_size = (This->extBigBlockDepotLocationsSize+1)*2;
     ULONG *new_cache = HeapAlloc(GetProcessHeap(), 0, sizeof(ULONG) * new_cache_size);
+    ULONG *new_mirror = HeapAlloc(GetProcessHeap(), 0, sizeof(ULONG) * new_cache_size * depotBlocksPerExtBlock);
 
     memcpy(new_cache, This->extBigBlockDepotLocations, sizeof(ULONG) * This->extBigBlockDepotLocationsSize);
     HeapFree(GetProcessHeap(), 0, This->extBigBlockDepotLocations);
 
+    memcpy(new_mirror, This->extBlockDepotMirror,
+           sizeof(ULONG) * This->extBigBlockDepotLocationsSize * depotBlocksPerExtBlock);
+    HeapFree(GetProcessHeap(), 0, This->extBlockDepotMirror);
+
     This->extBigBlockDepotLocations = new_cache;
+    This->extBlockDepotMirror = new_mirror;
     This->extBigBlockDepotLocationsSize = new_cache_size;
   }
   This->extBigBlockDepotLocations[numExtBlocks] = index;
 
+  for (i = 0; i < depotBlocksPerExtBlock; i++)
+    This->extBlockDepotMirror[numExtBlocks * depotBlocksPerExtBlock + i] = BLOCK_UNUSED;
+
   return index;
 }
 
+/******************************************************************************
+ *      StorageImpl_LoadDepotBlock
+ *
+ * Returns the entries of a depot block from the in-memory copy of the big
+ * block depot, reading the block first if needed.
+ */
+static HRESULT StorageImpl_LoadDepotBlock(StorageImpl* This, ULONG depotIndex, ULONG** entries)
+{
+  ULONG blocksPerDepot = This->bigBlockSize / sizeof(ULONG);
+  ULONG depotBlockIndexPos;
+  SectorCacheEntry *sector;
+  ULONG index;
+  HRESULT hr;
+
+  hr = StorageImpl_GrowDepotMirror(This, depotIndex + 1);
+  if (FAILED(hr))
+    return hr;
+
+  *entries = This->blockDepotMirror + depotIndex * blocksPerDepot;
+
+  if (This->blockDepotLoaded[depotIndex])
+    return S_OK;
+
+  if (depotIndex < COUNT_BBDEPOTINHEADER)
+    depotBlockIndexPos = This->bigBlockDepotStart[depotIndex];
+  else
+    depotBlockIndexPos = Storage32Impl_GetExtDepotBlock(This, depotIndex);
+
+  if (depotBlockIndexPos == BLOCK_UNUSED)
+    return STG_E_READFAULT;
+
+  /* Keep the block cached, it is updated in place by SetNextBlockInChain. */
+  hr = StorageImpl_GetCachedSector(This, depotBlockIndexPos, TRUE, &sector);
+  if (FAILED(hr))
+    return STG_E_READFAULT;
+
+  for (index = 0; index < blocksPerDepot; index++)
+    StorageUtl_ReadDWord(sector->data, index*sizeof(ULONG), &(*entries)[index]);
+
+  This->blockDepotLoaded[depotIndex] = TRUE;
+
+  return S_OK;
+}
+
 /************************************************************************
  * StorageImpl_GetNextBlockInChain
  *
@@ -4006,13 +4271,9 @@ static HRESULT StorageImpl_GetNextBlockInChain(
   ULONG        blockIndex,
   ULONG*       nextBlockIndex)
 {
-  ULONG offsetInDepot    = blockIndex * sizeof (ULONG);
-  ULONG depotBlockCount  = offsetInDepot / This->bigBlockSize;
-  ULONG depotBlockOffset = offsetInDepot % This->bigBlockSize;
-  BYTE depotBuffer[MAX_BIG_BLOCK_SIZE];
-  ULONG read;
-  ULONG depotBlockIndexPos;
-  int index, num_blocks;
+  ULONG blocksPerDepot  = This->bigBlockSize / sizeof(ULONG);
+  ULONG depotBlockCount = blockIndex / blocksPerDepot;
+  ULONG *entries;
 
   *nextBlockIndex   = BLOCK_SPECIAL;
 
@@ -4023,70 +4284,14 @@ static HRESULT StorageImpl_GetNextBlockInChain(
     return STG_E_READFAULT;
   }
 
-  /*
-   * Cache the currently accessed depot block.
-   */
-  if (depotBlockCount != This->indexBlockDepotCached)
-  {
-    This->indexBlockDepotCached = depotBlockCount;
-
-    if (depotBlockCount < COUNT_BBDEPOTINHEADER)
-    {
-      depotBlockIndexPos = This->bigBlockDepotStart[depotBlockCount];
-    }
-    else
-    {
-      /*
-       * We have to look in the extended depot.
-       */
-      depotBlockIndexPos = Storage32Impl_GetExtDepotBlock(This, depotBlockCount);
-    }
-
-    StorageImpl_ReadBigBlock(This, depotBlockIndexPos, depotBuffer, &read);
-
-    if (!read)
-      return STG_E_READFAULT;
-
-    num_blocks = This->bigBlockSize / 4;
-
-    for (index = 0; index < num_blocks; index++)
-    {
-      StorageUtl_ReadDWord(depotBuffer, index*sizeof(ULONG), nextBlockIndex);
-      This->blockDepotCached[index] = *nextBlockIndex;
-    }
-  }
+  if (FAILED(StorageImpl_LoadDepotBlock(This, depotBlockCount, &entries)))
+    return STG_E_READFAULT;
 
-  *nextBlockIndex = This->blockDepotCached[depotBlockOffset/sizeof(ULONG)];
+  *nextBlockIndex = entries[blockIndex % blocksPerDepot];
 
   return S_OK;
 }
 
-/******************************************************************************
- *      Storage32Impl_GetNextExtendedBlock
- *
- * Given an extended block this method will return the next extended block.
- *
- * NOTES:
- * The last ULONG of an extended block is the block index of the next
- * extended block. Extended blocks are marked as BLOCK_EXTBBDEPOT in the
- * depot.
- *
- * Return values:
- *    - The index of the next extended block
- *    - BLOCK_UNUSED: there is no next extended block.
- *    - Any other return values denotes failure.
- */
-static ULONG Storage32Impl_GetNextExtendedBlock(StorageImpl* This, ULONG blockIndex)
-{
-  ULONG nextBlockIndex   = BLOCK_SPECIAL;
-  ULONG depotBlockOffset = This->bigBlockSize - sizeof(ULONG);
-
-  StorageImpl_ReadDWordFromBigBlock(This, blockIndex, depotBlockOffset,
-                        &nextBlockIndex);
-
-  return nextBlockIndex;
-}
-
 /******************************************************************************
  *      StorageImpl_SetNextBlockInChain
  *
@@ -4136,11 +4341,12 @@ static void StorageImpl_SetNextBlockInChain(
   StorageImpl_WriteDWordToBigBlock(This, depotBlockIndexPos, depotBlockOffset,
                         nextBlock);
   /*
-   * Update the cached block depot, if necessary.
+   * Update the in-memory copy of the depot, if this block was loaded.
    */
-  if (depotBlockCount == This->indexBlockDepotCached)
+  if (depotBlockCount < This->blockDepotMirrorSize &&
+      This->blockDepotLoaded[depotBlockCount])
   {
-    This->blockDepotCached[depotBlockOffset/sizeof(ULONG)] = nextBlock;
+    This->blockDepotMirror[blockIndex] = nextBlock;
   }
 }
 
@@ -4155,13 +4361,12 @@ static ULONG StorageImpl_GetNextFreeBigBlock(
   StorageImpl* This)
 {
   ULONG depotBlockIndexPos;
-  BYTE depotBuffer[MAX_BIG_BLOCK_SIZE];
+  ULONG *entries;
   ULONG depotBlockOffset;
   ULONG blocksPerDepot    = This->bigBlockSize / sizeof(ULONG);
   ULONG nextBlockIndex    = BLOCK_SPECIAL;
   int   depotIndex        = 0;
   ULONG freeBlock         = BLOCK_UNUSED;
-  ULONG read;
   ULARGE_INTEGER neededSize;
   STATSTG statstg;
 
@@ -4251,14 +4456,12 @@ static ULONG StorageImpl_GetNextFreeBigBlock(
       }
     }
 
-    StorageImpl_ReadBigBlock(This, depotBlockIndexPos, depotBuffer, &read);
-
-    if (read)
+    if (SUCCEEDED(StorageImpl_LoadDepotBlock(This, depotIndex, &entries)))
     {
       while ( ( (depotBlockOffset/sizeof(ULONG) ) < blocksPerDepot) &&
               ( nextBlockIndex != BLOCK_UNUSED))
       {
-        StorageUtl_ReadDWord(depotBuffer, depotBlockOffset, &nextBlockIndex);
+        nextBlockIndex = entries[depotBlockOffset/sizeof(ULONG)];
 
         if (nextBlockIndex == BLOCK_UNUSED)
         {
@@ -4610,6 +4813,24 @@ static HRESULT StorageImpl_Refresh(StorageImpl *This, BOOL new_object, BOOL crea
   DirRef      currentEntryRef;
   BlockChainStream *blockChainStream;
 
+  /*
+   * Forget what we know about the file, someone else may have changed it.
+   */
+  hr = StorageImpl_SyncSectorCache(This, 0, ~0u, TRUE);
+  if (FAILED(hr))
+    return hr;
+
+  HeapFree(GetProcessHeap(), 0, This->blockDepotMirror);
+  HeapFree(GetProcessHeap(), 0, This->blockDepotLoaded);
+  This->blockDepotMirror     = NULL;
+  This->blockDepotLoaded     = NULL;
+  This->blockDepotMirrorSize = 0;
+
+  HeapFree(GetProcessHeap(), 0, This->extBigBlockDepotLocations);
+  HeapFree(GetProcessHeap(), 0, This->extBlockDepotMirror);
+  This->extBigBlockDepotLocations = NULL;
+  This->extBlockDepotMirror       = NULL;
+
   if (create)
   {
     ULARGE_INTEGER size;
@@ -4672,12 +4893,6 @@ static HRESULT StorageImpl_Refresh(StorageImpl *This, BOOL new_object, BOOL crea
     }
   }
 
-  /*
-   * There is no block depot cached yet.
-   */
-  This->indexBlockDepotCached = 0xFFFFFFFF;
-  This->indexExtBlockDepotCached = 0xFFFFFFFF;
-
   /*
    * Start searching for free blocks with block 0.
    */
@@ -4685,15 +4900,19 @@ static HRESULT StorageImpl_Refresh(StorageImpl *This, BOOL new_object, BOOL crea
 
   This->firstFreeSmallBlock = 0;
 
-  /* Read the extended big block depot locations. */
+  /* Read the extended big block depot. */
   if (This->extBigBlockDepotCount != 0)
   {
     ULONG current_block = This->extBigBlockDepotStart;
     ULONG cache_size = This->extBigBlockDepotCount * 2;
-    ULONG i;
+    ULONG depotBlocksPerExtBlock = (This->bigBlockSize / sizeof(ULONG)) - 1;
+    BYTE depotBuffer[MAX_BIG_BLOCK_SIZE];
+    ULONG i, j, read;
 
     This->extBigBlockDepotLocations = HeapAlloc(GetProcessHeap(), 0, sizeof(ULONG) * cache_size);
-    if (!This->extBigBlockDepotLocations)
+    This->extBlockDepotMirror = HeapAlloc(GetProcessHeap(), 0,
+        sizeof(ULONG) * cache_size * depotBlocksPerExtBlock);
+    if (!This->extBigBlockDepotLocations || !This->extBlockDepotMirror)
     {
       return E_OUTOFMEMORY;
     }
@@ -4708,12 +4927,28 @@ static HRESULT StorageImpl_Refresh(StorageImpl *This, BOOL new_object, BOOL crea
         return STG_E_DOCFILECORRUPT;
       }
       This->extBigBlockDepotLocations[i] = current_block;
-      current_block = Storage32Impl_GetNextExtendedBlock(This, current_block);
+
+      hr = StorageImpl_ReadSectors(This, current_block, 0, depotBuffer, This->bigBlockSize, &read);
+      if (!read)
+      {
+        WARN("Can't read extended big block depot block %u.\n", current_block);
+        return STG_E_DOCFILECORRUPT;
+      }
+      hr = S_OK;
+
+      /* File ends during this block; fill the rest with 0's. */
+      memset(depotBuffer + read, 0, This->bigBlockSize - read);
+
+      for (j=0; j<depotBlocksPerExtBlock; j++)
+        StorageUtl_ReadDWord(depotBuffer, j*sizeof(ULONG),
+                             &This->extBlockDepotMirror[i*depotBlocksPerExtBlock+j]);
+
+      /* The last entry links to the next extended block. */
+      StorageUtl_ReadDWord(depotBuffer, depotBlocksPerExtBlock*sizeof(ULONG), &current_block);
     }
   }
   else
   {
-    This->extBigBlockDepotLocations = NULL;
     This->extBigBlockDepotLocationsSize = 0;
   }
 
@@ -5151,6 +5386,9 @@ static HRESULT StorageImpl_Flush(StorageBaseImpl *storage)
     if (This->blockChainCache[i])
       hr = BlockChainStream_Flush(This->blockChainCache[i]);
 
+  if (SUCCEEDED(hr))
+    hr = StorageImpl_SyncSectorCache(This, 0, ~0u, FALSE);
+
   if (SUCCEEDED(hr))
     hr = ILockBytes_Flush(This->lockBytes);
 
@@ -5177,6 +5415,9 @@ static void StorageImpl_Destroy(StorageBaseImpl* iface)
   StorageImpl_Invalidate(iface);
 
   HeapFree(GetProcessHeap(), 0, This->extBigBlockDepotLocations);
+  HeapFree(GetProcessHeap(), 0, This->extBlockDepotMirror);
+  HeapFree(GetProcessHeap(), 0, This->blockDepotMirror);
+  HeapFree(GetProcessHeap(), 0, This->blockDepotLoaded);
 
   BlockChainStream_Destroy(This->smallBlockRootChain);
   BlockChainStream_Destroy(This->rootBlockChain);
@@ -5185,6 +5426,9 @@ static void StorageImpl_Destroy(StorageBaseImpl* iface)
   for (i=0; i<BLOCKCHAIN_CACHE_SIZE; i++)
     BlockChainStream_Destroy(This->blockChainCache[i]);
 
+  /* The block chains were flushed above, anything left is written back here. */
+  StorageImpl_SyncSectorCache(This, 0, ~0u, TRUE);
+
   for (i=0; i<sizeof(This->locked_bytes)/sizeof(This->locked_bytes[0]); i++)
   {
     ULARGE_INTEGER offset, cb;
@@ -5275,6 +5519,8 @@ static HRESULT StorageImpl_Construct(
 
   list_init(&This->base.storageHead);
 
+  list_init(&This->sectorCache);
+
   This->base.IStorage_iface.lpVtbl = &StorageImpl_Vtbl;
   This->base.IPropertySetStorage_iface.lpVtbl = &IPropertySetStorage_Vtbl;
   This->base.IDirectWriterLock_iface.lpVtbl = &DirectWriterLockVtbl;
@@ -7194,6 +7440,26 @@ static ULONG BlockChainStream_GetSectorOfOffset(BlockChainStream *This, ULONG of
   return This->indexCache[min_run].firstSector + offset - This->indexCache[min_run].firstOffset;
 }
 
+/* Count the blocks from index on that follow each other in the file and are
+ * not in the block cache, up to max blocks. */
+static ULONG BlockChainStream_GetRunLength(BlockChainStream *This,
+    ULONG index, ULONG sector, ULONG max)
+{
+  ULONG count;
+
+  for (count = 1; count < max; count++)
+  {
+    if (This->cachedBlocks[0].index == index + count ||
+        This->cachedBlocks[1].index == index + count)
+      break;
+
+    if (BlockChainStream_GetSectorOfOffset(This, index + count) != sector + count)
+      break;
+  }
+
+  return count;
+}
+
 static HRESULT BlockChainStream_GetBlockAtOffset(BlockChainStream *This,
     ULONG index, BlockChainBlock **block, ULONG *sector, BOOL create)
 {
@@ -7593,6 +7859,7 @@ HRESULT BlockChainStream_ReadAt(BlockChainStream* This,
   ULONG offsetInBlock     = offset.QuadPart % This->parentStorage->bigBlockSize;
   ULONG bytesToReadInBuffer;
   ULONG blockIndex;
+  ULONG blockCount;
   BYTE* bufferWalker;
   ULARGE_INTEGER stream_size;
   HRESULT hr;
@@ -7620,7 +7887,6 @@ HRESULT BlockChainStream_ReadAt(BlockChainStream* This,
 
   while (size > 0)
   {
-    ULARGE_INTEGER ulOffset;
     DWORD bytesReadAt;
 
     /*
@@ -7634,14 +7900,22 @@ HRESULT BlockChainStream_ReadAt(BlockChainStream* This,
     if (FAILED(hr))
       return hr;
 
+    blockCount = 1;
+
     if (!cachedBlock)
     {
-      /* Not in cache, and we're going to read past the end of the block. */
-      ulOffset.QuadPart = StorageImpl_GetBigBlockOffset(This->parentStorage, blockIndex) +
-                               offsetInBlock;
+      /*
+       * Not in cache, and we're going to read past the end of the block.
+       * Read the following full blocks along with it, as long as they are
+       * contiguous in the file.
+       */
+      blockCount = BlockChainStream_GetRunLength(This, blockNoInSequence, blockIndex,
+          1 + (size - bytesToReadInBuffer - 1) / This->parentStorage->bigBlockSize);
+      bytesToReadInBuffer += (blockCount - 1) * This->parentStorage->bigBlockSize;
 
-      StorageImpl_ReadAt(This->parentStorage,
-           ulOffset,
+      StorageImpl_ReadSectors(This->parentStorage,
+           blockIndex,
+           offsetInBlock,
            bufferWalker,
            bytesToReadInBuffer,
            &bytesReadAt);
@@ -7661,7 +7935,7 @@ HRESULT BlockChainStream_ReadAt(BlockChainStream* This,
       bytesReadAt = bytesToReadInBuffer;
     }
 
-    blockNoInSequence++;
+    blockNoInSequence += blockCount;
     bufferWalker += bytesReadAt;
     size         -= bytesReadAt;
     *bytesRead   += bytesReadAt;
@@ -7690,6 +7964,7 @@ HRESULT BlockChainStream_WriteAt(BlockChainStream* This,
   ULONG offsetInBlock     = offset.QuadPart % This->parentStorage->bigBlockSize;
   ULONG bytesToWrite;
   ULONG blockIndex;
+  ULONG blockCount;
   const BYTE* bufferWalker;
   HRESULT hr;
   BlockChainBlock *cachedBlock;
@@ -7699,7 +7974,6 @@ HRESULT BlockChainStream_WriteAt(BlockChainStream* This,
 
   while (size > 0)
   {
-    ULARGE_INTEGER ulOffset;
     DWORD bytesWrittenAt;
 
     /*
@@ -7718,14 +7992,22 @@ HRESULT BlockChainStream_WriteAt(BlockChainStream* This,
       return hr;
     }
 
+    blockCount = 1;
+
     if (!cachedBlock)
     {
-      /* Not in cache, and we're going to write past the end of the block. */
-      ulOffset.QuadPart = StorageImpl_GetBigBlockOffset(This->parentStorage, blockIndex) +
-                               offsetInBlock;
+      /*
+       * Not in cache, and we're going to write past the end of the block.
+       * Write the following full blocks along with it, as long as they are
+       * contiguous in the file.
+       */
+      blockCount = BlockChainStream_GetRunLength(This, blockNoInSequence, blockIndex,
+          1 + (size - bytesToWrite - 1) / This->parentStorage->bigBlockSize);
+      bytesToWrite += (blockCount - 1) * This->parentStorage->bigBlockSize;
 
-      StorageImpl_WriteAt(This->parentStorage,
-           ulOffset,
+      StorageImpl_WriteSectors(This->parentStorage,
+           blockIndex,
+           offsetInBlock,
            bufferWalker,
            bytesToWrite,
            &bytesWrittenAt);
@@ -7745,7 +8027,7 @@ HRESULT BlockChainStream_WriteAt(BlockChainStream* This,
       cachedBlock->dirty = TRUE;
     }
 
-    blockNoInSequence++;
+    blockNoInSequence += blockCount;
     bufferWalker  += bytesWrittenAt;
     size          -= bytesWrittenAt;
     *bytesWritten += bytesWrittenAt;
@@ -353,6 +353,17 @@ void StorageBaseImpl_RemoveStream(StorageBaseImpl * stg, StgStreamImpl * strm) D
 /* Number of BlockChainStream objects to cache in a StorageImpl */
 #define BLOCKCHAIN_CACHE_SIZE 4
 
+/* Number of big blocks kept in the sector cache of a storage */
+#define SECTOR_CACHE_SIZE 64
+
+typedef struct SectorCacheEntry
+{
+  struct list entry;
+  ULONG sector;
+  BOOL  dirty;
+  BYTE  data[1];
+} SectorCacheEntry;
+
 /****************************************************************************
  * StorageImpl definitions.
  *
@@ -381,13 +392,27 @@ struct StorageImpl
   ULONG bigBlockDepotStart[COUNT_BBDEPOTINHEADER];
   ULONG transactionSig;
 
-  ULONG extBlockDepotCached[MAX_BIG_BLOCK_SIZE / 4];
-  ULONG indexExtBlockDepotCached;
+  /*
+   * Depot block locations stored in the extended depot blocks, the same
+   * number of extended blocks as extBigBlockDepotLocations.
+   */
+  ULONG *extBlockDepotMirror;
 
-  ULONG blockDepotCached[MAX_BIG_BLOCK_SIZE / 4];
-  ULONG indexBlockDepotCached;
+  /*
+   * In-memory copy of the big block depot, loaded one depot block at a time.
+   */
+  ULONG *blockDepotMirror;
+  BYTE  *blockDepotLoaded;
+  ULONG blockDepotMirrorSize;  /* in depot blocks */
   ULONG prevFreeBlock;
 
+  /*
+   * Recently used big blocks, most recently used first. Writes stay here
+   * until the storage is flushed.
+   */
+  struct list sectorCache;
+  ULONG sectorCacheCount;
+
   /* All small blocks before this one are known to be in use. */
   ULONG firstFreeSmallBlock;
 
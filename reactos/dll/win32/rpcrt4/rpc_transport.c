@@ -169,69 +169,6 @@ static RPC_STATUS rpcrt4_conn_open_pipe(RpcConnection *Connection, LPCSTR pname,
   return RPC_S_OK;
 }
 
-static char *ncalrpc_pipe_name(const char *endpoint)
-{
-  static const char prefix[] = "\\\\.\\pipe\\lrpc\\";
-  char *pipe_name;
-
-  /* protseq=ncalrpc: supposed to use NT LPC ports,
-   * but we'll implement it with named pipes for now */
-  pipe_name = I_RpcAllocate(sizeof(prefix) + strlen(endpoint));
-  strcat(strcpy(pipe_name, prefix), endpoint);
-  return pipe_name;
-}
-
-static RPC_STATUS rpcrt4_ncalrpc_open(RpcConnection* Connection)
-{
-  RpcConnection_np *npc = (RpcConnection_np *) Connection;
-  RPC_STATUS r;
-  LPSTR pname;
-
-  /* already connected? */
-  if (npc->pipe)
-    return RPC_S_OK;
-
-  pname = ncalrpc_pipe_name(Connection->Endpoint);
-  r = rpcrt4_conn_open_pipe(Connection, pname, TRUE);
-  I_RpcFree(pname);
-
-  return r;
-}
-
-static RPC_STATUS rpcrt4_protseq_ncalrpc_open_endpoint(RpcServerProtseq* protseq, const char *endpoint)
-{
-  RPC_STATUS r;
-  LPSTR pname;
-  RpcConnection *Connection;
-  char generated_endpoint[22];
-
-  if (!endpoint)
-  {
-    static LONG lrpc_nameless_id;
-    DWORD process_id = GetCurrentProcessId();
-    ULONG id = InterlockedIncrement(&lrpc_nameless_id);
-    snprintf(generated_endpoint, sizeof(generated_endpoint),
-             "LRPC%08x.%08x", process_id, id);
-    endpoint = generated_endpoint;
-  }
-
-  r = RPCRT4_CreateConnection(&Connection, TRUE, protseq->Protseq, NULL,
-                              endpoint, NULL, NULL, NULL, NULL);
-  if (r != RPC_S_OK)
-      return r;
-
-  pname = ncalrpc_pipe_name(Connection->Endpoint);
-  r = rpcrt4_conn_create_pipe(Connection, pname);
-  I_RpcFree(pname);
-
-  EnterCriticalSection(&protseq->cs);
-  list_add_head(&protseq->listeners, &Connection->protseq_entry);
-  Connection->protseq = protseq;
-  LeaveCriticalSection(&protseq->cs);
-
-  return r;
-}
-
 static char *ncacn_pipe_name(const char *endpoint)
 {
   static const char prefix[] = "\\\\.";
@@ -344,42 +281,6 @@ static RPC_STATUS rpcrt4_ncacn_np_is_server_listening(const char *endpoint)
   return status;
 }
 
-static RPC_STATUS rpcrt4_ncalrpc_np_is_server_listening(const char *endpoint)
-{
-  char *pipe_name;
-  RPC_STATUS status;
-
-  pipe_name = ncalrpc_pipe_name(endpoint);
-  status = is_pipe_listening(pipe_name);
-  I_RpcFree(pipe_name);
-  return status;
-}
-
-static RPC_STATUS rpcrt4_ncalrpc_handoff(RpcConnection *old_conn, RpcConnection *new_conn)
-{
-  DWORD len = MAX_COMPUTERNAME_LENGTH + 1;
-  RPC_STATUS status;
-  LPSTR pname;
-
-  TRACE("%s\n", old_conn->Endpoint);
-
-  rpcrt4_conn_np_handoff((RpcConnection_np *)old_conn, (RpcConnection_np *)new_conn);
-
-  pname = ncalrpc_pipe_name(old_conn->Endpoint);
-  status = rpcrt4_conn_create_pipe(old_conn, pname);
-  I_RpcFree(pname);
-
-  /* Store the local computer name as the NetworkAddr for ncalrpc. */
-  new_conn->NetworkAddr = HeapAlloc(GetProcessHeap(), 0, len);
-  if (!GetComputerNameA(new_conn->NetworkAddr, &len))
-  {
-    ERR("Failed to retrieve the computer name, error %u\n", GetLastError());
-    return RPC_S_OUT_OF_RESOURCES;
-  }
-
-  return status;
-}
-
 static int rpcrt4_conn_np_read(RpcConnection *conn, void *buffer, unsigned int count)
 {
     RpcConnection_np *connection = (RpcConnection_np *) conn;
@@ -531,258 +432,1360 @@ static size_t rpcrt4_ncacn_np_get_top_of_tower(unsigned char *tower_data,
     else
         tower_data[0] = 0;
 
-    return size;
+    return size;
+}
+
+static RPC_STATUS rpcrt4_ncacn_np_parse_top_of_tower(const unsigned char *tower_data,
+                                                     size_t tower_size,
+                                                     char **networkaddr,
+                                                     char **endpoint)
+{
+    const twr_empty_floor_t *smb_floor = (const twr_empty_floor_t *)tower_data;
+    const twr_empty_floor_t *nb_floor;
+
+    TRACE("(%p, %d, %p, %p)\n", tower_data, (int)tower_size, networkaddr, endpoint);
+
+    if (tower_size < sizeof(*smb_floor))
+        return EPT_S_NOT_REGISTERED;
+
+    tower_data += sizeof(*smb_floor);
+    tower_size -= sizeof(*smb_floor);
+
+    if ((smb_floor->count_lhs != sizeof(smb_floor->protid)) ||
+        (smb_floor->protid != EPM_PROTOCOL_SMB) ||
+        (smb_floor->count_rhs > tower_size) ||
+        (tower_data[smb_floor->count_rhs - 1] != '\0'))
+        return EPT_S_NOT_REGISTERED;
+
+    if (endpoint)
+    {
+        *endpoint = I_RpcAllocate(smb_floor->count_rhs);
+        if (!*endpoint)
+            return RPC_S_OUT_OF_RESOURCES;
+        memcpy(*endpoint, tower_data, smb_floor->count_rhs);
+    }
+    tower_data += smb_floor->count_rhs;
+    tower_size -= smb_floor->count_rhs;
+
+    if (tower_size < sizeof(*nb_floor))
+        return EPT_S_NOT_REGISTERED;
+
+    nb_floor = (const twr_empty_floor_t *)tower_data;
+
+    tower_data += sizeof(*nb_floor);
+    tower_size -= sizeof(*nb_floor);
+
+    if ((nb_floor->count_lhs != sizeof(nb_floor->protid)) ||
+        (nb_floor->protid != EPM_PROTOCOL_NETBIOS) ||
+        (nb_floor->count_rhs > tower_size) ||
+        (tower_data[nb_floor->count_rhs - 1] != '\0'))
+        return EPT_S_NOT_REGISTERED;
+
+    if (networkaddr)
+    {
+        *networkaddr = I_RpcAllocate(nb_floor->count_rhs);
+        if (!*networkaddr)
+        {
+            if (endpoint)
+            {
+                I_RpcFree(*endpoint);
+                *endpoint = NULL;
+            }
+            return RPC_S_OUT_OF_RESOURCES;
+        }
+        memcpy(*networkaddr, tower_data, nb_floor->count_rhs);
+    }
+
+    return RPC_S_OK;
+}
+
+static RPC_STATUS rpcrt4_conn_np_impersonate_client(RpcConnection *conn)
+{
+    RpcConnection_np *npc = (RpcConnection_np *)conn;
+    BOOL ret;
+
+    TRACE("(%p)\n", conn);
+
+    if (conn->AuthInfo && SecIsValidHandle(&conn->ctx))
+        return RPCRT4_default_impersonate_client(conn);
+
+    ret = ImpersonateNamedPipeClient(npc->pipe);
+    if (!ret)
+    {
+        DWORD error = GetLastError();
+        WARN("ImpersonateNamedPipeClient failed with error %u\n", error);
+        switch (error)
+        {
+        case ERROR_CANNOT_IMPERSONATE:
+            return RPC_S_NO_CONTEXT_AVAILABLE;
+        }
+    }
+    return RPC_S_OK;
+}
+
+static RPC_STATUS rpcrt4_conn_np_revert_to_self(RpcConnection *conn)
+{
+    BOOL ret;
+
+    TRACE("(%p)\n", conn);
+
+    if (conn->AuthInfo && SecIsValidHandle(&conn->ctx))
+        return RPCRT4_default_revert_to_self(conn);
+
+    ret = RevertToSelf();
+    if (!ret)
+    {
+        WARN("RevertToSelf failed with error %u\n", GetLastError());
+        return RPC_S_NO_CONTEXT_AVAILABLE;
+    }
+    return RPC_S_OK;
+}
+
+typedef struct _RpcServerProtseq_np
+{
+    RpcServerProtseq common;
+    HANDLE mgr_event;
+} RpcServerProtseq_np;
+
+static RpcServerProtseq *rpcrt4_protseq_np_alloc(void)
+{
+    RpcServerProtseq_np *ps = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*ps));
+    if (ps)
+        ps->mgr_event = CreateEventW(NULL, FALSE, FALSE, NULL);
+    return &ps->common;
+}
+
+static void rpcrt4_protseq_np_signal_state_changed(RpcServerProtseq *protseq)
+{
+    RpcServerProtseq_np *npps = CONTAINING_RECORD(protseq, RpcServerProtseq_np, common);
+    SetEvent(npps->mgr_event);
+}
+
+static void *rpcrt4_protseq_np_get_wait_array(RpcServerProtseq *protseq, void *prev_array, unsigned int *count)
+{
+    HANDLE *objs = prev_array;
+    RpcConnection_np *conn;
+    RpcServerProtseq_np *npps = CONTAINING_RECORD(protseq, RpcServerProtseq_np, common);
+    
+    EnterCriticalSection(&protseq->cs);
+    
+    /* open and count connections */
+    *count = 1;
+    LIST_FOR_EACH_ENTRY(conn, &protseq->listeners, RpcConnection_np, common.protseq_entry)
+    {
+        if (!conn->listen_event)
+        {
+            NTSTATUS status;
+            HANDLE event;
+
+            event = get_np_event(conn);
+            if (!event)
+                continue;
+
+            status = NtFsControlFile(conn->pipe, event, NULL, NULL, &conn->io_status, FSCTL_PIPE_LISTEN, NULL, 0, NULL, 0);
+            switch (status)
+            {
+            case STATUS_SUCCESS:
+            case STATUS_PIPE_CONNECTED:
+                conn->io_status.u.Status = status;
+                SetEvent(event);
+                break;
+            case STATUS_PENDING:
+                break;
+            default:
+                ERR("pipe listen error %x\n", status);
+                continue;
+            }
+
+            conn->listen_event = event;
+        }
+        (*count)++;
+    }
+    
+    /* make array of connections */
+    if (objs)
+        objs = HeapReAlloc(GetProcessHeap(), 0, objs, *count*sizeof(HANDLE));
+    else
+        objs = HeapAlloc(GetProcessHeap(), 0, *count*sizeof(HANDLE));
+    if (!objs)
+    {
+        ERR("couldn't allocate objs\n");
+        LeaveCriticalSection(&protseq->cs);
+        return NULL;
+    }
+    
+    objs[0] = npps->mgr_event;
+    *count = 1;
+    LIST_FOR_EACH_ENTRY(conn, &protseq->listeners, RpcConnection_np, common.protseq_entry)
+    {
+        if (conn->listen_event)
+            objs[(*count)++] = conn->listen_event;
+    }
+    LeaveCriticalSection(&protseq->cs);
+    return objs;
+}
+
+static void rpcrt4_protseq_np_free_wait_array(RpcServerProtseq *protseq, void *array)
+{
+    HeapFree(GetProcessHeap(), 0, array);
+}
+
+static int rpcrt4_protseq_np_wait_for_new_connection(RpcServerProtseq *protseq, unsigned int count, void *wait_array)
+{
+    HANDLE b_handle;
+    HANDLE *objs = wait_array;
+    DWORD res;
+    RpcConnection *cconn = NULL;
+    RpcConnection_np *conn;
+    
+    if (!objs)
+        return -1;
+
+    do
+    {
+        /* an alertable wait isn't strictly necessary, but due to our
+         * overlapped I/O implementation in Wine we need to free some memory
+         * by the file user APC being called, even if no completion routine was
+         * specified at the time of starting the async operation */
+        res = WaitForMultipleObjectsEx(count, objs, FALSE, INFINITE, TRUE);
+    } while (res == WAIT_IO_COMPLETION);
+
+    if (res == WAIT_OBJECT_0)
+        return 0;
+    else if (res == WAIT_FAILED)
+    {
+        ERR("wait failed with error %d\n", GetLastError());
+        return -1;
+    }
+    else
+    {
+        b_handle = objs[res - WAIT_OBJECT_0];
+        /* find which connection got a RPC */
+        EnterCriticalSection(&protseq->cs);
+        LIST_FOR_EACH_ENTRY(conn, &protseq->listeners, RpcConnection_np, common.protseq_entry)
+        {
+            if (b_handle == conn->listen_event)
+            {
+                release_np_event(conn, conn->listen_event);
+                conn->listen_event = NULL;
+                if (conn->io_status.u.Status == STATUS_SUCCESS || conn->io_status.u.Status == STATUS_PIPE_CONNECTED)
+                    cconn = rpcrt4_spawn_connection(&conn->common);
+                else
+                    ERR("listen failed %x\n", conn->io_status.u.Status);
+                break;
+            }
+        }
+        LeaveCriticalSection(&protseq->cs);
+        if (!cconn)
+        {
+            ERR("failed to locate connection for handle %p\n", b_handle);
+            return -1;
+        }
+        RPCRT4_new_client(cconn);
+        return 1;
+    }
+}
+
+/**** ncalrpc support ****/
+
+/*
+ * protseq=ncalrpc: NT LPC ports.
+ *
+ * Fragments that fit in a port message are carried inline. Larger ones are
+ * copied through a section that the client creates when it connects and
+ * that the kernel maps into both processes: the first half of the view
+ * carries data to the server, the second half data to the client. Messages
+ * pointing into the view are sent as requests, and the writer waits for the
+ * reader's reply before reusing its half.
+ *
+ * Everything the clients of an endpoint send arrives on its connection port,
+ * so a thread per endpoint receives it and queues it on the connection it
+ * belongs to. Clients receive directly on their own port.
+ *
+ * A thread waiting on a port can't wait for anything else, so the endpoint
+ * thread is woken up by a message on its own connection port when the
+ * listening state changes, and a client cancelling a call asks the server
+ * to send it a message.
+ *
+ * Nothing is sent to a client when the server process dies, its port just
+ * gets disconnected. A waiting client pings the server every now and then,
+ * which fails once the server is gone.
+ */
+
+#define LRPC_MESSAGE_SIZE 256
+#define LRPC_VIEW_SIZE    0x10000
+#define LRPC_HALF_VIEW    (LRPC_VIEW_SIZE / 2)
+
+/* how long a client waits for the server before checking it is still there */
+#define LRPC_PING_INTERVAL 2000
+
+/* LPC message types, see ndk/lpctypes.h */
+#define LRPC_LPC_REQUEST            1
+#define LRPC_LPC_DATAGRAM           3
+#define LRPC_LPC_PORT_CLOSED        5
+#define LRPC_LPC_CLIENT_DIED        6
+#define LRPC_LPC_CONNECTION_REQUEST 10
+
+/* connection information flags */
+#define LRPC_CONNECT_PROBE 0x1
+
+/* PORT_MESSAGE, PORT_VIEW and REMOTE_PORT_VIEW from ndk/lpctypes.h, the
+ * structures in winternl.h only have the same layout on 32-bit */
+typedef struct _LRPC_PORT_MESSAGE
+{
+    USHORT DataLength;
+    USHORT TotalLength;
+    USHORT Type;
+    USHORT DataInfoOffset;
+    CLIENT_ID ClientId;
+    ULONG MessageId;
+    SIZE_T ClientViewSize;
+} LRPC_PORT_MESSAGE;
+
+typedef struct _LRPC_PORT_VIEW
+{
+    ULONG Length;
+    HANDLE SectionHandle;
+    ULONG SectionOffset;
+    SIZE_T ViewSize;
+    PVOID ViewBase;
+    PVOID ViewRemoteBase;
+} LRPC_PORT_VIEW;
+
+typedef struct _LRPC_REMOTE_PORT_VIEW
+{
+    ULONG Length;
+    SIZE_T ViewSize;
+    PVOID ViewBase;
+} LRPC_REMOTE_PORT_VIEW;
+
+enum lrpc_message_kind
+{
+    LRPC_DATA,  /* the data follows the message header */
+    LRPC_VIEW,  /* the data is in the sender's half of the view */
+    LRPC_WAKE,  /* wakes up the receiver, no data */
+    LRPC_CLOSE, /* the server closed the connection */
+    LRPC_PING   /* the client checks that the server is still there */
+};
+
+typedef struct _LRPC_MESSAGE
+{
+    LRPC_PORT_MESSAGE header;
+    /* connection requests carry the connection flags here */
+    ULONG kind;
+    ULONG length;
+    BYTE data[LRPC_MESSAGE_SIZE - sizeof(LRPC_PORT_MESSAGE) - 2 * sizeof(ULONG)];
+} LRPC_MESSAGE;
+
+#define LRPC_BODY_SIZE (FIELD_OFFSET(LRPC_MESSAGE, data) - sizeof(LRPC_PORT_MESSAGE))
+
+struct lrpc_packet
+{
+    struct list entry;
+    LRPC_MESSAGE msg;
+};
+
+struct lrpc_endpoint
+{
+    LONG refs;
+    HANDLE port;
+    HANDLE thread;
+    RpcConnection *listener;   /* held by the thread */
+    CRITICAL_SECTION cs;
+    struct list connections;   /* CS cs */
+    struct list deferred;      /* connection requests received before listening, CS cs */
+    ULONG next_id;             /* thread only */
+    BOOL listening;            /* CS cs */
+    BOOL stopping;             /* CS cs */
+    /* connection being accepted, handed over to the new connection */
+    HANDLE accepted_port;
+    BYTE *accepted_view;
+    ULONG accepted_id;
+};
+
+typedef struct _RpcConnection_lrpc
+{
+    RpcConnection common;
+    HANDLE port;
+    BYTE *send_view;
+    BYTE *recv_view;
+    /* message being read */
+    LRPC_MESSAGE msg;
+    const BYTE *msg_data;
+    ULONG msg_offset;
+    ULONG msg_length;
+    /* client: the first message has been sent; server: the client's token
+     * has been captured */
+    BOOL identified;
+    LONG cancelled;
+    /* server only */
+    BOOL stopped;              /* listener no longer listening */
+    struct lrpc_endpoint *endpoint;
+    struct list endpoint_entry;
+    ULONG id;
+    struct list packets;       /* CS endpoint->cs */
+    HANDLE packet_event;
+    HANDLE token;
+    BOOL read_closed;          /* CS endpoint->cs */
+    BOOL disconnected;         /* CS endpoint->cs */
+} RpcConnection_lrpc;
+
+static RpcConnection *rpcrt4_conn_lrpc_alloc(void)
+{
+  RpcConnection_lrpc *lrpc = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(RpcConnection_lrpc));
+  if (!lrpc)
+    return NULL;
+  list_init(&lrpc->endpoint_entry);
+  list_init(&lrpc->packets);
+  return &lrpc->common;
+}
+
+static WCHAR *ncalrpc_port_name(const char *endpoint)
+{
+  static const WCHAR prefix[] = {'\\','R','P','C',' ','C','o','n','t','r','o','l','\\',0};
+  WCHAR *port_name;
+  int len;
+
+  len = MultiByteToWideChar(CP_ACP, 0, endpoint, -1, NULL, 0);
+  port_name = I_RpcAllocate(sizeof(prefix) + len * sizeof(WCHAR));
+  if (!port_name)
+    return NULL;
+  strcpyW(port_name, prefix);
+  MultiByteToWideChar(CP_ACP, 0, endpoint, -1, port_name + ARRAYSIZE(prefix) - 1, len);
+  return port_name;
+}
+
+static NTSTATUS ncalrpc_connect_port(const char *endpoint, SECURITY_QUALITY_OF_SERVICE *qos,
+                                     LRPC_PORT_VIEW *view, ULONG flags, HANDLE *port)
+{
+  UNICODE_STRING name;
+  ULONG info_length = sizeof(flags);
+  WCHAR *port_name;
+  NTSTATUS status;
+
+  port_name = ncalrpc_port_name(endpoint);
+  if (!port_name)
+    return STATUS_NO_MEMORY;
+  RtlInitUnicodeString(&name, port_name);
+  status = NtConnectPort(port, &name, qos, (PLPC_SECTION_WRITE)view, NULL, NULL,
+                         &flags, &info_length);
+  I_RpcFree(port_name);
+  return status;
+}
+
+static void lrpc_endpoint_release(struct lrpc_endpoint *endpoint)
+{
+  struct lrpc_packet *packet, *next;
+
+  if (InterlockedDecrement(&endpoint->refs))
+    return;
+
+  LIST_FOR_EACH_ENTRY_SAFE(packet, next, &endpoint->deferred, struct lrpc_packet, entry)
+  {
+    NtAcceptConnectPort(&endpoint->accepted_port, 0, (PLPC_MESSAGE)&packet->msg, FALSE, NULL, NULL);
+    HeapFree(GetProcessHeap(), 0, packet);
+  }
+  if (endpoint->thread)
+    CloseHandle(endpoint->thread);
+  NtClose(endpoint->port);
+  endpoint->cs.DebugInfo->Spare[0] = 0;
+  DeleteCriticalSection(&endpoint->cs);
+  HeapFree(GetProcessHeap(), 0, endpoint);
+}
+
+static RpcConnection_lrpc *lrpc_endpoint_find(struct lrpc_endpoint *endpoint, ULONG id)
+{
+  RpcConnection_lrpc *lrpc;
+
+  LIST_FOR_EACH_ENTRY(lrpc, &endpoint->connections, RpcConnection_lrpc, endpoint_entry)
+    if (lrpc->id == id)
+      return lrpc;
+  return NULL;
+}
+
+static void lrpc_reply(HANDLE port, const LRPC_PORT_MESSAGE *request)
+{
+  LRPC_PORT_MESSAGE reply = *request;
+  NTSTATUS status;
+
+  reply.DataLength = 0;
+  reply.TotalLength = sizeof(reply);
+  reply.Type = 0;
+  reply.DataInfoOffset = 0;
+  status = NtReplyPort(port, (PLPC_MESSAGE)&reply);
+  if (status)
+    WARN("NtReplyPort failed with status 0x%08x\n", status);
+}
+
+static NTSTATUS lrpc_send_control(HANDLE port, ULONG kind)
+{
+  LRPC_MESSAGE msg;
+
+  memset(&msg.header, 0, sizeof(msg.header));
+  msg.header.DataLength = LRPC_BODY_SIZE;
+  msg.header.TotalLength = sizeof(msg.header) + LRPC_BODY_SIZE;
+  msg.kind = kind;
+  msg.length = 0;
+  return NtRequestPort(port, (PLPC_MESSAGE)&msg);
+}
+
+/* makes the endpoint thread look at the endpoint state again, a message on
+ * a connection port is queued on the port itself */
+static void lrpc_endpoint_wake(struct lrpc_endpoint *endpoint)
+{
+  NTSTATUS status = lrpc_send_control(endpoint->port, LRPC_WAKE);
+  if (status)
+    WARN("waking up the endpoint thread failed with status 0x%08x\n", status);
+}
+
+static void lrpc_endpoint_accept(struct lrpc_endpoint *endpoint, LRPC_MESSAGE *request)
+{
+  LRPC_REMOTE_PORT_VIEW view;
+  RpcConnection *conn;
+  NTSTATUS status;
+
+  view.Length = sizeof(view);
+  view.ViewSize = 0;
+  view.ViewBase = NULL;
+
+  endpoint->accepted_id = ++endpoint->next_id;
+  if (!endpoint->accepted_id)
+    endpoint->accepted_id = ++endpoint->next_id;
+
+  status = NtAcceptConnectPort(&endpoint->accepted_port, endpoint->accepted_id, (PLPC_MESSAGE)request,
+                               TRUE, NULL, (PLPC_SECTION_READ)&view);
+  if (status)
+  {
+    WARN("NtAcceptConnectPort failed with status 0x%08x\n", status);
+    return;
+  }
+  endpoint->accepted_view = view.ViewSize >= LRPC_VIEW_SIZE ? view.ViewBase : NULL;
+
+  conn = rpcrt4_spawn_connection(endpoint->listener);
+  if (!conn)
+  {
+    ERR("failed to create a connection for endpoint %s\n", endpoint->listener->Endpoint);
+    NtClose(endpoint->accepted_port);
+    endpoint->accepted_port = NULL;
+    return;
+  }
+
+  NtCompleteConnectPort(((RpcConnection_lrpc *)conn)->port);
+  RPCRT4_new_client(conn);
+}
+
+static void lrpc_endpoint_connection_request(struct lrpc_endpoint *endpoint, LRPC_MESSAGE *request)
+{
+  struct lrpc_packet *packet;
+  BOOL listening, stopping;
+  HANDLE port;
+
+  EnterCriticalSection(&endpoint->cs);
+  listening = endpoint->listening;
+  stopping = endpoint->stopping;
+  LeaveCriticalSection(&endpoint->cs);
+
+  if (request->header.DataLength >= sizeof(ULONG) && (request->kind & LRPC_CONNECT_PROBE))
+  {
+    /* somebody only wants to know whether we are listening */
+    if (NtAcceptConnectPort(&port, 0, (PLPC_MESSAGE)request, listening && !stopping, NULL, NULL) == STATUS_SUCCESS &&
+        listening && !stopping)
+    {
+      NtCompleteConnectPort(port);
+      NtClose(port);
+    }
+    return;
+  }
+
+  if (stopping)
+  {
+    NtAcceptConnectPort(&port, 0, (PLPC_MESSAGE)request, FALSE, NULL, NULL);
+    return;
+  }
+
+  if (!listening)
+  {
+    /* leave the client waiting until the server starts listening, like a
+     * pipe nobody listens on yet */
+    packet = HeapAlloc(GetProcessHeap(), 0, sizeof(*packet));
+    if (!packet)
+    {
+      NtAcceptConnectPort(&port, 0, (PLPC_MESSAGE)request, FALSE, NULL, NULL);
+      return;
+    }
+    packet->msg = *request;
+    EnterCriticalSection(&endpoint->cs);
+    list_add_tail(&endpoint->deferred, &packet->entry);
+    LeaveCriticalSection(&endpoint->cs);
+    return;
+  }
+
+  lrpc_endpoint_accept(endpoint, request);
+}
+
+static void lrpc_endpoint_route(struct lrpc_endpoint *endpoint, ULONG id, LRPC_MESSAGE *msg)
+{
+  USHORT type = msg->header.Type & 0xff;
+  struct lrpc_packet *packet = NULL;
+  RpcConnection_lrpc *lrpc;
+  BOOL queued = FALSE;
+
+  if (type == LRPC_LPC_DATAGRAM || type == LRPC_LPC_REQUEST)
+  {
+    if (msg->header.DataLength >= LRPC_BODY_SIZE && msg->kind == LRPC_WAKE)
+    {
+      /* the client cancels a call, wake up its receiving thread */
+      EnterCriticalSection(&endpoint->cs);
+      lrpc = lrpc_endpoint_find(endpoint, id);
+      if (lrpc && lrpc->port)
+        lrpc_send_control(lrpc->port, LRPC_WAKE);
+      LeaveCriticalSection(&endpoint->cs);
+      if (type == LRPC_LPC_REQUEST)
+        lrpc_reply(endpoint->port, &msg->header);
+      return;
+    }
+    if (msg->header.DataLength >= LRPC_BODY_SIZE && msg->kind == LRPC_PING)
+    {
+      /* getting here is all the client wanted */
+      if (type == LRPC_LPC_REQUEST)
+        lrpc_reply(endpoint->port, &msg->header);
+      return;
+    }
+    packet = HeapAlloc(GetProcessHeap(), 0, sizeof(*packet));
+    if (packet)
+      packet->msg = *msg;
+  }
+
+  EnterCriticalSection(&endpoint->cs);
+  lrpc = lrpc_endpoint_find(endpoint, id);
+  if (lrpc)
+  {
+    /* the client went away, or we lost part of the stream */
+    if (packet)
+    {
+      list_add_tail(&lrpc->packets, &packet->entry);
+      queued = TRUE;
+    }
+    else
+      lrpc->disconnected = TRUE;
+    SetEvent(lrpc->packet_event);
+  }
+  LeaveCriticalSection(&endpoint->cs);
+
+  if (!queued)
+  {
+    /* don't leave a client waiting for a reply nobody would send */
+    if (type == LRPC_LPC_REQUEST)
+      lrpc_reply(endpoint->port, &msg->header);
+    HeapFree(GetProcessHeap(), 0, packet);
+  }
+}
+
+static DWORD CALLBACK lrpc_endpoint_thread(LPVOID arg)
+{
+  struct lrpc_endpoint *endpoint = arg;
+  struct lrpc_packet *packet;
+  RpcConnection_lrpc *lrpc;
+  LRPC_MESSAGE msg;
+  PVOID context;
+  NTSTATUS status;
+  BOOL done;
+
+  for (;;)
+  {
+    /* accept the connections that came in before the server was listening */
+    EnterCriticalSection(&endpoint->cs);
+    packet = NULL;
+    if (endpoint->listening || endpoint->stopping)
+    {
+      struct list *head = list_head(&endpoint->deferred);
+      if (head)
+      {
+        packet = LIST_ENTRY(head, struct lrpc_packet, entry);
+        list_remove(&packet->entry);
+      }
+    }
+    done = endpoint->stopping && list_empty(&endpoint->connections);
+    LeaveCriticalSection(&endpoint->cs);
+
+    if (packet)
+    {
+      lrpc_endpoint_connection_request(endpoint, &packet->msg);
+      HeapFree(GetProcessHeap(), 0, packet);
+      continue;
+    }
+    if (done)
+      break;
+
+    context = NULL;
+    status = NtReplyWaitReceivePortEx(endpoint->port, &context, NULL, (PPORT_MESSAGE)&msg, NULL);
+    if (status)
+    {
+      ERR("NtReplyWaitReceivePortEx failed with status 0x%08x\n", status);
+      break;
+    }
+
+    /* sent by lrpc_endpoint_wake, the clients all have a context */
+    if (!context && (msg.header.Type & 0xff) == LRPC_LPC_DATAGRAM)
+      continue;
+
+    switch (msg.header.Type & 0xff)
+    {
+    case LRPC_LPC_CONNECTION_REQUEST:
+      lrpc_endpoint_connection_request(endpoint, &msg);
+      break;
+    case LRPC_LPC_REQUEST:
+    case LRPC_LPC_DATAGRAM:
+    case LRPC_LPC_PORT_CLOSED:
+    case LRPC_LPC_CLIENT_DIED:
+      lrpc_endpoint_route(endpoint, (ULONG)(ULONG_PTR)context, &msg);
+      break;
+    default:
+      TRACE("ignoring message of type %u\n", msg.header.Type);
+      break;
+    }
+  }
+
+  /* nothing will arrive for the remaining connections any more */
+  EnterCriticalSection(&endpoint->cs);
+  LIST_FOR_EACH_ENTRY(lrpc, &endpoint->connections, RpcConnection_lrpc, endpoint_entry)
+  {
+    lrpc->disconnected = TRUE;
+    SetEvent(lrpc->packet_event);
+  }
+  LeaveCriticalSection(&endpoint->cs);
+
+  RPCRT4_ReleaseConnection(endpoint->listener);
+  lrpc_endpoint_release(endpoint);
+  return 0;
+}
+
+static RPC_STATUS rpcrt4_ncalrpc_open(RpcConnection* Connection)
+{
+  RpcConnection_lrpc *lrpc = (RpcConnection_lrpc *) Connection;
+  SECURITY_QUALITY_OF_SERVICE qos;
+  LRPC_PORT_VIEW view;
+  NTSTATUS status;
+
+  /* already connected? */
+  if (lrpc->port)
+    return RPC_S_OK;
+
+  qos.Length = sizeof(qos);
+  qos.ImpersonationLevel = SecurityImpersonation;
+  qos.ContextTrackingMode = SECURITY_STATIC_TRACKING;
+  qos.EffectiveOnly = FALSE;
+  if (Connection->QOS)
+  {
+    switch (Connection->QOS->qos->ImpersonationType)
+    {
+      case RPC_C_IMP_LEVEL_DEFAULT:
+        /* FIXME: what to do here? */
+        break;
+      case RPC_C_IMP_LEVEL_ANONYMOUS:
+        qos.ImpersonationLevel = SecurityAnonymous;
+        break;
+      case RPC_C_IMP_LEVEL_IDENTIFY:
+        qos.ImpersonationLevel = SecurityIdentification;
+        break;
+      case RPC_C_IMP_LEVEL_IMPERSONATE:
+        qos.ImpersonationLevel = SecurityImpersonation;
+        break;
+      case RPC_C_IMP_LEVEL_DELEGATE:
+        qos.ImpersonationLevel = SecurityDelegation;
+        break;
+    }
+    if (Connection->QOS->qos->IdentityTracking == RPC_C_QOS_IDENTITY_DYNAMIC)
+      qos.ContextTrackingMode = SECURITY_DYNAMIC_TRACKING;
+  }
+
+  view.Length = sizeof(view);
+  view.SectionHandle = CreateFileMappingW(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, LRPC_VIEW_SIZE, NULL);
+  if (!view.SectionHandle)
+  {
+    WARN("CreateFileMapping failed with error %u\n", GetLastError());
+    return RPC_S_OUT_OF_RESOURCES;
+  }
+  view.SectionOffset = 0;
+  view.ViewSize = LRPC_VIEW_SIZE;
+  view.ViewBase = NULL;
+  view.ViewRemoteBase = NULL;
+
+  TRACE("connecting to %s\n", Connection->Endpoint);
+  status = ncalrpc_connect_port(Connection->Endpoint, &qos, &view, 0, &lrpc->port);
+  CloseHandle(view.SectionHandle);
+  if (status)
+  {
+    WARN("connection failed, status=%08x\n", status);
+    lrpc->port = NULL;
+    return RPC_S_SERVER_UNAVAILABLE;
+  }
+
+  lrpc->send_view = view.ViewBase;
+  lrpc->recv_view = lrpc->send_view + LRPC_HALF_VIEW;
+  return RPC_S_OK;
+}
+
+static RPC_STATUS rpcrt4_protseq_ncalrpc_open_endpoint(RpcServerProtseq* protseq, const char *endpoint)
+{
+  RPC_STATUS r;
+  RpcConnection *Connection;
+  RpcConnection_lrpc *lrpc;
+  struct lrpc_endpoint *ep;
+  OBJECT_ATTRIBUTES attr;
+  SECURITY_DESCRIPTOR sd;
+  UNICODE_STRING name;
+  WCHAR *port_name;
+  NTSTATUS status;
+  char generated_endpoint[22];
+
+  if (!endpoint)
+  {
+    static LONG lrpc_nameless_id;
+    DWORD process_id = GetCurrentProcessId();
+    ULONG id = InterlockedIncrement(&lrpc_nameless_id);
+    snprintf(generated_endpoint, sizeof(generated_endpoint),
+             "LRPC%08x.%08x", process_id, id);
+    endpoint = generated_endpoint;
+  }
+
+  r = RPCRT4_CreateConnection(&Connection, TRUE, protseq->Protseq, NULL,
+                              endpoint, NULL, NULL, NULL, NULL);
+  if (r != RPC_S_OK)
+      return r;
+  lrpc = (RpcConnection_lrpc *) Connection;
+
+  ep = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*ep));
+  port_name = ncalrpc_port_name(Connection->Endpoint);
+  if (!ep || !port_name)
+  {
+    HeapFree(GetProcessHeap(), 0, ep);
+    I_RpcFree(port_name);
+    RPCRT4_ReleaseConnection(Connection);
+    return RPC_S_OUT_OF_RESOURCES;
+  }
+
+  /* like the pipes this replaces, anybody may connect, the interfaces do
+   * their own access checks */
+  InitializeSecurityDescriptor(&sd, SECURITY_DESCRIPTOR_REVISION);
+  SetSecurityDescriptorDacl(&sd, TRUE, NULL, FALSE);
+
+  TRACE("listening on %s\n", Connection->Endpoint);
+  RtlInitUnicodeString(&name, port_name);
+  InitializeObjectAttributes(&attr, &name, 0, NULL, &sd);
+  status = NtCreatePort(&ep->port, &attr, sizeof(ULONG), LRPC_MESSAGE_SIZE, NULL);
+  I_RpcFree(port_name);
+  if (status)
+  {
+    WARN("NtCreatePort failed with status 0x%08x\n", status);
+    HeapFree(GetProcessHeap(), 0, ep);
+    RPCRT4_ReleaseConnection(Connection);
+    if (status == STATUS_OBJECT_NAME_COLLISION)
+      return RPC_S_DUPLICATE_ENDPOINT;
+    else
+      return RPC_S_CANT_CREATE_ENDPOINT;
+  }
+
+  ep->refs = 2;
+  InitializeCriticalSection(&ep->cs);
+  ep->cs.DebugInfo->Spare[0] = (DWORD_PTR)(__FILE__ ": lrpc_endpoint.cs");
+  list_init(&ep->connections);
+  list_init(&ep->deferred);
+  ep->listener = RPCRT4_GrabConnection(Connection);
+  lrpc->endpoint = ep;
+
+  /* the thread receives from the start, so that clients connecting before
+   * the server listens wait instead of failing */
+  ep->thread = CreateThread(NULL, 0, lrpc_endpoint_thread, ep, 0, NULL);
+  if (!ep->thread)
+  {
+    ERR("failed to create thread, error=%u\n", GetLastError());
+    RPCRT4_ReleaseConnection(Connection);
+    lrpc_endpoint_release(ep);
+    RPCRT4_ReleaseConnection(Connection);
+    return RPC_S_OUT_OF_RESOURCES;
+  }
+
+  EnterCriticalSection(&protseq->cs);
+  list_add_head(&protseq->listeners, &Connection->protseq_entry);
+  Connection->protseq = protseq;
+  LeaveCriticalSection(&protseq->cs);
+
+  return RPC_S_OK;
+}
+
+static RPC_STATUS rpcrt4_ncalrpc_handoff(RpcConnection *old_conn, RpcConnection *new_conn)
+{
+  RpcConnection_lrpc *listener = (RpcConnection_lrpc *) old_conn;
+  RpcConnection_lrpc *lrpc = (RpcConnection_lrpc *) new_conn;
+  struct lrpc_endpoint *endpoint = listener->endpoint;
+  DWORD len = MAX_COMPUTERNAME_LENGTH + 1;
+
+  TRACE("%s\n", old_conn->Endpoint);
+
+  /* take over the port the endpoint thread has just accepted */
+  lrpc->port = endpoint->accepted_port;
+  endpoint->accepted_port = NULL;
+  if (endpoint->accepted_view)
+  {
+    lrpc->recv_view = endpoint->accepted_view;
+    lrpc->send_view = lrpc->recv_view + LRPC_HALF_VIEW;
+  }
+  lrpc->packet_event = CreateEventW(NULL, FALSE, FALSE, NULL);
+  lrpc->id = endpoint->accepted_id;
+  lrpc->endpoint = endpoint;
+  InterlockedIncrement(&endpoint->refs);
+
+  EnterCriticalSection(&endpoint->cs);
+  list_add_tail(&endpoint->connections, &lrpc->endpoint_entry);
+  LeaveCriticalSection(&endpoint->cs);
+
+  /* Store the local computer name as the NetworkAddr for ncalrpc. */
+  new_conn->NetworkAddr = HeapAlloc(GetProcessHeap(), 0, len);
+  if (!GetComputerNameA(new_conn->NetworkAddr, &len))
+  {
+    ERR("Failed to retrieve the computer name, error %u\n", GetLastError());
+    return RPC_S_OUT_OF_RESOURCES;
+  }
+
+  return RPC_S_OK;
+}
+
+static RPC_STATUS rpcrt4_ncalrpc_is_server_listening(const char *endpoint)
+{
+  SECURITY_QUALITY_OF_SERVICE qos;
+  NTSTATUS status;
+  HANDLE port;
+
+  qos.Length = sizeof(qos);
+  qos.ImpersonationLevel = SecurityAnonymous;
+  qos.ContextTrackingMode = SECURITY_STATIC_TRACKING;
+  qos.EffectiveOnly = TRUE;
+
+  status = ncalrpc_connect_port(endpoint, &qos, NULL, LRPC_CONNECT_PROBE, &port);
+  if (status)
+    return RPC_S_NOT_LISTENING;
+  NtClose(port);
+  return RPC_S_OK;
+}
+
+/* waits for the next message of a server connection */
+static BOOL rpcrt4_conn_lrpc_receive_queued(RpcConnection_lrpc *lrpc)
+{
+  struct lrpc_endpoint *endpoint = lrpc->endpoint;
+  struct lrpc_packet *packet = NULL;
+  struct list *head;
+
+  EnterCriticalSection(&endpoint->cs);
+  while (!lrpc->read_closed)
+  {
+    head = list_head(&lrpc->packets);
+    if (head)
+    {
+      packet = LIST_ENTRY(head, struct lrpc_packet, entry);
+      list_remove(&packet->entry);
+      break;
+    }
+    if (lrpc->disconnected)
+      break;
+    LeaveCriticalSection(&endpoint->cs);
+    WaitForSingleObject(lrpc->packet_event, INFINITE);
+    EnterCriticalSection(&endpoint->cs);
+  }
+  LeaveCriticalSection(&endpoint->cs);
+
+  if (!packet)
+    return FALSE;
+  lrpc->msg = packet->msg;
+  HeapFree(GetProcessHeap(), 0, packet);
+  return TRUE;
+}
+
+/* waits for the next message of a client connection */
+static BOOL rpcrt4_conn_lrpc_receive_port(RpcConnection_lrpc *lrpc)
+{
+  LARGE_INTEGER timeout;
+  NTSTATUS status;
+  USHORT type;
+
+  timeout.QuadPart = -(LONGLONG)LRPC_PING_INTERVAL * 10000;
+  for (;;)
+  {
+    if (InterlockedExchange(&lrpc->cancelled, FALSE))
+      return FALSE;
+
+    status = NtReplyWaitReceivePortEx(lrpc->port, NULL, NULL, (PPORT_MESSAGE)&lrpc->msg, &timeout);
+    if (status == STATUS_TIMEOUT)
+    {
+      /* the port of a server that died is disconnected */
+      status = lrpc_send_control(lrpc->port, LRPC_PING);
+      if (status)
+      {
+        WARN("the server went away, status 0x%08x\n", status);
+        return FALSE;
+      }
+      continue;
+    }
+    if (status)
+    {
+      WARN("NtReplyWaitReceivePortEx failed with status 0x%08x\n", status);
+      return FALSE;
+    }
+
+    type = lrpc->msg.header.Type & 0xff;
+    if (type == LRPC_LPC_DATAGRAM && lrpc->msg.header.DataLength >= LRPC_BODY_SIZE &&
+        lrpc->msg.kind == LRPC_WAKE)
+      continue;
+    if (type == LRPC_LPC_REQUEST || type == LRPC_LPC_DATAGRAM)
+      return TRUE;
+    TRACE("ignoring message of type %u\n", lrpc->msg.header.Type);
+  }
+}
+
+/* remembers who the client is, it is only possible to find out while the
+ * client waits for a reply */
+static void rpcrt4_conn_lrpc_identify_client(RpcConnection_lrpc *lrpc)
+{
+  NTSTATUS status;
+
+  lrpc->identified = TRUE;
+  status = NtImpersonateClientOfPort(lrpc->port, (PPORT_MESSAGE)&lrpc->msg.header);
+  if (status)
+  {
+    WARN("NtImpersonateClientOfPort failed with status 0x%08x\n", status);
+    return;
+  }
+  if (!OpenThreadToken(GetCurrentThread(), TOKEN_IMPERSONATE | TOKEN_QUERY, TRUE, &lrpc->token))
+    WARN("OpenThreadToken failed with error %u\n", GetLastError());
+  RevertToSelf();
+}
+
+static void rpcrt4_conn_lrpc_release_message(RpcConnection_lrpc *lrpc)
+{
+  if ((lrpc->msg.header.Type & 0xff) == LRPC_LPC_REQUEST)
+  {
+    if (lrpc->common.server && !lrpc->identified)
+      rpcrt4_conn_lrpc_identify_client(lrpc);
+    lrpc_reply(lrpc->port, &lrpc->msg.header);
+  }
+  lrpc->msg_offset = lrpc->msg_length = 0;
+}
+
+static BOOL rpcrt4_conn_lrpc_next_message(RpcConnection_lrpc *lrpc)
+{
+  BOOL ret;
+
+  if (lrpc->common.server)
+    ret = rpcrt4_conn_lrpc_receive_queued(lrpc);
+  else
+    ret = rpcrt4_conn_lrpc_receive_port(lrpc);
+  if (!ret)
+    return FALSE;
+
+  lrpc->msg_offset = 0;
+  lrpc->msg_length = 0;
+  if (lrpc->msg.header.DataLength >= LRPC_BODY_SIZE)
+  {
+    switch (lrpc->msg.kind)
+    {
+    case LRPC_DATA:
+      if (lrpc->msg.length <= lrpc->msg.header.DataLength - LRPC_BODY_SIZE)
+      {
+        lrpc->msg_data = lrpc->msg.data;
+        lrpc->msg_length = lrpc->msg.length;
+      }
+      break;
+    case LRPC_VIEW:
+      if (lrpc->recv_view && lrpc->msg.length <= LRPC_HALF_VIEW)
+      {
+        lrpc->msg_data = lrpc->recv_view;
+        lrpc->msg_length = lrpc->msg.length;
+      }
+      break;
+    case LRPC_CLOSE:
+      TRACE("connection closed by the server\n");
+      return FALSE;
+    }
+  }
+
+  if (!lrpc->msg_length)
+  {
+    WARN("invalid message, kind %u length %u\n", lrpc->msg.kind, lrpc->msg.length);
+    rpcrt4_conn_lrpc_release_message(lrpc);
+    return FALSE;
+  }
+  return TRUE;
 }
 
-static RPC_STATUS rpcrt4_ncacn_np_parse_top_of_tower(const unsigned char *tower_data,
-                                                     size_t tower_size,
-                                                     char **networkaddr,
-                                                     char **endpoint)
+static int rpcrt4_conn_lrpc_read(RpcConnection *conn, void *buffer, unsigned int count)
 {
-    const twr_empty_floor_t *smb_floor = (const twr_empty_floor_t *)tower_data;
-    const twr_empty_floor_t *nb_floor;
+  RpcConnection_lrpc *lrpc = (RpcConnection_lrpc *) conn;
+  BYTE *data = buffer;
+  unsigned int done = 0, len;
 
-    TRACE("(%p, %d, %p, %p)\n", tower_data, (int)tower_size, networkaddr, endpoint);
+  while (done < count)
+  {
+    if (lrpc->msg_offset == lrpc->msg_length)
+    {
+      if (!rpcrt4_conn_lrpc_next_message(lrpc))
+        return -1;
+    }
 
-    if (tower_size < sizeof(*smb_floor))
-        return EPT_S_NOT_REGISTERED;
+    len = min(count - done, lrpc->msg_length - lrpc->msg_offset);
+    memcpy(data + done, lrpc->msg_data + lrpc->msg_offset, len);
+    lrpc->msg_offset += len;
+    done += len;
 
-    tower_data += sizeof(*smb_floor);
-    tower_size -= sizeof(*smb_floor);
+    /* let the writer reuse its half of the view */
+    if (lrpc->msg_offset == lrpc->msg_length)
+      rpcrt4_conn_lrpc_release_message(lrpc);
+  }
+  return count;
+}
 
-    if ((smb_floor->count_lhs != sizeof(smb_floor->protid)) ||
-        (smb_floor->protid != EPM_PROTOCOL_SMB) ||
-        (smb_floor->count_rhs > tower_size) ||
-        (tower_data[smb_floor->count_rhs - 1] != '\0'))
-        return EPT_S_NOT_REGISTERED;
+static int rpcrt4_conn_lrpc_write(RpcConnection *conn, const void *buffer, unsigned int count)
+{
+  RpcConnection_lrpc *lrpc = (RpcConnection_lrpc *) conn;
+  const BYTE *data = buffer;
+  unsigned int done = 0, len;
+  LRPC_MESSAGE msg;
+  NTSTATUS status;
 
-    if (endpoint)
+  while (done < count)
+  {
+    len = count - done;
+    memset(&msg.header, 0, sizeof(msg.header));
+    if (len <= sizeof(msg.data))
     {
-        *endpoint = I_RpcAllocate(smb_floor->count_rhs);
-        if (!*endpoint)
-            return RPC_S_OUT_OF_RESOURCES;
-        memcpy(*endpoint, tower_data, smb_floor->count_rhs);
+      msg.kind = LRPC_DATA;
+      memcpy(msg.data, data + done, len);
+      msg.header.DataLength = LRPC_BODY_SIZE + len;
     }
-    tower_data += smb_floor->count_rhs;
-    tower_size -= smb_floor->count_rhs;
-
-    if (tower_size < sizeof(*nb_floor))
-        return EPT_S_NOT_REGISTERED;
+    else
+    {
+      if (!lrpc->send_view)
+        return -1;
+      if (len > LRPC_HALF_VIEW)
+        len = LRPC_HALF_VIEW;
+      msg.kind = LRPC_VIEW;
+      memcpy(lrpc->send_view, data + done, len);
+      msg.header.DataLength = LRPC_BODY_SIZE;
+    }
+    msg.length = len;
+    msg.header.TotalLength = sizeof(msg.header) + msg.header.DataLength;
 
-    nb_floor = (const twr_empty_floor_t *)tower_data;
+    /* the first message of a client also waits, so that the server can
+     * find out who is calling */
+    if (msg.kind == LRPC_VIEW || (!conn->server && !lrpc->identified))
+    {
+      lrpc->identified = TRUE;
+      status = NtRequestWaitReplyPort(lrpc->port, (PLPC_MESSAGE)&msg, (PLPC_MESSAGE)&msg);
+    }
+    else
+      status = NtRequestPort(lrpc->port, (PLPC_MESSAGE)&msg);
+    if (status)
+    {
+      WARN("sending failed with status 0x%08x\n", status);
+      return -1;
+    }
+    done += len;
+  }
+  return count;
+}
 
-    tower_data += sizeof(*nb_floor);
-    tower_size -= sizeof(*nb_floor);
+static int rpcrt4_conn_lrpc_close(RpcConnection *conn)
+{
+  RpcConnection_lrpc *lrpc = (RpcConnection_lrpc *) conn;
+  struct lrpc_endpoint *endpoint = lrpc->endpoint;
+  struct lrpc_packet *packet, *next;
+  BOOL last;
 
-    if ((nb_floor->count_lhs != sizeof(nb_floor->protid)) ||
-        (nb_floor->protid != EPM_PROTOCOL_NETBIOS) ||
-        (nb_floor->count_rhs > tower_size) ||
-        (tower_data[nb_floor->count_rhs - 1] != '\0'))
-        return EPT_S_NOT_REGISTERED;
+  if (endpoint && !lrpc->id)
+  {
+    /* a listener, the endpoint thread keeps using it until the last
+     * connection is gone */
+    if (!lrpc->stopped)
+    {
+      lrpc->stopped = TRUE;
+      EnterCriticalSection(&endpoint->cs);
+      endpoint->stopping = TRUE;
+      LeaveCriticalSection(&endpoint->cs);
+      lrpc_endpoint_wake(endpoint);
+      lrpc_endpoint_release(endpoint);
+    }
+  }
+  else if (endpoint)
+  {
+    EnterCriticalSection(&endpoint->cs);
+    list_remove(&lrpc->endpoint_entry);
+    last = endpoint->stopping && list_empty(&endpoint->connections);
+    LeaveCriticalSection(&endpoint->cs);
+    /* the endpoint thread waits for the last connection to go away */
+    if (last)
+      lrpc_endpoint_wake(endpoint);
+    LIST_FOR_EACH_ENTRY_SAFE(packet, next, &lrpc->packets, struct lrpc_packet, entry)
+    {
+      if ((packet->msg.header.Type & 0xff) == LRPC_LPC_REQUEST)
+        lrpc_reply(lrpc->port, &packet->msg.header);
+      list_remove(&packet->entry);
+      HeapFree(GetProcessHeap(), 0, packet);
+    }
+    lrpc->endpoint = NULL;
+    lrpc_endpoint_release(endpoint);
+  }
 
-    if (networkaddr)
+  if (lrpc->port)
+  {
+    if (conn->server)
     {
-        *networkaddr = I_RpcAllocate(nb_floor->count_rhs);
-        if (!*networkaddr)
-        {
-            if (endpoint)
-            {
-                I_RpcFree(*endpoint);
-                *endpoint = NULL;
-            }
-            return RPC_S_OUT_OF_RESOURCES;
-        }
-        memcpy(*networkaddr, tower_data, nb_floor->count_rhs);
+      /* the client would not notice otherwise */
+      lrpc_send_control(lrpc->port, LRPC_CLOSE);
     }
+    NtClose(lrpc->port);
+    lrpc->port = NULL;
+  }
+  if (lrpc->packet_event)
+  {
+    CloseHandle(lrpc->packet_event);
+    lrpc->packet_event = NULL;
+  }
+  if (lrpc->token)
+  {
+    CloseHandle(lrpc->token);
+    lrpc->token = NULL;
+  }
+  return 0;
+}
 
-    return RPC_S_OK;
+static void rpcrt4_conn_lrpc_cancel_call(RpcConnection *conn)
+{
+  RpcConnection_lrpc *lrpc = (RpcConnection_lrpc *) conn;
+  InterlockedExchange(&lrpc->cancelled, TRUE);
+  /* the server sends it back, which wakes up the receiving thread */
+  if (!conn->server && lrpc->port)
+    lrpc_send_control(lrpc->port, LRPC_WAKE);
 }
 
-static RPC_STATUS rpcrt4_conn_np_impersonate_client(RpcConnection *conn)
+static void rpcrt4_conn_lrpc_close_read(RpcConnection *conn)
 {
-    RpcConnection_np *npc = (RpcConnection_np *)conn;
-    BOOL ret;
+  RpcConnection_lrpc *lrpc = (RpcConnection_lrpc *) conn;
+  struct lrpc_endpoint *endpoint = lrpc->endpoint;
 
-    TRACE("(%p)\n", conn);
+  if (!endpoint)
+  {
+    rpcrt4_conn_lrpc_cancel_call(conn);
+    return;
+  }
 
-    if (conn->AuthInfo && SecIsValidHandle(&conn->ctx))
-        return RPCRT4_default_impersonate_client(conn);
+  EnterCriticalSection(&endpoint->cs);
+  lrpc->read_closed = TRUE;
+  if (lrpc->packet_event)
+    SetEvent(lrpc->packet_event);
+  LeaveCriticalSection(&endpoint->cs);
+}
 
-    ret = ImpersonateNamedPipeClient(npc->pipe);
-    if (!ret)
-    {
-        DWORD error = GetLastError();
-        WARN("ImpersonateNamedPipeClient failed with error %u\n", error);
-        switch (error)
-        {
-        case ERROR_CANNOT_IMPERSONATE:
-            return RPC_S_NO_CONTEXT_AVAILABLE;
-        }
-    }
-    return RPC_S_OK;
+static int rpcrt4_conn_lrpc_wait_for_incoming_data(RpcConnection *Connection)
+{
+  /* FIXME: messages can't be peeked at on a port */
+  return -1;
 }
 
-static RPC_STATUS rpcrt4_conn_np_revert_to_self(RpcConnection *conn)
+static RPC_STATUS rpcrt4_conn_lrpc_impersonate_client(RpcConnection *conn)
 {
-    BOOL ret;
+  RpcConnection_lrpc *lrpc = (RpcConnection_lrpc *) conn;
 
-    TRACE("(%p)\n", conn);
+  TRACE("(%p)\n", conn);
 
-    if (conn->AuthInfo && SecIsValidHandle(&conn->ctx))
-        return RPCRT4_default_revert_to_self(conn);
+  if (conn->AuthInfo && SecIsValidHandle(&conn->ctx))
+    return RPCRT4_default_impersonate_client(conn);
 
-    ret = RevertToSelf();
-    if (!ret)
-    {
-        WARN("RevertToSelf failed with error %u\n", GetLastError());
-        return RPC_S_NO_CONTEXT_AVAILABLE;
-    }
-    return RPC_S_OK;
+  if (!lrpc->token)
+    return RPC_S_NO_CONTEXT_AVAILABLE;
+  if (!SetThreadToken(NULL, lrpc->token))
+  {
+    WARN("SetThreadToken failed with error %u\n", GetLastError());
+    return RPC_S_NO_CONTEXT_AVAILABLE;
+  }
+  return RPC_S_OK;
 }
 
-typedef struct _RpcServerProtseq_np
+typedef struct _RpcServerProtseq_lrpc
 {
     RpcServerProtseq common;
     HANDLE mgr_event;
-} RpcServerProtseq_np;
+} RpcServerProtseq_lrpc;
 
-static RpcServerProtseq *rpcrt4_protseq_np_alloc(void)
+static RpcServerProtseq *rpcrt4_protseq_lrpc_alloc(void)
 {
-    RpcServerProtseq_np *ps = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*ps));
+    RpcServerProtseq_lrpc *ps = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*ps));
     if (ps)
         ps->mgr_event = CreateEventW(NULL, FALSE, FALSE, NULL);
     return &ps->common;
 }
 
-static void rpcrt4_protseq_np_signal_state_changed(RpcServerProtseq *protseq)
+static void rpcrt4_protseq_lrpc_signal_state_changed(RpcServerProtseq *protseq)
 {
-    RpcServerProtseq_np *npps = CONTAINING_RECORD(protseq, RpcServerProtseq_np, common);
-    SetEvent(npps->mgr_event);
+    RpcServerProtseq_lrpc *lrpcps = CONTAINING_RECORD(protseq, RpcServerProtseq_lrpc, common);
+    SetEvent(lrpcps->mgr_event);
 }
 
-static void *rpcrt4_protseq_np_get_wait_array(RpcServerProtseq *protseq, void *prev_array, unsigned int *count)
+static void *rpcrt4_protseq_lrpc_get_wait_array(RpcServerProtseq *protseq, void *prev_array, unsigned int *count)
 {
+    RpcServerProtseq_lrpc *lrpcps = CONTAINING_RECORD(protseq, RpcServerProtseq_lrpc, common);
+    RpcConnection_lrpc *conn;
     HANDLE *objs = prev_array;
-    RpcConnection_np *conn;
-    RpcServerProtseq_np *npps = CONTAINING_RECORD(protseq, RpcServerProtseq_np, common);
-    
+    BOOL wake;
+
+    /* the endpoint threads accept the connections, let them know that the
+     * server is listening now */
     EnterCriticalSection(&protseq->cs);
-    
-    /* open and count connections */
-    *count = 1;
-    LIST_FOR_EACH_ENTRY(conn, &protseq->listeners, RpcConnection_np, common.protseq_entry)
+    LIST_FOR_EACH_ENTRY(conn, &protseq->listeners, RpcConnection_lrpc, common.protseq_entry)
     {
-        if (!conn->listen_event)
-        {
-            NTSTATUS status;
-            HANDLE event;
-
-            event = get_np_event(conn);
-            if (!event)
-                continue;
-
-            status = NtFsControlFile(conn->pipe, event, NULL, NULL, &conn->io_status, FSCTL_PIPE_LISTEN, NULL, 0, NULL, 0);
-            switch (status)
-            {
-            case STATUS_SUCCESS:
-            case STATUS_PIPE_CONNECTED:
-                conn->io_status.u.Status = status;
-                SetEvent(event);
-                break;
-            case STATUS_PENDING:
-                break;
-            default:
-                ERR("pipe listen error %x\n", status);
-                continue;
-            }
-
-            conn->listen_event = event;
-        }
-        (*count)++;
+        if (!conn->endpoint || conn->stopped)
+            continue;
+        EnterCriticalSection(&conn->endpoint->cs);
+        wake = !conn->endpoint->listening;
+        conn->endpoint->listening = TRUE;
+        LeaveCriticalSection(&conn->endpoint->cs);
+        /* accept the clients that connected before */
+        if (wake)
+            lrpc_endpoint_wake(conn->endpoint);
     }
-    
-    /* make array of connections */
-    if (objs)
-        objs = HeapReAlloc(GetProcessHeap(), 0, objs, *count*sizeof(HANDLE));
-    else
-        objs = HeapAlloc(GetProcessHeap(), 0, *count*sizeof(HANDLE));
+    LeaveCriticalSection(&protseq->cs);
+
+    if (!objs)
+        objs = HeapAlloc(GetProcessHeap(), 0, sizeof(HANDLE));
     if (!objs)
     {
         ERR("couldn't allocate objs\n");
-        LeaveCriticalSection(&protseq->cs);
         return NULL;
     }
-    
-    objs[0] = npps->mgr_event;
+    objs[0] = lrpcps->mgr_event;
     *count = 1;
-    LIST_FOR_EACH_ENTRY(conn, &protseq->listeners, RpcConnection_np, common.protseq_entry)
-    {
-        if (conn->listen_event)
-            objs[(*count)++] = conn->listen_event;
-    }
-    LeaveCriticalSection(&protseq->cs);
     return objs;
 }
 
-static void rpcrt4_protseq_np_free_wait_array(RpcServerProtseq *protseq, void *array)
+static void rpcrt4_protseq_lrpc_free_wait_array(RpcServerProtseq *protseq, void *array)
 {
     HeapFree(GetProcessHeap(), 0, array);
 }
 
-static int rpcrt4_protseq_np_wait_for_new_connection(RpcServerProtseq *protseq, unsigned int count, void *wait_array)
+static int rpcrt4_protseq_lrpc_wait_for_new_connection(RpcServerProtseq *protseq, unsigned int count, void *wait_array)
 {
-    HANDLE b_handle;
     HANDLE *objs = wait_array;
     DWORD res;
-    RpcConnection *cconn = NULL;
-    RpcConnection_np *conn;
-    
+
     if (!objs)
         return -1;
 
-    do
-    {
-        /* an alertable wait isn't strictly necessary, but due to our
-         * overlapped I/O implementation in Wine we need to free some memory
-         * by the file user APC being called, even if no completion routine was
-         * specified at the time of starting the async operation */
-        res = WaitForMultipleObjectsEx(count, objs, FALSE, INFINITE, TRUE);
-    } while (res == WAIT_IO_COMPLETION);
-
+    /* new connections are handed to RPCRT4_new_client by the endpoint
+     * threads, all we wait for are state changes */
+    res = WaitForMultipleObjects(count, objs, FALSE, INFINITE);
     if (res == WAIT_OBJECT_0)
         return 0;
-    else if (res == WAIT_FAILED)
-    {
-        ERR("wait failed with error %d\n", GetLastError());
-        return -1;
-    }
-    else
-    {
-        b_handle = objs[res - WAIT_OBJECT_0];
-        /* find which connection got a RPC */
-        EnterCriticalSection(&protseq->cs);
-        LIST_FOR_EACH_ENTRY(conn, &protseq->listeners, RpcConnection_np, common.protseq_entry)
-        {
-            if (b_handle == conn->listen_event)
-            {
-                release_np_event(conn, conn->listen_event);
-                conn->listen_event = NULL;
-                if (conn->io_status.u.Status == STATUS_SUCCESS || conn->io_status.u.Status == STATUS_PIPE_CONNECTED)
-                    cconn = rpcrt4_spawn_connection(&conn->common);
-                else
-                    ERR("listen failed %x\n", conn->io_status.u.Status);
-                break;
-            }
-        }
-        LeaveCriticalSection(&protseq->cs);
-        if (!cconn)
-        {
-            ERR("failed to locate connection for handle %p\n", b_handle);
-            return -1;
-        }
-        RPCRT4_new_client(cconn);
-        return 1;
-    }
+
+    ERR("wait failed with error %d\n", GetLastError());
+    return -1;
 }
 
 static size_t rpcrt4_ncalrpc_get_top_of_tower(unsigned char *tower_data,
@@ -3170,23 +4173,23 @@ static const struct connection_ops conn_protseq_list[] = {
   },
   { "ncalrpc",
     { EPM_PROTOCOL_NCALRPC, EPM_PROTOCOL_PIPE },
-    rpcrt4_conn_np_alloc,
+    rpcrt4_conn_lrpc_alloc,
     rpcrt4_ncalrpc_open,
     rpcrt4_ncalrpc_handoff,
-    rpcrt4_conn_np_read,
-    rpcrt4_conn_np_write,
-    rpcrt4_conn_np_close,
-    rpcrt4_conn_np_close_read,
-    rpcrt4_conn_np_cancel_call,
-    rpcrt4_ncalrpc_np_is_server_listening,
-    rpcrt4_conn_np_wait_for_incoming_data,
+    rpcrt4_conn_lrpc_read,
+    rpcrt4_conn_lrpc_write,
+    rpcrt4_conn_lrpc_close,
+    rpcrt4_conn_lrpc_close_read,
+    rpcrt4_conn_lrpc_cancel_call,
+    rpcrt4_ncalrpc_is_server_listening,
+    rpcrt4_conn_lrpc_wait_for_incoming_data,
     rpcrt4_ncalrpc_get_top_of_tower,
     rpcrt4_ncalrpc_parse_top_of_tower,
     NULL,
     rpcrt4_ncalrpc_is_authorized,
     rpcrt4_ncalrpc_authorize,
     rpcrt4_ncalrpc_secure_packet,
-    rpcrt4_conn_np_impersonate_client,
+    rpcrt4_conn_lrpc_impersonate_client,
     rpcrt4_conn_np_revert_to_self,
     rpcrt4_ncalrpc_inquire_auth_client,
   },
@@ -3250,11 +4253,11 @@ static const struct protseq_ops protseq_list[] =
     },
     {
         "ncalrpc",
-        rpcrt4_protseq_np_alloc,
-        rpcrt4_protseq_np_signal_state_changed,
-        rpcrt4_protseq_np_get_wait_array,
-        rpcrt4_protseq_np_free_wait_array,
-        rpcrt4_protseq_np_wait_for_new_connection,
+        rpcrt4_protseq_lrpc_alloc,
+        rpcrt4_protseq_lrpc_signal_state_changed,
+        rpcrt4_protseq_lrpc_get_wait_array,
+        rpcrt4_protseq_lrpc_free_wait_array,
+        rpcrt4_protseq_lrpc_wait_for_new_connection,
         rpcrt4_protseq_ncalrpc_open_endpoint,
     },
     {
@@ -298,6 +298,7 @@ Ext2ClearFlag(PULONG Flags, ULONG FlagBit)
 #define EXT2_FLIST_MAGIC        'LF2E'
 #define EXT2_PARAM_MAGIC        'PP2E'
 #define EXT2_RWC_MAGIC          'WR2E'
+#define EXT2_MHASH_MAGIC        'HM2E'
 
 //
 // Bug Check Codes Definitions
@@ -897,6 +898,16 @@ struct _EXT2_MCB {
         PEXT2_MCB                   Target; // Target Mcb of symlink
     };
 
+    // Hashed index of children, built when a directory caches
+    // more than EXT2_MCB_HASH_THRESHOLD entries
+    PEXT2_MCB                      *ChildHash;
+    ULONG                           ChildHashSize;
+    ULONG                           ChildCount;
+
+    // Hash of the case-folded short name and bucket link
+    ULONG                           NameHash;
+    PEXT2_MCB                       HashNext;
+
     // Mcb Node Info
 
     // -> Fcb
@@ -945,6 +956,13 @@ struct _EXT2_MCB {
 #define MCB_TYPE_SPECIAL            0x40000000  /* unresolved symlink + device node */
 #define MCB_TYPE_SYMLINK            0x80000000
 
+//
+// Child hash table sizing for MCB
+//
+#define EXT2_MCB_HASH_THRESHOLD     8
+#define EXT2_MCB_HASH_MIN_SIZE      32
+#define EXT2_MCB_HASH_MAX_SIZE      4096
+
 #define IsMcbUsed(Mcb)          ((Mcb)->Refercount > 0)
 #define IsMcbSymLink(Mcb)       IsFlagOn((Mcb)->Flags, MCB_TYPE_SYMLINK)
 #define IsZoneInited(Mcb)       IsFlagOn((Mcb)->Flags, MCB_ZONE_INITED)
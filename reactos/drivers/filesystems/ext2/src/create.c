@@ -268,6 +268,93 @@ Ext2IsSpecialSystemFile(
     return FALSE;
 }
 
+/*
+ * Resolve a path only from the cached Mcb tree, holding McbLock shared
+ * so concurrent opens of hot paths do not serialize on the volume. Any
+ * miss or unusual node makes it give up and lets Ext2LookupFile redo
+ * the walk exclusively, where new Mcbs can be created.
+ */
+
+static BOOLEAN
+Ext2LookupCachedFile (
+    IN PEXT2_VCB            Vcb,
+    IN PUNICODE_STRING      FullName,
+    IN PEXT2_MCB            Parent,
+    OUT PEXT2_MCB *         Ext2Mcb
+)
+{
+    UNICODE_STRING  FileName;
+    PEXT2_MCB       Mcb = NULL;
+    USHORT          i = 0, End;
+    BOOLEAN         bFound = FALSE;
+
+    ExAcquireResourceSharedLite(&Vcb->McbLock, TRUE);
+
+    if (FullName->Buffer[0] == L'\\' || !Parent) {
+        Parent = Vcb->McbTree;
+    }
+
+    if (!Parent || !IsMcbDirectory(Parent)) {
+        goto errorout;
+    }
+
+    if (IsMcbSymLink(Parent)) {
+        Parent = Parent->Target;
+        if (!Parent || IsFileDeleted(Parent)) {
+            goto errorout;
+        }
+    }
+
+    End = FullName->Length/sizeof(WCHAR);
+    if (End == 0 || FullName->Buffer[End - 1] == L'\\') {
+        /* leave root and directory-only opens to the full lookup */
+        goto errorout;
+    }
+
+    Ext2ReferMcb(Parent);
+
+    while (i < End) {
+
+        USHORT Start;
+
+        while (i < End && FullName->Buffer[i] == L'\\') i++;
+        Start = i;
+        while (i < End && (FullName->Buffer[i] != L'\\')) i++;
+
+        FileName = *FullName;
+        FileName.Buffer += Start;
+        FileName.Length = (USHORT)((i - Start) * 2);
+
+        /* symlinks in the middle of the path are followed by the full walk */
+        if (!IsMcbDirectory(Parent) || IsMcbSymLink(Parent)) {
+            Ext2DerefMcb(Parent);
+            goto errorout;
+        }
+
+        Mcb = Ext2SearchMcbWithoutLock(Parent, &FileName);
+        Ext2DerefMcb(Parent);
+        if (!Mcb) {
+            goto errorout;
+        }
+
+        /* stale symlinks are fixed up under the exclusive lock */
+        if (IsMcbSymLink(Mcb) && IsFileDeleted(Mcb->Target)) {
+            Ext2DerefMcb(Mcb);
+            goto errorout;
+        }
+
+        Parent = Mcb;
+    }
+
+    *Ext2Mcb = Mcb;
+    bFound = TRUE;
+
+errorout:
+
+    ExReleaseResourceLite(&Vcb->McbLock);
+    return bFound;
+}
+
 NTSTATUS
 Ext2LookupFile (
     IN PEXT2_IRP_CONTEXT    IrpContext,
@@ -291,6 +378,14 @@ Ext2LookupFile (
     BOOLEAN         LockAcquired = FALSE;
     BOOLEAN         bNotFollow = FALSE;
 
+    /* fast path: the whole path is already cached. symlink lookups
+       (nested or not to be followed) always take the full walk */
+    *Ext2Mcb = NULL;
+    if (FullName->Length && Linkdep == 0 &&
+        Ext2LookupCachedFile(Vcb, FullName, Parent, Ext2Mcb)) {
+        return STATUS_SUCCESS;
+    }
+
     _SEH2_TRY {
 
         ExAcquireResourceExclusiveLite(&Vcb->McbLock, TRUE);
@@ -1573,14 +1573,21 @@ Ext2SetRenameInfo(
 
         }
 
-        if (TargetMcb->Inode.i_ino != ParentMcb->Inode.i_ino) {
-            Ext2RemoveMcb(Vcb, Mcb);
-            Ext2InsertMcb(Vcb, TargetMcb, Mcb);
-        }
+        /* detach Mcb so it gets rehashed under its new name */
+        Ext2RemoveMcb(Vcb, Mcb);
 
         if (!Ext2BuildName( &Mcb->ShortName,
                             &FileName, NULL     )) {
             Status = STATUS_INSUFFICIENT_RESOURCES;
+        }
+
+        if (TargetMcb->Inode.i_ino != ParentMcb->Inode.i_ino) {
+            Ext2InsertMcb(Vcb, TargetMcb, Mcb);
+        } else {
+            Ext2InsertMcb(Vcb, ParentMcb, Mcb);
+        }
+
+        if (!NT_SUCCESS(Status)) {
             goto errorout;
         }
 
@@ -1581,6 +1581,12 @@ Ext2FreeMcb (IN PEXT2_VCB Vcb, IN PEXT2_MCB Mcb)
         Ext2FreePool(Mcb->FullName.Buffer, EXT2_FNAME_MAGIC);
     }
 
+    /* free hashed children index */
+    if (Mcb->ChildHash) {
+        Ext2FreePool(Mcb->ChildHash, EXT2_MHASH_MAGIC);
+        Mcb->ChildHash = NULL;
+    }
+
     /* free dentry */
     if (Mcb->de) {
         Ext2FreeEntry(Mcb->de);
@@ -1594,6 +1600,77 @@ Ext2FreeMcb (IN PEXT2_VCB Vcb, IN PEXT2_MCB Mcb)
 }
 
 
+static ULONG
+Ext2HashMcbName(PUNICODE_STRING Name)
+{
+    ULONG   Hash = 0;
+    USHORT  i;
+
+    /* hash must be case-insensitive, same as the name comparison */
+    for (i = 0; i < Name->Length / sizeof(WCHAR); i++) {
+        Hash = Hash * 31 + RtlUpcaseUnicodeChar(Name->Buffer[i]);
+    }
+
+    return Hash;
+}
+
+static VOID
+Ext2HashChildMcb(PEXT2_MCB Parent, PEXT2_MCB Child)
+{
+    ULONG i = Child->NameHash & (Parent->ChildHashSize - 1);
+
+    Child->HashNext = Parent->ChildHash[i];
+    Parent->ChildHash[i] = Child;
+}
+
+static VOID
+Ext2UnhashChildMcb(PEXT2_MCB Parent, PEXT2_MCB Child)
+{
+    PEXT2_MCB *Link;
+
+    Link = &Parent->ChildHash[Child->NameHash & (Parent->ChildHashSize - 1)];
+    while (*Link) {
+        if (*Link == Child) {
+            *Link = Child->HashNext;
+            break;
+        }
+        Link = &(*Link)->HashNext;
+    }
+    Child->HashNext = NULL;
+}
+
+/*
+ * (Re)build the children hash table of a directory Mcb. The child
+ * list stays the master copy, so failing to allocate a new table just
+ * leaves the lookups on the current table or on the linear scan.
+ */
+
+static BOOLEAN
+Ext2ResizeChildHash(PEXT2_MCB Parent, ULONG Size)
+{
+    PEXT2_MCB  *Table;
+    PEXT2_MCB   Mcb;
+
+    Table = Ext2AllocatePool(NonPagedPool, Size * sizeof(PEXT2_MCB),
+                             EXT2_MHASH_MAGIC);
+    if (!Table) {
+        return FALSE;
+    }
+    RtlZeroMemory(Table, Size * sizeof(PEXT2_MCB));
+
+    if (Parent->ChildHash) {
+        Ext2FreePool(Parent->ChildHash, EXT2_MHASH_MAGIC);
+    }
+    Parent->ChildHash = Table;
+    Parent->ChildHashSize = Size;
+
+    for (Mcb = Parent->Child; Mcb; Mcb = Mcb->Next) {
+        Ext2HashChildMcb(Parent, Mcb);
+    }
+
+    return TRUE;
+}
+
 PEXT2_MCB
 Ext2SearchMcb(
     PEXT2_VCB           Vcb,
@@ -1625,6 +1702,8 @@ Ext2SearchMcbWithoutLock(
 )
 {
     PEXT2_MCB TmpMcb = NULL;
+    PEXT2_MCB Dir = Parent;
+    ULONG     Hash;
 
     DEBUG(DL_RES, ("Ext2SearchMcb: %wZ\n", FileName));
 
@@ -1652,16 +1731,37 @@ Ext2SearchMcbWithoutLock(
 
         if (IsMcbSymLink(Parent)) {
             if (Parent->Target) {
-                TmpMcb = Parent->Target->Child;
-                ASSERT(!IsMcbSymLink(Parent->Target));
+                Dir = Parent->Target;
+                ASSERT(!IsMcbSymLink(Dir));
             } else {
                 TmpMcb = NULL;
                 _SEH2_LEAVE;
             }
-        } else {
-            TmpMcb = Parent->Child;
         }
 
+        /* large directories are indexed by name hash */
+        if (Dir->ChildHash) {
+
+            Hash = Ext2HashMcbName(FileName);
+            TmpMcb = Dir->ChildHash[Hash & (Dir->ChildHashSize - 1)];
+
+            while (TmpMcb) {
+
+                if (TmpMcb->NameHash == Hash &&
+                    !RtlCompareUnicodeString(
+                        &(TmpMcb->ShortName),
+                        FileName, TRUE )) {
+                    Ext2ReferMcb(TmpMcb);
+                    break;
+                }
+
+                TmpMcb = TmpMcb->HashNext;
+            }
+
+            _SEH2_LEAVE;
+        }
+
+        TmpMcb = Dir->Child;
         while (TmpMcb) {
 
             if (!RtlCompareUnicodeString(
@@ -1732,6 +1832,21 @@ Ext2InsertMcb (
             Child->de->d_parent = Parent->de;
             Ext2ReferMcb(Parent);
             SetLongFlag(Child->Flags, MCB_ENTRY_TREE);
+
+            /* index it by name, growing the table with the directory */
+            Child->NameHash = Ext2HashMcbName(&Child->ShortName);
+            Child->HashNext = NULL;
+            Parent->ChildCount++;
+
+            if (Parent->ChildHash == NULL) {
+                if (Parent->ChildCount > EXT2_MCB_HASH_THRESHOLD) {
+                    Ext2ResizeChildHash(Parent, EXT2_MCB_HASH_MIN_SIZE);
+                }
+            } else if (Parent->ChildCount <= Parent->ChildHashSize * 2 ||
+                       Parent->ChildHashSize >= EXT2_MCB_HASH_MAX_SIZE ||
+                       !Ext2ResizeChildHash(Parent, Parent->ChildHashSize * 4)) {
+                Ext2HashChildMcb(Parent, Child);
+            }
         }
 
     } _SEH2_FINALLY {
@@ -1778,6 +1893,11 @@ Ext2RemoveMcb (
             }
 
             if (bLinked) {
+                if (Mcb->Parent->ChildHash) {
+                    Ext2UnhashChildMcb(Mcb->Parent, Mcb);
+                }
+                ASSERT(Mcb->Parent->ChildCount > 0);
+                Mcb->Parent->ChildCount--;
                 if (IsFlagOn(Mcb->Flags, MCB_ENTRY_TREE)) {
                     DEBUG(DL_RES, ("Mcb %p %wZ removed from Mcb %p %wZ\n", Mcb,
                                    &Mcb->FullName, Mcb->Parent, &Mcb->Parent->FullName));
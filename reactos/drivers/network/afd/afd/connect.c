@@ -299,6 +299,69 @@ MakeSocketIntoConnection(PAFD_FCB FCB) {
    return Status;
 }
 
+static
+BOOLEAN
+IsSuperConnect(PIRP Irp) {
+    PIO_STACK_LOCATION IrpSp = IoGetCurrentIrpStackLocation( Irp );
+
+    return IrpSp->Parameters.DeviceIoControl.IoControlCode ==
+        IOCTL_AFD_SUPER_CONNECT;
+}
+
+static
+VOID
+UnlockSuperConnect(PIRP Irp) {
+    PAFD_SUPER_CONNECT_INFO ConnectReq;
+
+    if( !IsSuperConnect( Irp ) ) return;
+
+    ConnectReq = GetLockedData( Irp, IoGetCurrentIrpStackLocation( Irp ) );
+    UnlockBuffers( ConnectReq->BufferArray, ConnectReq->BufferCount, FALSE );
+}
+
+/* Moves the ConnectEx data into the send window, it goes out with the
+ * next send */
+static
+VOID
+SatisfySuperConnect(PAFD_FCB FCB, PIRP Irp) {
+    PAFD_SUPER_CONNECT_INFO ConnectReq =
+        GetLockedData( Irp, IoGetCurrentIrpStackLocation( Irp ) );
+    PAFD_MAPBUF Map;
+    UINT i, BytesCopied, TotalBytesCopied = 0;
+    UINT SpaceAvail = FCB->Send.Size - FCB->Send.BytesUsed;
+
+    Map = (PAFD_MAPBUF)(ConnectReq->BufferArray + ConnectReq->BufferCount);
+
+    for( i = 0; SpaceAvail && i < ConnectReq->BufferCount; i++ ) {
+        if( !Map[i].Mdl ) continue;
+
+        BytesCopied = MIN( ConnectReq->BufferArray[i].len, SpaceAvail );
+
+        Map[i].BufferAddress =
+            MmMapLockedPages( Map[i].Mdl, KernelMode );
+
+        RtlCopyMemory( FCB->Send.Window + FCB->Send.BytesUsed,
+                       Map[i].BufferAddress,
+                       BytesCopied );
+
+        MmUnmapLockedPages( Map[i].BufferAddress, Map[i].Mdl );
+
+        TotalBytesCopied += BytesCopied;
+        SpaceAvail -= BytesCopied;
+        FCB->Send.BytesUsed += BytesCopied;
+    }
+
+    AFD_DbgPrint(MID_TRACE,("Completing connect %p with %u bytes\n",
+                            Irp, TotalBytesCopied));
+
+    UnlockBuffers( ConnectReq->BufferArray, ConnectReq->BufferCount, FALSE );
+    Irp->IoStatus.Status = STATUS_SUCCESS;
+    Irp->IoStatus.Information = TotalBytesCopied;
+    if( Irp->MdlAddress ) UnlockRequest( Irp, IoGetCurrentIrpStackLocation( Irp ) );
+    (void)IoSetCancelRoutine(Irp, NULL);
+    IoCompleteRequest( Irp, IO_NETWORK_INCREMENT );
+}
+
 static IO_COMPLETION_ROUTINE StreamSocketConnectComplete;
 static
 NTSTATUS
@@ -309,6 +372,9 @@ StreamSocketConnectComplete(PDEVICE_OBJECT DeviceObject, PIRP Irp,
     PAFD_FCB FCB = (PAFD_FCB)Context;
     PLIST_ENTRY NextIrpEntry;
     PIRP NextIrp;
+    LIST_ENTRY SuperConnects;
+
+    InitializeListHead( &SuperConnects );
 
     AFD_DbgPrint(MID_TRACE,("Called: FCB %p, FO %p\n",
                             Context, FCB->FileObject));
@@ -331,6 +397,7 @@ StreamSocketConnectComplete(PDEVICE_OBJECT DeviceObject, PIRP Irp,
                NextIrp = CONTAINING_RECORD(NextIrpEntry, IRP, Tail.Overlay.ListEntry);
                NextIrp->IoStatus.Status = STATUS_FILE_CLOSED;
                NextIrp->IoStatus.Information = 0;
+               UnlockSuperConnect( NextIrp );
                if( NextIrp->MdlAddress ) UnlockRequest( NextIrp, IoGetCurrentIrpStackLocation( NextIrp ) );
                (void)IoSetCancelRoutine(NextIrp, NULL);
                IoCompleteRequest( NextIrp, IO_NETWORK_INCREMENT );
@@ -351,9 +418,17 @@ StreamSocketConnectComplete(PDEVICE_OBJECT DeviceObject, PIRP Irp,
     while( !IsListEmpty( &FCB->PendingIrpList[FUNCTION_CONNECT] ) ) {
         NextIrpEntry = RemoveHeadList(&FCB->PendingIrpList[FUNCTION_CONNECT]);
         NextIrp = CONTAINING_RECORD(NextIrpEntry, IRP, Tail.Overlay.ListEntry);
+
+        /* ConnectEx completes once its data is queued */
+        if( NT_SUCCESS(Status) && IsSuperConnect( NextIrp ) ) {
+            InsertTailList( &SuperConnects, &NextIrp->Tail.Overlay.ListEntry );
+            continue;
+        }
+
         AFD_DbgPrint(MID_TRACE,("Completing connect %p\n", NextIrp));
         NextIrp->IoStatus.Status = Status;
         NextIrp->IoStatus.Information = NT_SUCCESS(Status) ? ((ULONG_PTR)FCB->Connection.Handle) : 0;
+        UnlockSuperConnect( NextIrp );
         if( NextIrp->MdlAddress ) UnlockRequest( NextIrp, IoGetCurrentIrpStackLocation( NextIrp ) );
         (void)IoSetCancelRoutine(NextIrp, NULL);
         IoCompleteRequest( NextIrp, IO_NETWORK_INCREMENT );
@@ -363,6 +438,16 @@ StreamSocketConnectComplete(PDEVICE_OBJECT DeviceObject, PIRP Irp,
         Status = MakeSocketIntoConnection( FCB );
 
         if( !NT_SUCCESS(Status) ) {
+            while( !IsListEmpty( &SuperConnects ) ) {
+                NextIrpEntry = RemoveHeadList( &SuperConnects );
+                NextIrp = CONTAINING_RECORD(NextIrpEntry, IRP, Tail.Overlay.ListEntry);
+                NextIrp->IoStatus.Status = Status;
+                NextIrp->IoStatus.Information = 0;
+                UnlockSuperConnect( NextIrp );
+                if( NextIrp->MdlAddress ) UnlockRequest( NextIrp, IoGetCurrentIrpStackLocation( NextIrp ) );
+                (void)IoSetCancelRoutine(NextIrp, NULL);
+                IoCompleteRequest( NextIrp, IO_NETWORK_INCREMENT );
+            }
             SocketStateUnlock( FCB );
             return Status;
         }
@@ -383,6 +468,16 @@ StreamSocketConnectComplete(PDEVICE_OBJECT DeviceObject, PIRP Irp,
                           FCB->FilledConnectOptions);
         }
 
+        if( !IsListEmpty( &SuperConnects ) ) {
+            while( !IsListEmpty( &SuperConnects ) ) {
+                NextIrpEntry = RemoveHeadList( &SuperConnects );
+                NextIrp = CONTAINING_RECORD(NextIrpEntry, IRP, Tail.Overlay.ListEntry);
+                SatisfySuperConnect( FCB, NextIrp );
+            }
+
+            RetryPendingSends( FCB );
+        }
+
         if( !IsListEmpty( &FCB->PendingIrpList[FUNCTION_SEND] ) ) {
             NextIrpEntry = RemoveHeadList(&FCB->PendingIrpList[FUNCTION_SEND]);
             NextIrp = CONTAINING_RECORD(NextIrpEntry, IRP,
@@ -416,15 +511,47 @@ AfdStreamSocketConnect(PDEVICE_OBJECT DeviceObject, PIRP Irp,
     PFILE_OBJECT FileObject = IrpSp->FileObject;
     PAFD_FCB FCB = FileObject->FsContext;
     PAFD_CONNECT_INFO ConnectReq;
+    PAFD_SUPER_CONNECT_INFO SuperConnectReq = NULL;
+    PAFD_WSABUF SendBuffers = NULL;
+    UINT SendBufferCount = 0;
+    KPROCESSOR_MODE LockMode;
     AFD_DbgPrint(MID_TRACE,("Called on %p\n", FCB));
 
     UNREFERENCED_PARAMETER(DeviceObject);
 
     if( !SocketAcquireStateLock( FCB ) ) return LostSocket( Irp );
-    if( !(ConnectReq = LockRequest( Irp, IrpSp, FALSE, NULL )) )
+    if( !(ConnectReq = LockRequest( Irp, IrpSp, FALSE, &LockMode )) )
         return UnlockAndMaybeComplete( FCB, STATUS_NO_MEMORY, Irp,
                                        0 );
 
+    if( IrpSp->Parameters.DeviceIoControl.IoControlCode ==
+        IOCTL_AFD_SUPER_CONNECT ) {
+        SuperConnectReq = (PAFD_SUPER_CONNECT_INFO)ConnectReq;
+        ConnectReq = &SuperConnectReq->ConnectInfo;
+
+        /* ConnectEx needs a bound stream socket that isn't connected yet */
+        if( (FCB->Flags & AFD_ENDPOINT_CONNECTIONLESS) ||
+            FCB->State != SOCKET_STATE_BOUND )
+            return UnlockAndMaybeComplete( FCB, STATUS_INVALID_PARAMETER,
+                                           Irp, 0 );
+
+        if( SuperConnectReq->BufferCount ) {
+            SuperConnectReq->BufferArray =
+                LockBuffers( SuperConnectReq->BufferArray,
+                             SuperConnectReq->BufferCount,
+                             NULL, NULL,
+                             FALSE, FALSE, LockMode );
+
+            if( !SuperConnectReq->BufferArray )
+                return UnlockAndMaybeComplete( FCB, STATUS_ACCESS_VIOLATION,
+                                               Irp, 0 );
+        } else
+            SuperConnectReq->BufferArray = NULL;
+
+        SendBuffers = SuperConnectReq->BufferArray;
+        SendBufferCount = SuperConnectReq->BufferCount;
+    }
+
     AFD_DbgPrint(MID_TRACE,("Connect request:\n"));
 #if 0
     OskitDumpBuffer
@@ -511,7 +638,12 @@ AfdStreamSocketConnect(PDEVICE_OBJECT DeviceObject, PIRP Irp,
 
         AFD_DbgPrint(MID_TRACE,("Queueing IRP %p\n", Irp));
         Status = QueueUserModeIrp( FCB, Irp, FUNCTION_CONNECT );
-        if (Status == STATUS_PENDING)
+        if (Status != STATUS_PENDING)
+        {
+            /* The IRP is already gone */
+            UnlockBuffers( SendBuffers, SendBufferCount, FALSE );
+        }
+        else
         {
             Status = TdiConnect( &FCB->ConnectIrp.InFlightRequest,
                                 FCB->Connection.Object,
@@ -536,5 +668,7 @@ AfdStreamSocketConnect(PDEVICE_OBJECT DeviceObject, PIRP Irp,
         break;
     }
 
+    UnlockBuffers( SendBuffers, SendBufferCount, FALSE );
+
     return UnlockAndMaybeComplete( FCB, Status, Irp, 0 );
 }
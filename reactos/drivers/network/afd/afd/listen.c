@@ -10,18 +10,10 @@
 
 #include "afd.h"
 
-static NTSTATUS SatisfyAccept( PAFD_DEVICE_EXTENSION DeviceExt,
-                               PIRP Irp,
-                               PFILE_OBJECT NewFileObject,
-                               PAFD_TDI_OBJECT_QELT Qelt ) {
-    PAFD_FCB FCB = NewFileObject->FsContext;
+/* Called with the new socket locked */
+static NTSTATUS TransferConnection( PAFD_FCB FCB, PAFD_TDI_OBJECT_QELT Qelt ) {
     NTSTATUS Status;
 
-    UNREFERENCED_PARAMETER(DeviceExt);
-
-    if( !SocketAcquireStateLock( FCB ) )
-        return LostSocket( Irp );
-
     /* Transfer the connection to the new socket, launch the opening read */
     AFD_DbgPrint(MID_TRACE,("Completing a real accept (FCB %p)\n", FCB));
 
@@ -42,9 +34,131 @@ static NTSTATUS SatisfyAccept( PAFD_DEVICE_EXTENSION DeviceExt,
     if (NT_SUCCESS(Status))
         Status = TdiBuildConnectionInfo(&FCB->ConnectReturnInfo, FCB->RemoteAddress);
 
+    return Status;
+}
+
+static NTSTATUS SatisfyAccept( PAFD_DEVICE_EXTENSION DeviceExt,
+                               PIRP Irp,
+                               PFILE_OBJECT NewFileObject,
+                               PAFD_TDI_OBJECT_QELT Qelt ) {
+    PAFD_FCB FCB = NewFileObject->FsContext;
+    NTSTATUS Status;
+
+    UNREFERENCED_PARAMETER(DeviceExt);
+
+    if( !SocketAcquireStateLock( FCB ) )
+        return LostSocket( Irp );
+
+    Status = TransferConnection( FCB, Qelt );
+
     return UnlockAndMaybeComplete( FCB, Status, Irp, 0 );
 }
 
+VOID CompleteSuperAccept( PIRP Irp, NTSTATUS Status, ULONG_PTR Information ) {
+    PIO_STACK_LOCATION IrpSp = IoGetCurrentIrpStackLocation( Irp );
+    PAFD_SUPER_ACCEPT_INFO AcceptReq = GetLockedData( Irp, IrpSp );
+
+    AFD_DbgPrint(MID_TRACE,("Completing AcceptEx %p (%x, %u bytes)\n",
+                            Irp, Status, Information));
+
+    UnlockBuffers( AcceptReq->BufferArray, AcceptReq->BufferCount, FALSE );
+    ObDereferenceObject( Irp->Tail.Overlay.DriverContext[2] );
+
+    Irp->IoStatus.Status = Status;
+    Irp->IoStatus.Information = Information;
+    if( Irp->MdlAddress ) UnlockRequest( Irp, IrpSp );
+    (void)IoSetCancelRoutine(Irp, NULL);
+    IoCompleteRequest( Irp, IO_NETWORK_INCREMENT );
+}
+
+/* The length, then the address in sockaddr layout */
+static VOID StoreAcceptAddress( PCHAR Slot, PTRANSPORT_ADDRESS Address ) {
+    ULONG Length = sizeof(USHORT) + Address->Address[0].AddressLength;
+
+    RtlCopyMemory( Slot, &Length, sizeof(Length) );
+    RtlCopyMemory( Slot + sizeof(Length),
+                   &Address->Address[0].AddressType,
+                   Length );
+}
+
+/* Called with the listening socket locked. The connection is only taken
+ * if the accept socket can have it. */
+static VOID SatisfySuperAccept( PAFD_FCB FCB,
+                                PIRP Irp,
+                                PAFD_TDI_OBJECT_QELT Qelt ) {
+    PAFD_SUPER_ACCEPT_INFO AcceptReq =
+        GetLockedData( Irp, IoGetCurrentIrpStackLocation( Irp ) );
+    PFILE_OBJECT NewFileObject = Irp->Tail.Overlay.DriverContext[2];
+    PAFD_FCB NewFCB = NewFileObject->FsContext;
+    PAFD_MAPBUF Map =
+        (PAFD_MAPBUF)(AcceptReq->BufferArray + AcceptReq->BufferCount);
+    PCHAR Buffer;
+    NTSTATUS Status;
+
+    if( !SocketAcquireStateLock( NewFCB ) ) {
+        CompleteSuperAccept( Irp, STATUS_FILE_CLOSED, 0 );
+        return;
+    }
+
+    if( NewFCB->State != SOCKET_STATE_CREATED ) {
+        AFD_DbgPrint(MIN_TRACE,("Accept socket %p is in use\n", NewFCB));
+        SocketStateUnlock( NewFCB );
+        CompleteSuperAccept( Irp, STATUS_INVALID_PARAMETER, 0 );
+        return;
+    }
+
+    Buffer = MmGetSystemAddressForMdlSafe( Map[0].Mdl, NormalPagePriority );
+    if( !Buffer ) {
+        SocketStateUnlock( NewFCB );
+        CompleteSuperAccept( Irp, STATUS_NO_MEMORY, 0 );
+        return;
+    }
+
+    StoreAcceptAddress( Buffer + AcceptReq->ReceiveDataLength,
+                        FCB->LocalAddress );
+    StoreAcceptAddress( Buffer + AcceptReq->ReceiveDataLength +
+                        AcceptReq->LocalAddressLength,
+                        Qelt->ConnInfo->RemoteAddress );
+
+    RemoveEntryList( &Qelt->ListEntry );
+
+    Status = TransferConnection( NewFCB, Qelt );
+
+    ExFreePool( Qelt );
+
+    if( !NT_SUCCESS(Status) || !AcceptReq->ReceiveDataLength ) {
+        SocketStateUnlock( NewFCB );
+        CompleteSuperAccept( Irp, Status, 0 );
+        return;
+    }
+
+    /* The accept socket completes it with its first data, or when it is closed.
+     * It stays cancelable meanwhile, see CancelSuperAcceptReceive. */
+    NewFCB->SuperAcceptIrp = Irp;
+    SatisfySuperAcceptReceive( NewFCB );
+
+    SocketStateUnlock( NewFCB );
+}
+
+/* Called with the listening socket locked when an AcceptEx is cancelled.
+ * Takes it back if it is parked on its accept socket, waiting for data. */
+BOOLEAN CancelSuperAcceptReceive( PIRP Irp ) {
+    PFILE_OBJECT NewFileObject = Irp->Tail.Overlay.DriverContext[2];
+    PAFD_FCB NewFCB = NewFileObject->FsContext;
+    BOOLEAN Found;
+
+    if( !SocketAcquireStateLock( NewFCB ) )
+        return FALSE;
+
+    Found = (NewFCB->SuperAcceptIrp == Irp);
+    if( Found )
+        NewFCB->SuperAcceptIrp = NULL;
+
+    SocketStateUnlock( NewFCB );
+
+    return Found;
+}
+
 static NTSTATUS SatisfyPreAccept( PIRP Irp, PAFD_TDI_OBJECT_QELT Qelt ) {
     PAFD_RECEIVED_ACCEPT_DATA ListenReceive =
         (PAFD_RECEIVED_ACCEPT_DATA)Irp->AssociatedIrp.SystemBuffer;
@@ -112,6 +226,12 @@ static NTSTATUS NTAPI ListenComplete( PDEVICE_OBJECT DeviceObject,
            IoCompleteRequest( NextIrp, IO_NETWORK_INCREMENT );
         }
 
+        while( !IsListEmpty( &FCB->PendingIrpList[FUNCTION_ACCEPT] ) ) {
+           NextIrpEntry = RemoveHeadList(&FCB->PendingIrpList[FUNCTION_ACCEPT]);
+           NextIrp = CONTAINING_RECORD(NextIrpEntry, IRP, Tail.Overlay.ListEntry);
+           CompleteSuperAccept( NextIrp, STATUS_FILE_CLOSED, 0 );
+        }
+
         /* Free ConnectionReturnInfo and ConnectionCallInfo */
         if (FCB->ListenIrp.ConnectionReturnInfo)
         {
@@ -161,6 +281,20 @@ static NTSTATUS NTAPI ListenComplete( PDEVICE_OBJECT DeviceObject,
         }
     }
 
+    /* Pre-posted AcceptEx requests get the connection first */
+    while( !IsListEmpty( &FCB->PendingIrpList[FUNCTION_ACCEPT] ) &&
+           !IsListEmpty( &FCB->PendingConnections ) ) {
+        PLIST_ENTRY PendingIrp  =
+            RemoveHeadList( &FCB->PendingIrpList[FUNCTION_ACCEPT] );
+        PLIST_ENTRY PendingConn = FCB->PendingConnections.Flink;
+        SatisfySuperAccept
+            ( FCB,
+              CONTAINING_RECORD( PendingIrp, IRP,
+                                 Tail.Overlay.ListEntry ),
+              CONTAINING_RECORD( PendingConn, AFD_TDI_OBJECT_QELT,
+                                 ListEntry ) );
+    }
+
     /* Satisfy a pre-accept request if one is available */
     if( !IsListEmpty( &FCB->PendingIrpList[FUNCTION_PREACCEPT] ) &&
         !IsListEmpty( &FCB->PendingConnections ) ) {
@@ -391,3 +525,98 @@ NTSTATUS AfdAccept( PDEVICE_OBJECT DeviceObject, PIRP Irp,
 
     return UnlockAndMaybeComplete( FCB, STATUS_UNSUCCESSFUL, Irp, 0 );
 }
+
+NTSTATUS AfdSuperAccept( PDEVICE_OBJECT DeviceObject, PIRP Irp,
+                         PIO_STACK_LOCATION IrpSp ) {
+    PFILE_OBJECT FileObject = IrpSp->FileObject;
+    PAFD_FCB FCB = FileObject->FsContext;
+    PAFD_SUPER_ACCEPT_INFO AcceptReq;
+    PFILE_OBJECT NewFileObject;
+    KPROCESSOR_MODE LockMode;
+    ULONG AddressLength;
+    NTSTATUS Status;
+
+    AFD_DbgPrint(MID_TRACE,("Called on %p\n", FCB));
+
+    if( !SocketAcquireStateLock( FCB ) ) return LostSocket( Irp );
+
+    if( !(AcceptReq = LockRequest( Irp, IrpSp, FALSE, &LockMode )) )
+        return UnlockAndMaybeComplete( FCB, STATUS_NO_MEMORY, Irp, 0 );
+
+    if( FCB->State != SOCKET_STATE_LISTENING ) {
+        AFD_DbgPrint(MIN_TRACE,("Socket is not listening\n"));
+        return UnlockAndMaybeComplete( FCB, STATUS_INVALID_PARAMETER, Irp, 0 );
+    }
+
+    /* Both addresses have the size of the one we listen on */
+    AddressLength = sizeof(ULONG) + sizeof(USHORT) +
+        FCB->LocalAddress->Address[0].AddressLength;
+
+    if( AcceptReq->BufferCount != 1 ||
+        AcceptReq->LocalAddressLength < AddressLength ||
+        AcceptReq->RemoteAddressLength < AddressLength ) {
+        return UnlockAndMaybeComplete( FCB, STATUS_INVALID_PARAMETER, Irp, 0 );
+    }
+
+    Status = ObReferenceObjectByHandle( AcceptReq->AcceptHandle,
+                                        FILE_ALL_ACCESS,
+                                        *IoFileObjectType,
+                                        Irp->RequestorMode,
+                                        (PVOID *)&NewFileObject,
+                                        NULL );
+
+    if( !NT_SUCCESS(Status) ) return UnlockAndMaybeComplete( FCB, Status, Irp, 0 );
+
+    /* It has to be another one of our sockets */
+    if( NewFileObject->DeviceObject != DeviceObject ||
+        NewFileObject == FileObject ) {
+        ObDereferenceObject( NewFileObject );
+        return UnlockAndMaybeComplete( FCB, STATUS_INVALID_PARAMETER, Irp, 0 );
+    }
+
+    AcceptReq->BufferArray = LockBuffers( AcceptReq->BufferArray,
+                                          AcceptReq->BufferCount,
+                                          NULL, NULL,
+                                          TRUE, FALSE, LockMode );
+
+    if( !AcceptReq->BufferArray ) {
+        ObDereferenceObject( NewFileObject );
+        return UnlockAndMaybeComplete( FCB, STATUS_ACCESS_VIOLATION, Irp, 0 );
+    }
+
+    if( (ULONGLONG)AcceptReq->ReceiveDataLength +
+        AcceptReq->LocalAddressLength +
+        AcceptReq->RemoteAddressLength > AcceptReq->BufferArray[0].len ) {
+        UnlockBuffers( AcceptReq->BufferArray, AcceptReq->BufferCount, FALSE );
+        ObDereferenceObject( NewFileObject );
+        return UnlockAndMaybeComplete( FCB, STATUS_INVALID_PARAMETER, Irp, 0 );
+    }
+
+    /* Keeps the accept socket around until we're done */
+    Irp->Tail.Overlay.DriverContext[2] = NewFileObject;
+
+    if( IsListEmpty( &FCB->PendingConnections ) ) {
+        AFD_DbgPrint(MID_TRACE,("Holding\n"));
+
+        return LeaveIrpUntilLater( FCB, Irp, FUNCTION_ACCEPT );
+    }
+
+    /* The IRP may stay with the accept socket for the first data */
+    IoMarkIrpPending( Irp );
+
+    SatisfySuperAccept( FCB, Irp,
+                        CONTAINING_RECORD( FCB->PendingConnections.Flink,
+                                           AFD_TDI_OBJECT_QELT, ListEntry ) );
+
+    if( !IsListEmpty( &FCB->PendingConnections ) )
+    {
+        FCB->PollState |= AFD_EVENT_ACCEPT;
+        FCB->PollStatus[FD_ACCEPT_BIT] = STATUS_SUCCESS;
+        PollReeval( FCB->DeviceExt, FCB->FileObject );
+    } else
+        FCB->PollState &= ~AFD_EVENT_ACCEPT;
+
+    SocketStateUnlock( FCB );
+
+    return STATUS_PENDING;
+}
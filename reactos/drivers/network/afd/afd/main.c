@@ -348,6 +348,8 @@ AfdCreateSocket(PDEVICE_OBJECT DeviceObject, PIRP Irp,
 
     InitializeListHead( &FCB->DatagramList );
     InitializeListHead( &FCB->PendingConnections );
+    InitializeListHead( &FCB->PollEntries );
+    InitializeListHead( &FCB->PollRegistrations );
 
     AFD_DbgPrint(MID_TRACE,("%p: Checking command channel\n", FCB));
 
@@ -428,7 +430,20 @@ AfdCleanupSocket(PDEVICE_OBJECT DeviceObject, PIRP Irp,
         }
     }
 
+    if (FCB->Transmit)
+        AfdCancelTransmit(FCB);
+
+    /* An AcceptEx still waiting for the first data on this socket */
+    if (FCB->SuperAcceptIrp)
+    {
+        CurrentIrp = FCB->SuperAcceptIrp;
+        FCB->SuperAcceptIrp = NULL;
+        CompleteSuperAccept(CurrentIrp, STATUS_CANCELLED, 0);
+    }
+
     KillSelectsForFCB( FCB->DeviceExt, FileObject, FALSE );
+    DestroyPollSet( FCB );
+    KillPollRegistrationsForFCB( FCB );
 
     return UnlockAndMaybeComplete(FCB, STATUS_SUCCESS, Irp, 0);
 }
@@ -679,7 +694,8 @@ RetryDisconnectCompletion(PAFD_FCB FCB)
 {
     ASSERT(FCB->RemoteAddress);
 
-    if (IsListEmpty(&FCB->PendingIrpList[FUNCTION_SEND]) && !FCB->SendIrp.InFlightRequest && FCB->DisconnectPending)
+    if (IsListEmpty(&FCB->PendingIrpList[FUNCTION_SEND]) && !FCB->SendIrp.InFlightRequest &&
+        !FCB->Transmit && FCB->DisconnectPending)
     {
         /* Sends are done; fire off a TDI_DISCONNECT request */
         DoDisconnect(FCB);
@@ -789,7 +805,8 @@ AfdDisconnect(PDEVICE_OBJECT DeviceObject, PIRP Irp,
         Status = QueueUserModeIrp(FCB, Irp, FUNCTION_DISCONNECT);
         if (Status == STATUS_PENDING)
         {
-            if ((IsListEmpty(&FCB->PendingIrpList[FUNCTION_SEND]) && !FCB->SendIrp.InFlightRequest) ||
+            if ((IsListEmpty(&FCB->PendingIrpList[FUNCTION_SEND]) && !FCB->SendIrp.InFlightRequest &&
+                 !FCB->Transmit) ||
                 (FCB->DisconnectFlags & TDI_DISCONNECT_ABORT))
             {
                 /* Go ahead and execute the disconnect because we're ready for it */
@@ -892,6 +909,12 @@ AfdDispatch(PDEVICE_OBJECT DeviceObject, PIRP Irp)
         case IOCTL_AFD_EVENT_SELECT:
             return AfdEventSelect( DeviceObject, Irp, IrpSp );
 
+        case IOCTL_AFD_POLL_SET_UPDATE:
+            return AfdPollSetUpdate( DeviceObject, Irp, IrpSp );
+
+        case IOCTL_AFD_POLL_SET_WAIT:
+            return AfdPollSetWait( DeviceObject, Irp, IrpSp );
+
         case IOCTL_AFD_ENUM_NETWORK_EVENTS:
             return AfdEnumEvents( DeviceObject, Irp, IrpSp );
 
@@ -974,6 +997,15 @@ AfdDispatch(PDEVICE_OBJECT DeviceObject, PIRP Irp)
         case IOCTL_AFD_GET_TDI_HANDLES:
             return AfdGetTdiHandles(DeviceObject, Irp, IrpSp);
 
+        case IOCTL_AFD_TRANSMIT_FILE:
+            return AfdTransmitFile(DeviceObject, Irp, IrpSp);
+
+        case IOCTL_AFD_SUPER_ACCEPT:
+            return AfdSuperAccept(DeviceObject, Irp, IrpSp);
+
+        case IOCTL_AFD_SUPER_CONNECT:
+            return AfdStreamSocketConnect(DeviceObject, Irp, IrpSp);
+
         case IOCTL_AFD_DEFER_ACCEPT:
             DbgPrint("IOCTL_AFD_DEFER_ACCEPT is UNIMPLEMENTED!\n");
             break;
@@ -1067,6 +1099,8 @@ CleanupPendingIrp(PAFD_FCB FCB, PIRP Irp, PIO_STACK_LOCATION IrpSp, PAFD_ACTIVE_
     PAFD_RECV_INFO RecvReq;
     PAFD_SEND_INFO SendReq;
     PAFD_POLL_INFO PollReq;
+    PAFD_SUPER_ACCEPT_INFO AcceptReq;
+    PAFD_SUPER_CONNECT_INFO ConnectReq;
 
     if (IrpSp->MajorFunction == IRP_MJ_READ)
     {
@@ -1100,6 +1134,17 @@ CleanupPendingIrp(PAFD_FCB FCB, PIRP Irp, PIO_STACK_LOCATION IrpSp, PAFD_ACTIVE_
             ZeroEvents(PollReq->Handles, PollReq->HandleCount);
             SignalSocket(Poll, NULL, PollReq, STATUS_CANCELLED);
         }
+        else if (IrpSp->Parameters.DeviceIoControl.IoControlCode == IOCTL_AFD_SUPER_ACCEPT)
+        {
+            AcceptReq = GetLockedData(Irp, IrpSp);
+            UnlockBuffers(AcceptReq->BufferArray, AcceptReq->BufferCount, FALSE);
+            ObDereferenceObject(Irp->Tail.Overlay.DriverContext[2]);
+        }
+        else if (IrpSp->Parameters.DeviceIoControl.IoControlCode == IOCTL_AFD_SUPER_CONNECT)
+        {
+            ConnectReq = GetLockedData(Irp, IrpSp);
+            UnlockBuffers(ConnectReq->BufferArray, ConnectReq->BufferCount, FALSE);
+        }
     }
 }
 
@@ -1156,9 +1201,14 @@ AfdCancelHandler(PDEVICE_OBJECT DeviceObject,
             break;
 
         case IOCTL_AFD_CONNECT:
+        case IOCTL_AFD_SUPER_CONNECT:
             Function = FUNCTION_CONNECT;
             break;
 
+        case IOCTL_AFD_SUPER_ACCEPT:
+            Function = FUNCTION_ACCEPT;
+            break;
+
         case IOCTL_AFD_WAIT_FOR_LISTEN:
             Function = FUNCTION_PREACCEPT;
             break;
@@ -1191,10 +1241,20 @@ AfdCancelHandler(PDEVICE_OBJECT DeviceObject,
             DbgPrint("WARNING!!! IRP cancellation race could lead to a process hang! (IOCTL_AFD_SELECT)\n");
             return;
 
+        case IOCTL_AFD_POLL_SET_WAIT:
+            CancelPollSetWait(FCB, Irp);
+            SocketStateUnlock(FCB);
+            return;
+
         case IOCTL_AFD_DISCONNECT:
             Function = FUNCTION_DISCONNECT;
             break;
 
+        case IOCTL_AFD_TRANSMIT_FILE:
+            AfdCancelTransmitIrp(FCB, Irp);
+            SocketStateUnlock(FCB);
+            return;
+
         default:
             ASSERT(FALSE);
             UnlockAndMaybeComplete(FCB, STATUS_CANCELLED, Irp, 0);
@@ -1219,6 +1279,14 @@ AfdCancelHandler(PDEVICE_OBJECT DeviceObject,
         }
     }
 
+    /* An AcceptEx that already has its connection waits on the accept socket */
+    if (Function == FUNCTION_ACCEPT && CancelSuperAcceptReceive(Irp))
+    {
+        SocketStateUnlock(FCB);
+        CompleteSuperAccept(Irp, STATUS_CANCELLED, 0);
+        return;
+    }
+
     SocketStateUnlock(FCB);
 
     DbgPrint("WARNING!!! IRP cancellation race could lead to a process hang! (Function: %u)\n", Function);
@@ -148,6 +148,44 @@ static NTSTATUS TryToSatisfyRecvRequestFromBuffer( PAFD_FCB FCB,
     return STATUS_SUCCESS;
 }
 
+/* An AcceptEx with a receive buffer completes with the first data */
+VOID SatisfySuperAcceptReceive( PAFD_FCB FCB ) {
+    PIRP Irp = FCB->SuperAcceptIrp;
+    PAFD_SUPER_ACCEPT_INFO AcceptReq;
+    PAFD_MAPBUF Map;
+    PCHAR Buffer;
+    UINT BytesToCopy, BytesAvailable =
+        FCB->Recv.Content - FCB->Recv.BytesUsed;
+
+    if( !Irp ) return;
+    if( !BytesAvailable && !FCB->TdiReceiveClosed ) return;
+
+    FCB->SuperAcceptIrp = NULL;
+
+    AcceptReq = GetLockedData( Irp, IoGetCurrentIrpStackLocation( Irp ) );
+    Map = (PAFD_MAPBUF)(AcceptReq->BufferArray + AcceptReq->BufferCount);
+    BytesToCopy = MIN( AcceptReq->ReceiveDataLength, BytesAvailable );
+
+    AFD_DbgPrint(MID_TRACE,("AcceptEx %p gets %u bytes\n", Irp, BytesToCopy));
+
+    if( BytesToCopy ) {
+        /* Mapped already, it holds the addresses too */
+        Buffer = MmGetSystemAddressForMdlSafe( Map[0].Mdl, NormalPagePriority );
+        ASSERT(Buffer);
+
+        RtlCopyMemory( Buffer,
+                       FCB->Recv.Window + FCB->Recv.BytesUsed,
+                       BytesToCopy );
+
+        FCB->Recv.BytesUsed += BytesToCopy;
+
+        /* Issue another receive IRP to keep the buffer well stocked */
+        RefillSocketBuffer(FCB);
+    }
+
+    CompleteSuperAccept( Irp, STATUS_SUCCESS, BytesToCopy );
+}
+
 static NTSTATUS ReceiveActivity( PAFD_FCB FCB, PIRP Irp ) {
     PLIST_ENTRY NextIrpEntry;
     PIRP NextIrp;
@@ -161,6 +199,9 @@ static NTSTATUS ReceiveActivity( PAFD_FCB FCB, PIRP Irp ) {
     AFD_DbgPrint(MID_TRACE,("FCB %p Receive data waiting %u\n",
                             FCB, FCB->Recv.Content));
 
+    /* The first data belongs to a pending AcceptEx */
+    SatisfySuperAcceptReceive( FCB );
+
     if( CantReadMore( FCB ) ) {
         /* Success here means that we got an EOF.  Complete a pending read
          * with zero bytes if we haven't yet overread, then kill the others.
@@ -68,6 +68,8 @@ VOID SignalSocket(
     {
         KeCancelTimer( &Poll->Timer );
         RemoveEntryList( &Poll->ListEntry );
+        for( i = 0; i < Poll->EntryCount; i++ )
+            RemoveEntryList( &Poll->Entries[i].ListEntry );
         ExFreePool( Poll );
     }
 
@@ -122,38 +124,45 @@ static VOID NTAPI SelectTimeout( PKDPC Dpc,
     AFD_DbgPrint(MID_TRACE,("Timeout\n"));
 }
 
+/* The entries a select has for one socket are linked in one go, so they
+ * are next to each other. Skipping all of them lets the caller free the
+ * poll. */
+static PLIST_ENTRY NextPollEntry( PLIST_ENTRY Head,
+                                  PLIST_ENTRY ListEntry,
+                                  PAFD_ACTIVE_POLL Poll ) {
+    do {
+        ListEntry = ListEntry->Flink;
+    } while( ListEntry != Head &&
+             CONTAINING_RECORD(ListEntry, AFD_POLL_ENTRY, ListEntry)->Poll == Poll );
+
+    return ListEntry;
+}
+
 VOID KillSelectsForFCB( PAFD_DEVICE_EXTENSION DeviceExt,
                         PFILE_OBJECT FileObject,
                         BOOLEAN OnlyExclusive ) {
     KIRQL OldIrql;
     PLIST_ENTRY ListEntry;
+    PAFD_POLL_ENTRY Entry;
     PAFD_ACTIVE_POLL Poll;
-    PIRP Irp;
     PAFD_POLL_INFO PollReq;
-    PAFD_HANDLE HandleArray;
-    UINT i;
+    PAFD_FCB FCB = FileObject->FsContext;
 
     AFD_DbgPrint(MID_TRACE,("Killing selects that refer to %p\n", FileObject));
 
     KeAcquireSpinLock( &DeviceExt->Lock, &OldIrql );
 
-    ListEntry = DeviceExt->Polls.Flink;
-    while ( ListEntry != &DeviceExt->Polls ) {
-        Poll = CONTAINING_RECORD(ListEntry, AFD_ACTIVE_POLL, ListEntry);
-        ListEntry = ListEntry->Flink;
-        Irp = Poll->Irp;
-        PollReq = Irp->AssociatedIrp.SystemBuffer;
-        HandleArray = AFD_HANDLES(PollReq);
+    ListEntry = FCB->PollEntries.Flink;
+    while ( ListEntry != &FCB->PollEntries ) {
+        Entry = CONTAINING_RECORD(ListEntry, AFD_POLL_ENTRY, ListEntry);
+        Poll = Entry->Poll;
+        ListEntry = NextPollEntry( &FCB->PollEntries, ListEntry, Poll );
 
-        for( i = 0; i < PollReq->HandleCount; i++ ) {
-            AFD_DbgPrint(MAX_TRACE,("Req: %u, This %p\n",
-                                    HandleArray[i].Handle, FileObject));
-            if( (PVOID)HandleArray[i].Handle == FileObject &&
-                (!OnlyExclusive || (OnlyExclusive && Poll->Exclusive)) ) {
-                ZeroEvents( PollReq->Handles, PollReq->HandleCount );
-                SignalSocket( Poll, NULL, PollReq, STATUS_CANCELLED );
-            }
-        }
+        if( OnlyExclusive && !Poll->Exclusive ) continue;
+
+        PollReq = Poll->Irp->AssociatedIrp.SystemBuffer;
+        ZeroEvents( PollReq->Handles, PollReq->HandleCount );
+        SignalSocket( Poll, NULL, PollReq, STATUS_CANCELLED );
     }
 
     KeReleaseSpinLock( &DeviceExt->Lock, OldIrql );
@@ -169,11 +178,20 @@ AfdSelect( PDEVICE_OBJECT DeviceObject, PIRP Irp,
     PFILE_OBJECT FileObject;
     PAFD_POLL_INFO PollReq = Irp->AssociatedIrp.SystemBuffer;
     PAFD_DEVICE_EXTENSION DeviceExt = DeviceObject->DeviceExtension;
+    ULONG InputLength = IrpSp->Parameters.DeviceIoControl.InputBufferLength;
     KIRQL OldIrql;
     UINT i, Signalled = 0;
-    ULONG Exclusive = PollReq->Exclusive;
+    ULONG Exclusive;
+
+    if( InputLength < FIELD_OFFSET(AFD_POLL_INFO, Handles) ||
+        PollReq->HandleCount > (InputLength - FIELD_OFFSET(AFD_POLL_INFO, Handles)) / sizeof(AFD_HANDLE) ) {
+        Irp->IoStatus.Status = STATUS_INVALID_PARAMETER;
+        Irp->IoStatus.Information = 0;
+        IoCompleteRequest( Irp, IO_NETWORK_INCREMENT );
+        return STATUS_INVALID_PARAMETER;
+    }
 
-    UNREFERENCED_PARAMETER(IrpSp);
+    Exclusive = PollReq->Exclusive;
 
     AFD_DbgPrint(MID_TRACE,("Called (HandleCount %u Timeout %d)\n",
                             PollReq->HandleCount,
@@ -228,12 +246,30 @@ AfdSelect( PDEVICE_OBJECT DeviceObject, PIRP Irp,
 
        PAFD_ACTIVE_POLL Poll = NULL;
 
-       Poll = ExAllocatePool( NonPagedPool, sizeof(AFD_ACTIVE_POLL) );
+       Poll = ExAllocatePool( NonPagedPool,
+                              FIELD_OFFSET(AFD_ACTIVE_POLL, Entries) +
+                              sizeof(AFD_POLL_ENTRY) * PollReq->HandleCount );
 
        if (Poll){
           Poll->Irp = Irp;
           Poll->DeviceExt = DeviceExt;
           Poll->Exclusive = Exclusive;
+          Poll->EntryCount = PollReq->HandleCount;
+
+          /* Hook into every socket so that only their changes look at us */
+          for( i = 0; i < PollReq->HandleCount; i++ ) {
+              Poll->Entries[i].Poll = Poll;
+              Poll->Entries[i].Index = i;
+
+              if( !AFD_HANDLES(PollReq)[i].Handle ) {
+                  InitializeListHead( &Poll->Entries[i].ListEntry );
+                  continue;
+              }
+
+              FileObject = (PFILE_OBJECT)AFD_HANDLES(PollReq)[i].Handle;
+              FCB = FileObject->FsContext;
+              InsertTailList( &FCB->PollEntries, &Poll->Entries[i].ListEntry );
+          }
 
           KeInitializeTimerEx( &Poll->Timer, NotificationTimer );
 
@@ -376,6 +412,381 @@ AfdEnumEvents( PDEVICE_OBJECT DeviceObject, PIRP Irp,
     return UnlockAndMaybeComplete( FCB, STATUS_SUCCESS, Irp, 0 );
 }
 
+/* * * NOTE ALWAYS CALLED AT DISPATCH_LEVEL * * */
+static UINT HarvestPollSet( PAFD_POLL_SET Set,
+                            PAFD_HANDLE Handles,
+                            UINT MaxHandles ) {
+    PLIST_ENTRY ListEntry;
+    PAFD_POLL_REGISTRATION Registration;
+    PAFD_FCB FCB;
+    LIST_ENTRY Reported;
+    ULONG Events;
+    UINT Count = 0;
+
+    InitializeListHead( &Reported );
+
+    while( Count < MaxHandles && !IsListEmpty( &Set->ReadyList ) ) {
+        ListEntry = RemoveHeadList( &Set->ReadyList );
+        Registration = CONTAINING_RECORD(ListEntry, AFD_POLL_REGISTRATION, ReadyEntry);
+        FCB = Registration->FileObject->FsContext;
+
+        /* It may have been drained since */
+        Events = Registration->Events & FCB->PollState;
+        if( !Events ) {
+            InitializeListHead( &Registration->ReadyEntry );
+            continue;
+        }
+
+        Handles[Count].Handle = Registration->Handle;
+        Handles[Count].Events = Events;
+        Handles[Count].Status = 0;
+        Count++;
+
+        InsertTailList( &Reported, &Registration->ReadyEntry );
+    }
+
+    /* Reported sockets stay ready until they are drained, but go behind
+     * the ones we didn't get to */
+    while( !IsListEmpty( &Reported ) ) {
+        ListEntry = RemoveHeadList( &Reported );
+        InsertTailList( &Set->ReadyList, ListEntry );
+    }
+
+    return Count;
+}
+
+static UINT MaxPollSetHandles( PIO_STACK_LOCATION IrpSp ) {
+    return (IrpSp->Parameters.DeviceIoControl.OutputBufferLength -
+            FIELD_OFFSET(AFD_POLL_SET_WAIT_INFO, Handles)) / sizeof(AFD_HANDLE);
+}
+
+/* * * NOTE ALWAYS CALLED AT DISPATCH_LEVEL * * */
+static VOID CompletePollSetWait( PAFD_POLL_SET Set, NTSTATUS Status ) {
+    PIRP Irp = Set->WaitIrp;
+    PAFD_POLL_SET_WAIT_INFO WaitReq = Irp->AssociatedIrp.SystemBuffer;
+    UINT Count = 0;
+
+    Set->WaitIrp = NULL;
+    KeCancelTimer( &Set->Timer );
+
+    if( Status != STATUS_CANCELLED ) {
+        Count = HarvestPollSet( Set, WaitReq->Handles,
+                                MaxPollSetHandles( IoGetCurrentIrpStackLocation( Irp ) ) );
+        Status = Count ? STATUS_SUCCESS : STATUS_TIMEOUT;
+    }
+
+    AFD_DbgPrint(MID_TRACE,("Completing poll set wait %p with %u sockets\n",
+                            Irp, Count));
+
+    WaitReq->HandleCount = Count;
+    Irp->IoStatus.Status = Status;
+    Irp->IoStatus.Information =
+        FIELD_OFFSET(AFD_POLL_SET_WAIT_INFO, Handles) + sizeof(AFD_HANDLE) * Count;
+    (void)IoSetCancelRoutine( Irp, NULL );
+    IoCompleteRequest( Irp, IO_NETWORK_INCREMENT );
+}
+
+/* * * NOTE ALWAYS CALLED AT DISPATCH_LEVEL * * */
+static VOID MarkRegistrationReady( PAFD_POLL_REGISTRATION Registration ) {
+    PAFD_POLL_SET Set = Registration->Set;
+
+    if( IsListEmpty( &Registration->ReadyEntry ) )
+        InsertTailList( &Set->ReadyList, &Registration->ReadyEntry );
+
+    if( Set->WaitIrp )
+        CompletePollSetWait( Set, STATUS_SUCCESS );
+}
+
+static KDEFERRED_ROUTINE PollSetTimeout;
+static VOID NTAPI PollSetTimeout( PKDPC Dpc,
+                                  PVOID DeferredContext,
+                                  PVOID SystemArgument1,
+                                  PVOID SystemArgument2 ) {
+    PAFD_POLL_SET Set = DeferredContext;
+    KIRQL OldIrql;
+
+    UNREFERENCED_PARAMETER(Dpc);
+    UNREFERENCED_PARAMETER(SystemArgument1);
+    UNREFERENCED_PARAMETER(SystemArgument2);
+
+    KeAcquireSpinLock( &Set->DeviceExt->Lock, &OldIrql );
+
+    /* The timer is re-armed for every wait, so this may be a stale DPC */
+    if( Set->WaitIrp && KeReadStateTimer( &Set->Timer ) )
+        CompletePollSetWait( Set, STATUS_TIMEOUT );
+
+    KeReleaseSpinLock( &Set->DeviceExt->Lock, OldIrql );
+}
+
+static PAFD_POLL_REGISTRATION FindRegistration( PAFD_POLL_SET Set,
+                                                PAFD_FCB FCB ) {
+    PLIST_ENTRY ListEntry;
+    PAFD_POLL_REGISTRATION Registration;
+
+    for( ListEntry = FCB->PollRegistrations.Flink;
+         ListEntry != &FCB->PollRegistrations;
+         ListEntry = ListEntry->Flink ) {
+        Registration = CONTAINING_RECORD(ListEntry, AFD_POLL_REGISTRATION, FcbEntry);
+        if( Registration->Set == Set ) return Registration;
+    }
+
+    return NULL;
+}
+
+/* A poll set hangs off the handle it was first updated through. The
+ * sockets in it report their readiness to it as it changes, so a wait
+ * only looks at the sockets that became ready. */
+NTSTATUS NTAPI
+AfdPollSetUpdate( PDEVICE_OBJECT DeviceObject, PIRP Irp,
+                  PIO_STACK_LOCATION IrpSp ) {
+    PFILE_OBJECT FileObject = IrpSp->FileObject;
+    PAFD_FCB FCB = FileObject->FsContext;
+    PAFD_POLL_SET_UPDATE_INFO UpdateReq = Irp->AssociatedIrp.SystemBuffer;
+    ULONG InputLength = IrpSp->Parameters.DeviceIoControl.InputBufferLength;
+    PAFD_DEVICE_EXTENSION DeviceExt = DeviceObject->DeviceExtension;
+    PAFD_POLL_SET Set;
+    PAFD_POLL_REGISTRATION Registration, Removed;
+    PFILE_OBJECT WatchedObject;
+    PAFD_FCB WatchedFCB;
+    NTSTATUS Status = STATUS_SUCCESS;
+    KIRQL OldIrql;
+    UINT i;
+
+    if( !SocketAcquireStateLock( FCB ) ) return LostSocket( Irp );
+
+    if( InputLength < FIELD_OFFSET(AFD_POLL_SET_UPDATE_INFO, Handles) ||
+        UpdateReq->HandleCount > (InputLength - FIELD_OFFSET(AFD_POLL_SET_UPDATE_INFO, Handles)) / sizeof(AFD_HANDLE) )
+        return UnlockAndMaybeComplete( FCB, STATUS_INVALID_PARAMETER, Irp, 0 );
+
+    AFD_DbgPrint(MID_TRACE,("Called (FCB %p, HandleCount %u)\n",
+                            FCB, UpdateReq->HandleCount));
+
+    Set = FCB->PollSet;
+    if( !Set ) {
+        Set = ExAllocatePool( NonPagedPool, sizeof(AFD_POLL_SET) );
+        if( !Set )
+            return UnlockAndMaybeComplete( FCB, STATUS_NO_MEMORY, Irp, 0 );
+
+        InitializeListHead( &Set->Registrations );
+        InitializeListHead( &Set->ReadyList );
+        Set->WaitIrp = NULL;
+        Set->DeviceExt = DeviceExt;
+        KeInitializeTimerEx( &Set->Timer, NotificationTimer );
+        KeInitializeDpc( &Set->TimeoutDpc, PollSetTimeout, Set );
+        FCB->PollSet = Set;
+    }
+
+    for( i = 0; i < UpdateReq->HandleCount; i++ ) {
+        Status = ObReferenceObjectByHandle( (HANDLE)UpdateReq->Handles[i].Handle,
+                                            0,
+                                            *IoFileObjectType,
+                                            Irp->RequestorMode,
+                                            (PVOID*)&WatchedObject,
+                                            NULL );
+        if( !NT_SUCCESS(Status) ) break;
+
+        /* Only sockets know how to report to us */
+        if( WatchedObject->DeviceObject != DeviceObject ||
+            !WatchedObject->FsContext ) {
+            ObDereferenceObject( WatchedObject );
+            Status = STATUS_INVALID_HANDLE;
+            break;
+        }
+
+        WatchedFCB = WatchedObject->FsContext;
+        Removed = NULL;
+
+        KeAcquireSpinLock( &DeviceExt->Lock, &OldIrql );
+
+        Registration = FindRegistration( Set, WatchedFCB );
+
+        if( !Registration && UpdateReq->Handles[i].Events ) {
+            Registration = ExAllocatePool( NonPagedPool,
+                                           sizeof(AFD_POLL_REGISTRATION) );
+            if( Registration ) {
+                Registration->Set = Set;
+                Registration->FileObject = WatchedObject;
+                InsertTailList( &Set->Registrations, &Registration->SetEntry );
+                InsertTailList( &WatchedFCB->PollRegistrations, &Registration->FcbEntry );
+                InitializeListHead( &Registration->ReadyEntry );
+
+                /* The registration keeps the reference */
+                WatchedObject = NULL;
+            } else
+                Status = STATUS_NO_MEMORY;
+        }
+
+        if( Registration && UpdateReq->Handles[i].Events ) {
+            Registration->Handle = UpdateReq->Handles[i].Handle;
+            Registration->Events = UpdateReq->Handles[i].Events;
+
+            if( Registration->Events & WatchedFCB->PollState )
+                MarkRegistrationReady( Registration );
+        } else if( Registration ) {
+            RemoveEntryList( &Registration->SetEntry );
+            RemoveEntryList( &Registration->FcbEntry );
+            RemoveEntryList( &Registration->ReadyEntry );
+            Removed = Registration;
+        }
+
+        KeReleaseSpinLock( &DeviceExt->Lock, OldIrql );
+
+        if( Removed ) {
+            ObDereferenceObject( Removed->FileObject );
+            ExFreePool( Removed );
+        }
+
+        if( WatchedObject ) ObDereferenceObject( WatchedObject );
+
+        if( !NT_SUCCESS(Status) ) break;
+    }
+
+    AFD_DbgPrint(MID_TRACE,("Returning %x\n", Status));
+
+    return UnlockAndMaybeComplete( FCB, Status, Irp, 0 );
+}
+
+NTSTATUS NTAPI
+AfdPollSetWait( PDEVICE_OBJECT DeviceObject, PIRP Irp,
+                PIO_STACK_LOCATION IrpSp ) {
+    PFILE_OBJECT FileObject = IrpSp->FileObject;
+    PAFD_FCB FCB = FileObject->FsContext;
+    PAFD_POLL_SET_WAIT_INFO WaitReq = Irp->AssociatedIrp.SystemBuffer;
+    PAFD_DEVICE_EXTENSION DeviceExt = DeviceObject->DeviceExtension;
+    PAFD_POLL_SET Set;
+    LARGE_INTEGER Timeout;
+    KIRQL OldIrql;
+    UINT Count;
+
+    if( !SocketAcquireStateLock( FCB ) ) return LostSocket( Irp );
+
+    if( IrpSp->Parameters.DeviceIoControl.InputBufferLength < sizeof(LARGE_INTEGER) ||
+        IrpSp->Parameters.DeviceIoControl.OutputBufferLength <
+        FIELD_OFFSET(AFD_POLL_SET_WAIT_INFO, Handles) + sizeof(AFD_HANDLE) )
+        return UnlockAndMaybeComplete( FCB, STATUS_INVALID_PARAMETER, Irp, 0 );
+
+    Set = FCB->PollSet;
+    if( !Set )
+        return UnlockAndMaybeComplete( FCB, STATUS_INVALID_PARAMETER, Irp, 0 );
+
+    /* The output overwrites the request */
+    Timeout = WaitReq->Timeout;
+
+    KeAcquireSpinLock( &DeviceExt->Lock, &OldIrql );
+
+    /* One waiter at a time */
+    if( Set->WaitIrp ) {
+        KeReleaseSpinLock( &DeviceExt->Lock, OldIrql );
+        return UnlockAndMaybeComplete( FCB, STATUS_INVALID_PARAMETER, Irp, 0 );
+    }
+
+    Count = HarvestPollSet( Set, WaitReq->Handles, MaxPollSetHandles( IrpSp ) );
+
+    if( Count || !Timeout.QuadPart ) {
+        KeReleaseSpinLock( &DeviceExt->Lock, OldIrql );
+
+        WaitReq->HandleCount = Count;
+        return UnlockAndMaybeComplete( FCB, Count ? STATUS_SUCCESS : STATUS_TIMEOUT, Irp,
+                                       FIELD_OFFSET(AFD_POLL_SET_WAIT_INFO, Handles) +
+                                       sizeof(AFD_HANDLE) * Count );
+    }
+
+    Set->WaitIrp = Irp;
+    KeSetTimer( &Set->Timer, Timeout, &Set->TimeoutDpc );
+
+    IoMarkIrpPending( Irp );
+    (void)IoSetCancelRoutine( Irp, AfdCancelHandler );
+
+    KeReleaseSpinLock( &DeviceExt->Lock, OldIrql );
+
+    SocketStateUnlock( FCB );
+
+    return STATUS_PENDING;
+}
+
+VOID CancelPollSetWait( PAFD_FCB FCB, PIRP Irp ) {
+    PAFD_POLL_SET Set = FCB->PollSet;
+    KIRQL OldIrql;
+
+    /* DestroyPollSet completed it already */
+    if( !Set ) return;
+
+    KeAcquireSpinLock( &Set->DeviceExt->Lock, &OldIrql );
+
+    if( Set->WaitIrp == Irp )
+        CompletePollSetWait( Set, STATUS_CANCELLED );
+
+    KeReleaseSpinLock( &Set->DeviceExt->Lock, OldIrql );
+}
+
+VOID DestroyPollSet( PAFD_FCB FCB ) {
+    PAFD_POLL_SET Set = FCB->PollSet;
+    PAFD_POLL_REGISTRATION Registration;
+    PLIST_ENTRY ListEntry;
+    KIRQL OldIrql;
+
+    if( !Set ) return;
+
+    KeAcquireSpinLock( &Set->DeviceExt->Lock, &OldIrql );
+
+    if( Set->WaitIrp )
+        CompletePollSetWait( Set, STATUS_CANCELLED );
+
+    /* Once the sockets forget about them, the registrations are ours */
+    for( ListEntry = Set->Registrations.Flink;
+         ListEntry != &Set->Registrations;
+         ListEntry = ListEntry->Flink ) {
+        Registration = CONTAINING_RECORD(ListEntry, AFD_POLL_REGISTRATION, SetEntry);
+        RemoveEntryList( &Registration->FcbEntry );
+    }
+
+    KeReleaseSpinLock( &Set->DeviceExt->Lock, OldIrql );
+
+    FCB->PollSet = NULL;
+
+    /* PollSetTimeout may still be running */
+    KeCancelTimer( &Set->Timer );
+    KeFlushQueuedDpcs();
+
+    while( !IsListEmpty( &Set->Registrations ) ) {
+        ListEntry = RemoveHeadList( &Set->Registrations );
+        Registration = CONTAINING_RECORD(ListEntry, AFD_POLL_REGISTRATION, SetEntry);
+        ObDereferenceObject( Registration->FileObject );
+        ExFreePool( Registration );
+    }
+
+    ExFreePool( Set );
+}
+
+/* Closing a socket takes it out of every poll set */
+VOID KillPollRegistrationsForFCB( PAFD_FCB FCB ) {
+    PAFD_POLL_REGISTRATION Registration;
+    PLIST_ENTRY ListEntry;
+    LIST_ENTRY Removed;
+    KIRQL OldIrql;
+
+    InitializeListHead( &Removed );
+
+    KeAcquireSpinLock( &FCB->DeviceExt->Lock, &OldIrql );
+
+    while( !IsListEmpty( &FCB->PollRegistrations ) ) {
+        ListEntry = RemoveHeadList( &FCB->PollRegistrations );
+        Registration = CONTAINING_RECORD(ListEntry, AFD_POLL_REGISTRATION, FcbEntry);
+        RemoveEntryList( &Registration->SetEntry );
+        RemoveEntryList( &Registration->ReadyEntry );
+        InsertTailList( &Removed, &Registration->SetEntry );
+    }
+
+    KeReleaseSpinLock( &FCB->DeviceExt->Lock, OldIrql );
+
+    while( !IsListEmpty( &Removed ) ) {
+        ListEntry = RemoveHeadList( &Removed );
+        Registration = CONTAINING_RECORD(ListEntry, AFD_POLL_REGISTRATION, SetEntry);
+        ObDereferenceObject( Registration->FileObject );
+        ExFreePool( Registration );
+    }
+}
+
 /* * * NOTE ALWAYS CALLED AT DISPATCH_LEVEL * * */
 static BOOLEAN UpdatePollWithFCB( PAFD_ACTIVE_POLL Poll, PFILE_OBJECT FileObject ) {
     UINT i;
@@ -405,6 +816,8 @@ static BOOLEAN UpdatePollWithFCB( PAFD_ACTIVE_POLL Poll, PFILE_OBJECT FileObject
 VOID PollReeval( PAFD_DEVICE_EXTENSION DeviceExt, PFILE_OBJECT FileObject ) {
     PAFD_ACTIVE_POLL Poll = NULL;
     PLIST_ENTRY ThePollEnt = NULL;
+    PAFD_POLL_ENTRY Entry;
+    PAFD_POLL_REGISTRATION Registration;
     PAFD_FCB FCB;
     KIRQL OldIrql;
     PAFD_POLL_INFO PollReq;
@@ -422,22 +835,34 @@ VOID PollReeval( PAFD_DEVICE_EXTENSION DeviceExt, PFILE_OBJECT FileObject ) {
         return;
     }
 
-    /* Now signal normal select irps */
-    ThePollEnt = DeviceExt->Polls.Flink;
+    /* Now signal the select irps waiting on this socket */
+    ThePollEnt = FCB->PollEntries.Flink;
 
-    while( ThePollEnt != &DeviceExt->Polls ) {
-        Poll = CONTAINING_RECORD( ThePollEnt, AFD_ACTIVE_POLL, ListEntry );
+    while( ThePollEnt != &FCB->PollEntries ) {
+        Entry = CONTAINING_RECORD( ThePollEnt, AFD_POLL_ENTRY, ListEntry );
+        Poll = Entry->Poll;
         PollReq = Poll->Irp->AssociatedIrp.SystemBuffer;
         AFD_DbgPrint(MID_TRACE,("Checking poll %p\n", Poll));
 
-        if( UpdatePollWithFCB( Poll, FileObject ) ) {
-            ThePollEnt = ThePollEnt->Flink;
+        if( (PollReq->Handles[Entry->Index].Events & FCB->PollState) &&
+            UpdatePollWithFCB( Poll, FileObject ) ) {
+            ThePollEnt = NextPollEntry( &FCB->PollEntries, ThePollEnt, Poll );
             AFD_DbgPrint(MID_TRACE,("Signalling socket\n"));
             SignalSocket( Poll, NULL, PollReq, STATUS_SUCCESS );
         } else
             ThePollEnt = ThePollEnt->Flink;
     }
 
+    /* And the poll sets watching it */
+    for( ThePollEnt = FCB->PollRegistrations.Flink;
+         ThePollEnt != &FCB->PollRegistrations;
+         ThePollEnt = ThePollEnt->Flink ) {
+        Registration = CONTAINING_RECORD( ThePollEnt, AFD_POLL_REGISTRATION, FcbEntry );
+
+        if( Registration->Events & FCB->PollState )
+            MarkRegistrationReady( Registration );
+    }
+
     KeReleaseSpinLock( &DeviceExt->Lock, OldIrql );
 
     if((FCB->EventSelect) &&
@@ -0,0 +1,711 @@
+/*
+ * COPYRIGHT:        See COPYING in the top level directory
+ * PROJECT:          ReactOS kernel
+ * FILE:             drivers/network/afd/afd/transmit.c
+ * PURPOSE:          Ancillary functions driver -- TransmitFile
+ */
+
+#include "afd.h"
+
+#include <tdikrnl.h>
+
+/* File data read for each round of sends, unless the caller asks otherwise */
+#define AFD_TRANSMIT_SEND_SIZE  0x10000
+
+/* Each round reads into one pool buffer or locked MDL, so cap what the caller asks for */
+#define AFD_TRANSMIT_MAX_SEND_SIZE 0x100000
+
+/* Keeps the element array to a sane size */
+#define AFD_TRANSMIT_MAX_RANGES 0x1000
+
+static IO_WORKITEM_ROUTINE AfdTransmitWorker;
+
+static
+BOOLEAN
+AfdTransmitMdlRead(PFILE_OBJECT FileObject,
+                   PLARGE_INTEGER FileOffset,
+                   ULONG Length,
+                   PMDL *MdlChain,
+                   PIO_STATUS_BLOCK Iosb)
+{
+    PFSRTL_COMMON_FCB_HEADER FcbHeader = FileObject->FsContext;
+    PDEVICE_OBJECT DeviceObject = IoGetRelatedDeviceObject(FileObject);
+    PFAST_IO_DISPATCH FastDispatch = DeviceObject->DriverObject->FastIoDispatch;
+    BOOLEAN Result = TRUE;
+
+    /* Let the file system do it if it has a fast path for it */
+    if (FastDispatch && FastDispatch->MdlRead &&
+        FastDispatch->MdlRead(FileObject, FileOffset, Length, 0, MdlChain, Iosb, DeviceObject))
+    {
+        return TRUE;
+    }
+
+    /* Otherwise take the data from the cache ourselves, if there is one */
+    if (!FileObject->PrivateCacheMap || !FcbHeader || !FcbHeader->Resource)
+        return FALSE;
+
+    FsRtlEnterFileSystem();
+    ExAcquireResourceSharedLite(FcbHeader->Resource, TRUE);
+
+    if (FileOffset->QuadPart >= FcbHeader->FileSize.QuadPart)
+    {
+        Iosb->Status = STATUS_END_OF_FILE;
+        Iosb->Information = 0;
+    }
+    else
+    {
+        Length = (ULONG)MIN(Length, FcbHeader->FileSize.QuadPart - FileOffset->QuadPart);
+
+        _SEH2_TRY {
+            CcMdlRead(FileObject, FileOffset, Length, MdlChain, Iosb);
+        } _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER) {
+            *MdlChain = NULL;
+            Result = FALSE;
+        } _SEH2_END;
+    }
+
+    ExReleaseResourceLite(FcbHeader->Resource);
+    FsRtlExitFileSystem();
+
+    return Result;
+}
+
+static
+NTSTATUS
+AfdTransmitReadUncached(PAFD_TRANSMIT_CONTEXT Context,
+                        PAFD_TRANSMIT_ELEMENT Element,
+                        ULONG Length,
+                        PIO_STATUS_BLOCK Iosb)
+{
+    PDEVICE_OBJECT DeviceObject;
+    PVOID Buffer;
+    KEVENT Event;
+    PIRP Irp;
+    PMDL Mdl;
+    NTSTATUS Status;
+
+    Buffer = ExAllocatePool(NonPagedPool, Length);
+    if (!Buffer)
+        return STATUS_NO_MEMORY;
+
+    /* A regular read, which normally gets the file cached for the next round */
+    DeviceObject = IoGetRelatedDeviceObject(Context->FileObject);
+    KeInitializeEvent(&Event, NotificationEvent, FALSE);
+    Irp = IoBuildSynchronousFsdRequest(IRP_MJ_READ,
+                                       DeviceObject,
+                                       Buffer,
+                                       Length,
+                                       &Element->Offset,
+                                       &Event,
+                                       Iosb);
+    if (!Irp)
+    {
+        ExFreePool(Buffer);
+        return STATUS_NO_MEMORY;
+    }
+
+    IoGetNextIrpStackLocation(Irp)->FileObject = Context->FileObject;
+
+    Status = IoCallDriver(DeviceObject, Irp);
+    if (Status == STATUS_PENDING)
+    {
+        KeWaitForSingleObject(&Event, Executive, KernelMode, FALSE, NULL);
+        Status = Iosb->Status;
+    }
+
+    if (NT_SUCCESS(Status) && !Iosb->Information)
+        Status = STATUS_END_OF_FILE;
+
+    if (!NT_SUCCESS(Status))
+    {
+        ExFreePool(Buffer);
+        return Status;
+    }
+
+    Mdl = IoAllocateMdl(Buffer, (ULONG)Iosb->Information, FALSE, FALSE, NULL);
+    if (!Mdl)
+    {
+        ExFreePool(Buffer);
+        return STATUS_NO_MEMORY;
+    }
+
+    MmBuildMdlForNonPagedPool(Mdl);
+
+    Context->Buffer = Buffer;
+    Context->MdlChain = Mdl;
+
+    return STATUS_SUCCESS;
+}
+
+static
+NTSTATUS
+AfdTransmitReadFile(PAFD_TRANSMIT_CONTEXT Context,
+                    PAFD_TRANSMIT_ELEMENT Element)
+{
+    IO_STATUS_BLOCK Iosb;
+    ULONG Length;
+    NTSTATUS Status;
+
+    Length = MIN(Element->Length, Context->SendSize);
+
+    /* Describe the data where it sits in the cache, without copying it */
+    if (AfdTransmitMdlRead(Context->FileObject,
+                           &Element->Offset,
+                           Length,
+                           &Context->MdlChain,
+                           &Iosb))
+    {
+        Status = Iosb.Status;
+        if (NT_SUCCESS(Status) && !Iosb.Information)
+            Status = STATUS_END_OF_FILE;
+
+        if (!NT_SUCCESS(Status) && Context->MdlChain)
+        {
+            CcMdlReadComplete(Context->FileObject, Context->MdlChain);
+            Context->MdlChain = NULL;
+        }
+    }
+    else
+    {
+        Status = AfdTransmitReadUncached(Context, Element, Length, &Iosb);
+    }
+
+    if (!NT_SUCCESS(Status))
+    {
+        AFD_DbgPrint(MIN_TRACE,("Reading %u bytes at %I64x failed: %x\n",
+                                Length, Element->Offset.QuadPart, Status));
+        return Status;
+    }
+
+    Element->Offset.QuadPart += Iosb.Information;
+    Element->Length -= (ULONG)Iosb.Information;
+
+    Context->CurrentMdl = Context->MdlChain;
+    Context->CurrentOffset = 0;
+
+    return STATUS_SUCCESS;
+}
+
+static
+VOID
+AfdTransmitReleaseFileData(PAFD_TRANSMIT_CONTEXT Context)
+{
+    if (!Context->MdlChain)
+        return;
+
+    if (Context->Buffer)
+    {
+        IoFreeMdl(Context->MdlChain);
+        ExFreePool(Context->Buffer);
+        Context->Buffer = NULL;
+    }
+    else
+    {
+        CcMdlReadComplete(Context->FileObject, Context->MdlChain);
+    }
+
+    Context->MdlChain = NULL;
+}
+
+static IO_COMPLETION_ROUTINE AfdTransmitSendComplete;
+static
+NTSTATUS
+NTAPI
+AfdTransmitSendComplete(PDEVICE_OBJECT DeviceObject,
+                        PIRP Irp,
+                        PVOID Context)
+{
+    PAFD_TRANSMIT_CONTEXT Transmit = Context;
+    PAFD_FCB FCB = Transmit->FCB;
+    ULONG_PTR BytesSent = Irp->IoStatus.Information;
+    NTSTATUS Status = Irp->IoStatus.Status;
+
+    UNREFERENCED_PARAMETER(DeviceObject);
+
+    AFD_DbgPrint(MID_TRACE,("Called, status %x, %u bytes sent\n",
+                            Status, BytesSent));
+
+    /* Nobody may cancel the IRP once we start freeing it */
+    if (SocketAcquireStateLock(FCB))
+    {
+        ASSERT(Transmit->SendIrp == Irp);
+        Transmit->SendIrp = NULL;
+        SocketStateUnlock(FCB);
+    }
+
+    Irp->MdlAddress = NULL;
+    IoFreeIrp(Irp);
+    IoFreeMdl(Transmit->SendMdl);
+    Transmit->SendMdl = NULL;
+
+    if (!NT_SUCCESS(Status))
+    {
+        Transmit->Status = Status;
+    }
+    else
+    {
+        Transmit->BytesSent += BytesSent;
+        Transmit->CurrentOffset += (ULONG)BytesSent;
+
+        /* Move on once the transport took the whole MDL */
+        if (Transmit->CurrentOffset >= MmGetMdlByteCount(Transmit->CurrentMdl))
+        {
+            Transmit->CurrentMdl = Transmit->CurrentMdl->Next;
+            Transmit->CurrentOffset = 0;
+        }
+    }
+
+    /* Reading the file needs PASSIVE_LEVEL */
+    IoQueueWorkItem(Transmit->WorkItem, AfdTransmitWorker, DelayedWorkQueue, Transmit);
+
+    return STATUS_MORE_PROCESSING_REQUIRED;
+}
+
+static
+NTSTATUS
+AfdTransmitSend(PAFD_TRANSMIT_CONTEXT Context)
+{
+    PAFD_FCB FCB = Context->FCB;
+    PDEVICE_OBJECT DeviceObject;
+    PCHAR VirtualAddress;
+    ULONG Length;
+    PIRP Irp;
+
+    DeviceObject = IoGetRelatedDeviceObject(FCB->Connection.Object);
+
+    /* Partial MDL over whatever the transport didn't take yet */
+    VirtualAddress = (PCHAR)MmGetMdlVirtualAddress(Context->CurrentMdl) + Context->CurrentOffset;
+    Length = MmGetMdlByteCount(Context->CurrentMdl) - Context->CurrentOffset;
+
+    Context->SendMdl = IoAllocateMdl(VirtualAddress, Length, FALSE, FALSE, NULL);
+    if (!Context->SendMdl)
+        return STATUS_NO_MEMORY;
+
+    IoBuildPartialMdl(Context->CurrentMdl, Context->SendMdl, VirtualAddress, Length);
+
+    Irp = IoAllocateIrp(DeviceObject->StackSize, FALSE);
+    if (!Irp)
+    {
+        IoFreeMdl(Context->SendMdl);
+        Context->SendMdl = NULL;
+        return STATUS_NO_MEMORY;
+    }
+
+    TdiBuildSend(Irp,
+                 DeviceObject,
+                 FCB->Connection.Object,
+                 AfdTransmitSendComplete,
+                 Context,
+                 Context->SendMdl,
+                 0,
+                 Length);
+
+    Context->SendIrp = Irp;
+    IoCallDriver(DeviceObject, Irp);
+
+    return STATUS_PENDING;
+}
+
+static
+VOID
+AfdTransmitComplete(PAFD_TRANSMIT_CONTEXT Context, NTSTATUS Status)
+{
+    PAFD_FCB FCB = Context->FCB;
+    PIRP Irp = Context->Irp;
+    ULONG i;
+
+    AFD_DbgPrint(MID_TRACE,("Transmit done, status %x, %u bytes sent\n",
+                            Status, Context->BytesSent));
+
+    AfdTransmitReleaseFileData(Context);
+
+    for (i = 0; i < Context->ElementCount; i++)
+    {
+        if (Context->Elements[i].Mdl)
+        {
+            MmUnlockPages(Context->Elements[i].Mdl);
+            IoFreeMdl(Context->Elements[i].Mdl);
+        }
+    }
+
+    if (Context->FileObject)
+        ObDereferenceObject(Context->FileObject);
+
+    IoFreeWorkItem(Context->WorkItem);
+
+    if (!SocketAcquireStateLock(FCB))
+    {
+        ExFreePool(Context);
+        (void)IoSetCancelRoutine(Irp, NULL);
+        LostSocket(Irp);
+        return;
+    }
+
+    FCB->Transmit = NULL;
+
+    if (NT_SUCCESS(Status) && (Context->Flags & AFD_TF_DISCONNECT) &&
+        FCB->ConnectCallInfo && !FCB->DisconnectPending)
+    {
+        /* Same graceful closure as shutdown(SD_SEND) */
+        FCB->DisconnectFlags = TDI_DISCONNECT_RELEASE;
+        FCB->DisconnectTimeout.QuadPart = -1000000;
+        FCB->DisconnectPending = TRUE;
+        FCB->SendClosed = TRUE;
+        FCB->PollState &= ~AFD_EVENT_SEND;
+    }
+
+    /* Sends that came in meanwhile were held back, then a disconnect may go */
+    RetryPendingSends(FCB);
+    if (FCB->DisconnectPending)
+        RetryDisconnectCompletion(FCB);
+
+    UnlockAndMaybeComplete(FCB, Status, Irp, (UINT)Context->BytesSent);
+
+    ExFreePool(Context);
+}
+
+static
+VOID
+NTAPI
+AfdTransmitWorker(PDEVICE_OBJECT DeviceObject, PVOID Context)
+{
+    PAFD_TRANSMIT_CONTEXT Transmit = Context;
+    PAFD_FCB FCB = Transmit->FCB;
+    PAFD_TRANSMIT_ELEMENT Element;
+    NTSTATUS Status;
+
+    UNREFERENCED_PARAMETER(DeviceObject);
+
+    for (;;)
+    {
+        Status = Transmit->Status;
+        if (!NT_SUCCESS(Status))
+            break;
+
+        if (!Transmit->CurrentMdl)
+        {
+            /* Done with the current element, or the current piece of it */
+            AfdTransmitReleaseFileData(Transmit);
+
+            if (Transmit->Element == Transmit->ElementCount)
+                break;
+
+            Element = &Transmit->Elements[Transmit->Element];
+            if (Element->Mdl)
+            {
+                Transmit->CurrentMdl = Element->Mdl;
+                Transmit->CurrentOffset = 0;
+                Transmit->Element++;
+            }
+            else if (!Element->Length)
+            {
+                Transmit->Element++;
+                continue;
+            }
+            else
+            {
+                Status = AfdTransmitReadFile(Transmit, Element);
+                if (!NT_SUCCESS(Status))
+                    break;
+            }
+        }
+
+        if (!SocketAcquireStateLock(FCB))
+        {
+            Status = STATUS_FILE_CLOSED;
+            break;
+        }
+
+        if (Transmit->Irp->Cancel)
+            Status = STATUS_CANCELLED;
+        else if (FCB->State == SOCKET_STATE_CLOSED || (FCB->PollState & (AFD_EVENT_CLOSE | AFD_EVENT_ABORT)))
+            Status = STATUS_FILE_CLOSED;
+        else
+            Status = AfdTransmitSend(Transmit);
+
+        SocketStateUnlock(FCB);
+
+        /* The completion routine brings us back */
+        if (Status == STATUS_PENDING)
+            return;
+
+        break;
+    }
+
+    AfdTransmitComplete(Transmit, Status);
+}
+
+static
+PMDL
+AfdTransmitLockBuffer(PAFD_WSABUF Buffer, KPROCESSOR_MODE LockMode)
+{
+    BOOLEAN LockFailed = FALSE;
+    PMDL Mdl;
+
+    Mdl = IoAllocateMdl(Buffer->buf, Buffer->len, FALSE, FALSE, NULL);
+    if (!Mdl)
+        return NULL;
+
+    _SEH2_TRY {
+        MmProbeAndLockPages(Mdl, LockMode, IoReadAccess);
+    } _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER) {
+        LockFailed = TRUE;
+    } _SEH2_END;
+
+    if (LockFailed)
+    {
+        AFD_DbgPrint(MIN_TRACE,("Failed to lock pages\n"));
+        IoFreeMdl(Mdl);
+        return NULL;
+    }
+
+    return Mdl;
+}
+
+NTSTATUS NTAPI
+AfdTransmitFile(PDEVICE_OBJECT DeviceObject, PIRP Irp,
+                PIO_STACK_LOCATION IrpSp)
+{
+    PFILE_OBJECT FileObject = IrpSp->FileObject;
+    PAFD_FCB FCB = FileObject->FsContext;
+    PAFD_TRANSMIT_FILE_INFO TransmitReq;
+    PAFD_TRANSMIT_CONTEXT Context;
+    PAFD_TRANSMIT_ELEMENT Element;
+    LARGE_INTEGER FileSize;
+    NTSTATUS Status = STATUS_SUCCESS;
+    ULONG i;
+
+    AFD_DbgPrint(MID_TRACE,("Called on %p\n", FCB));
+
+    if (!SocketAcquireStateLock(FCB)) return LostSocket(Irp);
+
+    if ((FCB->Flags & AFD_ENDPOINT_CONNECTIONLESS) ||
+        FCB->State != SOCKET_STATE_CONNECTED)
+    {
+        AFD_DbgPrint(MIN_TRACE,("Socket not connected\n"));
+        return UnlockAndMaybeComplete(FCB, STATUS_INVALID_CONNECTION, Irp, 0);
+    }
+
+    if (FCB->SendClosed)
+    {
+        AFD_DbgPrint(MIN_TRACE,("No more sends\n"));
+        return UnlockAndMaybeComplete(FCB, STATUS_FILE_CLOSED, Irp, 0);
+    }
+
+    /* One at a time, the data of two transmits would get mixed up */
+    if (FCB->Transmit)
+    {
+        AFD_DbgPrint(MIN_TRACE,("Transmit already in progress\n"));
+        return UnlockAndMaybeComplete(FCB, STATUS_DEVICE_BUSY, Irp, 0);
+    }
+
+    if (!(TransmitReq = LockRequest(Irp, IrpSp, FALSE, NULL)))
+        return UnlockAndMaybeComplete(FCB, STATUS_NO_MEMORY, Irp, 0);
+
+    if (TransmitReq->RangeCount > AFD_TRANSMIT_MAX_RANGES ||
+        (TransmitReq->RangeCount && !TransmitReq->FileHandle))
+    {
+        return UnlockAndMaybeComplete(FCB, STATUS_INVALID_PARAMETER, Irp, 0);
+    }
+
+    /* Head, file ranges and tail, in that order */
+    Context = ExAllocatePool(NonPagedPool,
+                             FIELD_OFFSET(AFD_TRANSMIT_CONTEXT,
+                                          Elements[TransmitReq->RangeCount + 2]));
+    if (!Context)
+        return UnlockAndMaybeComplete(FCB, STATUS_NO_MEMORY, Irp, 0);
+
+    RtlZeroMemory(Context, FIELD_OFFSET(AFD_TRANSMIT_CONTEXT, Elements));
+    Context->Irp = Irp;
+    Context->FCB = FCB;
+    Context->Flags = TransmitReq->Flags;
+    Context->SendSize = TransmitReq->SendSize ? TransmitReq->SendSize : AFD_TRANSMIT_SEND_SIZE;
+    Context->SendSize = MIN(Context->SendSize, AFD_TRANSMIT_MAX_SEND_SIZE);
+    Context->Status = STATUS_SUCCESS;
+
+    Context->WorkItem = IoAllocateWorkItem(DeviceObject);
+    if (!Context->WorkItem)
+    {
+        ExFreePool(Context);
+        return UnlockAndMaybeComplete(FCB, STATUS_NO_MEMORY, Irp, 0);
+    }
+
+    if (TransmitReq->Head.len)
+    {
+        Element = &Context->Elements[Context->ElementCount++];
+        Element->Length = TransmitReq->Head.len;
+        Element->Mdl = AfdTransmitLockBuffer(&TransmitReq->Head, Irp->RequestorMode);
+        if (!Element->Mdl)
+        {
+            Context->ElementCount--;
+            Status = STATUS_ACCESS_VIOLATION;
+            goto Fail;
+        }
+    }
+
+    if (TransmitReq->RangeCount)
+    {
+        Status = ObReferenceObjectByHandle(TransmitReq->FileHandle,
+                                           FILE_READ_DATA,
+                                           *IoFileObjectType,
+                                           Irp->RequestorMode,
+                                           (PVOID*)&Context->FileObject,
+                                           NULL);
+        if (!NT_SUCCESS(Status))
+            goto Fail;
+
+        Status = FsRtlGetFileSize(Context->FileObject, &FileSize);
+        if (!NT_SUCCESS(Status))
+            goto Fail;
+
+        _SEH2_TRY {
+            if (Irp->RequestorMode != KernelMode)
+            {
+                ProbeForRead(TransmitReq->Ranges,
+                             TransmitReq->RangeCount * sizeof(AFD_TRANSMIT_RANGE),
+                             sizeof(ULONG));
+            }
+
+            for (i = 0; i < TransmitReq->RangeCount; i++)
+            {
+                Element = &Context->Elements[Context->ElementCount++];
+                Element->Mdl = NULL;
+                Element->Offset = TransmitReq->Ranges[i].Offset;
+                Element->Length = TransmitReq->Ranges[i].Length;
+            }
+        } _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER) {
+            Status = _SEH2_GetExceptionCode();
+        } _SEH2_END;
+
+        if (!NT_SUCCESS(Status))
+            goto Fail;
+
+        /* A zero length means the rest of the file, and nothing goes past its end */
+        for (i = Context->ElementCount - TransmitReq->RangeCount; i < Context->ElementCount; i++)
+        {
+            Element = &Context->Elements[i];
+            if (Element->Offset.QuadPart < 0)
+            {
+                Status = STATUS_INVALID_PARAMETER;
+                goto Fail;
+            }
+
+            if (Element->Offset.QuadPart >= FileSize.QuadPart)
+            {
+                Element->Length = 0;
+            }
+            else if (!Element->Length ||
+                     Element->Length > FileSize.QuadPart - Element->Offset.QuadPart)
+            {
+                Element->Length = (ULONG)MIN(MAXULONG, FileSize.QuadPart - Element->Offset.QuadPart);
+            }
+        }
+    }
+
+    if (TransmitReq->Tail.len)
+    {
+        Element = &Context->Elements[Context->ElementCount++];
+        Element->Length = TransmitReq->Tail.len;
+        Element->Mdl = AfdTransmitLockBuffer(&TransmitReq->Tail, Irp->RequestorMode);
+        if (!Element->Mdl)
+        {
+            Context->ElementCount--;
+            Status = STATUS_ACCESS_VIOLATION;
+            goto Fail;
+        }
+    }
+
+    /* Same as any other request left pending, unless it's cancelled already */
+    IoAcquireCancelSpinLock(&Irp->CancelIrql);
+    if (Irp->Cancel)
+    {
+        IoReleaseCancelSpinLock(Irp->CancelIrql);
+        Status = STATUS_CANCELLED;
+        goto Fail;
+    }
+    (void)IoSetCancelRoutine(Irp, AfdCancelHandler);
+    IoReleaseCancelSpinLock(Irp->CancelIrql);
+
+    FCB->Transmit = Context;
+    IoMarkIrpPending(Irp);
+
+    /* Data already in the send window goes out first */
+    if (FCB->SendIrp.InFlightRequest ||
+        !IsListEmpty(&FCB->PendingIrpList[FUNCTION_SEND]))
+    {
+        Context->Waiting = TRUE;
+    }
+    else
+    {
+        IoQueueWorkItem(Context->WorkItem, AfdTransmitWorker, DelayedWorkQueue, Context);
+    }
+
+    SocketStateUnlock(FCB);
+
+    return STATUS_PENDING;
+
+Fail:
+    for (i = 0; i < Context->ElementCount; i++)
+    {
+        if (Context->Elements[i].Mdl)
+        {
+            MmUnlockPages(Context->Elements[i].Mdl);
+            IoFreeMdl(Context->Elements[i].Mdl);
+        }
+    }
+
+    if (Context->FileObject)
+        ObDereferenceObject(Context->FileObject);
+
+    IoFreeWorkItem(Context->WorkItem);
+    ExFreePool(Context);
+
+    return UnlockAndMaybeComplete(FCB, Status, Irp, 0);
+}
+
+/* Called with the socket locked once the send window has gone out */
+VOID
+AfdTransmitSendsDrained(PAFD_FCB FCB)
+{
+    PAFD_TRANSMIT_CONTEXT Context = FCB->Transmit;
+
+    if (Context && Context->Waiting)
+    {
+        Context->Waiting = FALSE;
+        IoQueueWorkItem(Context->WorkItem, AfdTransmitWorker, DelayedWorkQueue, Context);
+    }
+}
+
+/* Called with the socket locked when the transmit IRP is cancelled */
+VOID
+AfdCancelTransmitIrp(PAFD_FCB FCB, PIRP Irp)
+{
+    PAFD_TRANSMIT_CONTEXT Context = FCB->Transmit;
+
+    if (!Context || Context->Irp != Irp)
+        return;
+
+    /* The send in flight stops now, the worker sees the cancel at its next step */
+    if (Context->SendIrp)
+        IoCancelIrp(Context->SendIrp);
+
+    /* Nothing would wake a transmit still waiting behind earlier sends */
+    if (Context->Waiting)
+    {
+        Context->Waiting = FALSE;
+        IoQueueWorkItem(Context->WorkItem, AfdTransmitWorker, DelayedWorkQueue, Context);
+    }
+}
+
+/* Called with the socket locked when its handle goes away */
+VOID
+AfdCancelTransmit(PAFD_FCB FCB)
+{
+    PAFD_TRANSMIT_CONTEXT Context = FCB->Transmit;
+
+    if (!Context)
+        return;
+
+    /* The cancel routine does the rest */
+    IoCancelIrp(Context->Irp);
+}
@@ -94,6 +94,9 @@ static NTSTATUS NTAPI SendComplete
 
         RetryDisconnectCompletion(FCB);
 
+        /* A transmit waiting behind us finds out about the error itself */
+        AfdTransmitSendsDrained(FCB);
+
         SocketStateUnlock( FCB );
 
         return STATUS_SUCCESS;
@@ -250,6 +253,9 @@ static NTSTATUS NTAPI SendComplete
     {
         /* Nothing is waiting so try to complete a pending disconnect */
         RetryDisconnectCompletion(FCB);
+
+        /* Or start a transmit that was queued behind these sends */
+        AfdTransmitSendsDrained(FCB);
     }
 
     SocketStateUnlock( FCB );
@@ -257,6 +263,21 @@ static NTSTATUS NTAPI SendComplete
     return STATUS_SUCCESS;
 }
 
+VOID
+RetryPendingSends(PAFD_FCB FCB)
+{
+    if (FCB->Send.BytesUsed && !FCB->SendIrp.InFlightRequest && !FCB->Transmit)
+    {
+        TdiSend(&FCB->SendIrp.InFlightRequest,
+                FCB->Connection.Object,
+                0,
+                FCB->Send.Window,
+                FCB->Send.BytesUsed,
+                SendComplete,
+                FCB);
+    }
+}
+
 static IO_COMPLETION_ROUTINE PacketSocketSendComplete;
 static NTSTATUS NTAPI PacketSocketSendComplete
 ( PDEVICE_OBJECT DeviceObject,
@@ -543,8 +564,9 @@ AfdConnectedSocketWriteData(PDEVICE_OBJECT DeviceObject, PIRP Irp,
     /* We use the IRP tail for some temporary storage here */
     Irp->Tail.Overlay.DriverContext[3] = (PVOID)Irp->IoStatus.Information;
 
+    /* A transmit in progress owns the connection, its completion sends this */
     Status = QueueUserModeIrp(FCB, Irp, FUNCTION_SEND);
-    if (Status == STATUS_PENDING && !FCB->SendIrp.InFlightRequest)
+    if (Status == STATUS_PENDING && !FCB->SendIrp.InFlightRequest && !FCB->Transmit)
     {
         TdiSend(&FCB->SendIrp.InFlightRequest,
                 FCB->Connection.Object,
@@ -95,6 +95,12 @@ typedef struct _AFD_DEVICE_EXTENSION {
     KSPIN_LOCK Lock;
 } AFD_DEVICE_EXTENSION, *PAFD_DEVICE_EXTENSION;
 
+typedef struct _AFD_POLL_ENTRY {
+    LIST_ENTRY ListEntry;       /* In the PollEntries of the socket */
+    struct _AFD_ACTIVE_POLL *Poll;
+    UINT Index;                 /* Into the handle array of the poll */
+} AFD_POLL_ENTRY, *PAFD_POLL_ENTRY;
+
 typedef struct _AFD_ACTIVE_POLL {
     LIST_ENTRY ListEntry;
     PIRP Irp;
@@ -103,8 +109,29 @@ typedef struct _AFD_ACTIVE_POLL {
     KTIMER Timer;
     PKEVENT EventObject;
     BOOLEAN Exclusive;
+    UINT EntryCount;
+    AFD_POLL_ENTRY Entries[1];
 } AFD_ACTIVE_POLL, *PAFD_ACTIVE_POLL;
 
+typedef struct _AFD_POLL_SET {
+    LIST_ENTRY Registrations;
+    LIST_ENTRY ReadyList;       /* Registrations that may be ready */
+    PIRP WaitIrp;
+    PAFD_DEVICE_EXTENSION DeviceExt;
+    KDPC TimeoutDpc;
+    KTIMER Timer;
+} AFD_POLL_SET, *PAFD_POLL_SET;
+
+typedef struct _AFD_POLL_REGISTRATION {
+    LIST_ENTRY SetEntry;        /* In the Registrations of the set */
+    LIST_ENTRY FcbEntry;        /* In the PollRegistrations of the socket */
+    LIST_ENTRY ReadyEntry;      /* In the ReadyList of the set, or empty */
+    PAFD_POLL_SET Set;
+    PFILE_OBJECT FileObject;    /* Referenced */
+    SOCKET Handle;
+    ULONG Events;
+} AFD_POLL_REGISTRATION, *PAFD_POLL_REGISTRATION;
+
 typedef struct _IRP_LIST {
     LIST_ENTRY ListEntry;
     PIRP Irp;
@@ -183,8 +210,40 @@ typedef struct _AFD_FCB {
     LIST_ENTRY PendingIrpList[MAX_FUNCTIONS];
     LIST_ENTRY DatagramList;
     LIST_ENTRY PendingConnections;
+    struct _AFD_TRANSMIT_CONTEXT *Transmit;
+    PIRP SuperAcceptIrp;        /* AcceptEx waiting for the first data */
+    LIST_ENTRY PollEntries;     /* Selects waiting on this socket */
+    LIST_ENTRY PollRegistrations; /* Poll sets watching this socket */
+    PAFD_POLL_SET PollSet;      /* Set created through this handle */
 } AFD_FCB, *PAFD_FCB;
 
+typedef struct _AFD_TRANSMIT_ELEMENT {
+    PMDL Mdl;                   /* Locked head or tail buffer, NULL for a file range */
+    LARGE_INTEGER Offset;
+    ULONG Length;
+} AFD_TRANSMIT_ELEMENT, *PAFD_TRANSMIT_ELEMENT;
+
+typedef struct _AFD_TRANSMIT_CONTEXT {
+    PIRP Irp;
+    PAFD_FCB FCB;
+    PFILE_OBJECT FileObject;
+    PIO_WORKITEM WorkItem;
+    BOOLEAN Waiting;            /* For earlier sends to leave the send window */
+    PIRP SendIrp;               /* TDI send in flight */
+    PMDL SendMdl;
+    PMDL MdlChain;              /* File data being sent */
+    PVOID Buffer;               /* Backs MdlChain when the file isn't cached */
+    PMDL CurrentMdl;
+    ULONG CurrentOffset;
+    ULONG SendSize;
+    ULONG Flags;
+    ULONG_PTR BytesSent;
+    NTSTATUS Status;
+    ULONG Element;
+    ULONG ElementCount;
+    AFD_TRANSMIT_ELEMENT Elements[1];
+} AFD_TRANSMIT_CONTEXT, *PAFD_TRANSMIT_CONTEXT;
+
 /* bind.c */
 
 NTSTATUS WarmSocketForBind( PAFD_FCB FCB, ULONG ShareType );
@@ -258,6 +317,12 @@ NTSTATUS AfdListenSocket(PDEVICE_OBJECT DeviceObject, PIRP Irp,
 NTSTATUS AfdAccept( PDEVICE_OBJECT DeviceObject, PIRP Irp,
 		    PIO_STACK_LOCATION IrpSp );
 
+NTSTATUS AfdSuperAccept( PDEVICE_OBJECT DeviceObject, PIRP Irp,
+			 PIO_STACK_LOCATION IrpSp );
+
+VOID CompleteSuperAccept( PIRP Irp, NTSTATUS Status, ULONG_PTR Information );
+BOOLEAN CancelSuperAcceptReceive( PIRP Irp );
+
 /* lock.c */
 
 PAFD_WSABUF LockBuffers( PAFD_WSABUF Buf, UINT Count,
@@ -298,6 +363,7 @@ AfdConnectedSocketReadData(PDEVICE_OBJECT DeviceObject, PIRP Irp, PIO_STACK_LOCA
 NTSTATUS NTAPI
 AfdPacketSocketReadData(PDEVICE_OBJECT DeviceObject, PIRP Irp,
 			PIO_STACK_LOCATION IrpSp );
+VOID SatisfySuperAcceptReceive( PAFD_FCB FCB );
 
 /* select.c */
 
@@ -310,6 +376,15 @@ AfdEventSelect( PDEVICE_OBJECT DeviceObject, PIRP Irp,
 NTSTATUS NTAPI
 AfdEnumEvents( PDEVICE_OBJECT DeviceObject, PIRP Irp,
 	       PIO_STACK_LOCATION IrpSp );
+NTSTATUS NTAPI
+AfdPollSetUpdate( PDEVICE_OBJECT DeviceObject, PIRP Irp,
+		  PIO_STACK_LOCATION IrpSp );
+NTSTATUS NTAPI
+AfdPollSetWait( PDEVICE_OBJECT DeviceObject, PIRP Irp,
+		PIO_STACK_LOCATION IrpSp );
+VOID CancelPollSetWait( PAFD_FCB FCB, PIRP Irp );
+VOID DestroyPollSet( PAFD_FCB FCB );
+VOID KillPollRegistrationsForFCB( PAFD_FCB FCB );
 VOID PollReeval( PAFD_DEVICE_EXTENSION DeviceObject, PFILE_OBJECT FileObject );
 VOID KillSelectsForFCB( PAFD_DEVICE_EXTENSION DeviceExt,
                         PFILE_OBJECT FileObject, BOOLEAN ExclusiveOnly );
@@ -384,6 +459,15 @@ NTSTATUS TdiQueryMaxDatagramLength(
         PFILE_OBJECT FileObject,
         PUINT MaxDatagramLength);
 
+/* transmit.c */
+
+NTSTATUS NTAPI
+AfdTransmitFile(PDEVICE_OBJECT DeviceObject, PIRP Irp,
+                PIO_STACK_LOCATION IrpSp);
+VOID AfdTransmitSendsDrained(PAFD_FCB FCB);
+VOID AfdCancelTransmitIrp(PAFD_FCB FCB, PIRP Irp);
+VOID AfdCancelTransmit(PAFD_FCB FCB);
+
 /* write.c */
 
 NTSTATUS NTAPI
@@ -392,5 +476,6 @@ AfdConnectedSocketWriteData(PDEVICE_OBJECT DeviceObject, PIRP Irp,
 NTSTATUS NTAPI
 AfdPacketSocketWriteData(PDEVICE_OBJECT DeviceObject, PIRP Irp,
 			 PIO_STACK_LOCATION IrpSp);
+VOID RetryPendingSends(PAFD_FCB FCB);
 
 #endif /* _AFD_H */
@@ -136,7 +136,33 @@ typedef struct _HW_DEVICE_EXTENSION {
 
     UCHAR ReturningMediaStatus;
 
-    UCHAR Reserved[1];
+    //
+    // Indicates a bus-master transfer is outstanding.
+    //
+
+    BOOLEAN DmaInProgress;
+
+    //
+    // SET FEATURES transfer mode value for each device, 0 if the
+    // device cannot do DMA.
+    //
+
+    UCHAR DmaTransferMode[4];
+
+    //
+    // Bus-master register base for each channel, NULL if the
+    // controller is not a PCI bus-master IDE controller.
+    //
+
+    PUCHAR BusMasterBase[2];
+
+    //
+    // Physical region descriptor table, shared by both channels
+    // since only one request is outstanding at a time.
+    //
+
+    PPHYSICAL_REGION_DESCRIPTOR PrdTable;
+    ULONG PrdTablePhysical;
 
     //
     // Identify data for device
@@ -244,6 +270,20 @@ IdeMediaStatus(
     IN ULONG Channel
     );
 
+ULONG
+NTAPI
+IdeReadWrite(
+    IN PVOID HwDeviceExtension,
+    IN PSCSI_REQUEST_BLOCK Srb
+    );
+
+UCHAR
+NTAPI
+AtapiStopBusMaster(
+    IN PVOID HwDeviceExtension,
+    IN ULONG Channel
+    );
+
 
 
 BOOLEAN
@@ -557,6 +597,61 @@ Return Value:
             (UCHAR)(deviceExtension->FullIdentifyData.MaximumBlockTransfer & 0xFF);
     }
 
+    //
+    // Pick the DMA transfer mode for ATA disks.
+    //
+
+    deviceExtension->DmaTransferMode[(Channel * 2) + DeviceNumber] = 0;
+
+    if (Command == IDE_COMMAND_IDENTIFY &&
+        (deviceExtension->FullIdentifyData.Capabilities & IDENTIFY_CAPABILITIES_DMA_SUPPORTED)) {
+
+        UCHAR supported, active, mode;
+
+        if (deviceExtension->FullIdentifyData.UltraDMAFieldsValid &&
+            deviceExtension->FullIdentifyData.UltraDMASupport) {
+
+            supported = (UCHAR)deviceExtension->FullIdentifyData.UltraDMASupport;
+            active = (UCHAR)deviceExtension->FullIdentifyData.UltraDMAActive;
+
+            //
+            // Use the highest mode supported, limited to what can be assumed
+            // safe without knowing the cable type. Keep a faster mode the
+            // BIOS has already selected.
+            //
+
+            for (mode = 7; mode > 0; mode--) {
+                if (supported & (1 << mode)) {
+                    break;
+                }
+            }
+
+            if (mode > IDE_MAX_DEFAULT_UDMA_MODE) {
+
+                if (!(active & (1 << mode))) {
+                    mode = IDE_MAX_DEFAULT_UDMA_MODE;
+                    while (active >> (mode + 1)) {
+                        mode++;
+                    }
+                }
+            }
+
+            deviceExtension->DmaTransferMode[(Channel * 2) + DeviceNumber] = IDE_TRANSFER_MODE_UDMA | mode;
+
+        } else if (deviceExtension->FullIdentifyData.MultiWordDMASupport & 0x07) {
+
+            supported = (UCHAR)deviceExtension->FullIdentifyData.MultiWordDMASupport;
+
+            for (mode = 2; mode > 0; mode--) {
+                if (supported & (1 << mode)) {
+                    break;
+                }
+            }
+
+            deviceExtension->DmaTransferMode[(Channel * 2) + DeviceNumber] = IDE_TRANSFER_MODE_MWDMA | mode;
+        }
+    }
+
     ScsiPortMoveMemory(&deviceExtension->IdentifyData[(Channel * 2) + DeviceNumber],&deviceExtension->FullIdentifyData,sizeof(IDENTIFY_DATA2));
 
     if (deviceExtension->IdentifyData[(Channel * 2) + DeviceNumber].GeneralConfiguration & 0x20 &&
@@ -816,6 +911,14 @@ Return Value:
         baseIoAddress1 = deviceExtension->BaseIoAddress1[j];
         baseIoAddress2 = deviceExtension->BaseIoAddress2[j];
 
+        //
+        // Stop any bus-master transfer before resetting the devices.
+        //
+
+        if (deviceExtension->BusMasterBase[j]) {
+            AtapiStopBusMaster(HwDeviceExtension, j);
+        }
+
         //
         // Do special processing for ATAPI and IDE disk devices.
         //
@@ -1277,6 +1380,448 @@ Return Value:
 } // end MapError()
 
 
+ULONG
+NTAPI
+AtapiFindBusMasterBase(
+    IN PVOID HwDeviceExtension,
+    IN ULONG SystemIoBusNumber,
+    IN ULONG IoBase
+    )
+
+/*++
+
+Routine Description:
+
+    Look for the PCI IDE controller decoding the compatibility mode
+    channel at IoBase and return the location of its bus-master registers.
+
+Arguments:
+
+    HwDeviceExtension - HBA miniport driver's adapter data storage
+    SystemIoBusNumber - PCI bus to scan
+    IoBase - Command block base of the channel (0x1F0 or 0x170)
+
+Return Value:
+
+    Bus-master register port for the channel, 0 if none.
+
+--*/
+
+{
+    PCI_SLOT_NUMBER   slotData;
+    PCI_COMMON_CONFIG pciData;
+    ULONG             deviceNumber;
+    ULONG             functionNumber;
+    ULONG             busDataRead;
+    ULONG             channel;
+    UCHAR             nativeModeBit;
+
+    if (IoBase == 0x1F0) {
+        channel = 0;
+        nativeModeBit = PCI_IDE_PROGIF_PRIMARY_NATIVE;
+    } else if (IoBase == 0x170) {
+        channel = 1;
+        nativeModeBit = PCI_IDE_PROGIF_SECONDARY_NATIVE;
+    } else {
+        return 0;
+    }
+
+    slotData.u.AsULONG = 0;
+
+    for (deviceNumber = 0; deviceNumber < PCI_MAX_DEVICES; deviceNumber++) {
+
+        for (functionNumber = 0; functionNumber < PCI_MAX_FUNCTION; functionNumber++) {
+
+            slotData.u.bits.DeviceNumber = deviceNumber;
+            slotData.u.bits.FunctionNumber = functionNumber;
+
+            busDataRead = ScsiPortGetBusData(HwDeviceExtension,
+                                             PCIConfiguration,
+                                             SystemIoBusNumber,
+                                             slotData.u.AsULONG,
+                                             &pciData,
+                                             PCI_COMMON_HDR_LENGTH);
+
+            if (busDataRead == 0) {
+
+                //
+                // No PCI bus.
+                //
+
+                return 0;
+            }
+
+            if (busDataRead < PCI_COMMON_HDR_LENGTH ||
+                pciData.VendorID == PCI_INVALID_VENDORID) {
+
+                if (functionNumber == 0) {
+                    break;
+                }
+                continue;
+            }
+
+            if (pciData.BaseClass == PCI_CLASS_MASS_STORAGE_CTLR &&
+                pciData.SubClass == PCI_SUBCLASS_MSC_IDE_CTLR &&
+                !(pciData.ProgIf & nativeModeBit) &&
+                (pciData.Command & PCI_ENABLE_IO_SPACE)) {
+
+                //
+                // This controller owns the legacy ports. Only use it if it
+                // is a bus master and the BIOS enabled it as one.
+                //
+
+                if (!(pciData.ProgIf & PCI_IDE_PROGIF_BUS_MASTER) ||
+                    !(pciData.Command & PCI_ENABLE_BUS_MASTER) ||
+                    !(pciData.u.type0.BaseAddresses[4] & PCI_ADDRESS_IO_SPACE)) {
+
+                    DebugPrint((1,
+                                "AtapiFindBusMasterBase: Controller %x:%x not bus-master capable\n",
+                                pciData.VendorID,
+                                pciData.DeviceID));
+                    return 0;
+                }
+
+                DebugPrint((1,
+                            "AtapiFindBusMasterBase: Bus-master IDE %x:%x at %x\n",
+                            pciData.VendorID,
+                            pciData.DeviceID,
+                            pciData.u.type0.BaseAddresses[4] & PCI_ADDRESS_IO_ADDRESS_MASK));
+
+                return (pciData.u.type0.BaseAddresses[4] & PCI_ADDRESS_IO_ADDRESS_MASK) +
+                       channel * BM_CHANNEL_REGISTER_SPAN;
+            }
+
+            if (functionNumber == 0 && !(pciData.HeaderType & PCI_MULTIFUNCTION)) {
+                break;
+            }
+        }
+    }
+
+    return 0;
+
+} // end AtapiFindBusMasterBase()
+
+
+BOOLEAN
+NTAPI
+AtapiInitializeBusMaster(
+    IN PVOID HwDeviceExtension,
+    IN OUT PPORT_CONFIGURATION_INFORMATION ConfigInfo,
+    IN ULONG Channel,
+    IN ULONG BusMasterPort
+    )
+
+/*++
+
+Routine Description:
+
+    Map the bus-master registers of a channel and, the first time through,
+    allocate the physical region descriptor table.
+
+Arguments:
+
+    HwDeviceExtension - HBA miniport driver's adapter data storage
+    ConfigInfo - Configuration information structure describing HBA
+    Channel - Channel the registers belong to
+    BusMasterPort - I/O port of the channel's bus-master registers
+
+Return Value:
+
+    TRUE if the channel can do DMA.
+
+--*/
+
+{
+    PHW_DEVICE_EXTENSION deviceExtension = HwDeviceExtension;
+    PUCHAR               ioSpace;
+    ULONG                length;
+
+    if (!BusMasterPort || deviceExtension->DriverMustPoll) {
+        return FALSE;
+    }
+
+    if (!deviceExtension->PrdTable) {
+
+        //
+        // The uncached extension can only be allocated for a bus master.
+        //
+
+        ConfigInfo->Master = TRUE;
+        ConfigInfo->ScatterGather = TRUE;
+        ConfigInfo->Dma32BitAddresses = TRUE;
+        ConfigInfo->NumberOfPhysicalBreaks = MAX_PRD_ENTRIES - 1;
+
+        deviceExtension->PrdTable = ScsiPortGetUncachedExtension(HwDeviceExtension,
+                                                                 ConfigInfo,
+                                                                 MAX_PRD_ENTRIES * sizeof(PHYSICAL_REGION_DESCRIPTOR));
+        if (!deviceExtension->PrdTable) {
+
+            DebugPrint((1,
+                        "AtapiInitializeBusMaster: Unable to allocate PRD table\n"));
+
+            ConfigInfo->Master = FALSE;
+            ConfigInfo->ScatterGather = FALSE;
+            return FALSE;
+        }
+
+        deviceExtension->PrdTablePhysical =
+            ScsiPortConvertPhysicalAddressToUlong(ScsiPortGetPhysicalAddress(HwDeviceExtension,
+                                                                             NULL,
+                                                                             deviceExtension->PrdTable,
+                                                                             &length));
+    }
+
+    ioSpace = ScsiPortGetDeviceBase(HwDeviceExtension,
+                                    ConfigInfo->AdapterInterfaceType,
+                                    ConfigInfo->SystemIoBusNumber,
+                                    ScsiPortConvertUlongToPhysicalAddress(BusMasterPort),
+                                    BM_CHANNEL_REGISTER_SPAN,
+                                    TRUE);
+    if (!ioSpace) {
+        return FALSE;
+    }
+
+    deviceExtension->BusMasterBase[Channel] = ioSpace;
+
+    return TRUE;
+
+} // end AtapiInitializeBusMaster()
+
+
+BOOLEAN
+NTAPI
+AtapiSetTransferMode(
+    IN PVOID HwDeviceExtension,
+    IN ULONG DeviceNumber
+    )
+
+/*++
+
+Routine Description:
+
+    Program the DMA transfer mode chosen from the identify data into
+    an ATA disk and enable DMA for it.
+
+    The controller timing registers are not touched; DMA is only used
+    when the BIOS marked the drive DMA capable in the bus-master status
+    register, i.e. when it has already set up the chipset for it.
+
+Arguments:
+
+    HwDeviceExtension - HBA miniport driver's adapter data storage
+    DeviceNumber - Indicates which device.
+
+Return Value:
+
+    TRUE if the device will use DMA.
+
+--*/
+
+{
+    PHW_DEVICE_EXTENSION deviceExtension = HwDeviceExtension;
+    PIDE_REGISTERS_1     baseIoAddress   = deviceExtension->BaseIoAddress1[DeviceNumber >> 1];
+    PUCHAR               busMasterBase   = deviceExtension->BusMasterBase[DeviceNumber >> 1];
+    UCHAR                statusByte, errorByte, bmStatus;
+
+    deviceExtension->DeviceFlags[DeviceNumber] &= ~DFLAGS_USE_DMA;
+
+    if (!busMasterBase ||
+        !deviceExtension->DmaTransferMode[DeviceNumber] ||
+        deviceExtension->ErrorCount >= MAX_ERRORS) {
+        return FALSE;
+    }
+
+    bmStatus = ScsiPortReadPortUchar(busMasterBase + BM_REGISTER_STATUS);
+
+    if (!(bmStatus & ((DeviceNumber & 0x1) ? BM_STATUS_DRIVE1_DMA_CAPABLE :
+                                              BM_STATUS_DRIVE0_DMA_CAPABLE))) {
+
+        DebugPrint((1,
+                    "AtapiSetTransferMode: Device %d not set up for DMA by the BIOS (%x)\n",
+                    DeviceNumber,
+                    bmStatus));
+        return FALSE;
+    }
+
+    //
+    // Select the device.
+    //
+
+    ScsiPortWritePortUchar(&baseIoAddress->DriveSelect,
+                           (UCHAR)(((DeviceNumber & 0x1) << 4) | 0xA0));
+
+    //
+    // Issue SET FEATURES - set transfer mode.
+    //
+
+    ScsiPortWritePortUchar((PUCHAR)baseIoAddress + 1, IDE_FEATURE_SET_TRANSFER_MODE);
+    ScsiPortWritePortUchar(&baseIoAddress->BlockCount,
+                           deviceExtension->DmaTransferMode[DeviceNumber]);
+    ScsiPortWritePortUchar(&baseIoAddress->Command,
+                           IDE_COMMAND_SET_FEATURES);
+
+    WaitOnBaseBusy(baseIoAddress,statusByte);
+
+    if (statusByte & (IDE_STATUS_ERROR | IDE_STATUS_BUSY)) {
+
+        errorByte = ScsiPortReadPortUchar((PUCHAR)baseIoAddress + 1);
+
+        DebugPrint((1,
+                    "AtapiSetTransferMode: Error setting mode %x. Status %x, error byte %x\n",
+                    deviceExtension->DmaTransferMode[DeviceNumber],
+                    statusByte,
+                    errorByte));
+        return FALSE;
+    }
+
+    DebugPrint((1,
+                "AtapiSetTransferMode: Device %d using DMA mode %x\n",
+                DeviceNumber,
+                deviceExtension->DmaTransferMode[DeviceNumber]));
+
+    deviceExtension->DeviceFlags[DeviceNumber] |= DFLAGS_USE_DMA;
+
+    return TRUE;
+
+} // end AtapiSetTransferMode()
+
+
+BOOLEAN
+NTAPI
+AtapiBuildPrdTable(
+    IN PVOID HwDeviceExtension,
+    IN PSCSI_REQUEST_BLOCK Srb
+    )
+
+/*++
+
+Routine Description:
+
+    Describe the data buffer of a request in the physical region
+    descriptor table, splitting regions at 64k boundaries.
+
+Arguments:
+
+    HwDeviceExtension - HBA miniport driver's adapter data storage
+    Srb - IO request packet
+
+Return Value:
+
+    FALSE if the buffer cannot be described, the request must then use PIO.
+
+--*/
+
+{
+    PHW_DEVICE_EXTENSION        deviceExtension = HwDeviceExtension;
+    PPHYSICAL_REGION_DESCRIPTOR prd = deviceExtension->PrdTable;
+    PUCHAR                      dataPointer = Srb->DataBuffer;
+    ULONG                       bytesLeft = Srb->DataTransferLength;
+    ULONG                       physicalAddress;
+    ULONG                       length;
+    ULONG                       entries = 0;
+
+    //
+    // Regions must be word aligned and a whole number of words.
+    //
+
+    if (!bytesLeft || (bytesLeft & 1)) {
+        return FALSE;
+    }
+
+    while (bytesLeft) {
+
+        physicalAddress = ScsiPortConvertPhysicalAddressToUlong(
+                              ScsiPortGetPhysicalAddress(HwDeviceExtension,
+                                                         Srb,
+                                                         dataPointer,
+                                                         &length));
+
+        if (physicalAddress == (ULONG)SP_UNINITIALIZED_VALUE ||
+            (physicalAddress & 1) ||
+            !length) {
+            return FALSE;
+        }
+
+        if (length > bytesLeft) {
+            length = bytesLeft;
+        }
+
+        //
+        // Don't cross a 64k boundary.
+        //
+
+        if (((physicalAddress & 0xFFFF) + length) > 0x10000) {
+            length = 0x10000 - (physicalAddress & 0xFFFF);
+        }
+
+        if (entries == MAX_PRD_ENTRIES) {
+            return FALSE;
+        }
+
+        prd[entries].PhysicalAddress = physicalAddress;
+        prd[entries].ByteCount = (USHORT)length;
+        prd[entries].Flags = 0;
+        entries++;
+
+        dataPointer += length;
+        bytesLeft -= length;
+    }
+
+    prd[entries - 1].Flags = PRD_FLAGS_END_OF_TABLE;
+
+    return TRUE;
+
+} // end AtapiBuildPrdTable()
+
+
+UCHAR
+NTAPI
+AtapiStopBusMaster(
+    IN PVOID HwDeviceExtension,
+    IN ULONG Channel
+    )
+
+/*++
+
+Routine Description:
+
+    Stop the bus-master engine of a channel and acknowledge its status.
+
+Arguments:
+
+    HwDeviceExtension - HBA miniport driver's adapter data storage
+    Channel - Channel to stop
+
+Return Value:
+
+    Bus-master status before it was cleared.
+
+--*/
+
+{
+    PHW_DEVICE_EXTENSION deviceExtension = HwDeviceExtension;
+    PUCHAR               busMasterBase   = deviceExtension->BusMasterBase[Channel];
+    UCHAR                bmStatus;
+
+    ScsiPortWritePortUchar(busMasterBase + BM_REGISTER_COMMAND, 0);
+
+    bmStatus = ScsiPortReadPortUchar(busMasterBase + BM_REGISTER_STATUS);
+
+    //
+    // Error and interrupt bits are cleared by writing ones, keep the
+    // drive capable bits.
+    //
+
+    ScsiPortWritePortUchar(busMasterBase + BM_REGISTER_STATUS,
+                           (UCHAR)(bmStatus | BM_STATUS_ERROR | BM_STATUS_INTERRUPT));
+
+    deviceExtension->DmaInProgress = FALSE;
+
+    return bmStatus;
+
+} // end AtapiStopBusMaster()
+
+
 BOOLEAN
 NTAPI
 AtapiHwInitialize(
@@ -1380,6 +1925,13 @@ Return Value:
                                     deviceExtension->MaximumBlockXfer[i]));
                     }
                 }
+
+                //
+                // If supported, switch the device to DMA.
+                //
+
+                AtapiSetTransferMode(HwDeviceExtension, i);
+
             } else if (!(deviceExtension->DeviceFlags[i] & DFLAGS_CHANGER_INITED)){
 
                 ULONG j;
@@ -2522,6 +3074,19 @@ retryIdentifier:
                         atapiOnly,
                         0)) {
 
+            //
+            // Use bus-master DMA if the channel belongs to a PCI IDE controller.
+            //
+
+            if (ConfigInfo->AdapterInterfaceType == Isa) {
+                AtapiInitializeBusMaster(HwDeviceExtension,
+                                         ConfigInfo,
+                                         0,
+                                         AtapiFindBusMasterBase(HwDeviceExtension,
+                                                                0,
+                                                                ScsiPortConvertPhysicalAddressToUlong((*ConfigInfo->AccessRanges)[0].RangeStart)));
+            }
+
             //
             // Claim primary or secondary ATA IO range.
             //
@@ -2934,6 +3499,21 @@ Return Value:
 
             deviceExtension->BaseIoAddress2[channel] = (PIDE_REGISTERS_2)(ioSpace);
 
+            //
+            // Map the bus-master registers of this channel.
+            //
+
+            if ((pciData.ProgIf & PCI_IDE_PROGIF_BUS_MASTER) &&
+                (pciData.Command & PCI_ENABLE_BUS_MASTER) &&
+                (pciData.u.type0.BaseAddresses[4] & PCI_ADDRESS_IO_SPACE)) {
+
+                AtapiInitializeBusMaster(HwDeviceExtension,
+                                         ConfigInfo,
+                                         channel,
+                                         (pciData.u.type0.BaseAddresses[4] & PCI_ADDRESS_IO_ADDRESS_MASK) +
+                                         channel * BM_CHANNEL_REGISTER_SPAN);
+            }
+
             deviceExtension->NumberChannels = 2;
 
             //
@@ -3509,7 +4089,7 @@ Return Value:
     ULONG wordCount = 0, wordsThisInterrupt = 256;
     ULONG status;
     ULONG i;
-    UCHAR statusByte,interruptReason;
+    UCHAR statusByte,interruptReason,bmStatus;
     BOOLEAN atapiDev = FALSE;
 
     if (srb) {
@@ -3556,6 +4136,71 @@ Return Value:
         return FALSE;
     }
 
+    if (deviceExtension->DmaInProgress) {
+
+        //
+        // Check that the bus-master engine raised the interrupt. If not,
+        // it belongs to another device sharing the line.
+        //
+
+        bmStatus = ScsiPortReadPortUchar(deviceExtension->BusMasterBase[srb->TargetId >> 1] + BM_REGISTER_STATUS);
+
+        if (!(bmStatus & BM_STATUS_INTERRUPT)) {
+            return FALSE;
+        }
+
+        AtapiStopBusMaster(HwDeviceExtension, srb->TargetId >> 1);
+
+        //
+        // Clear interrupt by reading status.
+        //
+
+        GetBaseStatus(baseIoAddress1, statusByte);
+
+        DebugPrint((3,
+                    "AtapiInterrupt: DMA complete. Status (%x), bus-master status (%x)\n",
+                    statusByte,
+                    bmStatus));
+
+        if ((bmStatus & BM_STATUS_ERROR) ||
+            (statusByte & (IDE_STATUS_ERROR | IDE_STATUS_BUSY | IDE_STATUS_DRQ))) {
+
+            //
+            // Don't use DMA on this device anymore, not even after a reset,
+            // and redo the request with PIO.
+            //
+
+            DebugPrint((1,
+                        "AtapiInterrupt: DMA failed on device %d. Status (%x), bus-master status (%x)\n",
+                        srb->TargetId,
+                        statusByte,
+                        bmStatus));
+
+            deviceExtension->DeviceFlags[srb->TargetId] &= ~DFLAGS_USE_DMA;
+            deviceExtension->DmaTransferMode[srb->TargetId] = 0;
+
+            if (statusByte & IDE_STATUS_BUSY) {
+                AtapiResetController(HwDeviceExtension,srb->PathId);
+                return TRUE;
+            }
+
+            status = IdeReadWrite(HwDeviceExtension, srb);
+            if (status == SRB_STATUS_PENDING) {
+                return TRUE;
+            }
+
+            goto CompleteRequest;
+        }
+
+        //
+        // The whole buffer was transferred.
+        //
+
+        deviceExtension->WordsLeft = 0;
+        status = SRB_STATUS_SUCCESS;
+        goto CompleteRequest;
+    }
+
     //
     // Clear interrupt by reading status.
     //
@@ -4522,10 +5167,12 @@ Return Value:
     PHW_DEVICE_EXTENSION deviceExtension = HwDeviceExtension;
     PIDE_REGISTERS_1     baseIoAddress1  = deviceExtension->BaseIoAddress1[Srb->TargetId >> 1];
     PIDE_REGISTERS_2     baseIoAddress2  = deviceExtension->BaseIoAddress2[Srb->TargetId >> 1];
+    PUCHAR               busMasterBase   = deviceExtension->BusMasterBase[Srb->TargetId >> 1];
     ULONG                startingSector,i;
     ULONG                wordCount;
-    UCHAR                statusByte,statusByte2;
+    UCHAR                statusByte,statusByte2,bmCommand;
     UCHAR                cylinderHigh,cylinderLow,drvSelect,sectorNumber;
+    BOOLEAN              useDma = FALSE;
 
     //
     // Select device 0 or 1.
@@ -4549,6 +5196,16 @@ Return Value:
     deviceExtension->DataBuffer = (PUSHORT)Srb->DataBuffer;
     deviceExtension->WordsLeft = Srb->DataTransferLength / 2;
 
+    //
+    // Use DMA if the device is set up for it and the buffer can be
+    // described to the bus-master engine.
+    //
+
+    if ((deviceExtension->DeviceFlags[Srb->TargetId] & DFLAGS_USE_DMA) &&
+        AtapiBuildPrdTable(HwDeviceExtension, Srb)) {
+        useDma = TRUE;
+    }
+
     //
     // Indicate expecting an interrupt.
     //
@@ -4618,6 +5275,43 @@ Return Value:
                startingSector %
                deviceExtension->IdentifyData[Srb->TargetId].SectorsPerTrack + 1));
 
+    if (useDma) {
+
+        //
+        // Program the bus-master engine: stop it, load the PRD table,
+        // clear the interrupt and error bits and set the direction.
+        //
+
+        bmCommand = (Srb->SrbFlags & SRB_FLAGS_DATA_IN) ? BM_COMMAND_READ : 0;
+
+        ScsiPortWritePortUchar(busMasterBase + BM_REGISTER_COMMAND, 0);
+        ScsiPortWritePortUlong((PULONG)(busMasterBase + BM_REGISTER_PRD_TABLE),
+                               deviceExtension->PrdTablePhysical);
+        ScsiPortWritePortUchar(busMasterBase + BM_REGISTER_STATUS,
+                               (UCHAR)(ScsiPortReadPortUchar(busMasterBase + BM_REGISTER_STATUS) |
+                                       BM_STATUS_ERROR | BM_STATUS_INTERRUPT));
+        ScsiPortWritePortUchar(busMasterBase + BM_REGISTER_COMMAND, bmCommand);
+
+        //
+        // Send the command and start the transfer.
+        //
+
+        ScsiPortWritePortUchar(&baseIoAddress1->Command,
+                               (UCHAR)((Srb->SrbFlags & SRB_FLAGS_DATA_IN) ? IDE_COMMAND_READ_DMA :
+                                                                            IDE_COMMAND_WRITE_DMA));
+
+        deviceExtension->DmaInProgress = TRUE;
+
+        ScsiPortWritePortUchar(busMasterBase + BM_REGISTER_COMMAND,
+                               (UCHAR)(bmCommand | BM_COMMAND_START));
+
+        //
+        // Wait for interrupt.
+        //
+
+        return SRB_STATUS_PENDING;
+    }
+
     //
     // Check if write request.
     //
@@ -6235,10 +6929,12 @@ Return Value:
     hwInitializationData.SpecificLuExtensionSize = sizeof(HW_LU_EXTENSION);
 
     //
-    // Indicate PIO device.
+    // Indicate PIO device. Physical addresses are needed for the
+    // controllers that can do bus-master DMA.
     //
 
     hwInitializationData.MapBuffers = TRUE;
+    hwInitializationData.NeedPhysicalAddresses = TRUE;
 
     //
     // Native Mode Devices
@@ -48,6 +48,7 @@ typedef struct _IDE_REGISTERS_3 {
 #define DFLAGS_ATAPI_CHANGER         0x0040    // Indicates atapi 2.5 changer present.
 #define DFLAGS_SANYO_ATAPI_CHANGER   0x0080    // Indicates multi-platter device, not conforming to the 2.5 spec.
 #define DFLAGS_CHANGER_INITED        0x0100    // Indicates that the init path for changers has already been done.
+#define DFLAGS_USE_DMA               0x0200    // Indicates that read/write requests use bus-master DMA.
 //
 // Used to disable 'advanced' features.
 //
@@ -115,6 +116,7 @@ typedef struct _MODE_PARAMETER_HEADER_10 {
 #define IDE_COMMAND_WRITE_DMA             0xCA
 #define IDE_COMMAND_GET_MEDIA_STATUS      0xDA
 #define IDE_COMMAND_ENABLE_MEDIA_STATUS   0xEF
+#define IDE_COMMAND_SET_FEATURES          0xEF
 #define IDE_COMMAND_IDENTIFY              0xEC
 #define IDE_COMMAND_MEDIA_EJECT           0xED
 
@@ -214,7 +216,9 @@ typedef struct _IDENTIFY_DATA {
     UCHAR  VendorUnique4;                   // 68  52
     UCHAR  DmaCycleTimingMode;              // 69
     USHORT TranslationFieldsValid:1;        // 6A  53
-    USHORT Reserved3:15;
+    USHORT Reserved3:1;
+    USHORT UltraDMAFieldsValid:1;
+    USHORT Reserved3a:13;
     USHORT NumberOfCurrentCylinders;        // 6C  54
     USHORT NumberOfCurrentHeads;            // 6E  55
     USHORT CurrentSectorsPerTrack;          // 70  56
@@ -236,7 +240,10 @@ typedef struct _IDENTIFY_DATA {
     USHORT ReleaseTimeServiceCommand;       //     72
     USHORT MajorRevision;                   //     73
     USHORT MinorRevision;                   //     74
-    USHORT Reserved6[50];                   //     75-126
+    USHORT Reserved6[13];                   //     75-87
+    USHORT UltraDMASupport : 8;             //     88
+    USHORT UltraDMAActive : 8;
+    USHORT Reserved6a[38];                  //     89-126
     USHORT SpecialFunctionsEnabled;         //     127
     USHORT Reserved7[128];                  //     128-255
 } IDENTIFY_DATA, *PIDENTIFY_DATA;
@@ -294,6 +301,67 @@ typedef struct _IDENTIFY_DATA2 {
 #define IDENTIFY_DMA_CYCLES_MODE_1 0x01
 #define IDENTIFY_DMA_CYCLES_MODE_2 0x02
 
+//
+// SET FEATURES sub-command and transfer mode values.
+//
+
+#define IDE_FEATURE_SET_TRANSFER_MODE   0x03
+#define IDE_TRANSFER_MODE_MWDMA         0x20
+#define IDE_TRANSFER_MODE_UDMA          0x40
+
+//
+// Highest Ultra DMA mode negotiated when the BIOS has not already
+// selected a faster one. Modes above 2 need an 80-conductor cable,
+// which cannot be detected without chipset specific code.
+//
+
+#define IDE_MAX_DEFAULT_UDMA_MODE       2
+
+//
+// PCI IDE bus-master register definitions (SFF-8038i).
+//
+
+#define BM_REGISTER_COMMAND             0
+#define BM_REGISTER_STATUS              2
+#define BM_REGISTER_PRD_TABLE           4
+#define BM_CHANNEL_REGISTER_SPAN        8
+
+#define BM_COMMAND_START                0x01
+#define BM_COMMAND_READ                 0x08
+
+#define BM_STATUS_ACTIVE                0x01
+#define BM_STATUS_ERROR                 0x02
+#define BM_STATUS_INTERRUPT             0x04
+#define BM_STATUS_DRIVE0_DMA_CAPABLE    0x20
+#define BM_STATUS_DRIVE1_DMA_CAPABLE    0x40
+
+//
+// PCI programming interface bits of a mass storage IDE controller.
+//
+
+#define PCI_IDE_PROGIF_PRIMARY_NATIVE   0x01
+#define PCI_IDE_PROGIF_SECONDARY_NATIVE 0x04
+#define PCI_IDE_PROGIF_BUS_MASTER       0x80
+
+//
+// Physical region descriptor. A region may not cross a 64k boundary,
+// and a byte count of zero means 64k.
+//
+
+typedef struct _PHYSICAL_REGION_DESCRIPTOR {
+    ULONG  PhysicalAddress;
+    USHORT ByteCount;
+    USHORT Flags;
+} PHYSICAL_REGION_DESCRIPTOR, *PPHYSICAL_REGION_DESCRIPTOR;
+
+#define PRD_FLAGS_END_OF_TABLE          0x8000
+
+//
+// Enough descriptors for a 64k transfer from an unaligned buffer.
+//
+
+#define MAX_PRD_ENTRIES                 ((0x10000 / PAGE_SIZE) + 1)
+
 
 typedef struct _BROKEN_CONTROLLER_INFORMATION {
     PCHAR   VendorId;
@@ -169,7 +169,9 @@ AhciAllocateResourceForAdapter (
     AdapterExtension->PortCount = portCount;
     nonCachedExtensionSize =    sizeof(AHCI_COMMAND_HEADER) * AlignedNCS + //should be 1K aligned
                                 sizeof(AHCI_RECEIVED_FIS) +
-                                sizeof(IDENTIFY_DEVICE_DATA);
+                                sizeof(IDENTIFY_DEVICE_DATA) +
+                                sizeof(AHCI_COMMAND_TABLE) + // should be 128 byte aligned
+                                DEVICE_ATA_BLOCK_SIZE;
 
     // align nonCachedExtensionSize to 1024
     nonCachedExtensionSize = ROUND_UP(nonCachedExtensionSize, 1024);
@@ -203,6 +205,10 @@ AhciAllocateResourceForAdapter (
 
             PortExtension->ReceivedFIS = (PAHCI_RECEIVED_FIS)tmp;
             PortExtension->IdentifyDeviceData = (PIDENTIFY_DEVICE_DATA)(tmp + sizeof(AHCI_RECEIVED_FIS));
+
+            tmp = (PCHAR)(PortExtension->IdentifyDeviceData + 1);
+            PortExtension->InternalCommandTable = (PAHCI_COMMAND_TABLE)tmp;
+            PortExtension->NcqErrorLog = (PUCHAR)(tmp + sizeof(AHCI_COMMAND_TABLE));
             PortExtension->MaxPortQueueDepth = NCS;
             nonCachedExtension += nonCachedExtensionSize;
         }
@@ -488,6 +494,7 @@ AhciHwPassiveInitialize (
             PortExtension = &AdapterExtension->PortExtension[index];
             PortExtension->DeviceParams.IsActive = AhciStartPort(PortExtension);
             StorPortInitializeDpc(AdapterExtension, &PortExtension->CommandCompletion, AhciCommandCompletionDpcRoutine);
+            StorPortInitializeDpc(AdapterExtension, &PortExtension->ErrorRecovery, AhciRecoverFromError);
         }
     }
 
@@ -574,18 +581,27 @@ AhciCompleteIssuedSrb (
                 continue;
             }
 
+            // release the command slot
+            PortExtension->Slot[i] = NULL;
+            PortExtension->NcqSlots &= ~(1 << i);
+
             SrbExtension = GetSrbExtension(Srb);
             NT_ASSERT(SrbExtension != NULL);
 
-            if (SrbExtension->CompletionRoutine != NULL)
+            // Srbs failed by error recovery skip their completion routine
+            if ((SrbExtension->CompletionRoutine != NULL) &&
+                (Srb->SrbStatus == SRB_STATUS_PENDING))
             {
                 AddQueue(&PortExtension->CompletionQueue, Srb);
                 StorPortIssueDpc(AdapterExtension, &PortExtension->CommandCompletion, PortExtension, Srb);
             }
             else
             {
-                NT_ASSERT(Srb->SrbStatus == SRB_STATUS_PENDING);
-                Srb->SrbStatus = SRB_STATUS_SUCCESS;
+                // error recovery may already have set a failure status
+                if (Srb->SrbStatus == SRB_STATUS_PENDING)
+                {
+                    Srb->SrbStatus = SRB_STATUS_SUCCESS;
+                }
                 StorPortNotification(RequestComplete, AdapterExtension, Srb);
             }
         }
@@ -594,6 +610,425 @@ AhciCompleteIssuedSrb (
     return;
 }// -- AhciCompleteIssuedSrb();
 
+/**
+ * @name AhciClearPortErrors
+ * @implemented
+ *
+ * Clear PxSERR and PxIS, so that the error doesn't raise the interrupt again
+ *
+ * @param PortExtension
+ *
+ */
+VOID
+AhciClearPortErrors (
+    __in PAHCI_PORT_EXTENSION PortExtension
+    )
+{
+    PAHCI_ADAPTER_EXTENSION AdapterExtension;
+
+    AdapterExtension = PortExtension->AdapterExtension;
+
+    StorPortWriteRegisterUlong(AdapterExtension, &PortExtension->Port->SERR, (ULONG)~0);
+    StorPortWriteRegisterUlong(AdapterExtension, &PortExtension->Port->IS, (ULONG)~0);
+}// -- AhciClearPortErrors();
+
+/**
+ * @name AhciRestartPort
+ * @implemented
+ *
+ * Restart the port command engine after a fatal error, section 6.2.2.1
+ * Every command issued to the port is discarded by the HBA.
+ * Polls for up to a second, must not be called from the interrupt handler.
+ *
+ * @param PortExtension
+ *
+ * @return
+ * return TRUE if the port is running again
+ */
+BOOLEAN
+AhciRestartPort (
+    __in PAHCI_PORT_EXTENSION PortExtension
+    )
+{
+    ULONG ticks;
+    AHCI_PORT_CMD cmd;
+    AHCI_TASK_FILE_DATA tfd;
+    PAHCI_ADAPTER_EXTENSION AdapterExtension;
+
+    AhciDebugPrint("AhciRestartPort()\n");
+
+    AdapterExtension = PortExtension->AdapterExtension;
+
+    // 1. clear PxCMD.ST and wait for PxCMD.CR to clear (up to 500 ms)
+    cmd.Status = StorPortReadRegisterUlong(AdapterExtension, &PortExtension->Port->CMD);
+    cmd.ST = 0;
+    StorPortWriteRegisterUlong(AdapterExtension, &PortExtension->Port->CMD, cmd.Status);
+
+    ticks = 500;
+    do
+    {
+        StorPortStallExecution(1000);
+        cmd.Status = StorPortReadRegisterUlong(AdapterExtension, &PortExtension->Port->CMD);
+    }
+    while ((cmd.CR != 0) && (--ticks != 0));
+
+    // 2. clear PxSERR and the error bits of PxIS
+    AhciClearPortErrors(PortExtension);
+
+    if (cmd.CR != 0)
+    {
+        AhciDebugPrint("\tPort command engine did not stop\n");
+        return FALSE;
+    }
+
+    // 3. if the device is still busy, use command list override to clear BSY and DRQ
+    tfd.Status = StorPortReadRegisterUlong(AdapterExtension, &PortExtension->Port->TFD);
+    if ((tfd.STS.BSY) || (tfd.STS.DRQ))
+    {
+        if ((AdapterExtension->CAP & AHCI_Global_HBA_CAP_SCLO) == 0)
+        {
+            AhciDebugPrint("\tDevice busy and CLO not supported\n");
+            return FALSE;
+        }
+
+        cmd.CLO = 1;
+        StorPortWriteRegisterUlong(AdapterExtension, &PortExtension->Port->CMD, cmd.Status);
+
+        ticks = 500;
+        do
+        {
+            StorPortStallExecution(1000);
+            cmd.Status = StorPortReadRegisterUlong(AdapterExtension, &PortExtension->Port->CMD);
+        }
+        while ((cmd.CLO != 0) && (--ticks != 0));
+
+        if (cmd.CLO != 0)
+        {
+            AhciDebugPrint("\tCommand list override did not complete\n");
+            return FALSE;
+        }
+    }
+
+    // 4. restart the command engine
+    cmd.ST = 1;
+    StorPortWriteRegisterUlong(AdapterExtension, &PortExtension->Port->CMD, cmd.Status);
+
+    return TRUE;
+}// -- AhciRestartPort();
+
+/**
+ * @name AhciComResetPort
+ * @implemented
+ *
+ * Reset the port with a COMRESET when restarting the command engine failed, section 10.4.2
+ * The device loses every command it has received.
+ * Polls for up to a second and a half, must not be called from the interrupt handler.
+ *
+ * @param PortExtension
+ *
+ * @return
+ * return TRUE if the device is back and the port is running again
+ */
+BOOLEAN
+AhciComResetPort (
+    __in PAHCI_PORT_EXTENSION PortExtension
+    )
+{
+    ULONG ticks;
+    AHCI_PORT_CMD cmd;
+    AHCI_TASK_FILE_DATA tfd;
+    AHCI_SERIAL_ATA_STATUS ssts;
+    AHCI_SERIAL_ATA_CONTROL sctl;
+    PAHCI_ADAPTER_EXTENSION AdapterExtension;
+
+    AhciDebugPrint("AhciComResetPort()\n");
+
+    AdapterExtension = PortExtension->AdapterExtension;
+
+    // PxCMD.ST was cleared by AhciRestartPort, it must stay clear during COMRESET
+    sctl.Status = StorPortReadRegisterUlong(AdapterExtension, &PortExtension->Port->SCTL);
+    sctl.DET = 1;
+    StorPortWriteRegisterUlong(AdapterExtension, &PortExtension->Port->SCTL, sctl.Status);
+
+    // at least 1 ms for one COMRESET signal to be sent
+    StorPortStallExecution(1000);
+
+    sctl.DET = 0;
+    StorPortWriteRegisterUlong(AdapterExtension, &PortExtension->Port->SCTL, sctl.Status);
+
+    // wait for communication to be re-established (up to 500 ms)
+    ticks = 500;
+    do
+    {
+        StorPortStallExecution(1000);
+        ssts.Status = StorPortReadRegisterUlong(AdapterExtension, &PortExtension->Port->SSTS);
+    }
+    while ((ssts.DET != 0x3) && (--ticks != 0));
+
+    // bits set as part of the port reset
+    AhciClearPortErrors(PortExtension);
+
+    if (ssts.DET != 0x3)
+    {
+        AhciDebugPrint("\tNo device after COMRESET: %x\n", ssts.Status);
+        return FALSE;
+    }
+
+    // the device reports its signature and clears BSY when it is ready (up to 1 s)
+    ticks = 1000;
+    do
+    {
+        StorPortStallExecution(1000);
+        tfd.Status = StorPortReadRegisterUlong(AdapterExtension, &PortExtension->Port->TFD);
+    }
+    while (((tfd.STS.BSY) || (tfd.STS.DRQ)) && (--ticks != 0));
+
+    cmd.Status = StorPortReadRegisterUlong(AdapterExtension, &PortExtension->Port->CMD);
+    if ((tfd.STS.BSY) || (tfd.STS.DRQ) || (cmd.CR != 0))
+    {
+        AhciDebugPrint("\tPort not ready after COMRESET: %x %x\n", tfd.Status, cmd.Status);
+        return FALSE;
+    }
+
+    AhciClearPortErrors(PortExtension);
+
+    cmd.ST = 1;
+    StorPortWriteRegisterUlong(AdapterExtension, &PortExtension->Port->CMD, cmd.Status);
+
+    return TRUE;
+}// -- AhciComResetPort();
+
+/**
+ * @name AhciReadNcqErrorLog
+ * @implemented
+ *
+ * Issue READ LOG EXT for the NCQ command error log (page 10h) by polling.
+ * After a failed native queued command the device refuses any other command
+ * until this log has been read, section 6.2.2.2
+ *
+ * @param PortExtension
+ * @param SlotIndex
+ * Free command slot used for the internal command
+ * @param FailedSlot
+ * Receives the tag of the failed command, or -1 if unknown
+ *
+ * @return
+ * return FALSE if READ LOG EXT failed and the port has to be restarted again
+ */
+BOOLEAN
+AhciReadNcqErrorLog (
+    __in PAHCI_PORT_EXTENSION PortExtension,
+    __in ULONG SlotIndex,
+    __out PLONG FailedSlot
+    )
+{
+    ULONG length, ticks, ci;
+    AHCI_TASK_FILE_DATA tfd;
+    PAHCI_COMMAND_TABLE cmdTable;
+    PAHCI_COMMAND_HEADER CommandHeader;
+    PAHCI_ADAPTER_EXTENSION AdapterExtension;
+    STOR_PHYSICAL_ADDRESS TablePhysicalAddress, LogPhysicalAddress;
+
+    AhciDebugPrint("AhciReadNcqErrorLog()\n");
+
+    *FailedSlot = -1;
+
+    AdapterExtension = PortExtension->AdapterExtension;
+    cmdTable = PortExtension->InternalCommandTable;
+
+    TablePhysicalAddress = StorPortGetPhysicalAddress(AdapterExtension, NULL, cmdTable, &length);
+    LogPhysicalAddress = StorPortGetPhysicalAddress(AdapterExtension, NULL, PortExtension->NcqErrorLog, &length);
+
+    NT_ASSERT((TablePhysicalAddress.LowPart % 128) == 0);
+
+    AhciZeroMemory((PCHAR)cmdTable->CFIS, sizeof(cmdTable->CFIS));
+    cmdTable->CFIS[AHCI_ATA_CFIS_FisType] = FIS_TYPE_REG_H2D;
+    cmdTable->CFIS[AHCI_ATA_CFIS_PMPort_C] = (1 << 7);
+    cmdTable->CFIS[AHCI_ATA_CFIS_CommandReg] = IDE_COMMAND_READ_LOG_EXT;
+    cmdTable->CFIS[AHCI_ATA_CFIS_LBA0] = ATA_LOG_NCQ_COMMAND_ERROR;
+    cmdTable->CFIS[AHCI_ATA_CFIS_SectorCountLow] = 1;
+
+    cmdTable->PRDT[0].DBA = LogPhysicalAddress.LowPart;
+    cmdTable->PRDT[0].DBAU = IsAdapterCAPS64(AdapterExtension->CAP) ? LogPhysicalAddress.HighPart : 0;
+    cmdTable->PRDT[0].RSV0 = 0;
+    cmdTable->PRDT[0].DBC = DEVICE_ATA_BLOCK_SIZE - 1;
+    cmdTable->PRDT[0].I = 0;
+
+    CommandHeader = &PortExtension->CommandList[SlotIndex];
+    CommandHeader->DI.Status = 0;
+    CommandHeader->DI.CFL = 5;
+    CommandHeader->DI.PRDTL = 1;
+    CommandHeader->PRDBC = 0;
+    CommandHeader->CTBA = TablePhysicalAddress.LowPart;
+    CommandHeader->CTBA_U = IsAdapterCAPS64(AdapterExtension->CAP) ? TablePhysicalAddress.HighPart : 0;
+
+    StorPortWriteRegisterUlong(AdapterExtension, &PortExtension->Port->CI, (1 << SlotIndex));
+
+    ticks = 100;
+    do
+    {
+        StorPortStallExecution(1000);
+        ci = StorPortReadRegisterUlong(AdapterExtension, &PortExtension->Port->CI);
+    }
+    while (((ci & (1 << SlotIndex)) != 0) && (--ticks != 0));
+
+    // the polled command must not be seen as a normal completion
+    StorPortWriteRegisterUlong(AdapterExtension, &PortExtension->Port->IS, (ULONG)~0);
+
+    tfd.Status = StorPortReadRegisterUlong(AdapterExtension, &PortExtension->Port->TFD);
+    if (((ci & (1 << SlotIndex)) != 0) || tfd.STS.ERR)
+    {
+        AhciDebugPrint("\tREAD LOG EXT failed: %x\n", tfd.Status);
+        return FALSE;
+    }
+
+    // NQ set means the error was for a non-queued command
+    if ((PortExtension->NcqErrorLog[0] & ATA_LOG_NCQ_ERROR_NQ) == 0)
+    {
+        *FailedSlot = PortExtension->NcqErrorLog[0] & ATA_LOG_NCQ_ERROR_TAG_MASK;
+    }
+
+    return TRUE;
+}// -- AhciReadNcqErrorLog();
+
+/**
+ * @name AhciRecoverFromError
+ * @implemented
+ *
+ * Fatal error recovery, section 6.2.2
+ * The failed command is completed with an error, every other command
+ * issued to the device is returned as busy so that it gets retried.
+ * If neither restarting the port nor COMRESET brings it back, the
+ * device is treated as gone.
+ *
+ * Runs as a DPC queued by the interrupt handler, which has masked the port
+ * interrupts. The hardware is polled without the InterruptLock,
+ * ErrorRecoveryPending keeps AhciProcessIO from touching the command slots meanwhile.
+ *
+ * @param Dpc
+ * @param AdapterExtension
+ * @param PortExtension
+ * @param SystemArgument2
+ */
+VOID
+AhciRecoverFromError (
+    __in PSTOR_DPC Dpc,
+    __in PAHCI_ADAPTER_EXTENSION AdapterExtension,
+    __in PAHCI_PORT_EXTENSION PortExtension,
+    __in PVOID SystemArgument2
+    )
+{
+    AHCI_PORT_CMD cmd;
+    PSCSI_REQUEST_BLOCK Srb;
+    LONG failedSlot;
+    BOOLEAN recovered;
+    STOR_LOCK_HANDLE lockhandle = {0};
+    ULONG i, NCS, issuedSlots, freeSlots, ncqSlots;
+
+    UNREFERENCED_PARAMETER(Dpc);
+    UNREFERENCED_PARAMETER(SystemArgument2);
+
+    AhciDebugPrint("AhciRecoverFromError()\n");
+
+    NCS = AHCI_Global_Port_CAP_NCS(AdapterExtension->CAP);
+
+    StorPortAcquireSpinLock(AdapterExtension, InterruptLock, NULL, &lockhandle);
+    issuedSlots = PortExtension->CommandIssuedSlots;
+    ncqSlots = PortExtension->NcqSlots;
+    // use a slot which doesn't hold an assigned but not yet issued Srb
+    freeSlots = AHCI_SLOT_MASK(NCS) & ~PortExtension->QueueSlots;
+    StorPortReleaseSpinLock(AdapterExtension, &lockhandle);
+
+    // for non-queued commands PxCMD.CCS holds the slot which caused the error
+    cmd.Status = StorPortReadRegisterUlong(AdapterExtension, &PortExtension->Port->CMD);
+    failedSlot = cmd.CCS;
+
+    recovered = AhciRestartPort(PortExtension);
+    if (recovered && ((issuedSlots & ncqSlots) != 0))
+    {
+        NT_ASSERT(freeSlots != 0);
+
+        for (i = 0; i < NCS; i++)
+        {
+            if ((freeSlots & (1 << i)) != 0)
+                break;
+        }
+
+        if (!AhciReadNcqErrorLog(PortExtension, i, &failedSlot))
+        {
+            recovered = AhciRestartPort(PortExtension);
+        }
+    }
+
+    if (!recovered)
+    {
+        // the device lost every command, none of them is known to have failed
+        failedSlot = -1;
+        recovered = AhciComResetPort(PortExtension);
+    }
+
+    StorPortAcquireSpinLock(AdapterExtension, InterruptLock, NULL, &lockhandle);
+
+    for (i = 0; i < NCS; i++)
+    {
+        if ((issuedSlots & (1 << i)) == 0)
+            continue;
+
+        Srb = PortExtension->Slot[i];
+        if (Srb == NULL)
+            continue;
+
+        if (!recovered)
+            Srb->SrbStatus = SRB_STATUS_NO_DEVICE;
+        else
+            Srb->SrbStatus = (i == (ULONG)failedSlot) ? SRB_STATUS_ERROR : SRB_STATUS_BUSY;
+    }
+
+    PortExtension->CommandIssuedSlots = 0;
+    if (issuedSlots != 0)
+    {
+        AhciCompleteIssuedSrb(PortExtension, issuedSlots);
+    }
+
+    if (!recovered)
+    {
+        AhciDebugPrint("\tPort %d lost\n", PortExtension->PortNumber);
+        PortExtension->DeviceParams.IsActive = FALSE;
+
+        // fail what was assigned a slot or waiting for one
+        for (i = 0; i < NCS; i++)
+        {
+            Srb = PortExtension->Slot[i];
+            if (Srb == NULL)
+                continue;
+
+            PortExtension->Slot[i] = NULL;
+            Srb->SrbStatus = SRB_STATUS_NO_DEVICE;
+            StorPortNotification(RequestComplete, AdapterExtension, Srb);
+        }
+        PortExtension->QueueSlots = 0;
+        PortExtension->NcqSlots = 0;
+
+        while ((Srb = RemoveQueue(&PortExtension->SrbQueue)) != NULL)
+        {
+            Srb->SrbStatus = SRB_STATUS_NO_DEVICE;
+            StorPortNotification(RequestComplete, AdapterExtension, Srb);
+        }
+    }
+
+    // unmask the port and continue with the Srbs which were waiting for a slot
+    PortExtension->ErrorRecoveryPending = FALSE;
+    StorPortWriteRegisterUlong(AdapterExtension, &PortExtension->Port->IE, PortExtension->InterruptEnable);
+
+    if (recovered)
+    {
+        AhciFillCommandSlots(PortExtension);
+        AhciActivatePort(PortExtension);
+    }
+
+    StorPortReleaseSpinLock(AdapterExtension, &lockhandle);
+}// -- AhciRecoverFromError();
+
 /**
  * @name AhciInterruptHandler
  * @not_implemented
@@ -649,6 +1084,23 @@ AhciInterruptHandler (
         // non-queued commands were being issued or native command queuing commands were being issued.
 
         AhciDebugPrint("\tFatal Error: %x\n", PxIS.Status);
+
+        // Recovery polls the port for up to seconds, so it runs in a DPC.
+        // Here only mask the port interrupts and acknowledge this one.
+        if (!PortExtension->ErrorRecoveryPending)
+        {
+            PortExtension->InterruptEnable = StorPortReadRegisterUlong(AdapterExtension, &PortExtension->Port->IE);
+        }
+        StorPortWriteRegisterUlong(AdapterExtension, &PortExtension->Port->IE, 0);
+        StorPortWriteRegisterUlong(AdapterExtension, &PortExtension->Port->IS, PxIS.Status);
+        StorPortWriteRegisterUlong(AdapterExtension, AdapterExtension->IS, (1 << PortExtension->PortNumber));
+
+        if (!PortExtension->ErrorRecoveryPending)
+        {
+            PortExtension->ErrorRecoveryPending = TRUE;
+            StorPortIssueDpc(AdapterExtension, &PortExtension->ErrorRecovery, PortExtension, NULL);
+        }
+        return;
     }
 
     // Normal Command Completion
@@ -683,6 +1135,10 @@ AhciInterruptHandler (
     {
         AhciCompleteIssuedSrb(PortExtension, (PortExtension->CommandIssuedSlots & (~outstanding)));
         PortExtension->CommandIssuedSlots &= outstanding;
+
+        // completed commands freed slots, issue what was waiting for them
+        AhciFillCommandSlots(PortExtension);
+        AhciActivatePort(PortExtension);
     }
 
     return;
@@ -1376,6 +1832,12 @@ AhciProcessSrb (
     NT_ASSERT(SlotIndex < AHCI_Global_Port_CAP_NCS(AdapterExtension->CAP));
     SrbExtension->SlotIndex = SlotIndex;
 
+    // FPDMA QUEUED commands carry their tag (= slot) in Count[7:3]
+    if (IsNcqCommand(SrbExtension))
+    {
+        SrbExtension->SectorCountLow = (UCHAR)(SlotIndex << 3);
+    }
+
     // program the CFIS in the CommandTable
     CommandHeader = &PortExtension->CommandList[SlotIndex];
 
@@ -1441,6 +1903,11 @@ AhciProcessSrb (
     // mark this slot
     PortExtension->Slot[SlotIndex] = Srb;
     PortExtension->QueueSlots |= 1 << SlotIndex;
+
+    if (IsNcqCommand(SrbExtension))
+    {
+        PortExtension->NcqSlots |= 1 << SlotIndex;
+    }
     return;
 }// -- AhciProcessSrb();
 
@@ -1465,6 +1932,12 @@ AhciActivatePort (
     AhciDebugPrint("AhciActivatePort()\n");
 
     AdapterExtension = PortExtension->AdapterExtension;
+
+    if (PortExtension->ErrorRecoveryPending)
+    {
+        // nothing may be issued until the port has been restarted
+        return;
+    }
     QueueSlots = PortExtension->QueueSlots;
 
     if (QueueSlots == 0)
@@ -1481,13 +1954,37 @@ AhciActivatePort (
         return;
     }
 
-    // get the lowest set bit
-    tmp = QueueSlots & (QueueSlots - 1);
+    // Native queued and non-queued commands must not be outstanding at the
+    // same time (section 5.3.1 & SATA 13.6.1). A pending non-queued command
+    // waits for the queue to drain and blocks new queued ones meanwhile.
+    if ((QueueSlots & ~PortExtension->NcqSlots) != 0)
+    {
+        if (PortExtension->CommandIssuedSlots != 0)
+        {
+            return;
+        }
+
+        QueueSlots &= ~PortExtension->NcqSlots;
 
-    if (tmp == 0)
-        slotToActivate = QueueSlots;
+        // get the lowest set bit
+        tmp = QueueSlots & (QueueSlots - 1);
+
+        if (tmp == 0)
+            slotToActivate = QueueSlots;
+        else
+            slotToActivate = (QueueSlots & (~tmp));
+    }
     else
-        slotToActivate = (QueueSlots & (~tmp));
+    {
+        if ((PortExtension->CommandIssuedSlots & ~PortExtension->NcqSlots) != 0)
+        {
+            return;
+        }
+
+        // issue every queued command at once, PxSACT must be set before PxCI
+        slotToActivate = QueueSlots;
+        StorPortWriteRegisterUlong(AdapterExtension, &PortExtension->Port->SACT, slotToActivate);
+    }
 
     // mark that bit off in QueueSlots
     // so we can know we it is really needed to activate port or not
@@ -1502,6 +1999,58 @@ AhciActivatePort (
     return;
 }// -- AhciActivatePort();
 
+/**
+ * @name AhciFillCommandSlots
+ * @implemented
+ *
+ * Assign pending Srbs from the port queue to every free command slot.
+ * Caller must hold the InterruptLock (or run in the interrupt handler).
+ *
+ * @param PortExtension
+ *
+ */
+VOID
+AhciFillCommandSlots (
+    __in PAHCI_PORT_EXTENSION PortExtension
+    )
+{
+    PSCSI_REQUEST_BLOCK tmpSrb;
+    PAHCI_ADAPTER_EXTENSION AdapterExtension;
+    ULONG commandSlotMask, occupiedSlots, slotIndex, NCS;
+
+    AhciDebugPrint("AhciFillCommandSlots()\n");
+
+    AdapterExtension = PortExtension->AdapterExtension;
+
+    occupiedSlots = (PortExtension->QueueSlots | PortExtension->CommandIssuedSlots); // Busy command slots for given port
+    NCS = AHCI_Global_Port_CAP_NCS(AdapterExtension->CAP);
+    commandSlotMask = AHCI_SLOT_MASK(NCS); // available slots mask
+
+    commandSlotMask = (commandSlotMask & ~occupiedSlots);
+
+    // iterate over HBA port slots
+    for (slotIndex = 0; (slotIndex < NCS) && (commandSlotMask != 0); slotIndex++)
+    {
+        // find next free slot
+        if ((commandSlotMask & (1 << slotIndex)) == 0)
+        {
+            continue;
+        }
+
+        tmpSrb = RemoveQueue(&PortExtension->SrbQueue);
+        if (tmpSrb == NULL)
+        {
+            break;
+        }
+
+        NT_ASSERT(tmpSrb->PathId == PortExtension->PortNumber);
+        AhciProcessSrb(PortExtension, tmpSrb, slotIndex);
+        commandSlotMask &= ~(1 << slotIndex);
+    }
+
+    return;
+}// -- AhciFillCommandSlots();
+
 /**
  * @name AhciProcessIO
  * @implemented
@@ -1521,10 +2070,8 @@ AhciProcessIO (
     __in PSCSI_REQUEST_BLOCK Srb
     )
 {
-    PSCSI_REQUEST_BLOCK tmpSrb;
     STOR_LOCK_HANDLE lockhandle = {0};
     PAHCI_PORT_EXTENSION PortExtension;
-    ULONG commandSlotMask, occupiedSlots, slotIndex, NCS;
 
     AhciDebugPrint("AhciProcessIO()\n");
     AhciDebugPrint("\tPathId: %d\n", PathId);
@@ -1546,37 +2093,16 @@ AhciProcessIO (
         return; // we should wait for device to get active
     }
 
-    occupiedSlots = (PortExtension->QueueSlots | PortExtension->CommandIssuedSlots); // Busy command slots for given port
-    NCS = AHCI_Global_Port_CAP_NCS(AdapterExtension->CAP);
-    commandSlotMask = (1 << NCS) - 1; // available slots mask
-
-    commandSlotMask = (commandSlotMask & ~occupiedSlots);
-    if(commandSlotMask != 0)
+    if (PortExtension->ErrorRecoveryPending)
     {
-        // iterate over HBA port slots
-        for (slotIndex = 0; slotIndex < NCS; slotIndex++)
-        {
-            // find first free slot
-            if ((commandSlotMask & (1 << slotIndex)) != 0)
-            {
-                tmpSrb = RemoveQueue(&PortExtension->SrbQueue);
-                if (tmpSrb != NULL)
-                {
-                    NT_ASSERT(tmpSrb->PathId == PathId);
-                    AhciProcessSrb(PortExtension, tmpSrb, slotIndex);
-                }
-                else
-                {
-                    break;
-                }
-            }
-            else
-            {
-                break;
-            }
-        }
+        // Release Lock
+        StorPortReleaseSpinLock(AdapterExtension, &lockhandle);
+        return; // AhciRecoverFromError issues the queue when it is done
     }
 
+    // assign pending Srbs to free command slots
+    AhciFillCommandSlots(PortExtension);
+
     // program HBA port
     AhciActivatePort(PortExtension);
 
@@ -1689,6 +2215,22 @@ InquiryCompletion (
 
         PortExtension->DeviceParams.AccessType = DIRECT_ACCESS_DEVICE;
 
+        /* Native Command Queuing, needs both HBA and device support */
+        PortExtension->DeviceParams.NcqSupported = 0;
+        PortExtension->MaxPortQueueDepth = AHCI_Global_Port_CAP_NCS(AdapterExtension->CAP);
+        if (IsAdapterCAPSNCQ(AdapterExtension->CAP) &&
+            (((PUSHORT)IdentifyDeviceData)[IDENTIFY_SATA_CAPABILITIES_WORD] & IDENTIFY_SATA_CAPABILITIES_NCQ))
+        {
+            PortExtension->DeviceParams.NcqSupported = 1;
+
+            // QueueDepth is 0's based
+            if (PortExtension->MaxPortQueueDepth > (ULONG)IdentifyDeviceData->QueueDepth + 1)
+            {
+                PortExtension->MaxPortQueueDepth = IdentifyDeviceData->QueueDepth + 1;
+            }
+            AhciDebugPrint("\tNCQ supported, queue depth %d\n", PortExtension->MaxPortQueueDepth);
+        }
+
         /* Device max address lba */
         if (PortExtension->DeviceParams.Lba48BitMode)
         {
@@ -1750,7 +2292,7 @@ InquiryCompletion (
     // prepare data to send
     InquiryData->Versions = 2;
     InquiryData->Wide32Bit = 1;
-    InquiryData->CommandQueue = 0; // NCQ not supported
+    InquiryData->CommandQueue = PortExtension->DeviceParams.NcqSupported;
     InquiryData->ResponseDataFormat = 0x2;
     InquiryData->DeviceTypeModifier = 0;
     InquiryData->DeviceTypeQualifier = DEVICE_CONNECTED;
@@ -1772,7 +2314,7 @@ InquiryCompletion (
                                          Srb->PathId,
                                          Srb->TargetId,
                                          Srb->Lun,
-                                         AHCI_Global_Port_CAP_NCS(AdapterExtension->CAP));
+                                         PortExtension->MaxPortQueueDepth);
 
     NT_ASSERT(status == TRUE);
     return;
@@ -1979,7 +2521,7 @@ DeviceRequestReadWrite (
     NT_ASSERT(SectorCount > 0);
 
     SrbExtension->AtaFunction = ATA_FUNCTION_ATA_READ;
-    SrbExtension->Flags |= ATA_FLAGS_USE_DMA;
+    SrbExtension->Flags = ATA_FLAGS_USE_DMA;
     SrbExtension->CompletionRoutine = NULL;
 
     if (IsReading)
@@ -2028,6 +2570,20 @@ DeviceRequestReadWrite (
 
     NT_ASSERT(SectorCount < 0x100);
 
+    if (PortExtension->DeviceParams.NcqSupported &&
+        PortExtension->DeviceParams.Lba48BitMode)
+    {
+        // READ/WRITE FPDMA QUEUED: sector count moves to the features register,
+        // count register holds the tag which is assigned with the command slot
+        SrbExtension->Flags |= ATA_FLAGS_NCQ_COMMAND;
+        SrbExtension->CommandReg = IsReading ? IDE_COMMAND_READ_FPDMA_QUEUED : IDE_COMMAND_WRITE_FPDMA_QUEUED;
+        SrbExtension->FeaturesLow = (SectorCount >> 0) & 0xFF;
+        SrbExtension->FeaturesHigh = (SectorCount >> 8) & 0xFF;
+        SrbExtension->SectorCountLow = 0;
+        SrbExtension->SectorCountHigh = 0;
+        SrbExtension->Device = IDE_LBA_MODE;
+    }
+
     SrbExtension->pSgl = (PLOCAL_SCATTER_GATHER_LIST)StorPortGetScatterGatherList(AdapterExtension, Srb);
 
     return SRB_STATUS_PENDING;
@@ -15,7 +15,7 @@
 
 #define MAXIMUM_AHCI_PORT_COUNT             32
 #define MAXIMUM_AHCI_PRDT_ENTRIES           32
-#define MAXIMUM_AHCI_PORT_NCS               30
+#define MAXIMUM_AHCI_PORT_NCS               32
 #define MAXIMUM_QUEUE_BUFFER_SIZE           255
 #define MAXIMUM_TRANSFER_LENGTH             (128*1024) // 128 KB
 
@@ -28,6 +28,22 @@
 
 // section 3.1.2
 #define AHCI_Global_HBA_CAP_S64A            (1 << 31)
+#define AHCI_Global_HBA_CAP_SNCQ            (1 << 30)
+#define AHCI_Global_HBA_CAP_SCLO            (1 << 24)
+
+// ATA-8 ACS commands not present in ata.h
+#define IDE_COMMAND_READ_LOG_EXT            0x2F
+#define IDE_COMMAND_READ_FPDMA_QUEUED       0x60
+#define IDE_COMMAND_WRITE_FPDMA_QUEUED      0x61
+
+// IDENTIFY DEVICE word 76 -- Serial ATA capabilities
+#define IDENTIFY_SATA_CAPABILITIES_WORD     76
+#define IDENTIFY_SATA_CAPABILITIES_NCQ      (1 << 8)
+
+// READ LOG EXT page 10h -- NCQ command error log
+#define ATA_LOG_NCQ_COMMAND_ERROR           0x10
+#define ATA_LOG_NCQ_ERROR_NQ                (1 << 7)
+#define ATA_LOG_NCQ_ERROR_TAG_MASK          0x1F
 
 // FIS Types : http://wiki.osdev.org/AHCI
 #define FIS_TYPE_REG_H2D        0x27 // Register FIS - host to device
@@ -66,14 +82,20 @@
 #define ATA_FLAGS_DATA_OUT                  (1 << 2)
 #define ATA_FLAGS_48BIT_COMMAND             (1 << 3)
 #define ATA_FLAGS_USE_DMA                   (1 << 4)
+#define ATA_FLAGS_NCQ_COMMAND               (1 << 5)
 
 #define IsAtaCommand(AtaFunction)           (AtaFunction & ATA_FUNCTION_ATA_COMMAND)
 #define IsAtapiCommand(AtaFunction)         (AtaFunction & ATA_FUNCTION_ATAPI_COMMAND)
 #define IsDataTransferNeeded(SrbExtension)  (SrbExtension->Flags & (ATA_FLAGS_DATA_IN | ATA_FLAGS_DATA_OUT))
+#define IsNcqCommand(SrbExtension)          (SrbExtension->Flags & ATA_FLAGS_NCQ_COMMAND)
 #define IsAdapterCAPS64(CAP)                (CAP & AHCI_Global_HBA_CAP_S64A)
+#define IsAdapterCAPSNCQ(CAP)               (CAP & AHCI_Global_HBA_CAP_SNCQ)
+
+// 3.1.1 NCS = CAP[12:08] -> 0's based value
+#define AHCI_Global_Port_CAP_NCS(x)         ((((x) & 0x1F00) >> 8) + 1)
 
-// 3.1.1 NCS = CAP[12:08] -> Align
-#define AHCI_Global_Port_CAP_NCS(x)         (((x) & 0xF00) >> 8)
+// bit mask of the first n command slots (n may be 32)
+#define AHCI_SLOT_MASK(n)                   (((n) >= 32) ? 0xFFFFFFFF : ((1UL << (n)) - 1))
 
 #define ROUND_UP(N, S) ((((N) + (S) - 1) / (S)) * (S))
 #define AhciDebugPrint(format, ...) StorPortDebugPrint(0, format, __VA_ARGS__)
@@ -458,6 +480,7 @@ typedef struct _AHCI_PORT_EXTENSION
     ULONG PortNumber;
     ULONG QueueSlots;                                   // slots which we have already assigned task (Slot)
     ULONG CommandIssuedSlots;                           // slots which has been programmed
+    ULONG NcqSlots;                                     // assigned or issued slots holding FPDMA QUEUED commands
     ULONG MaxPortQueueDepth;
 
     struct
@@ -467,6 +490,7 @@ typedef struct _AHCI_PORT_EXTENSION
         UCHAR AccessType;
         UCHAR DeviceType;
         UCHAR IsActive;
+        UCHAR NcqSupported;
         LARGE_INTEGER MaxLba;
         ULONG BytesPerLogicalSector;
         ULONG BytesPerPhysicalSector;
@@ -476,6 +500,9 @@ typedef struct _AHCI_PORT_EXTENSION
     } DeviceParams;
 
     STOR_DPC CommandCompletion;
+    STOR_DPC ErrorRecovery;
+    BOOLEAN ErrorRecoveryPending;                       // port interrupts masked, no commands issued
+    ULONG InterruptEnable;                              // PxIE to restore after error recovery
     PAHCI_PORT Port;                                    // AHCI Port Infomation
     AHCI_QUEUE SrbQueue;                                // pending Srbs
     AHCI_QUEUE CompletionQueue;
@@ -485,6 +512,8 @@ typedef struct _AHCI_PORT_EXTENSION
     STOR_DEVICE_POWER_STATE DevicePowerState;           // Device Power State
     PIDENTIFY_DEVICE_DATA IdentifyDeviceData;
     STOR_PHYSICAL_ADDRESS IdentifyDeviceDataPhysicalAddress;
+    PAHCI_COMMAND_TABLE InternalCommandTable;           // used for error recovery commands
+    PUCHAR NcqErrorLog;                                 // READ LOG EXT page 10h buffer
     struct _AHCI_ADAPTER_EXTENSION* AdapterExtension;   // Port's Adapter Information
 } AHCI_PORT_EXTENSION, *PAHCI_PORT_EXTENSION;
 
@@ -570,6 +599,24 @@ AhciProcessIO (
     __in PSCSI_REQUEST_BLOCK Srb
     );
 
+VOID
+AhciFillCommandSlots (
+    __in PAHCI_PORT_EXTENSION PortExtension
+    );
+
+VOID
+AhciActivatePort (
+    __in PAHCI_PORT_EXTENSION PortExtension
+    );
+
+VOID
+AhciRecoverFromError (
+    __in PSTOR_DPC Dpc,
+    __in PAHCI_ADAPTER_EXTENSION AdapterExtension,
+    __in PAHCI_PORT_EXTENSION PortExtension,
+    __in PVOID SystemArgument2
+    );
+
 BOOLEAN
 AhciAdapterReset (
     __in PAHCI_ADAPTER_EXTENSION AdapterExtension
@@ -124,6 +124,20 @@ CcPfInitializePrefetcher(VOID)
     /* FIXME: Setup the rest of the prefetecher */
 }
 
+VOID
+NTAPI
+CcPfBeginBootPhase(IN PF_BOOT_PHASE_ID Phase)
+{
+    /* The prefetcher only traces the ROS cache manager */
+}
+
+VOID
+NTAPI
+CcPfBeginAppLaunch(IN PEPROCESS Process)
+{
+    /* The prefetcher only traces the ROS cache manager */
+}
+
 BOOLEAN
 NTAPI
 CcpAcquireFileLock(PNOCC_CACHE_MAP Map)
@@ -13,29 +13,8 @@
 #define NDEBUG
 #include <debug.h>
 
-BOOLEAN CcPfEnablePrefetcher;
-PFSN_PREFETCHER_GLOBALS CcPfGlobals;
-
 /* FUNCTIONS *****************************************************************/
 
-VOID
-NTAPI
-INIT_FUNCTION
-CcPfInitializePrefetcher(VOID)
-{
-    /* Notify debugger */
-    DbgPrintEx(DPFLTR_PREFETCHER_ID,
-               DPFLTR_TRACE_LEVEL,
-               "CCPF: InitializePrefetecher()\n");
-
-    /* Setup the Prefetcher Data */
-    InitializeListHead(&CcPfGlobals.ActiveTraces);
-    InitializeListHead(&CcPfGlobals.CompletedTraces);
-    ExInitializeFastMutex(&CcPfGlobals.CompletedTracesLock);
-
-    /* FIXME: Setup the rest of the prefetecher */
-}
-
 BOOLEAN
 NTAPI
 INIT_FUNCTION
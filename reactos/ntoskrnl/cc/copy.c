@@ -110,6 +110,9 @@ CcReadVirtualAddress (
                       VACB_MAPPING_GRANULARITY - Size);
     }
 
+    /* Let the prefetcher know about this miss */
+    CcPfLogCacheRead(Vacb->SharedCacheMap->FileObject, Vacb->FileOffset.QuadPart);
+
     return STATUS_SUCCESS;
 }
 
@@ -13,6 +13,42 @@
 #define NDEBUG
 #include <debug.h>
 
+/* PRIVATE FUNCTIONS *********************************************************/
+
+static
+VOID
+CcMdlReleaseView (
+    IN PROS_SHARED_CACHE_MAP SharedCacheMap,
+    IN PMDL Mdl)
+{
+    PLIST_ENTRY ListEntry;
+    PCC_MDL_VIEW View = NULL;
+    KIRQL OldIrql;
+
+    /* Take back the record CcMdlRead made for this MDL */
+    KeAcquireSpinLock(&SharedCacheMap->CacheMapLock, &OldIrql);
+    for (ListEntry = SharedCacheMap->MdlViewListHead.Flink;
+         ListEntry != &SharedCacheMap->MdlViewListHead;
+         ListEntry = ListEntry->Flink)
+    {
+        if (CONTAINING_RECORD(ListEntry, CC_MDL_VIEW, MdlViewListEntry)->Mdl == Mdl)
+        {
+            View = CONTAINING_RECORD(ListEntry, CC_MDL_VIEW, MdlViewListEntry);
+            RemoveEntryList(&View->MdlViewListEntry);
+            break;
+        }
+    }
+    KeReleaseSpinLock(&SharedCacheMap->CacheMapLock, OldIrql);
+
+    /* An MDL that didn't come from CcMdlRead is a caller bug */
+    ASSERT(View != NULL);
+    if (View)
+    {
+        CcRosUnmapVacb(SharedCacheMap, View->Vacb->FileOffset.QuadPart, FALSE);
+        ExFreePoolWithTag(View, TAG_MDL_VIEW);
+    }
+}
+
 /* FUNCTIONS *****************************************************************/
 
 /*
@@ -28,10 +64,120 @@ CcMdlRead (
     OUT PIO_STATUS_BLOCK IoStatus
     )
 {
+    PROS_SHARED_CACHE_MAP SharedCacheMap;
+    PROS_VACB Vacb;
+    PCC_MDL_VIEW View;
+    PVOID BaseAddress;
+    BOOLEAN Valid;
+    LONGLONG CurrentOffset;
+    ULONG ViewOffset, PartialLength, BytesRead = 0;
+    PMDL Mdl, *NextMdl;
+    NTSTATUS Status;
+    KIRQL OldIrql;
+
     CCTRACE(CC_API_DEBUG, "FileObject=%p FileOffset=%I64d Length=%lu\n",
         FileObject, FileOffset->QuadPart, Length);
 
-    UNIMPLEMENTED;
+    SharedCacheMap = FileObject->SectionObjectPointer->SharedCacheMap;
+    CurrentOffset = FileOffset->QuadPart;
+    *MdlChain = NULL;
+    NextMdl = MdlChain;
+
+    /*
+     * Describe the data right where it sits in the cache, one MDL per view.
+     * The views stay mapped, and the pages locked, until the caller gives
+     * the chain back through CcMdlReadComplete.
+     */
+    while (Length > 0)
+    {
+        ViewOffset = CurrentOffset % VACB_MAPPING_GRANULARITY;
+        PartialLength = min(Length, VACB_MAPPING_GRANULARITY - ViewOffset);
+
+        View = ExAllocatePoolWithTag(NonPagedPool, sizeof(*View), TAG_MDL_VIEW);
+        if (!View)
+        {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            goto Fail;
+        }
+
+        Status = CcRosRequestVacb(SharedCacheMap,
+                                  CurrentOffset - ViewOffset,
+                                  &BaseAddress,
+                                  &Valid,
+                                  &Vacb);
+        if (!NT_SUCCESS(Status))
+        {
+            ExFreePoolWithTag(View, TAG_MDL_VIEW);
+            goto Fail;
+        }
+
+        if (!Valid)
+        {
+            Status = CcReadVirtualAddress(Vacb);
+            if (!NT_SUCCESS(Status))
+            {
+                CcRosReleaseVacb(SharedCacheMap, Vacb, FALSE, FALSE, FALSE);
+                ExFreePoolWithTag(View, TAG_MDL_VIEW);
+                goto Fail;
+            }
+        }
+
+        Mdl = IoAllocateMdl((PUCHAR)BaseAddress + ViewOffset,
+                            PartialLength,
+                            FALSE,
+                            FALSE,
+                            NULL);
+        if (!Mdl)
+        {
+            CcRosReleaseVacb(SharedCacheMap, Vacb, TRUE, FALSE, FALSE);
+            ExFreePoolWithTag(View, TAG_MDL_VIEW);
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            goto Fail;
+        }
+
+        /* The view's pages are pageable, so lock them for as long as the MDL lives */
+        _SEH2_TRY
+        {
+            MmProbeAndLockPages(Mdl, KernelMode, IoReadAccess);
+        }
+        _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+        {
+            Status = _SEH2_GetExceptionCode();
+        }
+        _SEH2_END;
+
+        if (!NT_SUCCESS(Status))
+        {
+            IoFreeMdl(Mdl);
+            CcRosReleaseVacb(SharedCacheMap, Vacb, TRUE, FALSE, FALSE);
+            ExFreePoolWithTag(View, TAG_MDL_VIEW);
+            goto Fail;
+        }
+
+        /* Keep the view mapped and remember which one it is */
+        CcRosReleaseVacb(SharedCacheMap, Vacb, TRUE, FALSE, TRUE);
+        View->Mdl = Mdl;
+        View->Vacb = Vacb;
+        KeAcquireSpinLock(&SharedCacheMap->CacheMapLock, &OldIrql);
+        InsertTailList(&SharedCacheMap->MdlViewListHead, &View->MdlViewListEntry);
+        KeReleaseSpinLock(&SharedCacheMap->CacheMapLock, OldIrql);
+
+        *NextMdl = Mdl;
+        NextMdl = &Mdl->Next;
+
+        Length -= PartialLength;
+        CurrentOffset += PartialLength;
+        BytesRead += PartialLength;
+    }
+
+    IoStatus->Status = STATUS_SUCCESS;
+    IoStatus->Information = BytesRead;
+    return;
+
+Fail:
+    CcMdlReadComplete2(FileObject, *MdlChain);
+    *MdlChain = NULL;
+    ExRaiseStatus(Status);
 }
 
 /*
@@ -58,13 +204,17 @@ CcMdlReadComplete2 (
     IN PMDL MemoryDescriptorList
 )
 {
+    PROS_SHARED_CACHE_MAP SharedCacheMap;
     PMDL Mdl;
 
-    /* Free MDLs */
+    SharedCacheMap = FileObject->SectionObjectPointer->SharedCacheMap;
+
+    /* Unlock and free MDLs and let go of the views they describe */
     while ((Mdl = MemoryDescriptorList))
     {
         MemoryDescriptorList = Mdl->Next;
         MmUnlockPages(Mdl);
+        CcMdlReleaseView(SharedCacheMap, Mdl);
         IoFreeMdl(Mdl);
     }
 }
@@ -102,9 +252,12 @@ CcMdlReadComplete (
     if (FastDispatch && FastDispatch->MdlReadComplete)
     {
          /* Use the fast path */
-        FastDispatch->MdlReadComplete(FileObject,
-                                      MdlChain,
-                                      DeviceObject);
+        if (FastDispatch->MdlReadComplete(FileObject,
+                                          MdlChain,
+                                          DeviceObject))
+        {
+            return;
+        }
     }
 
     /* Use slow path */
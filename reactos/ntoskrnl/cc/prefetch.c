@@ -0,0 +1,1044 @@
+/*
+ * COPYRIGHT:       See COPYING in the top level directory
+ * PROJECT:         ReactOS kernel
+ * FILE:            ntoskrnl/cc/prefetch.c
+ * PURPOSE:         Boot and application launch prefetcher
+ */
+
+/* INCLUDES *****************************************************************/
+
+#include <ntoskrnl.h>
+#define NDEBUG
+#include <debug.h>
+
+/* GLOBALS *******************************************************************/
+
+/* Bits of the EnablePrefetcher registry value */
+#define CCPF_ENABLE_APP_LAUNCH          0x1
+#define CCPF_ENABLE_BOOT                0x2
+
+#define CCPF_TRACE_MAGIC                'rTfP'
+
+/* An application launch is traced for at most 10 periods of 1 second */
+#define CCPF_APP_TRACE_PERIOD           1000
+#define CCPF_APP_MAX_ENTRIES            4096
+
+/* Boot is traced for at most 10 periods of 4 seconds, from SMSS on */
+#define CCPF_BOOT_TRACE_PERIOD          4000
+#define CCPF_BOOT_MAX_ENTRIES           16384
+
+#define CCPF_MAX_FILES                  512
+#define CCPF_MAX_ACTIVE_TRACES          8
+
+/* Scenario files only grow by merging, limit them and rebuild them now and then */
+#define CCPF_MAX_SCENARIO_SIZE          (4 * 1024 * 1024)
+#define CCPF_MAX_SCENARIO_RUNS          8192
+#define CCPF_RETRACE_LAUNCHES           32
+
+/* Number of prefetch reads kept in flight */
+#define CCPF_MAX_INFLIGHT_READS         8
+
+#define CCPF_PAGES_PER_VIEW             (VACB_MAPPING_GRANULARITY / PAGE_SIZE)
+
+#define TAG_PREFETCH                    'fPcC'
+
+typedef struct _CCPF_RUN
+{
+    ULONG FileIndex;
+    ULONG StartPage;
+    ULONG NumPages;
+} CCPF_RUN, *PCCPF_RUN;
+
+BOOLEAN CcPfEnablePrefetcher;
+PFSN_PREFETCHER_GLOBALS CcPfGlobals;
+static ULONG CcPfEnableFlags = CCPF_ENABLE_APP_LAUNCH | CCPF_ENABLE_BOOT;
+
+/* PRIVATE FUNCTIONS *********************************************************/
+
+static
+NTSTATUS
+CcPfGetScenarioFileName(IN PPF_SCENARIO_ID ScenarioId,
+                        OUT PWCHAR Buffer,
+                        IN SIZE_T BufferSize)
+{
+    /* Scenario files are named like NOTEPAD.EXE-1A2B3C4D.pf */
+    return RtlStringCbPrintfW(Buffer,
+                              BufferSize,
+                              L"\\SystemRoot\\Prefetch\\%s-%08lX.pf",
+                              ScenarioId->ScenName,
+                              ScenarioId->HashId);
+}
+
+static
+BOOLEAN
+CcPfIsScenarioValid(IN PPF_SCENARIO_HEADER Scenario,
+                    IN ULONG Size,
+                    IN PPF_SCENARIO_ID ScenarioId,
+                    IN PF_SCENARIO_TYPE ScenarioType)
+{
+    PPF_SCENARIO_FILE Files;
+    ULONG i;
+
+    /* Check the header */
+    if ((Size < sizeof(PF_SCENARIO_HEADER)) ||
+        (Scenario->MagicNumber != PF_SCENARIO_MAGIC) ||
+        (Scenario->Version != PF_SCENARIO_VERSION) ||
+        (Scenario->Size != Size) ||
+        (Scenario->ScenarioType != ScenarioType) ||
+        (Scenario->ScenarioId.HashId != ScenarioId->HashId))
+    {
+        return FALSE;
+    }
+
+    /* Check that all the tables are inside the file */
+    if ((Scenario->FileInfoOffset > Size) ||
+        (Scenario->NumFiles > (Size - Scenario->FileInfoOffset) / sizeof(PF_SCENARIO_FILE)) ||
+        (Scenario->RunInfoOffset > Size) ||
+        (Scenario->NumRuns > (Size - Scenario->RunInfoOffset) / sizeof(PF_SCENARIO_RUN)) ||
+        (Scenario->FileNameInfoOffset > Size) ||
+        (Scenario->FileNameInfoSize > Size - Scenario->FileNameInfoOffset))
+    {
+        return FALSE;
+    }
+
+    /* Check the files */
+    Files = (PPF_SCENARIO_FILE)((PUCHAR)Scenario + Scenario->FileInfoOffset);
+    for (i = 0; i < Scenario->NumFiles; i++)
+    {
+        if ((Files[i].FileNameOffset > Scenario->FileNameInfoSize) ||
+            (Files[i].FileNameLength > Scenario->FileNameInfoSize - Files[i].FileNameOffset) ||
+            (Files[i].FileNameLength > MAXUSHORT) ||
+            (Files[i].FileNameLength % sizeof(WCHAR)) ||
+            (Files[i].FileNameOffset % sizeof(WCHAR)) ||
+            (Files[i].FirstRun > Scenario->NumRuns) ||
+            (Files[i].NumRuns > Scenario->NumRuns - Files[i].FirstRun))
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static
+PPF_SCENARIO_HEADER
+CcPfLoadScenario(IN PPF_SCENARIO_ID ScenarioId,
+                 IN PF_SCENARIO_TYPE ScenarioType)
+{
+    WCHAR Buffer[MAX_PATH];
+    UNICODE_STRING FileName;
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    IO_STATUS_BLOCK IoStatusBlock;
+    FILE_STANDARD_INFORMATION FileInformation;
+    PPF_SCENARIO_HEADER Scenario;
+    HANDLE FileHandle;
+    NTSTATUS Status;
+    ULONG Size;
+    PAGED_CODE();
+
+    Status = CcPfGetScenarioFileName(ScenarioId, Buffer, sizeof(Buffer));
+    if (!NT_SUCCESS(Status)) return NULL;
+
+    RtlInitUnicodeString(&FileName, Buffer);
+    InitializeObjectAttributes(&ObjectAttributes,
+                               &FileName,
+                               OBJ_CASE_INSENSITIVE | OBJ_KERNEL_HANDLE,
+                               NULL,
+                               NULL);
+    Status = ZwCreateFile(&FileHandle,
+                          FILE_READ_DATA | SYNCHRONIZE,
+                          &ObjectAttributes,
+                          &IoStatusBlock,
+                          NULL,
+                          0,
+                          FILE_SHARE_READ,
+                          FILE_OPEN,
+                          FILE_NON_DIRECTORY_FILE | FILE_SYNCHRONOUS_IO_NONALERT,
+                          NULL,
+                          0);
+    if (!NT_SUCCESS(Status))
+    {
+        /* First launch of this scenario */
+        return NULL;
+    }
+
+    Scenario = NULL;
+    Status = ZwQueryInformationFile(FileHandle,
+                                    &IoStatusBlock,
+                                    &FileInformation,
+                                    sizeof(FileInformation),
+                                    FileStandardInformation);
+    if (!NT_SUCCESS(Status) ||
+        (FileInformation.EndOfFile.QuadPart < sizeof(PF_SCENARIO_HEADER)) ||
+        (FileInformation.EndOfFile.QuadPart > CCPF_MAX_SCENARIO_SIZE))
+    {
+        goto Quickie;
+    }
+
+    Size = FileInformation.EndOfFile.LowPart;
+    Scenario = ExAllocatePoolWithTag(PagedPool, Size, TAG_PREFETCH);
+    if (!Scenario) goto Quickie;
+
+    Status = ZwReadFile(FileHandle,
+                        NULL,
+                        NULL,
+                        NULL,
+                        &IoStatusBlock,
+                        Scenario,
+                        Size,
+                        NULL,
+                        NULL);
+    if (!NT_SUCCESS(Status) ||
+        (IoStatusBlock.Information != Size) ||
+        !CcPfIsScenarioValid(Scenario, Size, ScenarioId, ScenarioType))
+    {
+        DPRINT1("CCPF: Ignoring bad scenario file %wZ\n", &FileName);
+        ExFreePoolWithTag(Scenario, TAG_PREFETCH);
+        Scenario = NULL;
+    }
+
+Quickie:
+    ZwClose(FileHandle);
+    return Scenario;
+}
+
+static
+VOID
+CcPfPrefetchScenario(IN PPF_SCENARIO_HEADER Scenario)
+{
+    HANDLE Events[CCPF_MAX_INFLIGHT_READS];
+    IO_STATUS_BLOCK IoStatus[CCPF_MAX_INFLIGHT_READS];
+    BOOLEAN Pending[CCPF_MAX_INFLIGHT_READS];
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    IO_STATUS_BLOCK IoStatusBlock;
+    UNICODE_STRING FileName;
+    LARGE_INTEGER ByteOffset;
+    PPF_SCENARIO_FILE Files;
+    PPF_SCENARIO_RUN Runs, Run;
+    HANDLE FileHandle;
+    PVOID Buffer;
+    ULONG i, j, Page, EndPage, Slot, NumEvents;
+    NTSTATUS Status;
+    PAGED_CODE();
+
+    /*
+     * The read data is thrown away, all that matters is that it lands in
+     * the cache. All reads share one buffer for that reason.
+     */
+    Buffer = ExAllocatePoolWithTag(PagedPool, PAGE_SIZE, TAG_PREFETCH);
+    if (!Buffer) return;
+
+    /* Each read in flight gets its own event */
+    InitializeObjectAttributes(&ObjectAttributes, NULL, OBJ_KERNEL_HANDLE, NULL, NULL);
+    for (NumEvents = 0; NumEvents < CCPF_MAX_INFLIGHT_READS; NumEvents++)
+    {
+        Status = ZwCreateEvent(&Events[NumEvents],
+                               EVENT_ALL_ACCESS,
+                               &ObjectAttributes,
+                               NotificationEvent,
+                               FALSE);
+        if (!NT_SUCCESS(Status)) break;
+        Pending[NumEvents] = FALSE;
+    }
+
+    if (!NumEvents)
+    {
+        ExFreePoolWithTag(Buffer, TAG_PREFETCH);
+        return;
+    }
+
+    InterlockedIncrement(&CcPfGlobals.ActivePrefetches);
+
+    Files = (PPF_SCENARIO_FILE)((PUCHAR)Scenario + Scenario->FileInfoOffset);
+    Runs = (PPF_SCENARIO_RUN)((PUCHAR)Scenario + Scenario->RunInfoOffset);
+    Slot = 0;
+
+    /* Files are stored in the order they were first used, runs sorted by offset */
+    for (i = 0; i < Scenario->NumFiles; i++)
+    {
+        if (!Files[i].NumRuns || !Files[i].FileNameLength) continue;
+
+        FileName.Buffer = (PWCHAR)((PUCHAR)Scenario +
+                                   Scenario->FileNameInfoOffset +
+                                   Files[i].FileNameOffset);
+        FileName.Length = (USHORT)Files[i].FileNameLength;
+        FileName.MaximumLength = FileName.Length;
+
+        /* Open the file for asynchronous I/O */
+        InitializeObjectAttributes(&ObjectAttributes,
+                                   &FileName,
+                                   OBJ_CASE_INSENSITIVE | OBJ_KERNEL_HANDLE,
+                                   NULL,
+                                   NULL);
+        Status = ZwCreateFile(&FileHandle,
+                              FILE_READ_DATA,
+                              &ObjectAttributes,
+                              &IoStatusBlock,
+                              NULL,
+                              0,
+                              FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                              FILE_OPEN,
+                              FILE_NON_DIRECTORY_FILE,
+                              NULL,
+                              0);
+        if (!NT_SUCCESS(Status))
+        {
+            DPRINT("CCPF: Cannot open %wZ, Status 0x%lx\n", &FileName, Status);
+            continue;
+        }
+
+        for (j = 0; j < Files[i].NumRuns; j++)
+        {
+            Run = &Runs[Files[i].FirstRun + j];
+            EndPage = Run->StartPage + Run->NumPages;
+
+            /*
+             * A cache miss reads in the whole view, so touching one page
+             * per view turns each run into large sequential reads.
+             */
+            for (Page = Run->StartPage;
+                 (Page < EndPage) && (Page >= Run->StartPage);
+                 Page = (Page / CCPF_PAGES_PER_VIEW + 1) * CCPF_PAGES_PER_VIEW)
+            {
+                /* Recycle the oldest slot once all of them are busy */
+                if (Pending[Slot])
+                {
+                    ZwWaitForSingleObject(Events[Slot], FALSE, NULL);
+                    Pending[Slot] = FALSE;
+                }
+
+                ByteOffset.QuadPart = (LONGLONG)Page << PAGE_SHIFT;
+                Status = ZwReadFile(FileHandle,
+                                    Events[Slot],
+                                    NULL,
+                                    NULL,
+                                    &IoStatus[Slot],
+                                    Buffer,
+                                    PAGE_SIZE,
+                                    &ByteOffset,
+                                    NULL);
+                Pending[Slot] = (Status == STATUS_PENDING);
+                Slot = (Slot + 1) % NumEvents;
+
+                /* Don't keep reading a file that shrank */
+                if (Status == STATUS_END_OF_FILE) break;
+            }
+        }
+
+        /* Reads still in flight keep their own reference on the file */
+        ZwClose(FileHandle);
+    }
+
+    /* Wait for the remaining reads, they still use the buffer */
+    for (i = 0; i < NumEvents; i++)
+    {
+        if (Pending[i]) ZwWaitForSingleObject(Events[i], FALSE, NULL);
+        ZwClose(Events[i]);
+    }
+
+    InterlockedDecrement(&CcPfGlobals.ActivePrefetches);
+    ExFreePoolWithTag(Buffer, TAG_PREFETCH);
+}
+
+static
+VOID
+CcPfLogEntry(IN PPFSN_TRACE_HEADER Trace,
+             IN PFILE_OBJECT FileObject,
+             IN LONGLONG FileOffset)
+{
+    PPFSN_LOG_ENTRIES LogEntries = Trace->CurrentTraceBuffer;
+    PPF_LOG_ENTRY LogEntry;
+    ULONG FileKey;
+
+    /* Called with the active traces lock held */
+    Trace->NumFaults++;
+    if (LogEntries->NumEntries >= LogEntries->MaxEntries) return;
+
+    /* Misses usually come in bursts on the same file */
+    FileKey = Trace->LastFileKey;
+    if ((FileKey >= Trace->NumFiles) ||
+        (Trace->Files[FileKey].SectionObjectPointer != FileObject->SectionObjectPointer))
+    {
+        for (FileKey = 0; FileKey < Trace->NumFiles; FileKey++)
+        {
+            if (Trace->Files[FileKey].SectionObjectPointer == FileObject->SectionObjectPointer)
+                break;
+        }
+
+        if (FileKey == Trace->NumFiles)
+        {
+            /* New file, keep it around so we can get its name later */
+            if (FileKey == CCPF_MAX_FILES) return;
+            ObReferenceObject(FileObject);
+            Trace->Files[FileKey].SectionObjectPointer = FileObject->SectionObjectPointer;
+            Trace->Files[FileKey].FileObject = FileObject;
+            Trace->NumFiles++;
+        }
+
+        Trace->LastFileKey = FileKey;
+    }
+
+    LogEntry = &LogEntries->Entries[LogEntries->NumEntries++];
+    LogEntry->FileOffset = (ULONG)(FileOffset / VACB_MAPPING_GRANULARITY);
+    LogEntry->Type = 0;
+    LogEntry->FileKey = FileKey;
+}
+
+static
+VOID
+NTAPI
+CcPfTraceTimerDpc(IN PKDPC Dpc,
+                  IN PVOID DeferredContext,
+                  IN PVOID SystemArgument1,
+                  IN PVOID SystemArgument2)
+{
+    PPFSN_TRACE_HEADER Trace = (PPFSN_TRACE_HEADER)DeferredContext;
+    LONG NumFaults, Period;
+    BOOLEAN EndTrace;
+
+    /* The end of the trace is already underway */
+    if (Trace->EndTraceCalled) return;
+
+    /* Account the faults of the period that just ended */
+    NumFaults = Trace->NumFaults;
+    Period = Trace->CurPeriod;
+    Trace->FaultsPerPeriod[Period] = NumFaults - Trace->LastNumFaults;
+    Trace->LastNumFaults = NumFaults;
+    Trace->CurPeriod = ++Period;
+
+    /* Stop when time is up or the log is full */
+    EndTrace = (Period >= RTL_NUMBER_OF(Trace->FaultsPerPeriod)) ||
+               (NumFaults >= Trace->MaxFaults);
+
+    if (Trace->Process)
+    {
+        /* Also stop once the process is gone or done loading */
+        if ((Trace->Process->Flags & PSF_PROCESS_EXITING_BIT) ||
+            ((Period >= 2) &&
+             !Trace->FaultsPerPeriod[Period - 1] &&
+             !Trace->FaultsPerPeriod[Period - 2]))
+        {
+            EndTrace = TRUE;
+        }
+    }
+
+    /* The trace is saved and freed from a worker thread */
+    if (EndTrace && !InterlockedExchange(&Trace->EndTraceCalled, TRUE))
+    {
+        ExQueueWorkItem(&Trace->EndTraceWorkItem, DelayedWorkQueue);
+    }
+}
+
+static
+POBJECT_NAME_INFORMATION
+CcPfQueryFileName(IN PFILE_OBJECT FileObject)
+{
+    POBJECT_NAME_INFORMATION NameInfo;
+    ULONG Length = sizeof(OBJECT_NAME_INFORMATION) + MAX_PATH * sizeof(WCHAR);
+    NTSTATUS Status;
+
+    NameInfo = ExAllocatePoolWithTag(PagedPool, Length, TAG_PREFETCH);
+    if (!NameInfo) return NULL;
+
+    Status = ObQueryNameString(FileObject, NameInfo, Length, &Length);
+    if (Status == STATUS_INFO_LENGTH_MISMATCH || Status == STATUS_BUFFER_OVERFLOW)
+    {
+        /* Try again with the right size */
+        ExFreePoolWithTag(NameInfo, TAG_PREFETCH);
+        NameInfo = ExAllocatePoolWithTag(PagedPool, Length, TAG_PREFETCH);
+        if (!NameInfo) return NULL;
+
+        Status = ObQueryNameString(FileObject, NameInfo, Length, &Length);
+    }
+
+    if (!NT_SUCCESS(Status) || !NameInfo->Name.Length)
+    {
+        ExFreePoolWithTag(NameInfo, TAG_PREFETCH);
+        return NULL;
+    }
+
+    return NameInfo;
+}
+
+static
+ULONG
+CcPfAddFileName(IN OUT PUNICODE_STRING Names,
+                IN OUT PULONG NumNames,
+                IN PUNICODE_STRING Name)
+{
+    ULONG i;
+
+    /* Several file objects, or the old scenario, may name the same file */
+    for (i = 0; i < *NumNames; i++)
+    {
+        if (RtlEqualUnicodeString(&Names[i], Name, TRUE)) return i;
+    }
+
+    Names[i] = *Name;
+    (*NumNames)++;
+    return i;
+}
+
+static
+int
+__cdecl
+CcPfCompareRuns(const void *A,
+                const void *B)
+{
+    const CCPF_RUN *RunA = A, *RunB = B;
+
+    if (RunA->FileIndex != RunB->FileIndex)
+        return (RunA->FileIndex < RunB->FileIndex) ? -1 : 1;
+    if (RunA->StartPage != RunB->StartPage)
+        return (RunA->StartPage < RunB->StartPage) ? -1 : 1;
+    return 0;
+}
+
+static
+NTSTATUS
+CcPfWriteScenarioFile(IN PPF_SCENARIO_ID ScenarioId,
+                      IN PPF_SCENARIO_HEADER Scenario)
+{
+    WCHAR Buffer[MAX_PATH];
+    UNICODE_STRING FileName;
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    IO_STATUS_BLOCK IoStatusBlock;
+    HANDLE Handle;
+    NTSTATUS Status;
+    PAGED_CODE();
+
+    /* Make sure the prefetch directory exists */
+    RtlInitUnicodeString(&FileName, L"\\SystemRoot\\Prefetch");
+    InitializeObjectAttributes(&ObjectAttributes,
+                               &FileName,
+                               OBJ_CASE_INSENSITIVE | OBJ_KERNEL_HANDLE,
+                               NULL,
+                               NULL);
+    Status = ZwCreateFile(&Handle,
+                          FILE_LIST_DIRECTORY | SYNCHRONIZE,
+                          &ObjectAttributes,
+                          &IoStatusBlock,
+                          NULL,
+                          FILE_ATTRIBUTE_NORMAL,
+                          FILE_SHARE_READ | FILE_SHARE_WRITE,
+                          FILE_OPEN_IF,
+                          FILE_DIRECTORY_FILE | FILE_SYNCHRONOUS_IO_NONALERT,
+                          NULL,
+                          0);
+    if (!NT_SUCCESS(Status))
+    {
+        /* Most likely booting from read-only media, stop tracing for good */
+        DPRINT1("CCPF: Cannot create the prefetch directory, Status 0x%lx\n", Status);
+        CcPfEnablePrefetcher = FALSE;
+        return Status;
+    }
+    ZwClose(Handle);
+
+    Status = CcPfGetScenarioFileName(ScenarioId, Buffer, sizeof(Buffer));
+    if (!NT_SUCCESS(Status)) return Status;
+
+    RtlInitUnicodeString(&FileName, Buffer);
+    Status = ZwCreateFile(&Handle,
+                          FILE_WRITE_DATA | SYNCHRONIZE,
+                          &ObjectAttributes,
+                          &IoStatusBlock,
+                          NULL,
+                          FILE_ATTRIBUTE_NORMAL,
+                          0,
+                          FILE_OVERWRITE_IF,
+                          FILE_NON_DIRECTORY_FILE | FILE_SYNCHRONOUS_IO_NONALERT,
+                          NULL,
+                          0);
+    if (!NT_SUCCESS(Status)) return Status;
+
+    Status = ZwWriteFile(Handle,
+                         NULL,
+                         NULL,
+                         NULL,
+                         &IoStatusBlock,
+                         Scenario,
+                         Scenario->Size,
+                         NULL,
+                         NULL);
+
+    ZwClose(Handle);
+    return Status;
+}
+
+static
+NTSTATUS
+CcPfSaveTrace(IN PPFSN_TRACE_HEADER Trace)
+{
+    PPFSN_LOG_ENTRIES LogEntries = Trace->CurrentTraceBuffer;
+    PPF_SCENARIO_HEADER OldScenario = Trace->Scenario;
+    PPF_SCENARIO_HEADER Scenario = NULL;
+    PPF_SCENARIO_FILE OldFiles = NULL, Files;
+    PPF_SCENARIO_RUN OldRuns = NULL, Runs;
+    POBJECT_NAME_INFORMATION *NameInfos = NULL;
+    PUNICODE_STRING Names = NULL;
+    UNICODE_STRING Name;
+    PULONG FileMap = NULL;
+    PCCPF_RUN CcRuns = NULL;
+    ULONG NumOldFiles = 0, NumOldRuns = 0;
+    ULONG NumNames = 0, NumRuns = 0, NumFiles, NamesSize, Size;
+    ULONG i, j, Out, End;
+    PUCHAR NameBuffer;
+    NTSTATUS Status = STATUS_INSUFFICIENT_RESOURCES;
+    PAGED_CODE();
+
+    /* Merge with what we prefetched, those pages didn't miss this time */
+    if (OldScenario)
+    {
+        OldFiles = (PPF_SCENARIO_FILE)((PUCHAR)OldScenario + OldScenario->FileInfoOffset);
+        OldRuns = (PPF_SCENARIO_RUN)((PUCHAR)OldScenario + OldScenario->RunInfoOffset);
+        NumOldFiles = OldScenario->NumFiles;
+        NumOldRuns = OldScenario->NumRuns;
+    }
+
+    if (!LogEntries->NumEntries && !NumOldRuns) return STATUS_SUCCESS;
+
+    NameInfos = ExAllocatePoolWithTag(PagedPool,
+                                      (Trace->NumFiles + 1) * sizeof(POBJECT_NAME_INFORMATION),
+                                      TAG_PREFETCH);
+    if (NameInfos) RtlZeroMemory(NameInfos, (Trace->NumFiles + 1) * sizeof(POBJECT_NAME_INFORMATION));
+    Names = ExAllocatePoolWithTag(PagedPool,
+                                  (Trace->NumFiles + NumOldFiles + 1) * sizeof(UNICODE_STRING),
+                                  TAG_PREFETCH);
+    FileMap = ExAllocatePoolWithTag(PagedPool,
+                                    (Trace->NumFiles + NumOldFiles + 1) * sizeof(ULONG),
+                                    TAG_PREFETCH);
+    CcRuns = ExAllocatePoolWithTag(PagedPool,
+                                   (LogEntries->NumEntries + CCPF_MAX_SCENARIO_RUNS) * sizeof(CCPF_RUN),
+                                   TAG_PREFETCH);
+    if (!NameInfos || !Names || !FileMap || !CcRuns) goto Quickie;
+
+    /* Map the traced files and then the old ones to unique names */
+    for (i = 0; i < Trace->NumFiles; i++)
+    {
+        NameInfos[i] = CcPfQueryFileName(Trace->Files[i].FileObject);
+        FileMap[i] = NameInfos[i] ? CcPfAddFileName(Names, &NumNames, &NameInfos[i]->Name) :
+                                    MAXULONG;
+    }
+
+    for (i = 0; i < NumOldFiles; i++)
+    {
+        Name.Buffer = (PWCHAR)((PUCHAR)OldScenario +
+                               OldScenario->FileNameInfoOffset +
+                               OldFiles[i].FileNameOffset);
+        Name.Length = (USHORT)OldFiles[i].FileNameLength;
+        Name.MaximumLength = Name.Length;
+        FileMap[Trace->NumFiles + i] = CcPfAddFileName(Names, &NumNames, &Name);
+    }
+
+    /* New misses go first, so they survive the size limit */
+    for (i = 0; i < (ULONG)LogEntries->NumEntries; i++)
+    {
+        if (FileMap[LogEntries->Entries[i].FileKey] == MAXULONG) continue;
+        if (LogEntries->Entries[i].FileOffset >= MAXULONG / CCPF_PAGES_PER_VIEW) continue;
+
+        CcRuns[NumRuns].FileIndex = FileMap[LogEntries->Entries[i].FileKey];
+        CcRuns[NumRuns].StartPage = LogEntries->Entries[i].FileOffset * CCPF_PAGES_PER_VIEW;
+        CcRuns[NumRuns].NumPages = CCPF_PAGES_PER_VIEW;
+        NumRuns++;
+    }
+
+    for (i = 0; i < NumOldFiles; i++)
+    {
+        for (j = 0; j < OldFiles[i].NumRuns; j++)
+        {
+            if (NumRuns >= CCPF_MAX_SCENARIO_RUNS) break;
+
+            CcRuns[NumRuns].FileIndex = FileMap[Trace->NumFiles + i];
+            CcRuns[NumRuns].StartPage = OldRuns[OldFiles[i].FirstRun + j].StartPage;
+            CcRuns[NumRuns].NumPages = OldRuns[OldFiles[i].FirstRun + j].NumPages;
+            NumRuns++;
+        }
+    }
+
+    /* Sort by file and offset, then coalesce what overlaps or touches */
+    qsort(CcRuns, NumRuns, sizeof(CCPF_RUN), CcPfCompareRuns);
+    for (i = 0, Out = 0; i < NumRuns; i++)
+    {
+        if (Out &&
+            (CcRuns[Out - 1].FileIndex == CcRuns[i].FileIndex) &&
+            (CcRuns[i].StartPage - CcRuns[Out - 1].StartPage <= CcRuns[Out - 1].NumPages))
+        {
+            End = max(CcRuns[Out - 1].StartPage + CcRuns[Out - 1].NumPages,
+                      CcRuns[i].StartPage + CcRuns[i].NumPages);
+            CcRuns[Out - 1].NumPages = End - CcRuns[Out - 1].StartPage;
+            continue;
+        }
+
+        CcRuns[Out++] = CcRuns[i];
+    }
+    NumRuns = min(Out, CCPF_MAX_SCENARIO_RUNS);
+
+    /* Only files with runs make it to the scenario */
+    NumFiles = 0;
+    NamesSize = 0;
+    for (i = 0; i < NumRuns; i++)
+    {
+        if (!i || (CcRuns[i].FileIndex != CcRuns[i - 1].FileIndex))
+        {
+            NumFiles++;
+            NamesSize += Names[CcRuns[i].FileIndex].Length;
+        }
+    }
+
+    Size = sizeof(PF_SCENARIO_HEADER) +
+           NumFiles * sizeof(PF_SCENARIO_FILE) +
+           NumRuns * sizeof(PF_SCENARIO_RUN) +
+           NamesSize;
+    if (Size > CCPF_MAX_SCENARIO_SIZE)
+    {
+        Status = STATUS_BUFFER_OVERFLOW;
+        goto Quickie;
+    }
+
+    Scenario = ExAllocatePoolWithTag(PagedPool, Size, TAG_PREFETCH);
+    if (!Scenario) goto Quickie;
+
+    RtlZeroMemory(Scenario, sizeof(PF_SCENARIO_HEADER));
+    Scenario->Version = PF_SCENARIO_VERSION;
+    Scenario->MagicNumber = PF_SCENARIO_MAGIC;
+    Scenario->Size = Size;
+    Scenario->ScenarioId = Trace->ScenarioId;
+    Scenario->ScenarioType = Trace->ScenarioType;
+    Scenario->LaunchCount = OldScenario ? OldScenario->LaunchCount + 1 : 1;
+    Scenario->FileInfoOffset = sizeof(PF_SCENARIO_HEADER);
+    Scenario->NumFiles = NumFiles;
+    Scenario->RunInfoOffset = Scenario->FileInfoOffset + NumFiles * sizeof(PF_SCENARIO_FILE);
+    Scenario->NumRuns = NumRuns;
+    Scenario->FileNameInfoOffset = Scenario->RunInfoOffset + NumRuns * sizeof(PF_SCENARIO_RUN);
+    Scenario->FileNameInfoSize = NamesSize;
+
+    Files = (PPF_SCENARIO_FILE)((PUCHAR)Scenario + Scenario->FileInfoOffset);
+    Runs = (PPF_SCENARIO_RUN)((PUCHAR)Scenario + Scenario->RunInfoOffset);
+    NameBuffer = (PUCHAR)Scenario + Scenario->FileNameInfoOffset;
+
+    for (i = 0, j = 0, NamesSize = 0; i < NumRuns; i++)
+    {
+        if (!i || (CcRuns[i].FileIndex != CcRuns[i - 1].FileIndex))
+        {
+            /* Start a new file */
+            if (i) j++;
+            Files[j].FileNameOffset = NamesSize;
+            Files[j].FileNameLength = Names[CcRuns[i].FileIndex].Length;
+            Files[j].FirstRun = i;
+            Files[j].NumRuns = 0;
+            RtlCopyMemory(NameBuffer + NamesSize,
+                          Names[CcRuns[i].FileIndex].Buffer,
+                          Files[j].FileNameLength);
+            NamesSize += Files[j].FileNameLength;
+        }
+
+        Runs[i].StartPage = CcRuns[i].StartPage;
+        Runs[i].NumPages = CcRuns[i].NumPages;
+        Files[j].NumRuns++;
+    }
+
+    Status = CcPfWriteScenarioFile(&Trace->ScenarioId, Scenario);
+
+Quickie:
+    if (Scenario) ExFreePoolWithTag(Scenario, TAG_PREFETCH);
+    if (FileMap) ExFreePoolWithTag(FileMap, TAG_PREFETCH);
+    if (Names) ExFreePoolWithTag(Names, TAG_PREFETCH);
+    if (NameInfos)
+    {
+        for (i = 0; i < Trace->NumFiles; i++)
+        {
+            if (NameInfos[i]) ExFreePoolWithTag(NameInfos[i], TAG_PREFETCH);
+        }
+        ExFreePoolWithTag(NameInfos, TAG_PREFETCH);
+    }
+    if (CcRuns) ExFreePoolWithTag(CcRuns, TAG_PREFETCH);
+
+    return Status;
+}
+
+static
+VOID
+CcPfFreeTrace(IN PPFSN_TRACE_HEADER Trace)
+{
+    ULONG i;
+
+    for (i = 0; i < Trace->NumFiles; i++)
+    {
+        ObDereferenceObject(Trace->Files[i].FileObject);
+    }
+
+    if (Trace->Process) ObDereferenceObject(Trace->Process);
+    if (Trace->Scenario) ExFreePoolWithTag(Trace->Scenario, TAG_PREFETCH);
+    if (Trace->Files) ExFreePoolWithTag(Trace->Files, TAG_PREFETCH);
+    if (Trace->CurrentTraceBuffer) ExFreePoolWithTag(Trace->CurrentTraceBuffer, TAG_PREFETCH);
+    ExFreePoolWithTag(Trace, TAG_PREFETCH);
+}
+
+static
+VOID
+NTAPI
+CcPfEndTraceWorkerThreadRoutine(IN PVOID Parameter)
+{
+    PPFSN_TRACE_HEADER Trace = (PPFSN_TRACE_HEADER)Parameter;
+    KIRQL OldIrql;
+    PAGED_CODE();
+
+    /* Stop logging into this trace */
+    KeAcquireSpinLock(&CcPfGlobals.ActiveTracesLock, &OldIrql);
+    RemoveEntryList(&Trace->ActiveTracesLink);
+    if (CcPfGlobals.SystemWideTrace == Trace) CcPfGlobals.SystemWideTrace = NULL;
+    KeReleaseSpinLock(&CcPfGlobals.ActiveTracesLock, OldIrql);
+
+    /* And make sure the timer DPC is done with it */
+    KeCancelTimer(&Trace->TraceTimer);
+    KeFlushQueuedDpcs();
+
+    Trace->TraceDumpStatus = CcPfSaveTrace(Trace);
+    if (!NT_SUCCESS(Trace->TraceDumpStatus))
+    {
+        DPRINT1("CCPF: Failed to save scenario %S, Status 0x%lx\n",
+                Trace->ScenarioId.ScenName, Trace->TraceDumpStatus);
+    }
+
+    CcPfFreeTrace(Trace);
+    InterlockedDecrement(&CcPfGlobals.NumActiveTraces);
+}
+
+static
+VOID
+CcPfBeginTrace(IN PPF_SCENARIO_ID ScenarioId,
+               IN PF_SCENARIO_TYPE ScenarioType,
+               IN PEPROCESS Process OPTIONAL,
+               IN PPF_SCENARIO_HEADER Scenario OPTIONAL)
+{
+    PPFSN_TRACE_HEADER Trace;
+    PPFSN_LOG_ENTRIES LogEntries;
+    ULONG MaxEntries, Period;
+    KIRQL OldIrql;
+
+    /* Don't let a burst of launches eat up nonpaged pool */
+    if (InterlockedIncrement(&CcPfGlobals.NumActiveTraces) > CCPF_MAX_ACTIVE_TRACES)
+    {
+        InterlockedDecrement(&CcPfGlobals.NumActiveTraces);
+        if (Scenario) ExFreePoolWithTag(Scenario, TAG_PREFETCH);
+        return;
+    }
+
+    if (ScenarioType == PfSystemBootScenarioType)
+    {
+        MaxEntries = CCPF_BOOT_MAX_ENTRIES;
+        Period = CCPF_BOOT_TRACE_PERIOD;
+    }
+    else
+    {
+        MaxEntries = CCPF_APP_MAX_ENTRIES;
+        Period = CCPF_APP_TRACE_PERIOD;
+    }
+
+    /* Everything we log into is touched at DISPATCH_LEVEL */
+    Trace = ExAllocatePoolWithTag(NonPagedPool, sizeof(PFSN_TRACE_HEADER), TAG_PREFETCH);
+    if (!Trace)
+    {
+        InterlockedDecrement(&CcPfGlobals.NumActiveTraces);
+        if (Scenario) ExFreePoolWithTag(Scenario, TAG_PREFETCH);
+        return;
+    }
+
+    RtlZeroMemory(Trace, sizeof(PFSN_TRACE_HEADER));
+    Trace->Scenario = Scenario;
+    Trace->Files = ExAllocatePoolWithTag(NonPagedPool,
+                                         CCPF_MAX_FILES * sizeof(PFSN_FILE_ENTRY),
+                                         TAG_PREFETCH);
+    LogEntries = ExAllocatePoolWithTag(NonPagedPool,
+                                       FIELD_OFFSET(PFSN_LOG_ENTRIES, Entries[MaxEntries]),
+                                       TAG_PREFETCH);
+    Trace->CurrentTraceBuffer = LogEntries;
+    if (!Trace->Files || !LogEntries)
+    {
+        CcPfFreeTrace(Trace);
+        InterlockedDecrement(&CcPfGlobals.NumActiveTraces);
+        return;
+    }
+
+    LogEntries->NumEntries = 0;
+    LogEntries->MaxEntries = MaxEntries;
+    InitializeListHead(&Trace->TraceBuffersList);
+    InsertTailList(&Trace->TraceBuffersList, &LogEntries->TraceBuffersLink);
+    Trace->NumTraceBuffers = 1;
+
+    Trace->Magic = CCPF_TRACE_MAGIC;
+    Trace->ScenarioId = *ScenarioId;
+    Trace->ScenarioType = ScenarioType;
+    Trace->MaxFaults = MaxEntries;
+    KeQuerySystemTime(&Trace->LaunchTime);
+    ExInitializeRundownProtection(&Trace->RefCount);
+    ExInitializeWorkItem(&Trace->EndTraceWorkItem,
+                         CcPfEndTraceWorkerThreadRoutine,
+                         Trace);
+    if (Process)
+    {
+        ObReferenceObject(Process);
+        Trace->Process = Process;
+    }
+
+    KeInitializeSpinLock(&Trace->TraceBufferSpinLock);
+    KeInitializeSpinLock(&Trace->TraceTimerSpinLock);
+    KeInitializeTimerEx(&Trace->TraceTimer, NotificationTimer);
+    KeInitializeDpc(&Trace->TraceTimerDpc, CcPfTraceTimerDpc, Trace);
+    Trace->TraceTimerPeriod.QuadPart = (LONGLONG)Period * -10000;
+
+    /* Start logging */
+    KeAcquireSpinLock(&CcPfGlobals.ActiveTracesLock, &OldIrql);
+    InsertTailList(&CcPfGlobals.ActiveTraces, &Trace->ActiveTracesLink);
+    if (!Process) CcPfGlobals.SystemWideTrace = Trace;
+    KeReleaseSpinLock(&CcPfGlobals.ActiveTracesLock, OldIrql);
+
+    KeSetTimerEx(&Trace->TraceTimer,
+                 Trace->TraceTimerPeriod,
+                 Period,
+                 &Trace->TraceTimerDpc);
+}
+
+static
+VOID
+CcPfRunScenario(IN PPF_SCENARIO_ID ScenarioId,
+                IN PF_SCENARIO_TYPE ScenarioType,
+                IN PEPROCESS Process OPTIONAL)
+{
+    PPF_SCENARIO_HEADER Scenario;
+    PAGED_CODE();
+
+    Scenario = CcPfLoadScenario(ScenarioId, ScenarioType);
+    if (Scenario && (Scenario->LaunchCount >= CCPF_RETRACE_LAUNCHES))
+    {
+        /*
+         * Merged scenarios never forget a page, so every now and then
+         * take a trace without prefetching to start over clean.
+         */
+        ExFreePoolWithTag(Scenario, TAG_PREFETCH);
+        Scenario = NULL;
+    }
+
+    /* Issue the reads for what we saw last time before the launch goes on */
+    if (Scenario) CcPfPrefetchScenario(Scenario);
+
+    /* And record this launch for the next one */
+    CcPfBeginTrace(ScenarioId, ScenarioType, Process, Scenario);
+}
+
+/* PUBLIC FUNCTIONS **********************************************************/
+
+VOID
+NTAPI
+INIT_FUNCTION
+CcPfInitializePrefetcher(VOID)
+{
+    RTL_QUERY_REGISTRY_TABLE QueryTable[2];
+
+    /* Notify debugger */
+    DbgPrintEx(DPFLTR_PREFETCHER_ID,
+               DPFLTR_TRACE_LEVEL,
+               "CCPF: InitializePrefetecher()\n");
+
+    /* Setup the Prefetcher Data */
+    InitializeListHead(&CcPfGlobals.ActiveTraces);
+    KeInitializeSpinLock(&CcPfGlobals.ActiveTracesLock);
+    InitializeListHead(&CcPfGlobals.CompletedTraces);
+    ExInitializeFastMutex(&CcPfGlobals.CompletedTracesLock);
+
+    /* Read which scenarios are enabled, by default all of them are */
+    RtlZeroMemory(QueryTable, sizeof(QueryTable));
+    QueryTable[0].Flags = RTL_QUERY_REGISTRY_DIRECT;
+    QueryTable[0].Name = L"EnablePrefetcher";
+    QueryTable[0].EntryContext = &CcPfEnableFlags;
+    RtlQueryRegistryValues(RTL_REGISTRY_CONTROL,
+                           L"Session Manager\\Memory Management\\PrefetchParameters",
+                           QueryTable,
+                           NULL,
+                           NULL);
+
+    CcPfEnablePrefetcher = (CcPfEnableFlags & (CCPF_ENABLE_APP_LAUNCH | CCPF_ENABLE_BOOT)) != 0;
+}
+
+VOID
+NTAPI
+CcPfBeginBootPhase(IN PF_BOOT_PHASE_ID Phase)
+{
+    PF_SCENARIO_ID ScenarioId;
+    PAGED_CODE();
+
+    /* Boot is prefetched and traced from the start of the session manager on */
+    if (Phase != PfSessionManagerInitPhase) return;
+    if (!CcPfEnablePrefetcher || !(CcPfEnableFlags & CCPF_ENABLE_BOOT)) return;
+
+    RtlZeroMemory(&ScenarioId, sizeof(ScenarioId));
+    RtlCopyMemory(ScenarioId.ScenName, L"NTOSBOOT", sizeof(L"NTOSBOOT"));
+    ScenarioId.HashId = 0xB00DFAAD;
+
+    CcPfRunScenario(&ScenarioId, PfSystemBootScenarioType, NULL);
+}
+
+VOID
+NTAPI
+CcPfBeginAppLaunch(IN PEPROCESS Process)
+{
+    POBJECT_NAME_INFORMATION ImageName;
+    PF_SCENARIO_ID ScenarioId;
+    ULONG i;
+    PAGED_CODE();
+
+    if (!CcPfEnablePrefetcher || !(CcPfEnableFlags & CCPF_ENABLE_APP_LAUNCH)) return;
+
+    /* The scenario is named after the image and identified by its full path */
+    ImageName = Process->SeAuditProcessCreationInfo.ImageFileName;
+    if (!ImageName || !ImageName->Name.Length) return;
+
+    RtlZeroMemory(&ScenarioId, sizeof(ScenarioId));
+    for (i = 0; (i < sizeof(Process->ImageFileName)) && Process->ImageFileName[i]; i++)
+    {
+        ScenarioId.ScenName[i] = RtlUpcaseUnicodeChar((UCHAR)Process->ImageFileName[i]);
+    }
+
+    if (!NT_SUCCESS(RtlHashUnicodeString(&ImageName->Name,
+                                         TRUE,
+                                         HASH_STRING_ALGORITHM_X65599,
+                                         &ScenarioId.HashId)))
+    {
+        return;
+    }
+
+    CcPfRunScenario(&ScenarioId, PfApplicationLaunchScenarioType, Process);
+}
+
+VOID
+NTAPI
+CcPfLogCacheRead(IN PFILE_OBJECT FileObject,
+                 IN LONGLONG FileOffset)
+{
+    PPFSN_TRACE_HEADER Trace;
+    PLIST_ENTRY ListEntry;
+    PEPROCESS Process;
+    KIRQL OldIrql;
+
+    /* This runs for every cache miss, so bail out early when not tracing */
+    if (!CcPfEnablePrefetcher || IsListEmpty(&CcPfGlobals.ActiveTraces)) return;
+
+    /* Stream files can't be opened again by name */
+    if (FileObject->Flags & (FO_STREAM_FILE | FO_DIRECT_DEVICE_OPEN)) return;
+
+    Process = PsGetCurrentProcess();
+    KeAcquireSpinLock(&CcPfGlobals.ActiveTracesLock, &OldIrql);
+    for (ListEntry = CcPfGlobals.ActiveTraces.Flink;
+         ListEntry != &CcPfGlobals.ActiveTraces;
+         ListEntry = ListEntry->Flink)
+    {
+        Trace = CONTAINING_RECORD(ListEntry, PFSN_TRACE_HEADER, ActiveTracesLink);
+        if ((Trace == CcPfGlobals.SystemWideTrace) || (Trace->Process == Process))
+        {
+            CcPfLogEntry(Trace, FileObject, FileOffset);
+        }
+    }
+    KeReleaseSpinLock(&CcPfGlobals.ActiveTracesLock, OldIrql);
+}
+
+/* EOF */
@@ -1781,6 +1781,7 @@ CmEnumerateKey(IN PCM_KEY_CONTROL_BLOCK Kcb,
     /* Now get the actual child node */
     Child = (PCM_KEY_NODE)HvGetCell(Hive, ChildCell);
     ASSERT(Child);
+    CmpPrepareMappedKeyNode(Hive, ChildCell, Child);
 
     /* Track references */
     if (!HvTrackCellRef(&CellReferences, Hive, ChildCell))
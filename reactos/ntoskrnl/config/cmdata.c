@@ -346,6 +346,14 @@ INIT_FUNCTION CM_SYSTEM_CONTROL_VECTOR CmControlVector[] =
         NULL
     },
 
+    {
+        L"Session Manager\\Memory Management",
+        L"ReadClusterSize",
+        &MmReadClusterSize,
+        NULL,
+        NULL
+    },
+
     {
         L"Session Manager\\Memory Management",
         L"SystemPages",
@@ -168,6 +168,13 @@ CmpInitializeHive(OUT PCMHIVE *CmHive,
     Hive->Flags = 0;
     Hive->FlushCount = 0;
 
+    /* Mapped hives bring their bins in through the view list */
+    if (OperationType == HINIT_MAPFILE)
+    {
+        Hive->Hive.GetCellRoutine = CmpGetMappedCell;
+        Hive->Hive.ReleaseCellRoutine = CmpReleaseMappedCell;
+    }
+
     /* Initialize it */
     Status = HvInitialize(&Hive->Hive,
                           OperationType,
@@ -185,6 +192,7 @@ CmpInitializeHive(OUT PCMHIVE *CmHive,
     if (!NT_SUCCESS(Status))
     {
         /* Cleanup allocations and fail */
+        CmpDestroyHiveViewList(Hive);
         ExDeleteResourceLite(Hive->FlusherLock);
         ExFreePoolWithTag(Hive->FlusherLock, TAG_CMHIVE);
         ExFreePoolWithTag(Hive->ViewLock, TAG_CMHIVE);
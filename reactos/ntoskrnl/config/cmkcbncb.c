@@ -676,6 +676,9 @@ CmpCreateKeyControlBlock(IN PHHIVE Hive,
     /* Check if this is a fake KCB */
     IsFake = Flags & CMP_CREATE_FAKE_KCB ? TRUE : FALSE;
 
+    /* Drop volatile subkeys left over from the last boot */
+    if ((Node) && !(IsFake)) CmpPrepareMappedKeyNode(Hive, Index, Node);
+
     /* If we have a parent, use its ConvKey */
     if (Parent) ConvKey = Parent->ConvKey;
 
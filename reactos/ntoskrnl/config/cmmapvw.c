@@ -14,8 +14,683 @@
 
 /* GLOBALS *******************************************************************/
 
+typedef struct _CM_VIEW_FREE_CELL
+{
+    ULONG Offset;
+    LONG Size;
+    HCELL_INDEX Next;
+} CM_VIEW_FREE_CELL, *PCM_VIEW_FREE_CELL;
+
 /* FUNCTIONS *****************************************************************/
 
+static
+VOID
+CmpLockHiveViews(IN PCMHIVE Hive)
+{
+    KeAcquireGuardedMutex(Hive->ViewLock);
+    Hive->ViewLockOwner = KeGetCurrentThread();
+}
+
+static
+VOID
+CmpUnlockHiveViews(IN PCMHIVE Hive)
+{
+    ASSERT(KeGetCurrentThread() == Hive->ViewLockOwner);
+    Hive->ViewLockOwner = NULL;
+    KeReleaseGuardedMutex(Hive->ViewLock);
+}
+
+static
+PVOID
+CmpReadHiveView(IN PCMHIVE Hive,
+                IN ULONG FileOffset,
+                IN ULONG Size)
+{
+    PVOID Buffer;
+    ULONG Offset;
+
+    /* Bins start after the base block */
+    Buffer = ExAllocatePoolWithTag(PagedPool, Size, TAG_CM);
+    if (!Buffer) return NULL;
+
+    Offset = HBLOCK_SIZE + FileOffset;
+    if (!Hive->Hive.FileRead(&Hive->Hive,
+                             HFILE_TYPE_PRIMARY,
+                             &Offset,
+                             Buffer,
+                             Size))
+    {
+        DPRINT1("Failed to read view at 0x%lx of hive %p\n", FileOffset, Hive);
+        ExFreePoolWithTag(Buffer, TAG_CM);
+        return NULL;
+    }
+
+    return Buffer;
+}
+
+static
+BOOLEAN
+CmpReadBinHeader(IN PCMHIVE Hive,
+                 IN ULONG Block,
+                 OUT PHBIN Bin)
+{
+    ULONG Offset;
+
+    Offset = HBLOCK_SIZE + Block * HBLOCK_SIZE;
+    if (!Hive->Hive.FileRead(&Hive->Hive,
+                             HFILE_TYPE_PRIMARY,
+                             &Offset,
+                             Bin,
+                             sizeof(HBIN)))
+    {
+        return FALSE;
+    }
+
+    if ((Bin->Signature != HV_BIN_SIGNATURE) ||
+        (Bin->FileOffset != Block * HBLOCK_SIZE) ||
+        !(Bin->Size) ||
+        (Bin->Size % HBLOCK_SIZE) ||
+        (Bin->Size / HBLOCK_SIZE > Hive->Hive.Storage[Stable].Length - Block))
+    {
+        DPRINT1("Invalid bin at 0x%lx, Signature 0x%x, Size 0x%x\n",
+                Block * HBLOCK_SIZE, Bin->Signature, Bin->Size);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static
+BOOLEAN
+CmpFindViewBin(IN PCMHIVE Hive,
+               IN ULONG Block,
+               OUT PULONG BinBlock)
+{
+    PHMAP_ENTRY BlockList;
+    HBIN Bin;
+    ULONG Start, End;
+
+    /*
+     * Views have to start with a bin, but the block can be anywhere in one.
+     * The first block of every bin we have seen holds its size, the headers
+     * of the bins in between are read once to fill in the gap.
+     */
+    for (;;)
+    {
+        CmpLockHiveViews(Hive);
+        BlockList = Hive->Hive.Storage[Stable].BlockList;
+        for (Start = Block; (Start) && !(BlockList[Start].MemAlloc); Start--);
+        End = Start + BlockList[Start].MemAlloc / HBLOCK_SIZE;
+        CmpUnlockHiveViews(Hive);
+
+        if (Block < End)
+        {
+            *BinBlock = Start;
+            return TRUE;
+        }
+
+        /* The file can't be read from inside the guarded region */
+        if (!CmpReadBinHeader(Hive, End, &Bin)) return FALSE;
+
+        CmpLockHiveViews(Hive);
+        Hive->Hive.Storage[Stable].BlockList[End].MemAlloc = Bin.Size;
+        CmpUnlockHiveViews(Hive);
+    }
+}
+
+static
+ULONG
+CmpGetViewBinsSize(IN PVOID Buffer,
+                   IN ULONG FileOffset,
+                   IN ULONG Size,
+                   OUT PULONG FirstBinSize)
+{
+    PHBIN Bin;
+    ULONG Offset = 0;
+
+    /* Only take bins that fit entirely in the view */
+    *FirstBinSize = 0;
+    while (Offset < Size)
+    {
+        Bin = (PHBIN)((ULONG_PTR)Buffer + Offset);
+        if ((Bin->Signature != HV_BIN_SIGNATURE) ||
+            (Bin->FileOffset != FileOffset + Offset) ||
+            !(Bin->Size) ||
+            (Bin->Size % HBLOCK_SIZE))
+        {
+            DPRINT1("Invalid bin at 0x%lx, Signature 0x%x, Size 0x%x\n",
+                    FileOffset + Offset, Bin->Signature, Bin->Size);
+            return 0;
+        }
+
+        if (!Offset) *FirstBinSize = Bin->Size;
+        if (Offset + Bin->Size > Size) break;
+        Offset += Bin->Size;
+    }
+
+    return Offset;
+}
+
+static
+VOID
+CmpSetViewBlocks(IN PCMHIVE Hive,
+                 IN PCM_VIEW_OF_FILE CmView)
+{
+    PHMAP_ENTRY Entry;
+    PHBIN Bin;
+    ULONG Offset, i;
+
+    /* Point the blocks of every bin at the view */
+    for (Offset = 0; Offset < CmView->Size; Offset += Bin->Size)
+    {
+        Bin = (PHBIN)((ULONG_PTR)CmView->ViewAddress + Offset);
+        Entry = &Hive->Hive.Storage[Stable].BlockList[(CmView->FileOffset + Offset) / HBLOCK_SIZE];
+        Entry->MemAlloc = Bin->Size;
+        for (i = 0; i < Bin->Size / HBLOCK_SIZE; i++, Entry++)
+        {
+            Entry->BinAddress = (ULONG_PTR)Bin;
+            Entry->BlockAddress = (ULONG_PTR)Bin + i * HBLOCK_SIZE;
+            Entry->CmView = CmView;
+        }
+    }
+}
+
+static
+BOOLEAN
+CmpSaveViewFreeCells(IN PCM_VIEW_OF_FILE CmView)
+{
+    PCM_VIEW_FREE_CELL FreeCells;
+    PHCELL Cell;
+    PHBIN Bin;
+    ULONG Offset, CellOffset, Count = 0;
+
+    /*
+     * Free cells are linked through their data and get split and merged
+     * without marking the cells dirty, so the file doesn't have them.
+     */
+    for (Offset = 0; Offset < CmView->Size; Offset += Bin->Size)
+    {
+        Bin = (PHBIN)((ULONG_PTR)CmView->ViewAddress + Offset);
+        for (CellOffset = sizeof(HBIN); CellOffset < Bin->Size; CellOffset += abs(Cell->Size))
+        {
+            Cell = (PHCELL)((ULONG_PTR)Bin + CellOffset);
+            if (Cell->Size > 0) Count++;
+        }
+    }
+
+    CmView->FreeCells = NULL;
+    CmView->FreeCellCount = Count;
+    if (!Count) return TRUE;
+
+    FreeCells = ExAllocatePoolWithTag(PagedPool, Count * sizeof(CM_VIEW_FREE_CELL), TAG_CM);
+    if (!FreeCells)
+    {
+        CmView->FreeCellCount = 0;
+        return FALSE;
+    }
+
+    Count = 0;
+    for (Offset = 0; Offset < CmView->Size; Offset += Bin->Size)
+    {
+        Bin = (PHBIN)((ULONG_PTR)CmView->ViewAddress + Offset);
+        for (CellOffset = sizeof(HBIN); CellOffset < Bin->Size; CellOffset += abs(Cell->Size))
+        {
+            Cell = (PHCELL)((ULONG_PTR)Bin + CellOffset);
+            if (Cell->Size <= 0) continue;
+
+            FreeCells[Count].Offset = Offset + CellOffset;
+            FreeCells[Count].Size = Cell->Size;
+            FreeCells[Count].Next = *(PHCELL_INDEX)(Cell + 1);
+            Count++;
+        }
+    }
+
+    CmView->FreeCells = FreeCells;
+    return TRUE;
+}
+
+static
+VOID
+CmpRestoreViewFreeCells(IN PCM_VIEW_OF_FILE CmView)
+{
+    PCM_VIEW_FREE_CELL FreeCells = CmView->FreeCells;
+    PHCELL Cell;
+    ULONG i;
+
+    for (i = 0; i < CmView->FreeCellCount; i++)
+    {
+        Cell = (PHCELL)((ULONG_PTR)CmView->ViewAddress + FreeCells[i].Offset);
+        Cell->Size = FreeCells[i].Size;
+        *(PHCELL_INDEX)(Cell + 1) = FreeCells[i].Next;
+    }
+
+    if (FreeCells) ExFreePoolWithTag(FreeCells, TAG_CM);
+    CmView->FreeCells = NULL;
+    CmView->FreeCellCount = 0;
+}
+
+static
+BOOLEAN
+CmpIsViewDirty(IN PCMHIVE Hive,
+               IN PCM_VIEW_OF_FILE CmView)
+{
+    return !RtlAreBitsClear(&Hive->Hive.DirtyVector,
+                            CmView->FileOffset / HBLOCK_SIZE,
+                            CmView->Size / HBLOCK_SIZE);
+}
+
+static
+VOID
+CmpUnmapHiveView(IN PCMHIVE Hive,
+                 IN PCM_VIEW_OF_FILE CmView)
+{
+    PHMAP_ENTRY Entry;
+    ULONG i;
+
+    ASSERT(CmView->ViewAddress);
+    ASSERT(CmView->UseCount == 0);
+
+    /* The view stays around so that we can map it again */
+    Entry = &Hive->Hive.Storage[Stable].BlockList[CmView->FileOffset / HBLOCK_SIZE];
+    for (i = 0; i < CmView->Size / HBLOCK_SIZE; i++, Entry++)
+    {
+        Entry->BinAddress = 0;
+        Entry->BlockAddress = 0;
+    }
+
+    ExFreePoolWithTag(CmView->ViewAddress, TAG_CM);
+    CmView->ViewAddress = NULL;
+    Hive->MappedViews--;
+
+    /* Unmapped views live at the end of the LRU list */
+    RemoveEntryList(&CmView->LRUViewList);
+    InsertTailList(&Hive->LRUViewListHead, &CmView->LRUViewList);
+}
+
+static
+VOID
+CmpTrimHiveViews(IN PCMHIVE Hive)
+{
+    PCM_VIEW_OF_FILE CmView;
+    PLIST_ENTRY NextEntry;
+
+    /* Views that got flushed can be unmapped again */
+    NextEntry = Hive->PinViewListHead.Flink;
+    while (NextEntry != &Hive->PinViewListHead)
+    {
+        CmView = CONTAINING_RECORD(NextEntry, CM_VIEW_OF_FILE, PinViewList);
+        NextEntry = NextEntry->Flink;
+        if (CmpIsViewDirty(Hive, CmView)) continue;
+
+        RemoveEntryList(&CmView->PinViewList);
+        InitializeListHead(&CmView->PinViewList);
+        InsertHeadList(&Hive->LRUViewListHead, &CmView->LRUViewList);
+        Hive->PinnedViews--;
+        Hive->MappedViews++;
+    }
+
+    /* Unmap the least recently used views until there is room for another one */
+    NextEntry = Hive->LRUViewListHead.Blink;
+    while ((Hive->MappedViews >= CMP_MAX_HIVE_VIEWS) &&
+           (NextEntry != &Hive->LRUViewListHead))
+    {
+        CmView = CONTAINING_RECORD(NextEntry, CM_VIEW_OF_FILE, LRUViewList);
+        NextEntry = NextEntry->Blink;
+        if (!(CmView->ViewAddress) || (CmView->UseCount)) continue;
+
+        /* Dirty data must stay in memory until it has been written out */
+        if (CmpIsViewDirty(Hive, CmView))
+        {
+            RemoveEntryList(&CmView->LRUViewList);
+            InsertTailList(&Hive->PinViewListHead, &CmView->PinViewList);
+            Hive->MappedViews--;
+            Hive->PinnedViews++;
+            continue;
+        }
+
+        /* Without the free cells we would lose the free lists */
+        if (!CmpSaveViewFreeCells(CmView)) continue;
+        CmpUnmapHiveView(Hive, CmView);
+    }
+}
+
+static
+BOOLEAN
+CmpMapHiveView(IN PCMHIVE Hive,
+               IN ULONG Block)
+{
+    PCM_VIEW_OF_FILE CmView, NewView = NULL;
+    PHMAP_ENTRY Entry;
+    PVOID Buffer;
+    ULONG FileOffset, Size, BinsSize, FirstBinSize, BinBlock, i;
+    BOOLEAN Mapped;
+
+    /* Find out what to read */
+    CmpLockHiveViews(Hive);
+    CmView = Hive->Hive.Storage[Stable].BlockList[Block].CmView;
+    if (CmView)
+    {
+        FileOffset = CmView->FileOffset;
+        Size = CmView->Size;
+    }
+    CmpUnlockHiveViews(Hive);
+
+    if (!CmView)
+    {
+        /* First time the block is used, start a view with the bin holding it */
+        if (!CmpFindViewBin(Hive, Block, &BinBlock)) return FALSE;
+
+        CmpLockHiveViews(Hive);
+        Entry = &Hive->Hive.Storage[Stable].BlockList[BinBlock];
+        for (i = BinBlock; i < Hive->Hive.Storage[Stable].Length; i++, Entry++)
+        {
+            if ((Entry->CmView) || (Entry->BlockAddress)) break;
+            if ((i - BinBlock) * HBLOCK_SIZE == CM_VIEW_SIZE) break;
+        }
+        CmpUnlockHiveViews(Hive);
+
+        FileOffset = BinBlock * HBLOCK_SIZE;
+        Size = (i - BinBlock) * HBLOCK_SIZE;
+
+        /* Somebody else mapped the bin in the meantime */
+        if (!Size) return TRUE;
+    }
+
+    /* The file can't be read from inside the guarded region */
+    Buffer = CmpReadHiveView(Hive, FileOffset, Size);
+    if (!Buffer) return FALSE;
+
+    if (!CmView)
+    {
+        /* Cut the view at the last bin that fits */
+        BinsSize = CmpGetViewBinsSize(Buffer, FileOffset, Size, &FirstBinSize);
+        if (!FirstBinSize)
+        {
+            ExFreePoolWithTag(Buffer, TAG_CM);
+            return FALSE;
+        }
+
+        if (!BinsSize)
+        {
+            /* The bin is bigger than a view, it gets a view of its own */
+            ExFreePoolWithTag(Buffer, TAG_CM);
+            if (FileOffset + FirstBinSize > Hive->Hive.Storage[Stable].Length * HBLOCK_SIZE)
+                return FALSE;
+
+            Size = FirstBinSize;
+            Buffer = CmpReadHiveView(Hive, FileOffset, Size);
+            if (!Buffer) return FALSE;
+            if (CmpGetViewBinsSize(Buffer, FileOffset, Size, &FirstBinSize) != Size)
+            {
+                ExFreePoolWithTag(Buffer, TAG_CM);
+                return FALSE;
+            }
+        }
+        else
+        {
+            Size = BinsSize;
+        }
+
+        NewView = ExAllocatePoolWithTag(PagedPool, sizeof(CM_VIEW_OF_FILE), TAG_CM);
+        if (!NewView)
+        {
+            ExFreePoolWithTag(Buffer, TAG_CM);
+            return FALSE;
+        }
+    }
+
+    CmpLockHiveViews(Hive);
+    if (CmView)
+    {
+        Mapped = (CmView->ViewAddress != NULL);
+    }
+    else
+    {
+        /* A view may have been set up over some of our bins */
+        Entry = &Hive->Hive.Storage[Stable].BlockList[FileOffset / HBLOCK_SIZE];
+        for (i = 0; i < Size / HBLOCK_SIZE; i++, Entry++)
+        {
+            if (Entry->CmView) break;
+        }
+        Mapped = (i != Size / HBLOCK_SIZE);
+    }
+    if (Mapped)
+    {
+        /* Somebody else mapped it while we were reading, look again */
+        CmpUnlockHiveViews(Hive);
+        if (NewView) ExFreePoolWithTag(NewView, TAG_CM);
+        ExFreePoolWithTag(Buffer, TAG_CM);
+        return TRUE;
+    }
+
+    /* Make room for the view first, so that it doesn't get unmapped right away */
+    CmpTrimHiveViews(Hive);
+
+    if (NewView)
+    {
+        CmView = NewView;
+        RtlZeroMemory(CmView, sizeof(CM_VIEW_OF_FILE));
+        CmView->FileOffset = FileOffset;
+        CmView->Size = Size;
+        CmView->ViewAddress = Buffer;
+        InsertHeadList(&Hive->LRUViewListHead, &CmView->LRUViewList);
+    }
+    else
+    {
+        /* Put back what only the memory copy had */
+        CmView->ViewAddress = Buffer;
+        CmpRestoreViewFreeCells(CmView);
+        RemoveEntryList(&CmView->LRUViewList);
+        InsertHeadList(&Hive->LRUViewListHead, &CmView->LRUViewList);
+    }
+
+    InitializeListHead(&CmView->PinViewList);
+    Hive->MappedViews++;
+    CmpSetViewBlocks(Hive, CmView);
+    CmpUnlockHiveViews(Hive);
+    return TRUE;
+}
+
+struct _CELL_DATA*
+NTAPI
+CmpGetMappedCell(IN PHHIVE Hive,
+                 IN HCELL_INDEX Cell)
+{
+    PCMHIVE CmHive = (PCMHIVE)Hive;
+    PCM_VIEW_OF_FILE CmView;
+    PHMAP_ENTRY Entry;
+    ULONG Type, Block;
+    ULONG_PTR Address;
+
+    ASSERT(Cell != HCELL_NIL);
+    Type = HvGetCellType(Cell);
+    Block = HvGetCellBlock(Cell);
+    ASSERT(Block < Hive->Storage[Type].Length);
+
+    /* Volatile cells and bins added since the hive got loaded live in pool */
+    Entry = &Hive->Storage[Type].BlockList[Block];
+    if (!(Entry->CmView) && (Entry->BlockAddress))
+    {
+        return (struct _CELL_DATA*)(Entry->BlockAddress +
+                                    ((Cell & HCELL_OFFSET_MASK) >> HCELL_OFFSET_SHIFT) +
+                                    sizeof(HCELL));
+    }
+
+    ASSERT(Type == Stable);
+    for (;;)
+    {
+        CmpLockHiveViews(CmHive);
+        Entry = &Hive->Storage[Stable].BlockList[Block];
+        CmView = Entry->CmView;
+        if ((CmView) && (CmView->ViewAddress)) break;
+        CmpUnlockHiveViews(CmHive);
+
+        /* Bring the view in */
+        if (!CmpMapHiveView(CmHive, Block)) return NULL;
+    }
+
+    /* Reference the view, and keep the LRU order unless it's pinned */
+    CmView->UseCount++;
+    CmHive->UseCount++;
+    if (IsListEmpty(&CmView->PinViewList))
+    {
+        RemoveEntryList(&CmView->LRUViewList);
+        InsertHeadList(&CmHive->LRUViewListHead, &CmView->LRUViewList);
+    }
+
+    Address = Entry->BlockAddress +
+              ((Cell & HCELL_OFFSET_MASK) >> HCELL_OFFSET_SHIFT) +
+              sizeof(HCELL);
+    CmpUnlockHiveViews(CmHive);
+    return (struct _CELL_DATA*)Address;
+}
+
+VOID
+NTAPI
+CmpReleaseMappedCell(IN PHHIVE Hive,
+                     IN HCELL_INDEX Cell)
+{
+    PCMHIVE CmHive = (PCMHIVE)Hive;
+    PCM_VIEW_OF_FILE CmView;
+
+    ASSERT(Cell != HCELL_NIL);
+    if (HvGetCellType(Cell) != Stable) return;
+
+    /* Cells outside of views weren't referenced */
+    CmView = Hive->Storage[Stable].BlockList[HvGetCellBlock(Cell)].CmView;
+    if (!CmView) return;
+
+    CmpLockHiveViews(CmHive);
+    if (!CmView->UseCount)
+    {
+        /* The view could get unmapped while its cells are still in use */
+        DPRINT1("Unbalanced release of cell 0x%lx of hive %p\n", Cell, Hive);
+        CmpUnlockHiveViews(CmHive);
+        KeBugCheckEx(REGISTRY_ERROR, 12, 1, (ULONG_PTR)Hive, Cell);
+    }
+    CmView->UseCount--;
+    CmHive->UseCount--;
+    CmpUnlockHiveViews(CmHive);
+}
+
+static
+PVOID
+CmpGetVolatileCellData(IN PHHIVE Hive,
+                       IN HCELL_INDEX Cell,
+                       IN ULONG Size)
+{
+    PHMAP_ENTRY Entry;
+    PHCELL Header;
+    PHBIN Bin;
+
+    /* A stale index may point anywhere, only take whole allocated cells */
+    if ((Cell == HCELL_NIL) ||
+        (HvGetCellType(Cell) != Volatile) ||
+        (HvGetCellBlock(Cell) >= Hive->Storage[Volatile].Length))
+    {
+        return NULL;
+    }
+
+    Entry = &Hive->Storage[Volatile].BlockList[HvGetCellBlock(Cell)];
+    Bin = (PHBIN)Entry->BinAddress;
+    if (!Bin) return NULL;
+
+    Header = (PHCELL)(Entry->BlockAddress + ((Cell & HCELL_OFFSET_MASK) >> HCELL_OFFSET_SHIFT));
+    if (((ULONG_PTR)Header < (ULONG_PTR)Bin + sizeof(HBIN)) ||
+        ((ULONG_PTR)Header + sizeof(HCELL) + Size > (ULONG_PTR)Bin + Bin->Size) ||
+        (Header->Size >= 0) ||
+        ((ULONG)(-Header->Size) < sizeof(HCELL) + Size))
+    {
+        return NULL;
+    }
+
+    return Header + 1;
+}
+
+static
+BOOLEAN
+CmpIsVolatileListCurrent(IN PHHIVE Hive,
+                         IN HCELL_INDEX Cell,
+                         IN PCM_KEY_NODE Node)
+{
+    PCM_KEY_INDEX Index;
+    PCM_KEY_NODE SubKey;
+    HCELL_INDEX SubKeyCell;
+
+    if (!Node->SubKeyCounts[Volatile]) return FALSE;
+
+    Index = CmpGetVolatileCellData(Hive,
+                                   Node->SubKeyLists[Volatile],
+                                   FIELD_OFFSET(CM_KEY_FAST_INDEX, List[1]));
+    if (!(Index) || !(Index->Count)) return FALSE;
+
+    /* A root only points at leaves */
+    if (Index->Signature == CM_KEY_INDEX_ROOT)
+    {
+        Index = CmpGetVolatileCellData(Hive,
+                                       Index->List[0],
+                                       FIELD_OFFSET(CM_KEY_FAST_INDEX, List[1]));
+        if (!(Index) || !(Index->Count)) return FALSE;
+    }
+
+    if (Index->Signature == CM_KEY_INDEX_LEAF)
+    {
+        SubKeyCell = Index->List[0];
+    }
+    else if ((Index->Signature == CM_KEY_FAST_LEAF) ||
+             (Index->Signature == CM_KEY_HASH_LEAF))
+    {
+        SubKeyCell = ((PCM_KEY_FAST_INDEX)Index)->List[0].Cell;
+    }
+    else
+    {
+        return FALSE;
+    }
+
+    /* The volatile keys of this boot know their parent */
+    SubKey = CmpGetVolatileCellData(Hive, SubKeyCell, FIELD_OFFSET(CM_KEY_NODE, Name));
+    return (SubKey) &&
+           (SubKey->Signature == CM_KEY_NODE_SIGNATURE) &&
+           (SubKey->Parent == Cell);
+}
+
+VOID
+NTAPI
+CmpPrepareMappedKeyNode(IN PHHIVE Hive,
+                        IN HCELL_INDEX Cell,
+                        IN PCM_KEY_NODE Node)
+{
+    PCMHIVE CmHive = (PCMHIVE)Hive;
+
+    /*
+     * Volatile subkeys don't survive a reboot but the file still has the
+     * lists of the last one. Mapped hives aren't walked when loaded, so the
+     * key nodes drop them as they get opened. A list of this boot lives in
+     * volatile storage and its keys point back at the node.
+     */
+    if ((Hive->GetCellRoutine != CmpGetMappedCell) ||
+        (HvGetCellType(Cell) != Stable))
+    {
+        return;
+    }
+
+    if (!(Node->SubKeyCounts[Volatile]) &&
+        (Node->SubKeyLists[Volatile] == HCELL_NIL))
+    {
+        return;
+    }
+
+    CmpLockHiveViews(CmHive);
+    if (!CmpIsVolatileListCurrent(Hive, Cell, Node))
+    {
+        /* Write the node back, or reading its view in again brings the list back */
+        if (!Hive->ReadOnly) HvMarkCellDirty(Hive, Cell, FALSE);
+        Node->SubKeyLists[Volatile] = HCELL_NIL;
+        Node->SubKeyCounts[Volatile] = 0;
+    }
+    CmpUnlockHiveViews(CmHive);
+}
+
 VOID
 NTAPI
 CmpInitHiveViewList(IN PCMHIVE Hive)
@@ -47,9 +722,11 @@ CmpDestroyHiveViewList(IN PCMHIVE Hive)
 
         CmView = CONTAINING_RECORD(EntryList, CM_VIEW_OF_FILE, PinViewList);
 
-        /* FIXME: Unmap the view if it is mapped */
+        /* Pinned views are always mapped */
+        ASSERT(CmView->ViewAddress);
+        ExFreePoolWithTag(CmView->ViewAddress, TAG_CM);
 
-        ExFreePool(CmView);
+        ExFreePoolWithTag(CmView, TAG_CM);
 
         Hive->PinnedViews--;
     }
@@ -65,11 +742,15 @@ CmpDestroyHiveViewList(IN PCMHIVE Hive)
 
         CmView = CONTAINING_RECORD(EntryList, CM_VIEW_OF_FILE, LRUViewList);
 
-        /* FIXME: Unmap the view if it is mapped */
-
-        ExFreePool(CmView);
+        /* Unmap the view if it is mapped */
+        if (CmView->ViewAddress)
+        {
+            ExFreePoolWithTag(CmView->ViewAddress, TAG_CM);
+            Hive->MappedViews--;
+        }
+        if (CmView->FreeCells) ExFreePoolWithTag(CmView->FreeCells, TAG_CM);
 
-        Hive->MappedViews--;
+        ExFreePoolWithTag(CmView, TAG_CM);
     }
 
     /* The LRU View List should be empty */
@@ -983,39 +983,174 @@ CmpHandleExitNode(IN OUT PHHIVE *Hive,
     }
 }
 
+static
+BOOLEAN
+CmpCompareKcbName(IN PCM_KEY_CONTROL_BLOCK Kcb,
+                  IN PUNICODE_STRING Name)
+{
+    PCM_NAME_CONTROL_BLOCK Ncb = Kcb->NameBlock;
+    UNICODE_STRING NcbName;
+
+    /* Compressed names are stored one byte per character */
+    if (Ncb->Compressed)
+    {
+        return !CmpCompareCompressedName(Name, Ncb->Name, Ncb->NameLength);
+    }
+
+    /* Otherwise it's a plain Unicode name */
+    NcbName.Buffer = Ncb->Name;
+    NcbName.Length = NcbName.MaximumLength = Ncb->NameLength;
+    return RtlEqualUnicodeString(Name, &NcbName, TRUE);
+}
+
+static
+BOOLEAN
+CmpIsCachedKcbForPath(IN PCM_KEY_CONTROL_BLOCK ParseKcb,
+                      IN PCM_KEY_CONTROL_BLOCK Kcb,
+                      IN PCM_HASH_CACHE_STACK HashCacheStack,
+                      IN ULONG Depth)
+{
+    ULONG i;
+
+    /* It must be exactly that deep below the parse object */
+    if (Kcb->TotalLevels != ParseKcb->TotalLevels + Depth) return FALSE;
+
+    /* Leave deleted, fake and symlink keys to the slow path */
+    if ((Kcb->Delete) ||
+        (Kcb->ExtFlags & CM_KCB_KEY_NON_EXIST) ||
+        (Kcb->Flags & KEY_SYM_LINK))
+    {
+        return FALSE;
+    }
+
+    /* Don't hand out keys of a hive that is being unloaded */
+    if ((Kcb->KeyHive->HiveFlags & HIVE_IS_UNLOADING) &&
+        (((PCMHIVE)Kcb->KeyHive)->CreatorOwner != KeGetCurrentThread()))
+    {
+        return FALSE;
+    }
+
+    /* Hashes can collide, so walk back up to the parse object comparing names */
+    for (i = Depth; i > 0; i--)
+    {
+        if (!(Kcb) || !CmpCompareKcbName(Kcb, &HashCacheStack[i - 1].NameOfKey))
+        {
+            return FALSE;
+        }
+
+        Kcb = Kcb->ParentKcb;
+    }
+
+    return (Kcb == ParseKcb);
+}
+
 NTSTATUS
 NTAPI
 CmpBuildHashStackAndLookupCache(IN PCM_KEY_BODY ParseObject,
                                 IN OUT PCM_KEY_CONTROL_BLOCK *Kcb,
-                                IN PUNICODE_STRING Current,
+                                IN OUT PUNICODE_STRING Current,
                                 OUT PHHIVE *Hive,
                                 OUT HCELL_INDEX *Cell,
                                 OUT PULONG TotalRemainingSubkeys,
                                 OUT PULONG MatchRemainSubkeyLevel,
                                 OUT PULONG TotalSubkeys,
-                                OUT PULONG OuterStackArray,
+                                IN PCM_HASH_CACHE_STACK HashCacheStack,
                                 OUT PULONG *LockedKcbs)
 {
-    /* We don't lock anything for now */
+    PCM_KEY_CONTROL_BLOCK ParseKcb = *Kcb, FoundKcb = NULL, CachedKcb;
+    UNICODE_STRING RemainingName, NextName;
+    PCM_KEY_HASH HashEntry;
+    ULONG ConvKey, Count, Index, i, j;
+    ULONG_PTR Skipped;
+    BOOLEAN Last;
+    PWCHAR p;
+
+    /* KCB locks are only held while looking at the cache */
     *LockedKcbs = NULL;
 
-    /* Calculate hash values */
-    *TotalRemainingSubkeys = 0xBAADF00D;
+    /* Calculate the hash of every component, the same way KCBs are hashed */
+    RemainingName = *Current;
+    ConvKey = ParseKcb->ConvKey;
+    for (Count = 0; Count < CM_HASH_STACK_SIZE; Count++)
+    {
+        /* Stop at the end, or at anything the slow path should complain about */
+        if (!(CmpGetNextName(&RemainingName, &NextName, &Last)) ||
+            !(NextName.Length))
+        {
+            break;
+        }
+
+        p = NextName.Buffer;
+        for (j = 0; j < NextName.Length; j += sizeof(WCHAR))
+        {
+            ConvKey = 37 * ConvKey + RtlUpcaseUnicodeChar(*p);
+            p++;
+        }
+
+        HashCacheStack[Count].NameOfKey = NextName;
+        HashCacheStack[Count].ConvKey = ConvKey;
+        if (Last)
+        {
+            Count++;
+            break;
+        }
+    }
+    *TotalRemainingSubkeys = Count;
+    *TotalSubkeys = ParseKcb->TotalLevels + Count;
 
     /* Lock the registry */
     CmpLockRegistry();
 
-    /* Return hive and cell data */
-    *Hive = (*Kcb)->KeyHive;
-    *Cell = (*Kcb)->KeyCell;
+    /* Look for the deepest component which already has a KCB */
+    for (i = Count; i > 0; i--)
+    {
+        /* Only this bucket is locked, and only shared */
+        Index = GET_HASH_INDEX(HashCacheStack[i - 1].ConvKey);
+        CmpAcquireKcbLockSharedByIndex(Index);
 
-    /* Make sure it's not a dead KCB */
-    ASSERT((*Kcb)->RefCount > 0);
+        for (HashEntry = CmpCacheTable[Index].Entry;
+             HashEntry;
+             HashEntry = HashEntry->NextHash)
+        {
+            if (HashEntry->ConvKey != HashCacheStack[i - 1].ConvKey) continue;
 
-    /* Reference it */
-    (VOID)CmpReferenceKeyControlBlock(*Kcb);
+            CachedKcb = CONTAINING_RECORD(HashEntry, CM_KEY_CONTROL_BLOCK, KeyHash);
+            if (CmpIsCachedKcbForPath(ParseKcb, CachedKcb, HashCacheStack, i))
+            {
+                /* Reference it while the bucket is locked, this may take it out of delayed close */
+                if (CmpReferenceKeyControlBlock(CachedKcb)) FoundKcb = CachedKcb;
+                break;
+            }
+        }
+
+        CmpReleaseKcbLockByIndex(Index);
+        if (FoundKcb) break;
+    }
+    *MatchRemainSubkeyLevel = i;
+
+    if (FoundKcb)
+    {
+        /* Continue parsing after the last component we found */
+        NextName = HashCacheStack[i - 1].NameOfKey;
+        p = NextName.Buffer + (NextName.Length / sizeof(WCHAR));
+        Skipped = (ULONG_PTR)p - (ULONG_PTR)Current->Buffer;
+        Current->Buffer = p;
+        Current->Length -= (USHORT)Skipped;
+        Current->MaximumLength -= (USHORT)Skipped;
+        *Kcb = FoundKcb;
+    }
+    else
+    {
+        /* Make sure it's not a dead KCB */
+        ASSERT(ParseKcb->RefCount > 0);
+
+        /* Start from the parse object */
+        (VOID)CmpReferenceKeyControlBlock(ParseKcb);
+    }
 
-    /* Return success for now */
+    /* Return hive and cell data */
+    *Hive = (*Kcb)->KeyHive;
+    *Cell = (*Kcb)->KeyCell;
     return STATUS_SUCCESS;
 }
 
@@ -1042,6 +1177,7 @@ CmpParseKey(IN PVOID ParseObject,
     UNICODE_STRING Current, NextName;
     PCM_PARSE_CONTEXT ParseContext = Context;
     ULONG TotalRemainingSubkeys = 0, MatchRemainSubkeyLevel = 0, TotalSubkeys = 0;
+    CM_HASH_CACHE_STACK HashCacheStack[CM_HASH_STACK_SIZE];
     PULONG LockedKcbs = NULL;
     BOOLEAN Result, Last;
     PAGED_CODE();
@@ -1087,7 +1223,7 @@ CmpParseKey(IN PVOID ParseObject,
                                              &TotalRemainingSubkeys,
                                              &MatchRemainSubkeyLevel,
                                              &TotalSubkeys,
-                                             NULL,
+                                             HashCacheStack,
                                              &LockedKcbs);
 
     /* This is now the parent */
@@ -1096,8 +1232,8 @@ CmpParseKey(IN PVOID ParseObject,
     /* Sanity check */
     ASSERT(ParentKcb != NULL);
 
-    /* Check if everything was found cached */
-    if (!TotalRemainingSubkeys) ASSERTMSG("Caching not implemented", FALSE);
+    /* Everything that was found cached has been skipped in the name */
+    DPRINT("Found %lu of %lu components cached\n", MatchRemainSubkeyLevel, TotalRemainingSubkeys);
 
     /* Don't do anything if we're being deleted */
     if (Kcb->Delete)
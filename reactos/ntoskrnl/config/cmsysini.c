@@ -324,8 +324,8 @@ CmpInitHiveFromFile(IN PCUNICODE_STRING HiveName,
     }
     else
     {
-        /* Open it as a file */
-        Operation = HINIT_FILE;
+        /* Open it as a file, its bins get mapped on demand */
+        Operation = HINIT_MAPFILE;
         *New = FALSE;
     }
 
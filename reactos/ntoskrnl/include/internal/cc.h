@@ -41,6 +41,27 @@
 //
 extern ULONG CcRosTraceLevel;
 
+typedef enum _PF_SCENARIO_TYPE
+{
+    PfApplicationLaunchScenarioType,
+    PfSystemBootScenarioType,
+    PfMaxScenarioType
+} PF_SCENARIO_TYPE;
+
+typedef enum _PF_BOOT_PHASE_ID
+{
+    PfKernelInitPhase = 0,
+    PfBootDriverInitPhase = 90,
+    PfSystemDriverInitPhase = 120,
+    PfSessionManagerInitPhase = 150,
+    PfSMRegistryInitPhase = 180,
+    PfVideoInitPhase = 210,
+    PfPostVideoInitPhase = 240,
+    PfBootAcceptedRegistryInitPhase = 270,
+    PfUserShellReadyPhase = 300,
+    PfMaxBootPhaseId = 900
+} PF_BOOT_PHASE_ID;
+
 typedef struct _PF_SCENARIO_ID
 {
     WCHAR ScenName[30];
@@ -92,6 +113,49 @@ typedef struct _PF_TRACE_HEADER
     ULONGLONG Reserved[5];
 } PF_TRACE_HEADER, *PPF_TRACE_HEADER;
 
+//
+// Scenario file, as stored in %SystemRoot%\Prefetch. All offsets are
+// relative to the start of the file, file offsets in runs are in pages.
+//
+#define PF_SCENARIO_MAGIC                               'ACCS'
+#define PF_SCENARIO_VERSION                             1
+
+typedef struct _PF_SCENARIO_HEADER
+{
+    ULONG Version;
+    ULONG MagicNumber;
+    ULONG Size;
+    PF_SCENARIO_ID ScenarioId;
+    ULONG ScenarioType; // PF_SCENARIO_TYPE
+    ULONG LaunchCount;
+    ULONG FileInfoOffset;
+    ULONG NumFiles;
+    ULONG RunInfoOffset;
+    ULONG NumRuns;
+    ULONG FileNameInfoOffset;
+    ULONG FileNameInfoSize;
+} PF_SCENARIO_HEADER, *PPF_SCENARIO_HEADER;
+
+typedef struct _PF_SCENARIO_FILE
+{
+    ULONG FileNameOffset;
+    ULONG FileNameLength;
+    ULONG FirstRun;
+    ULONG NumRuns;
+} PF_SCENARIO_FILE, *PPF_SCENARIO_FILE;
+
+typedef struct _PF_SCENARIO_RUN
+{
+    ULONG StartPage;
+    ULONG NumPages;
+} PF_SCENARIO_RUN, *PPF_SCENARIO_RUN;
+
+typedef struct _PFSN_FILE_ENTRY
+{
+    PSECTION_OBJECT_POINTERS SectionObjectPointer;
+    PFILE_OBJECT FileObject;
+} PFSN_FILE_ENTRY, *PPFSN_FILE_ENTRY;
+
 typedef struct _PFSN_TRACE_DUMP
 {
     LIST_ENTRY CompletedTracesLink;
@@ -128,6 +192,10 @@ typedef struct _PFSN_TRACE_HEADER
     LARGE_INTEGER LaunchTime;
     PPF_SECTION_INFO SectionInfo;
     ULONG SectionInfoCount;
+    PPFSN_FILE_ENTRY Files;
+    ULONG NumFiles;
+    ULONG LastFileKey;
+    PPF_SCENARIO_HEADER Scenario;
 } PFSN_TRACE_HEADER, *PPFSN_TRACE_HEADER;
 
 typedef struct _PFSN_PREFETCHER_GLOBALS
@@ -140,6 +208,7 @@ typedef struct _PFSN_PREFETCHER_GLOBALS
     LONG NumCompletedTraces;
     PKEVENT CompletedTracesEvent;
     LONG ActivePrefetches;
+    LONG NumActiveTraces;
 } PFSN_PREFETCHER_GLOBALS, *PPFSN_PREFETCHER_GLOBALS;
 
 typedef struct _ROS_SHARED_CACHE_MAP
@@ -154,11 +223,23 @@ typedef struct _ROS_SHARED_CACHE_MAP
     PVOID LazyWriteContext;
     KSPIN_LOCK CacheMapLock;
     ULONG OpenCount;
+    /* Views handed out by CcMdlRead, protected by CacheMapLock */
+    LIST_ENTRY MdlViewListHead;
 #if DBG
     BOOLEAN Trace; /* enable extra trace output for this cache map and it's VACBs */
 #endif
 } ROS_SHARED_CACHE_MAP, *PROS_SHARED_CACHE_MAP;
 
+typedef struct _CC_MDL_VIEW
+{
+    /* Entry in the shared cache map's list of MDL views */
+    LIST_ENTRY MdlViewListEntry;
+    /* The MDL given to the caller, locking part of the view */
+    PMDL Mdl;
+    /* The view the MDL describes, kept mapped until the MDL is returned */
+    struct _ROS_VACB *Vacb;
+} CC_MDL_VIEW, *PCC_MDL_VIEW;
+
 typedef struct _ROS_VACB
 {
     /* Base address of the region where the view's data is mapped. */
@@ -209,6 +290,25 @@ CcPfInitializePrefetcher(
     VOID
 );
 
+VOID
+NTAPI
+CcPfBeginBootPhase(
+    IN PF_BOOT_PHASE_ID Phase
+);
+
+VOID
+NTAPI
+CcPfBeginAppLaunch(
+    IN PEPROCESS Process
+);
+
+VOID
+NTAPI
+CcPfLogCacheRead(
+    IN PFILE_OBJECT FileObject,
+    IN LONGLONG FileOffset
+);
+
 VOID
 NTAPI
 CcMdlReadComplete2(
@@ -84,6 +84,17 @@
 #define CMP_HASH_IRRATIONAL                             314159269
 #define CMP_HASH_PRIME                                  1000000007
 
+//
+// Number of path components CmpParseKey looks up in the KCB cache at once
+//
+#define CM_HASH_STACK_SIZE                              30
+
+//
+// Mapped Hive Views
+//
+#define CM_VIEW_SIZE                                    (256 * 1024)
+#define CMP_MAX_HIVE_VIEWS                              64
+
 //
 // CmpCreateKeyControlBlock Flags
 //
@@ -157,6 +168,15 @@ typedef struct _CM_KEY_HASH_TABLE_ENTRY
     PCM_KEY_HASH Entry;
 } CM_KEY_HASH_TABLE_ENTRY, *PCM_KEY_HASH_TABLE_ENTRY;
 
+//
+// Hash Stack Entry for a Path Component
+//
+typedef struct _CM_HASH_CACHE_STACK
+{
+    UNICODE_STRING NameOfKey;
+    ULONG ConvKey;
+} CM_HASH_CACHE_STACK, *PCM_HASH_CACHE_STACK;
+
 //
 // Name Hash
 //
@@ -558,6 +578,28 @@ CmpDestroyHiveViewList(
     IN PCMHIVE Hive
 );
 
+struct _CELL_DATA*
+NTAPI
+CmpGetMappedCell(
+    IN PHHIVE Hive,
+    IN HCELL_INDEX Cell
+);
+
+VOID
+NTAPI
+CmpReleaseMappedCell(
+    IN PHHIVE Hive,
+    IN HCELL_INDEX Cell
+);
+
+VOID
+NTAPI
+CmpPrepareMappedKeyNode(
+    IN PHHIVE Hive,
+    IN HCELL_INDEX Cell,
+    IN PCM_KEY_NODE Node
+);
+
 //
 // Security Cache Functions
 //
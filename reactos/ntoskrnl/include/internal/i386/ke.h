@@ -321,6 +321,13 @@ KiSetTebBase(PKPCR Pcr, PVOID TebAddress)
     Ke386SetGdtEntryBase(&Pcr->GDT[KGDT_R3_TEB / sizeof(KGDTENTRY)], TebAddress);
 }
 
+VOID
+FASTCALL
+KiXmmiZeroPages(
+    IN PVOID Address,
+    IN ULONG Size
+);
+
 VOID
 FASTCALL
 Ki386InitializeTss(
@@ -86,6 +86,11 @@
 //
 #define IOP_MAX_REPARSE_TRAVERSAL 0x20
 
+//
+// Max number of packets NtRemoveIoCompletionEx dequeues in one call
+//
+#define IOP_MAX_COMPLETION_BATCH 64
+
 //
 // Private flags for IoCreateFile / IoParseDevice
 //
@@ -1254,6 +1259,13 @@ IopDeleteIoCompletion(
     PVOID ObjectBody
 );
 
+VOID
+NTAPI
+IopGetCompletionPacketInformation(
+    IN PLIST_ENTRY ListEntry,
+    OUT PFILE_IO_COMPLETION_INFORMATION CompletionInfo
+);
+
 NTSTATUS
 NTAPI
 IoSetIoCompletion(
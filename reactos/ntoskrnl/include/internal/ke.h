@@ -638,6 +638,25 @@ KiInsertQueue(
     BOOLEAN Head
 );
 
+ULONG
+FASTCALL
+KiRemoveQueueEntries(
+    IN PKQUEUE Queue,
+    OUT PLIST_ENTRY *EntryArray,
+    IN ULONG Count
+);
+
+ULONG
+NTAPI
+KeRemoveQueueEx(
+    IN PKQUEUE Queue,
+    IN KPROCESSOR_MODE WaitMode,
+    IN BOOLEAN Alertable,
+    IN PLARGE_INTEGER Timeout OPTIONAL,
+    OUT PLIST_ENTRY *EntryArray,
+    IN ULONG Count
+);
+
 VOID
 NTAPI
 KiTimerExpiration(
@@ -799,6 +818,11 @@ FASTCALL
 KeZeroPages(IN PVOID Address,
             IN ULONG Size);
 
+VOID
+FASTCALL
+KeZeroPagesFromIdleThread(IN PVOID Address,
+                          IN ULONG Size);
+
 BOOLEAN
 FASTCALL
 KeInvalidAccessAllowed(IN PVOID TrapInformation OPTIONAL);
@@ -22,6 +22,11 @@ extern KMUTANT MmSystemLoadLock;
 
 extern ULONG MmNumberOfPagingFiles;
 
+extern ULONG MmReadClusterSize;
+extern ULONG MmSinglePageFaultCount;
+extern ULONG MmClusteredPageFaultCount;
+extern ULONG MmClusteredPagesRead;
+
 extern PVOID MmUnloadedDrivers;
 extern PVOID MmLastUnloadedDrivers;
 extern PVOID MmTriageActionTaken;
@@ -165,6 +170,7 @@ typedef struct _MM_SECTION_SEGMENT
     ULONG Flags;
     BOOLEAN WriteCopy;
 	BOOLEAN Locked;
+    ULONG ReadClusterSize;		/* extra pages read along with a faulting one */
 
 	struct
 	{
@@ -596,14 +602,38 @@ MmInitSystem(IN ULONG Phase,
 
 /* pagefile.c ****************************************************************/
 
+/* Largest run of swap pages transferred by a single paging I/O */
+#define MM_SWAP_CLUSTER_SIZE 16
+
 SWAPENTRY
 NTAPI
 MmAllocSwapPage(VOID);
 
+PFN_COUNT
+NTAPI
+MmAllocSwapPageRun(
+    _In_ PFN_COUNT Count,
+    _Out_writes_to_(Count, return) SWAPENTRY *SwapEntries
+);
+
 VOID
 NTAPI
 MmFreeSwapPage(SWAPENTRY Entry);
 
+VOID
+NTAPI
+MiGetPageFileLocation(
+    _In_ SWAPENTRY SwapEntry,
+    _Out_ PULONG PageFileIndex,
+    _Out_ PULONG_PTR PageFileOffset
+);
+
+VOID
+NTAPI
+MiReleasePageFileSpace(
+    _In_ MMPTE PteContents
+);
+
 VOID
 NTAPI
 MmInitPagingFile(VOID);
@@ -626,6 +656,22 @@ MmWriteToSwapPage(
     PFN_NUMBER Page
 );
 
+NTSTATUS
+NTAPI
+MmReadFromSwapPages(
+    _In_ SWAPENTRY SwapEntry,
+    _In_reads_(Count) PPFN_NUMBER Pages,
+    _In_ PFN_COUNT Count
+);
+
+NTSTATUS
+NTAPI
+MmWriteToSwapPages(
+    _In_ SWAPENTRY SwapEntry,
+    _In_reads_(Count) PPFN_NUMBER Pages,
+    _In_ PFN_COUNT Count
+);
+
 VOID
 NTAPI
 MmShowOutOfSpaceMessagePagingFile(VOID);
@@ -637,6 +683,14 @@ MiReadPageFile(
     _In_ ULONG PageFileIndex,
     _In_ ULONG_PTR PageFileOffset);
 
+NTSTATUS
+NTAPI
+MiReadPageFileRun(
+    _In_reads_(Count) PPFN_NUMBER Pages,
+    _In_ PFN_COUNT Count,
+    _In_ ULONG PageFileIndex,
+    _In_ ULONG_PTR PageFileOffset);
+
 /* process.c ****************************************************************/
 
 NTSTATUS
@@ -180,6 +180,12 @@ ObpDeleteEntryDirectory(
     IN POBP_LOOKUP_CONTEXT Context
 );
 
+VOID
+NTAPI
+ObpDeleteDirectory(
+    IN PVOID Object
+);
+
 BOOLEAN
 NTAPI
 ObpInsertEntryDirectory(
@@ -82,7 +82,7 @@ FASTCALL
 KeZeroPages(IN PVOID Address,
             IN ULONG Size)
 {
-    /* Not using XMMI in this routine */
+    /* Not using XMMI in this routine, the pages are about to be used */
     RtlZeroMemory(Address, Size);
 }
 
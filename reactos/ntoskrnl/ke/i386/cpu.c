@@ -1134,7 +1134,22 @@ FASTCALL
 KeZeroPages(IN PVOID Address,
             IN ULONG Size)
 {
-    /* Not using XMMI in this routine */
+    /* Not using XMMI in this routine, the pages are about to be used */
+    RtlZeroMemory(Address, Size);
+}
+
+VOID
+FASTCALL
+KeZeroPagesFromIdleThread(IN PVOID Address,
+                          IN ULONG Size)
+{
+    /* Bypass the caches with non-temporal stores when SSE2 is there */
+    if (KeFeatureBits & KF_XMMI64)
+    {
+        KiXmmiZeroPages(Address, Size);
+        return;
+    }
+
     RtlZeroMemory(Address, Size);
 }
 
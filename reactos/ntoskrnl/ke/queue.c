@@ -138,6 +138,49 @@ KiInsertQueue(IN PKQUEUE Queue,
     return InitialState;
 }
 
+/*
+ * Removes up to Count entries from the queue. The dispatcher lock must be
+ * held. Returns the number of entries removed.
+ */
+ULONG
+FASTCALL
+KiRemoveQueueEntries(IN PKQUEUE Queue,
+                     OUT PLIST_ENTRY *EntryArray,
+                     IN ULONG Count)
+{
+    PLIST_ENTRY QueueEntry;
+    ULONG EntryCount = 0;
+    ASSERT_QUEUE(Queue);
+
+    while ((EntryCount < Count) && !IsListEmpty(&Queue->EntryListHead))
+    {
+        /* Get the first entry and decrease the number of entries */
+        QueueEntry = Queue->EntryListHead.Flink;
+        Queue->Header.SignalState--;
+
+        /* Check if the entry is valid. If not, bugcheck */
+        if (!(QueueEntry->Flink) || !(QueueEntry->Blink))
+        {
+            /* Invalid item */
+            KeBugCheckEx(INVALID_WORK_QUEUE_ITEM,
+                         (ULONG_PTR)QueueEntry,
+                         (ULONG_PTR)Queue,
+                         (ULONG_PTR)NULL,
+                         (ULONG_PTR)((PWORK_QUEUE_ITEM)QueueEntry)->
+                                     WorkerRoutine);
+        }
+
+        /* Remove the Entry */
+        RemoveEntryList(QueueEntry);
+        QueueEntry->Flink = NULL;
+
+        /* Return it */
+        EntryArray[EntryCount++] = QueueEntry;
+    }
+
+    return EntryCount;
+}
+
 /* PUBLIC FUNCTIONS **********************************************************/
 
 /*
@@ -240,6 +283,28 @@ KeRemoveQueue(IN PKQUEUE Queue,
               IN PLARGE_INTEGER Timeout OPTIONAL)
 {
     PLIST_ENTRY QueueEntry;
+
+    /* Remove a single entry, without an alertable wait */
+    KeRemoveQueueEx(Queue, WaitMode, FALSE, Timeout, &QueueEntry, 1);
+    return QueueEntry;
+}
+
+/*
+ * @implemented
+ *
+ * Returns the number of entries written to EntryArray. If the wait ended
+ * without an entry, the first element holds the wait status instead.
+ */
+ULONG
+NTAPI
+KeRemoveQueueEx(IN PKQUEUE Queue,
+                IN KPROCESSOR_MODE WaitMode,
+                IN BOOLEAN Alertable,
+                IN PLARGE_INTEGER Timeout OPTIONAL,
+                OUT PLIST_ENTRY *EntryArray,
+                IN ULONG Count)
+{
+    PLIST_ENTRY QueueEntry;
     LONG_PTR Status;
     PKTHREAD Thread = KeGetCurrentThread();
     PKQUEUE PreviousQueue;
@@ -250,8 +315,11 @@ KeRemoveQueue(IN PKQUEUE Queue,
     PLARGE_INTEGER OriginalDueTime = Timeout;
     LARGE_INTEGER DueTime = {{0}}, NewDueTime, InterruptTime;
     ULONG Hand = 0;
+    ULONG EntryCount;
+    KIRQL OldIrql;
     ASSERT_QUEUE(Queue);
     ASSERT_IRQL_LESS_OR_EQUAL(DISPATCH_LEVEL);
+    ASSERT(Count != 0);
 
     /* Check if the Lock is already held */
     if (Thread->WaitNext)
@@ -306,27 +374,11 @@ KeRemoveQueue(IN PKQUEUE Queue,
         if ((Queue->CurrentCount < Queue->MaximumCount) &&
             (QueueEntry != &Queue->EntryListHead))
         {
-            /* Decrease the number of entries */
-            Queue->Header.SignalState--;
-
             /* Increase numbef of running threads */
             Queue->CurrentCount++;
 
-            /* Check if the entry is valid. If not, bugcheck */
-            if (!(QueueEntry->Flink) || !(QueueEntry->Blink))
-            {
-                /* Invalid item */
-                KeBugCheckEx(INVALID_WORK_QUEUE_ITEM,
-                             (ULONG_PTR)QueueEntry,
-                             (ULONG_PTR)Queue,
-                             (ULONG_PTR)NULL,
-                             (ULONG_PTR)((PWORK_QUEUE_ITEM)QueueEntry)->
-                                         WorkerRoutine);
-            }
-
-            /* Remove the Entry */
-            RemoveEntryList(QueueEntry);
-            QueueEntry->Flink = NULL;
+            /* Take as many entries as the caller asked for */
+            EntryCount = KiRemoveQueueEntries(Queue, EntryArray, Count);
 
             /* Nothing to wait on */
             break;
@@ -344,12 +396,13 @@ KeRemoveQueue(IN PKQUEUE Queue,
             }
             else
             {
-                /* Fail if there's a User APC Pending */
-                if ((WaitMode != KernelMode) &&
-                    (Thread->ApcState.UserApcPending))
+                /* Fail if we were alerted or there's a User APC Pending */
+                Status = KiCheckAlertability(Thread, Alertable, WaitMode);
+                if (Status != STATUS_WAIT_0)
                 {
                     /* Return the status and increase the pending threads */
-                    QueueEntry = (PLIST_ENTRY)STATUS_USER_APC;
+                    EntryArray[0] = (PLIST_ENTRY)Status;
+                    EntryCount = 1;
                     Queue->CurrentCount++;
                     break;
                 }
@@ -362,7 +415,8 @@ KeRemoveQueue(IN PKQUEUE Queue,
                     if ((ULONG64)InterruptTime.QuadPart >= Timer->DueTime.QuadPart)
                     {
                         /* It did, so we don't need to wait */
-                        QueueEntry = (PLIST_ENTRY)STATUS_TIMEOUT;
+                        EntryArray[0] = (PLIST_ENTRY)STATUS_TIMEOUT;
+                        EntryCount = 1;
                         Queue->CurrentCount++;
                         break;
                     }
@@ -404,7 +458,31 @@ KeRemoveQueue(IN PKQUEUE Queue,
                 Thread->WaitReason = 0;
 
                 /* Check if we were executing an APC */
-                if (Status != STATUS_KERNEL_APC) return (PLIST_ENTRY)Status;
+                if (Status != STATUS_KERNEL_APC)
+                {
+                    /* We got either an entry or the wait status */
+                    EntryArray[0] = (PLIST_ENTRY)Status;
+                    EntryCount = 1;
+
+                    /*
+                     * The entry was handed to us by the inserting thread,
+                     * also pick up whatever got queued behind it.
+                     */
+                    if ((Count > 1) &&
+                        (Status != STATUS_TIMEOUT) &&
+                        (Status != STATUS_USER_APC) &&
+                        (Status != STATUS_ALERTED) &&
+                        !IsListEmpty(&Queue->EntryListHead))
+                    {
+                        OldIrql = KiAcquireDispatcherLock();
+                        EntryCount += KiRemoveQueueEntries(Queue,
+                                                           &EntryArray[1],
+                                                           Count - 1);
+                        KiReleaseDispatcherLock(OldIrql);
+                    }
+
+                    return EntryCount;
+                }
 
                 /* Check if we had a timeout */
                 if (Timeout)
@@ -427,7 +505,7 @@ KeRemoveQueue(IN PKQUEUE Queue,
     /* Unlock Database and return */
     KiReleaseDispatcherLockFromDpcLevel();
     KiExitDispatcher(Thread->WaitIrql);
-    return QueueEntry;
+    return EntryCount;
 }
 
 /*
@@ -595,7 +595,7 @@ NtReplyWaitReceivePortEx(IN HANDLE PortHandle,
     }
 
     /* Now wait for someone to reply to us */
-    LpcpReceiveWait(ReceivePort->MsgQueue.Semaphore, WaitMode);
+    LpcpReceiveWait(ReceivePort->MsgQueue.Semaphore, WaitMode, Timeout);
     if (Status != STATUS_SUCCESS) goto Cleanup;
 
     /* Wait done, get the LPC lock */
@@ -610,8 +610,14 @@ extern PMMPDE MiHighestUserPde;
 extern PFN_NUMBER MmSystemPageDirectory[PD_COUNT];
 extern PMMPTE MmSharedUserDataPte;
 extern LIST_ENTRY MmProcessList;
-extern BOOLEAN MmZeroingPageThreadActive;
+extern ULONG MmZeroingPageThreadActive;
 extern KEVENT MmZeroingPageEvent;
+extern PFN_NUMBER MmZeroedPageTarget;
+extern KEVENT MmModifiedPageWriterEvent;
+extern KEVENT MpwThreadEvent;
+extern PFN_NUMBER MmModifiedPageMaximum;
+extern PFN_NUMBER MmModifiedPageMinimum;
+extern MMPFNLIST MmModifiedPageListByColor[1];
 extern ULONG MmSystemPageColor;
 extern ULONG MmProcessColorSeed;
 extern PMMWSL MmWorkingSetList;
@@ -1953,6 +1959,12 @@ MiZeroPhysicalPage(
     IN PFN_NUMBER PageFrameIndex
 );
 
+NTSTATUS
+NTAPI
+MiInitializeModifiedPageWriters(
+    VOID
+);
+
 VOID
 NTAPI
 MiInsertPageInFreeList(
@@ -0,0 +1,262 @@
+/*
+ * PROJECT:         ReactOS Kernel
+ * LICENSE:         BSD - See COPYING.ARM in the top level directory
+ * FILE:            ntoskrnl/mm/ARM3/modwrite.c
+ * PURPOSE:         ARM Memory Manager Modified and Mapped Page Writers
+ * PROGRAMMERS:     ReactOS Portable Systems Group
+ */
+
+/* INCLUDES *******************************************************************/
+
+#include <ntoskrnl.h>
+#define NDEBUG
+#include <debug.h>
+
+#define MODULE_INVOLVED_IN_ARM3
+#include <mm/ARM3/miarm.h>
+
+/* GLOBALS ********************************************************************/
+
+KEVENT MmModifiedPageWriterEvent;
+KEVENT MpwThreadEvent;
+
+/* Writing starts when the modified list reaches the maximum and stops at the minimum */
+PFN_NUMBER MmModifiedPageMaximum;
+PFN_NUMBER MmModifiedPageMinimum;
+
+/* Statistics */
+ULONG MiModifiedWriteIoCount;
+ULONG MiModifiedPagesWritten;
+
+/* PRIVATE FUNCTIONS **********************************************************/
+
+static
+BOOLEAN
+MiModifiedPageWriterShouldRun(VOID)
+{
+    /* Nothing to write */
+    if (!MmModifiedPageListHead.Total) return FALSE;
+
+    /* Write until the low mark, or everything if memory is getting short */
+    return ((MmModifiedPageListHead.Total > MmModifiedPageMinimum) ||
+            (MmAvailablePages < MmMinimumFreePages * 2));
+}
+
+static
+BOOLEAN
+MiWriteModifiedPageCluster(VOID)
+{
+    PFN_NUMBER Pages[MM_SWAP_CLUSTER_SIZE];
+    SWAPENTRY SwapEntries[MM_SWAP_CLUSTER_SIZE];
+    PFN_NUMBER PageFrameIndex;
+    PFN_COUNT Count, Reserved, i;
+    ULONG PageFileIndex;
+    ULONG_PTR PageFileOffset;
+    PMMPFN Pfn1;
+    KIRQL OldIrql;
+    NTSTATUS Status;
+
+    /* Reserve contiguous paging file space for the cluster before touching the list */
+    Count = (PFN_COUNT)min(MmModifiedPageListHead.Total, MM_SWAP_CLUSTER_SIZE);
+    if (!Count) return FALSE;
+    Reserved = MmAllocSwapPageRun(Count, SwapEntries);
+    if (!Reserved)
+    {
+        /* No paging file, or no space left in it */
+        MmShowOutOfSpaceMessagePagingFile();
+        return FALSE;
+    }
+
+    /* Take the oldest pages off the modified list */
+    OldIrql = KeAcquireQueuedSpinLock(LockQueuePfnLock);
+    for (Count = 0; Count < Reserved; Count++)
+    {
+        PageFrameIndex = MmModifiedPageListByColor[0].Flink;
+        if (PageFrameIndex == LIST_HEAD) break;
+
+        Pfn1 = MI_PFN_ELEMENT(PageFrameIndex);
+        ASSERT(Pfn1->u3.e1.PrototypePte == 1);
+        ASSERT(Pfn1->u3.e2.ReferenceCount == 0);
+        ASSERT(Pfn1->OriginalPte.u.Soft.PageFileHigh == 0);
+
+        /* Hold a reference for the duration of the write */
+        MiUnlinkPageFromList(Pfn1);
+        Pfn1->u3.e2.ReferenceCount = 1;
+        Pfn1->u3.e1.PageLocation = TransitionPage;
+        Pfn1->u3.e1.WriteInProgress = 1;
+        Pfn1->u1.Event = NULL;
+
+        /* Anybody writing to the page from now on makes our copy stale */
+        Pfn1->u3.e1.Modified = 0;
+
+        Pages[Count] = PageFrameIndex;
+    }
+    KeReleaseQueuedSpinLock(LockQueuePfnLock, OldIrql);
+
+    /* Give back the space we could not use */
+    for (i = Count; i < Reserved; i++) MmFreeSwapPage(SwapEntries[i]);
+    if (!Count) return FALSE;
+
+    /* The entries are contiguous, so this is a single I/O unless the file is fragmented */
+    Status = MmWriteToSwapPages(SwapEntries[0], Pages, Count);
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("Failed to write %lu modified pages: %lx\n", Count, Status);
+    }
+
+    OldIrql = KeAcquireQueuedSpinLock(LockQueuePfnLock);
+    for (i = 0; i < Count; i++)
+    {
+        Pfn1 = MI_PFN_ELEMENT(Pages[i]);
+        ASSERT(Pfn1->u3.e1.WriteInProgress == 1);
+        Pfn1->u3.e1.WriteInProgress = 0;
+
+        /* Wake up whoever faulted on the page in the meantime */
+        if (Pfn1->u1.Event)
+        {
+            KeSetEvent(Pfn1->u1.Event, IO_NO_INCREMENT, FALSE);
+            Pfn1->u1.Event = NULL;
+        }
+
+        if (NT_SUCCESS(Status) &&
+            !(Pfn1->u3.e1.Modified) &&
+            !(MI_IS_PFN_DELETED(Pfn1)))
+        {
+            /* The paging file has a good copy, remember where it is */
+            MiGetPageFileLocation(SwapEntries[i], &PageFileIndex, &PageFileOffset);
+            Pfn1->OriginalPte.u.Soft.PageFileLow = PageFileIndex;
+            Pfn1->OriginalPte.u.Soft.PageFileHigh = PageFileOffset;
+        }
+        else
+        {
+            /* The page is gone or dirty again, the copy is useless */
+            MmFreeSwapPage(SwapEntries[i]);
+            if (!MI_IS_PFN_DELETED(Pfn1)) Pfn1->u3.e1.Modified = 1;
+        }
+
+        /* Drop our reference, clean pages go to the standby list */
+        MiDecrementReferenceCount(Pfn1, Pages[i]);
+    }
+    KeReleaseQueuedSpinLock(LockQueuePfnLock, OldIrql);
+
+    MiModifiedWriteIoCount++;
+    if (NT_SUCCESS(Status)) MiModifiedPagesWritten += Count;
+
+    return NT_SUCCESS(Status);
+}
+
+VOID
+NTAPI
+MiModifiedPageWriter(IN PVOID StartContext)
+{
+    UNREFERENCED_PARAMETER(StartContext);
+
+    /* Run above normal threads so that writing keeps up with the faults */
+    KeSetPriorityThread(KeGetCurrentThread(), LOW_REALTIME_PRIORITY + 1);
+
+    for (;;)
+    {
+        KeWaitForSingleObject(&MmModifiedPageWriterEvent,
+                              WrFreePage,
+                              KernelMode,
+                              FALSE,
+                              NULL);
+
+        /* Write clusters until the list is short enough, or we can't make progress */
+        while (MiModifiedPageWriterShouldRun())
+        {
+            if (!MiWriteModifiedPageCluster()) break;
+        }
+    }
+}
+
+VOID
+NTAPI
+MiMappedPageWriter(IN PVOID StartContext)
+{
+    NTSTATUS Status;
+#ifndef NEWCC
+    ULONG PagesWritten;
+#endif
+    LARGE_INTEGER Timeout;
+
+    UNREFERENCED_PARAMETER(StartContext);
+
+    KeSetPriorityThread(KeGetCurrentThread(), LOW_REALTIME_PRIORITY + 1);
+
+    Timeout.QuadPart = -50000000;
+
+    for (;;)
+    {
+        Status = KeWaitForSingleObject(&MpwThreadEvent,
+                                       WrFreePage,
+                                       KernelMode,
+                                       FALSE,
+                                       &Timeout);
+        if (!NT_SUCCESS(Status))
+        {
+            DbgPrint("MpwThread: Wait failed\n");
+            KeBugCheck(MEMORY_MANAGEMENT);
+            return;
+        }
+
+#ifndef NEWCC
+        /*
+         * Mapped file data lives in the cache views. Write back their dirty
+         * pages periodically, and keep going while we were woken up because
+         * memory is short.
+         */
+        do
+        {
+            PagesWritten = 0;
+            CcRosFlushDirtyPages(128, &PagesWritten, FALSE);
+        } while ((Status == STATUS_SUCCESS) &&
+                 (PagesWritten != 0) &&
+                 (MmAvailablePages < MmMinimumFreePages * 2));
+#endif
+    }
+}
+
+/* PUBLIC FUNCTIONS ***********************************************************/
+
+NTSTATUS
+NTAPI
+INIT_FUNCTION
+MiInitializeModifiedPageWriters(VOID)
+{
+    HANDLE ThreadHandle;
+    NTSTATUS Status;
+
+    KeInitializeEvent(&MmModifiedPageWriterEvent, SynchronizationEvent, FALSE);
+    KeInitializeEvent(&MpwThreadEvent, SynchronizationEvent, FALSE);
+
+    /* Let the modified list grow to 1/64th of memory, within sane bounds */
+    MmModifiedPageMaximum = MmNumberOfPhysicalPages / 64;
+    if (MmModifiedPageMaximum < 64) MmModifiedPageMaximum = 64;
+    if (MmModifiedPageMaximum > 1024) MmModifiedPageMaximum = 1024;
+    MmModifiedPageMinimum = MmModifiedPageMaximum / 2;
+
+    Status = PsCreateSystemThread(&ThreadHandle,
+                                  THREAD_ALL_ACCESS,
+                                  NULL,
+                                  NULL,
+                                  NULL,
+                                  MiModifiedPageWriter,
+                                  NULL);
+    if (!NT_SUCCESS(Status)) return Status;
+    ZwClose(ThreadHandle);
+
+    Status = PsCreateSystemThread(&ThreadHandle,
+                                  THREAD_ALL_ACCESS,
+                                  NULL,
+                                  NULL,
+                                  NULL,
+                                  MiMappedPageWriter,
+                                  NULL);
+    if (!NT_SUCCESS(Status)) return Status;
+    ZwClose(ThreadHandle);
+
+    return STATUS_SUCCESS;
+}
+
+/* EOF */
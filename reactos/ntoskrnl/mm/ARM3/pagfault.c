@@ -22,6 +22,11 @@
 BOOLEAN UserPdeFault = FALSE;
 #endif
 
+/* Hard fault statistics */
+ULONG MmSinglePageFaultCount;
+ULONG MmClusteredPageFaultCount;
+ULONG MmClusteredPagesRead;
+
 /* PRIVATE FUNCTIONS **********************************************************/
 
 NTSTATUS
@@ -888,7 +893,6 @@ MiResolvePageFileFault(_In_ BOOLEAN StoreInstruction,
     ULONG Protection = TempPte.u.Soft.Protection;
 
     /* Things we don't support yet */
-    ASSERT(CurrentProcess > HYDRA_PROCESS);
     ASSERT(*OldIrql != MM_NOIRQL);
 
     /* We must hold the PFN lock */
@@ -900,7 +904,10 @@ MiResolvePageFileFault(_In_ BOOLEAN StoreInstruction,
     ASSERT(TempPte.u.Soft.PageFileHigh != MI_PTE_LOOKUP_NEEDED);
 
     /* Get any page, it will be overwritten */
-    Color = MI_GET_NEXT_PROCESS_COLOR(CurrentProcess);
+    if (CurrentProcess > HYDRA_PROCESS)
+        Color = MI_GET_NEXT_PROCESS_COLOR(CurrentProcess);
+    else
+        Color = MI_GET_NEXT_COLOR();
     Page = MiRemoveAnyPage(Color);
 
     /* Initialize this PFN */
@@ -922,6 +929,7 @@ MiResolvePageFileFault(_In_ BOOLEAN StoreInstruction,
     KeReleaseQueuedSpinLock(LockQueuePfnLock, *OldIrql);
 
     /* Do the paging IO */
+    InterlockedIncrement((PLONG)&MmSinglePageFaultCount);
     Status = MiReadPageFile(Page, PageFileIndex, PageFileOffset);
 
     /* Lock the PFN database again */
@@ -938,6 +946,15 @@ MiResolvePageFileFault(_In_ BOOLEAN StoreInstruction,
         Pfn1->u4.InPageError = 1;
         Pfn1->u1.ReadStatus = Status;
     }
+    else
+    {
+        /* The page is resident again, give its paging file space back */
+        MiReleasePageFileSpace(Pfn1->OriginalPte);
+        MI_MAKE_SOFTWARE_PTE(&Pfn1->OriginalPte, Protection);
+
+        /* Which means it has to be written again if it ever leaves */
+        Pfn1->u3.e1.Modified = 1;
+    }
 
     /* And the PTE can finally be valid */
     MI_MAKE_HARDWARE_PTE(&TempPte, PointerPte, Protection, Page);
@@ -954,6 +971,116 @@ MiResolvePageFileFault(_In_ BOOLEAN StoreInstruction,
     return Status;
 }
 
+static
+BOOLEAN
+MiReadPageFileCluster(IN PMMPTE PointerProtoPte,
+                      IN PMMPTE LastProtoPte,
+                      IN PEPROCESS Process,
+                      IN OUT PKIRQL OldIrql)
+{
+    PFN_NUMBER Pages[MM_SWAP_CLUSTER_SIZE];
+    MMPTE PteContents[MM_SWAP_CLUSTER_SIZE];
+    MMPTE TempPte;
+    PMMPTE PointerPte;
+    PMMPFN Pfn1, ProtoPfn;
+    PFN_NUMBER ProtoPageFrameIndex;
+    PFN_COUNT Count, i;
+    ULONG Color;
+    NTSTATUS Status;
+
+    /* We must hold the PFN lock */
+    ASSERT(KeGetCurrentIrql() == DISPATCH_LEVEL);
+    ASSERT(LastProtoPte - PointerProtoPte < MM_SWAP_CLUSTER_SIZE);
+
+    /* Gather the prototype PTEs whose pages follow each other in the paging file */
+    TempPte = *PointerProtoPte;
+    for (Count = 0, PointerPte = PointerProtoPte;
+         PointerPte <= LastProtoPte;
+         Count++, PointerPte++)
+    {
+        if ((PointerPte->u.Hard.Valid == 1) ||
+            (PointerPte->u.Soft.Prototype == 1) ||
+            (PointerPte->u.Soft.Transition == 1) ||
+            (PointerPte->u.Soft.PageFileLow != TempPte.u.Soft.PageFileLow) ||
+            (PointerPte->u.Soft.PageFileHigh != TempPte.u.Soft.PageFileHigh + Count))
+        {
+            break;
+        }
+
+        PteContents[Count] = *PointerPte;
+    }
+
+    /* Not worth it for a single page, and don't eat up the last pages */
+    if ((Count < 2) || (MmAvailablePages < MmMinimumFreePages * 2 + Count)) return FALSE;
+
+    /* Keep the page holding the prototype PTEs around while we wait */
+    ProtoPageFrameIndex = MiAddressToPte(PointerProtoPte)->u.Hard.PageFrameNumber;
+    ProtoPfn = MI_PFN_ELEMENT(ProtoPageFrameIndex);
+    MiReferenceUsedPageAndBumpLockCount(ProtoPfn);
+
+    /* Get the pages, they will be overwritten. Nobody knows about them yet */
+    for (i = 0; i < Count; i++)
+    {
+        if (Process > HYDRA_PROCESS)
+            Color = MI_GET_NEXT_PROCESS_COLOR(Process);
+        else
+            Color = MI_GET_NEXT_COLOR();
+        Pages[i] = MiRemoveAnyPage(Color);
+        MI_PFN_ELEMENT(Pages[i])->u3.e2.ReferenceCount = 1;
+    }
+
+    /* Release the PFN lock and read the whole run in one go */
+    KeReleaseQueuedSpinLock(LockQueuePfnLock, *OldIrql);
+    Status = MiReadPageFileRun(Pages,
+                               Count,
+                               TempPte.u.Soft.PageFileLow,
+                               TempPte.u.Soft.PageFileHigh);
+    *OldIrql = KeAcquireQueuedSpinLock(LockQueuePfnLock);
+
+    for (i = 0; i < Count; i++)
+    {
+        Pfn1 = MI_PFN_ELEMENT(Pages[i]);
+        PointerPte = PointerProtoPte + i;
+
+        /* Drop the page if the read failed, or someone else brought it in meanwhile */
+        if (!(NT_SUCCESS(Status)) || (PointerPte->u.Long != PteContents[i].u.Long))
+        {
+            Pfn1->u3.e2.ReferenceCount = 0;
+            MiInsertPageInFreeList(Pages[i]);
+            continue;
+        }
+
+        /* This is a clean prototype page which still has its paging file copy */
+        Pfn1->PteAddress = PointerPte;
+        Pfn1->OriginalPte = PteContents[i];
+        Pfn1->u3.e1.PrototypePte = 1;
+        Pfn1->u3.e1.Modified = 0;
+        Pfn1->u3.e1.PageLocation = TransitionPage;
+        Pfn1->u4.PteFrame = ProtoPageFrameIndex;
+        ProtoPfn->u2.ShareCount++;
+
+        /* Put the PTE in transition */
+        MI_MAKE_TRANSITION_PTE(&TempPte, Pages[i], PteContents[i].u.Soft.Protection);
+        MI_WRITE_INVALID_PTE(PointerPte, TempPte);
+
+        /* And move the page to the standby list, the fault will pick it from there */
+        MiDecrementReferenceCount(Pfn1, Pages[i]);
+    }
+
+    /* Release the page table */
+    MiDereferencePfnAndDropLockCount(ProtoPfn);
+
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("Clustered read of %lu pages failed: %lx\n", Count, Status);
+        return FALSE;
+    }
+
+    InterlockedIncrement((PLONG)&MmClusteredPageFaultCount);
+    InterlockedExchangeAdd((PLONG)&MmClusteredPagesRead, Count);
+    return TRUE;
+}
+
 NTSTATUS
 NTAPI
 MiResolveTransitionFault(IN BOOLEAN StoreInstruction,
@@ -1024,12 +1151,22 @@ MiResolveTransitionFault(IN BOOLEAN StoreInstruction,
         ASSERT(Pfn1->u2.ShareCount != 0);
         ASSERT(Pfn1->u3.e2.ReferenceCount != 0);
     }
+    else if (Pfn1->u3.e1.WriteInProgress)
+    {
+        /* The modified page writer owns the page, it is on no list */
+        DPRINT("Transition page being written out\n");
+        MiReferenceUnusedPageAndBumpLockCount(Pfn1);
+        Pfn1->u3.e1.Modified = 1;
+    }
     else
     {
         /* Otherwise, the page is removed from its list */
         DPRINT("Transition page in free/zero list\n");
         MiUnlinkPageFromList(Pfn1);
         MiReferenceUnusedPageAndBumpLockCount(Pfn1);
+
+        /* Its paging file copy, if any, was released, so it must be written again */
+        if (Pfn1->u3.e1.PrototypePte) Pfn1->u3.e1.Modified = 1;
     }
 
     /* At this point, there should no longer be any in-page errors */
@@ -1259,11 +1396,18 @@ MiResolveProtoPteFault(IN BOOLEAN StoreInstruction,
                                           &InPageBlock);
         ASSERT(NT_SUCCESS(Status));
     }
+    else if (TempPte.u.Soft.PageFileHigh != 0)
+    {
+        /* The modified page writer put this page in the paging file */
+        Status = MiResolvePageFileFault(StoreInstruction,
+                                        Address,
+                                        PointerProtoPte,
+                                        Process,
+                                        &OldIrql);
+        ASSERT(NT_SUCCESS(Status));
+    }
     else
     {
-        /* We also don't support paged out pages */
-        ASSERT(TempPte.u.Soft.PageFileHigh == 0);
-
         /* Resolve the demand zero fault */
         Status = MiResolveDemandZeroFault(Address,
                                           PointerProtoPte,
@@ -1300,6 +1444,8 @@ MiDispatchFault(IN BOOLEAN StoreInstruction,
     PMMPFN Pfn1, OutPfn = NULL;
     PFN_NUMBER PageFrameIndex;
     PFN_COUNT PteCount, ProcessedPtes;
+    PMMPTE LastClusterPte;
+    ULONG ClusterSize;
     DPRINT("ARM3 Page Fault Dispatcher for address: %p in process: %p\n",
              Address,
              Process);
@@ -1367,13 +1513,20 @@ MiDispatchFault(IN BOOLEAN StoreInstruction,
             ASSERT(PointerPte->u.Soft.PageFileHigh == MI_PTE_LOOKUP_NEEDED);
 
             /* Is there a non-image VAD? */
+            LastClusterPte = NULL;
             if ((Vad) &&
                 (Vad->u.VadFlags.VadType != VadImageMap) &&
                 !(Vad->u2.VadFlags2.ExtendableFile))
             {
-                /* One day, ReactOS will cluster faults */
+                /* Cluster within the VAD and the page of prototype PTEs */
                 ASSERT(Address <= MM_HIGHEST_USER_ADDRESS);
-                DPRINT("Should cluster fault, but won't\n");
+                ClusterSize = min(PsGetCurrentThread()->ReadClusterSize + 1, MM_SWAP_CLUSTER_SIZE);
+                LastClusterPte = PointerProtoPte + ClusterSize - 1;
+                if (LastClusterPte > Vad->LastContiguousPte) LastClusterPte = Vad->LastContiguousPte;
+                if (MiAddressToPte(LastClusterPte) != SuperProtoPte)
+                {
+                    LastClusterPte = (PMMPTE)PAGE_ALIGN(PointerProtoPte) + PTE_COUNT - 1;
+                }
             }
 
             /* Only one PTE to handle for now */
@@ -1389,6 +1542,18 @@ MiDispatchFault(IN BOOLEAN StoreInstruction,
             /* Capture the PTE */
             TempPte = *PointerProtoPte;
 
+            /* For a paged out page, bring its neighbours in with it. They land on standby */
+            if ((LastClusterPte > PointerProtoPte) &&
+                (TempPte.u.Soft.Valid == 0) &&
+                (TempPte.u.Soft.Prototype == 0) &&
+                (TempPte.u.Soft.Transition == 0) &&
+                (TempPte.u.Soft.PageFileHigh != 0) &&
+                (MiReadPageFileCluster(PointerProtoPte, LastClusterPte, Process, &LockIrql)))
+            {
+                /* The page is in transition now, take it the soft fault way */
+                TempPte = *PointerProtoPte;
+            }
+
             /* Loop to handle future case of clustered faults */
             while (TRUE)
             {
@@ -1413,8 +1578,11 @@ MiDispatchFault(IN BOOLEAN StoreInstruction,
                     ASSERT(Pfn1->u3.e1.ReadInProgress == 0);
                     ASSERT(Pfn1->u4.InPageError == 0);
 
-                    /* Get the page */
-                    MiUnlinkPageFromList(Pfn1);
+                    /* Get the page, unless the modified page writer has it */
+                    if (!Pfn1->u3.e1.WriteInProgress) MiUnlinkPageFromList(Pfn1);
+
+                    /* Any paging file copy is gone or about to be stale */
+                    Pfn1->u3.e1.Modified = 1;
 
                     /* Bump its reference count */
                     ASSERT(Pfn1->u2.ShareCount == 0);
@@ -108,7 +108,12 @@ MiDecrementAvailablePages(
     MmAvailablePages--;
     if (MmAvailablePages < MmMinimumFreePages)
     {
-        /* FIXME: Should wake up the MPW and working set manager, if we had one */
+        /* Get the page writers going, so that modified pages become reusable */
+        if (MmModifiedPageMaximum)
+        {
+            if (MmModifiedPageListHead.Total) KeSetEvent(&MmModifiedPageWriterEvent, 0, FALSE);
+            KeSetEvent(&MpwThreadEvent, 0, FALSE);
+        }
 
         DPRINT1("Running low on pages: %lu remaining\n", MmAvailablePages);
 
@@ -346,8 +351,21 @@ MiUnlinkPageFromList(IN PMMPFN Pfn)
         ListHead->Flink = OldFlink;
     }
 
-    /* ReactOS Hack */
-    Pfn->OriginalPte.u.Long = 0;
+    if (Pfn->u3.e1.PrototypePte)
+    {
+        /* The page is being used again, so its paging file copy is about to be stale */
+        if (Pfn->OriginalPte.u.Soft.PageFileHigh != 0)
+        {
+            MiReleasePageFileSpace(Pfn->OriginalPte);
+            Pfn->OriginalPte.u.Soft.PageFileLow = 0;
+            Pfn->OriginalPte.u.Soft.PageFileHigh = 0;
+        }
+    }
+    else
+    {
+        /* ReactOS Hack */
+        Pfn->OriginalPte.u.Long = 0;
+    }
 
     /* We are not on a list anymore */
     Pfn->u1.Flink = Pfn->u2.Blink = 0;
@@ -470,6 +488,65 @@ MiRemovePageByColor(IN PFN_NUMBER PageIndex,
     return PageIndex;
 }
 
+static
+PFN_NUMBER
+MiRemoveStandbyPage(VOID)
+{
+    PFN_NUMBER PageIndex = LIST_HEAD;
+    PMMPFN Pfn1;
+    PMMPTE PointerPte;
+    PVOID PageTable;
+    PFN_NUMBER PteFrame;
+    ULONG OldColor, OldCache, Priority;
+    PEPROCESS Process = PsGetCurrentProcess();
+    KIRQL OldIrql;
+
+    /* Repurpose the oldest page of the lowest priority */
+    for (Priority = 0; Priority < RTL_NUMBER_OF(MmStandbyPageListByPriority); Priority++)
+    {
+        PageIndex = MmStandbyPageListByPriority[Priority].Blink;
+        if (PageIndex != LIST_HEAD) break;
+    }
+    ASSERT(PageIndex != LIST_HEAD);
+
+    /* Only clean prototype pages with a paging file copy are on standby */
+    Pfn1 = MI_PFN_ELEMENT(PageIndex);
+    ASSERT(Pfn1->u3.e1.PrototypePte == 1);
+    ASSERT(Pfn1->u3.e1.Modified == 0);
+    ASSERT(Pfn1->OriginalPte.u.Soft.PageFileHigh != 0);
+
+    /* Point the prototype PTE back to the paging file copy */
+    PageTable = MiMapPageInHyperSpace(Process, Pfn1->u4.PteFrame, &OldIrql);
+    PointerPte = (PMMPTE)((ULONG_PTR)PageTable + BYTE_OFFSET(Pfn1->PteAddress));
+    ASSERT(PointerPte->u.Soft.Transition == 1);
+    MI_WRITE_INVALID_PTE(PointerPte, Pfn1->OriginalPte);
+    MiUnmapPageInHyperSpace(Process, PageTable, OldIrql);
+
+    /* The prototype PTE no longer refers to this page, so drop the share
+       count MiInitializePfn took on the page holding the prototype PTE */
+    PteFrame = Pfn1->u4.PteFrame;
+    MiDecrementShareCount(MI_PFN_ELEMENT(PteFrame), PteFrame);
+
+    /* The copy now belongs to the PTE, so don't let the unlink release it */
+    Pfn1->OriginalPte.u.Soft.PageFileHigh = 0;
+    MiUnlinkPageFromList(Pfn1);
+
+    /* Zero flags but restore color and cache */
+    OldColor = Pfn1->u3.e1.PageColor;
+    OldCache = Pfn1->u3.e1.CacheAttribute;
+    Pfn1->u3.e2.ShortFlags = 0;
+    Pfn1->u3.e1.PageColor = OldColor;
+    Pfn1->u3.e1.CacheAttribute = OldCache;
+    Pfn1->OriginalPte.u.Long = 0;
+
+#if MI_TRACE_PFNS
+    Pfn1->PfnUsage = MI_PFN_CURRENT_USAGE;
+    memcpy(Pfn1->ProcessName, MI_PFN_CURRENT_PROCESS_NAME, 16);
+#endif
+
+    return PageIndex;
+}
+
 PFN_NUMBER
 NTAPI
 MiRemoveAnyPage(IN ULONG Color)
@@ -500,11 +577,11 @@ MiRemoveAnyPage(IN ULONG Color)
                 ASSERT_LIST_INVARIANT(&MmZeroedPageListHead);
                 PageIndex = MmZeroedPageListHead.Flink;
                 Color = PageIndex & MmSecondaryColorMask;
-                ASSERT(PageIndex != LIST_HEAD);
                 if (PageIndex == LIST_HEAD)
                 {
-                    /* FIXME: Should check the standby list */
+                    /* Nothing free, take a page from the standby list */
                     ASSERT(MmZeroedPageListHead.Total == 0);
+                    return MiRemoveStandbyPage();
                 }
             }
         }
@@ -560,11 +637,13 @@ MiRemoveZeroPage(IN ULONG Color)
                 ASSERT_LIST_INVARIANT(&MmFreePageListHead);
                 PageIndex = MmFreePageListHead.Flink;
                 Color = PageIndex & MmSecondaryColorMask;
-                ASSERT(PageIndex != LIST_HEAD);
                 if (PageIndex == LIST_HEAD)
                 {
-                    /* FIXME: Should check the standby list */
-                    ASSERT(MmZeroedPageListHead.Total == 0);
+                    /* Nothing free, take a page from the standby list and wipe it */
+                    ASSERT(MmFreePageListHead.Total == 0);
+                    PageIndex = MiRemoveStandbyPage();
+                    MiZeroPhysicalPage(PageIndex);
+                    return PageIndex;
                 }
             }
         }
@@ -586,6 +665,14 @@ MiRemoveZeroPage(IN ULONG Color)
     /* Zero it, if needed */
     if (Zero) MiZeroPhysicalPage(PageIndex);
 
+    /* Get the zero page threads going before we run out of zeroed pages */
+    if ((MmZeroedPageListHead.Total < MmZeroedPageTarget) &&
+        (MmFreePageListHead.Total) &&
+        !(MmZeroingPageThreadActive))
+    {
+        KeSetEvent(&MmZeroingPageEvent, IO_NO_INCREMENT, FALSE);
+    }
+
     /* Sanity checks */
     ASSERT(Pfn1->u3.e2.ReferenceCount == 0);
     ASSERT(Pfn1->u2.ShareCount == 0);
@@ -955,7 +1042,11 @@ MiInsertPageInList(IN PMMPFNLIST ListHead,
         /* Increment the number of per-process modified pages */
         PsGetCurrentProcess()->ModifiedPageCount++;
 
-        /* FIXME: Wake up modified page writer if there are not enough free pages */
+        /* Wake up the modified page writer once enough pages have piled up */
+        if ((ListHead->Total >= MmModifiedPageMaximum) && (MmModifiedPageMaximum))
+        {
+            KeSetEvent(&MmModifiedPageWriterEvent, 0, FALSE);
+        }
     }
     else if (ListName == ModifiedNoWritePageList)
     {
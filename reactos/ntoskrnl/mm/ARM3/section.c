@@ -680,25 +680,33 @@ MiSegmentDelete(IN PSEGMENT Segment)
                 PageFrameIndex = PFN_FROM_PTE(&TempPte);
                 Pfn1 = MI_PFN_ELEMENT(PageFrameIndex);
 
-                /* As this is a paged-backed section, nobody should reference it anymore (no cache or whatever) */
-                ASSERT(Pfn1->u3.ReferenceCount == 0);
+                if (Pfn1->u3.e1.WriteInProgress)
+                {
+                    /* The modified page writer will free the page once it is done with it */
+                    MI_SET_PFN_DELETED(Pfn1);
+                }
+                else
+                {
+                    /* As this is a paged-backed section, nobody should reference it anymore (no cache or whatever) */
+                    ASSERT(Pfn1->u3.ReferenceCount == 0);
 
-                /* And it should be in standby or modified list */
-                ASSERT((Pfn1->u3.e1.PageLocation == ModifiedPageList) || (Pfn1->u3.e1.PageLocation == StandbyPageList));
+                    /* And it should be in standby or modified list */
+                    ASSERT((Pfn1->u3.e1.PageLocation == ModifiedPageList) || (Pfn1->u3.e1.PageLocation == StandbyPageList));
 
-                /* Unlink it and put it back in free list */
-                MiUnlinkPageFromList(Pfn1);
+                    /* Unlink it and put it back in free list */
+                    MiUnlinkPageFromList(Pfn1);
 
-                /* Temporarily mark this as active and make it free again */
-                Pfn1->u3.e1.PageLocation = ActiveAndValid;
-                MI_SET_PFN_DELETED(Pfn1);
+                    /* Temporarily mark this as active and make it free again */
+                    Pfn1->u3.e1.PageLocation = ActiveAndValid;
+                    MI_SET_PFN_DELETED(Pfn1);
 
-                MiInsertPageInFreeList(PageFrameIndex);
+                    MiInsertPageInFreeList(PageFrameIndex);
+                }
             }
             else if (TempPte.u.Soft.PageFileHigh != 0)
             {
-                /* Should not happen for now */
-                ASSERT(FALSE);
+                /* The page was written out, release its paging file space */
+                MiReleasePageFileSpace(TempPte);
             }
         }
         else
@@ -17,9 +17,19 @@
 
 /* GLOBALS ********************************************************************/
 
-BOOLEAN MmZeroingPageThreadActive;
+/* Number of zero page threads currently working */
+ULONG MmZeroingPageThreadActive;
 KEVENT MmZeroingPageEvent;
 
+/* Wake up the zero page threads when fewer zeroed pages than this are left */
+PFN_NUMBER MmZeroedPageTarget;
+
+/* One zero page thread per processor */
+static ULONG MiZeroPageThreadCount;
+
+/* Pages zeroed with a single mapping */
+#define MI_ZERO_PAGE_BATCH 16
+
 /* PRIVATE FUNCTIONS **********************************************************/
 
 VOID
@@ -32,27 +42,77 @@ NTAPI
 MiFreeInitializationCode(IN PVOID StartVa,
 IN PVOID EndVa);
 
+static
+PFN_COUNT
+MiGrabFreePages(OUT PMMPFN *Pfns,
+                OUT PPFN_NUMBER Pages)
+{
+    PFN_NUMBER PageIndex, FreePage;
+    PFN_COUNT Count;
+    PMMPFN Pfn1;
+
+    ASSERT(KeGetCurrentIrql() == DISPATCH_LEVEL);
+
+    for (Count = 0; Count < MI_ZERO_PAGE_BATCH; Count++)
+    {
+        if (!MmFreePageListHead.Total) break;
+
+        PageIndex = MmFreePageListHead.Flink;
+        ASSERT(PageIndex != LIST_HEAD);
+        Pfn1 = MiGetPfnEntry(PageIndex);
+        MI_SET_USAGE(MI_USAGE_ZERO_LOOP);
+        MI_SET_PROCESS2("Kernel 0 Loop");
+        FreePage = MiRemoveAnyPage(MI_GET_PAGE_COLOR(PageIndex));
+
+        /* The first global free page should also be the first on its own list */
+        if (FreePage != PageIndex)
+        {
+            KeBugCheckEx(PFN_LIST_CORRUPT,
+                         0x8F,
+                         FreePage,
+                         PageIndex,
+                         0);
+        }
+
+        Pfn1->u1.Flink = LIST_HEAD;
+        Pfns[Count] = Pfn1;
+        Pages[Count] = PageIndex;
+    }
+
+    return Count;
+}
+
+static
 VOID
-NTAPI
-MmZeroPageThread(VOID)
+MiZeroPageLoop(IN ULONG Processor)
 {
     PKTHREAD Thread = KeGetCurrentThread();
-    PVOID StartAddress, EndAddress;
     PVOID WaitObjects[2];
-    KIRQL OldIrql;
+    PMMPFN Pfns[MI_ZERO_PAGE_BATCH];
+    PFN_NUMBER Pages[MI_ZERO_PAGE_BATCH];
+    PMMPTE ZeroPte, PointerPte;
+    MMPTE TempPte;
     PVOID ZeroAddress;
-    PFN_NUMBER PageIndex, FreePage;
-    PMMPFN Pfn1;
-
-    /* Get the discardable sections to free them */
-    MiFindInitializationCode(&StartAddress, &EndAddress);
-    if (StartAddress) MiFreeInitializationCode(StartAddress, EndAddress);
-    DPRINT("Free non-cache pages: %lx\n", MmAvailablePages + MiMemoryConsumers[MC_CACHE].PagesUsed);
+    PFN_COUNT Count, i;
+    KIRQL OldIrql;
 
-    /* Set our priority to 0 */
+    /*
+     * Stay on our processor and only run when it has nothing else to do, so
+     * zeroing happens in otherwise idle time and the mapping stays local.
+     */
+    KeSetAffinityThread(Thread, AFFINITY_MASK(Processor));
     Thread->BasePriority = 0;
     KeSetPriorityThread(Thread, 0);
 
+    /* Get a private mapping window, so that processors don't share the zero space */
+    ZeroPte = MiReserveSystemPtes(MI_ZERO_PAGE_BATCH, SystemPteSpace);
+    if (!ZeroPte)
+    {
+        /* The boot processor can still fall back to the zero space */
+        DPRINT1("No zeroing PTEs for processor %lu\n", Processor);
+        if (Processor) return;
+    }
+
     /* Setup the wait objects */
     WaitObjects[0] = &MmZeroingPageEvent;
 //    WaitObjects[1] = &PoSystemIdleTimer; FIXME: Implement idle timer
@@ -68,47 +128,109 @@ MmZeroPageThread(VOID)
                                  NULL,
                                  NULL);
         OldIrql = KeAcquireQueuedSpinLock(LockQueuePfnLock);
-        MmZeroingPageThreadActive = TRUE;
+        MmZeroingPageThreadActive++;
 
         while (TRUE)
         {
-            if (!MmFreePageListHead.Total)
+            Count = MiGrabFreePages(Pfns, Pages);
+            if (!Count)
             {
-                MmZeroingPageThreadActive = FALSE;
+                MmZeroingPageThreadActive--;
                 KeReleaseQueuedSpinLock(LockQueuePfnLock, OldIrql);
                 break;
             }
 
-            PageIndex = MmFreePageListHead.Flink;
-            ASSERT(PageIndex != LIST_HEAD);
-            Pfn1 = MiGetPfnEntry(PageIndex);
-            MI_SET_USAGE(MI_USAGE_ZERO_LOOP);
-            MI_SET_PROCESS2("Kernel 0 Loop");
-            FreePage = MiRemoveAnyPage(MI_GET_PAGE_COLOR(PageIndex));
-
-            /* The first global free page should also be the first on its own list */
-            if (FreePage != PageIndex)
+            /* Get another processor to help if there is plenty left */
+            if ((MmFreePageListHead.Total >= MI_ZERO_PAGE_BATCH) &&
+                (MmZeroingPageThreadActive < MiZeroPageThreadCount))
             {
-                KeBugCheckEx(PFN_LIST_CORRUPT,
-                             0x8F,
-                             FreePage,
-                             PageIndex,
-                             0);
+                KeSetEvent(&MmZeroingPageEvent, IO_NO_INCREMENT, FALSE);
             }
 
-            Pfn1->u1.Flink = LIST_HEAD;
             KeReleaseQueuedSpinLock(LockQueuePfnLock, OldIrql);
 
-            ZeroAddress = MiMapPagesInZeroSpace(Pfn1, 1);
-            ASSERT(ZeroAddress);
-            RtlZeroMemory(ZeroAddress, PAGE_SIZE);
-            MiUnmapPagesInZeroSpace(ZeroAddress, 1);
+            if (ZeroPte)
+            {
+                /* Map the whole batch, nobody else ever uses these PTEs */
+                TempPte = ValidKernelPte;
+                for (i = 0; i < Count; i++)
+                {
+                    TempPte.u.Hard.PageFrameNumber = Pages[i];
+                    MI_WRITE_VALID_PTE(ZeroPte + i, TempPte);
+                }
+
+                ZeroAddress = MiPteToAddress(ZeroPte);
+                KeZeroPagesFromIdleThread(ZeroAddress, Count * PAGE_SIZE);
+
+                /* The mapping was only ever used on this processor */
+                for (i = 0, PointerPte = ZeroPte; i < Count; i++, PointerPte++)
+                {
+                    MI_ERASE_PTE(PointerPte);
+                    KeInvalidateTlbEntry(MiPteToAddress(PointerPte));
+                }
+            }
+            else
+            {
+                /* Link the batch for the zero space */
+                for (i = 1; i < Count; i++) Pfns[i - 1]->u1.Flink = (ULONG_PTR)Pfns[i];
+                Pfns[Count - 1]->u1.Flink = LIST_HEAD;
+
+                ZeroAddress = MiMapPagesInZeroSpace(Pfns[0], Count);
+                ASSERT(ZeroAddress);
+                KeZeroPagesFromIdleThread(ZeroAddress, Count * PAGE_SIZE);
+                MiUnmapPagesInZeroSpace(ZeroAddress, Count);
+            }
 
             OldIrql = KeAcquireQueuedSpinLock(LockQueuePfnLock);
 
-            MiInsertPageInList(&MmZeroedPageListHead, PageIndex);
+            for (i = 0; i < Count; i++) MiInsertPageInList(&MmZeroedPageListHead, Pages[i]);
         }
     }
 }
 
+static
+VOID
+NTAPI
+MiZeroPageWorkerThread(IN PVOID StartContext)
+{
+    MiZeroPageLoop(PtrToUlong(StartContext));
+}
+
+VOID
+NTAPI
+MmZeroPageThread(VOID)
+{
+    PVOID StartAddress, EndAddress;
+    HANDLE ThreadHandle;
+    NTSTATUS Status;
+    ULONG i;
+
+    /* Keep a few batches worth of zeroed pages around for each processor */
+    MmZeroedPageTarget = MI_ZERO_PAGE_BATCH * 4 * KeNumberProcessors;
+    MiZeroPageThreadCount = 1;
+
+    /* Start the zero page threads for the other processors */
+    for (i = 1; i < (ULONG)KeNumberProcessors; i++)
+    {
+        Status = PsCreateSystemThread(&ThreadHandle,
+                                      THREAD_ALL_ACCESS,
+                                      NULL,
+                                      NULL,
+                                      NULL,
+                                      MiZeroPageWorkerThread,
+                                      UlongToPtr(i));
+        if (!NT_SUCCESS(Status)) break;
+        ZwClose(ThreadHandle);
+        MiZeroPageThreadCount++;
+    }
+
+    /* Get the discardable sections to free them */
+    MiFindInitializationCode(&StartAddress, &EndAddress);
+    if (StartAddress) MiFreeInitializationCode(StartAddress, EndAddress);
+    DPRINT("Free non-cache pages: %lx\n", MmAvailablePages + MiMemoryConsumers[MC_CACHE].PagesUsed);
+
+    /* The boot processor's zero page thread is this one */
+    MiZeroPageLoop(0);
+}
+
 /* EOF */
@@ -50,9 +50,9 @@ typedef struct _PAGINGFILE
     LARGE_INTEGER CurrentSize;
     PFN_NUMBER FreePages;
     PFN_NUMBER UsedPages;
-    PULONG AllocMap;
+    PRTL_BITMAP AllocMap;
     KSPIN_LOCK AllocMapLock;
-    ULONG AllocMapSize;
+    ULONG AllocHint;
     PRETRIEVAL_POINTERS_BUFFER RetrievalPointers;
 }
 PAGINGFILE, *PPAGINGFILE;
@@ -217,20 +217,101 @@ MmGetOffsetPageFile(PRETRIEVAL_POINTERS_BUFFER RetrievalPointers, LARGE_INTEGER
 #endif
 }
 
+static
 NTSTATUS
-NTAPI
-MmWriteToSwapPage(SWAPENTRY SwapEntry, PFN_NUMBER Page)
+MiPagingFileIo(
+    _In_ PPAGINGFILE PagingFile,
+    _In_ ULONG_PTR PageFileOffset,
+    _In_reads_(Count) PPFN_NUMBER Pages,
+    _In_ PFN_COUNT Count,
+    _In_ BOOLEAN Write)
 {
-    ULONG i;
-    ULONG_PTR offset;
     LARGE_INTEGER file_offset;
+    LARGE_INTEGER next_offset;
     IO_STATUS_BLOCK Iosb;
-    NTSTATUS Status;
+    NTSTATUS Status = STATUS_SUCCESS;
     KEVENT Event;
-    UCHAR MdlBase[sizeof(MDL) + sizeof(ULONG)];
+    UCHAR MdlBase[sizeof(MDL) + MM_SWAP_CLUSTER_SIZE * sizeof(PFN_NUMBER)];
     PMDL Mdl = (PMDL)MdlBase;
+    PFN_COUNT Run;
+
+    ASSERT(Count <= MM_SWAP_CLUSTER_SIZE);
+
+    if (PagingFile->FileObject == NULL || PagingFile->FileObject->DeviceObject == NULL)
+    {
+        DPRINT1("Bad paging file %p\n", PagingFile);
+        KeBugCheck(MEMORY_MANAGEMENT);
+    }
 
-    DPRINT("MmWriteToSwapPage\n");
+    while (Count)
+    {
+        file_offset.QuadPart = (LONGLONG)PageFileOffset * PAGE_SIZE;
+        file_offset = MmGetOffsetPageFile(PagingFile->RetrievalPointers, file_offset);
+
+        /* Only what is contiguous on the disk can go in one I/O */
+        for (Run = 1; Run < Count; Run++)
+        {
+            next_offset.QuadPart = (LONGLONG)(PageFileOffset + Run) * PAGE_SIZE;
+            next_offset = MmGetOffsetPageFile(PagingFile->RetrievalPointers, next_offset);
+            if (next_offset.QuadPart != file_offset.QuadPart + (LONGLONG)Run * PAGE_SIZE)
+            {
+                break;
+            }
+        }
+
+        MmInitializeMdl(Mdl, NULL, Run * PAGE_SIZE);
+        MmBuildMdlFromPages(Mdl, Pages);
+        Mdl->MdlFlags |= MDL_PAGES_LOCKED;
+
+        KeInitializeEvent(&Event, NotificationEvent, FALSE);
+        if (Write)
+        {
+            Status = IoSynchronousPageWrite(PagingFile->FileObject,
+                                            Mdl,
+                                            &file_offset,
+                                            &Event,
+                                            &Iosb);
+        }
+        else
+        {
+            Status = IoPageRead(PagingFile->FileObject,
+                                Mdl,
+                                &file_offset,
+                                &Event,
+                                &Iosb);
+        }
+        if (Status == STATUS_PENDING)
+        {
+            KeWaitForSingleObject(&Event, Executive, KernelMode, FALSE, NULL);
+            Status = Iosb.Status;
+        }
+
+        if (Mdl->MdlFlags & MDL_MAPPED_TO_SYSTEM_VA)
+        {
+            MmUnmapLockedPages (Mdl->MappedSystemVa, Mdl);
+        }
+
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        PageFileOffset += Run;
+        Pages += Run;
+        Count -= Run;
+    }
+
+    return(Status);
+}
+
+NTSTATUS
+NTAPI
+MmWriteToSwapPages(SWAPENTRY SwapEntry, PPFN_NUMBER Pages, PFN_COUNT Count)
+{
+    ULONG i;
+    ULONG_PTR offset;
+
+    DPRINT("MmWriteToSwapPages\n");
 
     if (SwapEntry == 0)
     {
@@ -241,63 +322,47 @@ MmWriteToSwapPage(SWAPENTRY SwapEntry, PFN_NUMBER Page)
     i = FILE_FROM_ENTRY(SwapEntry);
     offset = OFFSET_FROM_ENTRY(SwapEntry) - 1;
 
-    if (PagingFileList[i]->FileObject == NULL ||
-            PagingFileList[i]->FileObject->DeviceObject == NULL)
+    if (PagingFileList[i] == NULL)
     {
         DPRINT1("Bad paging file 0x%.8X\n", SwapEntry);
         KeBugCheck(MEMORY_MANAGEMENT);
     }
 
-    MmInitializeMdl(Mdl, NULL, PAGE_SIZE);
-    MmBuildMdlFromPages(Mdl, &Page);
-    Mdl->MdlFlags |= MDL_PAGES_LOCKED;
-
-    file_offset.QuadPart = offset * PAGE_SIZE;
-    file_offset = MmGetOffsetPageFile(PagingFileList[i]->RetrievalPointers, file_offset);
-
-    KeInitializeEvent(&Event, NotificationEvent, FALSE);
-    Status = IoSynchronousPageWrite(PagingFileList[i]->FileObject,
-                                    Mdl,
-                                    &file_offset,
-                                    &Event,
-                                    &Iosb);
-    if (Status == STATUS_PENDING)
-    {
-        KeWaitForSingleObject(&Event, Executive, KernelMode, FALSE, NULL);
-        Status = Iosb.Status;
-    }
+    return MiPagingFileIo(PagingFileList[i], offset, Pages, Count, TRUE);
+}
 
-    if (Mdl->MdlFlags & MDL_MAPPED_TO_SYSTEM_VA)
-    {
-        MmUnmapLockedPages (Mdl->MappedSystemVa, Mdl);
-    }
-    return(Status);
+NTSTATUS
+NTAPI
+MmWriteToSwapPage(SWAPENTRY SwapEntry, PFN_NUMBER Page)
+{
+    return MmWriteToSwapPages(SwapEntry, &Page, 1);
 }
 
+NTSTATUS
+NTAPI
+MmReadFromSwapPages(SWAPENTRY SwapEntry, PPFN_NUMBER Pages, PFN_COUNT Count)
+{
+    return MiReadPageFileRun(Pages, Count, FILE_FROM_ENTRY(SwapEntry), OFFSET_FROM_ENTRY(SwapEntry) - 1);
+}
 
 NTSTATUS
 NTAPI
 MmReadFromSwapPage(SWAPENTRY SwapEntry, PFN_NUMBER Page)
 {
-    return MiReadPageFile(Page, FILE_FROM_ENTRY(SwapEntry), OFFSET_FROM_ENTRY(SwapEntry) - 1);
+    return MmReadFromSwapPages(SwapEntry, &Page, 1);
 }
 
 NTSTATUS
 NTAPI
-MiReadPageFile(
-    _In_ PFN_NUMBER Page,
+MiReadPageFileRun(
+    _In_reads_(Count) PPFN_NUMBER Pages,
+    _In_ PFN_COUNT Count,
     _In_ ULONG PageFileIndex,
     _In_ ULONG_PTR PageFileOffset)
 {
-    LARGE_INTEGER file_offset;
-    IO_STATUS_BLOCK Iosb;
-    NTSTATUS Status;
-    KEVENT Event;
-    UCHAR MdlBase[sizeof(MDL) + sizeof(ULONG)];
-    PMDL Mdl = (PMDL)MdlBase;
     PPAGINGFILE PagingFile;
 
-    DPRINT("MiReadSwapFile\n");
+    DPRINT("MiReadPageFileRun\n");
 
     if (PageFileOffset == 0)
     {
@@ -308,36 +373,23 @@ MiReadPageFile(
     ASSERT(PageFileIndex < MAX_PAGING_FILES);
 
     PagingFile = PagingFileList[PageFileIndex];
-
-    if (PagingFile->FileObject == NULL || PagingFile->FileObject->DeviceObject == NULL)
+    if (PagingFile == NULL)
     {
         DPRINT1("Bad paging file %u\n", PageFileIndex);
         KeBugCheck(MEMORY_MANAGEMENT);
     }
 
-    MmInitializeMdl(Mdl, NULL, PAGE_SIZE);
-    MmBuildMdlFromPages(Mdl, &Page);
-    Mdl->MdlFlags |= MDL_PAGES_LOCKED;
-
-    file_offset.QuadPart = PageFileOffset * PAGE_SIZE;
-    file_offset = MmGetOffsetPageFile(PagingFile->RetrievalPointers, file_offset);
+    return MiPagingFileIo(PagingFile, PageFileOffset, Pages, Count, FALSE);
+}
 
-    KeInitializeEvent(&Event, NotificationEvent, FALSE);
-    Status = IoPageRead(PagingFile->FileObject,
-                        Mdl,
-                        &file_offset,
-                        &Event,
-                        &Iosb);
-    if (Status == STATUS_PENDING)
-    {
-        KeWaitForSingleObject(&Event, Executive, KernelMode, FALSE, NULL);
-        Status = Iosb.Status;
-    }
-    if (Mdl->MdlFlags & MDL_MAPPED_TO_SYSTEM_VA)
-    {
-        MmUnmapLockedPages (Mdl->MappedSystemVa, Mdl);
-    }
-    return(Status);
+NTSTATUS
+NTAPI
+MiReadPageFile(
+    _In_ PFN_NUMBER Page,
+    _In_ ULONG PageFileIndex,
+    _In_ ULONG_PTR PageFileOffset)
+{
+    return MiReadPageFileRun(&Page, 1, PageFileIndex, PageFileOffset);
 }
 
 VOID
@@ -361,30 +413,27 @@ MmInitPagingFile(VOID)
 }
 
 static ULONG
-MiAllocPageFromPagingFile(PPAGINGFILE PagingFile)
+MiAllocPagesFromPagingFile(PPAGINGFILE PagingFile, PFN_COUNT Count)
 {
     KIRQL oldIrql;
-    ULONG i, j;
+    ULONG Index;
 
     KeAcquireSpinLock(&PagingFile->AllocMapLock, &oldIrql);
 
-    for (i = 0; i < PagingFile->AllocMapSize; i++)
+    /*
+     * Go on from where the last run ended, rather than from the start of
+     * the file, so that pages written one after the other stay together.
+     */
+    Index = RtlFindClearBitsAndSet(PagingFile->AllocMap, Count, PagingFile->AllocHint);
+    if (Index != 0xFFFFFFFF)
     {
-        for (j = 0; j < 32; j++)
-        {
-            if (!(PagingFile->AllocMap[i] & (1 << j)))
-            {
-                PagingFile->AllocMap[i] |= (1 << j);
-                PagingFile->UsedPages++;
-                PagingFile->FreePages--;
-                KeReleaseSpinLock(&PagingFile->AllocMapLock, oldIrql);
-                return((i * 32) + j);
-            }
-        }
+        PagingFile->AllocHint = Index + Count;
+        PagingFile->UsedPages += Count;
+        PagingFile->FreePages -= Count;
     }
 
     KeReleaseSpinLock(&PagingFile->AllocMapLock, oldIrql);
-    return(0xFFFFFFFF);
+    return(Index);
 }
 
 VOID
@@ -405,7 +454,7 @@ MmFreeSwapPage(SWAPENTRY Entry)
     }
     KeAcquireSpinLockAtDpcLevel(&PagingFileList[i]->AllocMapLock);
 
-    PagingFileList[i]->AllocMap[off >> 5] &= (~(1 << (off % 32)));
+    RtlClearBit(PagingFileList[i]->AllocMap, (ULONG)off);
 
     PagingFileList[i]->FreePages++;
     PagingFileList[i]->UsedPages--;
@@ -417,49 +466,86 @@ MmFreeSwapPage(SWAPENTRY Entry)
     KeReleaseSpinLock(&PagingFileListLock, oldIrql);
 }
 
-SWAPENTRY
+PFN_COUNT
 NTAPI
-MmAllocSwapPage(VOID)
+MmAllocSwapPageRun(PFN_COUNT Count, SWAPENTRY *SwapEntries)
 {
     KIRQL oldIrql;
     ULONG i;
     ULONG off;
-    SWAPENTRY entry;
+    PFN_COUNT j;
 
-    KeAcquireSpinLock(&PagingFileListLock, &oldIrql);
+    ASSERT(Count >= 1 && Count <= MM_SWAP_CLUSTER_SIZE);
 
-    if (MiFreeSwapPages == 0)
-    {
-        KeReleaseSpinLock(&PagingFileListLock, oldIrql);
-        return(0);
-    }
+    KeAcquireSpinLock(&PagingFileListLock, &oldIrql);
 
-    for (i = 0; i < MAX_PAGING_FILES; i++)
+    /* Settle for a shorter run when the paging files are fragmented */
+    for (Count = min(Count, MiFreeSwapPages); Count; Count /= 2)
     {
-        if (PagingFileList[i] != NULL &&
-                PagingFileList[i]->FreePages >= 1)
+        for (i = 0; i < MAX_PAGING_FILES; i++)
         {
-            off = MiAllocPageFromPagingFile(PagingFileList[i]);
+            if (PagingFileList[i] == NULL ||
+                    PagingFileList[i]->FreePages < Count)
+            {
+                continue;
+            }
+
+            off = MiAllocPagesFromPagingFile(PagingFileList[i], Count);
             if (off == 0xFFFFFFFF)
             {
-                KeBugCheck(MEMORY_MANAGEMENT);
-                KeReleaseSpinLock(&PagingFileListLock, oldIrql);
-                return(STATUS_UNSUCCESSFUL);
+                continue;
             }
-            MiUsedSwapPages++;
-            MiFreeSwapPages--;
+
+            MiUsedSwapPages += Count;
+            MiFreeSwapPages -= Count;
             KeReleaseSpinLock(&PagingFileListLock, oldIrql);
 
-            entry = ENTRY_FROM_FILE_OFFSET(i, off + 1);
-            return(entry);
+            /* Consecutive entries map to consecutive pages of the file */
+            for (j = 0; j < Count; j++)
+            {
+                SwapEntries[j] = ENTRY_FROM_FILE_OFFSET(i, off + j + 1);
+            }
+            return(Count);
         }
     }
 
     KeReleaseSpinLock(&PagingFileListLock, oldIrql);
-    KeBugCheck(MEMORY_MANAGEMENT);
     return(0);
 }
 
+VOID
+NTAPI
+MiGetPageFileLocation(SWAPENTRY SwapEntry, PULONG PageFileIndex, PULONG_PTR PageFileOffset)
+{
+    *PageFileIndex = FILE_FROM_ENTRY(SwapEntry);
+    *PageFileOffset = OFFSET_FROM_ENTRY(SwapEntry) - 1;
+}
+
+VOID
+NTAPI
+MiReleasePageFileSpace(MMPTE PteContents)
+{
+    ASSERT(PteContents.u.Soft.Prototype == 0);
+    ASSERT(PteContents.u.Soft.PageFileHigh != 0);
+
+    MmFreeSwapPage(ENTRY_FROM_FILE_OFFSET(PteContents.u.Soft.PageFileLow,
+                                          PteContents.u.Soft.PageFileHigh + 1));
+}
+
+SWAPENTRY
+NTAPI
+MmAllocSwapPage(VOID)
+{
+    SWAPENTRY entry;
+
+    if (!MmAllocSwapPageRun(1, &entry))
+    {
+        return(0);
+    }
+
+    return(entry);
+}
+
 static PRETRIEVEL_DESCRIPTOR_LIST FASTCALL
 MmAllocRetrievelDescriptorList(ULONG Pairs)
 {
@@ -490,6 +576,7 @@ NtCreatePagingFile(IN PUNICODE_STRING FileName,
     PPAGINGFILE PagingFile;
     KIRQL oldIrql;
     ULONG AllocMapSize;
+    PULONG AllocMapBuffer;
     FILE_FS_SIZE_INFORMATION FsSizeInformation;
     PRETRIEVEL_DESCRIPTOR_LIST RetDescList;
     PRETRIEVEL_DESCRIPTOR_LIST CurrentRetDescList;
@@ -724,10 +811,8 @@ NtCreatePagingFile(IN PUNICODE_STRING FileName,
     PagingFile->UsedPages = 0;
     KeInitializeSpinLock(&PagingFile->AllocMapLock);
 
-    AllocMapSize = (PagingFile->FreePages / 32) + 1;
-    PagingFile->AllocMap = ExAllocatePool(NonPagedPool,
-                                          AllocMapSize * sizeof(ULONG));
-    PagingFile->AllocMapSize = AllocMapSize;
+    AllocMapSize = sizeof(RTL_BITMAP) + (((PagingFile->FreePages + 31) / 32) * sizeof(ULONG));
+    PagingFile->AllocMap = ExAllocatePool(NonPagedPool, AllocMapSize);
 
     if (PagingFile->AllocMap == NULL)
     {
@@ -760,7 +845,16 @@ NtCreatePagingFile(IN PUNICODE_STRING FileName,
         return(STATUS_NO_MEMORY);
     }
 
-    RtlZeroMemory(PagingFile->AllocMap, AllocMapSize * sizeof(ULONG));
+    AllocMapBuffer = (PULONG)(PagingFile->AllocMap + 1);
+    RtlInitializeBitMap(PagingFile->AllocMap, AllocMapBuffer, (ULONG)PagingFile->FreePages);
+    RtlClearAllBits(PagingFile->AllocMap);
+
+    /* Page 0 is never handed out, a zero offset in a PTE means "not paged out" */
+    if (PagingFile->FreePages)
+    {
+        RtlSetBit(PagingFile->AllocMap, 0);
+        PagingFile->FreePages--;
+    }
     RtlZeroMemory(PagingFile->RetrievalPointers, Size);
 
     Count = 0;
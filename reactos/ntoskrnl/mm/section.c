@@ -1277,6 +1277,55 @@ MiReadPage(PMEMORY_AREA MemoryArea,
 }
 #endif
 
+static
+ULONG
+MiGetSectionReadCluster(PEPROCESS Process,
+                        PMEMORY_AREA MemoryArea,
+                        PMM_REGION Region,
+                        PVOID PAddress,
+                        PLARGE_INTEGER Offset)
+/*
+ * FUNCTION: Count the pages, starting with the faulting one, which can be
+ *           read in together: they must be in the same view and region, not
+ *           resident yet and backed by the file.
+ */
+{
+    PMM_SECTION_SEGMENT Segment = MemoryArea->Data.SectionData.Segment;
+    LARGE_INTEGER ClusterOffset;
+    PVOID ClusterAddress;
+    ULONG Count, MaxCount;
+
+    MaxCount = min(Segment->ReadClusterSize + 1, MM_SWAP_CLUSTER_SIZE);
+    for (Count = 1; Count < MaxCount; Count++)
+    {
+        ClusterAddress = (PCHAR)PAddress + Count * PAGE_SIZE;
+        ClusterOffset.QuadPart = Offset->QuadPart + Count * PAGE_SIZE;
+
+        if ((ULONG_PTR)ClusterAddress >= MA_GetEndingAddress(MemoryArea) ||
+            ClusterOffset.QuadPart >= (LONGLONG)PAGE_ROUND_UP(Segment->RawLength.QuadPart))
+        {
+            break;
+        }
+
+        if (MmFindRegion((PVOID)MA_GetStartingAddress(MemoryArea),
+                         &MemoryArea->Data.SectionData.RegionListHead,
+                         ClusterAddress, NULL) != Region)
+        {
+            break;
+        }
+
+        if (MmIsPagePresent(Process, ClusterAddress) ||
+            MmIsPageSwapEntry(Process, ClusterAddress) ||
+            MmIsDisabledPage(Process, ClusterAddress) ||
+            MmGetPageEntrySectionSegment(Segment, &ClusterOffset) != 0)
+        {
+            break;
+        }
+    }
+
+    return Count;
+}
+
 NTSTATUS
 NTAPI
 MmNotPresentFaultSectionView(PMMSUPPORT AddressSpace,
@@ -1497,23 +1546,46 @@ MmNotPresentFaultSectionView(PMMSUPPORT AddressSpace,
     if (Entry == 0)
     {
         SWAPENTRY FakeSwapEntry;
+        BOOLEAN ReadFromFile;
+        PFN_NUMBER Pages[MM_SWAP_CLUSTER_SIZE];
+        LARGE_INTEGER ClusterOffset;
+        PVOID ClusterAddress;
+        ULONG ClusterSize, PagesRead, i;
 
         /*
          * If the entry is zero (and it can't change because we have
          * locked the segment) then we need to load the page.
          */
+        ReadFromFile = !(Segment->Flags & MM_PAGEFILE_SEGMENT) &&
+                       !((Offset.QuadPart >= (LONGLONG)PAGE_ROUND_UP(Segment->RawLength.QuadPart) &&
+                          (Section->AllocationAttributes & SEC_IMAGE)));
+
+        /*
+         * Read the following pages of the file along with this one, they
+         * come from the same cache view so this mostly saves faults and I/O
+         */
+        ClusterSize = 1;
+        if (ReadFromFile)
+        {
+            ClusterSize = MiGetSectionReadCluster(Process, MemoryArea, Region, PAddress, &Offset);
+        }
 
         /*
-         * Release all our locks and read in the page from disk
+         * Release all our locks and read in the pages from disk
          */
-        MmSetPageEntrySectionSegment(Segment, &Offset, MAKE_SWAP_SSE(MM_WAIT_ENTRY));
+        for (i = 0; i < ClusterSize; i++)
+        {
+            ClusterOffset.QuadPart = Offset.QuadPart + i * PAGE_SIZE;
+            MmSetPageEntrySectionSegment(Segment, &ClusterOffset, MAKE_SWAP_SSE(MM_WAIT_ENTRY));
+        }
         MmUnlockSectionSegment(Segment);
-        MmCreatePageFileMapping(Process, PAddress, MM_WAIT_ENTRY);
+        for (i = 0; i < ClusterSize; i++)
+        {
+            MmCreatePageFileMapping(Process, (PCHAR)PAddress + i * PAGE_SIZE, MM_WAIT_ENTRY);
+        }
         MmUnlockAddressSpace(AddressSpace);
 
-        if ((Segment->Flags & MM_PAGEFILE_SEGMENT) ||
-                ((Offset.QuadPart >= (LONGLONG)PAGE_ROUND_UP(Segment->RawLength.QuadPart) &&
-                  (Section->AllocationAttributes & SEC_IMAGE))))
+        if (!ReadFromFile)
         {
             MI_SET_USAGE(MI_USAGE_SECTION);
             if (Process) MI_SET_PROCESS2(Process->ImageFileName);
@@ -1533,7 +1605,66 @@ MmNotPresentFaultSectionView(PMMSUPPORT AddressSpace,
                 DPRINT1("MiReadPage failed (Status %x)\n", Status);
             }
         }
-        if (!NT_SUCCESS(Status))
+
+        /* Read the rest of the cluster, stopping at the first failure */
+        PagesRead = 0;
+        if (NT_SUCCESS(Status))
+        {
+            for (PagesRead = 1; PagesRead < ClusterSize; PagesRead++)
+            {
+                if (!NT_SUCCESS(MiReadPage(MemoryArea,
+                                           Offset.QuadPart + PagesRead * PAGE_SIZE,
+                                           &Pages[PagesRead])))
+                {
+                    break;
+                }
+            }
+
+            if (ClusterSize > 1)
+            {
+                InterlockedIncrement((PLONG)&MmClusteredPageFaultCount);
+                InterlockedExchangeAdd((PLONG)&MmClusteredPagesRead, PagesRead);
+            }
+            else if (ReadFromFile)
+            {
+                InterlockedIncrement((PLONG)&MmSinglePageFaultCount);
+            }
+        }
+
+        /* Lock both segment and process address space while we proceed. */
+        MmLockAddressSpace(AddressSpace);
+        MmLockSectionSegment(Segment);
+
+        /* Map the pages we read after the faulting one, and give up on the others */
+        for (i = 1; i < ClusterSize; i++)
+        {
+            ClusterAddress = (PCHAR)PAddress + i * PAGE_SIZE;
+            ClusterOffset.QuadPart = Offset.QuadPart + i * PAGE_SIZE;
+
+            MmDeletePageFileMapping(Process, ClusterAddress, &FakeSwapEntry);
+            if (i >= PagesRead)
+            {
+                MmSetPageEntrySectionSegment(Segment, &ClusterOffset, 0);
+                continue;
+            }
+
+            Status = MmCreateVirtualMapping(Process,
+                                            ClusterAddress,
+                                            Attributes,
+                                            &Pages[i],
+                                            1);
+            if (!NT_SUCCESS(Status))
+            {
+                DPRINT1("Unable to create virtual mapping\n");
+                KeBugCheck(MEMORY_MANAGEMENT);
+            }
+            MmInsertRmap(Pages[i], Process, ClusterAddress);
+
+            Entry = MAKE_SSE(Pages[i] << PAGE_SHIFT, 1);
+            MmSetPageEntrySectionSegment(Segment, &ClusterOffset, Entry);
+        }
+
+        if (!PagesRead)
         {
             /*
              * FIXME: What do we know in this case?
@@ -1541,16 +1672,12 @@ MmNotPresentFaultSectionView(PMMSUPPORT AddressSpace,
             /*
              * Cleanup and release locks
              */
-            MmLockAddressSpace(AddressSpace);
+            MmUnlockSectionSegment(Segment);
             MiSetPageEvent(Process, Address);
             DPRINT("Address 0x%p\n", Address);
             return(Status);
         }
 
-        /* Lock both segment and process address space while we proceed. */
-        MmLockAddressSpace(AddressSpace);
-        MmLockSectionSegment(Segment);
-
         MmDeletePageFileMapping(Process, PAddress, &FakeSwapEntry);
         DPRINT("CreateVirtualMapping Page %x Process %p PAddress %p Attributes %x\n",
                Page, Process, PAddress, Attributes);
@@ -3036,6 +3163,7 @@ MmCreateDataFileSection(PROS_SECTION_OBJECT *SectionObject,
         Segment->Flags = MM_DATAFILE_SEGMENT;
         Segment->Image.Characteristics = 0;
         Segment->WriteCopy = (SectionPageProtection & (PAGE_WRITECOPY | PAGE_EXECUTE_WRITECOPY));
+        Segment->ReadClusterSize = MmReadClusterSize;
         if (AllocationAttributes & SEC_RESERVE)
         {
             Segment->Length.QuadPart = Segment->RawLength.QuadPart = 0;
@@ -3698,6 +3826,7 @@ ExeFmtpCreateImageSection(PFILE_OBJECT FileObject,
     {
         ExInitializeFastMutex(&ImageSectionObject->Segments[i].Lock);
         ImageSectionObject->Segments[i].ReferenceCount = 1;
+        ImageSectionObject->Segments[i].ReadClusterSize = MmReadClusterSize;
         MiInitializeSectionPageTable(&ImageSectionObject->Segments[i]);
     }
 
@@ -673,6 +673,7 @@
 @ stdcall KeRemoveDeviceQueue(ptr)
 @ stdcall KeRemoveEntryDeviceQueue(ptr ptr)
 @ stdcall KeRemoveQueue(ptr long ptr)
+@ stdcall KeRemoveQueueEx(ptr long long ptr ptr long)
 @ stdcall KeRemoveQueueDpc(ptr)
 @ stdcall KeRemoveSystemServiceTable(long)
 @ stdcall KeResetEvent(ptr)
@@ -20,8 +20,79 @@
 BOOLEAN ObpLUIDDeviceMapsEnabled;
 POBJECT_TYPE ObDirectoryType = NULL;
 
+/* Prime bucket counts a directory grows through as it fills up */
+static const ULONG ObpDirectoryHashSizes[] =
+{
+    NUMBER_HASH_BUCKETS, 79, 163, 331, 673, 1361, 2729, 5471, 10949, 21911, 43853
+};
+
 /* PRIVATE FUNCTIONS ******************************************************/
 
+static
+POBJECT_DIRECTORY_ENTRY *
+ObpGetDirectoryHashBuckets(IN POBJECT_DIRECTORY Directory,
+                           OUT PULONG NumberOfBuckets)
+{
+    /* Small directories use the buckets embedded in the object */
+    if (!Directory->ExtendedHashBuckets)
+    {
+        *NumberOfBuckets = NUMBER_HASH_BUCKETS;
+        return Directory->HashBuckets;
+    }
+
+    *NumberOfBuckets = Directory->NumberOfHashBuckets;
+    return Directory->ExtendedHashBuckets;
+}
+
+static
+VOID
+ObpExpandDirectory(IN POBJECT_DIRECTORY Directory)
+{
+    POBJECT_DIRECTORY_ENTRY *OldBuckets, *NewBuckets, *Bucket;
+    POBJECT_DIRECTORY_ENTRY CurrentEntry, NextEntry;
+    ULONG OldCount, NewCount, i;
+
+    /* Find the next size, if there's one */
+    OldBuckets = ObpGetDirectoryHashBuckets(Directory, &OldCount);
+    for (i = 0; i < RTL_NUMBER_OF(ObpDirectoryHashSizes) - 1; i++)
+    {
+        if (ObpDirectoryHashSizes[i] == OldCount) break;
+    }
+    if (i == RTL_NUMBER_OF(ObpDirectoryHashSizes) - 1) return;
+    NewCount = ObpDirectoryHashSizes[i + 1];
+
+    /* It's fine to keep going with long chains if we can't grow */
+    NewBuckets = ExAllocatePoolWithTag(PagedPool,
+                                       NewCount * sizeof(POBJECT_DIRECTORY_ENTRY),
+                                       OB_DIR_TAG);
+    if (!NewBuckets) return;
+    RtlZeroMemory(NewBuckets, NewCount * sizeof(POBJECT_DIRECTORY_ENTRY));
+
+    /* Move every entry to its new chain, we own the directory exclusively */
+    for (i = 0; i < OldCount; i++)
+    {
+        for (CurrentEntry = OldBuckets[i]; CurrentEntry; CurrentEntry = NextEntry)
+        {
+            NextEntry = CurrentEntry->ChainLink;
+            Bucket = &NewBuckets[CurrentEntry->HashValue % NewCount];
+            CurrentEntry->ChainLink = *Bucket;
+            *Bucket = CurrentEntry;
+        }
+    }
+
+    /* Switch to the new buckets */
+    if (Directory->ExtendedHashBuckets)
+    {
+        ExFreePoolWithTag(Directory->ExtendedHashBuckets, OB_DIR_TAG);
+    }
+    else
+    {
+        RtlZeroMemory(Directory->HashBuckets, sizeof(Directory->HashBuckets));
+    }
+    Directory->ExtendedHashBuckets = NewBuckets;
+    Directory->NumberOfHashBuckets = NewCount;
+}
+
 /*++
 * @name ObpInsertEntryDirectory
 *
@@ -48,8 +119,10 @@ ObpInsertEntryDirectory(IN POBJECT_DIRECTORY Parent,
                         IN POBJECT_HEADER ObjectHeader)
 {
     POBJECT_DIRECTORY_ENTRY *AllocatedEntry;
+    POBJECT_DIRECTORY_ENTRY *HashBuckets;
     POBJECT_DIRECTORY_ENTRY NewEntry;
     POBJECT_HEADER_NAME_INFO HeaderNameInfo;
+    ULONG NumberOfBuckets;
 
     /* Make sure we have a name */
     ASSERT(ObjectHeader->NameInfoOffset != 0);
@@ -78,12 +151,22 @@ ObpInsertEntryDirectory(IN POBJECT_DIRECTORY Parent,
     /* Get the Object Name Information */
     HeaderNameInfo = OBJECT_HEADER_TO_NAME_INFO(ObjectHeader);
 
+    /* Keep the chains short, growing the table moves the entry's bucket */
+    HashBuckets = ObpGetDirectoryHashBuckets(Parent, &NumberOfBuckets);
+    if (Parent->NumberOfEntries >= 2 * NumberOfBuckets)
+    {
+        ObpExpandDirectory(Parent);
+        HashBuckets = ObpGetDirectoryHashBuckets(Parent, &NumberOfBuckets);
+        Context->HashIndex = (USHORT)(Context->HashValue % NumberOfBuckets);
+    }
+
     /* Get the Allocated entry */
-    AllocatedEntry = &Parent->HashBuckets[Context->HashIndex];
+    AllocatedEntry = &HashBuckets[Context->HashIndex];
 
     /* Set it */
     NewEntry->ChainLink = *AllocatedEntry;
     *AllocatedEntry = NewEntry;
+    Parent->NumberOfEntries++;
 
     /* Associate the Object */
     NewEntry->Object = &ObjectHeader->Body;
@@ -135,7 +218,9 @@ ObpLookupEntryDirectory(IN POBJECT_DIRECTORY Directory,
     WCHAR CurrentChar;
     POBJECT_DIRECTORY_ENTRY *AllocatedEntry;
     POBJECT_DIRECTORY_ENTRY *LookupBucket;
+    POBJECT_DIRECTORY_ENTRY *HashBuckets;
     POBJECT_DIRECTORY_ENTRY CurrentEntry;
+    ULONG NumberOfBuckets;
     PVOID FoundObject = NULL;
     PWSTR Buffer;
     PAGED_CODE();
@@ -171,24 +256,25 @@ ObpLookupEntryDirectory(IN POBJECT_DIRECTORY Directory,
         else HashValue += (CurrentChar - ('a'-'A'));
     }
 
+    /* Check if the directory is already locked */
+    if (!Context->DirectoryLocked)
+    {
+        /* Lock it, the table can only grow while it's held exclusively */
+        ObpAcquireDirectoryLockShared(Directory, Context);
+    }
+
     /* Merge it with our number of hash buckets */
-    HashIndex = HashValue % 37;
+    HashBuckets = ObpGetDirectoryHashBuckets(Directory, &NumberOfBuckets);
+    HashIndex = HashValue % NumberOfBuckets;
 
     /* Save the result */
     Context->HashValue = HashValue;
     Context->HashIndex = (USHORT)HashIndex;
 
     /* Get the root entry and set it as our lookup bucket */
-    AllocatedEntry = &Directory->HashBuckets[HashIndex];
+    AllocatedEntry = &HashBuckets[HashIndex];
     LookupBucket = AllocatedEntry;
 
-    /* Check if the directory is already locked */
-    if (!Context->DirectoryLocked)
-    {
-        /* Lock it */
-        ObpAcquireDirectoryLockShared(Directory, Context);
-    }
-
     /* Start looping */
     while ((CurrentEntry = *AllocatedEntry))
     {
@@ -217,12 +303,14 @@ ObpLookupEntryDirectory(IN POBJECT_DIRECTORY Directory,
     /* Check if we still have an entry */
     if (CurrentEntry)
     {
-        /* Set this entry as the first, to speed up incoming insertion */
+        /*
+         * Set this entry as the first, to speed up incoming deletion. Only do
+         * it if the caller owns the directory: converting a shared lock would
+         * serialize all the readers of a busy directory.
+         */
         if (AllocatedEntry != LookupBucket)
         {
-            /* Check if the directory was locked or convert the lock */
-            if ((Context->DirectoryLocked) ||
-                (ExConvertPushLockSharedToExclusive(&Directory->Lock)))
+            if (Context->DirectoryLocked)
             {
                 /* Set the Current Entry */
                 *AllocatedEntry = CurrentEntry->ChainLink;
@@ -312,18 +400,22 @@ ObpDeleteEntryDirectory(POBP_LOOKUP_CONTEXT Context)
     POBJECT_DIRECTORY Directory;
     POBJECT_DIRECTORY_ENTRY *AllocatedEntry;
     POBJECT_DIRECTORY_ENTRY CurrentEntry;
+    ULONG NumberOfBuckets;
 
     /* Get the Directory */
     Directory = Context->Directory;
     if (!Directory) return FALSE;
 
-    /* Get the Entry */
-    AllocatedEntry = &Directory->HashBuckets[Context->HashIndex];
+    /* Get the Entry, the exclusive lookup moved it to the head of its chain */
+    AllocatedEntry = &ObpGetDirectoryHashBuckets(Directory,
+                                                 &NumberOfBuckets)[Context->HashIndex];
     CurrentEntry = *AllocatedEntry;
+    ASSERT(Context->HashIndex < NumberOfBuckets);
 
     /* Unlink the Entry */
     *AllocatedEntry = CurrentEntry->ChainLink;
     CurrentEntry->ChainLink = NULL;
+    Directory->NumberOfEntries--;
 
     /* Free it */
     ExFreePoolWithTag(CurrentEntry, OB_DIR_TAG);
@@ -332,6 +424,36 @@ ObpDeleteEntryDirectory(POBP_LOOKUP_CONTEXT Context)
     return TRUE;
 }
 
+/*++
+* @name ObpDeleteDirectory
+*
+*     The ObpDeleteDirectory routine frees the hash table of a directory
+*     object that grew past its embedded buckets.
+*
+* @param Object
+*        Directory object being deleted.
+*
+* @return None.
+*
+* @remarks The directory is empty at this point, as every named object
+*          keeps a reference on its directory.
+*
+*--*/
+VOID
+NTAPI
+ObpDeleteDirectory(IN PVOID Object)
+{
+    POBJECT_DIRECTORY Directory = (POBJECT_DIRECTORY)Object;
+
+    ASSERT(Directory->NumberOfEntries == 0);
+
+    if (Directory->ExtendedHashBuckets)
+    {
+        ExFreePoolWithTag(Directory->ExtendedHashBuckets, OB_DIR_TAG);
+        Directory->ExtendedHashBuckets = NULL;
+    }
+}
+
 /* FUNCTIONS **************************************************************/
 
 /*++
@@ -469,7 +591,8 @@ NtQueryDirectoryObject(IN HANDLE DirectoryHandle,
     POBJECT_DIRECTORY_INFORMATION DirectoryInfo;
     ULONG Length, TotalLength;
     ULONG Count, CurrentEntry;
-    ULONG Hash;
+    ULONG Hash, NumberOfBuckets;
+    POBJECT_DIRECTORY_ENTRY *HashBuckets;
     POBJECT_DIRECTORY_ENTRY Entry;
     POBJECT_HEADER ObjectHeader;
     POBJECT_HEADER_NAME_INFO ObjectNameInfo;
@@ -544,10 +667,11 @@ NtQueryDirectoryObject(IN HANDLE DirectoryHandle,
 
     /* Set default status and start looping */
     Status = STATUS_NO_MORE_ENTRIES;
-    for (Hash = 0; Hash < 37; Hash++)
+    HashBuckets = ObpGetDirectoryHashBuckets(Directory, &NumberOfBuckets);
+    for (Hash = 0; Hash < NumberOfBuckets; Hash++)
     {
         /* Get this entry and loop all of them */
-        Entry = Directory->HashBuckets[Hash];
+        Entry = HashBuckets[Hash];
         while (Entry)
         {
             /* Check if we should process this entry */
@@ -280,7 +280,7 @@ ObInitSystem(VOID)
     ObjectTypeInitializer.CaseInsensitive = TRUE;
     ObjectTypeInitializer.MaintainTypeList = FALSE;
     ObjectTypeInitializer.GenericMapping = ObpDirectoryMapping;
-    ObjectTypeInitializer.DeleteProcedure = NULL;
+    ObjectTypeInitializer.DeleteProcedure = ObpDeleteDirectory;
     ObjectTypeInitializer.DefaultNonPagedPoolCharge = sizeof(OBJECT_DIRECTORY);
     ObCreateObjectType(&Name, &ObjectTypeInitializer, NULL, &ObDirectoryType);
     ObDirectoryType->TypeInfo.ValidAccessMask &= ~SYNCHRONIZE;
@@ -65,7 +65,14 @@ PspUserThreadStartup(IN PKSTART_ROUTINE StartRoutine,
         /* Check if the Prefetcher is enabled */
         if (CcPfEnablePrefetcher)
         {
-            /* FIXME: Prepare to prefetch this process */
+            /* Only the first thread of the process starts the launch */
+            if (!(PspSetProcessFlag(PsGetCurrentProcess(),
+                                    PSF_LAUNCH_PREFETCHED_BIT) &
+                  PSF_LAUNCH_PREFETCHED_BIT))
+            {
+                /* Prefetch and trace this launch */
+                CcPfBeginAppLaunch(PsGetCurrentProcess());
+            }
         }
 
         /* Raise to APC */
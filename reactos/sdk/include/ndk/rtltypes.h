@@ -437,6 +437,18 @@ typedef enum _RTL_GENERIC_COMPARE_RESULTS
     GenericEqual
 } RTL_GENERIC_COMPARE_RESULTS;
 
+//
+// I/O Completion Callback for the Thread Pool
+//
+typedef VOID
+(NTAPI *PTP_IO_CALLBACK)(
+    _Inout_ PTP_CALLBACK_INSTANCE Instance,
+    _Inout_opt_ PVOID Context,
+    _In_ PVOID ApcContext,
+    _In_ PIO_STATUS_BLOCK IoStatusBlock,
+    _In_ PTP_IO Io
+);
+
 #endif /* NTOS_MODE_USER */
 
 //
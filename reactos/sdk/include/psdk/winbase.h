@@ -778,6 +778,15 @@ typedef struct _OVERLAPPED {
 	HANDLE hEvent;
 } OVERLAPPED, *POVERLAPPED, *LPOVERLAPPED;
 
+#if (_WIN32_WINNT >= 0x0600)
+typedef struct _OVERLAPPED_ENTRY {
+	ULONG_PTR lpCompletionKey;
+	LPOVERLAPPED lpOverlapped;
+	ULONG_PTR Internal;
+	DWORD dwNumberOfBytesTransferred;
+} OVERLAPPED_ENTRY, *LPOVERLAPPED_ENTRY;
+#endif
+
 typedef struct _STARTUPINFOA {
 	DWORD	cb;
 	LPSTR	lpReserved;
@@ -2284,6 +2293,9 @@ GetProfileStringW(
   _In_ DWORD nSize);
 
 BOOL WINAPI GetQueuedCompletionStatus(HANDLE,PDWORD,PULONG_PTR,LPOVERLAPPED*,DWORD);
+#if (_WIN32_WINNT >= 0x0600)
+BOOL WINAPI GetQueuedCompletionStatusEx(HANDLE,LPOVERLAPPED_ENTRY,ULONG,PULONG,DWORD,BOOL);
+#endif
 BOOL WINAPI GetSecurityDescriptorControl(PSECURITY_DESCRIPTOR,PSECURITY_DESCRIPTOR_CONTROL,PDWORD);
 BOOL WINAPI GetSecurityDescriptorDacl(PSECURITY_DESCRIPTOR,LPBOOL,PACL*,LPBOOL);
 BOOL WINAPI GetSecurityDescriptorGroup(PSECURITY_DESCRIPTOR,PSID*,LPBOOL);
@@ -3837,6 +3849,119 @@ WINAPI
 InitializeSListHead(
     _Out_ PSLIST_HEADER ListHead);
 
+#if (_WIN32_WINNT >= 0x0600)
+
+typedef VOID
+(WINAPI *PTP_WIN32_IO_CALLBACK)(
+  _Inout_ PTP_CALLBACK_INSTANCE Instance,
+  _Inout_opt_ PVOID Context,
+  _Inout_opt_ PVOID Overlapped,
+  _In_ ULONG IoResult,
+  _In_ ULONG_PTR NumberOfBytesTransferred,
+  _Inout_ PTP_IO Io);
+
+PTP_POOL WINAPI CreateThreadpool(_Reserved_ PVOID);
+VOID WINAPI CloseThreadpool(_Inout_ PTP_POOL);
+VOID WINAPI SetThreadpoolThreadMaximum(_Inout_ PTP_POOL, _In_ DWORD);
+BOOL WINAPI SetThreadpoolThreadMinimum(_Inout_ PTP_POOL, _In_ DWORD);
+
+PTP_CLEANUP_GROUP WINAPI CreateThreadpoolCleanupGroup(VOID);
+VOID WINAPI CloseThreadpoolCleanupGroup(_Inout_ PTP_CLEANUP_GROUP);
+VOID WINAPI CloseThreadpoolCleanupGroupMembers(_Inout_ PTP_CLEANUP_GROUP, _In_ BOOL, _Inout_opt_ PVOID);
+
+PTP_WORK WINAPI CreateThreadpoolWork(_In_ PTP_WORK_CALLBACK, _Inout_opt_ PVOID, _In_opt_ PTP_CALLBACK_ENVIRON);
+VOID WINAPI SubmitThreadpoolWork(_Inout_ PTP_WORK);
+VOID WINAPI WaitForThreadpoolWorkCallbacks(_Inout_ PTP_WORK, _In_ BOOL);
+VOID WINAPI CloseThreadpoolWork(_Inout_ PTP_WORK);
+BOOL WINAPI TrySubmitThreadpoolCallback(_In_ PTP_SIMPLE_CALLBACK, _Inout_opt_ PVOID, _In_opt_ PTP_CALLBACK_ENVIRON);
+
+PTP_TIMER WINAPI CreateThreadpoolTimer(_In_ PTP_TIMER_CALLBACK, _Inout_opt_ PVOID, _In_opt_ PTP_CALLBACK_ENVIRON);
+VOID WINAPI SetThreadpoolTimer(_Inout_ PTP_TIMER, _In_opt_ PFILETIME, _In_ DWORD, _In_opt_ DWORD);
+BOOL WINAPI IsThreadpoolTimerSet(_Inout_ PTP_TIMER);
+VOID WINAPI WaitForThreadpoolTimerCallbacks(_Inout_ PTP_TIMER, _In_ BOOL);
+VOID WINAPI CloseThreadpoolTimer(_Inout_ PTP_TIMER);
+
+PTP_WAIT WINAPI CreateThreadpoolWait(_In_ PTP_WAIT_CALLBACK, _Inout_opt_ PVOID, _In_opt_ PTP_CALLBACK_ENVIRON);
+VOID WINAPI SetThreadpoolWait(_Inout_ PTP_WAIT, _In_opt_ HANDLE, _In_opt_ PFILETIME);
+VOID WINAPI WaitForThreadpoolWaitCallbacks(_Inout_ PTP_WAIT, _In_ BOOL);
+VOID WINAPI CloseThreadpoolWait(_Inout_ PTP_WAIT);
+
+PTP_IO WINAPI CreateThreadpoolIo(_In_ HANDLE, _In_ PTP_WIN32_IO_CALLBACK, _Inout_opt_ PVOID, _In_opt_ PTP_CALLBACK_ENVIRON);
+VOID WINAPI StartThreadpoolIo(_Inout_ PTP_IO);
+VOID WINAPI CancelThreadpoolIo(_Inout_ PTP_IO);
+VOID WINAPI WaitForThreadpoolIoCallbacks(_Inout_ PTP_IO, _In_ BOOL);
+VOID WINAPI CloseThreadpoolIo(_Inout_ PTP_IO);
+
+BOOL WINAPI CallbackMayRunLong(_Inout_ PTP_CALLBACK_INSTANCE);
+VOID WINAPI DisassociateCurrentThreadFromCallback(_Inout_ PTP_CALLBACK_INSTANCE);
+VOID WINAPI SetEventWhenCallbackReturns(_Inout_ PTP_CALLBACK_INSTANCE, _In_ HANDLE);
+VOID WINAPI ReleaseSemaphoreWhenCallbackReturns(_Inout_ PTP_CALLBACK_INSTANCE, _In_ HANDLE, _In_ DWORD);
+VOID WINAPI ReleaseMutexWhenCallbackReturns(_Inout_ PTP_CALLBACK_INSTANCE, _In_ HANDLE);
+VOID WINAPI LeaveCriticalSectionWhenCallbackReturns(_Inout_ PTP_CALLBACK_INSTANCE, _Inout_ PCRITICAL_SECTION);
+VOID WINAPI FreeLibraryWhenCallbackReturns(_Inout_ PTP_CALLBACK_INSTANCE, _In_ HMODULE);
+
+FORCEINLINE
+VOID
+InitializeThreadpoolEnvironment(
+  _Out_ PTP_CALLBACK_ENVIRON pcbe)
+{
+  TpInitializeCallbackEnviron(pcbe);
+}
+
+FORCEINLINE
+VOID
+SetThreadpoolCallbackPool(
+  _Inout_ PTP_CALLBACK_ENVIRON pcbe,
+  _In_ PTP_POOL ptpp)
+{
+  TpSetCallbackThreadpool(pcbe, ptpp);
+}
+
+FORCEINLINE
+VOID
+SetThreadpoolCallbackCleanupGroup(
+  _Inout_ PTP_CALLBACK_ENVIRON pcbe,
+  _In_ PTP_CLEANUP_GROUP ptpcg,
+  _In_opt_ PTP_CLEANUP_GROUP_CANCEL_CALLBACK pfng)
+{
+  TpSetCallbackCleanupGroup(pcbe, ptpcg, pfng);
+}
+
+FORCEINLINE
+VOID
+SetThreadpoolCallbackRunsLong(
+  _Inout_ PTP_CALLBACK_ENVIRON pcbe)
+{
+  TpSetCallbackLongFunction(pcbe);
+}
+
+FORCEINLINE
+VOID
+SetThreadpoolCallbackLibrary(
+  _Inout_ PTP_CALLBACK_ENVIRON pcbe,
+  _In_ PVOID mod)
+{
+  TpSetCallbackRaceWithDll(pcbe, mod);
+}
+
+FORCEINLINE
+VOID
+SetThreadpoolCallbackPersistent(
+  _Inout_ PTP_CALLBACK_ENVIRON pcbe)
+{
+  TpSetCallbackPersistent(pcbe);
+}
+
+FORCEINLINE
+VOID
+DestroyThreadpoolEnvironment(
+  _Inout_ PTP_CALLBACK_ENVIRON pcbe)
+{
+  TpDestroyCallbackEnviron(pcbe);
+}
+
+#endif /* _WIN32_WINNT >= 0x0600 */
+
 #ifdef _MSC_VER
 #pragma warning(pop)
 #endif
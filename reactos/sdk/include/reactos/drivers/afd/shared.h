@@ -59,6 +59,19 @@ typedef struct _AFD_POLL_INFO {
     AFD_HANDLE			        Handles[1];
 } AFD_POLL_INFO, *PAFD_POLL_INFO;
 
+/* Adds or changes the sockets a poll set watches, zero Events removes one */
+typedef struct _AFD_POLL_SET_UPDATE_INFO {
+    ULONG				HandleCount;
+    AFD_HANDLE			        Handles[1];
+} AFD_POLL_SET_UPDATE_INFO, *PAFD_POLL_SET_UPDATE_INFO;
+
+/* Only the ready sockets come back, with the handle they were added with */
+typedef struct _AFD_POLL_SET_WAIT_INFO {
+    LARGE_INTEGER		        Timeout;
+    ULONG				HandleCount;
+    AFD_HANDLE			        Handles[1];
+} AFD_POLL_SET_WAIT_INFO, *PAFD_POLL_SET_WAIT_INFO;
+
 typedef struct _AFD_ACCEPT_DATA {
     ULONG				UseSAN;
     ULONG				SequenceNumber;
@@ -149,6 +162,38 @@ typedef struct _AFD_TDI_HANDLE_DATA
     HANDLE TdiConnectionHandle;
 } AFD_TDI_HANDLE_DATA, *PAFD_TDI_HANDLE_DATA;
 
+typedef struct _AFD_TRANSMIT_RANGE {
+    LARGE_INTEGER			Offset;
+    ULONG				Length;
+} AFD_TRANSMIT_RANGE, *PAFD_TRANSMIT_RANGE;
+
+typedef struct _AFD_TRANSMIT_FILE_INFO {
+    HANDLE				FileHandle;
+    PAFD_TRANSMIT_RANGE			Ranges;
+    ULONG				RangeCount;
+    ULONG				SendSize;
+    AFD_WSABUF				Head;
+    AFD_WSABUF				Tail;
+    ULONG				Flags;
+} AFD_TRANSMIT_FILE_INFO, *PAFD_TRANSMIT_FILE_INFO;
+
+/* The buffer holds the receive data, then the local and the remote address */
+typedef struct _AFD_SUPER_ACCEPT_INFO {
+    PAFD_WSABUF				BufferArray;
+    ULONG				BufferCount;
+    HANDLE				AcceptHandle;
+    ULONG				ReceiveDataLength;
+    ULONG				LocalAddressLength;
+    ULONG				RemoteAddressLength;
+} AFD_SUPER_ACCEPT_INFO, *PAFD_SUPER_ACCEPT_INFO;
+
+/* The buffer is sent as soon as the connection is up */
+typedef struct _AFD_SUPER_CONNECT_INFO {
+    PAFD_WSABUF				BufferArray;
+    ULONG				BufferCount;
+    AFD_CONNECT_INFO			ConnectInfo;
+} AFD_SUPER_CONNECT_INFO, *PAFD_SUPER_CONNECT_INFO;
+
 /* AFD Packet Endpoint Flags */
 #define AFD_ENDPOINT_CONNECTIONLESS	0x1
 #define AFD_ENDPOINT_MESSAGE_ORIENTED	0x10
@@ -219,6 +264,9 @@ typedef struct _AFD_TDI_HANDLE_DATA
 #define AFD_OVERLAPPED			0x2L
 #define AFD_IMMEDIATE                   0x4L
 
+/* AFD Transmit Flags */
+#define AFD_TF_DISCONNECT		0x01L
+
 /* IOCTL Generation */
 #define FSCTL_AFD_BASE                  FILE_DEVICE_NETWORK
 #define _AFD_CONTROL_CODE(Operation,Method) \
@@ -259,6 +307,11 @@ typedef struct _AFD_TDI_HANDLE_DATA
 #define AFD_EVENT_SELECT		33
 #define AFD_ENUM_NETWORK_EVENTS         34
 #define AFD_DEFER_ACCEPT		35
+#define AFD_TRANSMIT_FILE		36
+#define AFD_SUPER_ACCEPT		37
+#define AFD_SUPER_CONNECT		38
+#define AFD_POLL_SET_UPDATE		39
+#define AFD_POLL_SET_WAIT		40
 #define AFD_GET_PENDING_CONNECT_DATA	41
 #define AFD_VALIDATE_GROUP		42
 
@@ -336,6 +389,16 @@ typedef struct _AFD_TDI_HANDLE_DATA
   _AFD_CONTROL_CODE(AFD_ENUM_NETWORK_EVENTS, METHOD_NEITHER)
 #define IOCTL_AFD_VALIDATE_GROUP \
   _AFD_CONTROL_CODE(AFD_VALIDATE_GROUP, METHOD_NEITHER)
+#define IOCTL_AFD_TRANSMIT_FILE \
+  _AFD_CONTROL_CODE(AFD_TRANSMIT_FILE, METHOD_NEITHER)
+#define IOCTL_AFD_SUPER_ACCEPT \
+  _AFD_CONTROL_CODE(AFD_SUPER_ACCEPT, METHOD_NEITHER)
+#define IOCTL_AFD_SUPER_CONNECT \
+  _AFD_CONTROL_CODE(AFD_SUPER_CONNECT, METHOD_NEITHER)
+#define IOCTL_AFD_POLL_SET_UPDATE \
+  _AFD_CONTROL_CODE(AFD_POLL_SET_UPDATE, METHOD_BUFFERED)
+#define IOCTL_AFD_POLL_SET_WAIT \
+  _AFD_CONTROL_CODE(AFD_POLL_SET_WAIT, METHOD_BUFFERED)
 
 typedef struct _AFD_SOCKET_INFORMATION {
     BOOL CommandChannel;
@@ -0,0 +1,72 @@
+/*
+ * PROJECT:         ReactOS Kernel
+ * LICENSE:         GPL - See COPYING in the top level directory
+ * FILE:            include/reactos/ldrcache.h
+ * PURPOSE:         Format of the KnownDlls import resolution cache
+ */
+#pragma once
+#ifndef _LDRCACHE_H
+#define _LDRCACHE_H
+
+//
+// SMSS resolves the imports that the known DLLs make from each other once per
+// boot and leaves the results in \KnownDlls\ImportCache, a read-only section
+// next to the known DLL sections. The loader uses them to fill whole IATs
+// without looking up any names, as long as both images are the exact versions
+// the cache was built from.
+//
+#define LDR_IMPORT_CACHE_NAME       L"ImportCache"
+#define LDR_IMPORT_CACHE_SIGNATURE  'CIdL'
+
+//
+// Known DLLs with longer file names are left out of the cache
+//
+#define LDR_IMPORT_CACHE_MAX_NAME   32
+
+//
+// One known DLL, identified by its file name and version
+//
+typedef struct _LDR_IMPORT_CACHE_IMAGE
+{
+    WCHAR BaseDllName[LDR_IMPORT_CACHE_MAX_NAME];
+    ULONG TimeDateStamp;
+    ULONG CheckSum;
+    ULONG SizeOfImage;
+    ULONG FirstDescriptor;
+    ULONG DescriptorCount;
+} LDR_IMPORT_CACHE_IMAGE, *PLDR_IMPORT_CACHE_IMAGE;
+
+//
+// One import descriptor of an importer, identified by the RVA of its IAT, and
+// the index of the image it was resolved against
+//
+typedef struct _LDR_IMPORT_CACHE_DESCRIPTOR
+{
+    ULONG FirstThunkRva;
+    ULONG ExportImage;
+    ULONG FirstThunk;
+    ULONG ThunkCount;
+} LDR_IMPORT_CACHE_DESCRIPTOR, *PLDR_IMPORT_CACHE_DESCRIPTOR;
+
+//
+// The images are followed by all the descriptors, and then by the export RVAs
+// of all the thunks. A zero RVA (forwarders, missing exports) must be snapped
+// the usual way.
+//
+typedef struct _LDR_IMPORT_CACHE_HEADER
+{
+    ULONG Signature;
+    ULONG Size;
+    ULONG ImageCount;
+    ULONG DescriptorCount;
+    ULONG ThunkCount;
+    LDR_IMPORT_CACHE_IMAGE Images[ANYSIZE_ARRAY];
+} LDR_IMPORT_CACHE_HEADER, *PLDR_IMPORT_CACHE_HEADER;
+
+#define LDR_IMPORT_CACHE_DESCRIPTORS(Header) \
+    ((PLDR_IMPORT_CACHE_DESCRIPTOR)&(Header)->Images[(Header)->ImageCount])
+
+#define LDR_IMPORT_CACHE_THUNKS(Header) \
+    ((PULONG)&LDR_IMPORT_CACHE_DESCRIPTORS(Header)[(Header)->DescriptorCount])
+
+#endif
@@ -4187,6 +4187,25 @@ typedef VOID
   _Inout_opt_ PVOID ObjectContext,
   _Inout_opt_ PVOID CleanupContext);
 
+typedef struct _TP_TIMER TP_TIMER, *PTP_TIMER;
+typedef struct _TP_WAIT TP_WAIT, *PTP_WAIT;
+typedef struct _TP_IO TP_IO, *PTP_IO;
+
+typedef DWORD TP_WAIT_RESULT;
+
+typedef VOID
+(NTAPI *PTP_TIMER_CALLBACK)(
+  _Inout_ PTP_CALLBACK_INSTANCE Instance,
+  _Inout_opt_ PVOID Context,
+  _Inout_ PTP_TIMER Timer);
+
+typedef VOID
+(NTAPI *PTP_WAIT_CALLBACK)(
+  _Inout_ PTP_CALLBACK_INSTANCE Instance,
+  _Inout_opt_ PVOID Context,
+  _Inout_ PTP_WAIT Wait,
+  _In_ TP_WAIT_RESULT WaitResult);
+
 #if (_WIN32_WINNT >= _WIN32_WINNT_WIN7)
 typedef struct _TP_CALLBACK_ENVIRON_V3 {
   TP_VERSION Version;
@@ -4227,6 +4246,108 @@ typedef struct _TP_CALLBACK_ENVIRON_V1 {
 } TP_CALLBACK_ENVIRON_V1, TP_CALLBACK_ENVIRON, *PTP_CALLBACK_ENVIRON;
 #endif /* (_WIN32_WINNT >= _WIN32_WINNT_WIN7) */
 
+FORCEINLINE
+VOID
+TpInitializeCallbackEnviron(
+  _Out_ PTP_CALLBACK_ENVIRON CallbackEnviron)
+{
+#if (_WIN32_WINNT >= _WIN32_WINNT_WIN7)
+  CallbackEnviron->Version = 3;
+#else
+  CallbackEnviron->Version = 1;
+#endif
+  CallbackEnviron->Pool = NULL;
+  CallbackEnviron->CleanupGroup = NULL;
+  CallbackEnviron->CleanupGroupCancelCallback = NULL;
+  CallbackEnviron->RaceDll = NULL;
+  CallbackEnviron->ActivationContext = NULL;
+  CallbackEnviron->FinalizationCallback = NULL;
+  CallbackEnviron->u.Flags = 0;
+#if (_WIN32_WINNT >= _WIN32_WINNT_WIN7)
+  CallbackEnviron->CallbackPriority = TP_CALLBACK_PRIORITY_NORMAL;
+  CallbackEnviron->Size = sizeof(TP_CALLBACK_ENVIRON);
+#endif
+}
+
+FORCEINLINE
+VOID
+TpSetCallbackThreadpool(
+  _Inout_ PTP_CALLBACK_ENVIRON CallbackEnviron,
+  _In_ PTP_POOL Pool)
+{
+  CallbackEnviron->Pool = Pool;
+}
+
+FORCEINLINE
+VOID
+TpSetCallbackCleanupGroup(
+  _Inout_ PTP_CALLBACK_ENVIRON CallbackEnviron,
+  _In_ PTP_CLEANUP_GROUP CleanupGroup,
+  _In_opt_ PTP_CLEANUP_GROUP_CANCEL_CALLBACK CleanupGroupCancelCallback)
+{
+  CallbackEnviron->CleanupGroup = CleanupGroup;
+  CallbackEnviron->CleanupGroupCancelCallback = CleanupGroupCancelCallback;
+}
+
+FORCEINLINE
+VOID
+TpSetCallbackActivationContext(
+  _Inout_ PTP_CALLBACK_ENVIRON CallbackEnviron,
+  _In_opt_ struct _ACTIVATION_CONTEXT *ActivationContext)
+{
+  CallbackEnviron->ActivationContext = ActivationContext;
+}
+
+FORCEINLINE
+VOID
+TpSetCallbackNoActivationContext(
+  _Inout_ PTP_CALLBACK_ENVIRON CallbackEnviron)
+{
+  CallbackEnviron->ActivationContext = (struct _ACTIVATION_CONTEXT *)(LONG_PTR)-1;
+}
+
+FORCEINLINE
+VOID
+TpSetCallbackLongFunction(
+  _Inout_ PTP_CALLBACK_ENVIRON CallbackEnviron)
+{
+  CallbackEnviron->u.s.LongFunction = 1;
+}
+
+FORCEINLINE
+VOID
+TpSetCallbackRaceWithDll(
+  _Inout_ PTP_CALLBACK_ENVIRON CallbackEnviron,
+  _In_ PVOID DllHandle)
+{
+  CallbackEnviron->RaceDll = DllHandle;
+}
+
+FORCEINLINE
+VOID
+TpSetCallbackFinalizationCallback(
+  _Inout_ PTP_CALLBACK_ENVIRON CallbackEnviron,
+  _In_ PTP_SIMPLE_CALLBACK FinalizationCallback)
+{
+  CallbackEnviron->FinalizationCallback = FinalizationCallback;
+}
+
+FORCEINLINE
+VOID
+TpSetCallbackPersistent(
+  _Inout_ PTP_CALLBACK_ENVIRON CallbackEnviron)
+{
+  CallbackEnviron->u.s.Persistent = 1;
+}
+
+FORCEINLINE
+VOID
+TpDestroyCallbackEnviron(
+  _In_ PTP_CALLBACK_ENVIRON CallbackEnviron)
+{
+  UNREFERENCED_PARAMETER(CallbackEnviron);
+}
+
 #ifdef _MSC_VER
 #pragma warning(pop)
 #endif
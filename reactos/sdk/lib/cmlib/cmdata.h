@@ -64,6 +64,9 @@ typedef struct _CM_VIEW_OF_FILE
     PULONG_PTR ViewAddress;
     PVOID Bcb;
     ULONG UseCount;
+    // Free cell headers saved while the view isn't mapped
+    PVOID FreeCells;
+    ULONG FreeCellCount;
 } CM_VIEW_OF_FILE, *PCM_VIEW_OF_FILE;
 
 //
@@ -1669,6 +1669,10 @@ CmpAddSubKey(IN PHHIVE Hive,
     /* Update the key counts */
     KeyNode->SubKeyCounts[Type]++;
 
+    /* Keep the view holding a volatile list mapped, the file has a stale one */
+    if ((Type == Volatile) && (KeyNode->SubKeyCounts[Volatile] == 1))
+        HvGetCell(Hive, Parent);
+
     /* Check if caller wants us to return the leaf */
     if (RootPointer)
     {
@@ -1811,6 +1815,11 @@ CmpRemoveSubKey(IN PHHIVE Hive,
 
     /* Decrement key counts and check if this was the last leaf entry */
     Node->SubKeyCounts[Storage]--;
+    if ((Storage == Volatile) && !(Node->SubKeyCounts[Volatile]))
+    {
+        /* The volatile list is going away, the view can be unmapped again */
+        HvReleaseCell(Hive, ParentKey);
+    }
     if (!(--Leaf->Count))
     {
         /* Free the leaf */
@@ -73,7 +73,7 @@ CmCreateRootNode(
 static VOID CMAPI
 CmpPrepareKey(
     PHHIVE RegistryHive,
-    PCM_KEY_NODE KeyCell);
+    HCELL_INDEX KeyCellIndex);
 
 static VOID CMAPI
 CmpPrepareIndexOfKeys(
@@ -89,9 +89,15 @@ CmpPrepareIndexOfKeys(
         {
             PCM_KEY_INDEX SubIndexCell = HvGetCell(RegistryHive, IndexCell->List[i]);
             if (SubIndexCell->Signature == CM_KEY_NODE_SIGNATURE)
-                CmpPrepareKey(RegistryHive, (PCM_KEY_NODE)SubIndexCell);
+            {
+                HvReleaseCell(RegistryHive, IndexCell->List[i]);
+                CmpPrepareKey(RegistryHive, IndexCell->List[i]);
+            }
             else
+            {
                 CmpPrepareIndexOfKeys(RegistryHive, SubIndexCell);
+                HvReleaseCell(RegistryHive, IndexCell->List[i]);
+            }
         }
    }
     else if (IndexCell->Signature == CM_KEY_FAST_LEAF ||
@@ -100,8 +106,7 @@ CmpPrepareIndexOfKeys(
         PCM_KEY_FAST_INDEX HashCell = (PCM_KEY_FAST_INDEX)IndexCell;
         for (i = 0; i < HashCell->Count; i++)
         {
-            PCM_KEY_NODE SubKeyCell = HvGetCell(RegistryHive, HashCell->List[i].Cell);
-            CmpPrepareKey(RegistryHive, SubKeyCell);
+            CmpPrepareKey(RegistryHive, HashCell->List[i].Cell);
         }
     }
     else
@@ -114,10 +119,12 @@ CmpPrepareIndexOfKeys(
 static VOID CMAPI
 CmpPrepareKey(
     PHHIVE RegistryHive,
-    PCM_KEY_NODE KeyCell)
+    HCELL_INDEX KeyCellIndex)
 {
+    PCM_KEY_NODE KeyCell;
     PCM_KEY_INDEX IndexCell;
 
+    KeyCell = HvGetCell(RegistryHive, KeyCellIndex);
     ASSERT(KeyCell->Signature == CM_KEY_NODE_SIGNATURE);
 
     KeyCell->SubKeyLists[Volatile] = HCELL_NIL;
@@ -128,15 +135,15 @@ CmpPrepareKey(
     {
         IndexCell = HvGetCell(RegistryHive, KeyCell->SubKeyLists[Stable]);
         CmpPrepareIndexOfKeys(RegistryHive, IndexCell);
+        HvReleaseCell(RegistryHive, KeyCell->SubKeyLists[Stable]);
     }
+
+    HvReleaseCell(RegistryHive, KeyCellIndex);
 }
 
 VOID CMAPI
 CmPrepareHive(
     PHHIVE RegistryHive)
 {
-    PCM_KEY_NODE RootCell;
-
-    RootCell = HvGetCell(RegistryHive, RegistryHive->BaseBlock->RootCell);
-    CmpPrepareKey(RegistryHive, RootCell);
+    CmpPrepareKey(RegistryHive, RegistryHive->BaseBlock->RootCell);
 }
@@ -476,6 +476,16 @@ NTSTATUS CMAPI
 HvpCreateHiveFreeCellList(
    PHHIVE Hive);
 
+PHBIN CMAPI
+HvpGetBin(
+   PHHIVE RegistryHive,
+   ULONG BlockIndex);
+
+VOID CMAPI
+HvpReleaseBin(
+   PHHIVE RegistryHive,
+   ULONG BlockIndex);
+
 ULONG CMAPI
 HvpHiveHeaderChecksum(
    PHBASE_BLOCK HiveHeader);
@@ -58,11 +58,16 @@ HvpAddBin(
     RegistryHive->Storage[Storage].BlockList = BlockList;
     RegistryHive->Storage[Storage].Length += BlockCount;
 
+    /* New bins are only added once all free cells are known */
+    ASSERT(RegistryHive->Storage[Storage].FreeScanBlock == OldBlockListSize);
+    RegistryHive->Storage[Storage].FreeScanBlock = RegistryHive->Storage[Storage].Length;
+
     for (i = 0; i < BlockCount; i++)
     {
         RegistryHive->Storage[Storage].BlockList[OldBlockListSize + i].BlockAddress =
             ((ULONG_PTR)Bin + (i * HBLOCK_SIZE));
         RegistryHive->Storage[Storage].BlockList[OldBlockListSize + i].BinAddress = (ULONG_PTR)Bin;
+        RegistryHive->Storage[Storage].BlockList[OldBlockListSize + i].CmView = NULL;
     }
 
     /* Initialize a free block in this heap. */
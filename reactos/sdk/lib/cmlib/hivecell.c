@@ -9,6 +9,10 @@
 #define NDEBUG
 #include <debug.h>
 
+/*
+ * For mapped hives the header is returned referenced, the caller keeps the
+ * view holding the cell mapped until it calls HvReleaseCell on the cell.
+ */
 static __inline PHCELL CMAPI
 HvpGetCellHeader(
     PHHIVE RegistryHive,
@@ -27,6 +31,13 @@ HvpGetCellHeader(
         ULONG CellOffset = (CellIndex & HCELL_OFFSET_MASK) >> HCELL_OFFSET_SHIFT;
 
         ASSERT(CellBlock < RegistryHive->Storage[CellType].Length);
+        if (RegistryHive->GetCellRoutine)
+        {
+            /* Bring in the view holding the cell and keep it referenced */
+            Block = RegistryHive->GetCellRoutine(RegistryHive, CellIndex);
+            if (!Block) return NULL;
+            return (PHCELL)Block - 1;
+        }
         Block = (PVOID)RegistryHive->Storage[CellType].BlockList[CellBlock].BlockAddress;
         ASSERT(Block != NULL);
         return (PVOID)((ULONG_PTR)Block + CellOffset);
@@ -55,8 +66,9 @@ HvIsCellAllocated(IN PHHIVE RegistryHive,
     if (Block >= RegistryHive->Storage[Type].Length)
         return FALSE;
 
-    /* Try to get the cell block */
-    if (RegistryHive->Storage[Type].BlockList[Block].BlockAddress)
+    /* Try to get the cell block, or the view it gets mapped from */
+    if (RegistryHive->Storage[Type].BlockList[Block].BlockAddress ||
+        RegistryHive->Storage[Type].BlockList[Block].CmView)
         return TRUE;
 
     /* No valid block, fail */
@@ -69,9 +81,42 @@ HvGetCell(
     HCELL_INDEX CellIndex)
 {
     ASSERT(CellIndex != HCELL_NIL);
+
+    /* Mapped hives reference the view holding the cell */
+    if (RegistryHive->GetCellRoutine)
+        return RegistryHive->GetCellRoutine(RegistryHive, CellIndex);
+
     return (PVOID)(HvpGetCellHeader(RegistryHive, CellIndex) + 1);
 }
 
+/*
+ * Returns the stable bin holding the block. For mapped hives the view
+ * holding the bin stays referenced until HvpReleaseBin is called.
+ */
+PHBIN CMAPI
+HvpGetBin(
+    PHHIVE RegistryHive,
+    ULONG BlockIndex)
+{
+    ASSERT(BlockIndex < RegistryHive->Storage[Stable].Length);
+
+    if (RegistryHive->GetCellRoutine &&
+        !RegistryHive->GetCellRoutine(RegistryHive, BlockIndex * HBLOCK_SIZE))
+    {
+        return NULL;
+    }
+
+    return (PHBIN)RegistryHive->Storage[Stable].BlockList[BlockIndex].BinAddress;
+}
+
+VOID CMAPI
+HvpReleaseBin(
+    PHHIVE RegistryHive,
+    ULONG BlockIndex)
+{
+    HvReleaseCell(RegistryHive, BlockIndex * HBLOCK_SIZE);
+}
+
 static __inline LONG CMAPI
 HvpGetCellFullSize(
     PHHIVE RegistryHive,
@@ -204,6 +249,8 @@ HvpRemoveFree(
 {
     PHCELL_INDEX FreeCellData;
     PHCELL_INDEX pFreeCellOffset;
+    HCELL_INDEX FreeCellOffset;
+    HCELL_INDEX PreviousCell = HCELL_NIL;
     HSTORAGE_TYPE Storage;
     ULONG Index, FreeListIndex;
 
@@ -212,18 +259,29 @@ HvpRemoveFree(
     Storage = HvGetCellType(CellIndex);
     Index = HvpComputeFreeListIndex((ULONG)CellBlock->Size);
 
+    /* Keep the previous cell referenced while we may still write its link */
     pFreeCellOffset = &RegistryHive->Storage[Storage].FreeDisplay[Index];
     while (*pFreeCellOffset != HCELL_NIL)
     {
-        FreeCellData = (PHCELL_INDEX)HvGetCell(RegistryHive, *pFreeCellOffset);
-        if (*pFreeCellOffset == CellIndex)
+        FreeCellOffset = *pFreeCellOffset;
+        FreeCellData = (PHCELL_INDEX)HvGetCell(RegistryHive, FreeCellOffset);
+        if (FreeCellOffset == CellIndex)
         {
             *pFreeCellOffset = *FreeCellData;
+            HvReleaseCell(RegistryHive, FreeCellOffset);
+            if (PreviousCell != HCELL_NIL)
+                HvReleaseCell(RegistryHive, PreviousCell);
             return;
         }
+        if (PreviousCell != HCELL_NIL)
+            HvReleaseCell(RegistryHive, PreviousCell);
+        PreviousCell = FreeCellOffset;
         pFreeCellOffset = FreeCellData;
     }
 
+    if (PreviousCell != HCELL_NIL)
+        HvReleaseCell(RegistryHive, PreviousCell);
+
     /* Something bad happened, print a useful trace info and bugcheck */
     CMLTRACE(CMLIB_HCELL_DEBUG, "-- beginning of HvpRemoveFree trace --\n");
     CMLTRACE(CMLIB_HCELL_DEBUG, "block we are about to free: %08x\n", CellIndex);
@@ -231,12 +289,14 @@ HvpRemoveFree(
     for (FreeListIndex = 0; FreeListIndex < 24; FreeListIndex++)
     {
         CMLTRACE(CMLIB_HCELL_DEBUG, "free list [%u]: ", FreeListIndex);
-        pFreeCellOffset = &RegistryHive->Storage[Storage].FreeDisplay[FreeListIndex];
-        while (*pFreeCellOffset != HCELL_NIL)
+        FreeCellOffset = RegistryHive->Storage[Storage].FreeDisplay[FreeListIndex];
+        while (FreeCellOffset != HCELL_NIL)
         {
-            CMLTRACE(CMLIB_HCELL_DEBUG, "%08x ", *pFreeCellOffset);
-            FreeCellData = (PHCELL_INDEX)HvGetCell(RegistryHive, *pFreeCellOffset);
-            pFreeCellOffset = FreeCellData;
+            CMLTRACE(CMLIB_HCELL_DEBUG, "%08x ", FreeCellOffset);
+            FreeCellData = (PHCELL_INDEX)HvGetCell(RegistryHive, FreeCellOffset);
+            PreviousCell = FreeCellOffset;
+            FreeCellOffset = *FreeCellData;
+            HvReleaseCell(RegistryHive, PreviousCell);
         }
         CMLTRACE(CMLIB_HCELL_DEBUG, "\n");
     }
@@ -245,6 +305,56 @@ HvpRemoveFree(
     ASSERT(FALSE);
 }
 
+/*
+ * Adds the free cells of the stable bins that the free lists don't know
+ * about yet, and stops after a bin with a free cell of at least Size bytes.
+ * The bins of mapped hives thus only get mapped once space is needed.
+ */
+static BOOLEAN CMAPI
+HvpScanFreeCells(
+    PHHIVE Hive,
+    ULONG Size)
+{
+    PHCELL FreeBlock;
+    ULONG BlockIndex;
+    ULONG FreeOffset;
+    PHBIN Bin;
+    BOOLEAN Found = FALSE;
+
+    while (!Found &&
+           Hive->Storage[Stable].FreeScanBlock < Hive->Storage[Stable].Length)
+    {
+        BlockIndex = Hive->Storage[Stable].FreeScanBlock;
+        Bin = HvpGetBin(Hive, BlockIndex);
+        if (Bin == NULL)
+            return FALSE;
+
+        /* Search free blocks and add to list */
+        FreeOffset = sizeof(HBIN);
+        while (FreeOffset < Bin->Size)
+        {
+            FreeBlock = (PHCELL)((ULONG_PTR)Bin + FreeOffset);
+            if (FreeBlock->Size > 0)
+            {
+                HvpAddFree(Hive, FreeBlock, Bin->FileOffset + FreeOffset);
+                if ((ULONG)FreeBlock->Size >= Size)
+                    Found = TRUE;
+
+                FreeOffset += FreeBlock->Size;
+            }
+            else
+            {
+                FreeOffset -= FreeBlock->Size;
+            }
+        }
+
+        Hive->Storage[Stable].FreeScanBlock = BlockIndex + Bin->Size / HBLOCK_SIZE;
+        HvpReleaseBin(Hive, BlockIndex);
+    }
+
+    return Found;
+}
+
 static HCELL_INDEX CMAPI
 HvpFindFree(
     PHHIVE RegistryHive,
@@ -253,25 +363,41 @@ HvpFindFree(
 {
     PHCELL_INDEX FreeCellData;
     HCELL_INDEX FreeCellOffset;
+    HCELL_INDEX PreviousCell;
     PHCELL_INDEX pFreeCellOffset;
     ULONG Index;
 
+Retry:
     for (Index = HvpComputeFreeListIndex(Size); Index < 24; Index++)
     {
+        /* Keep the previous cell referenced while we may still write its link */
+        PreviousCell = HCELL_NIL;
         pFreeCellOffset = &RegistryHive->Storage[Storage].FreeDisplay[Index];
         while (*pFreeCellOffset != HCELL_NIL)
         {
-            FreeCellData = (PHCELL_INDEX)HvGetCell(RegistryHive, *pFreeCellOffset);
+            FreeCellOffset = *pFreeCellOffset;
+            FreeCellData = (PHCELL_INDEX)HvGetCell(RegistryHive, FreeCellOffset);
             if ((ULONG)HvpGetCellFullSize(RegistryHive, FreeCellData) >= Size)
             {
-                FreeCellOffset = *pFreeCellOffset;
                 *pFreeCellOffset = *FreeCellData;
+                HvReleaseCell(RegistryHive, FreeCellOffset);
+                if (PreviousCell != HCELL_NIL)
+                    HvReleaseCell(RegistryHive, PreviousCell);
                 return FreeCellOffset;
             }
+            if (PreviousCell != HCELL_NIL)
+                HvReleaseCell(RegistryHive, PreviousCell);
+            PreviousCell = FreeCellOffset;
             pFreeCellOffset = FreeCellData;
         }
+        if (PreviousCell != HCELL_NIL)
+            HvReleaseCell(RegistryHive, PreviousCell);
     }
 
+    /* The bins that weren't scanned yet may have a cell that fits */
+    if ((Storage == Stable) && HvpScanFreeCells(RegistryHive, Size))
+        goto Retry;
+
     return HCELL_NIL;
 }
 
@@ -279,12 +405,6 @@ NTSTATUS CMAPI
 HvpCreateHiveFreeCellList(
     PHHIVE Hive)
 {
-    HCELL_INDEX BlockOffset;
-    PHCELL FreeBlock;
-    ULONG BlockIndex;
-    ULONG FreeOffset;
-    PHBIN Bin;
-    NTSTATUS Status;
     ULONG Index;
 
     /* Initialize the free cell list */
@@ -293,35 +413,17 @@ HvpCreateHiveFreeCellList(
         Hive->Storage[Stable].FreeDisplay[Index] = HCELL_NIL;
         Hive->Storage[Volatile].FreeDisplay[Index] = HCELL_NIL;
     }
+    Hive->Storage[Stable].FreeScanBlock = 0;
+    Hive->Storage[Volatile].FreeScanBlock = Hive->Storage[Volatile].Length;
 
-    BlockOffset = 0;
-    BlockIndex = 0;
-    while (BlockIndex < Hive->Storage[Stable].Length)
-    {
-        Bin = (PHBIN)Hive->Storage[Stable].BlockList[BlockIndex].BinAddress;
-
-        /* Search free blocks and add to list */
-        FreeOffset = sizeof(HBIN);
-        while (FreeOffset < Bin->Size)
-        {
-            FreeBlock = (PHCELL)((ULONG_PTR)Bin + FreeOffset);
-            if (FreeBlock->Size > 0)
-            {
-                Status = HvpAddFree(Hive, FreeBlock, Bin->FileOffset + FreeOffset);
-                if (!NT_SUCCESS(Status))
-                    return Status;
-
-                FreeOffset += FreeBlock->Size;
-            }
-            else
-            {
-                FreeOffset -= FreeBlock->Size;
-            }
-        }
+    /* Mapped hives look for free cells once they need them */
+    if (Hive->GetCellRoutine)
+        return STATUS_SUCCESS;
 
-        BlockIndex += Bin->Size / HBLOCK_SIZE;
-        BlockOffset += Bin->Size;
-    }
+    /* Add the free cells of every bin */
+    HvpScanFreeCells(Hive, MAXULONG);
+    if (Hive->Storage[Stable].FreeScanBlock != Hive->Storage[Stable].Length)
+        return STATUS_REGISTRY_CORRUPT;
 
     return STATUS_SUCCESS;
 }
@@ -352,6 +454,13 @@ HvAllocateCell(
     /* If no free cell was found we need to extend the hive file. */
     if (FreeCellOffset == HCELL_NIL)
     {
+        /* Bins we couldn't look into may still have free cells */
+        if (RegistryHive->Storage[Storage].FreeScanBlock !=
+            RegistryHive->Storage[Storage].Length)
+        {
+            return HCELL_NIL;
+        }
+
         Bin = HvpAddBin(RegistryHive, Size, Storage);
         if (Bin == NULL)
             return HCELL_NIL;
@@ -360,6 +469,8 @@ HvAllocateCell(
     }
 
     FreeCell = HvpGetCellHeader(RegistryHive, FreeCellOffset);
+    if (FreeCell == NULL)
+        return HCELL_NIL;
 
     /* Split the block in two parts */
 
@@ -383,6 +494,7 @@ HvAllocateCell(
 
     FreeCell->Size = -FreeCell->Size;
     RtlZeroMemory(FreeCell + 1, Size - sizeof(HCELL));
+    HvReleaseCell(RegistryHive, FreeCellOffset);
 
     CMLTRACE(CMLIB_HCELL_DEBUG, "%s - CellIndex %08lx\n",
              __FUNCTION__, FreeCellOffset);
@@ -424,16 +536,22 @@ HvReallocateCell(
     {
         NewCellIndex = HvAllocateCell(RegistryHive, Size, Storage, HCELL_NIL);
         if (NewCellIndex == HCELL_NIL)
+        {
+            HvReleaseCell(RegistryHive, CellIndex);
             return HCELL_NIL;
+        }
 
         NewCell = HvGetCell(RegistryHive, NewCellIndex);
         RtlCopyMemory(NewCell, OldCell, (SIZE_T)OldCellSize);
+        HvReleaseCell(RegistryHive, NewCellIndex);
+        HvReleaseCell(RegistryHive, CellIndex);
 
         HvFreeCell(RegistryHive, CellIndex);
 
         return NewCellIndex;
     }
 
+    HvReleaseCell(RegistryHive, CellIndex);
     return CellIndex;
 }
 
@@ -454,6 +572,8 @@ HvFreeCell(
              __FUNCTION__, RegistryHive, CellIndex);
 
     Free = HvpGetCellHeader(RegistryHive, CellIndex);
+    if (Free == NULL)
+        return;
 
     ASSERT(Free->Size < 0);
 
@@ -462,6 +582,15 @@ HvFreeCell(
     CellType = HvGetCellType(CellIndex);
     CellBlock = HvGetCellBlock(CellIndex);
 
+    /* Bins that weren't scanned yet pick the cell up once they are */
+    if (CellBlock >= RegistryHive->Storage[CellType].FreeScanBlock)
+    {
+        ASSERT(CellType == Stable);
+        HvMarkCellDirty(RegistryHive, CellIndex, FALSE);
+        HvReleaseCell(RegistryHive, CellIndex);
+        return;
+    }
+
     /* FIXME: Merge free blocks */
     Bin = (PHBIN)RegistryHive->Storage[CellType].BlockList[CellBlock].BinAddress;
 
@@ -502,6 +631,7 @@ HvFreeCell(
                 if (CellType == Stable)
                     HvMarkCellDirty(RegistryHive, NeighborCellIndex, FALSE);
 
+                HvReleaseCell(RegistryHive, CellIndex);
                 return;
             }
             Neighbor = (PHCELL)((ULONG_PTR)Neighbor + Neighbor->Size);
@@ -517,6 +647,8 @@ HvFreeCell(
 
     if (CellType == Stable)
         HvMarkCellDirty(RegistryHive, CellIndex, FALSE);
+
+    HvReleaseCell(RegistryHive, CellIndex);
 }
 
 
@@ -275,6 +275,8 @@ typedef struct _DUAL
     HCELL_INDEX FreeDisplay[24]; // FREE_DISPLAY FreeDisplay[24];
     ULONG FreeSummary;
     LIST_ENTRY FreeBins;
+    // ReactOS: first block whose free cells aren't in FreeDisplay yet
+    ULONG FreeScanBlock;
 } DUAL, *PDUAL;
 
 typedef struct _HHIVE
@@ -64,6 +64,9 @@ HvpFreeHiveBins(
         {
             if (Hive->Storage[Storage].BlockList[i].BinAddress == (ULONG_PTR)NULL)
                 continue;
+            /* Views of mapped hives are owned by whoever mapped them */
+            if (Hive->Storage[Storage].BlockList[i].CmView != NULL)
+                continue;
             if (Hive->Storage[Storage].BlockList[i].BinAddress != (ULONG_PTR)Bin)
             {
                 Bin = (PHBIN)Hive->Storage[Storage].BlockList[i].BinAddress;
@@ -290,6 +293,7 @@ HvpInitializeMemoryHive(
 
         Hive->Storage[Stable].BlockList[BlockIndex].BinAddress = (ULONG_PTR)NewBin;
         Hive->Storage[Stable].BlockList[BlockIndex].BlockAddress = (ULONG_PTR)NewBin;
+        Hive->Storage[Stable].BlockList[BlockIndex].CmView = NULL;
 
         RtlCopyMemory(NewBin, Bin, Bin->Size);
 
@@ -300,6 +304,7 @@ HvpInitializeMemoryHive(
                 Hive->Storage[Stable].BlockList[BlockIndex + i].BinAddress = (ULONG_PTR)NewBin;
                 Hive->Storage[Stable].BlockList[BlockIndex + i].BlockAddress =
                     ((ULONG_PTR)NewBin + (i * HBLOCK_SIZE));
+                Hive->Storage[Stable].BlockList[BlockIndex + i].CmView = NULL;
             }
         }
 
@@ -488,6 +493,118 @@ HvLoadHive(IN PHHIVE Hive,
     return Status;
 }
 
+/**
+ * @name HvpMapHive
+ *
+ * Internal helper function to initialize a hive descriptor for a hive
+ * file whose bins are brought into memory on demand. Only the header is
+ * read here, the hive's GetCellRoutine maps the bins as cells are used.
+ *
+ * @see HvInitialize
+ */
+NTSTATUS CMAPI
+HvpMapHive(IN PHHIVE Hive,
+           IN PCUNICODE_STRING FileName OPTIONAL)
+{
+    NTSTATUS Status;
+    PHBASE_BLOCK BaseBlock = NULL;
+    ULONG Result;
+    LARGE_INTEGER TimeStamp;
+    ULONG BitmapSize;
+    PULONG BitmapBuffer;
+
+    /* Without a way to map the bins, read the whole hive */
+    if (!Hive->GetCellRoutine)
+        return HvLoadHive(Hive, FileName);
+
+    /* Get the hive header */
+    Result = HvpGetHiveHeader(Hive, &BaseBlock, &TimeStamp);
+    switch (Result)
+    {
+        /* Out of memory */
+        case NoMemory:
+
+            /* Fail */
+            return STATUS_INSUFFICIENT_RESOURCES;
+
+        /* Not a hive */
+        case NotHive:
+
+            /* Fail */
+            return STATUS_NOT_REGISTRY_FILE;
+
+        /* Has recovery data */
+        case RecoverData:
+        case RecoverHeader:
+
+            /* Fail */
+            return STATUS_REGISTRY_CORRUPT;
+    }
+
+    /* Set default boot type */
+    BaseBlock->BootType = 0;
+
+    /* Setup hive data */
+    Hive->BaseBlock = BaseBlock;
+    Hive->Version = BaseBlock->Minor;
+
+    /* The blocks get their addresses once the view holding them is mapped */
+    Hive->Storage[Stable].Length = BaseBlock->Length / HBLOCK_SIZE;
+    Hive->Storage[Stable].BlockList =
+        Hive->Allocate(Hive->Storage[Stable].Length *
+                       sizeof(HMAP_ENTRY), TRUE, TAG_CM);
+    if (Hive->Storage[Stable].BlockList == NULL)
+    {
+        DPRINT1("Allocating block list failed\n");
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto Cleanup;
+    }
+
+    RtlZeroMemory(Hive->Storage[Stable].BlockList,
+                  Hive->Storage[Stable].Length * sizeof(HMAP_ENTRY));
+
+    /* Views can't be unmapped without knowing whether they are dirty */
+    BitmapSize = ROUND_UP(Hive->Storage[Stable].Length,
+                          sizeof(ULONG) * 8) / 8;
+    BitmapBuffer = (PULONG)Hive->Allocate(BitmapSize, TRUE, TAG_CM);
+    if (BitmapBuffer == NULL)
+    {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto Cleanup;
+    }
+
+    RtlInitializeBitMap(&Hive->DirtyVector, BitmapBuffer, BitmapSize * 8);
+    RtlClearAllBits(&Hive->DirtyVector);
+
+    /* The bins are only scanned for free cells once those are needed */
+    Status = HvpCreateHiveFreeCellList(Hive);
+    if (!NT_SUCCESS(Status))
+        goto Cleanup;
+
+    HvpInitFileName(Hive->BaseBlock, FileName);
+
+    return STATUS_SUCCESS;
+
+Cleanup:
+    if (Hive->DirtyVector.Buffer)
+    {
+        Hive->Free(Hive->DirtyVector.Buffer, 0);
+        RtlZeroMemory(&Hive->DirtyVector, sizeof(RTL_BITMAP));
+    }
+
+    /* The views themselves are freed by the caller */
+    if (Hive->Storage[Stable].BlockList)
+    {
+        Hive->Free(Hive->Storage[Stable].BlockList, 0);
+        Hive->Storage[Stable].BlockList = NULL;
+        Hive->Storage[Stable].Length = 0;
+    }
+
+    Hive->Free(BaseBlock, Hive->BaseBlockAlloc);
+    Hive->BaseBlock = NULL;
+    return Status;
+}
+
 /**
  * @name HvInitialize
  *
@@ -506,6 +623,10 @@ HvLoadHive(IN PHHIVE Hive,
  *          Load an in-memory hive for read-only access. The pointer
  *          to data passed to this routine MUSTN'T be freed until
  *          HvFree is called.
+ *        - HINIT_MAPFILE
+ *          Load a hive file whose bins are mapped on demand. The caller
+ *          sets the GetCellRoutine and ReleaseCellRoutine of the hive
+ *          before calling this routine.
  * @param ChunkBase
  *        Pointer to hive data.
  * @param ChunkSize
@@ -536,6 +657,15 @@ HvInitialize(
 {
     NTSTATUS Status;
     PHHIVE Hive = RegistryHive;
+    PGET_CELL_ROUTINE GetCellRoutine = NULL;
+    PRELEASE_CELL_ROUTINE ReleaseCellRoutine = NULL;
+
+    /* Mapped hives come with the routines that map their views */
+    if (OperationType == HINIT_MAPFILE)
+    {
+        GetCellRoutine = Hive->GetCellRoutine;
+        ReleaseCellRoutine = Hive->ReleaseCellRoutine;
+    }
 
     /*
      * Create a new hive structure that will hold all the maintenance data.
@@ -543,6 +673,9 @@ HvInitialize(
 
     RtlZeroMemory(Hive, sizeof(HHIVE));
 
+    Hive->GetCellRoutine = GetCellRoutine;
+    Hive->ReleaseCellRoutine = ReleaseCellRoutine;
+
     Hive->Allocate = Allocate;
     Hive->Free = Free;
     Hive->FileSetSize = FileSetSize;
@@ -588,12 +721,25 @@ HvInitialize(
             break;
         }
 
+        case HINIT_MAPFILE:
+        {
+            Status = HvpMapHive(Hive, FileName);
+            if ((Status != STATUS_SUCCESS) &&
+                (Status != STATUS_REGISTRY_RECOVERED))
+            {
+                /* Unrecoverable failure */
+                return Status;
+            }
+
+            /* Check for previous damage */
+            ASSERT(Status != STATUS_REGISTRY_RECOVERED);
+            break;
+        }
+
         case HINIT_MEMORY_INPLACE:
             // Status = HvpInitializeMemoryInplaceHive(Hive, HiveData);
             // break;
 
-        case HINIT_MAPFILE:
-
         default:
         /* FIXME: A better return status value is needed */
         Status = STATUS_NOT_IMPLEMENTED;
@@ -605,7 +751,9 @@ HvInitialize(
     /* HACK: ROS: Init root key cell and prepare the hive */
     // r31253
     // if (OperationType == HINIT_CREATE) CmCreateRootNode(Hive, L"");
-    if (OperationType != HINIT_CREATE) CmPrepareHive(Hive);
+    /* Mapped hives drop stale volatile lists as their key nodes get opened */
+    if ((OperationType != HINIT_CREATE) && !(Hive->GetCellRoutine))
+        CmPrepareHive(Hive);
 
     return Status;
 }
@@ -195,12 +195,19 @@ HvpWriteHive(
             }
         }
 
+        /* Mapped hives may have to bring the bin holding the block in */
+        if (!HvpGetBin(RegistryHive, BlockIndex))
+        {
+            return FALSE;
+        }
+
         BlockPtr = (PVOID)RegistryHive->Storage[Stable].BlockList[BlockIndex].BlockAddress;
         FileOffset = (BlockIndex + 1) * HBLOCK_SIZE;
 
         /* Write hive block */
         Success = RegistryHive->FileWrite(RegistryHive, HFILE_TYPE_PRIMARY,
                                           &FileOffset, BlockPtr, HBLOCK_SIZE);
+        HvpReleaseBin(RegistryHive, BlockIndex);
         if (!Success)
         {
             return FALSE;
@@ -118,7 +118,6 @@ list(APPEND CRT_SOURCE
     mbstring/mbstok.c
     mbstring/mbstrlen.c
     mbstring/mbsupr.c
-    mem/memcmp.c
     mem/memccpy.c
     mem/memicmp.c
     misc/__crt_MessageBoxA.c
@@ -552,25 +551,17 @@ if(NOT ARCH STREQUAL "i386")
         math/tanf.c
         math/tanhf.c
         math/stubs.c
-        mem/memchr.c
-        mem/memcpy.c
-        mem/memmove.c
-        mem/memset.c
         string/strcat.c
-        string/strchr.c
         string/strcmp.c
         string/strcpy.c
-        string/strlen.c
         string/strncat.c
         string/strncmp.c
         string/strncpy.c
         string/strnlen.c
         string/strrchr.c
         string/wcscat.c
-        string/wcschr.c
         string/wcscmp.c
         string/wcscpy.c
-        string/wcslen.c
         string/wcsncat.c
         string/wcsncmp.c
         string/wcsncpy.c
@@ -578,6 +569,32 @@ if(NOT ARCH STREQUAL "i386")
         string/wcsrchr.c)
 endif()
 
+if(ARCH STREQUAL "i386")
+    list(APPEND CRT_SOURCE
+        mem/memcmp.c)
+elseif(ARCH STREQUAL "amd64")
+    list(APPEND CRT_ASM_SOURCE
+        mem/amd64/memchr_asm.s
+        mem/amd64/memcmp_asm.s
+        mem/amd64/memmove_asm.s
+        mem/amd64/memset_asm.s
+        string/amd64/strchr_asm.s
+        string/amd64/strlen_asm.s
+        string/amd64/wcschr_asm.s
+        string/amd64/wcslen_asm.s)
+else()
+    list(APPEND CRT_SOURCE
+        mem/memchr.c
+        mem/memcmp.c
+        mem/memcpy.c
+        mem/memmove.c
+        mem/memset.c
+        string/strchr.c
+        string/strlen.c
+        string/wcschr.c
+        string/wcslen.c)
+endif()
+
 set_source_files_properties(${CRT_ASM_SOURCE} PROPERTIES COMPILE_DEFINITIONS "__MINGW_IMPORT=extern;USE_MSVCRT_PREFIX;_MSVCRT_LIB_;_MSVCRT_;_MT;CRTDLL")
 add_asm_files(crt_asm ${CRT_ASM_SOURCE})
 
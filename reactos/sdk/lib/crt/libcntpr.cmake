@@ -7,7 +7,6 @@ list(APPEND LIBCNTPR_SOURCE
     math/rand_nt.c
     mbstring/mbstrlen.c
     mem/memccpy.c
-    mem/memcmp.c
     mem/memicmp.c
     misc/fltused.c
     printf/_snprintf.c
@@ -205,12 +204,45 @@ if(ARCH STREQUAL "i386")
         string/i386/wcsncpy_asm.s
         string/i386/wcsnlen_asm.s
         string/i386/wcsrchr_asm.s)
+    list(APPEND LIBCNTPR_SOURCE
+        mem/memcmp.c)
+elseif(ARCH STREQUAL "amd64")
+    list(APPEND LIBCNTPR_ASM_SOURCE
+        mem/amd64/memchr_asm.s
+        mem/amd64/memcmp_asm.s
+        mem/amd64/memmove_asm.s
+        mem/amd64/memset_asm.s
+        string/amd64/strchr_asm.s
+        string/amd64/strlen_asm.s
+        string/amd64/wcschr_asm.s
+        string/amd64/wcslen_asm.s)
+    list(APPEND LIBCNTPR_SOURCE
+        math/cos.c
+        math/sin.c
+        math/sqrt.c
+        string/strcat.c
+        string/strcmp.c
+        string/strcpy.c
+        string/strncat.c
+        string/strncmp.c
+        string/strncpy.c
+        string/strnlen.c
+        string/strrchr.c
+        string/wcscat.c
+        string/wcscmp.c
+        string/wcscpy.c
+        string/wcsncat.c
+        string/wcsncmp.c
+        string/wcsncpy.c
+        string/wcsnlen.c
+        string/wcsrchr.c)
 else()
     list(APPEND LIBCNTPR_SOURCE
         math/cos.c
         math/sin.c
         math/sqrt.c
         mem/memchr.c
+        mem/memcmp.c
         mem/memcpy.c
         mem/memmove.c
         mem/memset.c
@@ -0,0 +1,75 @@
+/*
+ * COPYRIGHT:       See COPYING in the top level directory
+ * PROJECT:         ReactOS CRT library
+ * FILE:            lib/sdk/crt/mem/amd64/memchr_asm.s
+ * PURPOSE:         memchr for amd64
+ */
+
+#include <asm.inc>
+
+/* FUNCTIONS *****************************************************************/
+.code64
+
+/*
+ * void *memchr(const void *s <rcx>, int c <edx>, size_t count <r8>)
+ *
+ * Reads whole aligned 16 byte blocks, which never cross a page boundary,
+ * and ignores the matches outside of the buffer.
+ */
+PUBLIC memchr
+FUNC memchr
+    test r8, r8
+    jz .NotFound
+
+    /* Replicate the byte over xmm1 */
+    movd xmm1, edx
+    punpcklbw xmm1, xmm1
+    punpcklwd xmm1, xmm1
+    pshufd xmm1, xmm1, 0
+
+    /* First block, drop the bytes in front of the buffer */
+    mov r9, rcx
+    and r9, -16
+    and ecx, 15
+    movdqa xmm0, [r9]
+    pcmpeqb xmm0, xmm1
+    pmovmskb eax, xmm0
+    shr eax, cl
+
+    /* Count from the block start from now on, saturating at the top */
+    add r8, rcx
+    sbb r10, r10
+    or r8, r10
+
+    test eax, eax
+    jz .Loop
+    bsf eax, eax
+    add rax, rcx
+    cmp rax, r8
+    jae .NotFound
+    add rax, r9
+    ret
+
+.Loop:
+    cmp r8, 16
+    jbe .NotFound
+    sub r8, 16
+    add r9, 16
+    movdqa xmm0, [r9]
+    pcmpeqb xmm0, xmm1
+    pmovmskb eax, xmm0
+    test eax, eax
+    jz .Loop
+
+    bsf eax, eax
+    cmp rax, r8
+    jae .NotFound
+    add rax, r9
+    ret
+
+.NotFound:
+    xor eax, eax
+    ret
+ENDFUNC
+
+END
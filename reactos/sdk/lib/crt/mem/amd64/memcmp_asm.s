@@ -0,0 +1,68 @@
+/*
+ * COPYRIGHT:       See COPYING in the top level directory
+ * PROJECT:         ReactOS CRT library
+ * FILE:            lib/sdk/crt/mem/amd64/memcmp_asm.s
+ * PURPOSE:         memcmp for amd64
+ */
+
+#include <asm.inc>
+
+/* FUNCTIONS *****************************************************************/
+.code64
+
+/*
+ * int memcmp(const void *s1 <rcx>, const void *s2 <rdx>, size_t count <r8>)
+ */
+PUBLIC memcmp
+FUNC memcmp
+    cmp r8, 16
+    jb .Bytes
+
+.Loop:
+    movdqu xmm0, [rcx]
+    movdqu xmm1, [rdx]
+    pcmpeqb xmm0, xmm1
+    pmovmskb eax, xmm0
+    xor eax, HEX(0FFFF)
+    jnz .Different
+    add rcx, 16
+    add rdx, 16
+    sub r8, 16
+    cmp r8, 16
+    jae .Loop
+
+    /* Compare the last 16 bytes again, overlapping what we already know is equal */
+    test r8, r8
+    jz .Equal
+    lea rcx, [rcx + r8 - 16]
+    lea rdx, [rdx + r8 - 16]
+    mov r8d, 16
+    jmp .Loop
+
+.Different:
+    bsf eax, eax
+    movzx r9d, byte ptr [rcx + rax]
+    movzx eax, byte ptr [rdx + rax]
+    sub r9d, eax
+    mov eax, r9d
+    ret
+
+.Bytes:
+    test r8, r8
+    jz .Equal
+.ByteLoop:
+    movzx eax, byte ptr [rcx]
+    movzx r9d, byte ptr [rdx]
+    sub eax, r9d
+    jnz .Done
+    inc rcx
+    inc rdx
+    dec r8
+    jnz .ByteLoop
+.Equal:
+    xor eax, eax
+.Done:
+    ret
+ENDFUNC
+
+END
@@ -0,0 +1,246 @@
+/*
+ * COPYRIGHT:       See COPYING in the top level directory
+ * PROJECT:         ReactOS CRT library
+ * FILE:            lib/sdk/crt/mem/amd64/memmove_asm.s
+ * PURPOSE:         memcpy/memmove for amd64
+ */
+
+#include <asm.inc>
+
+/* Copies of at least this size use rep movsb, if the CPU has fast strings */
+#define ERMS_THRESHOLD 2048
+
+/* GLOBALS *******************************************************************/
+
+.data
+
+/* 0 = not checked yet, 1 = no ERMS, 2 = ERMS */
+PUBLIC __crt_erms
+__crt_erms:
+    .long 0
+
+/* FUNCTIONS *****************************************************************/
+.code
+
+/*
+ * Detects Enhanced REP MOVSB/STOSB (CPUID.(EAX=7,ECX=0):EBX[9]) and restarts
+ * the routine in r11 with its original rcx/rdx/r8.
+ */
+PUBLIC __crt_detect_erms
+FUNC __crt_detect_erms
+    push rbx
+    .pushreg rbx
+    .endprolog
+
+    mov r9, rcx
+    mov r10, rdx
+
+    /* Make sure leaf 7 exists */
+    xor eax, eax
+    cpuid
+    mov edx, 1
+    cmp eax, 7
+    jb .DetectDone
+
+    mov eax, 7
+    xor ecx, ecx
+    cpuid
+    mov edx, 1
+    bt ebx, 9
+    jnc .DetectDone
+    mov edx, 2
+
+.DetectDone:
+    mov dword ptr __crt_erms[rip], edx
+
+    mov rcx, r9
+    mov rdx, r10
+    pop rbx
+    jmp r11
+ENDFUNC
+
+FUNC MemmoveErms
+    push rdi
+    .pushreg rdi
+    push rsi
+    .pushreg rsi
+    .endprolog
+
+    /* rax already holds the destination */
+    mov rdi, rcx
+    mov rsi, rdx
+    mov rcx, r8
+    rep movsb
+
+    pop rsi
+    pop rdi
+    ret
+ENDFUNC
+
+/*
+ * void *memmove(void *dest <rcx>, const void *src <rdx>, size_t count <r8>)
+ * void *memcpy(void *dest <rcx>, const void *src <rdx>, size_t count <r8>)
+ *
+ * Small and medium sizes load everything before storing anything, larger
+ * ones load the first and last 16 bytes up front and copy the rest with
+ * aligned stores. That way overlapping buffers need no special casing,
+ * unless the destination lies above the source.
+ */
+PUBLIC memcpy
+PUBLIC memmove
+memcpy:
+FUNC memmove
+    mov rax, rcx
+
+    /* Copy backwards if the destination starts inside the source */
+    mov r9, rcx
+    sub r9, rdx
+    cmp r9, r8
+    jb .CopyDown
+
+    cmp r8, 16
+    jb .Small
+    cmp r8, 32
+    ja .Large
+
+    /* 16 to 32 bytes */
+    movdqu xmm0, [rdx]
+    movdqu xmm1, [rdx + r8 - 16]
+    movdqu [rcx], xmm0
+    movdqu [rcx + r8 - 16], xmm1
+    ret
+
+.Small:
+    cmp r8, 8
+    jb .Small4
+    mov r9, [rdx]
+    mov r10, [rdx + r8 - 8]
+    mov [rcx], r9
+    mov [rcx + r8 - 8], r10
+    ret
+.Small4:
+    cmp r8, 4
+    jb .Small2
+    mov r9d, [rdx]
+    mov r10d, [rdx + r8 - 4]
+    mov [rcx], r9d
+    mov [rcx + r8 - 4], r10d
+    ret
+.Small2:
+    cmp r8, 2
+    jb .Small1
+    movzx r9d, word ptr [rdx]
+    movzx r10d, word ptr [rdx + r8 - 2]
+    mov [rcx], r9w
+    mov [rcx + r8 - 2], r10w
+    ret
+.Small1:
+    test r8, r8
+    jz .Done
+    movzx r9d, byte ptr [rdx]
+    mov [rcx], r9b
+.Done:
+    ret
+
+.Large:
+    cmp r8, ERMS_THRESHOLD
+    jb .LargeSse
+    mov r9d, dword ptr __crt_erms[rip]
+    cmp r9d, 2
+    je MemmoveErms
+    test r9d, r9d
+    jnz .LargeSse
+    lea r11, memmove[rip]
+    jmp __crt_detect_erms
+
+.LargeSse:
+    /* Keep the head and the tail, they are stored last */
+    movdqu xmm4, [rdx]
+    movdqu xmm5, [rdx + r8 - 16]
+    lea r10, [rcx + r8 - 16]
+
+    /* Align the destination */
+    mov r9, rcx
+    and r9, 15
+    neg r9
+    add r9, 16
+    lea r11, [rcx + r9]
+    add rdx, r9
+    sub r8, r9
+
+    sub r8, 32
+    jbe .Up16
+.Up32:
+    movdqu xmm0, [rdx]
+    movdqu xmm1, [rdx + 16]
+    add rdx, 32
+    movdqa [r11], xmm0
+    movdqa [r11 + 16], xmm1
+    add r11, 32
+    sub r8, 32
+    ja .Up32
+.Up16:
+    add r8, 32
+    cmp r8, 16
+    jbe .UpTail
+    movdqu xmm0, [rdx]
+    movdqa [r11], xmm0
+.UpTail:
+    movdqu [rcx], xmm4
+    movdqu [r10], xmm5
+    ret
+
+.CopyDown:
+    /* The small and medium cases don't care about the direction */
+    cmp r8, 16
+    jb .Small
+    cmp r8, 32
+    jbe .Medium
+
+    /* Same as above, mirrored: keep head and tail, align the end */
+    movdqu xmm4, [rdx]
+    movdqu xmm5, [rdx + r8 - 16]
+    lea r10, [rcx + r8 - 16]
+
+    lea r11, [rcx + r8]
+    mov r9, r11
+    and r9, 15
+    jnz .DownAligned
+    mov r9, 16
+.DownAligned:
+    sub r11, r9
+    lea rdx, [rdx + r8]
+    sub rdx, r9
+    sub r8, r9
+
+    sub r8, 32
+    jbe .Down16
+.Down32:
+    movdqu xmm0, [rdx - 16]
+    movdqu xmm1, [rdx - 32]
+    sub rdx, 32
+    movdqa [r11 - 16], xmm0
+    movdqa [r11 - 32], xmm1
+    sub r11, 32
+    sub r8, 32
+    ja .Down32
+.Down16:
+    add r8, 32
+    cmp r8, 16
+    jbe .DownHead
+    movdqu xmm0, [rdx - 16]
+    movdqa [r11 - 16], xmm0
+.DownHead:
+    movdqu [r10], xmm5
+    movdqu [rcx], xmm4
+    ret
+
+.Medium:
+    movdqu xmm0, [rdx]
+    movdqu xmm1, [rdx + r8 - 16]
+    movdqu [rcx], xmm0
+    movdqu [rcx + r8 - 16], xmm1
+    ret
+ENDFUNC
+
+END
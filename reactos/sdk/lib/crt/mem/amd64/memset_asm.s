@@ -0,0 +1,114 @@
+/*
+ * COPYRIGHT:       See COPYING in the top level directory
+ * PROJECT:         ReactOS CRT library
+ * FILE:            lib/sdk/crt/mem/amd64/memset_asm.s
+ * PURPOSE:         memset for amd64
+ */
+
+#include <asm.inc>
+
+/* Fills of at least this size use rep stosb, if the CPU has fast strings */
+#define ERMS_THRESHOLD 2048
+
+EXTERN __crt_erms:DWORD
+EXTERN __crt_detect_erms:PROC
+
+/* FUNCTIONS *****************************************************************/
+.code64
+
+FUNC MemsetErms
+    push rdi
+    .pushreg rdi
+    .endprolog
+
+    /* rax holds the destination, al is all we need from the pattern */
+    mov rdi, rcx
+    mov r9, rax
+    mov rax, rdx
+    mov rcx, r8
+    rep stosb
+    mov rax, r9
+
+    pop rdi
+    ret
+ENDFUNC
+
+/*
+ * void *memset(void *dest <rcx>, int val <edx>, size_t count <r8>)
+ */
+PUBLIC memset
+FUNC memset
+    mov rax, rcx
+
+    /* Replicate the byte over a qword */
+    movzx edx, dl
+    mov r9, HEX(0101010101010101)
+    imul rdx, r9
+
+    cmp r8, 16
+    jb .Small
+
+    movq xmm0, rdx
+    punpcklqdq xmm0, xmm0
+
+    cmp r8, 32
+    ja .Large
+
+    /* 16 to 32 bytes */
+    movdqu [rcx], xmm0
+    movdqu [rcx + r8 - 16], xmm0
+    ret
+
+.Small:
+    cmp r8, 8
+    jb .Small4
+    mov [rcx], rdx
+    mov [rcx + r8 - 8], rdx
+    ret
+.Small4:
+    cmp r8, 4
+    jb .Small2
+    mov [rcx], edx
+    mov [rcx + r8 - 4], edx
+    ret
+.Small2:
+    cmp r8, 2
+    jb .Small1
+    mov [rcx], dx
+    mov [rcx + r8 - 2], dx
+    ret
+.Small1:
+    test r8, r8
+    jz .Done
+    mov [rcx], dl
+.Done:
+    ret
+
+.Large:
+    cmp r8, ERMS_THRESHOLD
+    jb .LargeSse
+    mov r9d, dword ptr __crt_erms[rip]
+    cmp r9d, 2
+    je MemsetErms
+    test r9d, r9d
+    jnz .LargeSse
+    lea r11, memset[rip]
+    jmp __crt_detect_erms
+
+.LargeSse:
+    /* Unaligned head and tail, aligned stores in between */
+    lea r10, [rcx + r8 - 16]
+    movdqu [rcx], xmm0
+    movdqu [r10], xmm0
+
+    lea r9, [rcx + 16]
+    and r9, -16
+.Loop:
+    movdqa [r9], xmm0
+    add r9, 16
+    cmp r9, r10
+    jb .Loop
+    ret
+ENDFUNC
+
+END
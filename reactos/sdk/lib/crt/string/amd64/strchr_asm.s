@@ -0,0 +1,68 @@
+/*
+ * COPYRIGHT:       See COPYING in the top level directory
+ * PROJECT:         ReactOS CRT library
+ * FILE:            lib/sdk/crt/string/amd64/strchr_asm.s
+ * PURPOSE:         strchr for amd64
+ */
+
+#include <asm.inc>
+
+/* FUNCTIONS *****************************************************************/
+.code64
+
+/*
+ * char *strchr(const char *s <rcx>, int c <edx>)
+ *
+ * Looks for the character and the terminator at the same time, whichever
+ * comes first decides the result.
+ */
+PUBLIC strchr
+FUNC strchr
+    /* Replicate the character over xmm1 */
+    movzx edx, dl
+    movd xmm1, edx
+    punpcklbw xmm1, xmm1
+    punpcklwd xmm1, xmm1
+    pshufd xmm1, xmm1, 0
+    pxor xmm2, xmm2
+
+    mov r9, rcx
+    and r9, -16
+
+    /* First block, drop the bytes in front of the string */
+    movdqa xmm0, [r9]
+    movdqa xmm3, xmm0
+    pcmpeqb xmm0, xmm1
+    pcmpeqb xmm3, xmm2
+    por xmm0, xmm3
+    pmovmskb eax, xmm0
+    and ecx, 15
+    shr eax, cl
+    shl eax, cl
+    test eax, eax
+    jnz .Found
+
+.Loop:
+    add r9, 16
+    movdqa xmm0, [r9]
+    movdqa xmm3, xmm0
+    pcmpeqb xmm0, xmm1
+    pcmpeqb xmm3, xmm2
+    por xmm0, xmm3
+    pmovmskb eax, xmm0
+    test eax, eax
+    jz .Loop
+
+.Found:
+    bsf eax, eax
+    add rax, r9
+
+    /* Stopped at the terminator, unless that is what we were looking for */
+    cmp byte ptr [rax], dl
+    je .Done
+    xor eax, eax
+.Done:
+    ret
+ENDFUNC
+
+END
@@ -0,0 +1,50 @@
+/*
+ * COPYRIGHT:       See COPYING in the top level directory
+ * PROJECT:         ReactOS CRT library
+ * FILE:            lib/sdk/crt/string/amd64/strlen_asm.s
+ * PURPOSE:         strlen for amd64
+ */
+
+#include <asm.inc>
+
+/* FUNCTIONS *****************************************************************/
+.code64
+
+/*
+ * size_t strlen(const char *s <rcx>)
+ *
+ * Reads whole aligned 16 byte blocks, which never cross a page boundary.
+ */
+PUBLIC strlen
+FUNC strlen
+    pxor xmm1, xmm1
+    mov r9, rcx
+    and r9, -16
+
+    /* First block, drop the bytes in front of the string */
+    movdqa xmm0, [r9]
+    pcmpeqb xmm0, xmm1
+    pmovmskb eax, xmm0
+    mov r8, rcx
+    and ecx, 15
+    shr eax, cl
+    test eax, eax
+    jz .Loop
+    bsf eax, eax
+    ret
+
+.Loop:
+    add r9, 16
+    movdqa xmm0, [r9]
+    pcmpeqb xmm0, xmm1
+    pmovmskb eax, xmm0
+    test eax, eax
+    jz .Loop
+
+    bsf eax, eax
+    add rax, r9
+    sub rax, r8
+    ret
+ENDFUNC
+
+END
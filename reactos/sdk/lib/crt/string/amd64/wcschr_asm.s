@@ -0,0 +1,81 @@
+/*
+ * COPYRIGHT:       See COPYING in the top level directory
+ * PROJECT:         ReactOS CRT library
+ * FILE:            lib/sdk/crt/string/amd64/wcschr_asm.s
+ * PURPOSE:         wcschr for amd64
+ */
+
+#include <asm.inc>
+
+/* FUNCTIONS *****************************************************************/
+.code64
+
+/*
+ * wchar_t *wcschr(const wchar_t *s <rcx>, wchar_t c <dx>)
+ *
+ * Same as strchr, on words. Strings at odd addresses take the slow path.
+ */
+PUBLIC wcschr
+FUNC wcschr
+    movzx edx, dx
+    test cl, 1
+    jnz .Unaligned
+
+    /* Replicate the character over xmm1 */
+    movd xmm1, edx
+    punpcklwd xmm1, xmm1
+    pshufd xmm1, xmm1, 0
+    pxor xmm2, xmm2
+
+    mov r9, rcx
+    and r9, -16
+
+    /* First block, drop the bytes in front of the string */
+    movdqa xmm0, [r9]
+    movdqa xmm3, xmm0
+    pcmpeqw xmm0, xmm1
+    pcmpeqw xmm3, xmm2
+    por xmm0, xmm3
+    pmovmskb eax, xmm0
+    and ecx, 15
+    shr eax, cl
+    shl eax, cl
+    test eax, eax
+    jnz .Found
+
+.Loop:
+    add r9, 16
+    movdqa xmm0, [r9]
+    movdqa xmm3, xmm0
+    pcmpeqw xmm0, xmm1
+    pcmpeqw xmm3, xmm2
+    por xmm0, xmm3
+    pmovmskb eax, xmm0
+    test eax, eax
+    jz .Loop
+
+.Found:
+    bsf eax, eax
+    add rax, r9
+
+    /* Stopped at the terminator, unless that is what we were looking for */
+    cmp word ptr [rax], dx
+    je .Done
+    xor eax, eax
+.Done:
+    ret
+
+.Unaligned:
+    mov rax, rcx
+.UnalignedLoop:
+    movzx r8d, word ptr [rax]
+    cmp r8d, edx
+    je .Done
+    add rax, 2
+    test r8d, r8d
+    jnz .UnalignedLoop
+    xor eax, eax
+    ret
+ENDFUNC
+
+END
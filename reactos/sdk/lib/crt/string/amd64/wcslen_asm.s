@@ -0,0 +1,69 @@
+/*
+ * COPYRIGHT:       See COPYING in the top level directory
+ * PROJECT:         ReactOS CRT library
+ * FILE:            lib/sdk/crt/string/amd64/wcslen_asm.s
+ * PURPOSE:         wcslen for amd64
+ */
+
+#include <asm.inc>
+
+/* FUNCTIONS *****************************************************************/
+.code64
+
+/*
+ * size_t wcslen(const wchar_t *s <rcx>)
+ *
+ * Reads whole aligned 16 byte blocks, which never cross a page boundary.
+ * Strings at odd addresses can't be split into aligned characters, they
+ * take the slow path.
+ */
+PUBLIC wcslen
+FUNC wcslen
+    test cl, 1
+    jnz .Unaligned
+
+    pxor xmm1, xmm1
+    mov r9, rcx
+    and r9, -16
+
+    /* First block, drop the bytes in front of the string */
+    movdqa xmm0, [r9]
+    pcmpeqw xmm0, xmm1
+    pmovmskb eax, xmm0
+    mov r8, rcx
+    and ecx, 15
+    shr eax, cl
+    test eax, eax
+    jz .Loop
+    bsf eax, eax
+    shr eax, 1
+    ret
+
+.Loop:
+    add r9, 16
+    movdqa xmm0, [r9]
+    pcmpeqw xmm0, xmm1
+    pmovmskb eax, xmm0
+    test eax, eax
+    jz .Loop
+
+    bsf eax, eax
+    add rax, r9
+    sub rax, r8
+    shr rax, 1
+    ret
+
+.Unaligned:
+    mov rax, rcx
+.UnalignedLoop:
+    cmp word ptr [rax], 0
+    je .UnalignedDone
+    add rax, 2
+    jmp .UnalignedLoop
+.UnalignedDone:
+    sub rax, rcx
+    shr rax, 1
+    ret
+ENDFUNC
+
+END
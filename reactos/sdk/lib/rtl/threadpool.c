@@ -0,0 +1,1379 @@
+/*
+ * COPYRIGHT:         See COPYING in the top level directory
+ * PROJECT:           ReactOS system libraries
+ * PURPOSE:           Vista-style thread pool (Tp* functions)
+ * FILE:              lib/rtl/threadpool.c
+ * PROGRAMMER:
+ */
+
+/* INCLUDES *****************************************************************/
+
+#include <rtl.h>
+
+#define NDEBUG
+#include <debug.h>
+
+/* GLOBALS ******************************************************************/
+
+extern PRTL_START_POOL_THREAD RtlpStartThreadFunc;
+extern PRTL_EXIT_POOL_THREAD RtlpExitThreadFunc;
+
+#define TPP_DEFAULT_MAX_THREADS     500
+#define TPP_WORKER_IDLE_TIMEOUT     (-50000000LL) /* 5 seconds */
+
+typedef enum _TPP_OBJECT_TYPE
+{
+    TppObjectWork,
+    TppObjectSimple,
+    TppObjectTimer,
+    TppObjectWait,
+    TppObjectIo
+} TPP_OBJECT_TYPE;
+
+/*
+ * All packets, whether posted by us or completed by the I/O manager, go
+ * through the pool's completion port. The key is always the object the
+ * packet belongs to; a NULL key tells a worker thread to exit.
+ */
+struct _TP_POOL
+{
+    LONG RefCount;
+    BOOLEAN Shutdown;
+    RTL_CRITICAL_SECTION Lock;
+    HANDLE CompletionPort;
+    LONG MaxThreads;
+    LONG MinThreads;
+    LONG ThreadCount;
+    LONG IdleThreads;
+    LONG PendingPackets;
+};
+
+struct _TP_CLEANUP_GROUP
+{
+    RTL_CRITICAL_SECTION Lock;
+    LIST_ENTRY MemberList;
+};
+
+typedef struct _TPP_OBJECT
+{
+    PVOID Win32Callback; /* Reserved for kernel32, must stay first */
+    TPP_OBJECT_TYPE Type;
+    LONG RefCount;
+    LONG Released;
+    PTP_POOL Pool;
+    PVOID Callback;
+    PVOID Context;
+    PTP_CLEANUP_GROUP CleanupGroup;
+    PTP_CLEANUP_GROUP_CANCEL_CALLBACK CleanupGroupCancelCallback;
+    PTP_SIMPLE_CALLBACK FinalizationCallback;
+    PVOID RaceDll;
+    HANDLE ActivationContext;
+    LIST_ENTRY CleanupGroupEntry;
+    BOOLEAN InCleanupGroup;
+    BOOLEAN LongFunction;
+
+    /* Protected by the pool lock */
+    LONG PendingCallbacks;
+    LONG CancelledCallbacks;
+    LONG RunningCallbacks;
+    HANDLE IdleEvent;
+
+    union
+    {
+        struct
+        {
+            HANDLE Handle;
+            LONG Period;
+            BOOLEAN Set;
+        } Timer;
+        struct
+        {
+            HANDLE Handle;
+        } Wait;
+    } u;
+} TPP_OBJECT, *PTPP_OBJECT;
+
+struct _TP_CALLBACK_INSTANCE
+{
+    PTPP_OBJECT Object;
+    BOOLEAN MayRunLong;
+    BOOLEAN Disassociated;
+    PRTL_CRITICAL_SECTION CriticalSection;
+    HANDLE Mutex;
+    HANDLE Semaphore;
+    LONG SemaphoreReleaseCount;
+    HANDLE Event;
+    PVOID DllHandle;
+};
+
+static PTP_POOL TppDefaultPool;
+
+/* PRIVATE FUNCTIONS ********************************************************/
+
+static ULONG
+TppTimeoutToMilliseconds(IN PLARGE_INTEGER Timeout OPTIONAL)
+{
+    LARGE_INTEGER CurrentTime;
+    LONGLONG Interval;
+
+    if (!Timeout) return INFINITE;
+
+    if (Timeout->QuadPart < 0)
+    {
+        /* Relative time */
+        Interval = -Timeout->QuadPart;
+    }
+    else
+    {
+        /* Absolute time, anything in the past expires right away */
+        NtQuerySystemTime(&CurrentTime);
+        Interval = Timeout->QuadPart - CurrentTime.QuadPart;
+        if (Interval < 0) Interval = 0;
+    }
+
+    /* Round up to the next millisecond and stay clear of INFINITE */
+    Interval = (Interval + 9999) / 10000;
+    if (Interval >= INFINITE) Interval = INFINITE - 1;
+
+    return (ULONG)Interval;
+}
+
+static VOID
+TppFreePool(IN PTP_POOL Pool)
+{
+    NtClose(Pool->CompletionPort);
+    RtlDeleteCriticalSection(&Pool->Lock);
+    RtlFreeHeap(RtlGetProcessHeap(), 0, Pool);
+}
+
+static VOID
+TppDereferencePool(IN PTP_POOL Pool)
+{
+    LONG i;
+
+    if (InterlockedDecrement(&Pool->RefCount) != 0) return;
+
+    RtlEnterCriticalSection(&Pool->Lock);
+    Pool->Shutdown = TRUE;
+
+    if (Pool->ThreadCount == 0)
+    {
+        RtlLeaveCriticalSection(&Pool->Lock);
+        TppFreePool(Pool);
+        return;
+    }
+
+    /* Wake every worker with an empty packet, the last one out frees the
+       pool. This is done under the lock so no worker can exit early and
+       free the pool while we are still posting. */
+    for (i = 0; i < Pool->ThreadCount; i++)
+    {
+        NtSetIoCompletion(Pool->CompletionPort, NULL, NULL, STATUS_SUCCESS, 0);
+    }
+    RtlLeaveCriticalSection(&Pool->Lock);
+}
+
+static ULONG
+NTAPI
+TppWorkerThread(IN PVOID Parameter);
+
+static NTSTATUS
+TppStartWorkerThread(IN PTP_POOL Pool)
+{
+    NTSTATUS Status;
+    HANDLE ThreadHandle;
+
+    /* We MUST hold the pool lock. The new thread starts out idle. */
+    Pool->ThreadCount++;
+    Pool->IdleThreads++;
+
+    Status = RtlpStartThreadFunc(TppWorkerThread, Pool, &ThreadHandle);
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("Failed to start a thread pool worker, Status 0x%lx\n", Status);
+        Pool->ThreadCount--;
+        Pool->IdleThreads--;
+        return Status;
+    }
+
+    NtResumeThread(ThreadHandle, NULL);
+    NtClose(ThreadHandle);
+    return STATUS_SUCCESS;
+}
+
+static VOID
+TppGrowPool(IN PTP_POOL Pool)
+{
+    /* We MUST hold the pool lock. Every queued packet should find an idle
+       thread waiting for it, otherwise add one if we are allowed to. */
+    if ((Pool->PendingPackets > Pool->IdleThreads) &&
+        (Pool->ThreadCount < Pool->MaxThreads))
+    {
+        TppStartWorkerThread(Pool);
+    }
+}
+
+static NTSTATUS
+TppGetDefaultPool(OUT PTP_POOL *Pool)
+{
+    PTP_POOL NewPool;
+    NTSTATUS Status;
+
+    if (!TppDefaultPool)
+    {
+        Status = TpAllocPool(&NewPool, NULL);
+        if (!NT_SUCCESS(Status)) return Status;
+
+        if (InterlockedCompareExchangePointer((PVOID *)&TppDefaultPool,
+                                              NewPool,
+                                              NULL) != NULL)
+        {
+            /* Got beaten to it */
+            TpReleasePool(NewPool);
+        }
+    }
+
+    *Pool = TppDefaultPool;
+    return STATUS_SUCCESS;
+}
+
+static VOID
+TppDestroyObject(IN PTPP_OBJECT Object)
+{
+    ASSERT(Object->PendingCallbacks == 0);
+    ASSERT(Object->RunningCallbacks == 0);
+    ASSERT(!Object->InCleanupGroup);
+
+    if (Object->IdleEvent) NtClose(Object->IdleEvent);
+    if (Object->ActivationContext) RtlReleaseActivationContext(Object->ActivationContext);
+    if (Object->RaceDll) LdrUnloadDll(Object->RaceDll);
+
+    TppDereferencePool(Object->Pool);
+    RtlFreeHeap(RtlGetProcessHeap(), 0, Object);
+}
+
+static VOID
+TppDereferenceObject(IN PTPP_OBJECT Object)
+{
+    if (InterlockedDecrement(&Object->RefCount) == 0)
+        TppDestroyObject(Object);
+}
+
+static NTSTATUS
+TppAllocObject(OUT PTPP_OBJECT *ObjectReturn,
+               IN TPP_OBJECT_TYPE Type,
+               IN PVOID Callback,
+               IN PVOID Context OPTIONAL,
+               IN PTP_CALLBACK_ENVIRON CallbackEnviron OPTIONAL)
+{
+    PTPP_OBJECT Object;
+    PTP_POOL Pool = NULL;
+    PTP_CLEANUP_GROUP Group;
+    NTSTATUS Status;
+
+    if (CallbackEnviron)
+    {
+        if ((CallbackEnviron->Version != 1) && (CallbackEnviron->Version != 3))
+            return STATUS_INVALID_PARAMETER;
+
+        Pool = CallbackEnviron->Pool;
+    }
+
+    if (!Pool)
+    {
+        Status = TppGetDefaultPool(&Pool);
+        if (!NT_SUCCESS(Status)) return Status;
+    }
+
+    Object = RtlAllocateHeap(RtlGetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(TPP_OBJECT));
+    if (!Object) return STATUS_NO_MEMORY;
+
+    Object->Type = Type;
+    Object->RefCount = 1;
+    Object->Pool = Pool;
+    Object->Callback = Callback;
+    Object->Context = Context;
+
+    if (CallbackEnviron)
+    {
+        if (CallbackEnviron->RaceDll)
+        {
+            /* Keep the DLL loaded for as long as the object lives */
+            Status = LdrAddRefDll(0, CallbackEnviron->RaceDll);
+            if (!NT_SUCCESS(Status))
+            {
+                RtlFreeHeap(RtlGetProcessHeap(), 0, Object);
+                return Status;
+            }
+            Object->RaceDll = CallbackEnviron->RaceDll;
+        }
+
+        if (CallbackEnviron->ActivationContext &&
+            (CallbackEnviron->ActivationContext != (struct _ACTIVATION_CONTEXT *)(LONG_PTR)-1))
+        {
+            Object->ActivationContext = CallbackEnviron->ActivationContext;
+            RtlAddRefActivationContext(Object->ActivationContext);
+        }
+
+        Object->FinalizationCallback = CallbackEnviron->FinalizationCallback;
+        Object->LongFunction = CallbackEnviron->u.s.LongFunction;
+        Object->CleanupGroup = CallbackEnviron->CleanupGroup;
+        Object->CleanupGroupCancelCallback = CallbackEnviron->CleanupGroupCancelCallback;
+    }
+
+    InterlockedIncrement(&Pool->RefCount);
+
+    /* Group membership holds its own reference */
+    Group = Object->CleanupGroup;
+    if (Group)
+    {
+        Object->RefCount++;
+        Object->InCleanupGroup = TRUE;
+
+        RtlEnterCriticalSection(&Group->Lock);
+        InsertTailList(&Group->MemberList, &Object->CleanupGroupEntry);
+        RtlLeaveCriticalSection(&Group->Lock);
+    }
+
+    *ObjectReturn = Object;
+    return STATUS_SUCCESS;
+}
+
+static VOID
+TppRemoveFromCleanupGroup(IN PTPP_OBJECT Object)
+{
+    PTP_CLEANUP_GROUP Group = Object->CleanupGroup;
+    BOOLEAN Removed = FALSE;
+
+    if (!Group) return;
+
+    RtlEnterCriticalSection(&Group->Lock);
+    if (Object->InCleanupGroup)
+    {
+        RemoveEntryList(&Object->CleanupGroupEntry);
+        Object->InCleanupGroup = FALSE;
+        Removed = TRUE;
+    }
+    RtlLeaveCriticalSection(&Group->Lock);
+
+    /* Drop the group's reference */
+    if (Removed) TppDereferenceObject(Object);
+}
+
+static VOID
+TppSignalIfIdle(IN PTPP_OBJECT Object)
+{
+    /* We MUST hold the pool lock */
+    if (Object->IdleEvent &&
+        (Object->RunningCallbacks == 0) &&
+        (Object->PendingCallbacks == Object->CancelledCallbacks))
+    {
+        NtSetEvent(Object->IdleEvent, NULL);
+    }
+}
+
+static NTSTATUS
+TppPostObject(IN PTPP_OBJECT Object,
+              IN ULONG_PTR Information)
+{
+    PTP_POOL Pool = Object->Pool;
+    NTSTATUS Status;
+
+    /* The packet holds a reference until a worker is done with it */
+    InterlockedIncrement(&Object->RefCount);
+
+    RtlEnterCriticalSection(&Pool->Lock);
+    Object->PendingCallbacks++;
+    Pool->PendingPackets++;
+    TppGrowPool(Pool);
+    RtlLeaveCriticalSection(&Pool->Lock);
+
+    Status = NtSetIoCompletion(Pool->CompletionPort,
+                               Object,
+                               NULL,
+                               STATUS_SUCCESS,
+                               Information);
+    if (!NT_SUCCESS(Status))
+    {
+        RtlEnterCriticalSection(&Pool->Lock);
+        Object->PendingCallbacks--;
+        Pool->PendingPackets--;
+        TppSignalIfIdle(Object);
+        RtlLeaveCriticalSection(&Pool->Lock);
+
+        TppDereferenceObject(Object);
+    }
+
+    return Status;
+}
+
+static LONG
+TppCancelPendingCallbacks(IN PTPP_OBJECT Object)
+{
+    PTP_POOL Pool = Object->Pool;
+    LONG Cancelled;
+
+    /* Packets already queued on the port will be dropped by the worker
+       that dequeues them */
+    RtlEnterCriticalSection(&Pool->Lock);
+    Cancelled = Object->PendingCallbacks - Object->CancelledCallbacks;
+    Object->CancelledCallbacks = Object->PendingCallbacks;
+    TppSignalIfIdle(Object);
+    RtlLeaveCriticalSection(&Pool->Lock);
+
+    return Cancelled;
+}
+
+static VOID
+TppWaitForCallbacks(IN PTPP_OBJECT Object,
+                    IN BOOLEAN CancelPendingCallbacks)
+{
+    PTP_POOL Pool = Object->Pool;
+    HANDLE IdleEvent;
+    LARGE_INTEGER Timeout;
+    NTSTATUS Status;
+
+    if (CancelPendingCallbacks) TppCancelPendingCallbacks(Object);
+
+    for (;;)
+    {
+        RtlEnterCriticalSection(&Pool->Lock);
+
+        if ((Object->RunningCallbacks == 0) &&
+            (Object->PendingCallbacks == Object->CancelledCallbacks))
+        {
+            RtlLeaveCriticalSection(&Pool->Lock);
+            return;
+        }
+
+        if (!Object->IdleEvent)
+        {
+            Status = NtCreateEvent(&Object->IdleEvent,
+                                   EVENT_ALL_ACCESS,
+                                   NULL,
+                                   NotificationEvent,
+                                   FALSE);
+            if (!NT_SUCCESS(Status))
+            {
+                /* Poll instead */
+                RtlLeaveCriticalSection(&Pool->Lock);
+                Timeout.QuadPart = -100000LL; /* 10ms */
+                NtDelayExecution(FALSE, &Timeout);
+                continue;
+            }
+        }
+
+        /* Cleared and signaled under the lock, so no wakeup is lost */
+        IdleEvent = Object->IdleEvent;
+        NtClearEvent(IdleEvent);
+        RtlLeaveCriticalSection(&Pool->Lock);
+
+        NtWaitForSingleObject(IdleEvent, FALSE, NULL);
+    }
+}
+
+static VOID
+TppShutdownObject(IN PTPP_OBJECT Object)
+{
+    HANDLE Handle;
+
+    /* Stop anything that could still post new callbacks */
+    switch (Object->Type)
+    {
+        case TppObjectTimer:
+            Handle = InterlockedExchangePointer(&Object->u.Timer.Handle, NULL);
+            if (Handle) RtlDeleteTimer(NULL, Handle, INVALID_HANDLE_VALUE);
+            Object->u.Timer.Set = FALSE;
+            break;
+
+        case TppObjectWait:
+            Handle = InterlockedExchangePointer(&Object->u.Wait.Handle, NULL);
+            if (Handle) RtlDeregisterWaitEx(Handle, INVALID_HANDLE_VALUE);
+            break;
+
+        default:
+            break;
+    }
+}
+
+static VOID
+TppReleaseObject(IN PTPP_OBJECT Object)
+{
+    /* Drop the caller's reference, exactly once */
+    if (InterlockedExchange(&Object->Released, TRUE)) return;
+
+    TppShutdownObject(Object);
+    TppDereferenceObject(Object);
+}
+
+static VOID
+TppCompleteInstance(IN PTP_CALLBACK_INSTANCE Instance)
+{
+    if (Instance->CriticalSection)
+        RtlLeaveCriticalSection(Instance->CriticalSection);
+
+    if (Instance->Mutex)
+        NtReleaseMutant(Instance->Mutex, NULL);
+
+    if (Instance->Semaphore)
+        NtReleaseSemaphore(Instance->Semaphore, Instance->SemaphoreReleaseCount, NULL);
+
+    if (Instance->Event)
+        NtSetEvent(Instance->Event, NULL);
+
+    if (Instance->DllHandle)
+        LdrUnloadDll(Instance->DllHandle);
+}
+
+static VOID
+TppExecuteCallback(IN PTPP_OBJECT Object,
+                   IN PTP_CALLBACK_INSTANCE Instance,
+                   IN PVOID ApcContext,
+                   IN PIO_STATUS_BLOCK IoStatusBlock)
+{
+    ULONG_PTR Cookie = 0;
+
+    if (Object->LongFunction) TpCallbackMayRunLong(Instance);
+
+    if (Object->ActivationContext)
+        RtlActivateActivationContext(0, Object->ActivationContext, &Cookie);
+
+    _SEH2_TRY
+    {
+        switch (Object->Type)
+        {
+            case TppObjectWork:
+                ((PTP_WORK_CALLBACK)Object->Callback)(Instance,
+                                                      Object->Context,
+                                                      (PTP_WORK)Object);
+                break;
+
+            case TppObjectSimple:
+                ((PTP_SIMPLE_CALLBACK)Object->Callback)(Instance,
+                                                        Object->Context);
+                break;
+
+            case TppObjectTimer:
+                ((PTP_TIMER_CALLBACK)Object->Callback)(Instance,
+                                                       Object->Context,
+                                                       (PTP_TIMER)Object);
+                break;
+
+            case TppObjectWait:
+                ((PTP_WAIT_CALLBACK)Object->Callback)(Instance,
+                                                      Object->Context,
+                                                      (PTP_WAIT)Object,
+                                                      (TP_WAIT_RESULT)IoStatusBlock->Information);
+                break;
+
+            case TppObjectIo:
+                ((PTP_IO_CALLBACK)Object->Callback)(Instance,
+                                                    Object->Context,
+                                                    ApcContext,
+                                                    IoStatusBlock,
+                                                    (PTP_IO)Object);
+                break;
+        }
+
+        if (Object->FinalizationCallback)
+            Object->FinalizationCallback(Instance, Object->Context);
+    }
+    _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+    {
+        DPRINT1("Exception 0x%x while executing thread pool callback 0x%p\n", _SEH2_GetExceptionCode(), Object->Callback);
+    }
+    _SEH2_END;
+
+    if (Object->ActivationContext)
+        RtlDeactivateActivationContext(0, Cookie);
+
+    TppCompleteInstance(Instance);
+}
+
+static ULONG
+NTAPI
+TppWorkerThread(IN PVOID Parameter)
+{
+    PTP_POOL Pool = (PTP_POOL)Parameter;
+    PTPP_OBJECT Object;
+    TP_CALLBACK_INSTANCE Instance;
+    IO_STATUS_BLOCK IoStatusBlock;
+    LARGE_INTEGER Timeout;
+    PVOID ApcContext;
+    BOOLEAN Referenced, Execute, Last;
+    NTSTATUS Status;
+
+    for (;;)
+    {
+        Timeout.QuadPart = TPP_WORKER_IDLE_TIMEOUT;
+
+        Status = NtRemoveIoCompletion(Pool->CompletionPort,
+                                      (PVOID *)&Object,
+                                      &ApcContext,
+                                      &IoStatusBlock,
+                                      &Timeout);
+
+        RtlEnterCriticalSection(&Pool->Lock);
+
+        if (!NT_SUCCESS(Status) || (Status == STATUS_TIMEOUT) || !Object)
+        {
+            /* Stay around if the pool still needs us */
+            if ((Status == STATUS_TIMEOUT) &&
+                !Pool->Shutdown &&
+                ((Pool->ThreadCount <= Pool->MinThreads) ||
+                 (Pool->IdleThreads - 1 < Pool->PendingPackets)))
+            {
+                RtlLeaveCriticalSection(&Pool->Lock);
+                continue;
+            }
+
+            Pool->ThreadCount--;
+            Pool->IdleThreads--;
+            Last = Pool->Shutdown && (Pool->ThreadCount == 0);
+            RtlLeaveCriticalSection(&Pool->Lock);
+
+            if (Last) TppFreePool(Pool);
+            break;
+        }
+
+        Pool->IdleThreads--;
+
+        /* I/O completions only hold a reference if they were announced */
+        Referenced = (Object->PendingCallbacks > 0);
+        if (Referenced)
+        {
+            Object->PendingCallbacks--;
+            Pool->PendingPackets--;
+        }
+
+        Execute = (Object->CancelledCallbacks == 0);
+        if (Execute)
+            Object->RunningCallbacks++;
+        else
+            Object->CancelledCallbacks--;
+
+        RtlLeaveCriticalSection(&Pool->Lock);
+
+        RtlZeroMemory(&Instance, sizeof(Instance));
+        Instance.Object = Object;
+
+        if (Execute)
+            TppExecuteCallback(Object, &Instance, ApcContext, &IoStatusBlock);
+
+        RtlEnterCriticalSection(&Pool->Lock);
+        if (Execute && !Instance.Disassociated) Object->RunningCallbacks--;
+        TppSignalIfIdle(Object);
+        Pool->IdleThreads++;
+        RtlLeaveCriticalSection(&Pool->Lock);
+
+        /* Simple callbacks leave their group as soon as they are done */
+        if (Object->Type == TppObjectSimple) TppRemoveFromCleanupGroup(Object);
+
+        if (Referenced) TppDereferenceObject(Object);
+    }
+
+    RtlpExitThreadFunc(STATUS_SUCCESS);
+    return 0;
+}
+
+static VOID
+NTAPI
+TppTimerCallback(IN PVOID Context,
+                 IN BOOLEAN TimerOrWaitFired)
+{
+    PTPP_OBJECT Object = (PTPP_OBJECT)Context;
+
+    if (!Object->u.Timer.Period) Object->u.Timer.Set = FALSE;
+    TppPostObject(Object, 0);
+}
+
+static VOID
+NTAPI
+TppWaitCallback(IN PVOID Context,
+                IN BOOLEAN TimerOrWaitFired)
+{
+    TppPostObject((PTPP_OBJECT)Context,
+                  TimerOrWaitFired ? WAIT_TIMEOUT : WAIT_OBJECT_0);
+}
+
+/* PUBLIC FUNCTIONS *********************************************************/
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+TpAllocPool(OUT PTP_POOL *PoolReturn,
+            IN PVOID Reserved)
+{
+    PTP_POOL Pool;
+    NTSTATUS Status;
+
+    Pool = RtlAllocateHeap(RtlGetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(TP_POOL));
+    if (!Pool) return STATUS_NO_MEMORY;
+
+    /* Let the port limit concurrency to the number of processors */
+    Status = NtCreateIoCompletion(&Pool->CompletionPort,
+                                  IO_COMPLETION_ALL_ACCESS,
+                                  NULL,
+                                  0);
+    if (!NT_SUCCESS(Status))
+    {
+        RtlFreeHeap(RtlGetProcessHeap(), 0, Pool);
+        return Status;
+    }
+
+    Status = RtlInitializeCriticalSection(&Pool->Lock);
+    if (!NT_SUCCESS(Status))
+    {
+        NtClose(Pool->CompletionPort);
+        RtlFreeHeap(RtlGetProcessHeap(), 0, Pool);
+        return Status;
+    }
+
+    Pool->RefCount = 1;
+    Pool->MaxThreads = TPP_DEFAULT_MAX_THREADS;
+
+    *PoolReturn = Pool;
+    return STATUS_SUCCESS;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpReleasePool(IN PTP_POOL Pool)
+{
+    ASSERT(Pool != TppDefaultPool);
+    TppDereferencePool(Pool);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpSetPoolMaxThreads(IN PTP_POOL Pool,
+                    IN LONG MaxThreads)
+{
+    if (MaxThreads < 1) MaxThreads = 1;
+
+    /* Extra threads retire once they have been idle for a while */
+    RtlEnterCriticalSection(&Pool->Lock);
+    Pool->MaxThreads = MaxThreads;
+    if (Pool->MinThreads > MaxThreads) Pool->MinThreads = MaxThreads;
+    RtlLeaveCriticalSection(&Pool->Lock);
+}
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+TpSetPoolMinThreads(IN PTP_POOL Pool,
+                    IN LONG MinThreads)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    if (MinThreads < 0) return STATUS_INVALID_PARAMETER;
+
+    RtlEnterCriticalSection(&Pool->Lock);
+
+    Pool->MinThreads = MinThreads;
+    if (Pool->MaxThreads < MinThreads) Pool->MaxThreads = MinThreads;
+
+    while (Pool->ThreadCount < MinThreads)
+    {
+        Status = TppStartWorkerThread(Pool);
+        if (!NT_SUCCESS(Status)) break;
+    }
+
+    RtlLeaveCriticalSection(&Pool->Lock);
+    return Status;
+}
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+TpAllocCleanupGroup(OUT PTP_CLEANUP_GROUP *CleanupGroupReturn)
+{
+    PTP_CLEANUP_GROUP Group;
+    NTSTATUS Status;
+
+    Group = RtlAllocateHeap(RtlGetProcessHeap(), 0, sizeof(TP_CLEANUP_GROUP));
+    if (!Group) return STATUS_NO_MEMORY;
+
+    Status = RtlInitializeCriticalSection(&Group->Lock);
+    if (!NT_SUCCESS(Status))
+    {
+        RtlFreeHeap(RtlGetProcessHeap(), 0, Group);
+        return Status;
+    }
+
+    InitializeListHead(&Group->MemberList);
+
+    *CleanupGroupReturn = Group;
+    return STATUS_SUCCESS;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpReleaseCleanupGroupMembers(IN PTP_CLEANUP_GROUP CleanupGroup,
+                             IN BOOLEAN CancelPendingCallbacks,
+                             IN PVOID CleanupParameter OPTIONAL)
+{
+    LIST_ENTRY Members;
+    PLIST_ENTRY Entry;
+    PTPP_OBJECT Object;
+
+    /* Take over the members along with their group references */
+    InitializeListHead(&Members);
+
+    RtlEnterCriticalSection(&CleanupGroup->Lock);
+    while (!IsListEmpty(&CleanupGroup->MemberList))
+    {
+        Entry = RemoveHeadList(&CleanupGroup->MemberList);
+        Object = CONTAINING_RECORD(Entry, TPP_OBJECT, CleanupGroupEntry);
+        Object->InCleanupGroup = FALSE;
+        InsertTailList(&Members, Entry);
+    }
+    RtlLeaveCriticalSection(&CleanupGroup->Lock);
+
+    /* Stop timers and waits from queueing anything new */
+    for (Entry = Members.Flink; Entry != &Members; Entry = Entry->Flink)
+    {
+        Object = CONTAINING_RECORD(Entry, TPP_OBJECT, CleanupGroupEntry);
+        TppShutdownObject(Object);
+    }
+
+    /* Drop what has not started yet if asked to, and tell the owner */
+    if (CancelPendingCallbacks)
+    {
+        for (Entry = Members.Flink; Entry != &Members; Entry = Entry->Flink)
+        {
+            Object = CONTAINING_RECORD(Entry, TPP_OBJECT, CleanupGroupEntry);
+            if (TppCancelPendingCallbacks(Object) && Object->CleanupGroupCancelCallback)
+            {
+                Object->CleanupGroupCancelCallback(Object->Context, CleanupParameter);
+            }
+        }
+    }
+
+    while (!IsListEmpty(&Members))
+    {
+        Entry = RemoveHeadList(&Members);
+        Object = CONTAINING_RECORD(Entry, TPP_OBJECT, CleanupGroupEntry);
+
+        TppWaitForCallbacks(Object, FALSE);
+
+        /* Simple callbacks have no owner reference to release */
+        if (Object->Type != TppObjectSimple) TppReleaseObject(Object);
+        TppDereferenceObject(Object);
+    }
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpReleaseCleanupGroup(IN PTP_CLEANUP_GROUP CleanupGroup)
+{
+    LIST_ENTRY Members;
+    PLIST_ENTRY Entry;
+    PTPP_OBJECT Object;
+
+    /* Members that were never released just leave the group */
+    InitializeListHead(&Members);
+
+    RtlEnterCriticalSection(&CleanupGroup->Lock);
+    while (!IsListEmpty(&CleanupGroup->MemberList))
+    {
+        Entry = RemoveHeadList(&CleanupGroup->MemberList);
+        Object = CONTAINING_RECORD(Entry, TPP_OBJECT, CleanupGroupEntry);
+        Object->InCleanupGroup = FALSE;
+        Object->CleanupGroup = NULL;
+        InsertTailList(&Members, Entry);
+    }
+    RtlLeaveCriticalSection(&CleanupGroup->Lock);
+
+    while (!IsListEmpty(&Members))
+    {
+        Entry = RemoveHeadList(&Members);
+        Object = CONTAINING_RECORD(Entry, TPP_OBJECT, CleanupGroupEntry);
+        TppDereferenceObject(Object);
+    }
+
+    RtlDeleteCriticalSection(&CleanupGroup->Lock);
+    RtlFreeHeap(RtlGetProcessHeap(), 0, CleanupGroup);
+}
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+TpAllocWork(OUT PTP_WORK *WorkReturn,
+            IN PTP_WORK_CALLBACK Callback,
+            IN PVOID Context OPTIONAL,
+            IN PTP_CALLBACK_ENVIRON CallbackEnviron OPTIONAL)
+{
+    return TppAllocObject((PTPP_OBJECT *)WorkReturn,
+                          TppObjectWork,
+                          Callback,
+                          Context,
+                          CallbackEnviron);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpPostWork(IN PTP_WORK Work)
+{
+    NTSTATUS Status;
+
+    Status = TppPostObject((PTPP_OBJECT)Work, 0);
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("Failed to post work 0x%p, Status 0x%lx\n", Work, Status);
+    }
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpReleaseWork(IN PTP_WORK Work)
+{
+    TppRemoveFromCleanupGroup((PTPP_OBJECT)Work);
+    TppReleaseObject((PTPP_OBJECT)Work);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpWaitForWork(IN PTP_WORK Work,
+              IN BOOLEAN CancelPendingCallbacks)
+{
+    TppWaitForCallbacks((PTPP_OBJECT)Work, CancelPendingCallbacks);
+}
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+TpSimpleTryPost(IN PTP_SIMPLE_CALLBACK Callback,
+                IN PVOID Context OPTIONAL,
+                IN PTP_CALLBACK_ENVIRON CallbackEnviron OPTIONAL)
+{
+    PTPP_OBJECT Object;
+    NTSTATUS Status;
+
+    Status = TppAllocObject(&Object,
+                            TppObjectSimple,
+                            Callback,
+                            Context,
+                            CallbackEnviron);
+    if (!NT_SUCCESS(Status)) return Status;
+
+    /* Nobody owns a simple callback, the packet keeps it alive */
+    Object->Released = TRUE;
+    Status = TppPostObject(Object, 0);
+    if (!NT_SUCCESS(Status)) TppRemoveFromCleanupGroup(Object);
+
+    TppDereferenceObject(Object);
+    return Status;
+}
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+TpAllocTimer(OUT PTP_TIMER *TimerReturn,
+             IN PTP_TIMER_CALLBACK Callback,
+             IN PVOID Context OPTIONAL,
+             IN PTP_CALLBACK_ENVIRON CallbackEnviron OPTIONAL)
+{
+    return TppAllocObject((PTPP_OBJECT *)TimerReturn,
+                          TppObjectTimer,
+                          Callback,
+                          Context,
+                          CallbackEnviron);
+}
+
+/*
+ * @implemented
+ *
+ * The timer queue has no notion of coalescing, so WindowLength is only
+ * accepted for compatibility.
+ */
+VOID
+NTAPI
+TpSetTimer(IN PTP_TIMER Timer,
+           IN PLARGE_INTEGER DueTime OPTIONAL,
+           IN LONG Period,
+           IN LONG WindowLength OPTIONAL)
+{
+    PTPP_OBJECT Object = (PTPP_OBJECT)Timer;
+    HANDLE OldTimer, NewTimer;
+    NTSTATUS Status;
+
+    /* Cancel the previous setting, callbacks already queued still run */
+    OldTimer = InterlockedExchangePointer(&Object->u.Timer.Handle, NULL);
+    if (OldTimer) RtlDeleteTimer(NULL, OldTimer, INVALID_HANDLE_VALUE);
+    Object->u.Timer.Set = FALSE;
+
+    if (!DueTime) return;
+
+    /* Set before the timer exists, a one-shot may expire right away */
+    Object->u.Timer.Period = Period;
+    Object->u.Timer.Set = TRUE;
+
+    Status = RtlCreateTimer(NULL,
+                            &NewTimer,
+                            TppTimerCallback,
+                            Object,
+                            TppTimeoutToMilliseconds(DueTime),
+                            (ULONG)Period,
+                            WT_EXECUTEINTIMERTHREAD);
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("Failed to set timer 0x%p, Status 0x%lx\n", Timer, Status);
+        Object->u.Timer.Set = FALSE;
+        return;
+    }
+
+    InterlockedExchangePointer(&Object->u.Timer.Handle, NewTimer);
+}
+
+/*
+ * @implemented
+ */
+BOOLEAN
+NTAPI
+TpIsTimerSet(IN PTP_TIMER Timer)
+{
+    return ((PTPP_OBJECT)Timer)->u.Timer.Set;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpReleaseTimer(IN PTP_TIMER Timer)
+{
+    TppRemoveFromCleanupGroup((PTPP_OBJECT)Timer);
+    TppReleaseObject((PTPP_OBJECT)Timer);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpWaitForTimer(IN PTP_TIMER Timer,
+               IN BOOLEAN CancelPendingCallbacks)
+{
+    TppWaitForCallbacks((PTPP_OBJECT)Timer, CancelPendingCallbacks);
+}
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+TpAllocWait(OUT PTP_WAIT *WaitReturn,
+            IN PTP_WAIT_CALLBACK Callback,
+            IN PVOID Context OPTIONAL,
+            IN PTP_CALLBACK_ENVIRON CallbackEnviron OPTIONAL)
+{
+    return TppAllocObject((PTPP_OBJECT *)WaitReturn,
+                          TppObjectWait,
+                          Callback,
+                          Context,
+                          CallbackEnviron);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpSetWait(IN PTP_WAIT Wait,
+          IN HANDLE Handle OPTIONAL,
+          IN PLARGE_INTEGER Timeout OPTIONAL)
+{
+    PTPP_OBJECT Object = (PTPP_OBJECT)Wait;
+    HANDLE OldWait, NewWait;
+    NTSTATUS Status;
+
+    /* Cancel the previous wait, callbacks already queued still run */
+    OldWait = InterlockedExchangePointer(&Object->u.Wait.Handle, NULL);
+    if (OldWait) RtlDeregisterWaitEx(OldWait, INVALID_HANDLE_VALUE);
+
+    if (!Handle) return;
+
+    Status = RtlRegisterWait(&NewWait,
+                             Handle,
+                             TppWaitCallback,
+                             Object,
+                             TppTimeoutToMilliseconds(Timeout),
+                             WT_EXECUTEONLYONCE | WT_EXECUTEINWAITTHREAD);
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("Failed to set wait 0x%p, Status 0x%lx\n", Wait, Status);
+        return;
+    }
+
+    InterlockedExchangePointer(&Object->u.Wait.Handle, NewWait);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpReleaseWait(IN PTP_WAIT Wait)
+{
+    TppRemoveFromCleanupGroup((PTPP_OBJECT)Wait);
+    TppReleaseObject((PTPP_OBJECT)Wait);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpWaitForWait(IN PTP_WAIT Wait,
+              IN BOOLEAN CancelPendingCallbacks)
+{
+    TppWaitForCallbacks((PTPP_OBJECT)Wait, CancelPendingCallbacks);
+}
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+TpAllocIoCompletion(OUT PTP_IO *IoReturn,
+                    IN HANDLE File,
+                    IN PTP_IO_CALLBACK Callback,
+                    IN PVOID Context OPTIONAL,
+                    IN PTP_CALLBACK_ENVIRON CallbackEnviron OPTIONAL)
+{
+    PTPP_OBJECT Object;
+    FILE_COMPLETION_INFORMATION FileCompletionInfo;
+    IO_STATUS_BLOCK IoStatusBlock;
+    NTSTATUS Status;
+
+    Status = TppAllocObject(&Object,
+                            TppObjectIo,
+                            Callback,
+                            Context,
+                            CallbackEnviron);
+    if (!NT_SUCCESS(Status)) return Status;
+
+    /* Completions for the file now land on the pool's port */
+    FileCompletionInfo.Port = Object->Pool->CompletionPort;
+    FileCompletionInfo.Key = Object;
+
+    Status = NtSetInformationFile(File,
+                                  &IoStatusBlock,
+                                  &FileCompletionInfo,
+                                  sizeof(FileCompletionInfo),
+                                  FileCompletionInformation);
+    if (!NT_SUCCESS(Status))
+    {
+        TppRemoveFromCleanupGroup(Object);
+        TppReleaseObject(Object);
+        return Status;
+    }
+
+    *IoReturn = (PTP_IO)Object;
+    return STATUS_SUCCESS;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpStartAsyncIoOperation(IN PTP_IO Io)
+{
+    PTPP_OBJECT Object = (PTPP_OBJECT)Io;
+    PTP_POOL Pool = Object->Pool;
+
+    /* Account for the completion packet before it can arrive */
+    InterlockedIncrement(&Object->RefCount);
+
+    RtlEnterCriticalSection(&Pool->Lock);
+    Object->PendingCallbacks++;
+    Pool->PendingPackets++;
+    TppGrowPool(Pool);
+    RtlLeaveCriticalSection(&Pool->Lock);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpCancelAsyncIoOperation(IN PTP_IO Io)
+{
+    PTPP_OBJECT Object = (PTPP_OBJECT)Io;
+    PTP_POOL Pool = Object->Pool;
+
+    /* The operation failed right away, no packet is coming */
+    RtlEnterCriticalSection(&Pool->Lock);
+    ASSERT(Object->PendingCallbacks > 0);
+    Object->PendingCallbacks--;
+    Pool->PendingPackets--;
+    if (Object->CancelledCallbacks > Object->PendingCallbacks)
+        Object->CancelledCallbacks = Object->PendingCallbacks;
+    TppSignalIfIdle(Object);
+    RtlLeaveCriticalSection(&Pool->Lock);
+
+    TppDereferenceObject(Object);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpReleaseIoCompletion(IN PTP_IO Io)
+{
+    TppRemoveFromCleanupGroup((PTPP_OBJECT)Io);
+    TppReleaseObject((PTPP_OBJECT)Io);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpWaitForIoCompletion(IN PTP_IO Io,
+                      IN BOOLEAN CancelPendingCallbacks)
+{
+    TppWaitForCallbacks((PTPP_OBJECT)Io, CancelPendingCallbacks);
+}
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+TpCallbackMayRunLong(IN PTP_CALLBACK_INSTANCE Instance)
+{
+    PTP_POOL Pool = Instance->Object->Pool;
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    if (Instance->MayRunLong) return STATUS_SUCCESS;
+    Instance->MayRunLong = TRUE;
+
+    /* Make sure queued work doesn't starve behind this callback */
+    RtlEnterCriticalSection(&Pool->Lock);
+    if (Pool->IdleThreads <= Pool->PendingPackets)
+    {
+        if (Pool->ThreadCount < Pool->MaxThreads)
+            Status = TppStartWorkerThread(Pool);
+        else
+            Status = STATUS_TOO_MANY_THREADS;
+    }
+    RtlLeaveCriticalSection(&Pool->Lock);
+
+    return Status;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpDisassociateCallback(IN PTP_CALLBACK_INSTANCE Instance)
+{
+    PTPP_OBJECT Object = Instance->Object;
+    PTP_POOL Pool = Object->Pool;
+
+    if (Instance->Disassociated) return;
+    Instance->Disassociated = TRUE;
+
+    /* Waiters no longer have to wait for this callback */
+    RtlEnterCriticalSection(&Pool->Lock);
+    Object->RunningCallbacks--;
+    TppSignalIfIdle(Object);
+    RtlLeaveCriticalSection(&Pool->Lock);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpCallbackSetEventOnCompletion(IN PTP_CALLBACK_INSTANCE Instance,
+                               IN HANDLE Event)
+{
+    Instance->Event = Event;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpCallbackReleaseSemaphoreOnCompletion(IN PTP_CALLBACK_INSTANCE Instance,
+                                       IN HANDLE Semaphore,
+                                       IN LONG ReleaseCount)
+{
+    Instance->Semaphore = Semaphore;
+    Instance->SemaphoreReleaseCount = ReleaseCount;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpCallbackReleaseMutexOnCompletion(IN PTP_CALLBACK_INSTANCE Instance,
+                                   IN HANDLE Mutex)
+{
+    Instance->Mutex = Mutex;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpCallbackLeaveCriticalSectionOnCompletion(IN PTP_CALLBACK_INSTANCE Instance,
+                                           IN PRTL_CRITICAL_SECTION CriticalSection)
+{
+    Instance->CriticalSection = CriticalSection;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpCallbackUnloadDllOnCompletion(IN PTP_CALLBACK_INSTANCE Instance,
+                                IN PVOID DllHandle)
+{
+    Instance->DllHandle = DllHandle;
+}
+
+/* EOF */
@@ -23,12 +23,6 @@ extern PRTL_START_POOL_THREAD RtlpStartThreadFunc;
 extern PRTL_EXIT_POOL_THREAD RtlpExitThreadFunc;
 HANDLE TimerThreadHandle = NULL;
 
-NTSTATUS
-RtlpInitializeTimerThread(VOID)
-{
-    return STATUS_NOT_IMPLEMENTED;
-}
-
 static inline PLARGE_INTEGER get_nt_timeout( PLARGE_INTEGER pTime, ULONG timeout )
 {
     if (timeout == INFINITE) return NULL;
@@ -40,7 +34,8 @@ struct timer_queue;
 struct queue_timer
 {
     struct timer_queue *q;
-    struct list entry;
+    struct list entry;          /* in timer_list, sorted by expiration time */
+    struct list queue_entry;    /* in the timers of the owning queue */
     ULONG runcount;             /* number of callbacks pending execution */
     WAITORTIMERCALLBACKFUNC callback;
     PVOID param;
@@ -54,19 +49,35 @@ struct queue_timer
 struct timer_queue
 {
     DWORD magic;
-    RTL_CRITICAL_SECTION cs;
-    struct list timers;         /* sorted by expiration time */
+    struct list timers;         /* all timers of this queue, unsorted */
     BOOL quit;                  /* queue should be deleted; once set, never unset */
-    HANDLE event;
-    HANDLE thread;
+    HANDLE event;               /* set once the last timer is gone after quitting */
 };
 
 #define EXPIRE_NEVER (~(ULONGLONG) 0)
 #define TIMER_QUEUE_MAGIC  0x516d6954   /* TimQ */
 
+/* All timer queues share one timer thread, which sleeps until the earliest
+   deadline of all timers.  The lock protects every queue and timer.  */
+static LONG TimerThreadInitialized = 0;
+static RTL_CRITICAL_SECTION timer_cs;
+static struct list timer_list = LIST_INIT(timer_list);
+static HANDLE timer_event;
+
+static void timer_queue_done(struct timer_queue *q)
+{
+    /* We MUST hold the timer cs while calling this function.  */
+    assert(q->quit && list_empty(&q->timers));
+
+    if (q->event)
+        NtSetEvent(q->event, NULL);
+    q->magic = 0;
+    RtlFreeHeap(RtlGetProcessHeap(), 0, q);
+}
+
 static void queue_remove_timer(struct queue_timer *t)
 {
-    /* We MUST hold the queue cs while calling this function.  This ensures
+    /* We MUST hold the timer cs while calling this function.  This ensures
        that we cannot queue another callback for this timer.  The runcount
        being zero makes sure we don't have any already queued.  */
     struct timer_queue *q = t->q;
@@ -75,18 +86,18 @@ static void queue_remove_timer(struct queue_timer *t)
     assert(t->destroy);
 
     list_remove(&t->entry);
+    list_remove(&t->queue_entry);
     if (t->event)
         NtSetEvent(t->event, NULL);
     RtlFreeHeap(RtlGetProcessHeap(), 0, t);
 
     if (q->quit && list_empty(&q->timers))
-        NtSetEvent(q->event, NULL);
+        timer_queue_done(q);
 }
 
 static void timer_cleanup_callback(struct queue_timer *t)
 {
-    struct timer_queue *q = t->q;
-    RtlEnterCriticalSection(&q->cs);
+    RtlEnterCriticalSection(&timer_cs);
 
     assert(0 < t->runcount);
     --t->runcount;
@@ -94,7 +105,7 @@ static void timer_cleanup_callback(struct queue_timer *t)
     if (t->destroy && t->runcount == 0)
         queue_remove_timer(t);
 
-    RtlLeaveCriticalSection(&q->cs);
+    RtlLeaveCriticalSection(&timer_cs);
 }
 
 static VOID WINAPI timer_callback_wrapper(LPVOID p)
@@ -114,14 +125,13 @@ static inline ULONGLONG queue_current_time(void)
 static void queue_add_timer(struct queue_timer *t, ULONGLONG time,
                             BOOL set_event)
 {
-    /* We MUST hold the queue cs while calling this function.  */
-    struct timer_queue *q = t->q;
-    struct list *ptr = &q->timers;
+    /* We MUST hold the timer cs while calling this function.  */
+    struct list *ptr = &timer_list;
 
-    assert(!q->quit || (t->destroy && time == EXPIRE_NEVER));
+    assert(!t->q->quit || (t->destroy && time == EXPIRE_NEVER));
 
     if (time != EXPIRE_NEVER)
-        LIST_FOR_EACH(ptr, &q->timers)
+        LIST_FOR_EACH(ptr, &timer_list)
         {
             struct queue_timer *cur = LIST_ENTRY(ptr, struct queue_timer, entry);
             if (time < cur->expire)
@@ -133,27 +143,27 @@ static void queue_add_timer(struct queue_timer *t, ULONGLONG time,
 
     /* If we insert at the head of the list, we need to expire sooner
        than expected.  */
-    if (set_event && &t->entry == list_head(&q->timers))
-        NtSetEvent(q->event, NULL);
+    if (set_event && &t->entry == list_head(&timer_list))
+        NtSetEvent(timer_event, NULL);
 }
 
 static inline void queue_move_timer(struct queue_timer *t, ULONGLONG time,
                                     BOOL set_event)
 {
-    /* We MUST hold the queue cs while calling this function.  */
+    /* We MUST hold the timer cs while calling this function.  */
     list_remove(&t->entry);
     queue_add_timer(t, time, set_event);
 }
 
-static void queue_timer_expire(struct timer_queue *q)
+static BOOL queue_timer_expire(void)
 {
     struct queue_timer *t = NULL;
 
-    RtlEnterCriticalSection(&q->cs);
-    if (list_head(&q->timers))
+    RtlEnterCriticalSection(&timer_cs);
+    if (list_head(&timer_list))
     {
         ULONGLONG now, next;
-        t = LIST_ENTRY(list_head(&q->timers), struct queue_timer, entry);
+        t = LIST_ENTRY(list_head(&timer_list), struct queue_timer, entry);
         if (!t->destroy && t->expire <= ((now = queue_current_time())))
         {
             ++t->runcount;
@@ -171,7 +181,7 @@ static void queue_timer_expire(struct timer_queue *q)
         else
             t = NULL;
     }
-    RtlLeaveCriticalSection(&q->cs);
+    RtlLeaveCriticalSection(&timer_cs);
 
     if (t)
     {
@@ -188,17 +198,19 @@ static void queue_timer_expire(struct timer_queue *q)
                 timer_cleanup_callback(t);
         }
     }
+
+    return t != NULL;
 }
 
-static ULONG queue_get_timeout(struct timer_queue *q)
+static ULONG queue_get_timeout(void)
 {
     struct queue_timer *t;
     ULONG timeout = INFINITE;
 
-    RtlEnterCriticalSection(&q->cs);
-    if (list_head(&q->timers))
+    RtlEnterCriticalSection(&timer_cs);
+    if (list_head(&timer_list))
     {
-        t = LIST_ENTRY(list_head(&q->timers), struct queue_timer, entry);
+        t = LIST_ENTRY(list_head(&timer_list), struct queue_timer, entry);
         assert(!t->destroy || t->expire == EXPIRE_NEVER);
 
         if (t->expire != EXPIRE_NEVER)
@@ -207,57 +219,90 @@ static ULONG queue_get_timeout(struct timer_queue *q)
             timeout = t->expire < time ? 0 : (ULONG)(t->expire - time);
         }
     }
-    RtlLeaveCriticalSection(&q->cs);
+    RtlLeaveCriticalSection(&timer_cs);
 
     return timeout;
 }
 
-static DWORD WINAPI timer_queue_thread_proc(LPVOID p)
+static DWORD WINAPI timer_thread_proc(LPVOID p)
 {
-    struct timer_queue *q = p;
-    ULONG timeout_ms;
+    LARGE_INTEGER timeout;
 
-    timeout_ms = INFINITE;
     for (;;)
     {
-        LARGE_INTEGER timeout;
-        NTSTATUS status;
-        BOOL done = FALSE;
+        /* Fire everything that is due.  */
+        while (queue_timer_expire())
+            ;
+
+        /* The event is set when a timer is inserted at the head of the list.
+           The wait is alertable so that persistent work items, which are
+           queued here as APCs, get to run.  */
+        NtWaitForSingleObject(timer_event, TRUE,
+                              get_nt_timeout(&timeout, queue_get_timeout()));
+    }
 
-        status = NtWaitForSingleObject(
-            q->event, FALSE, get_nt_timeout(&timeout, timeout_ms));
+    return 0;
+}
 
-        if (status == STATUS_WAIT_0)
+NTSTATUS
+RtlpInitializeTimerThread(VOID)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+    LARGE_INTEGER Timeout;
+    LONG InitStatus;
+
+    while ((InitStatus = InterlockedCompareExchange(&TimerThreadInitialized,
+                                                    2,
+                                                    0)) != 1)
+    {
+        if (InitStatus == 0)
         {
-            /* There are two possible ways to trigger the event.  Either
-               we are quitting and the last timer got removed, or a new
-               timer got put at the head of the list so we need to adjust
-               our timeout.  */
-            RtlEnterCriticalSection(&q->cs);
-            if (q->quit && list_empty(&q->timers))
-                done = TRUE;
-            RtlLeaveCriticalSection(&q->cs);
-        }
-        else if (status == STATUS_TIMEOUT)
-            queue_timer_expire(q);
+            /* We're the first thread, start the timer thread */
+            Status = RtlInitializeCriticalSection(&timer_cs);
+            if (!NT_SUCCESS(Status))
+                break;
 
-        if (done)
-            break;
+            Status = NtCreateEvent(&timer_event,
+                                   EVENT_ALL_ACCESS,
+                                   NULL,
+                                   SynchronizationEvent,
+                                   FALSE);
+            if (!NT_SUCCESS(Status))
+            {
+                RtlDeleteCriticalSection(&timer_cs);
+                break;
+            }
 
-        timeout_ms = queue_get_timeout(q);
+            Status = RtlpStartThreadFunc(timer_thread_proc,
+                                         NULL,
+                                         &TimerThreadHandle);
+            if (!NT_SUCCESS(Status))
+            {
+                NtClose(timer_event);
+                RtlDeleteCriticalSection(&timer_cs);
+                break;
+            }
+
+            NtResumeThread(TimerThreadHandle, NULL);
+            InterlockedExchange(&TimerThreadInitialized, 1);
+            return STATUS_SUCCESS;
+        }
+
+        /* Another thread is starting the timer thread, poll until it is done */
+        Timeout.QuadPart = -100000LL; /* Wait for 10ms */
+        NtDelayExecution(FALSE, &Timeout);
     }
 
-    NtClose(q->event);
-    RtlDeleteCriticalSection(&q->cs);
-    q->magic = 0;
-    RtlFreeHeap(RtlGetProcessHeap(), 0, q);
-    RtlpExitThreadFunc(STATUS_SUCCESS);
-    return 0;
+    /* Let the next caller try again if we failed */
+    if (!NT_SUCCESS(Status))
+        InterlockedExchange(&TimerThreadInitialized, 0);
+
+    return Status;
 }
 
 static void queue_destroy_timer(struct queue_timer *t)
 {
-    /* We MUST hold the queue cs while calling this function.  */
+    /* We MUST hold the timer cs while calling this function.  */
     t->destroy = TRUE;
     if (t->runcount == 0)
         /* Ensure a timer is promptly removed.  If callbacks are pending,
@@ -285,29 +330,21 @@ static void queue_destroy_timer(struct queue_timer *t)
 NTSTATUS WINAPI RtlCreateTimerQueue(PHANDLE NewTimerQueue)
 {
     NTSTATUS status;
-    struct timer_queue *q = RtlAllocateHeap(RtlGetProcessHeap(), 0, sizeof *q);
+    struct timer_queue *q;
+
+    status = RtlpInitializeTimerThread();
+    if (status != STATUS_SUCCESS)
+        return status;
+
+    q = RtlAllocateHeap(RtlGetProcessHeap(), 0, sizeof *q);
     if (!q)
         return STATUS_NO_MEMORY;
 
-    RtlInitializeCriticalSection(&q->cs);
     list_init(&q->timers);
     q->quit = FALSE;
+    q->event = NULL;
     q->magic = TIMER_QUEUE_MAGIC;
-    status = NtCreateEvent(&q->event, EVENT_ALL_ACCESS, NULL, SynchronizationEvent, FALSE);
-    if (status != STATUS_SUCCESS)
-    {
-        RtlFreeHeap(RtlGetProcessHeap(), 0, q);
-        return status;
-    }
-    status = RtlpStartThreadFunc(timer_queue_thread_proc, q, &q->thread);
-    if (status != STATUS_SUCCESS)
-    {
-        NtClose(q->event);
-        RtlFreeHeap(RtlGetProcessHeap(), 0, q);
-        return status;
-    }
 
-    NtResumeThread(q->thread, NULL);
     *NewTimerQueue = q;
     return STATUS_SUCCESS;
 }
@@ -332,43 +369,41 @@ NTSTATUS WINAPI RtlDeleteTimerQueueEx(HANDLE TimerQueue, HANDLE CompletionEvent)
 {
     struct timer_queue *q = TimerQueue;
     struct queue_timer *t, *temp;
-    HANDLE thread;
+    HANDLE event;
     NTSTATUS status;
 
     if (!q || q->magic != TIMER_QUEUE_MAGIC)
         return STATUS_INVALID_HANDLE;
 
-    thread = q->thread;
+    if (CompletionEvent == INVALID_HANDLE_VALUE)
+    {
+        status = NtCreateEvent(&event, EVENT_ALL_ACCESS, NULL, SynchronizationEvent, FALSE);
+        if (status != STATUS_SUCCESS)
+            return status;
+    }
+    else
+        event = CompletionEvent;
 
-    RtlEnterCriticalSection(&q->cs);
+    RtlEnterCriticalSection(&timer_cs);
+    q->event = event;
+    LIST_FOR_EACH_ENTRY_SAFE(t, temp, &q->timers, struct queue_timer, queue_entry)
+        queue_destroy_timer(t);
+    /* If callbacks are still pending, the last timer to go away will free
+       the queue.  However if we have none left, we must do it ourselves.  */
     q->quit = TRUE;
-    if (list_head(&q->timers))
-        /* When the last timer is removed, it will signal the timer thread to
-           exit...  */
-        LIST_FOR_EACH_ENTRY_SAFE(t, temp, &q->timers, struct queue_timer, entry)
-            queue_destroy_timer(t);
-    else
-        /* However if we have none, we must do it ourselves.  */
-        NtSetEvent(q->event, NULL);
-    RtlLeaveCriticalSection(&q->cs);
+    if (list_empty(&q->timers))
+        timer_queue_done(q);
+    RtlLeaveCriticalSection(&timer_cs);
 
     if (CompletionEvent == INVALID_HANDLE_VALUE)
     {
-        NtWaitForSingleObject(thread, FALSE, NULL);
+        NtWaitForSingleObject(event, FALSE, NULL);
+        NtClose(event);
         status = STATUS_SUCCESS;
     }
     else
-    {
-        if (CompletionEvent)
-        {
-            DPRINT1("asynchronous return on completion event unimplemented\n");
-            NtWaitForSingleObject(thread, FALSE, NULL);
-            NtSetEvent(CompletionEvent, NULL);
-        }
         status = STATUS_PENDING;
-    }
 
-    NtClose(thread);
     return status;
 }
 
@@ -448,12 +483,15 @@ NTSTATUS WINAPI RtlCreateTimer(HANDLE TimerQueue, PHANDLE NewTimer,
     t->event = NULL;
 
     status = STATUS_SUCCESS;
-    RtlEnterCriticalSection(&q->cs);
+    RtlEnterCriticalSection(&timer_cs);
     if (q->quit)
         status = STATUS_INVALID_HANDLE;
     else
+    {
+        list_add_tail(&q->timers, &t->queue_entry);
         queue_add_timer(t, queue_current_time() + DueTime, TRUE);
-    RtlLeaveCriticalSection(&q->cs);
+    }
+    RtlLeaveCriticalSection(&timer_cs);
 
     if (status == STATUS_SUCCESS)
         *NewTimer = t;
@@ -485,16 +523,15 @@ NTSTATUS WINAPI RtlUpdateTimer(HANDLE TimerQueue, HANDLE Timer,
                                DWORD DueTime, DWORD Period)
 {
     struct queue_timer *t = Timer;
-    struct timer_queue *q = t->q;
 
-    RtlEnterCriticalSection(&q->cs);
+    RtlEnterCriticalSection(&timer_cs);
     /* Can't change a timer if it was once-only or destroyed.  */
     if (t->expire != EXPIRE_NEVER)
     {
         t->period = Period;
         queue_move_timer(t, queue_current_time() + DueTime, TRUE);
     }
-    RtlLeaveCriticalSection(&q->cs);
+    RtlLeaveCriticalSection(&timer_cs);
 
     return STATUS_SUCCESS;
 }
@@ -521,13 +558,11 @@ NTSTATUS WINAPI RtlDeleteTimer(HANDLE TimerQueue, HANDLE Timer,
                                HANDLE CompletionEvent)
 {
     struct queue_timer *t = Timer;
-    struct timer_queue *q;
     NTSTATUS status = STATUS_PENDING;
     HANDLE event = NULL;
 
     if (!Timer)
         return STATUS_INVALID_PARAMETER_1;
-    q = t->q;
     if (CompletionEvent == INVALID_HANDLE_VALUE)
     {
         status = NtCreateEvent(&event, EVENT_ALL_ACCESS, NULL, SynchronizationEvent, FALSE);
@@ -537,12 +572,12 @@ NTSTATUS WINAPI RtlDeleteTimer(HANDLE TimerQueue, HANDLE Timer,
     else if (CompletionEvent)
         event = CompletionEvent;
 
-    RtlEnterCriticalSection(&q->cs);
+    RtlEnterCriticalSection(&timer_cs);
     t->event = event;
     if (t->runcount == 0 && event)
         status = STATUS_SUCCESS;
     queue_destroy_timer(t);
-    RtlLeaveCriticalSection(&q->cs);
+    RtlLeaveCriticalSection(&timer_cs);
 
     if (CompletionEvent == INVALID_HANDLE_VALUE && event)
     {
@@ -16,88 +16,436 @@
 #define NDEBUG
 #include <debug.h>
 
+/* Registrations per wait thread, slot 0 is taken by the control event */
+#define RTLP_WAITS_PER_THREAD           (MAXIMUM_WAIT_OBJECTS - 1)
+
+/* An empty wait thread exits after this many milliseconds */
+#define RTLP_WAIT_THREAD_IDLE_TIMEOUT   (10 * 1000)
+
+#define EXPIRE_NEVER (~(ULONGLONG)0)
+
+typedef struct _RTLP_WAIT_THREAD *PRTLP_WAIT_THREAD;
+
 typedef struct _RTLP_WAIT
 {
     HANDLE Object;
-    BOOLEAN CallbackInProgress;
-    HANDLE CancelEvent;
-    LONG DeleteCount;
+    PRTLP_WAIT_THREAD WaitThread;
+    LONG RefCount;
+    ULONG RunCount;
+    BOOLEAN Deleted;
+    HANDLE RemovedEvent;
     HANDLE CompletionEvent;
     ULONG Flags;
     WAITORTIMERCALLBACKFUNC Callback;
     PVOID Context;
     ULONG Milliseconds;
+    ULONGLONG Expire;
 } RTLP_WAIT, *PRTLP_WAIT;
 
+/*
+ * A wait thread services up to RTLP_WAITS_PER_THREAD registrations with a
+ * single NtWaitForMultipleObjects. Other threads only ever append to Waits
+ * and signal the control event; entries are removed by the wait thread
+ * itself, so the indices it waited on stay valid.
+ */
+typedef struct _RTLP_WAIT_THREAD
+{
+    LIST_ENTRY ListEntry;
+    HANDLE ThreadId;
+    HANDLE ControlEvent;
+    ULONG Count;
+    PRTLP_WAIT Waits[RTLP_WAITS_PER_THREAD];
+} RTLP_WAIT_THREAD;
+
+extern PRTL_START_POOL_THREAD RtlpStartThreadFunc;
+extern PRTL_EXIT_POOL_THREAD RtlpExitThreadFunc;
+
+static LONG RtlpWaitThreadsInitialized = 0;
+static RTL_CRITICAL_SECTION RtlpWaitLock;
+static LIST_ENTRY RtlpWaitThreadList;
+
 /* PRIVATE FUNCTIONS *******************************************************/
 
-static inline PLARGE_INTEGER get_nt_timeout( PLARGE_INTEGER pTime, ULONG timeout )
+static inline ULONGLONG
+RtlpWaitCurrentTime(VOID)
+{
+    LARGE_INTEGER Now, Frequency;
+
+    NtQueryPerformanceCounter(&Now, &Frequency);
+    return Now.QuadPart * 1000 / Frequency.QuadPart;
+}
+
+static NTSTATUS
+RtlpInitializeWaitThreads(VOID)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+    LARGE_INTEGER Timeout;
+    LONG InitStatus;
+
+    while ((InitStatus = InterlockedCompareExchange(&RtlpWaitThreadsInitialized,
+                                                    2,
+                                                    0)) != 1)
+    {
+        if (InitStatus == 0)
+        {
+            /* We're the first thread, set up the lock and the thread list */
+            InitializeListHead(&RtlpWaitThreadList);
+            Status = RtlInitializeCriticalSection(&RtlpWaitLock);
+            if (!NT_SUCCESS(Status))
+            {
+                /* Let the next caller try again */
+                InterlockedExchange(&RtlpWaitThreadsInitialized, 0);
+                return Status;
+            }
+
+            InterlockedExchange(&RtlpWaitThreadsInitialized, 1);
+            break;
+        }
+
+        /* Another thread is initializing, poll until it is done */
+        Timeout.QuadPart = -100000LL; /* Wait for 10ms */
+        NtDelayExecution(FALSE, &Timeout);
+    }
+
+    return Status;
+}
+
+static VOID
+RtlpDereferenceWait(IN PRTLP_WAIT Wait)
+{
+    if (InterlockedDecrement(&Wait->RefCount) == 0)
+    {
+        NtClose(Wait->RemovedEvent);
+        RtlFreeHeap(RtlGetProcessHeap(), 0, Wait);
+    }
+}
+
+/* Must be called with the wait lock held, from the wait thread only */
+static VOID
+RtlpRemoveWait(IN PRTLP_WAIT_THREAD WaitThread,
+               IN ULONG Index)
+{
+    PRTLP_WAIT Wait = WaitThread->Waits[Index];
+
+    /* Keep the array packed, the order doesn't matter */
+    WaitThread->Waits[Index] = WaitThread->Waits[--WaitThread->Count];
+
+    /* Let a deregistering thread know we're done with the object */
+    Wait->WaitThread = NULL;
+    NtSetEvent(Wait->RemovedEvent, NULL);
+    RtlpDereferenceWait(Wait);
+}
+
+static VOID
+RtlpCompleteWaitCallback(IN PRTLP_WAIT Wait)
+{
+    RtlEnterCriticalSection(&RtlpWaitLock);
+
+    /* The last callback after a deregistration sets the completion event */
+    if (!--Wait->RunCount && Wait->CompletionEvent)
+        NtSetEvent(Wait->CompletionEvent, NULL);
+
+    RtlLeaveCriticalSection(&RtlpWaitLock);
+
+    RtlpDereferenceWait(Wait);
+}
+
+static VOID
+RtlpExecuteWaitCallback(IN PRTLP_WAIT Wait,
+                        IN BOOLEAN TimerOrWaitFired)
+{
+    Wait->Callback(Wait->Context, TimerOrWaitFired);
+    RtlpCompleteWaitCallback(Wait);
+}
+
+static VOID
+NTAPI
+RtlpWaitSignaledWorker(IN PVOID Context)
 {
-    if (timeout == INFINITE) return NULL;
-    pTime->QuadPart = (ULONGLONG)timeout * -10000;
-    return pTime;
+    RtlpExecuteWaitCallback((PRTLP_WAIT)Context, FALSE);
 }
 
 static VOID
 NTAPI
-Wait_thread_proc(LPVOID Arg)
+RtlpWaitTimedOutWorker(IN PVOID Context)
+{
+    RtlpExecuteWaitCallback((PRTLP_WAIT)Context, TRUE);
+}
+
+/* Must be called with the wait lock held, returns TRUE if the wait was removed */
+static BOOLEAN
+RtlpFireWait(IN PRTLP_WAIT_THREAD WaitThread,
+             IN ULONG Index,
+             IN ULONGLONG Now,
+             OUT PRTLP_WAIT *Fired)
+{
+    PRTLP_WAIT Wait = WaitThread->Waits[Index];
+
+    /* The callback keeps the registration alive until it returns */
+    Wait->RunCount++;
+    InterlockedIncrement(&Wait->RefCount);
+    *Fired = Wait;
+
+    if (Wait->Flags & WT_EXECUTEONLYONCE)
+    {
+        RtlpRemoveWait(WaitThread, Index);
+        return TRUE;
+    }
+
+    if (Wait->Milliseconds != INFINITE)
+        Wait->Expire = Now + Wait->Milliseconds;
+    return FALSE;
+}
+
+static VOID
+RtlpDispatchWaitCallback(IN PRTLP_WAIT Wait,
+                         IN BOOLEAN TimerOrWaitFired)
 {
-    PRTLP_WAIT Wait = (PRTLP_WAIT) Arg;
     NTSTATUS Status;
-    BOOLEAN alertable = (Wait->Flags & WT_EXECUTEINIOTHREAD) != 0;
-    HANDLE handles[2] = { Wait->CancelEvent, Wait->Object };
-    LARGE_INTEGER timeout;
-    HANDLE completion_event;
 
-//    TRACE("\n");
+    if (Wait->Flags & WT_EXECUTEINWAITTHREAD)
+    {
+        RtlpExecuteWaitCallback(Wait, TimerOrWaitFired);
+        return;
+    }
+
+    Status = RtlQueueWorkItem(TimerOrWaitFired ? RtlpWaitTimedOutWorker :
+                                                 RtlpWaitSignaledWorker,
+                              Wait,
+                              Wait->Flags & (WT_EXECUTEINIOTHREAD |
+                                             WT_EXECUTEINPERSISTENTTHREAD |
+                                             WT_EXECUTELONGFUNCTION |
+                                             WT_TRANSFER_IMPERSONATION));
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("Failed to queue wait callback 0x%p, Status 0x%lx\n", Wait->Callback, Status);
+        RtlpCompleteWaitCallback(Wait);
+    }
+}
+
+/* Must be called with the wait lock held */
+static VOID
+RtlpDropInvalidWaits(IN PRTLP_WAIT_THREAD WaitThread)
+{
+    LARGE_INTEGER Timeout;
+    NTSTATUS Status;
+    ULONG i;
+
+    /* Someone closed a handle under our feet, find and drop it */
+    Timeout.QuadPart = 0;
+    for (i = 0; i < WaitThread->Count;)
+    {
+        Status = NtWaitForSingleObject(WaitThread->Waits[i]->Object,
+                                       FALSE,
+                                       &Timeout);
+        if (!NT_SUCCESS(Status))
+        {
+            DPRINT1("Dropping wait on invalid handle 0x%p, Status 0x%lx\n",
+                    WaitThread->Waits[i]->Object, Status);
+            RtlpRemoveWait(WaitThread, i);
+            continue;
+        }
+
+        i++;
+    }
+}
+
+static
+DWORD
+NTAPI
+RtlpWaitThreadProc(IN PVOID Parameter)
+{
+    PRTLP_WAIT_THREAD WaitThread = (PRTLP_WAIT_THREAD)Parameter;
+    HANDLE Handles[MAXIMUM_WAIT_OBJECTS];
+    PRTLP_WAIT Fired[RTLP_WAITS_PER_THREAD];
+    ULONG Count, FiredCount, Index, i;
+    ULONGLONG Now, Expire;
+    LARGE_INTEGER Timeout;
+    PLARGE_INTEGER TimeoutPtr;
+    BOOLEAN TimedOut, Retire = FALSE;
+    NTSTATUS Status;
+
+    WaitThread->ThreadId = NtCurrentTeb()->ClientId.UniqueThread;
 
     while (TRUE)
     {
-        Status = NtWaitForMultipleObjects( 2,
-                                           handles,
-                                           WaitAny,
-                                           alertable,
-                                           get_nt_timeout( &timeout, Wait->Milliseconds ) );
+        RtlEnterCriticalSection(&RtlpWaitLock);
+
+        /* Drop the registrations that were deregistered meanwhile */
+        for (i = 0; i < WaitThread->Count;)
+        {
+            if (WaitThread->Waits[i]->Deleted)
+            {
+                RtlpRemoveWait(WaitThread, i);
+                continue;
+            }
+
+            i++;
+        }
+
+        /* Exit if nothing got registered while we were idle */
+        if (!WaitThread->Count && Retire)
+        {
+            RemoveEntryList(&WaitThread->ListEntry);
+            RtlLeaveCriticalSection(&RtlpWaitLock);
+            break;
+        }
 
-        if (Status == STATUS_WAIT_1 || Status == STATUS_TIMEOUT)
+        /* Build the handle array and find the earliest timeout */
+        Handles[0] = WaitThread->ControlEvent;
+        Count = WaitThread->Count;
+        Expire = EXPIRE_NEVER;
+        for (i = 0; i < Count; i++)
         {
-            BOOLEAN TimerOrWaitFired;
+            Handles[i + 1] = WaitThread->Waits[i]->Object;
+            if (WaitThread->Waits[i]->Expire < Expire)
+                Expire = WaitThread->Waits[i]->Expire;
+        }
+
+        RtlLeaveCriticalSection(&RtlpWaitLock);
 
-            if (Status == STATUS_WAIT_1)
+        if (!Count)
+        {
+            Timeout.QuadPart = (LONGLONG)RTLP_WAIT_THREAD_IDLE_TIMEOUT * -10000;
+            TimeoutPtr = &Timeout;
+        }
+        else if (Expire != EXPIRE_NEVER)
+        {
+            Now = RtlpWaitCurrentTime();
+            Timeout.QuadPart = (Expire > Now) ? (LONGLONG)(Expire - Now) * -10000 : 0;
+            TimeoutPtr = &Timeout;
+        }
+        else
+        {
+            TimeoutPtr = NULL;
+        }
+
+        /* Wait alertable, so that callbacks running here can use APCs */
+        Status = NtWaitForMultipleObjects(Count + 1,
+                                          Handles,
+                                          WaitAny,
+                                          TRUE,
+                                          TimeoutPtr);
+
+        FiredCount = 0;
+        TimedOut = FALSE;
+
+        if ((ULONG)Status > STATUS_WAIT_0 && (ULONG)Status <= STATUS_WAIT_0 + Count)
+        {
+            Index = Status - STATUS_WAIT_1;
+        }
+        else if ((ULONG)Status > STATUS_ABANDONED_WAIT_0 &&
+                 (ULONG)Status <= STATUS_ABANDONED_WAIT_0 + Count)
+        {
+            Index = Status - STATUS_ABANDONED_WAIT_0 - 1;
+        }
+        else
+        {
+            Index = MAXULONG;
+        }
+
+        if (Index != MAXULONG)
+        {
+            /* An object got signaled */
+            RtlEnterCriticalSection(&RtlpWaitLock);
+            if (!WaitThread->Waits[Index]->Deleted)
             {
-   //             TRACE( "object %p signaled, calling callback %p with context %p\n",
-   //                 Wait->Object, Wait->Callback,
-   //                 Wait->Context );
-                TimerOrWaitFired = FALSE;
+                RtlpFireWait(WaitThread,
+                             Index,
+                             RtlpWaitCurrentTime(),
+                             &Fired[FiredCount++]);
             }
-            else
+            RtlLeaveCriticalSection(&RtlpWaitLock);
+        }
+        else if (Status == STATUS_TIMEOUT)
+        {
+            if (!Count)
             {
-    //            TRACE( "wait for object %p timed out, calling callback %p with context %p\n",
-    //                Wait->Object, Wait->Callback,
-    //                Wait->Context );
-                TimerOrWaitFired = TRUE;
+                /* Nobody used us for a while */
+                Retire = TRUE;
+                continue;
             }
-            Wait->CallbackInProgress = TRUE;
-            Wait->Callback( Wait->Context, TimerOrWaitFired );
-            Wait->CallbackInProgress = FALSE;
 
-            if (Wait->Flags & WT_EXECUTEONLYONCE)
-                break;
+            /* Fire all the registrations whose timeout expired */
+            TimedOut = TRUE;
+            Now = RtlpWaitCurrentTime();
+            RtlEnterCriticalSection(&RtlpWaitLock);
+            for (i = 0; i < WaitThread->Count;)
+            {
+                if (!WaitThread->Waits[i]->Deleted &&
+                    WaitThread->Waits[i]->Expire <= Now)
+                {
+                    /* A once-only wait gets removed, which refills slot i */
+                    if (RtlpFireWait(WaitThread, i, Now, &Fired[FiredCount++]))
+                        continue;
+                }
+
+                i++;
+            }
+            RtlLeaveCriticalSection(&RtlpWaitLock);
         }
-        else if (Status != STATUS_USER_APC)
-            break;
+        else if (!NT_SUCCESS(Status))
+        {
+            DPRINT1("Wait thread failed to wait, Status 0x%lx\n", Status);
+            RtlEnterCriticalSection(&RtlpWaitLock);
+            RtlpDropInvalidWaits(WaitThread);
+            RtlLeaveCriticalSection(&RtlpWaitLock);
+        }
+
+        Retire = FALSE;
+
+        /* Run the callbacks outside of the lock */
+        for (i = 0; i < FiredCount; i++)
+            RtlpDispatchWaitCallback(Fired[i], TimedOut);
     }
 
-    completion_event = Wait->CompletionEvent;
-    if (completion_event) NtSetEvent( completion_event, NULL );
+    NtClose(WaitThread->ControlEvent);
+    RtlFreeHeap(RtlGetProcessHeap(), 0, WaitThread);
+    RtlpExitThreadFunc(STATUS_SUCCESS);
+    return 0;
+}
+
+/* Must be called with the wait lock held */
+static NTSTATUS
+RtlpCreateWaitThread(OUT PRTLP_WAIT_THREAD *WaitThreadReturn)
+{
+    PRTLP_WAIT_THREAD WaitThread;
+    HANDLE ThreadHandle;
+    NTSTATUS Status;
+
+    WaitThread = RtlAllocateHeap(RtlGetProcessHeap(), 0, sizeof(RTLP_WAIT_THREAD));
+    if (!WaitThread)
+        return STATUS_NO_MEMORY;
+
+    WaitThread->ThreadId = NULL;
+    WaitThread->Count = 0;
 
-    if (InterlockedIncrement( &Wait->DeleteCount ) == 2 )
+    Status = NtCreateEvent(&WaitThread->ControlEvent,
+                           EVENT_ALL_ACCESS,
+                           NULL,
+                           SynchronizationEvent,
+                           FALSE);
+    if (!NT_SUCCESS(Status))
     {
-       NtClose( Wait->CancelEvent );
-       RtlFreeHeap( RtlGetProcessHeap(), 0, Wait );
+        RtlFreeHeap(RtlGetProcessHeap(), 0, WaitThread);
+        return Status;
     }
-}
 
+    Status = RtlpStartThreadFunc(RtlpWaitThreadProc, WaitThread, &ThreadHandle);
+    if (!NT_SUCCESS(Status))
+    {
+        NtClose(WaitThread->ControlEvent);
+        RtlFreeHeap(RtlGetProcessHeap(), 0, WaitThread);
+        return Status;
+    }
+
+    InsertTailList(&RtlpWaitThreadList, &WaitThread->ListEntry);
+    NtResumeThread(ThreadHandle, NULL);
+    NtClose(ThreadHandle);
+
+    *WaitThreadReturn = WaitThread;
+    return STATUS_SUCCESS;
+}
 
 /* FUNCTIONS ***************************************************************/
 
@@ -137,10 +485,16 @@ RtlRegisterWait(PHANDLE NewWaitObject,
                 ULONG Flags)
 {
     PRTLP_WAIT Wait;
+    PRTLP_WAIT_THREAD WaitThread = NULL;
+    PLIST_ENTRY ListEntry;
     NTSTATUS Status;
 
     //TRACE( "(%p, %p, %p, %p, %d, 0x%x)\n", NewWaitObject, Object, Callback, Context, Milliseconds, Flags );
 
+    Status = RtlpInitializeWaitThreads();
+    if (!NT_SUCCESS(Status))
+        return Status;
+
     Wait = RtlAllocateHeap( RtlGetProcessHeap(), 0, sizeof(RTLP_WAIT) );
     if (!Wait)
         return STATUS_NO_MEMORY;
@@ -150,12 +504,14 @@ RtlRegisterWait(PHANDLE NewWaitObject,
     Wait->Context = Context;
     Wait->Milliseconds = Milliseconds;
     Wait->Flags = Flags;
-    Wait->CallbackInProgress = FALSE;
-    Wait->DeleteCount = 0;
+    Wait->WaitThread = NULL;
+    Wait->RefCount = 1;
+    Wait->RunCount = 0;
+    Wait->Deleted = FALSE;
     Wait->CompletionEvent = NULL;
 
-    Status = NtCreateEvent( &Wait->CancelEvent, 
-                             EVENT_ALL_ACCESS, 
+    Status = NtCreateEvent( &Wait->RemovedEvent,
+                             EVENT_ALL_ACCESS,
                              NULL,
                              NotificationEvent,
                              FALSE );
@@ -166,16 +522,42 @@ RtlRegisterWait(PHANDLE NewWaitObject,
         return Status;
     }
 
-    Flags = Flags & (WT_EXECUTEINIOTHREAD | WT_EXECUTEINPERSISTENTTHREAD |
-                     WT_EXECUTELONGFUNCTION | WT_TRANSFER_IMPERSONATION);
+    RtlEnterCriticalSection(&RtlpWaitLock);
 
-    Status = RtlQueueWorkItem( Wait_thread_proc,
-                               Wait,
-                               Flags );
+    /* Look for a wait thread with a free slot */
+    for (ListEntry = RtlpWaitThreadList.Flink;
+         ListEntry != &RtlpWaitThreadList;
+         ListEntry = ListEntry->Flink)
+    {
+        WaitThread = CONTAINING_RECORD(ListEntry, RTLP_WAIT_THREAD, ListEntry);
+        if (WaitThread->Count < RTLP_WAITS_PER_THREAD)
+            break;
+        WaitThread = NULL;
+    }
 
-    if (Status != STATUS_SUCCESS)
+    /* All of them are full, start another one */
+    if (!WaitThread)
+        Status = RtlpCreateWaitThread(&WaitThread);
+
+    if (NT_SUCCESS(Status))
     {
-        NtClose( Wait->CancelEvent );
+        Wait->Expire = (Milliseconds == INFINITE) ? EXPIRE_NEVER :
+                       RtlpWaitCurrentTime() + Milliseconds;
+
+        /* The wait thread holds its own reference */
+        InterlockedIncrement(&Wait->RefCount);
+        Wait->WaitThread = WaitThread;
+        WaitThread->Waits[WaitThread->Count++] = Wait;
+
+        /* Make it pick up the new handle */
+        NtSetEvent(WaitThread->ControlEvent, NULL);
+    }
+
+    RtlLeaveCriticalSection(&RtlpWaitLock);
+
+    if (!NT_SUCCESS(Status))
+    {
+        NtClose( Wait->RemovedEvent );
         RtlFreeHeap( RtlGetProcessHeap(), 0, Wait );
         return Status;
     }
@@ -203,52 +585,75 @@ RtlDeregisterWaitEx(HANDLE WaitHandle,
                     HANDLE CompletionEvent)
 {
     PRTLP_WAIT Wait = (PRTLP_WAIT) WaitHandle;
+    PRTLP_WAIT_THREAD WaitThread;
     NTSTATUS Status = STATUS_SUCCESS;
+    HANDLE Event;
+    ULONG i;
 
     //TRACE( "(%p)\n", WaitHandle );
 
-    NtSetEvent( Wait->CancelEvent, NULL );
-    if (Wait->CallbackInProgress)
+    if (CompletionEvent == INVALID_HANDLE_VALUE)
     {
-        if (CompletionEvent != NULL)
-        {
-            if (CompletionEvent == INVALID_HANDLE_VALUE)
-            {
-                Status = NtCreateEvent( &CompletionEvent,
-                                         EVENT_ALL_ACCESS,
-                                         NULL,
-                                         NotificationEvent,
-                                         FALSE );
-
-                if (Status != STATUS_SUCCESS)
-                    return Status;
-
-                (void)InterlockedExchangePointer( &Wait->CompletionEvent, CompletionEvent );
-
-                if (Wait->CallbackInProgress)
-                    NtWaitForSingleObject( CompletionEvent, FALSE, NULL );
-
-                NtClose( CompletionEvent );
-            }
-            else
-            {
-                (void)InterlockedExchangePointer( &Wait->CompletionEvent, CompletionEvent );
+        Status = NtCreateEvent( &Event,
+                                 EVENT_ALL_ACCESS,
+                                 NULL,
+                                 NotificationEvent,
+                                 FALSE );
+
+        if (Status != STATUS_SUCCESS)
+            return Status;
+    }
+    else
+        Event = CompletionEvent;
 
-                if (Wait->CallbackInProgress)
-                    Status = STATUS_PENDING;
-            }
+    RtlEnterCriticalSection(&RtlpWaitLock);
+    Wait->Deleted = TRUE;
+    WaitThread = Wait->WaitThread;
+    if (WaitThread)
+    {
+        if (WaitThread->ThreadId == NtCurrentTeb()->ClientId.UniqueThread)
+        {
+            /* We're called from a callback in the wait thread, drop it now */
+            for (i = 0; WaitThread->Waits[i] != Wait; i++);
+            RtlpRemoveWait(WaitThread, i);
+            WaitThread = NULL;
         }
         else
-            Status = STATUS_PENDING;
+        {
+            /* Have the wait thread drop it */
+            NtSetEvent(WaitThread->ControlEvent, NULL);
+        }
     }
+    RtlLeaveCriticalSection(&RtlpWaitLock);
+
+    /* The caller may close the object once we return */
+    if (WaitThread)
+        NtWaitForSingleObject(Wait->RemovedEvent, FALSE, NULL);
 
-    if (InterlockedIncrement( &Wait->DeleteCount ) == 2 )
+    RtlEnterCriticalSection(&RtlpWaitLock);
+    if (Wait->RunCount)
     {
-        Status = STATUS_SUCCESS;
-        NtClose( Wait->CancelEvent );
-        RtlFreeHeap( RtlGetProcessHeap(), 0, Wait );
+        /* The last callback to return sets the event */
+        Wait->CompletionEvent = Event;
+        Status = STATUS_PENDING;
+    }
+    else if (Event && CompletionEvent != INVALID_HANDLE_VALUE)
+    {
+        NtSetEvent(Event, NULL);
+    }
+    RtlLeaveCriticalSection(&RtlpWaitLock);
+
+    if (CompletionEvent == INVALID_HANDLE_VALUE)
+    {
+        if (Status == STATUS_PENDING)
+        {
+            NtWaitForSingleObject(Event, FALSE, NULL);
+            Status = STATUS_SUCCESS;
+        }
+        NtClose(Event);
     }
 
+    RtlpDereferenceWait(Wait);
     return Status;
 }
 
@@ -26,6 +26,10 @@
 #include "cabinet.h"
 #include "raw.h"
 #include "mszip.h"
+#include "lzx.h"
+#ifndef CAB_READ_ONLY
+#include "pool.h"
+#endif
 
 #if defined(_WIN32)
 #define GetSizeOfFile(handle) _GetSizeOfFile(handle)
@@ -330,12 +334,19 @@ CCabinet::CCabinet()
     Codec          = NULL;
     CodecId        = -1;
     CodecSelected  = false;
+    LZXWindowBits  = LZX_DEFAULT_WINDOW;
+    LZXLastNode    = NULL;
+    LZXNextNode    = NULL;
 
     OutputBuffer = NULL;
     InputBuffer  = NULL;
     MaxDiskSize  = 0;
     BlockIsSplit = false;
     ScratchFile  = NULL;
+    Pool         = NULL;
+    ThreadCount  = 1;
+    TotalUncompBytes = 0;
+    TotalCompBytes   = 0;
 
     FolderUncompSize = 0;
     BytesLeftInBlock = 0;
@@ -601,10 +612,30 @@ bool CCabinet::SetCompressionCodec(char* CodecName)
  *    CodecName = Pointer to a string with the name of the codec
  */
 {
+    ULONG WindowBits;
+    char* End;
+
     if( !strcasecmp(CodecName, "raw") )
         SelectCodec(CAB_CODEC_RAW);
     else if( !strcasecmp(CodecName, "mszip") )
         SelectCodec(CAB_CODEC_MSZIP);
+    else if( !strncasecmp(CodecName, "lzx", 3) && (CodecName[3] == '\0' || CodecName[3] == ':') )
+    {
+        /* "lzx:<bits>" selects the window size */
+        WindowBits = LZX_DEFAULT_WINDOW;
+        if (CodecName[3] == ':')
+        {
+            WindowBits = strtoul(&CodecName[4], &End, 10);
+            if (*End != '\0' || WindowBits < LZX_MIN_WINDOW || WindowBits > LZX_MAX_WINDOW)
+            {
+                printf("ERROR: The LZX window must be %u to %u bits!\n", LZX_MIN_WINDOW, LZX_MAX_WINDOW);
+                return false;
+            }
+        }
+
+        LZXWindowBits = WindowBits;
+        SelectCodec(CAB_CODEC_LZX);
+    }
     else
     {
         printf("ERROR: Invalid codec specified!\n");
@@ -733,10 +764,14 @@ ULONG CCabinet::Open()
         ULONG BytesRead;
         ULONG Size;
 
-        OutputBuffer = AllocateMemory(CAB_BLOCKSIZE + 12);    // This should be enough
+        OutputBuffer = AllocateMemory(CAB_MAX_COMPSIZE);
         if (!OutputBuffer)
             return CAB_STATUS_NOMEMORY;
 
+        /* The data block nodes are about to be replaced */
+        LZXLastNode = NULL;
+        LZXNextNode = NULL;
+
 #if defined(_WIN32)
         FileHandle = CreateFile(CabinetName, // Open this file
             GENERIC_READ,                    // Open for reading
@@ -1031,6 +1066,7 @@ ULONG CCabinet::ExtractFile(char* FileName)
     PUCHAR CurrentBuffer;
     FILEHANDLE DestFile;
     PCFFILE_NODE File;
+    PCFDATA_NODE DataNode;
     CFDATA CFData;
     ULONG Status;
     bool Skip;
@@ -1059,6 +1095,13 @@ ULONG CCabinet::ExtractFile(char* FileName)
             SelectCodec(CAB_CODEC_MSZIP);
             break;
 
+        case CAB_COMP_LZX:
+            LZXWindowBits = CAB_COMP_LZX_WINDOW(CurrentFolderNode->Folder.CompressionType);
+            if (LZXWindowBits < LZX_MIN_WINDOW || LZXWindowBits > LZX_MAX_WINDOW)
+                return CAB_STATUS_UNSUPPCOMP;
+            SelectCodec(CAB_CODEC_LZX);
+            break;
+
         default:
             return CAB_STATUS_UNSUPPCOMP;
     }
@@ -1142,7 +1185,7 @@ ULONG CCabinet::ExtractFile(char* FileName)
 #endif
     SetAttributesOnFile(DestName, File->File.Attributes);
 
-    Buffer = (PUCHAR)AllocateMemory(CAB_BLOCKSIZE + 12); // This should be enough
+    Buffer = (PUCHAR)AllocateMemory(CAB_MAX_COMPSIZE);
     if (!Buffer)
     {
         CloseFile(DestFile);
@@ -1150,6 +1193,20 @@ ULONG CCabinet::ExtractFile(char* FileName)
         return CAB_STATUS_NOMEMORY;
     }
 
+    /* LZX data blocks can only be uncompressed after the ones before them */
+    if ((CodecId == CAB_CODEC_LZX) &&
+        (File->DataBlock != LZXNextNode) && (File->DataBlock != LZXLastNode))
+    {
+        Status = PrimeLZXDecoder(File->DataBlock);
+        if (Status != CAB_STATUS_SUCCESS)
+        {
+            CloseFile(DestFile);
+            FreeMemory(Buffer);
+            return Status;
+        }
+    }
+    DataNode = File->DataBlock;
+
     /* Call OnExtract event handler */
     OnExtract(&File->File, FileName);
 
@@ -1216,7 +1273,7 @@ ULONG CCabinet::ExtractFile(char* FileName)
                         CFData.CompSize,
                         CFData.UncompSize));
 
-                    ASSERT(CFData.CompSize <= CAB_BLOCKSIZE + 12);
+                    ASSERT(CFData.CompSize <= CAB_MAX_COMPSIZE);
 
                     BytesToRead = CFData.CompSize;
 
@@ -1292,6 +1349,7 @@ ULONG CCabinet::ExtractFile(char* FileName)
 
                         /* The file is continued in the first data block in the folder */
                         File->DataBlock = CurrentFolderNode->DataListHead;
+                        DataNode = File->DataBlock;
 
                         /* Search to start of file */
 #if defined(_WIN32)
@@ -1330,17 +1388,35 @@ ULONG CCabinet::ExtractFile(char* FileName)
 
                 DPRINT(MAX_TRACE, ("TotalBytesRead (%u).\n", (UINT)TotalBytesRead));
 
-                Status = Codec->Uncompress(OutputBuffer, Buffer, TotalBytesRead, &BytesToWrite);
-                if (Status != CS_SUCCESS)
+                BytesToWrite = CFData.UncompSize;
+
+                /* If the previous file ended in this block, it's still in the output buffer */
+                if ((CodecId != CAB_CODEC_LZX) || (DataNode == NULL) || (DataNode != LZXLastNode))
                 {
-                    CloseFile(DestFile);
-                    FreeMemory(Buffer);
-                    DPRINT(MID_TRACE, ("Cannot uncompress block.\n"));
-                    if (Status == CS_NOMEMORY)
-                        return CAB_STATUS_NOMEMORY;
-                    return CAB_STATUS_INVALID_CAB;
+                    LZXLastNode = NULL;
+                    LZXNextNode = NULL;
+
+                    Status = Codec->Uncompress(OutputBuffer, Buffer, TotalBytesRead, &BytesToWrite);
+                    if (Status != CS_SUCCESS)
+                    {
+                        CloseFile(DestFile);
+                        FreeMemory(Buffer);
+                        DPRINT(MID_TRACE, ("Cannot uncompress block.\n"));
+                        if (Status == CS_NOMEMORY)
+                            return CAB_STATUS_NOMEMORY;
+                        return CAB_STATUS_INVALID_CAB;
+                    }
+
+                    if ((CodecId == CAB_CODEC_LZX) && (DataNode != NULL))
+                    {
+                        LZXLastNode = DataNode;
+                        LZXNextNode = DataNode->Next;
+                    }
                 }
 
+                if (DataNode != NULL)
+                    DataNode = DataNode->Next;
+
                 if (BytesToWrite != CFData.UncompSize)
                 {
                     DPRINT(MID_TRACE, ("BytesToWrite (%u) != CFData.UncompSize (%d)\n",
@@ -1397,6 +1473,7 @@ ULONG CCabinet::ExtractFile(char* FileName)
                 }
 #endif
 
+                DataNode   = CurrentDataNode->Next;
                 ReuseBlock = false;
             }
 
@@ -1450,6 +1527,91 @@ ULONG CCabinet::ExtractFile(char* FileName)
     return CAB_STATUS_SUCCESS;
 }
 
+ULONG CCabinet::PrimeLZXDecoder(PCFDATA_NODE DataNode)
+/*
+ * FUNCTION: Uncompresses the data blocks of the current folder up to a data block
+ * ARGUMENTS:
+ *     DataNode = Pointer to data block the codec should uncompress next
+ * RETURNS:
+ *     Status of operation
+ * NOTES:
+ *     LZX data blocks refer back to the ones before them in the folder
+ */
+{
+    PCFDATA_NODE Node;
+    CFDATA CFData;
+    ULONG BytesRead;
+    ULONG BytesToWrite;
+    ULONG Status;
+    PUCHAR Buffer;
+
+    Codec->Reset();
+    LZXLastNode = NULL;
+    LZXNextNode = NULL;
+
+    Buffer = (PUCHAR)AllocateMemory(CAB_MAX_COMPSIZE);
+    if (!Buffer)
+    {
+        DPRINT(MIN_TRACE, ("Insufficient memory.\n"));
+        return CAB_STATUS_NOMEMORY;
+    }
+
+    for (Node = CurrentFolderNode->DataListHead; Node != DataNode; Node = Node->Next)
+    {
+        /* Blocks split across cabinets are not supported here */
+        if ((Node == NULL) || (Node->Data.UncompSize == 0))
+        {
+            DPRINT(MIN_TRACE, ("Cannot find LZX data block.\n"));
+            FreeMemory(Buffer);
+            return CAB_STATUS_INVALID_CAB;
+        }
+
+#if defined(_WIN32)
+        if (SetFilePointer(FileHandle, Node->AbsoluteOffset, NULL, FILE_BEGIN) == INVALID_SET_FILE_POINTER)
+        {
+            DPRINT(MIN_TRACE, ("SetFilePointer() failed, error code is %u.\n", (UINT)GetLastError()));
+            FreeMemory(Buffer);
+            return CAB_STATUS_INVALID_CAB;
+        }
+#else
+        if (fseek(FileHandle, (off_t)Node->AbsoluteOffset, SEEK_SET) != 0)
+        {
+            DPRINT(MIN_TRACE, ("fseek() failed.\n"));
+            FreeMemory(Buffer);
+            return CAB_STATUS_FAILURE;
+        }
+#endif
+
+        if (((Status = ReadBlock(&CFData, sizeof(CFDATA), &BytesRead)) != CAB_STATUS_SUCCESS) ||
+            (CFData.CompSize > CAB_MAX_COMPSIZE) ||
+            ((Status = ReadBlock(Buffer, CFData.CompSize, &BytesRead)) != CAB_STATUS_SUCCESS) ||
+            (BytesRead != CFData.CompSize))
+        {
+            DPRINT(MIN_TRACE, ("Cannot read from file.\n"));
+            FreeMemory(Buffer);
+            return CAB_STATUS_INVALID_CAB;
+        }
+
+        BytesToWrite = CFData.UncompSize;
+        Status = Codec->Uncompress(OutputBuffer, Buffer, CFData.CompSize, &BytesToWrite);
+        if (Status != CS_SUCCESS)
+        {
+            DPRINT(MID_TRACE, ("Cannot uncompress block.\n"));
+            FreeMemory(Buffer);
+            if (Status == CS_NOMEMORY)
+                return CAB_STATUS_NOMEMORY;
+            return CAB_STATUS_INVALID_CAB;
+        }
+
+        LZXLastNode = Node;
+        LZXNextNode = Node->Next;
+    }
+
+    FreeMemory(Buffer);
+
+    return CAB_STATUS_SUCCESS;
+}
+
 bool CCabinet::IsCodecSelected()
 /*
  * FUNCTION: Returns the value of CodecSelected
@@ -1469,13 +1631,18 @@ void CCabinet::SelectCodec(LONG Id)
 {
     if (CodecSelected)
     {
-        if (Id == CodecId)
+        if ((Id == CodecId) && ((Id != CAB_CODEC_LZX) ||
+            (((CLZXCodec*)Codec)->GetWindowBits() == LZXWindowBits)))
             return;
 
         CodecSelected = false;
         delete Codec;
     }
 
+    /* A new codec has no LZX history */
+    LZXLastNode = NULL;
+    LZXNextNode = NULL;
+
     switch (Id)
     {
         case CAB_CODEC_RAW:
@@ -1486,6 +1653,10 @@ void CCabinet::SelectCodec(LONG Id)
             Codec = new CMSZipCodec();
             break;
 
+        case CAB_CODEC_LZX:
+            Codec = new CLZXCodec(LZXWindowBits);
+            break;
+
         default:
             return;
     }
@@ -1510,8 +1681,8 @@ ULONG CCabinet::NewCabinet()
 
     CurrentDiskNumber = 0;
 
-    OutputBuffer = AllocateMemory(CAB_BLOCKSIZE + 12); // This should be enough
-    InputBuffer  = AllocateMemory(CAB_BLOCKSIZE + 12); // This should be enough
+    OutputBuffer = AllocateMemory(CAB_MAX_COMPSIZE);
+    InputBuffer  = AllocateMemory(CAB_MAX_COMPSIZE);
     if ((!OutputBuffer) || (!InputBuffer))
     {
         DPRINT(MIN_TRACE, ("Insufficient memory.\n"));
@@ -1601,8 +1772,15 @@ ULONG CCabinet::NewFolder()
  *     Status of operation
  */
 {
+    ULONG Status;
+
     DPRINT(MAX_TRACE, ("Creating new folder.\n"));
 
+    /* Blocks still being compressed belong to the previous folder */
+    Status = FlushDataBlocks();
+    if (Status != CAB_STATUS_SUCCESS)
+        return Status;
+
     CurrentFolderNode = NewFolderNode();
     if (!CurrentFolderNode)
     {
@@ -1619,10 +1797,18 @@ ULONG CCabinet::NewFolder()
             CurrentFolderNode->Folder.CompressionType = CAB_COMP_MSZIP;
             break;
 
+        case CAB_CODEC_LZX:
+            CurrentFolderNode->Folder.CompressionType = (USHORT)(CAB_COMP_LZX |
+                (((CLZXCodec*)Codec)->GetWindowBits() << 8));
+            break;
+
         default:
             return CAB_STATUS_UNSUPPCOMP;
     }
 
+    /* Compression history doesn't cross folders */
+    Codec->Reset();
+
     /* FIXME: This won't work if no files are added to the new folder */
 
     DiskSize += sizeof(CFFOLDER);
@@ -1867,6 +2053,10 @@ ULONG CCabinet::CommitDisk(ULONG MoreDisks)
     PCFFOLDER_NODE FolderNode;
     ULONG Status;
 
+    Status = FlushDataBlocks();
+    if (Status != CAB_STATUS_SUCCESS)
+        return Status;
+
     OnCabinetName(CurrentDiskNumber, CabinetName);
 
     /* Create file, fail if it already exists */
@@ -1988,6 +2178,15 @@ ULONG CCabinet::CloseCabinet()
 {
     ULONG Status;
 
+    if (Pool)
+    {
+        delete Pool;
+        Pool = NULL;
+    }
+
+    LZXLastNode = NULL;
+    LZXNextNode = NULL;
+
     DestroyFileNodes();
 
     DestroyFolderNodes();
@@ -3554,16 +3753,33 @@ ULONG CCabinet::WriteDataBlock()
 
     if (!BlockIsSplit)
     {
+        /* Blocks which stand on their own are compressed on worker threads,
+           unless a block may have to be split across disks */
+        if ((ThreadCount > 1) && (MaxDiskSize == 0) && (CodecId == CAB_CODEC_MSZIP))
+            return QueueDataBlock();
+
+        Status = FlushDataBlocks();
+        if (Status != CAB_STATUS_SUCCESS)
+            return Status;
+
         Status = Codec->Compress(OutputBuffer,
             InputBuffer,
             CurrentIBufferSize,
             &TotalCompSize);
+        if (Status != CS_SUCCESS)
+        {
+            DPRINT(MIN_TRACE, ("Cannot compress block (%u).\n", (UINT)Status));
+            return (Status == CS_NOMEMORY) ? CAB_STATUS_NOMEMORY : CAB_STATUS_FAILURE;
+        }
 
         DPRINT(MAX_TRACE, ("Block compressed. CurrentIBufferSize (%u)  TotalCompSize(%u).\n",
             (UINT)CurrentIBufferSize, (UINT)TotalCompSize));
 
         CurrentOBuffer     = OutputBuffer;
         CurrentOBufferSize = TotalCompSize;
+
+        TotalUncompBytes += CurrentIBufferSize;
+        TotalCompBytes   += TotalCompSize;
     }
 
     DataNode = NewDataNode(CurrentFolderNode);
@@ -3628,6 +3844,175 @@ ULONG CCabinet::WriteDataBlock()
     return CAB_STATUS_SUCCESS;
 }
 
+
+ULONG CCabinet::QueueDataBlock()
+/*
+ * FUNCTION: Hands the current data block to the worker threads
+ * RETURNS:
+ *     Status of operation
+ */
+{
+    PCOMPRESSION_JOB Job;
+    ULONG Status;
+
+    if (!Pool)
+    {
+        Pool = new CCompressionPool();
+        Status = Pool->Start(CodecId, ThreadCount);
+        if (Status != CAB_STATUS_SUCCESS)
+        {
+            delete Pool;
+            Pool = NULL;
+            return Status;
+        }
+    }
+
+    /* Make room by storing the oldest block */
+    if (Pool->IsFull())
+    {
+        Job = Pool->GetNext(true);
+        Status = StoreDataBlock(Job);
+        Pool->Release(Job);
+        if (Status != CAB_STATUS_SUCCESS)
+            return Status;
+    }
+
+    Pool->Submit(InputBuffer, CurrentIBufferSize);
+
+    CurrentIBufferSize = 0;
+    CurrentIBuffer     = InputBuffer;
+
+    /* Store the blocks which are done already */
+    while ((Job = Pool->GetNext(false)) != NULL)
+    {
+        Status = StoreDataBlock(Job);
+        Pool->Release(Job);
+        if (Status != CAB_STATUS_SUCCESS)
+            return Status;
+    }
+
+    return CAB_STATUS_SUCCESS;
+}
+
+
+ULONG CCabinet::StoreDataBlock(PCOMPRESSION_JOB Job)
+/*
+ * FUNCTION: Writes a data block compressed by a worker thread to the scratch file
+ * ARGUMENTS:
+ *     Job = Pointer to finished compression job
+ * RETURNS:
+ *     Status of operation
+ */
+{
+    ULONG Status;
+    ULONG BytesWritten;
+    PCFDATA_NODE DataNode;
+
+    if (Job->Status != CS_SUCCESS)
+    {
+        DPRINT(MIN_TRACE, ("Cannot compress block (%u).\n", (UINT)Job->Status));
+        return (Job->Status == CS_NOMEMORY) ? CAB_STATUS_NOMEMORY : CAB_STATUS_FAILURE;
+    }
+
+    DataNode = NewDataNode(CurrentFolderNode);
+    if (!DataNode)
+    {
+        DPRINT(MIN_TRACE, ("Insufficient memory.\n"));
+        return CAB_STATUS_NOMEMORY;
+    }
+
+    DataNode->Data.CompSize   = (USHORT)Job->OutputSize;
+    DataNode->Data.UncompSize = (USHORT)Job->InputSize;
+    DataNode->Data.Checksum   = 0;
+    DataNode->ScratchFilePosition = ScratchFile->Position();
+
+    DPRINT(MAX_TRACE, ("Writing block. Checksum (0x%X)  CompSize (%u)  UncompSize (%u).\n",
+        (UINT)DataNode->Data.Checksum,
+        DataNode->Data.CompSize,
+        DataNode->Data.UncompSize));
+
+    Status = ScratchFile->WriteBlock(&DataNode->Data,
+        Job->OutputBuffer, &BytesWritten);
+    if (Status != CAB_STATUS_SUCCESS)
+        return Status;
+
+    DiskSize += sizeof(CFDATA) + BytesWritten;
+
+    CurrentFolderNode->TotalFolderSize += (BytesWritten + sizeof(CFDATA));
+    CurrentFolderNode->Folder.DataBlockCount++;
+
+    LastBlockStart += DataNode->Data.UncompSize;
+
+    TotalUncompBytes += Job->InputSize;
+    TotalCompBytes   += Job->OutputSize;
+
+    return CAB_STATUS_SUCCESS;
+}
+
+
+ULONG CCabinet::FlushDataBlocks()
+/*
+ * FUNCTION: Waits for the worker threads and writes all blocks they compressed
+ * RETURNS:
+ *     Status of operation
+ */
+{
+    PCOMPRESSION_JOB Job;
+    ULONG Status;
+
+    if (!Pool)
+        return CAB_STATUS_SUCCESS;
+
+    while ((Job = Pool->GetNext(true)) != NULL)
+    {
+        Status = StoreDataBlock(Job);
+        Pool->Release(Job);
+        if (Status != CAB_STATUS_SUCCESS)
+            return Status;
+    }
+
+    return CAB_STATUS_SUCCESS;
+}
+
+
+void CCabinet::SetThreadCount(ULONG Count)
+/*
+ * FUNCTION: Sets the number of threads used for compression
+ * ARGUMENTS:
+ *     Count = Number of threads, 0 for one per processor
+ */
+{
+    if (Count == 0)
+        Count = CCompressionPool::GetProcessorCount();
+
+    if (Count > POOL_MAX_THREADS)
+        Count = POOL_MAX_THREADS;
+
+    ThreadCount = Count;
+}
+
+
+ULONG CCabinet::GetThreadCount()
+/*
+ * FUNCTION: Returns the number of threads used for compression
+ */
+{
+    return ThreadCount;
+}
+
+
+void CCabinet::GetStatistics(ULONGLONG* UncompSize, ULONGLONG* CompSize)
+/*
+ * FUNCTION: Returns how much data was compressed into how much
+ * ARGUMENTS:
+ *     UncompSize = Pointer to buffer to place uncompressed bytes in
+ *     CompSize   = Pointer to buffer to place compressed bytes in
+ */
+{
+    *UncompSize = TotalUncompBytes;
+    *CompSize   = TotalCompBytes;
+}
+
 #if !defined(_WIN32)
 
 void CCabinet::ConvertDateAndTime(time_t* Time,
@@ -33,6 +33,7 @@
 #define DIR_SEPARATOR_STRING "\\"
 
 #define strcasecmp _stricmp
+#define strncasecmp _strnicmp
 #define strdup _strdup
 
 #define AllocateMemory(size) HeapAlloc(GetProcessHeap(), 0, size)
@@ -97,12 +98,14 @@ extern ULONG DebugTraceLevel;
 #define CAB_SIGNATURE        0x4643534D // "MSCF"
 #define CAB_VERSION          0x0103
 #define CAB_BLOCKSIZE        32768
+#define CAB_MAX_COMPSIZE     (CAB_BLOCKSIZE + 6144) // Largest compressed data block (LZX)
 
 #define CAB_COMP_MASK        0x00FF
 #define CAB_COMP_NONE        0x0000
 #define CAB_COMP_MSZIP       0x0001
 #define CAB_COMP_QUANTUM     0x0002
 #define CAB_COMP_LZX         0x0003
+#define CAB_COMP_LZX_WINDOW(Type) (((Type) >> 8) & 0x1F)
 
 #define CAB_FLAG_HASPREV     0x0001
 #define CAB_FLAG_HASNEXT     0x0002
@@ -273,6 +276,8 @@ public:
                              void* InputBuffer,
                              ULONG InputLength,
                              PULONG OutputLength) = 0;
+    /* Starts a new folder, for codecs which keep history between data blocks */
+    virtual void Reset() {};
 };
 
 
@@ -293,6 +298,9 @@ public:
 
 #ifndef CAB_READ_ONLY
 
+class CCompressionPool;
+typedef struct _COMPRESSION_JOB *PCOMPRESSION_JOB;
+
 class CCFDATAStorage
 {
 public:
@@ -392,6 +400,12 @@ public:
     ULONG AddFile(char* FileName);
     /* Sets the maximum size of the current disk */
     void SetMaxDiskSize(ULONG Size);
+    /* Sets the number of threads compressing data blocks */
+    void SetThreadCount(ULONG Count);
+    /* Returns the number of threads compressing data blocks */
+    ULONG GetThreadCount();
+    /* Returns the number of bytes compressed so far and their compressed size */
+    void GetStatistics(ULONGLONG* UncompSize, ULONGLONG* CompSize);
 #endif /* CAB_READ_ONLY */
 
     /* Default event handlers */
@@ -428,6 +442,7 @@ private:
     ULONG ComputeChecksum(void* Buffer, ULONG Size, ULONG Seed);
     ULONG ReadBlock(void* Buffer, ULONG Size, PULONG BytesRead);
     bool MatchFileNamePattern(char* FileName, char* Pattern);
+    ULONG PrimeLZXDecoder(PCFDATA_NODE DataNode);
 #ifndef CAB_READ_ONLY
     ULONG InitCabinetHeader();
     ULONG WriteCabinetHeader(bool MoreDisks);
@@ -435,6 +450,9 @@ private:
     ULONG WriteFileEntries();
     ULONG CommitDataBlocks(PCFFOLDER_NODE FolderNode);
     ULONG WriteDataBlock();
+    ULONG QueueDataBlock();
+    ULONG StoreDataBlock(PCOMPRESSION_JOB Job);
+    ULONG FlushDataBlocks();
     ULONG GetAttributesOnFile(PCFFILE_NODE File);
     ULONG SetAttributesOnFile(char* FileName, USHORT FileAttributes);
     ULONG GetFileTimes(FILEHANDLE FileHandle, PCFFILE_NODE File);
@@ -476,6 +494,9 @@ private:
     CCABCodec *Codec;
     LONG CodecId;
     bool CodecSelected;
+    ULONG LZXWindowBits;        // Window size for the LZX codec
+    PCFDATA_NODE LZXLastNode;   // Data block the LZX codec uncompressed last
+    PCFDATA_NODE LZXNextNode;   // Data block the LZX codec can uncompress next
     void* InputBuffer;
     void* CurrentIBuffer;               // Current offset in input buffer
     ULONG CurrentIBufferSize;   // Bytes left in input buffer
@@ -500,6 +521,10 @@ private:
     ULONG TotalBytesLeft;
     bool BlockIsSplit;                  // true if current data block is split
     ULONG NextFolderNumber;     // Zero based folder number
+    CCompressionPool *Pool;     // Threads compressing independent data blocks
+    ULONG ThreadCount;
+    ULONGLONG TotalUncompBytes; // Statistics
+    ULONGLONG TotalCompBytes;
 #endif /* CAB_READ_ONLY */
 };
 
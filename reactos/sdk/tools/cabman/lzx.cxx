@@ -0,0 +1,1429 @@
+/*
+ * COPYRIGHT:   See COPYING in the top level directory
+ * PROJECT:     ReactOS cabinet manager
+ * FILE:        tools/cabman/lzx.cxx
+ * PURPOSE:     CAB codec for LZX compressed data
+ * NOTES:       Every data block is compressed as one LZX frame holding a
+ *              single block, so a frame ends on a block boundary and can be
+ *              handed out as soon as it is done. The history and the
+ *              repeated offsets are carried from block to block until the
+ *              next folder starts (see Reset). Blocks which don't shrink
+ *              are stored as uncompressed LZX blocks. The E8 call
+ *              translation is never used when compressing, but it is
+ *              undone when uncompressing.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "lzx.h"
+
+#define LZX_MAX_CHAIN       128     /* Hash chain entries searched per position */
+#define LZX_NICE_MATCH      128     /* Stop searching when a match is this long */
+#define LZX_LAZY_MATCH      32      /* Don't look for a better match after one this long */
+#define LZX_FAR_MATCH       32768   /* 3 byte matches further away are not worth it */
+#define LZX_SCRATCH_SIZE    (2 * CAB_BLOCKSIZE)
+
+#define LZX_TOKEN_MATCH     0x80000000
+
+static const UCHAR ExtraBits[LZX_MAX_SLOTS + 1] =
+{
+     0,  0,  0,  0,  1,  1,  2,  2,  3,  3,  4,  4,  5,  5,  6,  6,
+     7,  7,  8,  8,  9,  9, 10, 10, 11, 11, 12, 12, 13, 13, 14, 14,
+    15, 15, 16, 16, 17, 17, 17, 17, 17, 17, 17, 17, 17, 17, 17, 17,
+    17, 17, 17
+};
+
+static const ULONG PositionBase[LZX_MAX_SLOTS + 1] =
+{
+          0,       1,       2,       3,       4,       6,       8,      12,
+         16,      24,      32,      48,      64,      96,     128,     192,
+        256,     384,     512,     768,    1024,    1536,    2048,    3072,
+       4096,    6144,    8192,   12288,   16384,   24576,   32768,   49152,
+      65536,   98304,  131072,  196608,  262144,  393216,  524288,  655360,
+     786432,  917504, 1048576, 1179648, 1310720, 1441792, 1572864, 1703936,
+    1835008, 1966080, 2097152
+};
+
+
+static int CompareLeaves(const void* Leaf1, const void* Leaf2)
+{
+    ULONGLONG Value1 = *(const ULONGLONG*)Leaf1;
+    ULONGLONG Value2 = *(const ULONGLONG*)Leaf2;
+
+    return (Value1 < Value2) ? -1 : (Value1 > Value2);
+}
+
+
+static ULONG PositionSlot(ULONG Formatted)
+/*
+ * FUNCTION: Returns the position slot of a formatted offset
+ * ARGUMENTS:
+ *     Formatted = Match offset plus two
+ */
+{
+    ULONG Bit;
+
+    if (Formatted < 4)
+        return Formatted;
+
+    /* The slots above 37 all have 17 extra bits */
+    if (Formatted >= 524288)
+        return 38 + ((Formatted - 524288) >> 17);
+
+    for (Bit = 2; (Formatted >> (Bit + 1)) != 0; Bit++)
+        ;
+
+    return 2 * Bit + ((Formatted >> (Bit - 1)) & 1);
+}
+
+
+static void InitTree(PLZX_TREE Tree, ULONG Count, ULONG MaxLength)
+{
+    Tree->Count     = Count;
+    Tree->MaxLength = MaxLength;
+    memset(Tree->Length, 0, sizeof(Tree->Length));
+}
+
+
+/* CLZXCodec */
+
+CLZXCodec::CLZXCodec(ULONG WindowBits)
+/*
+ * FUNCTION: Constructor
+ * ARGUMENTS:
+ *     WindowBits = Size of the window as a power of two (15 to 21)
+ */
+{
+    if (WindowBits < LZX_MIN_WINDOW)
+        WindowBits = LZX_MIN_WINDOW;
+    if (WindowBits > LZX_MAX_WINDOW)
+        WindowBits = LZX_MAX_WINDOW;
+
+    this->WindowBits = WindowBits;
+    WindowSize = 1 << WindowBits;
+
+    /* 21 bits get 50 slots, the smaller windows two per bit */
+    if (WindowBits == 21)
+        NumSlots = 50;
+    else if (WindowBits == 20)
+        NumSlots = 42;
+    else
+        NumSlots = WindowBits * 2;
+    MainElements = LZX_NUM_CHARS + NumSlots * 8;
+
+    /* Keep the hash chains short for the big windows */
+    HashBits = WindowBits - 1;
+    if (HashBits < LZX_MIN_HASH_BITS)
+        HashBits = LZX_MIN_HASH_BITS;
+
+    Window       = NULL;
+    HashHead     = NULL;
+    HashPrev     = NULL;
+    Tokens       = NULL;
+    Scratch      = NULL;
+    DecodeWindow = NULL;
+
+    Reset();
+}
+
+
+CLZXCodec::~CLZXCodec()
+/*
+ * FUNCTION: Default destructor
+ */
+{
+    if (Window)
+        FreeMemory(Window);
+    if (HashHead)
+        FreeMemory(HashHead);
+    if (HashPrev)
+        FreeMemory(HashPrev);
+    if (Tokens)
+        FreeMemory(Tokens);
+    if (Scratch)
+        FreeMemory(Scratch);
+    if (DecodeWindow)
+        FreeMemory(DecodeWindow);
+}
+
+
+void CLZXCodec::Reset()
+/*
+ * FUNCTION: Forgets the history, a new folder starts with the next data block
+ */
+{
+    InitTree(&MainTree, MainElements, 16);
+    InitTree(&LengthTree, LZX_NUM_SECONDARY, 16);
+    InitTree(&AlignedTree, LZX_NUM_ALIGNED, 7);
+    InitTree(&PreTree, LZX_NUM_PRETREE, 15);
+    memset(MainLengths, 0, sizeof(MainLengths));
+    memset(LengthLengths, 0, sizeof(LengthLengths));
+
+    HeaderDone = false;
+    R0 = R1 = R2 = 1;
+
+    WindowEnd = 0;
+    InsertPos = 0;
+    if (HashHead)
+        memset(HashHead, 0xFF, (1U << HashBits) * sizeof(LONG));
+
+    DecodePos      = 0;
+    BlockType      = 0;
+    BlockLength    = 0;
+    BlockRemaining = 0;
+    IntelFileSize  = 0;
+    IntelCurPos    = 0;
+    FrameCount     = 0;
+}
+
+
+/* Bit I/O. Bits are packed into 16 bit little endian words, most significant bit first */
+
+void CLZXCodec::PutBits(ULONG Count, ULONG Value)
+/*
+ * FUNCTION: Writes up to 17 bits to the output
+ */
+{
+    ULONG Word;
+
+    BitBuffer = (BitBuffer << Count) | (Value & ((1 << Count) - 1));
+    BitCount += Count;
+
+    while (BitCount >= 16)
+    {
+        BitCount -= 16;
+        Word = BitBuffer >> BitCount;
+
+        if (BitIndex + 2 > BitLimit)
+        {
+            Overflow = true;
+            continue;
+        }
+        BitBase[BitIndex++] = (UCHAR)Word;
+        BitBase[BitIndex++] = (UCHAR)(Word >> 8);
+    }
+}
+
+
+void CLZXCodec::FlushBits()
+/*
+ * FUNCTION: Pads the output to the next 16 bit boundary
+ */
+{
+    if (BitCount > 0)
+        PutBits(16 - BitCount, 0);
+}
+
+
+void CLZXCodec::EnsureBits(ULONG Count)
+/*
+ * FUNCTION: Makes sure the bit buffer holds at least Count (up to 17) bits.
+ *           Reading past the end of the input gives zeros.
+ */
+{
+    ULONG Word;
+
+    while (BitCount < Count)
+    {
+        Word = 0;
+        if (BitIndex + 2 <= BitLimit)
+            Word = BitBase[BitIndex] | (BitBase[BitIndex + 1] << 8);
+        BitIndex += 2;
+
+        BitBuffer |= Word << (16 - BitCount);
+        BitCount += 16;
+    }
+}
+
+
+ULONG CLZXCodec::GetBits(ULONG Count)
+/*
+ * FUNCTION: Reads up to 17 bits from the input
+ */
+{
+    ULONG Value;
+
+    if (Count == 0)
+        return 0;
+
+    EnsureBits(Count);
+    Value = BitBuffer >> (32 - Count);
+    BitBuffer <<= Count;
+    BitCount -= Count;
+
+    return Value;
+}
+
+
+/* Huffman trees */
+
+void CLZXCodec::BuildLengths(PLZX_TREE Tree, PULONG Frequencies)
+/*
+ * FUNCTION: Builds code lengths of at most Tree->MaxLength bits for the
+ *           given symbol frequencies. The code is always complete, unless
+ *           no symbol is used at all
+ * ARGUMENTS:
+ *     Tree        = Tree to build lengths for
+ *     Frequencies = Number of times each symbol is used
+ */
+{
+    ULONGLONG Leaves[LZX_MAX_MAIN];
+    USHORT Symbols[LZX_MAX_MAIN];
+    ULONG Weight[2 * LZX_MAX_MAIN];
+    ULONG Parent[2 * LZX_MAX_MAIN];
+    ULONG Depth[2 * LZX_MAX_MAIN];
+    ULONG Used, Leaf, Node, Next, Child, Full, Kraft, Length, i, j;
+    ULONG MaxLength = Tree->MaxLength;
+
+    memset(Tree->Length, 0, Tree->Count);
+
+    Used = 0;
+    for (i = 0; i < Tree->Count; i++)
+    {
+        if (Frequencies[i])
+            Leaves[Used++] = ((ULONGLONG)Frequencies[i] << 16) | i;
+    }
+
+    if (Used == 0)
+        return;
+
+    if (Used == 1)
+    {
+        /* A single code is incomplete, add a second one nobody uses */
+        i = (ULONG)(Leaves[0] & 0xFFFF);
+        Tree->Length[i] = 1;
+        Tree->Length[(i == 0) ? 1 : 0] = 1;
+        return;
+    }
+
+    /* Sort by frequency, ties by symbol, so the result doesn't depend on qsort */
+    qsort(Leaves, Used, sizeof(ULONGLONG), CompareLeaves);
+    for (i = 0; i < Used; i++)
+    {
+        Symbols[i] = (USHORT)(Leaves[i] & 0xFFFF);
+        Weight[i]  = (ULONG)(Leaves[i] >> 16);
+    }
+
+    /* Two queue Huffman construction, the leaves are already sorted and
+       the internal nodes are created in order of increasing weight */
+    Leaf = 0;
+    Node = Used;
+    for (Next = Used; Next < 2 * Used - 1; Next++)
+    {
+        Weight[Next] = 0;
+        for (j = 0; j < 2; j++)
+        {
+            if (Leaf < Used && (Node >= Next || Weight[Leaf] <= Weight[Node]))
+                Child = Leaf++;
+            else
+                Child = Node++;
+
+            Parent[Child] = Next;
+            Weight[Next] += Weight[Child];
+        }
+    }
+
+    Depth[2 * Used - 2] = 0;
+    for (i = 2 * Used - 2; i-- > 0;)
+        Depth[i] = Depth[Parent[i]] + 1;
+
+    /* Clamp the lengths and repair the Kraft sum */
+    Full  = 1 << MaxLength;
+    Kraft = 0;
+    for (i = 0; i < Used; i++)
+    {
+        Length = (Depth[i] > MaxLength) ? MaxLength : Depth[i];
+        Tree->Length[Symbols[i]] = (UCHAR)Length;
+        Kraft += 1 << (MaxLength - Length);
+    }
+
+    while (Kraft > Full)
+    {
+        /* Lengthen the rarest of the longest codes that can still grow */
+        for (Length = MaxLength - 1; Length > 0; Length--)
+        {
+            for (i = 0; i < Used; i++)
+            {
+                if (Tree->Length[Symbols[i]] == Length)
+                    break;
+            }
+            if (i < Used)
+                break;
+        }
+
+        Tree->Length[Symbols[i]]++;
+        Kraft -= 1 << (MaxLength - Length - 1);
+    }
+
+    while (Kraft < Full)
+    {
+        /* Shorten the most frequent codes while there is room */
+        for (i = Used; i-- > 0;)
+        {
+            Length = Tree->Length[Symbols[i]];
+            if (Length > 1 && Kraft + (1 << (MaxLength - Length)) <= Full)
+            {
+                Tree->Length[Symbols[i]]--;
+                Kraft += 1 << (MaxLength - Length);
+                break;
+            }
+        }
+    }
+}
+
+
+void CLZXCodec::BuildCodes(PLZX_TREE Tree)
+/*
+ * FUNCTION: Assigns canonical codes to the code lengths of a tree
+ */
+{
+    USHORT NextCode[18];
+    ULONG Code, i;
+
+    memset(Tree->Counts, 0, sizeof(Tree->Counts));
+    for (i = 0; i < Tree->Count; i++)
+        Tree->Counts[Tree->Length[i]]++;
+
+    Code = 0;
+    Tree->Counts[0] = 0;
+    for (i = 1; i <= 16; i++)
+    {
+        Code = (Code + Tree->Counts[i - 1]) << 1;
+        NextCode[i] = (USHORT)Code;
+    }
+
+    for (i = 0; i < Tree->Count; i++)
+    {
+        if (Tree->Length[i])
+            Tree->Code[i] = NextCode[Tree->Length[i]]++;
+    }
+}
+
+
+bool CLZXCodec::BuildTable(PLZX_TREE Tree)
+/*
+ * FUNCTION: Builds the decoding table of a tree with assigned codes
+ * RETURNS:
+ *     false if the code lengths are oversubscribed
+ */
+{
+    USHORT Offsets[18];
+    ULONG Kraft, Length, Start, Fill, i;
+
+    Kraft = 0;
+    for (i = 1; i <= 16; i++)
+        Kraft += Tree->Counts[i] << (16 - i);
+    if (Kraft > (1 << 16))
+        return false;
+
+    Offsets[1] = 0;
+    for (i = 1; i < 16; i++)
+        Offsets[i + 1] = Offsets[i] + Tree->Counts[i];
+
+    memset(Tree->Table, 0xFF, sizeof(Tree->Table));
+
+    for (i = 0; i < Tree->Count; i++)
+    {
+        Length = Tree->Length[i];
+        if (Length == 0)
+            continue;
+
+        Tree->Sorted[Offsets[Length]++] = (USHORT)i;
+
+        if (Length <= LZX_TABLE_BITS)
+        {
+            Start = Tree->Code[i] << (LZX_TABLE_BITS - Length);
+            for (Fill = 0; Fill < (1U << (LZX_TABLE_BITS - Length)); Fill++)
+                Tree->Table[Start + Fill] = (USHORT)i;
+        }
+    }
+
+    return true;
+}
+
+
+ULONG CLZXCodec::DecodeSymbol(PLZX_TREE Tree)
+/*
+ * FUNCTION: Reads one symbol
+ * RETURNS:
+ *     The symbol, or 0xFFFF if the input doesn't hold a valid code
+ */
+{
+    ULONG Bits, Symbol, Length;
+    LONG Code, First, Index, Count;
+
+    EnsureBits(16);
+
+    Symbol = Tree->Table[BitBuffer >> (32 - LZX_TABLE_BITS)];
+    if (Symbol != 0xFFFF)
+    {
+        Length = Tree->Length[Symbol];
+        BitBuffer <<= Length;
+        BitCount -= Length;
+        return Symbol;
+    }
+
+    /* Long code, walk the canonical code one bit at a time */
+    Bits  = BitBuffer;
+    Code  = 0;
+    First = 0;
+    Index = 0;
+    for (Length = 1; Length <= 16; Length++)
+    {
+        Code |= Bits >> 31;
+        Bits <<= 1;
+
+        Count = Tree->Counts[Length];
+        if (Code - First < Count)
+        {
+            BitBuffer <<= Length;
+            BitCount -= Length;
+            return Tree->Sorted[Index + Code - First];
+        }
+
+        Index += Count;
+        First = (First + Count) << 1;
+        Code <<= 1;
+    }
+
+    return 0xFFFF;
+}
+
+
+void CLZXCodec::WriteLengths(PLZX_TREE Tree, PUCHAR Previous, ULONG First, ULONG Last)
+/*
+ * FUNCTION: Writes a range of code lengths through the pretree
+ * ARGUMENTS:
+ *     Tree     = Tree with the new lengths
+ *     Previous = Lengths of the previous block the new ones are coded against
+ *     First    = First symbol to write
+ *     Last     = Symbol after the last one to write
+ */
+{
+    ULONG Items[LZX_MAX_MAIN * 2];
+    ULONG Frequencies[LZX_NUM_PRETREE];
+    ULONG ItemCount, Length, Run, Count, Symbol, i;
+
+    /* Items hold the pretree symbol in the low byte, followed by
+       the number of extra bits and the extra bits themselves */
+    ItemCount = 0;
+    i = First;
+    while (i < Last)
+    {
+        Length = Tree->Length[i];
+        for (Run = 1; i + Run < Last && Tree->Length[i + Run] == Length; Run++)
+            ;
+
+        if (Length == 0 && Run >= 4)
+        {
+            while (Run >= 20)
+            {
+                Count = (Run > 51) ? 51 : Run;
+                Items[ItemCount++] = 18 | (5 << 8) | ((Count - 20) << 16);
+                i += Count;
+                Run -= Count;
+            }
+            if (Run >= 4)
+            {
+                Items[ItemCount++] = 17 | (4 << 8) | ((Run - 4) << 16);
+                i += Run;
+            }
+            continue;
+        }
+
+        if (Run >= 4)
+        {
+            Count = (Run > 5) ? 5 : Run;
+            Items[ItemCount++] = 19 | (1 << 8) | ((Count - 4) << 16);
+            Items[ItemCount++] = (Previous[i] + 17 - Length) % 17;
+            i += Count;
+            continue;
+        }
+
+        Items[ItemCount++] = (Previous[i] + 17 - Length) % 17;
+        i++;
+    }
+
+    memset(Frequencies, 0, sizeof(Frequencies));
+    for (i = 0; i < ItemCount; i++)
+        Frequencies[Items[i] & 0xFF]++;
+
+    BuildLengths(&PreTree, Frequencies);
+    BuildCodes(&PreTree);
+
+    for (i = 0; i < LZX_NUM_PRETREE; i++)
+        PutBits(4, PreTree.Length[i]);
+
+    for (i = 0; i < ItemCount; i++)
+    {
+        Symbol = Items[i] & 0xFF;
+        PutBits(PreTree.Length[Symbol], PreTree.Code[Symbol]);
+        PutBits((Items[i] >> 8) & 0xFF, Items[i] >> 16);
+    }
+}
+
+
+bool CLZXCodec::ReadLengths(PUCHAR Lengths, ULONG First, ULONG Last)
+/*
+ * FUNCTION: Reads a range of code lengths through the pretree
+ * ARGUMENTS:
+ *     Lengths = Lengths of the previous block, updated in place
+ *     First   = First symbol to read
+ *     Last    = Symbol after the last one to read
+ * RETURNS:
+ *     false if the lengths are corrupt
+ */
+{
+    ULONG Symbol, Run, Value, i;
+
+    for (i = 0; i < LZX_NUM_PRETREE; i++)
+        PreTree.Length[i] = (UCHAR)GetBits(4);
+
+    BuildCodes(&PreTree);
+    if (!BuildTable(&PreTree))
+        return false;
+
+    i = First;
+    while (i < Last)
+    {
+        Symbol = DecodeSymbol(&PreTree);
+
+        if (Symbol <= 16)
+        {
+            Lengths[i] = (UCHAR)((Lengths[i] + 17 - Symbol) % 17);
+            i++;
+            continue;
+        }
+
+        if (Symbol == 17)
+        {
+            Run = GetBits(4) + 4;
+            Value = 0;
+        }
+        else if (Symbol == 18)
+        {
+            Run = GetBits(5) + 20;
+            Value = 0;
+        }
+        else if (Symbol == 19)
+        {
+            Run = GetBits(1) + 4;
+            Symbol = DecodeSymbol(&PreTree);
+            if (Symbol > 16)
+                return false;
+            Value = (Lengths[i] + 17 - Symbol) % 17;
+        }
+        else
+            return false;
+
+        if (i + Run > Last)
+            return false;
+
+        while (Run--)
+            Lengths[i++] = (UCHAR)Value;
+    }
+
+    return true;
+}
+
+
+/* Encoder */
+
+bool CLZXCodec::AllocateEncoder()
+/*
+ * FUNCTION: Allocates the encoder state on first use
+ */
+{
+    Window   = (PUCHAR)AllocateMemory(2 * WindowSize);
+    HashHead = (PLONG)AllocateMemory((1U << HashBits) * sizeof(LONG));
+    HashPrev = (PLONG)AllocateMemory(2 * WindowSize * sizeof(LONG));
+    Tokens   = (PULONG)AllocateMemory(CAB_BLOCKSIZE * sizeof(ULONG));
+    Scratch  = (PUCHAR)AllocateMemory(LZX_SCRATCH_SIZE);
+
+    if (!Window || !HashHead || !HashPrev || !Tokens || !Scratch)
+        return false;
+
+    memset(HashHead, 0xFF, (1U << HashBits) * sizeof(LONG));
+    return true;
+}
+
+
+void CLZXCodec::SlideWindow()
+/*
+ * FUNCTION: Drops everything but the last window of history
+ */
+{
+    LONG Shift = WindowEnd - (LONG)WindowSize;
+    LONG Value;
+    ULONG i;
+
+    memmove(Window, Window + Shift, WindowSize);
+
+    for (i = 0; i < (1U << HashBits); i++)
+    {
+        Value = HashHead[i];
+        HashHead[i] = (Value >= Shift) ? Value - Shift : -1;
+    }
+
+    for (i = 0; i < WindowSize; i++)
+    {
+        Value = HashPrev[i + Shift];
+        HashPrev[i] = (Value >= Shift) ? Value - Shift : -1;
+    }
+
+    WindowEnd -= Shift;
+    InsertPos -= Shift;
+}
+
+
+ULONG CLZXCodec::HashString(LONG Position)
+/*
+ * FUNCTION: Hashes the three bytes at Position
+ */
+{
+    PUCHAR Data = Window + Position;
+    ULONG Value = Data[0] | (Data[1] << 8) | (Data[2] << 16);
+
+    return (Value * 2654435761U) >> (32 - HashBits);
+}
+
+
+void CLZXCodec::InsertString(LONG Position)
+/*
+ * FUNCTION: Adds the three bytes at Position to the hash chains
+ */
+{
+    ULONG Hash = HashString(Position);
+
+    HashPrev[Position] = HashHead[Hash];
+    HashHead[Hash] = Position;
+}
+
+
+static inline ULONG MatchLength(PUCHAR Data, PUCHAR Match, ULONG MaxLength)
+{
+    ULONG Length = 0;
+
+    while (Length < MaxLength && Data[Length] == Match[Length])
+        Length++;
+
+    return Length;
+}
+
+
+ULONG CLZXCodec::LongestMatch(LONG Position, LONG End, PULONG Distance)
+/*
+ * FUNCTION: Searches the hash chains for the longest match
+ * ARGUMENTS:
+ *     Position = Position to find a match for
+ *     End      = End of the current block, matches don't cross it
+ *     Distance = Address of buffer to place the distance of the match
+ * RETURNS:
+ *     Length of the match, 0 if there is none of at least three bytes
+ */
+{
+    PUCHAR Data = Window + Position;
+    ULONG MaxLength, Best, Length, Chain;
+    LONG Candidate, Limit;
+
+    if (Position + 2 >= End)
+        return 0;
+
+    MaxLength = End - Position;
+    if (MaxLength > LZX_MAX_MATCH)
+        MaxLength = LZX_MAX_MATCH;
+
+    Limit = Position - (LONG)(WindowSize - 3);
+    Best  = 2;
+    Chain = LZX_MAX_CHAIN;
+
+    Candidate = HashHead[HashString(Position)];
+    while (Candidate >= 0 && Candidate >= Limit && Chain-- > 0)
+    {
+        PUCHAR Match = Window + Candidate;
+
+        if (Match[Best] == Data[Best] && Match[0] == Data[0] && Match[1] == Data[1])
+        {
+            Length = MatchLength(Data, Match, MaxLength);
+            if (Length > Best)
+            {
+                Best = Length;
+                *Distance = Position - Candidate;
+                if (Length >= LZX_NICE_MATCH || Length == MaxLength)
+                    break;
+            }
+        }
+
+        Candidate = HashPrev[Candidate];
+    }
+
+    if (Best < 3 || (Best == 3 && *Distance > LZX_FAR_MATCH))
+        return 0;
+
+    return Best;
+}
+
+
+ULONG CLZXCodec::RepeatMatch(LONG Position, LONG End, PULONG Index)
+/*
+ * FUNCTION: Finds the longest match at one of the repeated offsets
+ * ARGUMENTS:
+ *     Position = Position to find a match for
+ *     End      = End of the current block, matches don't cross it
+ *     Index    = Address of buffer to place the repeated offset used (0 to 2)
+ * RETURNS:
+ *     Length of the match, 0 if there is none of at least two bytes
+ */
+{
+    ULONG Offsets[3] = { R0, R1, R2 };
+    ULONG MaxLength, Best, Length, i;
+
+    MaxLength = End - Position;
+    if (MaxLength > LZX_MAX_MATCH)
+        MaxLength = LZX_MAX_MATCH;
+
+    Best = 0;
+    for (i = 0; i < 3; i++)
+    {
+        if (Offsets[i] > (ULONG)Position)
+            continue;
+
+        Length = MatchLength(Window + Position, Window + Position - Offsets[i], MaxLength);
+        if (Length > Best)
+        {
+            Best = Length;
+            *Index = i;
+        }
+    }
+
+    return (Best >= LZX_MIN_MATCH) ? Best : 0;
+}
+
+
+void CLZXCodec::EmitMatch(ULONG Length, ULONG Distance)
+/*
+ * FUNCTION: Adds a match to the tokens of the current block
+ */
+{
+    ULONG Slot, Footer, Temp;
+
+    Footer = 0;
+    if (Distance == R0)
+        Slot = 0;
+    else if (Distance == R1)
+    {
+        Slot = 1;
+        Temp = R0; R0 = R1; R1 = Temp;
+    }
+    else if (Distance == R2)
+    {
+        Slot = 2;
+        Temp = R0; R0 = R2; R2 = Temp;
+    }
+    else
+    {
+        Slot   = PositionSlot(Distance + 2);
+        Footer = Distance + 2 - PositionBase[Slot];
+        R2 = R1;
+        R1 = R0;
+        R0 = Distance;
+    }
+
+    Tokens[TokenCount++] = LZX_TOKEN_MATCH | (Slot << 25) | (Footer << 8) | (Length - LZX_MIN_MATCH);
+}
+
+
+ULONG CLZXCodec::WriteCompressedBlock(ULONG Length)
+/*
+ * FUNCTION: Writes the tokens of the current block as a verbatim or
+ *           aligned offset block into the scratch buffer
+ * ARGUMENTS:
+ *     Length = Number of uncompressed bytes in the block
+ * RETURNS:
+ *     Size of the frame, 0 if it didn't fit
+ */
+{
+    ULONG MainFrequencies[LZX_MAX_MAIN];
+    ULONG LengthFrequencies[LZX_NUM_SECONDARY];
+    ULONG AlignedFrequencies[LZX_NUM_ALIGNED];
+    ULONG AlignedBits, Token, Slot, Footer, Extra, Symbol, Type, i;
+
+    memset(MainFrequencies, 0, sizeof(MainFrequencies));
+    memset(LengthFrequencies, 0, sizeof(LengthFrequencies));
+    memset(AlignedFrequencies, 0, sizeof(AlignedFrequencies));
+
+    for (i = 0; i < TokenCount; i++)
+    {
+        Token = Tokens[i];
+        if (!(Token & LZX_TOKEN_MATCH))
+        {
+            MainFrequencies[Token]++;
+            continue;
+        }
+
+        Slot   = (Token >> 25) & 0x3F;
+        Footer = (Token >> 8) & 0x1FFFF;
+        Symbol = Token & 0xFF;
+
+        if (Symbol < LZX_NUM_PRIMARY)
+            MainFrequencies[LZX_NUM_CHARS + (Slot << 3) + Symbol]++;
+        else
+        {
+            MainFrequencies[LZX_NUM_CHARS + (Slot << 3) + LZX_NUM_PRIMARY]++;
+            LengthFrequencies[Symbol - LZX_NUM_PRIMARY]++;
+        }
+
+        if (ExtraBits[Slot] >= 3)
+            AlignedFrequencies[Footer & 7]++;
+    }
+
+    BuildLengths(&MainTree, MainFrequencies);
+    BuildCodes(&MainTree);
+    BuildLengths(&LengthTree, LengthFrequencies);
+    BuildCodes(&LengthTree);
+    BuildLengths(&AlignedTree, AlignedFrequencies);
+    BuildCodes(&AlignedTree);
+
+    /* Aligned offset blocks pay 24 bits for their tree, verbatim
+       blocks 3 bits for the low bits of each long offset */
+    AlignedBits = 24;
+    Extra = 0;
+    for (i = 0; i < LZX_NUM_ALIGNED; i++)
+    {
+        AlignedBits += AlignedFrequencies[i] * AlignedTree.Length[i];
+        Extra += AlignedFrequencies[i] * 3;
+    }
+    Type = (AlignedBits < Extra) ? LZX_BLOCK_ALIGNED : LZX_BLOCK_VERBATIM;
+
+    BitBase   = Scratch;
+    BitIndex  = 0;
+    BitLimit  = LZX_SCRATCH_SIZE;
+    BitBuffer = 0;
+    BitCount  = 0;
+    Overflow  = false;
+
+    /* No E8 call translation */
+    if (!HeaderDone)
+        PutBits(1, 0);
+
+    PutBits(3, Type);
+    PutBits(16, Length >> 8);
+    PutBits(8, Length & 0xFF);
+
+    if (Type == LZX_BLOCK_ALIGNED)
+    {
+        for (i = 0; i < LZX_NUM_ALIGNED; i++)
+            PutBits(3, AlignedTree.Length[i]);
+    }
+
+    WriteLengths(&MainTree, MainLengths, 0, LZX_NUM_CHARS);
+    WriteLengths(&MainTree, MainLengths, LZX_NUM_CHARS, MainElements);
+    WriteLengths(&LengthTree, LengthLengths, 0, LZX_NUM_SECONDARY);
+
+    for (i = 0; i < TokenCount && !Overflow; i++)
+    {
+        Token = Tokens[i];
+        if (!(Token & LZX_TOKEN_MATCH))
+        {
+            PutBits(MainTree.Length[Token], MainTree.Code[Token]);
+            continue;
+        }
+
+        Slot   = (Token >> 25) & 0x3F;
+        Footer = (Token >> 8) & 0x1FFFF;
+        Symbol = Token & 0xFF;
+
+        if (Symbol < LZX_NUM_PRIMARY)
+        {
+            Symbol += LZX_NUM_CHARS + (Slot << 3);
+            PutBits(MainTree.Length[Symbol], MainTree.Code[Symbol]);
+        }
+        else
+        {
+            Symbol -= LZX_NUM_PRIMARY;
+            PutBits(MainTree.Length[LZX_NUM_CHARS + (Slot << 3) + LZX_NUM_PRIMARY],
+                    MainTree.Code[LZX_NUM_CHARS + (Slot << 3) + LZX_NUM_PRIMARY]);
+            PutBits(LengthTree.Length[Symbol], LengthTree.Code[Symbol]);
+        }
+
+        Extra = ExtraBits[Slot];
+        if (Type == LZX_BLOCK_ALIGNED && Extra >= 3)
+        {
+            PutBits(Extra - 3, Footer >> 3);
+            PutBits(AlignedTree.Length[Footer & 7], AlignedTree.Code[Footer & 7]);
+        }
+        else
+            PutBits(Extra, Footer);
+    }
+
+    FlushBits();
+
+    return Overflow ? 0 : BitIndex;
+}
+
+
+ULONG CLZXCodec::WriteUncompressedBlock(PUCHAR Data, ULONG Length)
+/*
+ * FUNCTION: Writes the current block as an uncompressed block into the
+ *           output buffer (BitBase)
+ * ARGUMENTS:
+ *     Data   = Uncompressed data
+ *     Length = Number of bytes in the block
+ * RETURNS:
+ *     Size of the frame
+ */
+{
+    ULONG Offsets[3] = { R0, R1, R2 };
+    ULONG i;
+
+    BitIndex  = 0;
+    BitLimit  = CAB_MAX_COMPSIZE;
+    BitBuffer = 0;
+    BitCount  = 0;
+    Overflow  = false;
+
+    if (!HeaderDone)
+        PutBits(1, 0);
+
+    PutBits(3, LZX_BLOCK_UNCOMPRESSED);
+    PutBits(16, Length >> 8);
+    PutBits(8, Length & 0xFF);
+
+    /* Pad to the next 16 bit boundary, with a full word if already there */
+    PutBits(16 - BitCount, 0);
+
+    for (i = 0; i < 3; i++)
+    {
+        BitBase[BitIndex++] = (UCHAR)Offsets[i];
+        BitBase[BitIndex++] = (UCHAR)(Offsets[i] >> 8);
+        BitBase[BitIndex++] = (UCHAR)(Offsets[i] >> 16);
+        BitBase[BitIndex++] = (UCHAR)(Offsets[i] >> 24);
+    }
+
+    memcpy(BitBase + BitIndex, Data, Length);
+    BitIndex += Length;
+
+    if (Length & 1)
+        BitBase[BitIndex++] = 0;
+
+    return BitIndex;
+}
+
+
+ULONG CLZXCodec::Compress(void* OutputBuffer,
+                          void* InputBuffer,
+                          ULONG InputLength,
+                          PULONG OutputLength)
+/*
+ * FUNCTION: Compresses data in a buffer
+ * ARGUMENTS:
+ *     OutputBuffer   = Pointer to buffer to place compressed data,
+ *                      at least CAB_MAX_COMPSIZE bytes
+ *     InputBuffer    = Pointer to buffer with data to be compressed
+ *     InputLength    = Length of input buffer (at most CAB_BLOCKSIZE)
+ *     OutputLength   = Address of buffer to place size of compressed data
+ */
+{
+    ULONG SavedR0, SavedR1, SavedR2;
+    ULONG Length, Distance, Index, NextLength, NextDistance, Size;
+    LONG Start, End, Position, NextPosition;
+
+    DPRINT(MAX_TRACE, ("InputLength (%u).\n", (UINT)InputLength));
+
+    if (!Window && !AllocateEncoder())
+        return CS_NOMEMORY;
+
+    if (WindowEnd + InputLength > 2 * WindowSize)
+        SlideWindow();
+
+    Start = WindowEnd;
+    memcpy(Window + Start, InputBuffer, InputLength);
+    WindowEnd += InputLength;
+    End = WindowEnd;
+
+    SavedR0 = R0;
+    SavedR1 = R1;
+    SavedR2 = R2;
+
+    /* Find matches with one step of lazy evaluation */
+    TokenCount   = 0;
+    NextPosition = -1;
+    NextLength   = 0;
+    NextDistance = 0;
+    Position     = Start;
+    while (Position < End)
+    {
+        while (InsertPos < Position && InsertPos + 2 < End)
+            InsertString(InsertPos++);
+
+        if (Position == NextPosition)
+        {
+            Length   = NextLength;
+            Distance = NextDistance;
+        }
+        else
+        {
+            Length = LongestMatch(Position, End, &Distance);
+            NextLength = RepeatMatch(Position, End, &Index);
+            if (NextLength && NextLength + 1 >= Length)
+            {
+                Length = NextLength;
+                Distance = (Index == 0) ? R0 : (Index == 1) ? R1 : R2;
+            }
+        }
+
+        if (Length == 0)
+        {
+            Tokens[TokenCount++] = Window[Position++];
+            continue;
+        }
+
+        if (Length < LZX_LAZY_MATCH && Position + 1 < End)
+        {
+            if (InsertPos == Position && InsertPos + 2 < End)
+                InsertString(InsertPos++);
+
+            NextPosition = Position + 1;
+            NextLength = LongestMatch(NextPosition, End, &NextDistance);
+            Size = RepeatMatch(NextPosition, End, &Index);
+            if (Size && Size + 1 >= NextLength)
+            {
+                NextLength = Size;
+                NextDistance = (Index == 0) ? R0 : (Index == 1) ? R1 : R2;
+            }
+
+            if (NextLength > Length)
+            {
+                Tokens[TokenCount++] = Window[Position++];
+                continue;
+            }
+        }
+
+        EmitMatch(Length, Distance);
+        Position += Length;
+    }
+
+    Size = WriteCompressedBlock(InputLength);
+
+    /* 4 bytes of header, 12 bytes of repeated offsets and the padded data */
+    if (Size == 0 || Size >= 16 + InputLength + (InputLength & 1))
+    {
+        R0 = SavedR0;
+        R1 = SavedR1;
+        R2 = SavedR2;
+
+        BitBase = (PUCHAR)OutputBuffer;
+        Size = WriteUncompressedBlock((PUCHAR)InputBuffer, InputLength);
+    }
+    else
+    {
+        memcpy(OutputBuffer, Scratch, Size);
+        memcpy(MainLengths, MainTree.Length, MainElements);
+        memcpy(LengthLengths, LengthTree.Length, LZX_NUM_SECONDARY);
+    }
+
+    HeaderDone = true;
+    *OutputLength = Size;
+
+    return CS_SUCCESS;
+}
+
+
+/* Decoder */
+
+bool CLZXCodec::AllocateDecoder()
+/*
+ * FUNCTION: Allocates the decoder window on first use
+ */
+{
+    DecodeWindow = (PUCHAR)AllocateMemory(WindowSize);
+    if (!DecodeWindow)
+        return false;
+
+    memset(DecodeWindow, 0, WindowSize);
+    return true;
+}
+
+
+bool CLZXCodec::ReadBlockHeader()
+/*
+ * FUNCTION: Reads the header and the trees of the next block
+ * RETURNS:
+ *     false if the header is corrupt
+ */
+{
+    ULONG Offsets[3];
+    ULONG i;
+
+    BlockType   = GetBits(3);
+    BlockLength = GetBits(16) << 8;
+    BlockLength |= GetBits(8);
+    BlockRemaining = BlockLength;
+
+    switch (BlockType)
+    {
+        case LZX_BLOCK_ALIGNED:
+            for (i = 0; i < LZX_NUM_ALIGNED; i++)
+                AlignedTree.Length[i] = (UCHAR)GetBits(3);
+            BuildCodes(&AlignedTree);
+            if (!BuildTable(&AlignedTree))
+                return false;
+            /* Fall through */
+
+        case LZX_BLOCK_VERBATIM:
+            if (!ReadLengths(MainLengths, 0, LZX_NUM_CHARS) ||
+                !ReadLengths(MainLengths, LZX_NUM_CHARS, MainElements))
+                return false;
+            memcpy(MainTree.Length, MainLengths, MainElements);
+            BuildCodes(&MainTree);
+            if (!BuildTable(&MainTree))
+                return false;
+
+            if (!ReadLengths(LengthLengths, 0, LZX_NUM_SECONDARY))
+                return false;
+            memcpy(LengthTree.Length, LengthLengths, LZX_NUM_SECONDARY);
+            BuildCodes(&LengthTree);
+            if (!BuildTable(&LengthTree))
+                return false;
+            break;
+
+        case LZX_BLOCK_UNCOMPRESSED:
+            /* Realign to the next 16 bit boundary, skipping a full
+               word if already there, and forget the bit buffer */
+            BitIndex -= (BitCount / 16) * 2;
+            if ((BitCount % 16) == 0)
+                BitIndex += 2;
+            BitBuffer = 0;
+            BitCount  = 0;
+
+            if (BitIndex + 12 > BitLimit)
+                return false;
+
+            for (i = 0; i < 3; i++)
+            {
+                Offsets[i] = BitBase[BitIndex] | (BitBase[BitIndex + 1] << 8) |
+                             (BitBase[BitIndex + 2] << 16) | ((ULONG)BitBase[BitIndex + 3] << 24);
+                BitIndex += 4;
+            }
+            R0 = Offsets[0];
+            R1 = Offsets[1];
+            R2 = Offsets[2];
+            break;
+
+        default:
+            return false;
+    }
+
+    return true;
+}
+
+
+bool CLZXCodec::DecodeRun(ULONG Length)
+/*
+ * FUNCTION: Decodes Length bytes of the current block into the window
+ * RETURNS:
+ *     false if the data is corrupt
+ */
+{
+    ULONG Symbol, MatchLen, Slot, Extra, Offset, Source, Mask, Temp;
+
+    if (BlockType == LZX_BLOCK_UNCOMPRESSED)
+    {
+        if (BitIndex + Length > BitLimit)
+            return false;
+
+        memcpy(DecodeWindow + DecodePos, BitBase + BitIndex, Length);
+        BitIndex += Length;
+        DecodePos += Length;
+        return true;
+    }
+
+    Mask = WindowSize - 1;
+    while (Length > 0)
+    {
+        Symbol = DecodeSymbol(&MainTree);
+        if (Symbol >= MainElements)
+            return false;
+
+        if (Symbol < LZX_NUM_CHARS)
+        {
+            DecodeWindow[DecodePos++] = (UCHAR)Symbol;
+            Length--;
+            continue;
+        }
+
+        Symbol -= LZX_NUM_CHARS;
+        Slot = Symbol >> 3;
+        MatchLen = Symbol & 7;
+        if (MatchLen == LZX_NUM_PRIMARY)
+        {
+            Symbol = DecodeSymbol(&LengthTree);
+            if (Symbol >= LZX_NUM_SECONDARY)
+                return false;
+            MatchLen += Symbol;
+        }
+        MatchLen += LZX_MIN_MATCH;
+
+        if (Slot == 0)
+            Offset = R0;
+        else if (Slot == 1)
+        {
+            Offset = R1;
+            R1 = R0;
+            R0 = Offset;
+        }
+        else if (Slot == 2)
+        {
+            Offset = R2;
+            R2 = R0;
+            R0 = Offset;
+        }
+        else
+        {
+            Extra = ExtraBits[Slot];
+            Offset = PositionBase[Slot] - 2;
+
+            if (BlockType == LZX_BLOCK_ALIGNED && Extra >= 3)
+            {
+                Offset += GetBits(Extra - 3) << 3;
+                Temp = DecodeSymbol(&AlignedTree);
+                if (Temp >= LZX_NUM_ALIGNED)
+                    return false;
+                Offset += Temp;
+            }
+            else
+                Offset += GetBits(Extra);
+
+            R2 = R1;
+            R1 = R0;
+            R0 = Offset;
+        }
+
+        if (MatchLen > Length || Offset == 0 || Offset >= WindowSize)
+            return false;
+
+        Source = (DecodePos - Offset) & Mask;
+        Length -= MatchLen;
+        while (MatchLen--)
+        {
+            DecodeWindow[DecodePos++] = DecodeWindow[Source];
+            Source = (Source + 1) & Mask;
+        }
+    }
+
+    return true;
+}
+
+
+ULONG CLZXCodec::Uncompress(void* OutputBuffer,
+                            void* InputBuffer,
+                            ULONG InputLength,
+                            PULONG OutputLength)
+/*
+ * FUNCTION: Uncompresses data in a buffer
+ * ARGUMENTS:
+ *     OutputBuffer = Pointer to buffer to place uncompressed data
+ *     InputBuffer  = Pointer to buffer with data to be uncompressed
+ *     InputLength  = Length of input buffer
+ *     OutputLength = Address of buffer with the size of the uncompressed
+ *                    data. LZX frames don't record their size, so the
+ *                    caller passes it in (0 means CAB_BLOCKSIZE)
+ * NOTES:
+ *     The data blocks of a folder must be passed in order
+ */
+{
+    PUCHAR Data, DataEnd;
+    ULONG Expected, Start, Run, Header;
+    LONG Absolute, Relative, CurPos;
+
+    DPRINT(MAX_TRACE, ("InputLength (%u).\n", (UINT)InputLength));
+
+    if (!DecodeWindow && !AllocateDecoder())
+        return CS_NOMEMORY;
+
+    Expected = *OutputLength;
+    if (Expected == 0 || Expected > CAB_BLOCKSIZE)
+        Expected = CAB_BLOCKSIZE;
+
+    /* Frames start on a multiple of their size, so they never wrap */
+    if (DecodePos + Expected > WindowSize)
+        return CS_BADSTREAM;
+
+    BitBase   = (PUCHAR)InputBuffer;
+    BitIndex  = 0;
+    BitLimit  = InputLength;
+    BitBuffer = 0;
+    BitCount  = 0;
+
+    if (!HeaderDone)
+    {
+        if (GetBits(1))
+        {
+            Header = GetBits(16) << 16;
+            IntelFileSize = Header | GetBits(16);
+        }
+        HeaderDone = true;
+    }
+
+    Start = DecodePos;
+    while (DecodePos - Start < Expected)
+    {
+        if (BlockRemaining == 0 && !ReadBlockHeader())
+        {
+            DPRINT(MID_TRACE, ("Bad LZX block header.\n"));
+            return CS_BADSTREAM;
+        }
+
+        Run = Expected - (DecodePos - Start);
+        if (Run > BlockRemaining)
+            Run = BlockRemaining;
+
+        if (!DecodeRun(Run))
+        {
+            DPRINT(MID_TRACE, ("Bad LZX block data.\n"));
+            return CS_BADSTREAM;
+        }
+        BlockRemaining -= Run;
+
+        if (BlockRemaining == 0 && BlockType == LZX_BLOCK_UNCOMPRESSED && (BlockLength & 1))
+            BitIndex++;
+    }
+
+    memcpy(OutputBuffer, DecodeWindow + Start, Expected);
+    DecodePos = (Start + Expected) & (WindowSize - 1);
+
+    /* Undo the E8 call translation */
+    if (IntelFileSize && FrameCount < 32768 && Expected > 10)
+    {
+        Data    = (PUCHAR)OutputBuffer;
+        DataEnd = Data + Expected - 10;
+        CurPos  = IntelCurPos;
+        while (Data < DataEnd)
+        {
+            if (*Data++ != 0xE8)
+            {
+                CurPos++;
+                continue;
+            }
+
+            Absolute = (LONG)(Data[0] | (Data[1] << 8) | (Data[2] << 16) | ((ULONG)Data[3] << 24));
+            if (Absolute >= -CurPos && Absolute < (LONG)IntelFileSize)
+            {
+                Relative = (Absolute >= 0) ? Absolute - CurPos : Absolute + (LONG)IntelFileSize;
+                Data[0] = (UCHAR)Relative;
+                Data[1] = (UCHAR)(Relative >> 8);
+                Data[2] = (UCHAR)(Relative >> 16);
+                Data[3] = (UCHAR)(Relative >> 24);
+            }
+            Data += 4;
+            CurPos += 5;
+        }
+    }
+    IntelCurPos += Expected;
+
+    FrameCount++;
+    *OutputLength = Expected;
+
+    return CS_SUCCESS;
+}
+
+/* EOF */
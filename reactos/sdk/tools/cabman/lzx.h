@@ -0,0 +1,139 @@
+/*
+ * COPYRIGHT:   See COPYING in the top level directory
+ * PROJECT:     ReactOS cabinet manager
+ * FILE:        tools/cabman/lzx.h
+ * PURPOSE:     CAB codec for LZX compressed data
+ */
+
+#pragma once
+
+#include "cabinet.h"
+
+#define LZX_MIN_WINDOW      15      /* 32KB */
+#define LZX_MAX_WINDOW      21      /* 2MB */
+#define LZX_DEFAULT_WINDOW  21
+
+#define LZX_MIN_MATCH       2
+#define LZX_MAX_MATCH       257
+#define LZX_NUM_CHARS       256
+#define LZX_NUM_PRIMARY     7       /* Lengths coded in the main tree */
+#define LZX_NUM_SECONDARY   249     /* Symbols in the length tree */
+#define LZX_NUM_ALIGNED     8
+#define LZX_NUM_PRETREE     20
+#define LZX_MAX_SLOTS       50
+#define LZX_MAX_MAIN        (LZX_NUM_CHARS + LZX_MAX_SLOTS * 8)
+
+#define LZX_BLOCK_VERBATIM      1
+#define LZX_BLOCK_ALIGNED       2
+#define LZX_BLOCK_UNCOMPRESSED  3
+
+#define LZX_MIN_HASH_BITS   16
+#define LZX_TABLE_BITS      11      /* Codes up to this long are decoded with a single lookup */
+
+
+/* Classes */
+
+typedef struct _LZX_TREE
+{
+    ULONG Count;                    /* Number of symbols */
+    ULONG MaxLength;                /* Longest code allowed */
+    UCHAR Length[LZX_MAX_MAIN];     /* Code lengths */
+    USHORT Code[LZX_MAX_MAIN];      /* Canonical codes */
+    USHORT Table[1 << LZX_TABLE_BITS]; /* Decoding table, 0xFFFF for long codes */
+    USHORT Sorted[LZX_MAX_MAIN];    /* Symbols sorted by code, for long codes */
+    USHORT Counts[17];              /* Number of codes of each length */
+} LZX_TREE, *PLZX_TREE;
+
+class CLZXCodec : public CCABCodec
+{
+public:
+    /* Constructor */
+    CLZXCodec(ULONG WindowBits = LZX_DEFAULT_WINDOW);
+    /* Default destructor */
+    virtual ~CLZXCodec();
+    /* Compresses a data block */
+    virtual ULONG Compress(void* OutputBuffer,
+                           void* InputBuffer,
+                           ULONG InputLength,
+                           PULONG OutputLength);
+    /* Uncompresses a data block */
+    virtual ULONG Uncompress(void* OutputBuffer,
+                             void* InputBuffer,
+                             ULONG InputLength,
+                             PULONG OutputLength);
+    /* Starts a new folder */
+    virtual void Reset();
+    /* Returns the window size */
+    ULONG GetWindowBits() { return WindowBits; };
+private:
+    /* Bit I/O */
+    void PutBits(ULONG Count, ULONG Value);
+    void FlushBits();
+    ULONG GetBits(ULONG Count);
+    void EnsureBits(ULONG Count);
+    /* Trees */
+    static void BuildLengths(PLZX_TREE Tree, PULONG Frequencies);
+    static void BuildCodes(PLZX_TREE Tree);
+    static bool BuildTable(PLZX_TREE Tree);
+    ULONG DecodeSymbol(PLZX_TREE Tree);
+    void WriteLengths(PLZX_TREE Tree, PUCHAR Previous, ULONG First, ULONG Last);
+    bool ReadLengths(PUCHAR Lengths, ULONG First, ULONG Last);
+    /* Encoder */
+    bool AllocateEncoder();
+    void SlideWindow();
+    ULONG HashString(LONG Position);
+    void InsertString(LONG Position);
+    ULONG LongestMatch(LONG Position, LONG End, PULONG Distance);
+    ULONG RepeatMatch(LONG Position, LONG End, PULONG Index);
+    void EmitMatch(ULONG Length, ULONG Distance);
+    ULONG WriteCompressedBlock(ULONG Length);
+    ULONG WriteUncompressedBlock(PUCHAR Data, ULONG Length);
+    /* Decoder */
+    bool AllocateDecoder();
+    bool ReadBlockHeader();
+    bool DecodeRun(ULONG Length);
+
+    ULONG WindowBits;
+    ULONG WindowSize;
+    ULONG NumSlots;
+    ULONG MainElements;
+    bool HeaderDone;                /* Intel E8 header written or read */
+    ULONG R0, R1, R2;               /* Repeated offsets */
+    UCHAR MainLengths[LZX_MAX_MAIN];   /* Lengths of the previous block */
+    UCHAR LengthLengths[LZX_NUM_SECONDARY];
+    LZX_TREE MainTree;
+    LZX_TREE LengthTree;
+    LZX_TREE AlignedTree;
+    LZX_TREE PreTree;
+
+    /* Bit stream */
+    PUCHAR BitBase;
+    ULONG BitIndex;                 /* Byte offset into BitBase */
+    ULONG BitLimit;
+    ULONG BitBuffer;
+    ULONG BitCount;
+    bool Overflow;
+
+    /* Encoder state */
+    PUCHAR Window;                  /* Two windows worth of history */
+    LONG WindowEnd;                 /* End of the data in the window */
+    LONG InsertPos;                 /* Next position to insert into the hash chains */
+    ULONG HashBits;                 /* One bit less than the window */
+    PLONG HashHead;
+    PLONG HashPrev;
+    PULONG Tokens;                  /* Literals and matches of the current block */
+    ULONG TokenCount;
+    PUCHAR Scratch;                 /* Compressed block, before it is known to be smaller */
+
+    /* Decoder state */
+    PUCHAR DecodeWindow;
+    ULONG DecodePos;
+    ULONG BlockType;
+    ULONG BlockLength;
+    ULONG BlockRemaining;
+    ULONG IntelFileSize;            /* E8 translation size, 0 if not used */
+    ULONG IntelCurPos;
+    ULONG FrameCount;
+};
+
+/* EOF */
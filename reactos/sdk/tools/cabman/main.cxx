@@ -14,6 +14,9 @@
 #include <stdarg.h>
 #include <string.h>
 #include <stdio.h>
+#if !defined(_WIN32)
+#include <sys/time.h>
+#endif
 #include "cabman.h"
 
 
@@ -52,6 +55,24 @@ char* Pad(char* Str, char PadChar, ULONG Length)
 }
 
 
+ULONG GetMilliseconds()
+/*
+ * FUNCTION: Returns a time stamp for measuring how long something takes
+ * RETURNS:
+ *     Milliseconds since some arbitrary point in time
+ */
+{
+#if defined(_WIN32)
+    return GetTickCount();
+#else
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return (ULONG)(tv.tv_sec * 1000 + tv.tv_usec / 1000);
+#endif
+}
+
+
 char* Date2Str(char* Str, USHORT Date)
 /*
  * FUNCTION: Converts a DOS style date to a string
@@ -174,6 +195,9 @@ CCABManager::CCABManager()
     Mode = CM_MODE_DISPLAY;
     FileName[0] = 0;
     Verbose = false;
+
+    /* One compression thread per processor */
+    SetThreadCount(0);
 }
 
 
@@ -192,8 +216,8 @@ void CCABManager::Usage()
 {
     printf("ReactOS Cabinet Manager\n\n");
     printf("CABMAN [-D | -E] [-A] [-L dir] cabinet [filename ...]\n");
-    printf("CABMAN [-M mode] -C dirfile [-I] [-RC file] [-P dir]\n");
-    printf("CABMAN [-M mode] -S cabinet filename [...]\n");
+    printf("CABMAN [-M mode] [-T threads] -C dirfile [-I] [-RC file] [-P dir]\n");
+    printf("CABMAN [-M mode] [-T threads] -S cabinet filename [...]\n");
     printf("  cabinet   Cabinet file.\n");
     printf("  filename  Name of the file to add to or extract from the cabinet.\n");
     printf("            Wild cards and multiple filenames\n");
@@ -212,12 +236,17 @@ void CCABManager::Usage()
     printf("  -M mode   Specify the compression method to use:\n");
     printf("               raw    - No compression\n");
     printf("               mszip  - MsZip compression (default)\n");
+    printf("               lzx    - LZX compression, lzx:15 to lzx:21\n");
+    printf("                        selects the window size (default 21)\n");
     printf("  -N        Don't create the .inf file, only the cabinet.\n");
     printf("  -RC       Specify file to put in cabinet reserved area\n");
     printf("            (size must be less than 64KB).\n");
     printf("  -S        Create simple cabinet.\n");
     printf("  -P dir    Files in the .dff are relative to this directory.\n");
-    printf("  -V        Verbose mode (prints more messages).\n");
+    printf("  -T threads Number of threads compressing MsZip data blocks\n");
+    printf("            (default is one per processor).\n");
+    printf("  -V        Verbose mode (prints more messages and\n");
+    printf("            compression statistics).\n");
 }
 
 bool CCABManager::ParseCmdline(int argc, char* argv[])
@@ -347,6 +376,18 @@ bool CCABManager::ParseCmdline(int argc, char* argv[])
 
                     break;
 
+                case 't':
+                case 'T':
+                    if (argv[i][2] == 0)
+                    {
+                        i++;
+                        SetThreadCount(strtoul(&argv[i][0], NULL, 10));
+                    }
+                    else
+                        SetThreadCount(strtoul(&argv[i][2], NULL, 10));
+
+                    break;
+
                 case 'V':
                     Verbose = true;
                     break;
@@ -555,11 +596,37 @@ bool CCABManager::ExtractFromCabinet()
 }
 
 
+void CCABManager::PrintStatistics(ULONG Milliseconds)
+/*
+ * FUNCTION: Displays how well and how fast the data was compressed
+ * ARGUMENTS:
+ *     Milliseconds = Time it took to create the cabinet
+ */
+{
+    ULONGLONG UncompSize;
+    ULONGLONG CompSize;
+
+    GetStatistics(&UncompSize, &CompSize);
+
+    printf("\n%llu bytes compressed to %llu bytes",
+        (unsigned long long)UncompSize, (unsigned long long)CompSize);
+    if (UncompSize > 0)
+        printf(" (%.1f%%)", (double)CompSize * 100.0 / (double)UncompSize);
+    printf(" in %u.%03u seconds", (UINT)(Milliseconds / 1000), (UINT)(Milliseconds % 1000));
+    if (Milliseconds > 0)
+        printf(" (%.1f MB/s)", (double)UncompSize / 1048.576 / (double)Milliseconds);
+    printf(", %u thread(s).\n", (UINT)GetThreadCount());
+}
+
+
 bool CCABManager::Run()
 /*
  * FUNCTION: Process cabinet
  */
 {
+    ULONG StartTime;
+    bool Result;
+
     if (Verbose)
     {
         printf("ReactOS Cabinet Manager\n\n");
@@ -568,7 +635,9 @@ bool CCABManager::Run()
     switch (Mode)
     {
         case CM_MODE_CREATE:
-            return CreateCabinet();
+            StartTime = GetMilliseconds();
+            Result = CreateCabinet();
+            break;
 
         case CM_MODE_DISPLAY:
             return DisplayCabinet();
@@ -577,12 +646,18 @@ bool CCABManager::Run()
             return ExtractFromCabinet();
 
         case CM_MODE_CREATE_SIMPLE:
-            return CreateSimpleCabinet();
+            StartTime = GetMilliseconds();
+            Result = CreateSimpleCabinet();
+            break;
 
         default:
-            break;
+            return false;
     }
-    return false;
+
+    if (Result && Verbose)
+        PrintStatistics(GetMilliseconds() - StartTime);
+
+    return Result;
 }
 
 
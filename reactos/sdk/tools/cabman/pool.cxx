@@ -0,0 +1,371 @@
+/*
+ * COPYRIGHT:   See COPYING in the top level directory
+ * PROJECT:     ReactOS cabinet manager
+ * FILE:        tools/cabman/pool.cxx
+ * PURPOSE:     Worker threads for compressing data blocks
+ * NOTES:       Only for codecs where each data block stands on its own.
+ *              Jobs are handed out in the order they were submitted, so
+ *              the cabinet comes out the same no matter how many threads
+ *              do the work.
+ */
+#include "pool.h"
+#include "raw.h"
+#include "mszip.h"
+
+
+#if defined(_WIN32)
+static DWORD WINAPI WorkerThread(LPVOID Context)
+#else
+static void* WorkerThread(void* Context)
+#endif
+{
+    ((CCompressionPool*)Context)->Work();
+    return 0;
+}
+
+
+/* CCompressionPool */
+
+CCompressionPool::CCompressionPool()
+/*
+ * FUNCTION: Default constructor
+ */
+{
+    CodecId     = -1;
+    ThreadCount = 0;
+    Jobs        = NULL;
+    JobCount    = 0;
+}
+
+
+CCompressionPool::~CCompressionPool()
+/*
+ * FUNCTION: Default destructor
+ */
+{
+    Stop();
+}
+
+
+ULONG CCompressionPool::GetProcessorCount()
+/*
+ * FUNCTION: Returns the number of processors
+ */
+{
+#if defined(_WIN32)
+    SYSTEM_INFO SystemInfo;
+
+    GetSystemInfo(&SystemInfo);
+    return SystemInfo.dwNumberOfProcessors;
+#else
+    long Count = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return (Count > 0) ? (ULONG)Count : 1;
+#endif
+}
+
+
+void CCompressionPool::Lock()
+{
+#if defined(_WIN32)
+    EnterCriticalSection(&CritSect);
+#else
+    pthread_mutex_lock(&Mutex);
+#endif
+}
+
+
+void CCompressionPool::Unlock()
+{
+#if defined(_WIN32)
+    LeaveCriticalSection(&CritSect);
+#else
+    pthread_mutex_unlock(&Mutex);
+#endif
+}
+
+
+void CCompressionPool::WaitForWork()
+{
+#if defined(_WIN32)
+    SleepConditionVariableCS(&WorkReady, &CritSect, INFINITE);
+#else
+    pthread_cond_wait(&WorkReady, &Mutex);
+#endif
+}
+
+
+void CCompressionPool::WaitForDone()
+{
+#if defined(_WIN32)
+    SleepConditionVariableCS(&WorkDone, &CritSect, INFINITE);
+#else
+    pthread_cond_wait(&WorkDone, &Mutex);
+#endif
+}
+
+
+void CCompressionPool::SignalWork()
+{
+#if defined(_WIN32)
+    WakeConditionVariable(&WorkReady);
+#else
+    pthread_cond_signal(&WorkReady);
+#endif
+}
+
+
+void CCompressionPool::SignalDone()
+{
+#if defined(_WIN32)
+    WakeConditionVariable(&WorkDone);
+#else
+    pthread_cond_signal(&WorkDone);
+#endif
+}
+
+
+ULONG CCompressionPool::Start(LONG CodecId, ULONG Count)
+/*
+ * FUNCTION: Starts the worker threads
+ * ARGUMENTS:
+ *     CodecId = Codec the workers compress with
+ *     Count   = Number of worker threads
+ * RETURNS:
+ *     Status of operation
+ */
+{
+    ULONG i;
+
+    if (Count > POOL_MAX_THREADS)
+        Count = POOL_MAX_THREADS;
+
+    /* Two jobs per thread keep the workers busy while the oldest is stored */
+    JobCount = Count * 2;
+    Jobs = (PCOMPRESSION_JOB)AllocateMemory(JobCount * sizeof(COMPRESSION_JOB));
+    if (!Jobs)
+    {
+        DPRINT(MIN_TRACE, ("Insufficient memory.\n"));
+        return CAB_STATUS_NOMEMORY;
+    }
+
+    for (i = 0; i < JobCount; i++)
+        Jobs[i].State = JOB_FREE;
+
+    this->CodecId = CodecId;
+    Head     = 0;
+    Tail     = 0;
+    NextWork = 0;
+    Pending  = 0;
+    Stopping = false;
+
+#if defined(_WIN32)
+    InitializeCriticalSection(&CritSect);
+    InitializeConditionVariable(&WorkReady);
+    InitializeConditionVariable(&WorkDone);
+#else
+    pthread_mutex_init(&Mutex, NULL);
+    pthread_cond_init(&WorkReady, NULL);
+    pthread_cond_init(&WorkDone, NULL);
+#endif
+
+    for (ThreadCount = 0; ThreadCount < Count; ThreadCount++)
+    {
+#if defined(_WIN32)
+        Threads[ThreadCount] = CreateThread(NULL, 0, WorkerThread, this, 0, NULL);
+        if (!Threads[ThreadCount])
+#else
+        if (pthread_create(&Threads[ThreadCount], NULL, WorkerThread, this) != 0)
+#endif
+        {
+            DPRINT(MIN_TRACE, ("Cannot create worker thread.\n"));
+            Stop();
+            return CAB_STATUS_FAILURE;
+        }
+    }
+
+    return CAB_STATUS_SUCCESS;
+}
+
+
+void CCompressionPool::Stop()
+/*
+ * FUNCTION: Stops the worker threads
+ */
+{
+    ULONG i;
+
+    if (!Jobs)
+        return;
+
+    Lock();
+    Stopping = true;
+#if defined(_WIN32)
+    WakeAllConditionVariable(&WorkReady);
+#else
+    pthread_cond_broadcast(&WorkReady);
+#endif
+    Unlock();
+
+    for (i = 0; i < ThreadCount; i++)
+    {
+#if defined(_WIN32)
+        WaitForSingleObject(Threads[i], INFINITE);
+        CloseHandle(Threads[i]);
+#else
+        pthread_join(Threads[i], NULL);
+#endif
+    }
+
+#if defined(_WIN32)
+    DeleteCriticalSection(&CritSect);
+#else
+    pthread_cond_destroy(&WorkDone);
+    pthread_cond_destroy(&WorkReady);
+    pthread_mutex_destroy(&Mutex);
+#endif
+
+    FreeMemory(Jobs);
+    Jobs        = NULL;
+    JobCount    = 0;
+    ThreadCount = 0;
+}
+
+
+bool CCompressionPool::IsFull()
+/*
+ * FUNCTION: Returns whether all jobs are in use
+ */
+{
+    return (Pending == JobCount);
+}
+
+
+void CCompressionPool::Submit(void* Buffer, ULONG Size)
+/*
+ * FUNCTION: Queues a data block for compression
+ * ARGUMENTS:
+ *     Buffer = Pointer to buffer with data to be compressed
+ *     Size   = Length of buffer
+ * NOTES:
+ *     The pool must not be full
+ */
+{
+    PCOMPRESSION_JOB Job = &Jobs[Head];
+
+    ASSERT(!IsFull());
+
+    /* The workers don't look at the job before it is queued */
+    memcpy(Job->InputBuffer, Buffer, Size);
+    Job->InputSize = Size;
+
+    Lock();
+    Job->State = JOB_QUEUED;
+    Head = (Head + 1) % JobCount;
+    SignalWork();
+    Unlock();
+
+    Pending++;
+}
+
+
+PCOMPRESSION_JOB CCompressionPool::GetNext(bool Wait)
+/*
+ * FUNCTION: Returns the oldest job
+ * ARGUMENTS:
+ *     Wait = true to wait for the job to be done
+ * RETURNS:
+ *     Pointer to the job, NULL if there is none or it isn't done and Wait is false
+ */
+{
+    PCOMPRESSION_JOB Job;
+
+    if (Pending == 0)
+        return NULL;
+
+    Job = &Jobs[Tail];
+
+    Lock();
+    while (Job->State != JOB_DONE)
+    {
+        if (!Wait)
+        {
+            Unlock();
+            return NULL;
+        }
+        WaitForDone();
+    }
+    Unlock();
+
+    return Job;
+}
+
+
+void CCompressionPool::Release(PCOMPRESSION_JOB Job)
+/*
+ * FUNCTION: Makes the job returned by GetNext free for reuse
+ */
+{
+    ASSERT(Job == &Jobs[Tail]);
+
+    Lock();
+    Job->State = JOB_FREE;
+    Unlock();
+
+    Tail = (Tail + 1) % JobCount;
+    Pending--;
+}
+
+
+void CCompressionPool::Work()
+/*
+ * FUNCTION: Compresses queued jobs until the pool is stopped
+ */
+{
+    PCOMPRESSION_JOB Job;
+    CCABCodec* Codec;
+
+    /* Codecs keep state while compressing, so every worker has its own */
+    switch (CodecId)
+    {
+        case CAB_CODEC_RAW:
+            Codec = new CRawCodec();
+            break;
+
+        case CAB_CODEC_MSZIP:
+            Codec = new CMSZipCodec();
+            break;
+
+        default:
+            return;
+    }
+
+    Lock();
+    for (;;)
+    {
+        while (!Stopping && Jobs[NextWork].State != JOB_QUEUED)
+            WaitForWork();
+
+        if (Stopping)
+            break;
+
+        Job = &Jobs[NextWork];
+        Job->State = JOB_BUSY;
+        NextWork = (NextWork + 1) % JobCount;
+        Unlock();
+
+        Job->Status = Codec->Compress(Job->OutputBuffer,
+                                      Job->InputBuffer,
+                                      Job->InputSize,
+                                      &Job->OutputSize);
+
+        Lock();
+        Job->State = JOB_DONE;
+        SignalDone();
+    }
+    Unlock();
+
+    delete Codec;
+}
+
+/* EOF */
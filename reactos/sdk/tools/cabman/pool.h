@@ -0,0 +1,90 @@
+/*
+ * COPYRIGHT:   See COPYING in the top level directory
+ * PROJECT:     ReactOS cabinet manager
+ * FILE:        tools/cabman/pool.h
+ * PURPOSE:     Worker threads for compressing data blocks
+ */
+
+#pragma once
+
+#include "cabinet.h"
+
+#if !defined(_WIN32)
+#include <pthread.h>
+#endif
+
+#define POOL_MAX_THREADS    64
+
+/* Job states */
+#define JOB_FREE            0
+#define JOB_QUEUED          1
+#define JOB_BUSY            2
+#define JOB_DONE            3
+
+
+/* Classes */
+
+typedef struct _COMPRESSION_JOB
+{
+    ULONG State;
+    ULONG Status;                           // Codec status
+    ULONG InputSize;
+    ULONG OutputSize;
+    UCHAR InputBuffer[CAB_BLOCKSIZE];
+    UCHAR OutputBuffer[CAB_MAX_COMPSIZE];
+} COMPRESSION_JOB, *PCOMPRESSION_JOB;
+
+class CCompressionPool
+{
+public:
+    /* Default constructor */
+    CCompressionPool();
+    /* Default destructor */
+    virtual ~CCompressionPool();
+    /* Starts the worker threads */
+    ULONG Start(LONG CodecId, ULONG Count);
+    /* Stops the worker threads, unfinished jobs are lost */
+    void Stop();
+    /* Returns whether a job can be submitted */
+    bool IsFull();
+    /* Queues a data block for compression */
+    void Submit(void* Buffer, ULONG Size);
+    /* Returns the oldest job, if it is done or Wait is true */
+    PCOMPRESSION_JOB GetNext(bool Wait);
+    /* Makes the job returned by GetNext free for reuse */
+    void Release(PCOMPRESSION_JOB Job);
+    /* Worker thread body */
+    void Work();
+    /* Returns the number of processors */
+    static ULONG GetProcessorCount();
+private:
+    void Lock();
+    void Unlock();
+    void WaitForWork();
+    void WaitForDone();
+    void SignalWork();
+    void SignalDone();
+
+    LONG CodecId;
+    ULONG ThreadCount;
+    PCOMPRESSION_JOB Jobs;                  // Ring of jobs, in submission order
+    ULONG JobCount;
+    ULONG Head;                             // Next job to submit
+    ULONG Tail;                             // Oldest job not yet released
+    ULONG NextWork;                         // Next job for the workers
+    ULONG Pending;                          // Jobs submitted and not yet released
+    bool Stopping;
+#if defined(_WIN32)
+    CRITICAL_SECTION CritSect;
+    CONDITION_VARIABLE WorkReady;
+    CONDITION_VARIABLE WorkDone;
+    HANDLE Threads[POOL_MAX_THREADS];
+#else
+    pthread_mutex_t Mutex;
+    pthread_cond_t WorkReady;
+    pthread_cond_t WorkDone;
+    pthread_t Threads[POOL_MAX_THREADS];
+#endif
+};
+
+/* EOF */
@@ -426,11 +426,11 @@ list(APPEND SOURCE_CRTDLL
 #    mblen.c
     mbstowcs.c
 #    mbtowc.c
-#    memchr.c
-#    memcmp.c
-#    memcpy.c
-#    memmove.c
-#    memset.c
+    memchr.c
+    memcmp.c
+    # memcpy is tested along with memmove
+    memmove.c
+    memset.c
 #    mktime.c
 #    modf.c
 #    perror.c
@@ -458,7 +458,7 @@ list(APPEND SOURCE_CRTDLL
 #    srand.c
 #    sscanf.c
 #    strcat.c
-#    strchr.c
+    strchr.c
 #    strcmp.c
 #    strcoll.c
     strcpy.c
@@ -499,13 +499,13 @@ list(APPEND SOURCE_CRTDLL
 #    vswprintf.c
 #    vwprintf.c
 #    wcscat.c
-#    wcschr.c
+    wcschr.c
 #    wcscmp.c
 #    wcscoll.c
 #    wcscpy.c
 #    wcscspn.c
 #    wcsftime.c
-#    wcslen.c
+    wcslen.c
 #    wcsncat.c
 #    wcsncmp.c
 #    wcsncpy.c
@@ -0,0 +1,70 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPLv2+ - See COPYING in the top level directory
+ * PURPOSE:         Guard page buffers for the mem* and str* tests
+ */
+
+#pragma once
+
+#define GUARD_PAGE_SIZE 0x1000
+
+/* Allocates Pages accessible pages between two PAGE_NOACCESS pages */
+static
+unsigned char *
+AllocateGuarded(size_t Pages)
+{
+    unsigned char *Base;
+    DWORD OldProtect;
+
+    Base = VirtualAlloc(NULL, (Pages + 2) * GUARD_PAGE_SIZE, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    ok(Base != NULL, "VirtualAlloc failed with %lu\n", GetLastError());
+    if (!Base)
+        return NULL;
+
+    VirtualProtect(Base, GUARD_PAGE_SIZE, PAGE_NOACCESS, &OldProtect);
+    VirtualProtect(Base + (Pages + 1) * GUARD_PAGE_SIZE, GUARD_PAGE_SIZE, PAGE_NOACCESS, &OldProtect);
+    return Base + GUARD_PAGE_SIZE;
+}
+
+static
+void
+FreeGuarded(unsigned char *Buffer)
+{
+    VirtualFree(Buffer - GUARD_PAGE_SIZE, 0, MEM_RELEASE);
+}
+
+/* Deterministic test data, so failures can be reproduced */
+static unsigned int GuardRandomState = 0x1234567;
+
+static
+unsigned int
+GuardRandom(void)
+{
+    GuardRandomState = GuardRandomState * 1103515245 + 12345;
+    return GuardRandomState >> 8;
+}
+
+static
+void
+FillPattern(unsigned char *Buffer, size_t Length, unsigned char Seed)
+{
+    size_t i;
+
+    for (i = 0; i < Length; i++)
+        Buffer[i] = (unsigned char)(Seed + i * 7 + (i >> 8));
+}
+
+/* Plain byte loop, so we don't check the routines with themselves */
+static
+size_t
+FirstDifference(const unsigned char *Buffer1, const unsigned char *Buffer2, size_t Length)
+{
+    size_t i;
+
+    for (i = 0; i < Length; i++)
+    {
+        if (Buffer1[i] != Buffer2[i])
+            return i;
+    }
+    return Length;
+}
@@ -0,0 +1,90 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPLv2+ - See COPYING in the top level directory
+ * PURPOSE:         Test for memchr
+ */
+
+#include <apitest.h>
+
+#include <string.h>
+#include "guardbuf.h"
+
+static
+void
+Test_Alignment(void)
+{
+    unsigned char Buffer[512];
+    size_t Align, Length, Position;
+    unsigned long Failures = 0;
+    void *Result;
+
+    for (Align = 0; Align < 32; Align++)
+    {
+        for (Length = 0; Length <= 200; Length++)
+        {
+            memset(Buffer, 'a', sizeof(Buffer));
+
+            /* A match right past the end doesn't count */
+            Buffer[Align + Length] = 'x';
+            Result = memchr(Buffer + Align, 'x', Length);
+            if ((Result != NULL) && (Failures++ < 10))
+                ok(0, "memchr at +%lu found a match past %lu bytes\n", (ULONG)Align, (ULONG)Length);
+
+            /* The first match is returned */
+            for (Position = 0; Position < Length; Position += 1 + Position / 8)
+            {
+                Buffer[Align + Position] = 'x';
+                Result = memchr(Buffer + Align, 'x', Length);
+                if ((Result != Buffer + Align + Position) && (Failures++ < 10))
+                {
+                    ok(0, "memchr at +%lu of %lu bytes returned %p, expected %p\n",
+                       (ULONG)Align, (ULONG)Length, Result, Buffer + Align + Position);
+                }
+                Buffer[Align + Position] = 'a';
+            }
+        }
+    }
+    ok(Failures == 0, "memchr: %lu failures\n", Failures);
+
+    /* Only the low byte of the value counts */
+    Buffer[5] = 0x80;
+    ok(memchr(Buffer, 0x180, 10) == Buffer + 5, "memchr didn't truncate the value\n");
+}
+
+static
+void
+Test_PageBoundary(void)
+{
+    unsigned char *Buffer;
+    size_t Length;
+
+    Buffer = AllocateGuarded(2);
+    if (!Buffer)
+        return;
+
+    memset(Buffer, 'a', 2 * GUARD_PAGE_SIZE);
+
+    /* Scanning up to the guard page must not touch it */
+    for (Length = 0; Length <= 2 * GUARD_PAGE_SIZE; Length += (Length < 512) ? 1 : 37)
+    {
+        ok(memchr(Buffer + 2 * GUARD_PAGE_SIZE - Length, 'x', Length) == NULL,
+           "memchr of %lu bytes at the end of a page found something\n", (ULONG)Length);
+        ok(memchr(Buffer, 'x', Length) == NULL,
+           "memchr of %lu bytes at the start of a page found something\n", (ULONG)Length);
+    }
+
+    Buffer[2 * GUARD_PAGE_SIZE - 1] = 'x';
+    for (Length = 1; Length <= 2 * GUARD_PAGE_SIZE; Length += (Length < 512) ? 1 : 37)
+    {
+        ok(memchr(Buffer + 2 * GUARD_PAGE_SIZE - Length, 'x', Length) == Buffer + 2 * GUARD_PAGE_SIZE - 1,
+           "memchr of %lu bytes missed the last byte\n", (ULONG)Length);
+    }
+
+    FreeGuarded(Buffer);
+}
+
+START_TEST(memchr)
+{
+    Test_Alignment();
+    Test_PageBoundary();
+}
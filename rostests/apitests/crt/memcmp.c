@@ -0,0 +1,107 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPLv2+ - See COPYING in the top level directory
+ * PURPOSE:         Test for memcmp
+ */
+
+#include <apitest.h>
+
+#include <string.h>
+#include "guardbuf.h"
+
+static
+int
+Sign(int Value)
+{
+    return (Value > 0) - (Value < 0);
+}
+
+static
+void
+Test_Alignment(void)
+{
+    unsigned char Buffer1[512], Buffer2[512];
+    size_t Align1, Align2, Length, Diff;
+    unsigned long Failures = 0;
+    int Result, Expected;
+
+    for (Align1 = 0; Align1 < 32; Align1++)
+    {
+        for (Align2 = 0; Align2 < 32; Align2 += 3)
+        {
+            for (Length = 0; Length <= 200; Length++)
+            {
+                FillPattern(Buffer1 + Align1, Length, 9);
+                FillPattern(Buffer2 + Align2, Length, 9);
+
+                /* Equal, then differing in either direction at some byte */
+                Result = memcmp(Buffer1 + Align1, Buffer2 + Align2, Length);
+                if ((Result != 0) && (Failures++ < 10))
+                    ok(0, "memcmp of %lu equal bytes returned %d\n", (ULONG)Length, Result);
+
+                if (!Length)
+                    continue;
+
+                Diff = (Align1 * 31 + Align2 * 7 + Length) % Length;
+                Buffer2[Align2 + Diff] = 0x80;
+                Buffer1[Align1 + Diff] = 0x7F;
+                Expected = -1;
+                Result = memcmp(Buffer1 + Align1, Buffer2 + Align2, Length);
+                if ((Sign(Result) != Expected) && (Failures++ < 10))
+                    ok(0, "memcmp of %lu bytes differing at %lu returned %d\n", (ULONG)Length, (ULONG)Diff, Result);
+
+                Result = memcmp(Buffer2 + Align2, Buffer1 + Align1, Length);
+                if ((Sign(Result) != -Expected) && (Failures++ < 10))
+                    ok(0, "memcmp of %lu bytes differing at %lu returned %d\n", (ULONG)Length, (ULONG)Diff, Result);
+            }
+        }
+    }
+    ok(Failures == 0, "memcmp: %lu failures\n", Failures);
+
+    /* Bytes compare as unsigned char */
+    Buffer1[0] = 0x01;
+    Buffer2[0] = 0xFF;
+    ok(memcmp(Buffer1, Buffer2, 1) < 0, "memcmp compared signed bytes\n");
+}
+
+static
+void
+Test_PageBoundary(void)
+{
+    unsigned char *Buffer1, *Buffer2;
+    size_t Length;
+
+    Buffer1 = AllocateGuarded(2);
+    Buffer2 = AllocateGuarded(2);
+    if (!Buffer1 || !Buffer2)
+        return;
+
+    FillPattern(Buffer1, 2 * GUARD_PAGE_SIZE, 11);
+    FillPattern(Buffer2, 2 * GUARD_PAGE_SIZE, 11);
+
+    /* Equal buffers are read to their very end, and not a byte further */
+    for (Length = 0; Length <= 2 * GUARD_PAGE_SIZE; Length += (Length < 512) ? 1 : 37)
+    {
+        ok(memcmp(Buffer1 + 2 * GUARD_PAGE_SIZE - Length, Buffer2 + 2 * GUARD_PAGE_SIZE - Length, Length) == 0,
+           "memcmp of %lu bytes at the end of a page isn't equal\n", (ULONG)Length);
+        ok(memcmp(Buffer1, Buffer2, Length) == 0,
+           "memcmp of %lu bytes at the start of a page isn't equal\n", (ULONG)Length);
+    }
+
+    /* The last byte before the guard page must still be compared */
+    Buffer2[2 * GUARD_PAGE_SIZE - 1]++;
+    for (Length = 1; Length <= 2 * GUARD_PAGE_SIZE; Length += (Length < 512) ? 1 : 37)
+    {
+        ok(memcmp(Buffer1 + 2 * GUARD_PAGE_SIZE - Length, Buffer2 + 2 * GUARD_PAGE_SIZE - Length, Length) < 0,
+           "memcmp of %lu bytes missed the last byte\n", (ULONG)Length);
+    }
+
+    FreeGuarded(Buffer1);
+    FreeGuarded(Buffer2);
+}
+
+START_TEST(memcmp)
+{
+    Test_Alignment();
+    Test_PageBoundary();
+}
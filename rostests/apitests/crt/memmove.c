@@ -0,0 +1,165 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPLv2+ - See COPYING in the top level directory
+ * PURPOSE:         Test for memmove and memcpy
+ */
+
+#include <apitest.h>
+
+#include <string.h>
+#include "guardbuf.h"
+
+typedef void *(__cdecl *PFN_MEMMOVE)(void *, const void *, size_t);
+
+static
+void
+Test_Alignment(PFN_MEMMOVE pmemmove, const char *Name)
+{
+    unsigned char Source[512], Dest[512];
+    size_t SourceAlign, DestAlign, Length, Index;
+    unsigned long Failures = 0;
+    void *Result;
+
+    FillPattern(Source, sizeof(Source), 1);
+
+    /* Every combination of alignments, across all the small size paths */
+    for (SourceAlign = 0; SourceAlign < 32; SourceAlign++)
+    {
+        for (DestAlign = 0; DestAlign < 32; DestAlign++)
+        {
+            for (Length = 0; Length <= 300; Length++)
+            {
+                memset(Dest, 0xCC, sizeof(Dest));
+                Result = pmemmove(Dest + DestAlign, Source + SourceAlign, Length);
+
+                Index = FirstDifference(Dest + DestAlign, Source + SourceAlign, Length);
+                if ((Result != Dest + DestAlign) ||
+                    (Index != Length) ||
+                    (DestAlign && Dest[DestAlign - 1] != 0xCC) ||
+                    (Dest[DestAlign + Length] != 0xCC))
+                {
+                    if (Failures++ < 10)
+                    {
+                        ok(0, "%s: source +%lu, dest +%lu, length %lu: wrong at %lu\n",
+                           Name, (ULONG)SourceAlign, (ULONG)DestAlign, (ULONG)Length, (ULONG)Index);
+                    }
+                }
+            }
+        }
+    }
+    ok(Failures == 0, "%s: %lu failures\n", Name, Failures);
+}
+
+static
+void
+Test_PageBoundary(PFN_MEMMOVE pmemmove, const char *Name)
+{
+    unsigned char *Source, *Dest;
+    size_t Length;
+
+    Source = AllocateGuarded(4);
+    Dest = AllocateGuarded(4);
+    if (!Source || !Dest)
+        return;
+
+    FillPattern(Source, 4 * GUARD_PAGE_SIZE, 3);
+
+    /* Touching a guard page on either end would crash the test */
+    for (Length = 0; Length <= 4 * GUARD_PAGE_SIZE; Length += (Length < 512) ? 1 : 61)
+    {
+        pmemmove(Dest + 4 * GUARD_PAGE_SIZE - Length, Source + 4 * GUARD_PAGE_SIZE - Length, Length);
+        ok(FirstDifference(Dest + 4 * GUARD_PAGE_SIZE - Length, Source + 4 * GUARD_PAGE_SIZE - Length, Length) == Length,
+           "%s: copy of %lu bytes at the end of a page is wrong\n", Name, (ULONG)Length);
+
+        pmemmove(Dest, Source, Length);
+        ok(FirstDifference(Dest, Source, Length) == Length,
+           "%s: copy of %lu bytes at the start of a page is wrong\n", Name, (ULONG)Length);
+    }
+
+    FreeGuarded(Source);
+    FreeGuarded(Dest);
+}
+
+static
+void
+Test_Overlap(void)
+{
+    unsigned char Buffer[0x3000], Expected[0x3000];
+    size_t Length, Offset, Index, i;
+    unsigned long Failures = 0;
+    int Shift;
+
+    /* Overlapping moves in both directions, including the rep movsb sizes */
+    for (i = 0; i < 4000; i++)
+    {
+        Length = (i < 2000) ? (GuardRandom() % 600) : (GuardRandom() % 0x2000);
+        Shift = (int)(GuardRandom() % 161) - 80;
+        Offset = 80 + GuardRandom() % 64;
+
+        FillPattern(Buffer, sizeof(Buffer), (unsigned char)i);
+        FillPattern(Expected, sizeof(Expected), (unsigned char)i);
+        for (Index = 0; Index < Length; Index++)
+        {
+            if (Shift > 0)
+                Expected[Offset + Shift + Length - 1 - Index] = Expected[Offset + Length - 1 - Index];
+            else
+                Expected[Offset + Shift + Index] = Expected[Offset + Index];
+        }
+
+        memmove(Buffer + Offset + Shift, Buffer + Offset, Length);
+
+        Index = FirstDifference(Buffer, Expected, sizeof(Buffer));
+        if ((Index != sizeof(Buffer)) && (Failures++ < 10))
+        {
+            ok(0, "memmove of %lu bytes by %d is wrong at %lu\n", (ULONG)Length, Shift, (ULONG)Index);
+        }
+    }
+    ok(Failures == 0, "memmove: %lu overlap failures\n", Failures);
+}
+
+static
+void
+Test_Random(PFN_MEMMOVE pmemmove, const char *Name)
+{
+    unsigned char *Source, *Dest;
+    size_t SourceOffset, DestOffset, Length, Index, i;
+    unsigned long Failures = 0;
+
+    Source = AllocateGuarded(32);
+    Dest = AllocateGuarded(32);
+    if (!Source || !Dest)
+        return;
+
+    FillPattern(Source, 32 * GUARD_PAGE_SIZE, 5);
+
+    /* Random sizes and offsets up to well past the rep movsb threshold */
+    for (i = 0; i < 2000; i++)
+    {
+        Length = GuardRandom() % (24 * GUARD_PAGE_SIZE);
+        SourceOffset = GuardRandom() % (32 * GUARD_PAGE_SIZE - Length + 1);
+        DestOffset = GuardRandom() % (32 * GUARD_PAGE_SIZE - Length + 1);
+
+        pmemmove(Dest + DestOffset, Source + SourceOffset, Length);
+        Index = FirstDifference(Dest + DestOffset, Source + SourceOffset, Length);
+        if ((Index != Length) && (Failures++ < 10))
+        {
+            ok(0, "%s: %lu bytes from +%lu to +%lu wrong at %lu\n",
+               Name, (ULONG)Length, (ULONG)SourceOffset, (ULONG)DestOffset, (ULONG)Index);
+        }
+    }
+    ok(Failures == 0, "%s: %lu random copy failures\n", Name, Failures);
+
+    FreeGuarded(Source);
+    FreeGuarded(Dest);
+}
+
+START_TEST(memmove)
+{
+    Test_Alignment(memmove, "memmove");
+    Test_Alignment(memcpy, "memcpy");
+    Test_PageBoundary(memmove, "memmove");
+    Test_PageBoundary(memcpy, "memcpy");
+    Test_Overlap();
+    Test_Random(memmove, "memmove");
+    Test_Random(memcpy, "memcpy");
+}
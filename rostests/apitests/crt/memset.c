@@ -0,0 +1,107 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPLv2+ - See COPYING in the top level directory
+ * PURPOSE:         Test for memset
+ */
+
+#include <apitest.h>
+
+#include <string.h>
+#include "guardbuf.h"
+
+static
+int
+IsFilled(const unsigned char *Buffer, size_t Length, unsigned char Value)
+{
+    size_t i;
+
+    for (i = 0; i < Length; i++)
+    {
+        if (Buffer[i] != Value)
+            return 0;
+    }
+    return 1;
+}
+
+static
+void
+Test_Alignment(void)
+{
+    unsigned char Buffer[512];
+    size_t Align, Length;
+    unsigned long Failures = 0;
+    void *Result;
+
+    for (Align = 0; Align < 64; Align++)
+    {
+        for (Length = 0; Length <= 400; Length++)
+        {
+            memset(Buffer, 0xCC, sizeof(Buffer));
+            Result = memset(Buffer + Align, 0x5A, Length);
+
+            /* Only the bytes asked for may change */
+            if ((Result != Buffer + Align) ||
+                !IsFilled(Buffer, Align, 0xCC) ||
+                !IsFilled(Buffer + Align, Length, 0x5A) ||
+                !IsFilled(Buffer + Align + Length, sizeof(Buffer) - Align - Length, 0xCC))
+            {
+                if (Failures++ < 10)
+                    ok(0, "memset at +%lu of %lu bytes is wrong\n", (ULONG)Align, (ULONG)Length);
+            }
+        }
+    }
+    ok(Failures == 0, "memset: %lu failures\n", Failures);
+
+    /* Only the low byte of the value counts */
+    memset(Buffer, 0x1234, sizeof(Buffer));
+    ok(IsFilled(Buffer, sizeof(Buffer), 0x34), "memset didn't truncate the value\n");
+}
+
+static
+void
+Test_PageBoundary(void)
+{
+    unsigned char *Buffer;
+    size_t Length, Offset, i;
+    unsigned long Failures = 0;
+
+    Buffer = AllocateGuarded(32);
+    if (!Buffer)
+        return;
+
+    for (Length = 0; Length <= 4 * GUARD_PAGE_SIZE; Length += (Length < 512) ? 1 : 61)
+    {
+        memset(Buffer + 32 * GUARD_PAGE_SIZE - Length, 0xA5, Length);
+        ok(IsFilled(Buffer + 32 * GUARD_PAGE_SIZE - Length, Length, 0xA5),
+           "memset of %lu bytes at the end of a page is wrong\n", (ULONG)Length);
+        memset(Buffer, 0x3C, Length);
+        ok(IsFilled(Buffer, Length, 0x3C),
+           "memset of %lu bytes at the start of a page is wrong\n", (ULONG)Length);
+    }
+
+    /* Random sizes and offsets up to well past the rep stosb threshold */
+    for (i = 0; i < 1000; i++)
+    {
+        Length = GuardRandom() % (24 * GUARD_PAGE_SIZE);
+        Offset = GuardRandom() % (32 * GUARD_PAGE_SIZE - Length + 1);
+
+        memset(Buffer, 0, 32 * GUARD_PAGE_SIZE);
+        memset(Buffer + Offset, (int)i | 1, Length);
+        if ((!IsFilled(Buffer, Offset, 0) ||
+             !IsFilled(Buffer + Offset, Length, (unsigned char)(i | 1)) ||
+             !IsFilled(Buffer + Offset + Length, 32 * GUARD_PAGE_SIZE - Offset - Length, 0)) &&
+            (Failures++ < 10))
+        {
+            ok(0, "memset at +%lu of %lu bytes is wrong\n", (ULONG)Offset, (ULONG)Length);
+        }
+    }
+    ok(Failures == 0, "memset: %lu random failures\n", Failures);
+
+    FreeGuarded(Buffer);
+}
+
+START_TEST(memset)
+{
+    Test_Alignment();
+    Test_PageBoundary();
+}
@@ -0,0 +1,229 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPLv2+ - See COPYING in the top level directory
+ * PURPOSE:         Timing of the mem* and str* routines against plain C loops
+ */
+
+#include <apitest.h>
+
+#include <string.h>
+#include "guardbuf.h"
+
+/* Keep GCC from turning the reference loops back into library calls */
+#ifdef __GNUC__
+#define PLAIN_LOOP __attribute__((noinline, optimize("no-tree-loop-distribute-patterns")))
+#else
+#define PLAIN_LOOP __declspec(noinline)
+#endif
+
+/* The portable C versions, one element at a time */
+static PLAIN_LOOP void *Plain_memcpy(void *Dest, const void *Source, size_t Length)
+{
+    unsigned char *d = Dest;
+    const unsigned char *s = Source;
+    while (Length--) *d++ = *s++;
+    return Dest;
+}
+
+static PLAIN_LOOP void *Plain_memset(void *Dest, int Value, size_t Length)
+{
+    unsigned char *d = Dest;
+    while (Length--) *d++ = (unsigned char)Value;
+    return Dest;
+}
+
+static PLAIN_LOOP int Plain_memcmp(const void *Buffer1, const void *Buffer2, size_t Length)
+{
+    const unsigned char *p1 = Buffer1, *p2 = Buffer2;
+    for (; Length; Length--, p1++, p2++)
+    {
+        if (*p1 != *p2) return *p1 - *p2;
+    }
+    return 0;
+}
+
+static PLAIN_LOOP void *Plain_memchr(const void *Buffer, int Value, size_t Length)
+{
+    const unsigned char *p = Buffer;
+    for (; Length; Length--, p++)
+    {
+        if (*p == (unsigned char)Value) return (void *)p;
+    }
+    return NULL;
+}
+
+static PLAIN_LOOP size_t Plain_strlen(const char *String)
+{
+    const char *p = String;
+    while (*p) p++;
+    return p - String;
+}
+
+static PLAIN_LOOP char *Plain_strchr(const char *String, int Char)
+{
+    for (; *String != (char)Char; String++)
+    {
+        if (!*String) return NULL;
+    }
+    return (char *)String;
+}
+
+static PLAIN_LOOP size_t Plain_wcslen(const wchar_t *String)
+{
+    const wchar_t *p = String;
+    while (*p) p++;
+    return p - String;
+}
+
+static PLAIN_LOOP wchar_t *Plain_wcschr(const wchar_t *String, wchar_t Char)
+{
+    for (; *String != Char; String++)
+    {
+        if (!*String) return NULL;
+    }
+    return (wchar_t *)String;
+}
+
+typedef enum _TIMED_ROUTINE
+{
+    Timed_memcpy,
+    Timed_memset,
+    Timed_memcmp,
+    Timed_memchr,
+    Timed_strlen,
+    Timed_strchr,
+    Timed_wcslen,
+    Timed_wcschr,
+    Timed_Max
+} TIMED_ROUTINE;
+
+static const char *RoutineNames[Timed_Max] =
+{
+    "memcpy", "memset", "memcmp", "memchr", "strlen", "strchr", "wcslen", "wcschr",
+};
+
+static unsigned char *Source, *Dest;
+static volatile size_t Sink;
+
+static
+void
+RunRoutine(TIMED_ROUTINE Routine, int Plain, size_t Length)
+{
+    switch (Routine)
+    {
+        case Timed_memcpy:
+            Sink = (size_t)(Plain ? Plain_memcpy(Dest, Source, Length) : memcpy(Dest, Source, Length));
+            break;
+        case Timed_memset:
+            Sink = (size_t)(Plain ? Plain_memset(Dest, 0x5a, Length) : memset(Dest, 0x5a, Length));
+            break;
+        case Timed_memcmp:
+            Sink = Plain ? Plain_memcmp(Dest, Source, Length) : memcmp(Dest, Source, Length);
+            break;
+        case Timed_memchr:
+            Sink = (size_t)(Plain ? Plain_memchr(Source, 0, Length) : memchr(Source, 0, Length));
+            break;
+        case Timed_strlen:
+            Sink = Plain ? Plain_strlen((char *)Source) : strlen((char *)Source);
+            break;
+        case Timed_strchr:
+            Sink = (size_t)(Plain ? Plain_strchr((char *)Source, 'b') : strchr((char *)Source, 'b'));
+            break;
+        case Timed_wcslen:
+            Sink = Plain ? Plain_wcslen((wchar_t *)Source) : wcslen((wchar_t *)Source);
+            break;
+        case Timed_wcschr:
+            Sink = (size_t)(Plain ? Plain_wcschr((wchar_t *)Source, L'b') : wcschr((wchar_t *)Source, L'b'));
+            break;
+        default:
+            break;
+    }
+}
+
+/* Sets up the buffers so that every routine walks Length bytes */
+static
+void
+PrepareBuffers(TIMED_ROUTINE Routine, size_t Length)
+{
+    memset(Source, 'a', Length + sizeof(wchar_t));
+    memset(Dest, 'a', Length + sizeof(wchar_t));
+
+    if ((Routine == Timed_wcslen) || (Routine == Timed_wcschr))
+    {
+        wchar_t *String = (wchar_t *)Source;
+        size_t i;
+
+        for (i = 0; i < Length / sizeof(wchar_t); i++)
+            String[i] = L'a';
+        String[i] = 0;
+    }
+    else
+    {
+        Source[Length] = 0;
+    }
+}
+
+/* Best of a few rounds, in nanoseconds per call */
+static
+ULONGLONG
+TimeRoutine(TIMED_ROUTINE Routine, int Plain, size_t Length, ULONG Iterations)
+{
+    LARGE_INTEGER Frequency, Start, End;
+    ULONGLONG Best = ~0ULL, Elapsed;
+    ULONG Round, i;
+
+    QueryPerformanceFrequency(&Frequency);
+    RunRoutine(Routine, Plain, Length);
+
+    for (Round = 0; Round < 5; Round++)
+    {
+        QueryPerformanceCounter(&Start);
+        for (i = 0; i < Iterations; i++)
+            RunRoutine(Routine, Plain, Length);
+        QueryPerformanceCounter(&End);
+
+        Elapsed = (End.QuadPart - Start.QuadPart) * 1000000000ULL / Frequency.QuadPart / Iterations;
+        if (Elapsed < Best)
+            Best = Elapsed;
+    }
+
+    return Best;
+}
+
+START_TEST(memstr_timing)
+{
+    static const size_t Lengths[] = { 16, 64, 256, 4096, 65536 };
+    ULONGLONG Optimized, Plain;
+    ULONG Iterations, i;
+    TIMED_ROUTINE Routine;
+
+    Source = AllocateGuarded(Lengths[RTL_NUMBER_OF(Lengths) - 1] / GUARD_PAGE_SIZE + 1);
+    Dest = AllocateGuarded(Lengths[RTL_NUMBER_OF(Lengths) - 1] / GUARD_PAGE_SIZE + 1);
+    if (!Source || !Dest)
+        return;
+
+    for (Routine = 0; Routine < Timed_Max; Routine++)
+    {
+        for (i = 0; i < RTL_NUMBER_OF(Lengths); i++)
+        {
+            Iterations = (ULONG)(4 * 1024 * 1024 / Lengths[i]);
+            PrepareBuffers(Routine, Lengths[i]);
+
+            Optimized = TimeRoutine(Routine, 0, Lengths[i], Iterations);
+            Plain = TimeRoutine(Routine, 1, Lengths[i], Iterations);
+            trace("%s of %lu bytes: %I64u ns, plain C loop %I64u ns\n",
+                  RoutineNames[Routine], (ULONG)Lengths[i], Optimized, Plain);
+
+            /* Small sizes are mostly call overhead, only catch gross slowdowns on large ones */
+            if (Lengths[i] >= 4096)
+            {
+                ok(Optimized <= 2 * Plain + 100,
+                   "%s of %lu bytes took %I64u ns, the plain C loop %I64u ns\n",
+                   RoutineNames[Routine], (ULONG)Lengths[i], Optimized, Plain);
+            }
+        }
+    }
+
+    FreeGuarded(Source);
+    FreeGuarded(Dest);
+}
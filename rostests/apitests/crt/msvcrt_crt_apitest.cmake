@@ -1120,13 +1120,14 @@ list(APPEND SOURCE_MSVCRT
     mbstowcs.c
 #    mbstowcs_s Not exported in 2k3 Sp1
 #    mbtowc.c
-#    memchr.c
-#    memcmp.c
-#    memcpy.c
+    memchr.c
+    memcmp.c
+    # memcpy is tested along with memmove
 #    memcpy_s.c memmove_s
-#    memmove.c
+    memmove.c
 #    memmove_s.c
-#    memset.c
+    memset.c
+    memstr_timing.c
 #    mktime.c
 #    modf.c
 #    perror.c
@@ -1164,7 +1165,7 @@ list(APPEND SOURCE_MSVCRT
 #    sscanf_s.c
 #    strcat.c
 #    strcat_s.c
-#    strchr.c
+    strchr.c
 #    strcmp.c
 #    strcoll.c
     strcpy.c
@@ -1226,14 +1227,14 @@ list(APPEND SOURCE_MSVCRT
 #    wcrtomb_s
 #    wcscat.c
 #    wcscat_s.c
-#    wcschr.c
+    wcschr.c
 #    wcscmp.c
 #    wcscoll.c
 #    wcscpy.c
 #    wcscpy_s.c
 #    wcscspn.c
 #    wcsftime.c
-#    wcslen.c
+    wcslen.c
 #    wcsncat.c
 #    wcsncat_s.c
 #    wcsncmp.c
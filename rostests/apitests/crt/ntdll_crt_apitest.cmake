@@ -72,11 +72,12 @@ list(APPEND SOURCE_NTDLL
 #    labs.c
 #    log.c
     mbstowcs.c
-#    memchr.c
-#    memcmp.c
+    memchr.c
+    memcmp.c
     # memcpy == memmove
-#    memmove.c
-#    memset.c
+    memmove.c
+    memset.c
+    memstr_timing.c
 #    pow.c
 #    qsort.c
 #    sin.c
@@ -84,7 +85,7 @@ list(APPEND SOURCE_NTDLL
 #    sqrt.c
 #    sscanf.c
 #    strcat.c
-#    strchr.c
+    strchr.c
 #    strcmp.c
     strcpy.c
 #    strcspn.c
@@ -106,11 +107,11 @@ list(APPEND SOURCE_NTDLL
 #    towupper.c
 #    vsprintf.c
 #    wcscat.c
-#    wcschr.c
+    wcschr.c
 #    wcscmp.c
 #    wcscpy.c
 #    wcscspn.c
-#    wcslen.c
+    wcslen.c
 #    wcsncat.c
 #    wcsncmp.c
 #    wcsncpy.c
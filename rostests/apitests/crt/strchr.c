@@ -0,0 +1,89 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPLv2+ - See COPYING in the top level directory
+ * PURPOSE:         Test for strchr
+ */
+
+#include <apitest.h>
+
+#include <string.h>
+#include "guardbuf.h"
+
+static
+void
+Test_Alignment(void)
+{
+    char Buffer[512];
+    size_t Align, Length, Position;
+    unsigned long Failures = 0;
+    char *Result;
+
+    for (Align = 0; Align < 32; Align++)
+    {
+        for (Length = 0; Length <= 200; Length++)
+        {
+            memset(Buffer, 'x', sizeof(Buffer));
+            memset(Buffer + Align, 'a', Length);
+            Buffer[Align + Length] = 0;
+
+            /* Nothing past the terminator may be found */
+            Result = strchr(Buffer + Align, 'x');
+            if ((Result != NULL) && (Failures++ < 10))
+                ok(0, "strchr at +%lu of %lu chars found a match past the end\n", (ULONG)Align, (ULONG)Length);
+
+            /* But the terminator itself can */
+            Result = strchr(Buffer + Align, 0);
+            if ((Result != Buffer + Align + Length) && (Failures++ < 10))
+                ok(0, "strchr at +%lu of %lu chars didn't find the terminator\n", (ULONG)Align, (ULONG)Length);
+
+            for (Position = 0; Position < Length; Position += 1 + Position / 8)
+            {
+                Buffer[Align + Position] = 'x';
+                Result = strchr(Buffer + Align, 'x');
+                if ((Result != Buffer + Align + Position) && (Failures++ < 10))
+                {
+                    ok(0, "strchr at +%lu of %lu chars returned %p, expected %p\n",
+                       (ULONG)Align, (ULONG)Length, Result, Buffer + Align + Position);
+                }
+                Buffer[Align + Position] = 'a';
+            }
+        }
+    }
+    ok(Failures == 0, "strchr: %lu failures\n", Failures);
+
+    /* The character is converted to char */
+    strcpy(Buffer, "ab\x80z");
+    ok(strchr(Buffer, 0x180) == Buffer + 2, "strchr didn't truncate the character\n");
+    ok(strchr(Buffer, (char)0x80) == Buffer + 2, "strchr didn't find a high character\n");
+}
+
+static
+void
+Test_PageBoundary(void)
+{
+    char *Buffer;
+    size_t Length;
+
+    Buffer = (char *)AllocateGuarded(2);
+    if (!Buffer)
+        return;
+
+    /* The terminator is the last byte before the guard page */
+    memset(Buffer, 'a', 2 * GUARD_PAGE_SIZE);
+    Buffer[2 * GUARD_PAGE_SIZE - 1] = 0;
+    for (Length = 0; Length < 2 * GUARD_PAGE_SIZE; Length += (Length < 512) ? 1 : 37)
+    {
+        ok(strchr(Buffer + 2 * GUARD_PAGE_SIZE - 1 - Length, 'x') == NULL,
+           "strchr of %lu chars at the end of a page found something\n", (ULONG)Length);
+        ok(strchr(Buffer + 2 * GUARD_PAGE_SIZE - 1 - Length, 0) == Buffer + 2 * GUARD_PAGE_SIZE - 1,
+           "strchr of %lu chars at the end of a page missed the terminator\n", (ULONG)Length);
+    }
+
+    FreeGuarded((unsigned char *)Buffer);
+}
+
+START_TEST(strchr)
+{
+    Test_Alignment();
+    Test_PageBoundary();
+}
@@ -12,6 +12,7 @@
 #include <pseh/pseh2.h>
 #include <ntstatus.h>
 typedef _Return_type_success_(return >= 0) long NTSTATUS, *PNTSTATUS;
+#include "guardbuf.h"
 
 #ifdef __GNUC__
 #pragma GCC diagnostic ignored "-Wnonnull"
@@ -63,8 +64,57 @@ Test_strlen(PFN_STRLEN pstrlen)
 #endif
 }
 
+static
+void
+Test_Alignment(void)
+{
+    char Buffer[512];
+    size_t Align, Length, Result;
+    unsigned long Failures = 0;
+
+    for (Align = 0; Align < 32; Align++)
+    {
+        for (Length = 0; Length <= 300; Length++)
+        {
+            memset(Buffer, 'x', sizeof(Buffer));
+            memset(Buffer + Align, 'a', Length);
+            Buffer[Align + Length] = 0;
+
+            Result = strlen(Buffer + Align);
+            if ((Result != Length) && (Failures++ < 10))
+                ok(0, "strlen at +%lu returned %lu, expected %lu\n", (ULONG)Align, (ULONG)Result, (ULONG)Length);
+        }
+    }
+    ok(Failures == 0, "strlen: %lu failures\n", Failures);
+}
+
+static
+void
+Test_PageBoundary(void)
+{
+    char *Buffer;
+    size_t Length;
+
+    Buffer = (char *)AllocateGuarded(2);
+    if (!Buffer)
+        return;
+
+    /* The terminator is the last byte before the guard page */
+    memset(Buffer, 'a', 2 * GUARD_PAGE_SIZE);
+    Buffer[2 * GUARD_PAGE_SIZE - 1] = 0;
+    for (Length = 0; Length < 2 * GUARD_PAGE_SIZE; Length += (Length < 512) ? 1 : 37)
+    {
+        ok(strlen(Buffer + 2 * GUARD_PAGE_SIZE - 1 - Length) == Length,
+           "strlen of %lu chars at the end of a page failed\n", (ULONG)Length);
+    }
+
+    FreeGuarded((unsigned char *)Buffer);
+}
+
 START_TEST(strlen)
 {
+    Test_Alignment();
+    Test_PageBoundary();
     Test_strlen(strlen);
 #ifdef __GNUC__
     Test_strlen(GCC_builtin_strlen);
@@ -17,11 +17,21 @@ extern void func__snwprintf(void);
 extern void func__vsnprintf(void);
 extern void func__vsnwprintf(void);
 extern void func_mbstowcs(void);
+extern void func_memchr(void);
+extern void func_memcmp(void);
+extern void func_memmove(void);
+extern void func_memset(void);
+#if defined(TEST_NTDLL) || defined(TEST_MSVCRT)
+extern void func_memstr_timing(void);
+#endif
 extern void func_sprintf(void);
+extern void func_strchr(void);
 extern void func_strcpy(void);
 extern void func_strlen(void);
 extern void func_strnlen(void);
 extern void func_strtoul(void);
+extern void func_wcschr(void);
+extern void func_wcslen(void);
 extern void func_wcsnlen(void);
 extern void func_wcstombs(void);
 extern void func_wcstoul(void);
@@ -35,12 +45,22 @@ const struct test winetest_testlist[] =
     { "_vsnprintf", func__vsnprintf },
     { "_vsnwprintf", func__vsnwprintf },
     { "mbstowcs", func_mbstowcs },
+    { "memchr", func_memchr },
+    { "memcmp", func_memcmp },
+    { "memmove", func_memmove },
+    { "memset", func_memset },
+#if defined(TEST_NTDLL) || defined(TEST_MSVCRT)
+    { "memstr_timing", func_memstr_timing },
+#endif
     { "_snprintf", func__snprintf },
     { "_snwprintf", func__snwprintf },
     { "sprintf", func_sprintf },
+    { "strchr", func_strchr },
     { "strcpy", func_strcpy },
     { "strlen", func_strlen },
     { "strtoul", func_strtoul },
+    { "wcschr", func_wcschr },
+    { "wcslen", func_wcslen },
     { "wcstoul", func_wcstoul },
     { "wcstombs", func_wcstombs },
 #if defined(TEST_CRTDLL) || defined(TEST_MSVCRT) || defined(TEST_STATIC_CRT)
@@ -0,0 +1,105 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPLv2+ - See COPYING in the top level directory
+ * PURPOSE:         Test for wcschr
+ */
+
+#include <apitest.h>
+
+#include <string.h>
+#include "guardbuf.h"
+
+static
+void
+SetChar(wchar_t *String, size_t Index, wchar_t Char)
+{
+    /* The string may be at an odd address */
+    memcpy(&String[Index], &Char, sizeof(Char));
+}
+
+static
+void
+Test_Alignment(void)
+{
+    unsigned char Buffer[1024];
+    wchar_t *String, *Result;
+    size_t Align, Length, Position, i;
+    unsigned long Failures = 0;
+
+    for (Align = 0; Align < 32; Align++)
+    {
+        String = (wchar_t *)(Buffer + Align);
+        for (Length = 0; Length <= 200; Length++)
+        {
+            for (i = 0; i < Length; i++)
+                SetChar(String, i, L'a');
+            SetChar(String, Length, 0);
+            SetChar(String, Length + 1, L'x');
+
+            /* Nothing past the terminator may be found, but the terminator can */
+            Result = wcschr(String, L'x');
+            if ((Result != NULL) && (Failures++ < 10))
+                ok(0, "wcschr at +%lu of %lu chars found a match past the end\n", (ULONG)Align, (ULONG)Length);
+            Result = wcschr(String, 0);
+            if ((Result != String + Length) && (Failures++ < 10))
+                ok(0, "wcschr at +%lu of %lu chars didn't find the terminator\n", (ULONG)Align, (ULONG)Length);
+
+            /* Only whole characters match, not their halves */
+            Result = wcschr(String, L'a' << 8);
+            if ((Result != NULL) && (Failures++ < 10))
+                ok(0, "wcschr at +%lu of %lu chars matched across characters\n", (ULONG)Align, (ULONG)Length);
+
+            for (Position = 0; Position < Length; Position += 1 + Position / 8)
+            {
+                SetChar(String, Position, L'x');
+                Result = wcschr(String, L'x');
+                if ((Result != String + Position) && (Failures++ < 10))
+                {
+                    ok(0, "wcschr at +%lu of %lu chars returned %p, expected %p\n",
+                       (ULONG)Align, (ULONG)Length, Result, String + Position);
+                }
+                SetChar(String, Position, L'a');
+            }
+        }
+    }
+    ok(Failures == 0, "wcschr: %lu failures\n", Failures);
+}
+
+static
+void
+Test_PageBoundary(void)
+{
+    unsigned char *Buffer, *End;
+    wchar_t *String;
+    size_t Length, Odd, i;
+
+    Buffer = AllocateGuarded(2);
+    if (!Buffer)
+        return;
+
+    /* The terminator is right in front of the guard page */
+    for (Odd = 0; Odd <= 1; Odd++)
+    {
+        End = Buffer + 2 * GUARD_PAGE_SIZE - Odd;
+        for (Length = 0; Length < GUARD_PAGE_SIZE - 1; Length += (Length < 300) ? 1 : 37)
+        {
+            String = (wchar_t *)(End - (Length + 1) * sizeof(wchar_t));
+            for (i = 0; i < Length; i++)
+                SetChar(String, i, L'a');
+            SetChar(String, Length, 0);
+
+            ok(wcschr(String, L'x') == NULL, "wcschr of %lu chars at the end of a page (odd %lu) found something\n",
+               (ULONG)Length, (ULONG)Odd);
+            ok(wcschr(String, 0) == String + Length, "wcschr of %lu chars at the end of a page (odd %lu) missed the terminator\n",
+               (ULONG)Length, (ULONG)Odd);
+        }
+    }
+
+    FreeGuarded(Buffer);
+}
+
+START_TEST(wcschr)
+{
+    Test_Alignment();
+    Test_PageBoundary();
+}
@@ -0,0 +1,79 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPLv2+ - See COPYING in the top level directory
+ * PURPOSE:         Test for wcslen
+ */
+
+#include <apitest.h>
+
+#include <string.h>
+#include "guardbuf.h"
+
+static
+void
+Test_Alignment(void)
+{
+    unsigned char Buffer[1024];
+    wchar_t *String;
+    size_t Align, Length, i;
+    unsigned long Failures = 0;
+    size_t Result;
+
+    /* Odd addresses too, they happen with packed structures */
+    for (Align = 0; Align < 32; Align++)
+    {
+        String = (wchar_t *)(Buffer + Align);
+        for (Length = 0; Length <= 300; Length++)
+        {
+            memset(Buffer, 0xAA, sizeof(Buffer));
+            for (i = 0; i < Length; i++)
+                memcpy(&String[i], L"\x4100", sizeof(wchar_t));
+            memset(&String[Length], 0, sizeof(wchar_t));
+
+            Result = wcslen(String);
+            if ((Result != Length) && (Failures++ < 10))
+                ok(0, "wcslen at +%lu returned %lu, expected %lu\n", (ULONG)Align, (ULONG)Result, (ULONG)Length);
+        }
+    }
+    ok(Failures == 0, "wcslen: %lu failures\n", Failures);
+
+    /* A zero byte is not a terminator */
+    ok_int((int)wcslen(L"\x0100\x0001\x1000"), 3);
+}
+
+static
+void
+Test_PageBoundary(void)
+{
+    unsigned char *Buffer, *End;
+    wchar_t *String;
+    size_t Length, Odd, i;
+
+    Buffer = AllocateGuarded(2);
+    if (!Buffer)
+        return;
+
+    /* The terminator is right in front of the guard page */
+    for (Odd = 0; Odd <= 1; Odd++)
+    {
+        End = Buffer + 2 * GUARD_PAGE_SIZE - Odd;
+        for (Length = 0; Length < GUARD_PAGE_SIZE - 1; Length += (Length < 300) ? 1 : 37)
+        {
+            String = (wchar_t *)(End - (Length + 1) * sizeof(wchar_t));
+            for (i = 0; i < Length; i++)
+                memcpy(&String[i], L"b", sizeof(wchar_t));
+            memset(&String[Length], 0, sizeof(wchar_t));
+
+            ok(wcslen(String) == Length, "wcslen of %lu chars at the end of a page (odd %lu) failed\n",
+               (ULONG)Length, (ULONG)Odd);
+        }
+    }
+
+    FreeGuarded(Buffer);
+}
+
+START_TEST(wcslen)
+{
+    Test_Alignment();
+    Test_PageBoundary();
+}
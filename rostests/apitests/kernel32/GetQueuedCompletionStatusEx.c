@@ -0,0 +1,171 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPLv2+ - See COPYING in the top level directory
+ * PURPOSE:         Test for GetQueuedCompletionStatusEx
+ */
+
+#undef _WIN32_WINNT
+#define _WIN32_WINNT 0x0600
+
+#include <apitest.h>
+
+#define WIN32_NO_STATUS
+#include <ndk/psfuncs.h>
+
+typedef BOOL (WINAPI *PFN_GETQUEUEDCOMPLETIONSTATUSEX)(HANDLE, LPOVERLAPPED_ENTRY, ULONG, PULONG, DWORD, BOOL);
+
+static PFN_GETQUEUEDCOMPLETIONSTATUSEX pGetQueuedCompletionStatusEx;
+static LONG ApcCount;
+
+static
+VOID
+CALLBACK
+TestApc(ULONG_PTR Parameter)
+{
+    InterlockedIncrement(&ApcCount);
+}
+
+static
+void
+Test_Batch(HANDLE Port)
+{
+    OVERLAPPED_ENTRY Entries[8];
+    OVERLAPPED Overlapped[5];
+    ULONG Removed, i;
+    BOOL Ret;
+
+    for (i = 0; i < 5; i++)
+    {
+        ok(PostQueuedCompletionStatus(Port, 100 + i, 10 + i, &Overlapped[i]),
+           "PostQueuedCompletionStatus failed: %lu\n", GetLastError());
+    }
+
+    /* Only as many as asked for, in the order they were queued */
+    Removed = 0xdeadbeef;
+    Ret = pGetQueuedCompletionStatusEx(Port, Entries, 3, &Removed, 0, FALSE);
+    ok(Ret == TRUE, "Ret = %d, error %lu\n", Ret, GetLastError());
+    ok(Removed == 3, "Removed = %lu\n", Removed);
+    for (i = 0; i < 3 && i < Removed; i++)
+    {
+        ok(Entries[i].lpCompletionKey == 10 + i, "Entry %lu: key %Iu\n", i, Entries[i].lpCompletionKey);
+        ok(Entries[i].lpOverlapped == &Overlapped[i], "Entry %lu: overlapped %p\n", i, Entries[i].lpOverlapped);
+        ok(Entries[i].dwNumberOfBytesTransferred == 100 + i, "Entry %lu: bytes %lu\n", i, Entries[i].dwNumberOfBytesTransferred);
+    }
+
+    /* The rest, without waiting for more */
+    Removed = 0xdeadbeef;
+    Ret = pGetQueuedCompletionStatusEx(Port, Entries, 8, &Removed, INFINITE, FALSE);
+    ok(Ret == TRUE, "Ret = %d, error %lu\n", Ret, GetLastError());
+    ok(Removed == 2, "Removed = %lu\n", Removed);
+    ok(Entries[0].lpCompletionKey == 13, "Entry 0: key %Iu\n", Entries[0].lpCompletionKey);
+    ok(Entries[1].lpCompletionKey == 14, "Entry 1: key %Iu\n", Entries[1].lpCompletionKey);
+}
+
+static
+void
+Test_Timeout(HANDLE Port)
+{
+    OVERLAPPED_ENTRY Entries[4];
+    ULONG Removed;
+    DWORD Start, Elapsed;
+    BOOL Ret;
+
+    SetLastError(0xdeadbeef);
+    Removed = 0xdeadbeef;
+    Ret = pGetQueuedCompletionStatusEx(Port, Entries, 4, &Removed, 0, FALSE);
+    ok(Ret == FALSE, "Ret = %d\n", Ret);
+    ok(GetLastError() == WAIT_TIMEOUT, "Error %lu\n", GetLastError());
+    ok(Removed == 0, "Removed = %lu\n", Removed);
+
+    Start = GetTickCount();
+    SetLastError(0xdeadbeef);
+    Ret = pGetQueuedCompletionStatusEx(Port, Entries, 4, &Removed, 200, FALSE);
+    Elapsed = GetTickCount() - Start;
+    ok(Ret == FALSE, "Ret = %d\n", Ret);
+    ok(GetLastError() == WAIT_TIMEOUT, "Error %lu\n", GetLastError());
+    ok(Elapsed >= 150 && Elapsed < 2000, "Waited %lu ms\n", Elapsed);
+
+    /* Zero entries is invalid */
+    SetLastError(0xdeadbeef);
+    Ret = pGetQueuedCompletionStatusEx(Port, Entries, 0, &Removed, 0, FALSE);
+    ok(Ret == FALSE, "Ret = %d\n", Ret);
+    ok(GetLastError() == ERROR_INVALID_PARAMETER, "Error %lu\n", GetLastError());
+}
+
+static
+void
+Test_Alertable(HANDLE Port)
+{
+    OVERLAPPED_ENTRY Entries[4];
+    ULONG Removed;
+    NTSTATUS Status;
+    BOOL Ret;
+
+    /* A queued APC ends an alertable wait */
+    ApcCount = 0;
+    ok(QueueUserAPC(TestApc, GetCurrentThread(), 0), "QueueUserAPC failed: %lu\n", GetLastError());
+    SetLastError(0xdeadbeef);
+    Removed = 0xdeadbeef;
+    Ret = pGetQueuedCompletionStatusEx(Port, Entries, 4, &Removed, 5000, TRUE);
+    ok(Ret == FALSE, "Ret = %d\n", Ret);
+    ok(GetLastError() == WAIT_IO_COMPLETION, "Error %lu\n", GetLastError());
+    ok(Removed == 0, "Removed = %lu\n", Removed);
+    ok(ApcCount == 1, "ApcCount = %ld\n", ApcCount);
+
+    /* But not a non-alertable one, the APC stays queued */
+    ok(QueueUserAPC(TestApc, GetCurrentThread(), 0), "QueueUserAPC failed: %lu\n", GetLastError());
+    SetLastError(0xdeadbeef);
+    Ret = pGetQueuedCompletionStatusEx(Port, Entries, 4, &Removed, 100, FALSE);
+    ok(Ret == FALSE, "Ret = %d\n", Ret);
+    ok(GetLastError() == WAIT_TIMEOUT, "Error %lu\n", GetLastError());
+    ok(ApcCount == 1, "ApcCount = %ld\n", ApcCount);
+    ok(SleepEx(0, TRUE) == WAIT_IO_COMPLETION, "SleepEx didn't run the APC\n");
+    ok(ApcCount == 2, "ApcCount = %ld\n", ApcCount);
+
+    /* An alert without an APC ends it the same way */
+    Status = NtAlertThread(GetCurrentThread());
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    SetLastError(0xdeadbeef);
+    Removed = 0xdeadbeef;
+    Ret = pGetQueuedCompletionStatusEx(Port, Entries, 4, &Removed, 5000, TRUE);
+    ok(Ret == FALSE, "Ret = %d\n", Ret);
+    ok(GetLastError() == WAIT_IO_COMPLETION, "Error %lu\n", GetLastError());
+    ok(Removed == 0, "Removed = %lu\n", Removed);
+
+    /* Packets that are there are returned, even in an alertable wait */
+    ok(PostQueuedCompletionStatus(Port, 1, 2, NULL), "PostQueuedCompletionStatus failed: %lu\n", GetLastError());
+    Ret = pGetQueuedCompletionStatusEx(Port, Entries, 4, &Removed, 0, TRUE);
+    ok(Ret == TRUE, "Ret = %d, error %lu\n", Ret, GetLastError());
+    ok(Removed == 1, "Removed = %lu\n", Removed);
+}
+
+START_TEST(GetQueuedCompletionStatusEx)
+{
+    HMODULE Module;
+    HANDLE Port;
+
+    Module = GetModuleHandleW(L"kernel32.dll");
+    pGetQueuedCompletionStatusEx = (PFN_GETQUEUEDCOMPLETIONSTATUSEX)GetProcAddress(Module, "GetQueuedCompletionStatusEx");
+    if (!pGetQueuedCompletionStatusEx)
+    {
+        Module = LoadLibraryW(L"kernel32_vista.dll");
+        if (Module)
+            pGetQueuedCompletionStatusEx = (PFN_GETQUEUEDCOMPLETIONSTATUSEX)GetProcAddress(Module, "GetQueuedCompletionStatusEx");
+    }
+    if (!pGetQueuedCompletionStatusEx)
+    {
+        skip("GetQueuedCompletionStatusEx is not available\n");
+        return;
+    }
+
+    Port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 0);
+    ok(Port != NULL, "CreateIoCompletionPort failed: %lu\n", GetLastError());
+    if (!Port)
+        return;
+
+    Test_Batch(Port);
+    Test_Timeout(Port);
+    Test_Alertable(Port);
+
+    CloseHandle(Port);
+}
@@ -0,0 +1,626 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPLv2+ - See COPYING in the top level directory
+ * PURPOSE:         Test for the thread pool (CreateThreadpoolWork and friends)
+ */
+
+#undef _WIN32_WINNT
+#define _WIN32_WINNT 0x0600
+
+#include <apitest.h>
+
+#define TP_FUNC(Ret, Name, Args) \
+    typedef Ret (WINAPI *PFN_##Name) Args; \
+    static PFN_##Name p##Name;
+
+TP_FUNC(PTP_POOL, CreateThreadpool, (PVOID))
+TP_FUNC(VOID, CloseThreadpool, (PTP_POOL))
+TP_FUNC(VOID, SetThreadpoolThreadMaximum, (PTP_POOL, DWORD))
+TP_FUNC(BOOL, SetThreadpoolThreadMinimum, (PTP_POOL, DWORD))
+TP_FUNC(PTP_CLEANUP_GROUP, CreateThreadpoolCleanupGroup, (VOID))
+TP_FUNC(VOID, CloseThreadpoolCleanupGroup, (PTP_CLEANUP_GROUP))
+TP_FUNC(VOID, CloseThreadpoolCleanupGroupMembers, (PTP_CLEANUP_GROUP, BOOL, PVOID))
+TP_FUNC(PTP_WORK, CreateThreadpoolWork, (PTP_WORK_CALLBACK, PVOID, PTP_CALLBACK_ENVIRON))
+TP_FUNC(VOID, SubmitThreadpoolWork, (PTP_WORK))
+TP_FUNC(VOID, WaitForThreadpoolWorkCallbacks, (PTP_WORK, BOOL))
+TP_FUNC(VOID, CloseThreadpoolWork, (PTP_WORK))
+TP_FUNC(BOOL, TrySubmitThreadpoolCallback, (PTP_SIMPLE_CALLBACK, PVOID, PTP_CALLBACK_ENVIRON))
+TP_FUNC(PTP_TIMER, CreateThreadpoolTimer, (PTP_TIMER_CALLBACK, PVOID, PTP_CALLBACK_ENVIRON))
+TP_FUNC(VOID, SetThreadpoolTimer, (PTP_TIMER, PFILETIME, DWORD, DWORD))
+TP_FUNC(BOOL, IsThreadpoolTimerSet, (PTP_TIMER))
+TP_FUNC(VOID, WaitForThreadpoolTimerCallbacks, (PTP_TIMER, BOOL))
+TP_FUNC(VOID, CloseThreadpoolTimer, (PTP_TIMER))
+TP_FUNC(PTP_WAIT, CreateThreadpoolWait, (PTP_WAIT_CALLBACK, PVOID, PTP_CALLBACK_ENVIRON))
+TP_FUNC(VOID, SetThreadpoolWait, (PTP_WAIT, HANDLE, PFILETIME))
+TP_FUNC(VOID, WaitForThreadpoolWaitCallbacks, (PTP_WAIT, BOOL))
+TP_FUNC(VOID, CloseThreadpoolWait, (PTP_WAIT))
+TP_FUNC(BOOL, CallbackMayRunLong, (PTP_CALLBACK_INSTANCE))
+TP_FUNC(VOID, DisassociateCurrentThreadFromCallback, (PTP_CALLBACK_INSTANCE))
+TP_FUNC(VOID, SetEventWhenCallbackReturns, (PTP_CALLBACK_INSTANCE, HANDLE))
+TP_FUNC(VOID, ReleaseSemaphoreWhenCallbackReturns, (PTP_CALLBACK_INSTANCE, HANDLE, DWORD))
+TP_FUNC(VOID, ReleaseMutexWhenCallbackReturns, (PTP_CALLBACK_INSTANCE, HANDLE))
+TP_FUNC(VOID, LeaveCriticalSectionWhenCallbackReturns, (PTP_CALLBACK_INSTANCE, PCRITICAL_SECTION))
+TP_FUNC(VOID, FreeLibraryWhenCallbackReturns, (PTP_CALLBACK_INSTANCE, HMODULE))
+
+typedef struct _TP_TEST_CONTEXT
+{
+    LONG Count;
+    PVOID Object;
+    BOOL ObjectMatches;
+    HANDLE Event;
+    HANDLE Started;
+    HANDLE Release;
+    BOOL MayRunLong;
+    TP_WAIT_RESULT WaitResult;
+} TP_TEST_CONTEXT, *PTP_TEST_CONTEXT;
+
+static LONG CancelCount;
+static PVOID CancelObjectContext;
+static PVOID CancelCleanupContext;
+
+static
+VOID
+CALLBACK
+CountWork(PTP_CALLBACK_INSTANCE Instance, PVOID Context, PTP_WORK Work)
+{
+    PTP_TEST_CONTEXT TestContext = Context;
+
+    if (Work != TestContext->Object)
+        TestContext->ObjectMatches = FALSE;
+    InterlockedIncrement(&TestContext->Count);
+}
+
+static
+VOID
+CALLBACK
+CountSimple(PTP_CALLBACK_INSTANCE Instance, PVOID Context)
+{
+    PTP_TEST_CONTEXT TestContext = Context;
+
+    InterlockedIncrement(&TestContext->Count);
+    if (TestContext->Event)
+        pSetEventWhenCallbackReturns(Instance, TestContext->Event);
+}
+
+/* Keeps the only thread of a pool busy until it is released */
+static
+VOID
+CALLBACK
+BlockingWork(PTP_CALLBACK_INSTANCE Instance, PVOID Context, PTP_WORK Work)
+{
+    PTP_TEST_CONTEXT TestContext = Context;
+
+    TestContext->MayRunLong = pCallbackMayRunLong(Instance);
+    SetEvent(TestContext->Started);
+    ok(WaitForSingleObject(TestContext->Release, 10000) == WAIT_OBJECT_0, "The blocking work was never released\n");
+    InterlockedIncrement(&TestContext->Count);
+}
+
+static
+VOID
+CALLBACK
+MayRunLongWork(PTP_CALLBACK_INSTANCE Instance, PVOID Context, PTP_WORK Work)
+{
+    PTP_TEST_CONTEXT TestContext = Context;
+
+    TestContext->MayRunLong = pCallbackMayRunLong(Instance);
+    InterlockedIncrement(&TestContext->Count);
+}
+
+static
+VOID
+CALLBACK
+GroupCancel(PVOID ObjectContext, PVOID CleanupContext)
+{
+    InterlockedIncrement(&CancelCount);
+    CancelObjectContext = ObjectContext;
+    CancelCleanupContext = CleanupContext;
+}
+
+static
+DWORD
+WINAPI
+ReleaseLater(PVOID Parameter)
+{
+    Sleep(300);
+    SetEvent((HANDLE)Parameter);
+    return 0;
+}
+
+/* A pool that runs one callback at a time, so the others stay pending */
+static
+PTP_POOL
+CreateSingleThreadPool(PTP_CALLBACK_ENVIRON Environment)
+{
+    PTP_POOL Pool;
+
+    Pool = pCreateThreadpool(NULL);
+    ok(Pool != NULL, "CreateThreadpool failed: %lu\n", GetLastError());
+    if (!Pool)
+        return NULL;
+
+    pSetThreadpoolThreadMaximum(Pool, 1);
+    ok(pSetThreadpoolThreadMinimum(Pool, 1), "SetThreadpoolThreadMinimum failed: %lu\n", GetLastError());
+
+    InitializeThreadpoolEnvironment(Environment);
+    SetThreadpoolCallbackPool(Environment, Pool);
+    return Pool;
+}
+
+static
+void
+Test_Work(void)
+{
+    TP_TEST_CONTEXT Context = { 0 };
+    PTP_WORK Work;
+    ULONG i;
+
+    Context.ObjectMatches = TRUE;
+    Work = pCreateThreadpoolWork(CountWork, &Context, NULL);
+    ok(Work != NULL, "CreateThreadpoolWork failed: %lu\n", GetLastError());
+    if (!Work)
+        return;
+    Context.Object = Work;
+
+    /* Every submission runs the callback once */
+    for (i = 0; i < 5; i++)
+        pSubmitThreadpoolWork(Work);
+    pWaitForThreadpoolWorkCallbacks(Work, FALSE);
+    ok(Context.Count == 5, "Count = %ld\n", Context.Count);
+    ok(Context.ObjectMatches, "The callback got another work object\n");
+
+    /* Waiting with nothing submitted returns right away */
+    pWaitForThreadpoolWorkCallbacks(Work, FALSE);
+    ok(Context.Count == 5, "Count = %ld\n", Context.Count);
+
+    pCloseThreadpoolWork(Work);
+
+    /* Simple callbacks don't need an object */
+    Context.Count = 0;
+    Context.Event = CreateEventW(NULL, FALSE, FALSE, NULL);
+    ok(pTrySubmitThreadpoolCallback(CountSimple, &Context, NULL), "TrySubmitThreadpoolCallback failed: %lu\n", GetLastError());
+    ok(WaitForSingleObject(Context.Event, 5000) == WAIT_OBJECT_0, "The simple callback didn't run\n");
+    ok(Context.Count == 1, "Count = %ld\n", Context.Count);
+    CloseHandle(Context.Event);
+}
+
+static
+void
+Test_WorkCancel(void)
+{
+    TP_TEST_CONTEXT Blocker = { 0 }, Context = { 0 };
+    TP_CALLBACK_ENVIRON Environment;
+    PTP_WORK BlockerWork, Work;
+    PTP_POOL Pool;
+    ULONG i;
+
+    Pool = CreateSingleThreadPool(&Environment);
+    if (!Pool)
+        return;
+
+    Blocker.Started = CreateEventW(NULL, FALSE, FALSE, NULL);
+    Blocker.Release = CreateEventW(NULL, TRUE, FALSE, NULL);
+    BlockerWork = pCreateThreadpoolWork(BlockingWork, &Blocker, &Environment);
+    Work = pCreateThreadpoolWork(CountWork, &Context, &Environment);
+    ok(BlockerWork != NULL && Work != NULL, "CreateThreadpoolWork failed: %lu\n", GetLastError());
+    if (!BlockerWork || !Work)
+        return;
+    Context.Object = Work;
+    Context.ObjectMatches = TRUE;
+
+    pSubmitThreadpoolWork(BlockerWork);
+    ok(WaitForSingleObject(Blocker.Started, 5000) == WAIT_OBJECT_0, "The blocking work didn't start\n");
+
+    /* The only thread is busy, there is nobody to take a long callback's place */
+    ok(Blocker.MayRunLong == FALSE, "CallbackMayRunLong returned %d\n", Blocker.MayRunLong);
+
+    /* Cancelling drops what didn't start yet and doesn't wait for it */
+    for (i = 0; i < 3; i++)
+        pSubmitThreadpoolWork(Work);
+    pWaitForThreadpoolWorkCallbacks(Work, TRUE);
+    ok(Context.Count == 0, "Count = %ld\n", Context.Count);
+
+    SetEvent(Blocker.Release);
+    pWaitForThreadpoolWorkCallbacks(BlockerWork, FALSE);
+    ok(Blocker.Count == 1, "Blocker count = %ld\n", Blocker.Count);
+
+    /* The cancelled ones never run, even once the thread is free */
+    pSubmitThreadpoolWork(Work);
+    pWaitForThreadpoolWorkCallbacks(Work, FALSE);
+    ok(Context.Count == 1, "Count = %ld\n", Context.Count);
+
+    pCloseThreadpoolWork(Work);
+    pCloseThreadpoolWork(BlockerWork);
+    DestroyThreadpoolEnvironment(&Environment);
+    pCloseThreadpool(Pool);
+    CloseHandle(Blocker.Started);
+    CloseHandle(Blocker.Release);
+}
+
+static
+void
+Test_CleanupGroup(void)
+{
+    TP_TEST_CONTEXT Blocker = { 0 }, Context = { 0 };
+    TP_CALLBACK_ENVIRON Environment;
+    PTP_CLEANUP_GROUP Group;
+    PTP_WORK BlockerWork;
+    PTP_POOL Pool;
+    HANDLE Thread;
+    LONG CleanupParameter;
+    ULONG i;
+
+    Pool = CreateSingleThreadPool(&Environment);
+    if (!Pool)
+        return;
+
+    Group = pCreateThreadpoolCleanupGroup();
+    ok(Group != NULL, "CreateThreadpoolCleanupGroup failed: %lu\n", GetLastError());
+    if (!Group)
+    {
+        pCloseThreadpool(Pool);
+        return;
+    }
+    SetThreadpoolCallbackCleanupGroup(&Environment, Group, GroupCancel);
+
+    Blocker.Started = CreateEventW(NULL, FALSE, FALSE, NULL);
+    Blocker.Release = CreateEventW(NULL, TRUE, FALSE, NULL);
+
+    /* Members that didn't start are cancelled and their owner is told */
+    BlockerWork = pCreateThreadpoolWork(BlockingWork, &Blocker, &Environment);
+    ok(BlockerWork != NULL, "CreateThreadpoolWork failed: %lu\n", GetLastError());
+    pSubmitThreadpoolWork(BlockerWork);
+    ok(WaitForSingleObject(Blocker.Started, 5000) == WAIT_OBJECT_0, "The blocking work didn't start\n");
+
+    for (i = 0; i < 3; i++)
+    {
+        ok(pTrySubmitThreadpoolCallback(CountSimple, &Context, &Environment),
+           "TrySubmitThreadpoolCallback failed: %lu\n", GetLastError());
+    }
+
+    /* The running member is waited for */
+    Thread = CreateThread(NULL, 0, ReleaseLater, Blocker.Release, 0, NULL);
+    CancelCount = 0;
+    CancelObjectContext = CancelCleanupContext = NULL;
+    pCloseThreadpoolCleanupGroupMembers(Group, TRUE, &CleanupParameter);
+    ok(Blocker.Count == 1, "Blocker count = %ld\n", Blocker.Count);
+    ok(Context.Count == 0, "Count = %ld\n", Context.Count);
+    ok(CancelCount == 3, "CancelCount = %ld\n", CancelCount);
+    ok(CancelObjectContext == &Context, "ObjectContext = %p\n", CancelObjectContext);
+    ok(CancelCleanupContext == &CleanupParameter, "CleanupContext = %p\n", CancelCleanupContext);
+    WaitForSingleObject(Thread, INFINITE);
+    CloseHandle(Thread);
+
+    /* Without cancelling, everything runs and nobody is told */
+    ResetEvent(Blocker.Release);
+    BlockerWork = pCreateThreadpoolWork(BlockingWork, &Blocker, &Environment);
+    ok(BlockerWork != NULL, "CreateThreadpoolWork failed: %lu\n", GetLastError());
+    pSubmitThreadpoolWork(BlockerWork);
+    ok(WaitForSingleObject(Blocker.Started, 5000) == WAIT_OBJECT_0, "The blocking work didn't start\n");
+
+    for (i = 0; i < 3; i++)
+    {
+        ok(pTrySubmitThreadpoolCallback(CountSimple, &Context, &Environment),
+           "TrySubmitThreadpoolCallback failed: %lu\n", GetLastError());
+    }
+
+    Thread = CreateThread(NULL, 0, ReleaseLater, Blocker.Release, 0, NULL);
+    CancelCount = 0;
+    pCloseThreadpoolCleanupGroupMembers(Group, FALSE, NULL);
+    ok(Blocker.Count == 2, "Blocker count = %ld\n", Blocker.Count);
+    ok(Context.Count == 3, "Count = %ld\n", Context.Count);
+    ok(CancelCount == 0, "CancelCount = %ld\n", CancelCount);
+    WaitForSingleObject(Thread, INFINITE);
+    CloseHandle(Thread);
+
+    /* The members are gone, the group itself can go too */
+    pCloseThreadpoolCleanupGroup(Group);
+    DestroyThreadpoolEnvironment(&Environment);
+    pCloseThreadpool(Pool);
+    CloseHandle(Blocker.Started);
+    CloseHandle(Blocker.Release);
+}
+
+static
+VOID
+CALLBACK
+TimerCallback(PTP_CALLBACK_INSTANCE Instance, PVOID Context, PTP_TIMER Timer)
+{
+    PTP_TEST_CONTEXT TestContext = Context;
+
+    if (Timer != TestContext->Object)
+        TestContext->ObjectMatches = FALSE;
+    InterlockedIncrement(&TestContext->Count);
+    pSetEventWhenCallbackReturns(Instance, TestContext->Event);
+}
+
+static
+void
+Test_Timer(void)
+{
+    TP_TEST_CONTEXT Context = { 0 };
+    ULARGE_INTEGER Due;
+    FILETIME DueTime;
+    PTP_TIMER Timer;
+    LONG Count;
+    ULONG i;
+
+    Context.Event = CreateEventW(NULL, FALSE, FALSE, NULL);
+    Context.ObjectMatches = TRUE;
+    Timer = pCreateThreadpoolTimer(TimerCallback, &Context, NULL);
+    ok(Timer != NULL, "CreateThreadpoolTimer failed: %lu\n", GetLastError());
+    if (!Timer)
+        return;
+    Context.Object = Timer;
+    ok(!pIsThreadpoolTimerSet(Timer), "The new timer is set\n");
+
+    /* A relative one-shot timer fires once */
+    Due.QuadPart = (ULONGLONG)-500000; /* 50 ms */
+    DueTime.dwLowDateTime = Due.LowPart;
+    DueTime.dwHighDateTime = Due.HighPart;
+    pSetThreadpoolTimer(Timer, &DueTime, 0, 0);
+    ok(pIsThreadpoolTimerSet(Timer), "The timer isn't set\n");
+    ok(WaitForSingleObject(Context.Event, 5000) == WAIT_OBJECT_0, "The timer didn't fire\n");
+    pWaitForThreadpoolTimerCallbacks(Timer, FALSE);
+    ok(Context.Count == 1, "Count = %ld\n", Context.Count);
+    ok(Context.ObjectMatches, "The callback got another timer object\n");
+
+    /* A periodic one keeps firing until it is cancelled */
+    Due.QuadPart = (ULONGLONG)-100000; /* 10 ms */
+    DueTime.dwLowDateTime = Due.LowPart;
+    DueTime.dwHighDateTime = Due.HighPart;
+    pSetThreadpoolTimer(Timer, &DueTime, 50, 0);
+    for (i = 0; i < 3; i++)
+        ok(WaitForSingleObject(Context.Event, 5000) == WAIT_OBJECT_0, "The timer didn't fire %lu times\n", i + 1);
+    ok(pIsThreadpoolTimerSet(Timer), "The periodic timer isn't set\n");
+
+    pSetThreadpoolTimer(Timer, NULL, 0, 0);
+    ok(!pIsThreadpoolTimerSet(Timer), "The cancelled timer is set\n");
+    pWaitForThreadpoolTimerCallbacks(Timer, TRUE);
+    Count = Context.Count;
+    ok(Count >= 4, "Count = %ld\n", Count);
+    Sleep(200);
+    ok(Context.Count == Count, "The cancelled timer fired, Count = %ld\n", Context.Count);
+
+    pCloseThreadpoolTimer(Timer);
+    CloseHandle(Context.Event);
+}
+
+static
+VOID
+CALLBACK
+WaitCallback(PTP_CALLBACK_INSTANCE Instance, PVOID Context, PTP_WAIT Wait, TP_WAIT_RESULT WaitResult)
+{
+    PTP_TEST_CONTEXT TestContext = Context;
+
+    if (Wait != TestContext->Object)
+        TestContext->ObjectMatches = FALSE;
+    TestContext->WaitResult = WaitResult;
+    InterlockedIncrement(&TestContext->Count);
+    pSetEventWhenCallbackReturns(Instance, TestContext->Event);
+}
+
+static
+void
+Test_Wait(void)
+{
+    TP_TEST_CONTEXT Context = { 0 };
+    ULARGE_INTEGER Timeout;
+    FILETIME WaitTimeout;
+    HANDLE Signal;
+    PTP_WAIT Wait;
+
+    Context.Event = CreateEventW(NULL, FALSE, FALSE, NULL);
+    Context.ObjectMatches = TRUE;
+    Signal = CreateEventW(NULL, FALSE, FALSE, NULL);
+    Wait = pCreateThreadpoolWait(WaitCallback, &Context, NULL);
+    ok(Wait != NULL, "CreateThreadpoolWait failed: %lu\n", GetLastError());
+    if (!Wait)
+        return;
+    Context.Object = Wait;
+
+    /* The callback runs once the object is signaled */
+    Context.WaitResult = 0xdeadbeef;
+    pSetThreadpoolWait(Wait, Signal, NULL);
+    ok(WaitForSingleObject(Context.Event, 200) == WAIT_TIMEOUT, "The wait completed early\n");
+    SetEvent(Signal);
+    ok(WaitForSingleObject(Context.Event, 5000) == WAIT_OBJECT_0, "The wait didn't complete\n");
+    ok(Context.WaitResult == WAIT_OBJECT_0, "WaitResult = %lu\n", Context.WaitResult);
+    ok(Context.Count == 1, "Count = %ld\n", Context.Count);
+    ok(Context.ObjectMatches, "The callback got another wait object\n");
+
+    /* Or when the timeout expires */
+    Context.WaitResult = 0xdeadbeef;
+    Timeout.QuadPart = (ULONGLONG)-1000000; /* 100 ms */
+    WaitTimeout.dwLowDateTime = Timeout.LowPart;
+    WaitTimeout.dwHighDateTime = Timeout.HighPart;
+    pSetThreadpoolWait(Wait, Signal, &WaitTimeout);
+    ok(WaitForSingleObject(Context.Event, 5000) == WAIT_OBJECT_0, "The wait didn't time out\n");
+    ok(Context.WaitResult == WAIT_TIMEOUT, "WaitResult = %lu\n", Context.WaitResult);
+    ok(Context.Count == 2, "Count = %ld\n", Context.Count);
+
+    /* A wait only fires once */
+    SetEvent(Signal);
+    ok(WaitForSingleObject(Context.Event, 200) == WAIT_TIMEOUT, "The wait fired again\n");
+    ok(Context.Count == 2, "Count = %ld\n", Context.Count);
+
+    /* A cancelled wait doesn't fire */
+    ResetEvent(Signal);
+    pSetThreadpoolWait(Wait, Signal, NULL);
+    pSetThreadpoolWait(Wait, NULL, NULL);
+    pWaitForThreadpoolWaitCallbacks(Wait, TRUE);
+    SetEvent(Signal);
+    ok(WaitForSingleObject(Context.Event, 200) == WAIT_TIMEOUT, "The cancelled wait fired\n");
+    ok(Context.Count == 2, "Count = %ld\n", Context.Count);
+
+    pCloseThreadpoolWait(Wait);
+    CloseHandle(Signal);
+    CloseHandle(Context.Event);
+}
+
+typedef struct _INSTANCE_TEST
+{
+    HANDLE Semaphore;
+    HANDLE Mutex;
+    CRITICAL_SECTION CriticalSection;
+    HMODULE Module;
+    HANDLE Disassociated;
+    HANDLE Finish;
+    HANDLE Done;
+    BOOL Acquired;
+} INSTANCE_TEST, *PINSTANCE_TEST;
+
+static
+VOID
+CALLBACK
+ReleaseObjectsWork(PTP_CALLBACK_INSTANCE Instance, PVOID Context, PTP_WORK Work)
+{
+    PINSTANCE_TEST Test = Context;
+
+    /* Everything is still held until the callback returns */
+    Test->Acquired = (WaitForSingleObject(Test->Mutex, 0) == WAIT_OBJECT_0);
+    EnterCriticalSection(&Test->CriticalSection);
+
+    pReleaseSemaphoreWhenCallbackReturns(Instance, Test->Semaphore, 2);
+    pReleaseMutexWhenCallbackReturns(Instance, Test->Mutex);
+    pLeaveCriticalSectionWhenCallbackReturns(Instance, &Test->CriticalSection);
+    if (Test->Module)
+        pFreeLibraryWhenCallbackReturns(Instance, Test->Module);
+}
+
+static
+VOID
+CALLBACK
+DisassociateWork(PTP_CALLBACK_INSTANCE Instance, PVOID Context, PTP_WORK Work)
+{
+    PINSTANCE_TEST Test = Context;
+
+    pDisassociateCurrentThreadFromCallback(Instance);
+    SetEvent(Test->Disassociated);
+    ok(WaitForSingleObject(Test->Finish, 10000) == WAIT_OBJECT_0, "The disassociated work was never finished\n");
+    pSetEventWhenCallbackReturns(Instance, Test->Done);
+}
+
+static
+void
+Test_CallbackInstance(void)
+{
+    TP_TEST_CONTEXT Context = { 0 };
+    INSTANCE_TEST Test = { 0 };
+    PTP_WORK Work;
+
+    /* The objects are released after the callback is done with them */
+    Test.Semaphore = CreateSemaphoreW(NULL, 0, 10, NULL);
+    Test.Mutex = CreateMutexW(NULL, FALSE, NULL);
+    InitializeCriticalSection(&Test.CriticalSection);
+    if (!GetModuleHandleW(L"version.dll"))
+        Test.Module = LoadLibraryW(L"version.dll");
+
+    Work = pCreateThreadpoolWork(ReleaseObjectsWork, &Test, NULL);
+    ok(Work != NULL, "CreateThreadpoolWork failed: %lu\n", GetLastError());
+    if (!Work)
+        return;
+    pSubmitThreadpoolWork(Work);
+    pWaitForThreadpoolWorkCallbacks(Work, FALSE);
+    pCloseThreadpoolWork(Work);
+
+    ok(Test.Acquired, "The callback didn't get the mutex\n");
+    ok(WaitForSingleObject(Test.Semaphore, 0) == WAIT_OBJECT_0, "The semaphore wasn't released\n");
+    ok(WaitForSingleObject(Test.Semaphore, 0) == WAIT_OBJECT_0, "The semaphore was released only once\n");
+    ok(WaitForSingleObject(Test.Semaphore, 0) == WAIT_TIMEOUT, "The semaphore was released too often\n");
+    ok(WaitForSingleObject(Test.Mutex, 0) == WAIT_OBJECT_0, "The mutex wasn't released\n");
+    ReleaseMutex(Test.Mutex);
+    ok(TryEnterCriticalSection(&Test.CriticalSection), "The critical section wasn't left\n");
+    LeaveCriticalSection(&Test.CriticalSection);
+    if (Test.Module)
+        ok(GetModuleHandleW(L"version.dll") == NULL, "The library wasn't freed\n");
+    else
+        skip("version.dll is already loaded\n");
+
+    DeleteCriticalSection(&Test.CriticalSection);
+    CloseHandle(Test.Mutex);
+    CloseHandle(Test.Semaphore);
+
+    /* Waiting for callbacks doesn't wait for a disassociated one */
+    Test.Disassociated = CreateEventW(NULL, FALSE, FALSE, NULL);
+    Test.Finish = CreateEventW(NULL, FALSE, FALSE, NULL);
+    Test.Done = CreateEventW(NULL, FALSE, FALSE, NULL);
+    Work = pCreateThreadpoolWork(DisassociateWork, &Test, NULL);
+    ok(Work != NULL, "CreateThreadpoolWork failed: %lu\n", GetLastError());
+    if (!Work)
+        return;
+    pSubmitThreadpoolWork(Work);
+    ok(WaitForSingleObject(Test.Disassociated, 5000) == WAIT_OBJECT_0, "The work didn't start\n");
+    pWaitForThreadpoolWorkCallbacks(Work, FALSE);
+    ok(WaitForSingleObject(Test.Done, 0) == WAIT_TIMEOUT, "The disassociated work is done already\n");
+    SetEvent(Test.Finish);
+    ok(WaitForSingleObject(Test.Done, 5000) == WAIT_OBJECT_0, "The disassociated work didn't finish\n");
+    pCloseThreadpoolWork(Work);
+    CloseHandle(Test.Done);
+    CloseHandle(Test.Finish);
+    CloseHandle(Test.Disassociated);
+
+    /* The default pool can add a thread for a long callback */
+    Context.MayRunLong = -1;
+    Work = pCreateThreadpoolWork(MayRunLongWork, &Context, NULL);
+    ok(Work != NULL, "CreateThreadpoolWork failed: %lu\n", GetLastError());
+    if (!Work)
+        return;
+    pSubmitThreadpoolWork(Work);
+    pWaitForThreadpoolWorkCallbacks(Work, FALSE);
+    ok(Context.Count == 1, "Count = %ld\n", Context.Count);
+    ok(Context.MayRunLong == TRUE, "CallbackMayRunLong returned %d\n", Context.MayRunLong);
+    pCloseThreadpoolWork(Work);
+}
+
+#define LOAD_FUNC(Name) p##Name = (PFN_##Name)GetProcAddress(Module, #Name)
+
+START_TEST(Threadpool)
+{
+    HMODULE Module;
+
+    Module = GetModuleHandleW(L"kernel32.dll");
+    if (!GetProcAddress(Module, "CreateThreadpoolWork"))
+        Module = LoadLibraryW(L"kernel32_vista.dll");
+    if (!Module || !GetProcAddress(Module, "CreateThreadpoolWork"))
+    {
+        skip("The thread pool API is not available\n");
+        return;
+    }
+
+    LOAD_FUNC(CreateThreadpool);
+    LOAD_FUNC(CloseThreadpool);
+    LOAD_FUNC(SetThreadpoolThreadMaximum);
+    LOAD_FUNC(SetThreadpoolThreadMinimum);
+    LOAD_FUNC(CreateThreadpoolCleanupGroup);
+    LOAD_FUNC(CloseThreadpoolCleanupGroup);
+    LOAD_FUNC(CloseThreadpoolCleanupGroupMembers);
+    LOAD_FUNC(CreateThreadpoolWork);
+    LOAD_FUNC(SubmitThreadpoolWork);
+    LOAD_FUNC(WaitForThreadpoolWorkCallbacks);
+    LOAD_FUNC(CloseThreadpoolWork);
+    LOAD_FUNC(TrySubmitThreadpoolCallback);
+    LOAD_FUNC(CreateThreadpoolTimer);
+    LOAD_FUNC(SetThreadpoolTimer);
+    LOAD_FUNC(IsThreadpoolTimerSet);
+    LOAD_FUNC(WaitForThreadpoolTimerCallbacks);
+    LOAD_FUNC(CloseThreadpoolTimer);
+    LOAD_FUNC(CreateThreadpoolWait);
+    LOAD_FUNC(SetThreadpoolWait);
+    LOAD_FUNC(WaitForThreadpoolWaitCallbacks);
+    LOAD_FUNC(CloseThreadpoolWait);
+    LOAD_FUNC(CallbackMayRunLong);
+    LOAD_FUNC(DisassociateCurrentThreadFromCallback);
+    LOAD_FUNC(SetEventWhenCallbackReturns);
+    LOAD_FUNC(ReleaseSemaphoreWhenCallbackReturns);
+    LOAD_FUNC(ReleaseMutexWhenCallbackReturns);
+    LOAD_FUNC(LeaveCriticalSectionWhenCallbackReturns);
+    LOAD_FUNC(FreeLibraryWhenCallbackReturns);
+
+    Test_Work();
+    Test_WorkCancel();
+    Test_CleanupGroup();
+    Test_Timer();
+    Test_Wait();
+    Test_CallbackInstance();
+}
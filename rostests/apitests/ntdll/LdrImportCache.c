@@ -0,0 +1,321 @@
+/*
+ * PROJECT:         ReactOS API Tests
+ * LICENSE:         LGPLv2.1+ - See COPYING.LIB in the top level directory
+ * PURPOSE:         Test for the known DLL import resolution cache
+ */
+
+#include <apitest.h>
+#define WIN32_NO_STATUS
+#include <ndk/ntndk.h>
+#include <ldrcache.h>
+
+static PCSTR LoadSet[] =
+{
+    "advapi32.dll", "comctl32.dll", "comdlg32.dll", "crypt32.dll",
+    "gdi32.dll", "imm32.dll", "msvcrt.dll", "ole32.dll",
+    "oleaut32.dll", "rpcrt4.dll", "secur32.dll", "setupapi.dll",
+    "shell32.dll", "shlwapi.dll", "urlmon.dll", "user32.dll",
+    "userenv.dll", "version.dll", "wininet.dll", "ws2_32.dll",
+};
+
+static PLDR_IMPORT_CACHE_HEADER
+MapImportCache(VOID)
+{
+    UNICODE_STRING CacheName = RTL_CONSTANT_STRING(L"\\KnownDlls\\" LDR_IMPORT_CACHE_NAME);
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    HANDLE SectionHandle;
+    PVOID BaseAddress = NULL;
+    SIZE_T ViewSize = 0;
+    NTSTATUS Status;
+
+    InitializeObjectAttributes(&ObjectAttributes, &CacheName, OBJ_CASE_INSENSITIVE, NULL, NULL);
+    Status = NtOpenSection(&SectionHandle, SECTION_MAP_READ, &ObjectAttributes);
+    if (Status == STATUS_OBJECT_NAME_NOT_FOUND)
+        return NULL;
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+        return NULL;
+
+    Status = NtMapViewOfSection(SectionHandle,
+                                NtCurrentProcess(),
+                                &BaseAddress,
+                                0,
+                                0,
+                                NULL,
+                                &ViewSize,
+                                ViewShare,
+                                0,
+                                PAGE_READONLY);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    NtClose(SectionHandle);
+    if (!NT_SUCCESS(Status))
+        return NULL;
+
+    ok(ViewSize >= sizeof(LDR_IMPORT_CACHE_HEADER), "ViewSize = %lu\n", (ULONG)ViewSize);
+    return BaseAddress;
+}
+
+static BOOLEAN
+IsCachedImage(PLDR_IMPORT_CACHE_IMAGE Image,
+              PIMAGE_NT_HEADERS NtHeaders,
+              PCSTR Name)
+{
+    WCHAR WideName[LDR_IMPORT_CACHE_MAX_NAME];
+
+    if (Image->TimeDateStamp != NtHeaders->FileHeader.TimeDateStamp ||
+        Image->CheckSum != NtHeaders->OptionalHeader.CheckSum ||
+        Image->SizeOfImage != NtHeaders->OptionalHeader.SizeOfImage)
+        return FALSE;
+
+    if (!MultiByteToWideChar(CP_ACP, 0, Name, -1, WideName, RTL_NUMBER_OF(WideName)))
+        return FALSE;
+    return !_wcsicmp(Image->BaseDllName, WideName);
+}
+
+static PLDR_IMPORT_CACHE_DESCRIPTOR
+FindCachedDescriptor(PLDR_IMPORT_CACHE_HEADER Cache,
+                     PIMAGE_NT_HEADERS ImportHeaders,
+                     PCSTR ImportName,
+                     ULONG FirstThunkRva)
+{
+    PLDR_IMPORT_CACHE_DESCRIPTOR Descriptors = LDR_IMPORT_CACHE_DESCRIPTORS(Cache);
+    ULONG i, j;
+
+    for (i = 0; i < Cache->ImageCount; i++)
+    {
+        if (!IsCachedImage(&Cache->Images[i], ImportHeaders, ImportName))
+            continue;
+
+        for (j = 0; j < Cache->Images[i].DescriptorCount; j++)
+        {
+            if (Descriptors[Cache->Images[i].FirstDescriptor + j].FirstThunkRva == FirstThunkRva)
+                return &Descriptors[Cache->Images[i].FirstDescriptor + j];
+        }
+    }
+
+    return NULL;
+}
+
+static
+ULONG
+CheckImports(HMODULE Module, PCSTR ModuleName, PLDR_IMPORT_CACHE_HEADER Cache)
+{
+    PIMAGE_NT_HEADERS NtHeaders, ExportHeaders;
+    PIMAGE_IMPORT_DESCRIPTOR Descriptor;
+    PLDR_IMPORT_CACHE_DESCRIPTOR CachedDescriptor;
+    PIMAGE_THUNK_DATA OriginalThunk, FirstThunk;
+    PIMAGE_IMPORT_BY_NAME ImportByName;
+    PCSTR ImportName;
+    HMODULE ExportModule;
+    FARPROC Expected;
+    PULONG CachedThunks;
+    ULONG Size, i, Cached = 0;
+
+    NtHeaders = RtlImageNtHeader(Module);
+    Descriptor = RtlImageDirectoryEntryToData(Module, TRUE, IMAGE_DIRECTORY_ENTRY_IMPORT, &Size);
+    for (; Descriptor && Descriptor->Name; Descriptor++)
+    {
+        ImportName = (PCSTR)Module + Descriptor->Name;
+
+        /* SxS may have picked another version than the one we'd get by name */
+        if (!_stricmp(ImportName, "comctl32.dll") || !_stricmp(ImportName, "gdiplus.dll"))
+            continue;
+        if (!Descriptor->OriginalFirstThunk)
+            continue;
+
+        ExportModule = GetModuleHandleA(ImportName);
+        ok(ExportModule != NULL, "%s: %s not loaded\n", ModuleName, ImportName);
+        if (!ExportModule)
+            continue;
+        ExportHeaders = RtlImageNtHeader(ExportModule);
+
+        CachedDescriptor = Cache ? FindCachedDescriptor(Cache, NtHeaders, ModuleName, Descriptor->FirstThunk) : NULL;
+        if (CachedDescriptor &&
+            (CachedDescriptor->ExportImage >= Cache->ImageCount ||
+             !IsCachedImage(&Cache->Images[CachedDescriptor->ExportImage], ExportHeaders, ImportName)))
+        {
+            CachedDescriptor = NULL;
+        }
+        CachedThunks = CachedDescriptor ? &LDR_IMPORT_CACHE_THUNKS(Cache)[CachedDescriptor->FirstThunk] : NULL;
+
+        OriginalThunk = (PIMAGE_THUNK_DATA)((PCHAR)Module + Descriptor->OriginalFirstThunk);
+        FirstThunk = (PIMAGE_THUNK_DATA)((PCHAR)Module + Descriptor->FirstThunk);
+        for (i = 0; OriginalThunk[i].u1.AddressOfData; i++)
+        {
+            /* Whatever filled the IAT, it must agree with GetProcAddress */
+            if (IMAGE_SNAP_BY_ORDINAL(OriginalThunk[i].u1.Ordinal))
+            {
+                Expected = GetProcAddress(ExportModule, (PCSTR)IMAGE_ORDINAL(OriginalThunk[i].u1.Ordinal));
+                ok(FirstThunk[i].u1.Function == (ULONG_PTR)Expected,
+                   "%s: %s ordinal %lu is %p, expected %p\n",
+                   ModuleName, ImportName, (ULONG)IMAGE_ORDINAL(OriginalThunk[i].u1.Ordinal),
+                   (PVOID)FirstThunk[i].u1.Function, Expected);
+            }
+            else
+            {
+                ImportByName = (PIMAGE_IMPORT_BY_NAME)((PCHAR)Module + (OriginalThunk[i].u1.AddressOfData & 0xffffffff));
+                Expected = GetProcAddress(ExportModule, (PCSTR)ImportByName->Name);
+                ok(FirstThunk[i].u1.Function == (ULONG_PTR)Expected,
+                   "%s: %s!%s is %p, expected %p\n",
+                   ModuleName, ImportName, ImportByName->Name,
+                   (PVOID)FirstThunk[i].u1.Function, Expected);
+            }
+
+            /* And so must the cache, where it has an answer */
+            if (CachedThunks && i < CachedDescriptor->ThunkCount && CachedThunks[i])
+            {
+                ok((PCHAR)ExportModule + CachedThunks[i] == (PCHAR)Expected,
+                   "%s: cached import %lu from %s is %p, expected %p\n",
+                   ModuleName, i, ImportName, (PCHAR)ExportModule + CachedThunks[i], Expected);
+                Cached++;
+            }
+        }
+        if (CachedDescriptor)
+            ok(CachedDescriptor->ThunkCount == i, "%s: %lu cached imports from %s, expected %lu\n",
+               ModuleName, CachedDescriptor->ThunkCount, ImportName, i);
+    }
+
+    return Cached;
+}
+
+static
+VOID
+Test_LoadSet(VOID)
+{
+    PLDR_IMPORT_CACHE_HEADER Cache;
+    HMODULE Modules[RTL_NUMBER_OF(LoadSet)];
+    ULONG i, Cached = 0;
+
+    Cache = MapImportCache();
+
+    for (i = 0; i < RTL_NUMBER_OF(LoadSet); i++)
+    {
+        Modules[i] = LoadLibraryA(LoadSet[i]);
+        if (!Modules[i])
+        {
+            trace("%s not available\n", LoadSet[i]);
+            continue;
+        }
+    }
+
+    for (i = 0; i < RTL_NUMBER_OF(LoadSet); i++)
+    {
+        if (Modules[i])
+            Cached += CheckImports(Modules[i], LoadSet[i], Cache);
+    }
+    Cached += CheckImports(GetModuleHandleA("kernel32.dll"), "kernel32.dll", Cache);
+
+    if (Cache)
+    {
+        ok(Cached != 0, "No imports were resolved from the cache\n");
+        NtUnmapViewOfSection(NtCurrentProcess(), Cache);
+    }
+
+    for (i = 0; i < RTL_NUMBER_OF(LoadSet); i++)
+    {
+        if (Modules[i])
+            FreeLibrary(Modules[i]);
+    }
+}
+
+static
+VOID
+Test_CacheSection(VOID)
+{
+    UNICODE_STRING CacheName = RTL_CONSTANT_STRING(L"\\KnownDlls\\" LDR_IMPORT_CACHE_NAME);
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    PLDR_IMPORT_CACHE_HEADER Cache;
+    HANDLE SectionHandle;
+    NTSTATUS Status;
+    ULONG i;
+
+    Cache = MapImportCache();
+    if (!Cache)
+    {
+        skip("No known DLL import cache\n");
+        return;
+    }
+
+    ok(Cache->Signature == LDR_IMPORT_CACHE_SIGNATURE, "Signature = 0x%lx\n", Cache->Signature);
+    ok(Cache->ImageCount != 0, "No images in the cache\n");
+    ok(Cache->DescriptorCount != 0, "No descriptors in the cache\n");
+    ok(Cache->ThunkCount != 0, "No thunks in the cache\n");
+    ok(Cache->Size == FIELD_OFFSET(LDR_IMPORT_CACHE_HEADER, Images) +
+                      Cache->ImageCount * sizeof(LDR_IMPORT_CACHE_IMAGE) +
+                      Cache->DescriptorCount * sizeof(LDR_IMPORT_CACHE_DESCRIPTOR) +
+                      Cache->ThunkCount * sizeof(ULONG),
+       "Size = %lu\n", Cache->Size);
+    for (i = 0; i < Cache->ImageCount; i++)
+    {
+        ok(Cache->Images[i].BaseDllName[0] != UNICODE_NULL, "Image %lu has no name\n", i);
+        ok(Cache->Images[i].BaseDllName[LDR_IMPORT_CACHE_MAX_NAME - 1] == UNICODE_NULL,
+           "Image %lu name is not terminated\n", i);
+    }
+    for (i = 0; i < Cache->DescriptorCount; i++)
+    {
+        ok(LDR_IMPORT_CACHE_DESCRIPTORS(Cache)[i].ExportImage < Cache->ImageCount,
+           "Descriptor %lu exporter is %lu\n", i, LDR_IMPORT_CACHE_DESCRIPTORS(Cache)[i].ExportImage);
+    }
+    NtUnmapViewOfSection(NtCurrentProcess(), Cache);
+
+    /* Nobody but SMSS may change where the imports of other processes go */
+    InitializeObjectAttributes(&ObjectAttributes, &CacheName, OBJ_CASE_INSENSITIVE, NULL, NULL);
+    Status = NtOpenSection(&SectionHandle, SECTION_MAP_WRITE, &ObjectAttributes);
+    ok_ntstatus(Status, STATUS_ACCESS_DENIED);
+    if (NT_SUCCESS(Status))
+        NtClose(SectionHandle);
+}
+
+static
+VOID
+Test_LoadTime(VOID)
+{
+    CHAR CommandLine[MAX_PATH + 64];
+    STARTUPINFOA StartupInfo = { sizeof(StartupInfo) };
+    PROCESS_INFORMATION ProcessInfo;
+    LARGE_INTEGER Frequency, Start, End;
+    ULONGLONG Total = 0;
+    ULONG Runs = 0, i;
+
+    GetModuleFileNameA(NULL, CommandLine, MAX_PATH);
+    strcat(CommandLine, " LdrImportCache LoadSet");
+
+    /* Every run starts a fresh process, so nothing is loaded up front */
+    QueryPerformanceFrequency(&Frequency);
+    for (i = 0; i < 10; i++)
+    {
+        QueryPerformanceCounter(&Start);
+        if (!CreateProcessA(NULL, CommandLine, NULL, NULL, FALSE, 0, NULL, NULL, &StartupInfo, &ProcessInfo))
+        {
+            ok(0, "CreateProcess failed with %lu\n", GetLastError());
+            return;
+        }
+        winetest_wait_child_process(ProcessInfo.hProcess);
+        QueryPerformanceCounter(&End);
+        CloseHandle(ProcessInfo.hThread);
+        CloseHandle(ProcessInfo.hProcess);
+
+        Total += End.QuadPart - Start.QuadPart;
+        Runs++;
+    }
+
+    trace("Starting a process that loads %u DLLs took %I64u us on average\n",
+          (ULONG)RTL_NUMBER_OF(LoadSet),
+          Total * 1000000 / Frequency.QuadPart / Runs);
+}
+
+START_TEST(LdrImportCache)
+{
+    char **argv;
+    int argc;
+
+    argc = winetest_get_mainargs(&argv);
+    if (argc >= 3 && !strcmp(argv[2], "LoadSet"))
+    {
+        Test_LoadSet();
+        return;
+    }
+
+    Test_CacheSection();
+    Test_LoadTime();
+}
@@ -397,6 +397,255 @@ DisconnectRegistry(
 }
 
 
+/*
+ * Hives bigger than what the kernel keeps mapped at once get their views
+ * unmapped and read back in while they are used.
+ */
+#define BIG_HIVE_VALUE_COUNT    3200
+#define BIG_HIVE_VALUE_SIZE     (8 * 1024)
+
+static VOID
+FillBigHiveValue(
+    OUT PULONG Buffer,
+    IN ULONG Index,
+    IN ULONG Generation)
+{
+    ULONG i;
+
+    for (i = 0; i < BIG_HIVE_VALUE_SIZE / sizeof(ULONG); i++)
+        Buffer[i] = (Index << 16) ^ (Generation << 12) ^ i;
+}
+
+static NTSTATUS
+SetBigHiveValue(
+    IN HANDLE KeyHandle,
+    IN PCWSTR Prefix,
+    IN ULONG Index,
+    IN ULONG Generation,
+    IN PULONG Buffer)
+{
+    WCHAR NameBuffer[32];
+    UNICODE_STRING ValueName;
+
+    StringCchPrintfW(NameBuffer, _countof(NameBuffer), L"%s%lu", Prefix, Index);
+    RtlInitUnicodeString(&ValueName, NameBuffer);
+
+    FillBigHiveValue(Buffer, Index, Generation);
+    return NtSetValueKey(KeyHandle, &ValueName, 0, REG_BINARY,
+                         Buffer, BIG_HIVE_VALUE_SIZE);
+}
+
+static NTSTATUS
+DeleteBigHiveValue(
+    IN HANDLE KeyHandle,
+    IN PCWSTR Prefix,
+    IN ULONG Index)
+{
+    WCHAR NameBuffer[32];
+    UNICODE_STRING ValueName;
+
+    StringCchPrintfW(NameBuffer, _countof(NameBuffer), L"%s%lu", Prefix, Index);
+    RtlInitUnicodeString(&ValueName, NameBuffer);
+    return NtDeleteValueKey(KeyHandle, &ValueName);
+}
+
+static NTSTATUS
+CheckBigHiveValue(
+    IN HANDLE KeyHandle,
+    IN PCWSTR Prefix,
+    IN ULONG Index,
+    IN ULONG Generation,
+    IN PULONG Buffer,
+    IN PKEY_VALUE_PARTIAL_INFORMATION PartialInfo)
+{
+    NTSTATUS Status;
+    WCHAR NameBuffer[32];
+    UNICODE_STRING ValueName;
+    ULONG ResultLength;
+
+    StringCchPrintfW(NameBuffer, _countof(NameBuffer), L"%s%lu", Prefix, Index);
+    RtlInitUnicodeString(&ValueName, NameBuffer);
+
+    Status = NtQueryValueKey(KeyHandle,
+                             &ValueName,
+                             KeyValuePartialInformation,
+                             PartialInfo,
+                             FIELD_OFFSET(KEY_VALUE_PARTIAL_INFORMATION, Data[BIG_HIVE_VALUE_SIZE]),
+                             &ResultLength);
+    if (!NT_SUCCESS(Status))
+        return Status;
+
+    FillBigHiveValue(Buffer, Index, Generation);
+    if (PartialInfo->Type != REG_BINARY ||
+        PartialInfo->DataLength != BIG_HIVE_VALUE_SIZE ||
+        !RtlEqualMemory(PartialInfo->Data, Buffer, BIG_HIVE_VALUE_SIZE))
+    {
+        return STATUS_DATA_ERROR;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/* Every 7th value gets rewritten, every 13th deleted and replaced by an extra one */
+static ULONG
+CheckBigHive(
+    IN HANDLE KeyHandle,
+    IN BOOLEAN Modified,
+    IN PULONG Buffer,
+    IN PKEY_VALUE_PARTIAL_INFORMATION PartialInfo)
+{
+    NTSTATUS Status;
+    ULONG i, Failures = 0;
+
+    for (i = 0; i < BIG_HIVE_VALUE_COUNT; i++)
+    {
+        Status = CheckBigHiveValue(KeyHandle, L"Value", i,
+                                   (Modified && !(i % 7)) ? 1 : 0,
+                                   Buffer, PartialInfo);
+        if (Modified && !(i % 13))
+        {
+            if (Status != STATUS_OBJECT_NAME_NOT_FOUND)
+                Failures++;
+
+            Status = CheckBigHiveValue(KeyHandle, L"Extra", i, 2, Buffer, PartialInfo);
+        }
+
+        if (!NT_SUCCESS(Status))
+        {
+            if (Failures++ < 10)
+                trace("Value %lu: Status 0x%08lx\n", i, Status);
+        }
+    }
+
+    return Failures;
+}
+
+/*
+ * Should be called under privileges
+ */
+static VOID
+TestBigHive(
+    IN PUNICODE_STRING RootPath,
+    IN PCWSTR RegistryKey,
+    IN PCWSTR RegMountPoint)
+{
+    NTSTATUS Status;
+    UNICODE_STRING KeyName;
+    HANDLE KeyHandle;
+    PULONG Buffer;
+    PKEY_VALUE_PARTIAL_INFORMATION PartialInfo;
+    ULONG i, Failures;
+
+    Buffer = RtlAllocateHeap(RtlGetProcessHeap(), 0, BIG_HIVE_VALUE_SIZE);
+    PartialInfo = RtlAllocateHeap(RtlGetProcessHeap(), 0,
+                                  FIELD_OFFSET(KEY_VALUE_PARTIAL_INFORMATION, Data[BIG_HIVE_VALUE_SIZE]));
+    if (!Buffer || !PartialInfo)
+    {
+        skip("Out of memory\n");
+        goto Cleanup;
+    }
+
+    RtlInitUnicodeString(&KeyName, RegMountPoint);
+
+    /* Mount the hive and make it bigger than the views the kernel keeps mapped */
+    Status = ConnectRegistry(NULL, RegMountPoint, NULL, RootPath, RegistryKey);
+    if (!NT_SUCCESS(Status))
+    {
+        skip("ConnectRegistry('%S') failed, Status 0x%08lx\n", RegMountPoint, Status);
+        goto Cleanup;
+    }
+
+    Status = CreateRegKey(&KeyHandle, NULL, &KeyName, REG_OPTION_NON_VOLATILE, NULL);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+    {
+        DisconnectRegistry(NULL, RegMountPoint, 0);
+        goto Cleanup;
+    }
+
+    Failures = 0;
+    for (i = 0; i < BIG_HIVE_VALUE_COUNT; i++)
+    {
+        if (!NT_SUCCESS(SetBigHiveValue(KeyHandle, L"Value", i, 0, Buffer)))
+            Failures++;
+    }
+    ok(Failures == 0, "%lu values could not be written\n", Failures);
+
+    Status = NtFlushKey(KeyHandle);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    NtClose(KeyHandle);
+
+    Status = DisconnectRegistry(NULL, RegMountPoint, 0);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+
+    /* Mount it again, its bins now get mapped as they are used */
+    Status = ConnectRegistry(NULL, RegMountPoint, NULL, RootPath, RegistryKey);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+        goto Cleanup;
+
+    Status = CreateRegKey(&KeyHandle, NULL, &KeyName, REG_OPTION_NON_VOLATILE, NULL);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+    {
+        DisconnectRegistry(NULL, RegMountPoint, 0);
+        goto Cleanup;
+    }
+
+    Failures = CheckBigHive(KeyHandle, FALSE, Buffer, PartialInfo);
+    ok(Failures == 0, "%lu values were wrong after remounting\n", Failures);
+
+    /* Modify it all over the file, freed cells get reused by the new values */
+    Failures = 0;
+    for (i = 0; i < BIG_HIVE_VALUE_COUNT; i++)
+    {
+        if (!(i % 7) && !NT_SUCCESS(SetBigHiveValue(KeyHandle, L"Value", i, 1, Buffer)))
+            Failures++;
+        if (!(i % 13) && !NT_SUCCESS(DeleteBigHiveValue(KeyHandle, L"Value", i)))
+            Failures++;
+    }
+    for (i = 0; i < BIG_HIVE_VALUE_COUNT; i += 13)
+    {
+        if (!NT_SUCCESS(SetBigHiveValue(KeyHandle, L"Extra", i, 2, Buffer)))
+            Failures++;
+    }
+    ok(Failures == 0, "%lu values could not be modified\n", Failures);
+
+    Status = NtFlushKey(KeyHandle);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+
+    /* Views that got flushed can be unmapped, read them back in */
+    Failures = CheckBigHive(KeyHandle, TRUE, Buffer, PartialInfo);
+    ok(Failures == 0, "%lu values were wrong after flushing\n", Failures);
+
+    NtClose(KeyHandle);
+    Status = DisconnectRegistry(NULL, RegMountPoint, 0);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+
+    /* And the file has all of it */
+    Status = ConnectRegistry(NULL, RegMountPoint, NULL, RootPath, RegistryKey);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+        goto Cleanup;
+
+    Status = CreateRegKey(&KeyHandle, NULL, &KeyName, REG_OPTION_NON_VOLATILE, NULL);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (NT_SUCCESS(Status))
+    {
+        Failures = CheckBigHive(KeyHandle, TRUE, Buffer, PartialInfo);
+        ok(Failures == 0, "%lu values were wrong after reloading\n", Failures);
+        NtClose(KeyHandle);
+    }
+
+    Status = DisconnectRegistry(NULL, RegMountPoint, 0);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+
+Cleanup:
+    if (PartialInfo) RtlFreeHeap(RtlGetProcessHeap(), 0, PartialInfo);
+    if (Buffer) RtlFreeHeap(RtlGetProcessHeap(), 0, Buffer);
+}
+
+
 START_TEST(NtLoadUnloadKey)
 {
     typedef struct _HIVE_LIST_ENTRY
@@ -614,6 +863,13 @@ START_TEST(NtLoadUnloadKey)
 #endif
 
 
+/***********************************************************************************************/
+
+
+    /* Use the second hive for one that is bigger than the mapped views */
+    TestBigHive(&NtTestPath, RegistryHives[1].HiveName, RegistryHives[1].RegMountPoint);
+
+
 /***********************************************************************************************/
 
 
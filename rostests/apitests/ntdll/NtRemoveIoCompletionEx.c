@@ -0,0 +1,160 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPLv2+ - See COPYING in the top level directory
+ * PURPOSE:         Test for NtRemoveIoCompletionEx
+ */
+
+#include <apitest.h>
+
+#define WIN32_NO_STATUS
+#include <ndk/iofuncs.h>
+#include <ndk/kefuncs.h>
+#include <ndk/psfuncs.h>
+
+static LONG ApcCount;
+
+static
+VOID
+NTAPI
+TestApc(
+    PVOID NormalContext,
+    PVOID SystemArgument1,
+    PVOID SystemArgument2)
+{
+    InterlockedIncrement(&ApcCount);
+}
+
+static
+void
+Test_Batch(HANDLE Port)
+{
+    FILE_IO_COMPLETION_INFORMATION Info[70];
+    ULONG Removed, i;
+    NTSTATUS Status;
+
+    for (i = 0; i < 4; i++)
+    {
+        Status = NtSetIoCompletion(Port, (PVOID)(ULONG_PTR)(10 + i), (PVOID)(ULONG_PTR)(20 + i), STATUS_SUCCESS, 30 + i);
+        ok_ntstatus(Status, STATUS_SUCCESS);
+    }
+
+    Removed = 0xdeadbeef;
+    Status = NtRemoveIoCompletionEx(Port, Info, 3, &Removed, NULL, FALSE);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    ok(Removed == 3, "Removed = %lu\n", Removed);
+    for (i = 0; i < 3 && i < Removed; i++)
+    {
+        ok(Info[i].KeyContext == (PVOID)(ULONG_PTR)(10 + i), "Entry %lu: key %p\n", i, Info[i].KeyContext);
+        ok(Info[i].ApcContext == (PVOID)(ULONG_PTR)(20 + i), "Entry %lu: context %p\n", i, Info[i].ApcContext);
+        ok_ntstatus(Info[i].IoStatusBlock.Status, STATUS_SUCCESS);
+        ok(Info[i].IoStatusBlock.Information == 30 + i, "Entry %lu: information %Iu\n", i, Info[i].IoStatusBlock.Information);
+    }
+
+    /* A wait with packets queued returns what is there */
+    Removed = 0xdeadbeef;
+    Status = NtRemoveIoCompletionEx(Port, Info, 8, &Removed, NULL, FALSE);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    ok(Removed == 1, "Removed = %lu\n", Removed);
+    ok(Info[0].KeyContext == (PVOID)13, "Key %p\n", Info[0].KeyContext);
+
+    /* More than fit in one batch */
+    for (i = 0; i < 70; i++)
+    {
+        Status = NtSetIoCompletion(Port, (PVOID)(ULONG_PTR)i, NULL, STATUS_SUCCESS, 0);
+        ok_ntstatus(Status, STATUS_SUCCESS);
+    }
+    Removed = 0xdeadbeef;
+    Status = NtRemoveIoCompletionEx(Port, Info, 70, &Removed, NULL, FALSE);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    ok(Removed >= 64 && Removed <= 70, "Removed = %lu\n", Removed);
+    i = Removed;
+    while (i < 70)
+    {
+        Status = NtRemoveIoCompletionEx(Port, Info, 70, &Removed, NULL, FALSE);
+        ok_ntstatus(Status, STATUS_SUCCESS);
+        if (!NT_SUCCESS(Status))
+            break;
+        ok(Info[0].KeyContext == (PVOID)(ULONG_PTR)i, "Key %p, expected %lu\n", Info[0].KeyContext, i);
+        i += Removed;
+    }
+    ok(i == 70, "Removed %lu in total\n", i);
+}
+
+static
+void
+Test_Timeout(HANDLE Port)
+{
+    FILE_IO_COMPLETION_INFORMATION Info[4];
+    LARGE_INTEGER Timeout;
+    ULONG Removed;
+    NTSTATUS Status;
+
+    Timeout.QuadPart = 0;
+    Removed = 0xdeadbeef;
+    Status = NtRemoveIoCompletionEx(Port, Info, 4, &Removed, &Timeout, FALSE);
+    ok_ntstatus(Status, STATUS_TIMEOUT);
+    ok(Removed == 0, "Removed = %lu\n", Removed);
+
+    Timeout.QuadPart = -100 * 10000;
+    Removed = 0xdeadbeef;
+    Status = NtRemoveIoCompletionEx(Port, Info, 4, &Removed, &Timeout, FALSE);
+    ok_ntstatus(Status, STATUS_TIMEOUT);
+    ok(Removed == 0, "Removed = %lu\n", Removed);
+
+    Status = NtRemoveIoCompletionEx(Port, Info, 0, &Removed, &Timeout, FALSE);
+    ok_ntstatus(Status, STATUS_INVALID_PARAMETER);
+}
+
+static
+void
+Test_Alertable(HANDLE Port)
+{
+    FILE_IO_COMPLETION_INFORMATION Info[4];
+    LARGE_INTEGER Timeout;
+    ULONG Removed;
+    NTSTATUS Status;
+
+    Timeout.QuadPart = -5000 * 10000LL;
+
+    ApcCount = 0;
+    Status = NtQueueApcThread(NtCurrentThread(), TestApc, NULL, NULL, NULL);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    Removed = 0xdeadbeef;
+    Status = NtRemoveIoCompletionEx(Port, Info, 4, &Removed, &Timeout, TRUE);
+    ok_ntstatus(Status, STATUS_USER_APC);
+    ok(Removed == 0, "Removed = %lu\n", Removed);
+    ok(ApcCount == 1, "ApcCount = %ld\n", ApcCount);
+
+    Status = NtAlertThread(NtCurrentThread());
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    Removed = 0xdeadbeef;
+    Status = NtRemoveIoCompletionEx(Port, Info, 4, &Removed, &Timeout, TRUE);
+    ok_ntstatus(Status, STATUS_ALERTED);
+    ok(Removed == 0, "Removed = %lu\n", Removed);
+
+    /* A pending alert doesn't stop a non-alertable wait */
+    Status = NtAlertThread(NtCurrentThread());
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    Timeout.QuadPart = -50 * 10000;
+    Status = NtRemoveIoCompletionEx(Port, Info, 4, &Removed, &Timeout, FALSE);
+    ok_ntstatus(Status, STATUS_TIMEOUT);
+    Status = NtTestAlert();
+    ok_ntstatus(Status, STATUS_ALERTED);
+}
+
+START_TEST(NtRemoveIoCompletionEx)
+{
+    HANDLE Port;
+    NTSTATUS Status;
+
+    Status = NtCreateIoCompletion(&Port, IO_COMPLETION_ALL_ACCESS, NULL, 0);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+        return;
+
+    Test_Batch(Port);
+    Test_Timeout(Port);
+    Test_Alertable(Port);
+
+    NtClose(Port);
+}
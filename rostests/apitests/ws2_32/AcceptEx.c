@@ -0,0 +1,308 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPL - See COPYING in the top level directory
+ * PURPOSE:         Test for AcceptEx and ConnectEx
+ */
+
+#include <apitest.h>
+
+#include <stdio.h>
+#include "ws2_32.h"
+#include <mswsock.h>
+
+#define ADDRESS_LENGTH (sizeof(struct sockaddr_in) + 16)
+
+static LPFN_ACCEPTEX pAcceptEx;
+static LPFN_GETACCEPTEXSOCKADDRS pGetAcceptExSockaddrs;
+static LPFN_CONNECTEX pConnectEx;
+
+static
+SOCKET
+CreateListener(struct sockaddr_in *Address)
+{
+    SOCKET Listener;
+    int Length = sizeof(*Address);
+
+    Listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (Listener == INVALID_SOCKET)
+        return INVALID_SOCKET;
+
+    memset(Address, 0, sizeof(*Address));
+    Address->sin_family = AF_INET;
+    Address->sin_addr.s_addr = inet_addr("127.0.0.1");
+
+    if (bind(Listener, (struct sockaddr *)Address, sizeof(*Address)) == SOCKET_ERROR ||
+        getsockname(Listener, (struct sockaddr *)Address, &Length) == SOCKET_ERROR ||
+        listen(Listener, 5) == SOCKET_ERROR)
+    {
+        closesocket(Listener);
+        return INVALID_SOCKET;
+    }
+
+    return Listener;
+}
+
+static
+BOOL
+StartAccept(SOCKET Listener, SOCKET Acceptor, PVOID Buffer, DWORD ReceiveLength, OVERLAPPED *Overlapped)
+{
+    DWORD Received;
+
+    memset(Overlapped, 0, sizeof(*Overlapped));
+    Overlapped->hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+
+    if (pAcceptEx(Listener, Acceptor, Buffer, ReceiveLength, ADDRESS_LENGTH, ADDRESS_LENGTH, &Received, Overlapped) ||
+        WSAGetLastError() != ERROR_IO_PENDING)
+    {
+        ok(0, "AcceptEx didn't pend: %d\n", WSAGetLastError());
+        CloseHandle(Overlapped->hEvent);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static
+void
+Test_Accept(void)
+{
+    struct sockaddr_in Address, *Local, *Remote;
+    SOCKET Listener, Acceptor, Connector;
+    char Buffer[100 + 2 * ADDRESS_LENGTH];
+    OVERLAPPED Overlapped, *Completed;
+    HANDLE Port;
+    DWORD Transferred, Flags;
+    ULONG_PTR Key;
+    int LocalLength, RemoteLength;
+
+    Listener = CreateListener(&Address);
+    Acceptor = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    Connector = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (Listener == INVALID_SOCKET || Acceptor == INVALID_SOCKET || Connector == INVALID_SOCKET)
+    {
+        skip("Failed to create the sockets: %d\n", WSAGetLastError());
+        return;
+    }
+
+    /* Without a receive buffer, the accept completes with the connection */
+    Port = CreateIoCompletionPort((HANDLE)Listener, NULL, 0x1234, 0);
+    ok(Port != NULL, "CreateIoCompletionPort failed: %lu\n", GetLastError());
+
+    if (StartAccept(Listener, Acceptor, Buffer, 0, &Overlapped))
+    {
+        ok(WaitForSingleObject(Overlapped.hEvent, 200) == WAIT_TIMEOUT, "AcceptEx completed without a connection\n");
+
+        ok(connect(Connector, (struct sockaddr *)&Address, sizeof(Address)) == 0, "connect failed: %d\n", WSAGetLastError());
+
+        ok(GetQueuedCompletionStatus(Port, &Transferred, &Key, &Completed, 5000),
+           "No completion: %lu\n", GetLastError());
+        ok(Completed == &Overlapped, "Completed %p, expected %p\n", Completed, &Overlapped);
+        ok(Key == 0x1234, "Key is %lx\n", (ULONG)Key);
+        ok(Transferred == 0, "Transferred %lu bytes\n", Transferred);
+
+        pGetAcceptExSockaddrs(Buffer, 0, ADDRESS_LENGTH, ADDRESS_LENGTH,
+                              (struct sockaddr **)&Local, &LocalLength,
+                              (struct sockaddr **)&Remote, &RemoteLength);
+        ok(LocalLength == sizeof(struct sockaddr_in), "LocalLength is %d\n", LocalLength);
+        ok(Local->sin_port == Address.sin_port, "Local port is %u\n", ntohs(Local->sin_port));
+        ok(RemoteLength == sizeof(struct sockaddr_in), "RemoteLength is %d\n", RemoteLength);
+        ok(Remote->sin_addr.s_addr == inet_addr("127.0.0.1"), "Remote address is %lx\n", Remote->sin_addr.s_addr);
+
+        ok(setsockopt(Acceptor, SOL_SOCKET, SO_UPDATE_ACCEPT_CONTEXT, (char *)&Listener, sizeof(Listener)) == 0,
+           "SO_UPDATE_ACCEPT_CONTEXT failed: %d\n", WSAGetLastError());
+        ok(send(Connector, "ping", 4, 0) == 4, "send failed: %d\n", WSAGetLastError());
+        ok(recv(Acceptor, Buffer, sizeof(Buffer), 0) == 4, "recv on the accepted socket failed: %d\n", WSAGetLastError());
+
+        CloseHandle(Overlapped.hEvent);
+    }
+
+    closesocket(Acceptor);
+    closesocket(Connector);
+
+    /* With one, it waits for the first data */
+    Acceptor = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    Connector = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (StartAccept(Listener, Acceptor, Buffer, 100, &Overlapped))
+    {
+        ok(connect(Connector, (struct sockaddr *)&Address, sizeof(Address)) == 0, "connect failed: %d\n", WSAGetLastError());
+        ok(WaitForSingleObject(Overlapped.hEvent, 200) == WAIT_TIMEOUT, "AcceptEx completed without data\n");
+
+        ok(send(Connector, "hello", 5, 0) == 5, "send failed: %d\n", WSAGetLastError());
+        ok(WaitForSingleObject(Overlapped.hEvent, 5000) == WAIT_OBJECT_0, "AcceptEx didn't complete with the data\n");
+        ok(GetOverlappedResult((HANDLE)Listener, &Overlapped, &Transferred, FALSE), "AcceptEx failed: %lu\n", GetLastError());
+        ok(Transferred == 5, "Received %lu bytes\n", Transferred);
+        ok(!memcmp(Buffer, "hello", 5), "Received the wrong data\n");
+
+        /* The completion port sees it too */
+        ok(GetQueuedCompletionStatus(Port, &Transferred, &Key, &Completed, 5000) && Completed == &Overlapped,
+           "No completion: %lu\n", GetLastError());
+
+        CloseHandle(Overlapped.hEvent);
+    }
+
+    closesocket(Acceptor);
+    closesocket(Connector);
+
+    /* Still cancelable once it has the connection and waits for the data */
+    Acceptor = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    Connector = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (StartAccept(Listener, Acceptor, Buffer, 100, &Overlapped))
+    {
+        ok(connect(Connector, (struct sockaddr *)&Address, sizeof(Address)) == 0, "connect failed: %d\n", WSAGetLastError());
+        ok(WaitForSingleObject(Overlapped.hEvent, 200) == WAIT_TIMEOUT, "AcceptEx completed without data\n");
+
+        ok(CancelIo((HANDLE)Listener), "CancelIo failed: %lu\n", GetLastError());
+        ok(WaitForSingleObject(Overlapped.hEvent, 5000) == WAIT_OBJECT_0, "Cancelled AcceptEx didn't complete\n");
+        ok(!WSAGetOverlappedResult(Listener, (LPWSAOVERLAPPED)&Overlapped, &Transferred, FALSE, &Flags),
+           "Cancelled AcceptEx succeeded\n");
+        ok(WSAGetLastError() == WSA_OPERATION_ABORTED, "Cancelled AcceptEx failed with %d\n", WSAGetLastError());
+        GetQueuedCompletionStatus(Port, &Transferred, &Key, &Completed, 1000);
+
+        CloseHandle(Overlapped.hEvent);
+    }
+
+    closesocket(Acceptor);
+    closesocket(Connector);
+
+    /* And before it has one */
+    Acceptor = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (StartAccept(Listener, Acceptor, Buffer, 0, &Overlapped))
+    {
+        ok(CancelIo((HANDLE)Listener), "CancelIo failed: %lu\n", GetLastError());
+        ok(WaitForSingleObject(Overlapped.hEvent, 5000) == WAIT_OBJECT_0, "Cancelled AcceptEx didn't complete\n");
+        ok(!WSAGetOverlappedResult(Listener, (LPWSAOVERLAPPED)&Overlapped, &Transferred, FALSE, &Flags),
+           "Cancelled AcceptEx succeeded\n");
+        ok(WSAGetLastError() == WSA_OPERATION_ABORTED, "Cancelled AcceptEx failed with %d\n", WSAGetLastError());
+
+        CloseHandle(Overlapped.hEvent);
+    }
+
+    closesocket(Acceptor);
+    closesocket(Listener);
+    CloseHandle(Port);
+}
+
+static
+void
+Test_Connect(void)
+{
+    struct sockaddr_in Address, Local;
+    SOCKET Listener, Accepted, Connector;
+    OVERLAPPED Overlapped, *Completed;
+    char Buffer[32];
+    HANDLE Port;
+    DWORD Transferred;
+    ULONG_PTR Key;
+    int Length;
+
+    Listener = CreateListener(&Address);
+    Connector = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (Listener == INVALID_SOCKET || Connector == INVALID_SOCKET)
+    {
+        skip("Failed to create the sockets: %d\n", WSAGetLastError());
+        return;
+    }
+
+    memset(&Overlapped, 0, sizeof(Overlapped));
+    memset(&Local, 0, sizeof(Local));
+    Local.sin_family = AF_INET;
+
+    /* ConnectEx wants a bound socket */
+    ok(!pConnectEx(Connector, (struct sockaddr *)&Address, sizeof(Address), NULL, 0, NULL, &Overlapped),
+       "ConnectEx on an unbound socket succeeded\n");
+    ok(WSAGetLastError() == WSAEINVAL, "ConnectEx on an unbound socket failed with %d\n", WSAGetLastError());
+
+    ok(bind(Connector, (struct sockaddr *)&Local, sizeof(Local)) == 0, "bind failed: %d\n", WSAGetLastError());
+
+    /* The data goes out with the connection, and the completion counts it */
+    Port = CreateIoCompletionPort((HANDLE)Connector, NULL, 0x5678, 0);
+    ok(Port != NULL, "CreateIoCompletionPort failed: %lu\n", GetLastError());
+
+    if (pConnectEx(Connector, (struct sockaddr *)&Address, sizeof(Address), "hello", 5, NULL, &Overlapped) ||
+        WSAGetLastError() == ERROR_IO_PENDING)
+    {
+        ok(GetQueuedCompletionStatus(Port, &Transferred, &Key, &Completed, 5000),
+           "No completion: %lu\n", GetLastError());
+        ok(Completed == &Overlapped, "Completed %p, expected %p\n", Completed, &Overlapped);
+        ok(Key == 0x5678, "Key is %lx\n", (ULONG)Key);
+        ok(Transferred == 5, "Sent %lu bytes\n", Transferred);
+
+        ok(setsockopt(Connector, SOL_SOCKET, SO_UPDATE_CONNECT_CONTEXT, NULL, 0) == 0,
+           "SO_UPDATE_CONNECT_CONTEXT failed: %d\n", WSAGetLastError());
+        Length = sizeof(Local);
+        ok(getpeername(Connector, (struct sockaddr *)&Local, &Length) == 0, "getpeername failed: %d\n", WSAGetLastError());
+        ok(Local.sin_port == Address.sin_port, "Peer port is %u\n", ntohs(Local.sin_port));
+
+        Accepted = accept(Listener, NULL, NULL);
+        ok(Accepted != INVALID_SOCKET, "accept failed: %d\n", WSAGetLastError());
+        ok(recv(Accepted, Buffer, sizeof(Buffer), 0) == 5, "recv failed: %d\n", WSAGetLastError());
+        ok(!memcmp(Buffer, "hello", 5), "Received the wrong data\n");
+        closesocket(Accepted);
+    }
+    else
+    {
+        ok(0, "ConnectEx failed: %d\n", WSAGetLastError());
+    }
+
+    closesocket(Connector);
+    CloseHandle(Port);
+
+    /* Nobody listening any more */
+    closesocket(Listener);
+    Connector = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    memset(&Local, 0, sizeof(Local));
+    Local.sin_family = AF_INET;
+    bind(Connector, (struct sockaddr *)&Local, sizeof(Local));
+
+    memset(&Overlapped, 0, sizeof(Overlapped));
+    Overlapped.hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    if (!pConnectEx(Connector, (struct sockaddr *)&Address, sizeof(Address), NULL, 0, NULL, &Overlapped) &&
+        WSAGetLastError() == ERROR_IO_PENDING)
+    {
+        ok(WaitForSingleObject(Overlapped.hEvent, 10000) == WAIT_OBJECT_0, "Refused ConnectEx didn't complete\n");
+    }
+    ok(!GetOverlappedResult((HANDLE)Connector, &Overlapped, &Transferred, FALSE), "Refused ConnectEx succeeded\n");
+
+    CloseHandle(Overlapped.hEvent);
+    closesocket(Connector);
+}
+
+static
+BOOL
+GetExtension(SOCKET Socket, GUID Guid, PVOID Function)
+{
+    DWORD Length;
+
+    return WSAIoctl(Socket, SIO_GET_EXTENSION_FUNCTION_POINTER, &Guid, sizeof(Guid),
+                    Function, sizeof(PVOID), &Length, NULL, NULL) != SOCKET_ERROR;
+}
+
+START_TEST(AcceptEx)
+{
+    GUID AcceptExGuid = WSAID_ACCEPTEX;
+    GUID GetAcceptExSockaddrsGuid = WSAID_GETACCEPTEXSOCKADDRS;
+    GUID ConnectExGuid = WSAID_CONNECTEX;
+    WSADATA wdata;
+    SOCKET sck;
+    int err;
+
+    err = WSAStartup(MAKEWORD(2, 2), &wdata);
+    ok(err == 0, "WSAStartup failed, iResult == %d %d\n", err, WSAGetLastError());
+
+    sck = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (sck == INVALID_SOCKET ||
+        !GetExtension(sck, AcceptExGuid, &pAcceptEx) ||
+        !GetExtension(sck, GetAcceptExSockaddrsGuid, &pGetAcceptExSockaddrs) ||
+        !GetExtension(sck, ConnectExGuid, &pConnectEx))
+    {
+        skip("Extension functions missing: %d\n", WSAGetLastError());
+        WSACleanup();
+        return;
+    }
+    closesocket(sck);
+
+    Test_Accept();
+    Test_Connect();
+
+    WSACleanup();
+}
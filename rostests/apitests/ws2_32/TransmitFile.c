@@ -0,0 +1,260 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPL - See COPYING in the top level directory
+ * PURPOSE:         Test for TransmitFile
+ */
+
+#include <apitest.h>
+
+#include <stdio.h>
+#include <ntstatus.h>
+#include "ws2_32.h"
+#include <mswsock.h>
+
+/* Spans several cache views, so the file goes out as a chain of MDLs */
+#define FILE_SIZE       (3 * 1024 * 1024 + 1234)
+#define TRANSMIT_OFFSET 70000
+
+static LPFN_TRANSMITFILE pTransmitFile;
+static WCHAR FileName[MAX_PATH];
+
+typedef struct _RECEIVER
+{
+    SOCKET Socket;
+    ULONG Offset;
+    ULONG Received;
+    ULONG Mismatch;
+} RECEIVER, *PRECEIVER;
+
+static
+UCHAR
+PatternByte(ULONG Offset)
+{
+    return (UCHAR)((Offset * 7) ^ (Offset >> 11));
+}
+
+static
+BOOL
+CreateTestFile(void)
+{
+    WCHAR TempPath[MAX_PATH];
+    UCHAR Buffer[4096];
+    HANDLE File;
+    ULONG Offset, i;
+    DWORD Written;
+
+    GetTempPathW(_countof(TempPath), TempPath);
+    GetTempFileNameW(TempPath, L"tf", 0, FileName);
+
+    File = CreateFileW(FileName, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 0, NULL);
+    if (File == INVALID_HANDLE_VALUE)
+        return FALSE;
+
+    for (Offset = 0; Offset < FILE_SIZE; Offset += Written)
+    {
+        for (i = 0; i < sizeof(Buffer); i++)
+            Buffer[i] = PatternByte(Offset + i);
+
+        if (!WriteFile(File, Buffer, min(sizeof(Buffer), FILE_SIZE - Offset), &Written, NULL) || !Written)
+        {
+            CloseHandle(File);
+            return FALSE;
+        }
+    }
+
+    CloseHandle(File);
+    return TRUE;
+}
+
+static
+DWORD
+WINAPI
+ReceiverThread(PVOID Param)
+{
+    PRECEIVER Receiver = Param;
+    char Buffer[8192];
+    int Length, i;
+
+    while ((Length = recv(Receiver->Socket, Buffer, sizeof(Buffer), 0)) > 0)
+    {
+        for (i = 0; i < Length; i++)
+        {
+            if ((UCHAR)Buffer[i] != PatternByte(Receiver->Offset + Receiver->Received + i))
+                Receiver->Mismatch++;
+        }
+        Receiver->Received += Length;
+    }
+
+    return 0;
+}
+
+static
+void
+Test_CachedFile(void)
+{
+    SOCKET Server, Client;
+    RECEIVER Receiver;
+    OVERLAPPED Overlapped;
+    HANDLE File, Thread;
+    DWORD Transferred, Flags;
+    BOOL Success;
+    int Pass;
+
+    File = CreateFileW(FileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
+    if (File == INVALID_HANDLE_VALUE)
+    {
+        skip("Failed to open the file: %lu\n", GetLastError());
+        return;
+    }
+
+    /* The second round sends from views released by the first one */
+    for (Pass = 0; Pass < 2; Pass++)
+    {
+        if (!CreateSocketPair(&Server, &Client))
+        {
+            skip("Failed to connect: %d\n", WSAGetLastError());
+            break;
+        }
+
+        memset(&Receiver, 0, sizeof(Receiver));
+        Receiver.Socket = Server;
+        Receiver.Offset = TRANSMIT_OFFSET;
+        Thread = CreateThread(NULL, 0, ReceiverThread, &Receiver, 0, NULL);
+        ok(Thread != NULL, "CreateThread failed: %lu\n", GetLastError());
+
+        memset(&Overlapped, 0, sizeof(Overlapped));
+        Overlapped.Offset = TRANSMIT_OFFSET;
+        Overlapped.hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+
+        Success = pTransmitFile(Client, File, 0, 0, &Overlapped, NULL, TF_DISCONNECT);
+        ok(Success || WSAGetLastError() == ERROR_IO_PENDING, "TransmitFile failed: %d\n", WSAGetLastError());
+
+        Success = WSAGetOverlappedResult(Client, (LPWSAOVERLAPPED)&Overlapped, &Transferred, TRUE, &Flags);
+        ok(Success, "Pass %d: transmit failed: %d\n", Pass, WSAGetLastError());
+        ok(Transferred == FILE_SIZE - TRANSMIT_OFFSET, "Pass %d: sent %lu bytes\n", Pass, Transferred);
+
+        /* TF_DISCONNECT lets the receiver see the end of the data */
+        ok(WaitForSingleObject(Thread, 10000) == WAIT_OBJECT_0, "Pass %d: receiver didn't finish\n", Pass);
+        ok(Receiver.Received == FILE_SIZE - TRANSMIT_OFFSET, "Pass %d: received %lu bytes\n", Pass, Receiver.Received);
+        ok(Receiver.Mismatch == 0, "Pass %d: %lu bytes were wrong\n", Pass, Receiver.Mismatch);
+
+        CloseHandle(Overlapped.hEvent);
+        CloseHandle(Thread);
+        closesocket(Client);
+        closesocket(Server);
+    }
+
+    CloseHandle(File);
+}
+
+static
+BOOL
+StartStalledTransmit(SOCKET *Server, SOCKET *Client, HANDLE File, OVERLAPPED *Overlapped)
+{
+    if (!CreateSocketPair(Server, Client))
+    {
+        skip("Failed to connect: %d\n", WSAGetLastError());
+        return FALSE;
+    }
+
+    /* Nobody reads on the other end, so the transmit can't finish */
+    memset(Overlapped, 0, sizeof(*Overlapped));
+    Overlapped->hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    if (pTransmitFile(*Client, File, 0, 0, Overlapped, NULL, 0) ||
+        WSAGetLastError() != ERROR_IO_PENDING)
+    {
+        skip("TransmitFile didn't pend: %d\n", WSAGetLastError());
+        CloseHandle(Overlapped->hEvent);
+        closesocket(*Client);
+        closesocket(*Server);
+        return FALSE;
+    }
+
+    ok(WaitForSingleObject(Overlapped->hEvent, 500) == WAIT_TIMEOUT, "The transmit finished without a reader\n");
+    return TRUE;
+}
+
+static
+void
+Test_Cancel(void)
+{
+    SOCKET Server, Client;
+    OVERLAPPED Overlapped;
+    DWORD Transferred, Flags;
+    HANDLE File;
+    BOOL Success;
+
+    File = CreateFileW(FileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
+    if (File == INVALID_HANDLE_VALUE)
+    {
+        skip("Failed to open the file: %lu\n", GetLastError());
+        return;
+    }
+
+    /* CancelIo takes back a transmit stuck on a full send window */
+    if (StartStalledTransmit(&Server, &Client, File, &Overlapped))
+    {
+        ok(CancelIo((HANDLE)Client), "CancelIo failed: %lu\n", GetLastError());
+        ok(WaitForSingleObject(Overlapped.hEvent, 5000) == WAIT_OBJECT_0, "Cancelled transmit didn't complete\n");
+        Success = WSAGetOverlappedResult(Client, (LPWSAOVERLAPPED)&Overlapped, &Transferred, FALSE, &Flags);
+        ok(!Success, "Cancelled transmit succeeded\n");
+        ok(WSAGetLastError() == WSA_OPERATION_ABORTED, "Cancelled transmit failed with %d\n", WSAGetLastError());
+
+        /* The socket still works */
+        ok(send(Client, "x", 1, 0) == 1, "send after cancel failed: %d\n", WSAGetLastError());
+
+        CloseHandle(Overlapped.hEvent);
+        closesocket(Client);
+        closesocket(Server);
+    }
+
+    /* So does closing the socket */
+    if (StartStalledTransmit(&Server, &Client, File, &Overlapped))
+    {
+        closesocket(Client);
+        ok(WaitForSingleObject(Overlapped.hEvent, 5000) == WAIT_OBJECT_0, "Transmit on a closed socket didn't complete\n");
+        ok(Overlapped.Internal != STATUS_SUCCESS && Overlapped.Internal != STATUS_PENDING,
+           "Transmit on a closed socket returned %lx\n", (ULONG)Overlapped.Internal);
+
+        CloseHandle(Overlapped.hEvent);
+        closesocket(Server);
+    }
+
+    CloseHandle(File);
+}
+
+START_TEST(TransmitFile)
+{
+    GUID TransmitFileGuid = WSAID_TRANSMITFILE;
+    WSADATA wdata;
+    SOCKET sck;
+    DWORD Length;
+    int err;
+
+    err = WSAStartup(MAKEWORD(2, 2), &wdata);
+    ok(err == 0, "WSAStartup failed, iResult == %d %d\n", err, WSAGetLastError());
+
+    sck = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (sck == INVALID_SOCKET ||
+        WSAIoctl(sck, SIO_GET_EXTENSION_FUNCTION_POINTER, &TransmitFileGuid, sizeof(TransmitFileGuid),
+                 &pTransmitFile, sizeof(pTransmitFile), &Length, NULL, NULL) == SOCKET_ERROR)
+    {
+        skip("No TransmitFile: %d\n", WSAGetLastError());
+        WSACleanup();
+        return;
+    }
+    closesocket(sck);
+
+    if (!CreateTestFile())
+    {
+        skip("Failed to create the file: %lu\n", GetLastError());
+        WSACleanup();
+        return;
+    }
+
+    Test_CachedFile();
+    Test_Cancel();
+
+    DeleteFileW(FileName);
+    WSACleanup();
+}
@@ -66,3 +66,51 @@ int GetRequestAndWait(SOCKET sck)
     
     return 1;
 }
+
+int CreateSocketPair(SOCKET* pAccepted, SOCKET* pConnected)
+{
+    SOCKET Listener;
+    struct sockaddr_in sa;
+    int Length = sizeof(sa);
+
+    *pAccepted = *pConnected = INVALID_SOCKET;
+
+    /* Loopback connection on whatever port is free */
+    Listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (Listener == INVALID_SOCKET)
+        return 0;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+    if (bind(Listener, (struct sockaddr *)&sa, sizeof(sa)) == SOCKET_ERROR ||
+        getsockname(Listener, (struct sockaddr *)&sa, &Length) == SOCKET_ERROR ||
+        listen(Listener, 1) == SOCKET_ERROR)
+    {
+        closesocket(Listener);
+        return 0;
+    }
+
+    *pConnected = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (*pConnected == INVALID_SOCKET ||
+        connect(*pConnected, (struct sockaddr *)&sa, sizeof(sa)) == SOCKET_ERROR)
+    {
+        if (*pConnected != INVALID_SOCKET)
+            closesocket(*pConnected);
+        *pConnected = INVALID_SOCKET;
+        closesocket(Listener);
+        return 0;
+    }
+
+    *pAccepted = accept(Listener, NULL, NULL);
+    closesocket(Listener);
+    if (*pAccepted == INVALID_SOCKET)
+    {
+        closesocket(*pConnected);
+        *pConnected = INVALID_SOCKET;
+        return 0;
+    }
+
+    return 1;
+}
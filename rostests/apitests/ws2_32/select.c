@@ -0,0 +1,315 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPL - See COPYING in the top level directory
+ * PURPOSE:         Test for select and AFD poll sets
+ */
+
+#include <apitest.h>
+
+#include <stdio.h>
+#include <ntstatus.h>
+#include <wine/winternl.h>
+#include "ws2_32.h"
+#include <tdi.h>
+#include <afd/shared.h>
+
+typedef struct _SELECT_THREAD
+{
+    SOCKET Socket;
+    SOCKET Other;
+    int Result;
+    DWORD Elapsed;
+} SELECT_THREAD, *PSELECT_THREAD;
+
+static
+void
+Test_SameSocketInSeveralSets(void)
+{
+    SOCKET Server, Client;
+    fd_set readfds, writefds, exceptfds;
+    struct timeval timeout = { 0, 0 };
+    char Buffer[8];
+    int ret;
+
+    if (!CreateSocketPair(&Server, &Client))
+    {
+        skip("Failed to connect: %d\n", WSAGetLastError());
+        return;
+    }
+
+    /* Only writable, and it says so in the write set only */
+    FD_ZERO(&readfds); FD_ZERO(&writefds); FD_ZERO(&exceptfds);
+    FD_SET(Server, &readfds); FD_SET(Server, &writefds); FD_SET(Server, &exceptfds);
+    ret = select(0, &readfds, &writefds, &exceptfds, &timeout);
+    ok(ret == 1, "select returned %d\n", ret);
+    ok(!FD_ISSET(Server, &readfds), "Socket is readable\n");
+    ok(FD_ISSET(Server, &writefds), "Socket isn't writable\n");
+    ok(!FD_ISSET(Server, &exceptfds), "Socket has an exception\n");
+
+    /* Readable too, and the count goes per set */
+    ok(send(Client, "abc", 3, 0) == 3, "send failed: %d\n", WSAGetLastError());
+    Sleep(100);
+    FD_ZERO(&readfds); FD_ZERO(&writefds); FD_ZERO(&exceptfds);
+    FD_SET(Server, &readfds); FD_SET(Server, &writefds); FD_SET(Server, &exceptfds);
+    ret = select(0, &readfds, &writefds, &exceptfds, &timeout);
+    ok(ret == 2, "select returned %d\n", ret);
+    ok(FD_ISSET(Server, &readfds), "Socket isn't readable\n");
+    ok(FD_ISSET(Server, &writefds), "Socket isn't writable\n");
+    ok(!FD_ISSET(Server, &exceptfds), "Socket has an exception\n");
+
+    ok(recv(Server, Buffer, sizeof(Buffer), 0) == 3, "recv failed: %d\n", WSAGetLastError());
+
+    /* A waiting select with one socket in two sets wakes up for either */
+    FD_ZERO(&readfds); FD_ZERO(&exceptfds);
+    FD_SET(Server, &readfds); FD_SET(Server, &exceptfds);
+    timeout.tv_sec = 0;
+    timeout.tv_usec = 200000;
+    ret = select(0, &readfds, NULL, &exceptfds, &timeout);
+    ok(ret == 0, "select without data returned %d\n", ret);
+
+    ok(send(Client, "x", 1, 0) == 1, "send failed: %d\n", WSAGetLastError());
+    FD_ZERO(&readfds); FD_ZERO(&exceptfds);
+    FD_SET(Server, &readfds); FD_SET(Server, &exceptfds);
+    timeout.tv_sec = 5;
+    ret = select(0, &readfds, NULL, &exceptfds, &timeout);
+    ok(ret == 1, "select returned %d\n", ret);
+    ok(FD_ISSET(Server, &readfds), "Socket isn't readable\n");
+    ok(!FD_ISSET(Server, &exceptfds), "Socket has an exception\n");
+
+    closesocket(Client);
+    closesocket(Server);
+}
+
+static
+DWORD
+WINAPI
+SelectThread(PVOID Param)
+{
+    PSELECT_THREAD Thread = Param;
+    struct timeval timeout = { 10, 0 };
+    fd_set readfds;
+    DWORD Start = GetTickCount();
+
+    FD_ZERO(&readfds);
+    FD_SET(Thread->Socket, &readfds);
+    if (Thread->Other != INVALID_SOCKET)
+        FD_SET(Thread->Other, &readfds);
+
+    Thread->Result = select(0, &readfds, NULL, NULL, &timeout);
+    Thread->Elapsed = GetTickCount() - Start;
+
+    return 0;
+}
+
+static
+void
+Test_CloseRegisteredSocket(void)
+{
+    SOCKET Server, Client, Server2, Client2;
+    SELECT_THREAD Thread;
+    HANDLE hThread;
+    struct timeval timeout = { 5, 0 };
+    fd_set readfds;
+    char Buffer[8];
+    int ret;
+
+    if (!CreateSocketPair(&Server, &Client) || !CreateSocketPair(&Server2, &Client2))
+    {
+        skip("Failed to connect: %d\n", WSAGetLastError());
+        return;
+    }
+
+    /* Closing a socket a select waits on ends the select */
+    Thread.Socket = Server;
+    Thread.Other = Server2;
+    hThread = CreateThread(NULL, 0, SelectThread, &Thread, 0, NULL);
+    ok(hThread != NULL, "CreateThread failed: %lu\n", GetLastError());
+    Sleep(200);
+
+    ok(closesocket(Server) == 0, "closesocket failed: %d\n", WSAGetLastError());
+    ok(WaitForSingleObject(hThread, 5000) == WAIT_OBJECT_0, "select didn't return after the close\n");
+    ok(Thread.Elapsed < 5000, "select took %lu ms\n", Thread.Elapsed);
+    CloseHandle(hThread);
+
+    /* The other socket still reports to a new select */
+    ok(send(Client2, "x", 1, 0) == 1, "send failed: %d\n", WSAGetLastError());
+    FD_ZERO(&readfds);
+    FD_SET(Server2, &readfds);
+    ret = select(0, &readfds, NULL, NULL, &timeout);
+    ok(ret == 1, "select returned %d\n", ret);
+    ok(FD_ISSET(Server2, &readfds), "Socket isn't readable\n");
+
+    /* And closing the peer of a waited socket reports it readable */
+    Thread.Socket = Server2;
+    Thread.Other = INVALID_SOCKET;
+    ok(recv(Server2, Buffer, sizeof(Buffer), 0) == 1, "recv failed: %d\n", WSAGetLastError());
+    hThread = CreateThread(NULL, 0, SelectThread, &Thread, 0, NULL);
+    ok(hThread != NULL, "CreateThread failed: %lu\n", GetLastError());
+    Sleep(200);
+
+    closesocket(Client2);
+    ok(WaitForSingleObject(hThread, 5000) == WAIT_OBJECT_0, "select didn't return after the peer closed\n");
+    ok(Thread.Result == 1, "select returned %d\n", Thread.Result);
+    CloseHandle(hThread);
+
+    closesocket(Server2);
+    closesocket(Client);
+}
+
+static
+NTSTATUS
+PollSetIoctl(SOCKET Set, ULONG Code, PVOID Buffer, ULONG InLength, ULONG OutLength, HANDLE Event, PIO_STATUS_BLOCK Iosb)
+{
+    return NtDeviceIoControlFile((HANDLE)Set, Event, NULL, NULL, Iosb, Code, Buffer, InLength, Buffer, OutLength);
+}
+
+static
+NTSTATUS
+PollSetUpdate(SOCKET Set, SOCKET Socket, ULONG Events)
+{
+    AFD_POLL_SET_UPDATE_INFO Update;
+    IO_STATUS_BLOCK Iosb;
+
+    Update.HandleCount = 1;
+    Update.Handles[0].Handle = Socket;
+    Update.Handles[0].Events = Events;
+    Update.Handles[0].Status = 0;
+
+    return PollSetIoctl(Set, IOCTL_AFD_POLL_SET_UPDATE, &Update, sizeof(Update), 0, NULL, &Iosb);
+}
+
+static
+NTSTATUS
+PollSetWait(SOCKET Set, LONGLONG Timeout, PAFD_POLL_SET_WAIT_INFO Wait, HANDLE Event)
+{
+    IO_STATUS_BLOCK Iosb;
+    NTSTATUS Status;
+
+    Wait->Timeout.QuadPart = Timeout;
+    Wait->HandleCount = 0;
+
+    Status = PollSetIoctl(Set, IOCTL_AFD_POLL_SET_WAIT, Wait, sizeof(*Wait), sizeof(*Wait), Event, &Iosb);
+    if (Status == STATUS_PENDING)
+    {
+        WaitForSingleObject(Event, INFINITE);
+        Status = Iosb.Status;
+    }
+
+    return Status;
+}
+
+static
+void
+Test_PollSet(void)
+{
+    SOCKET Set, Server, Client, Server2, Client2;
+    AFD_POLL_SET_WAIT_INFO Wait;
+    IO_STATUS_BLOCK Iosb;
+    HANDLE Event;
+    NTSTATUS Status;
+    DWORD Start, Elapsed;
+    char Buffer[8];
+
+    Set = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (Set == INVALID_SOCKET || !CreateSocketPair(&Server, &Client) || !CreateSocketPair(&Server2, &Client2))
+    {
+        skip("Failed to create the sockets: %d\n", WSAGetLastError());
+        return;
+    }
+    Event = CreateEventW(NULL, FALSE, FALSE, NULL);
+
+    /* No set yet */
+    Status = PollSetWait(Set, 0, &Wait, Event);
+    ok_ntstatus(Status, STATUS_INVALID_PARAMETER);
+
+    Status = PollSetUpdate(Set, Server, AFD_EVENT_RECEIVE);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    Status = PollSetUpdate(Set, Server2, AFD_EVENT_RECEIVE);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+
+    /* Nothing ready: a zero timeout polls, a relative one expires */
+    Status = PollSetWait(Set, 0, &Wait, Event);
+    ok_ntstatus(Status, STATUS_TIMEOUT);
+    ok(Wait.HandleCount == 0, "HandleCount is %lu\n", Wait.HandleCount);
+
+    Start = GetTickCount();
+    Status = PollSetWait(Set, -2000000, &Wait, Event);
+    Elapsed = GetTickCount() - Start;
+    ok_ntstatus(Status, STATUS_TIMEOUT);
+    ok(Wait.HandleCount == 0, "HandleCount is %lu\n", Wait.HandleCount);
+    ok(Elapsed >= 150 && Elapsed < 2000, "Timeout of 200 ms took %lu ms\n", Elapsed);
+
+    /* Only the ready socket comes back, and it stays ready until drained */
+    ok(send(Client2, "abc", 3, 0) == 3, "send failed: %d\n", WSAGetLastError());
+    Status = PollSetWait(Set, -50000000, &Wait, Event);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    ok(Wait.HandleCount == 1, "HandleCount is %lu\n", Wait.HandleCount);
+    ok(Wait.Handles[0].Handle == Server2, "Handle is %lx\n", (ULONG)Wait.Handles[0].Handle);
+    ok(Wait.Handles[0].Events == AFD_EVENT_RECEIVE, "Events are %lx\n", Wait.Handles[0].Events);
+
+    Status = PollSetWait(Set, 0, &Wait, Event);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    ok(Wait.HandleCount == 1 && Wait.Handles[0].Handle == Server2, "Level triggered socket wasn't reported again\n");
+
+    ok(recv(Server2, Buffer, sizeof(Buffer), 0) == 3, "recv failed: %d\n", WSAGetLastError());
+    Status = PollSetWait(Set, 0, &Wait, Event);
+    ok_ntstatus(Status, STATUS_TIMEOUT);
+
+    /* A pending wait is cancelable */
+    Wait.Timeout.QuadPart = -100000000;
+    Wait.HandleCount = 0;
+    Status = PollSetIoctl(Set, IOCTL_AFD_POLL_SET_WAIT, &Wait, sizeof(Wait), sizeof(Wait), Event, &Iosb);
+    ok_ntstatus(Status, STATUS_PENDING);
+    if (Status == STATUS_PENDING)
+    {
+        ok(WaitForSingleObject(Event, 200) == WAIT_TIMEOUT, "Wait finished early\n");
+        ok(CancelIo((HANDLE)Set), "CancelIo failed: %lu\n", GetLastError());
+        ok(WaitForSingleObject(Event, 5000) == WAIT_OBJECT_0, "Cancelled wait didn't complete\n");
+        ok_ntstatus(Iosb.Status, STATUS_CANCELLED);
+    }
+
+    /* A closed or removed socket doesn't come back */
+    Status = PollSetUpdate(Set, Server2, 0);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    ok(send(Client2, "x", 1, 0) == 1, "send failed: %d\n", WSAGetLastError());
+    ok(send(Client, "x", 1, 0) == 1, "send failed: %d\n", WSAGetLastError());
+    Sleep(100);
+    closesocket(Server);
+
+    Status = PollSetWait(Set, 0, &Wait, Event);
+    ok_ntstatus(Status, STATUS_TIMEOUT);
+    ok(Wait.HandleCount == 0, "HandleCount is %lu\n", Wait.HandleCount);
+
+    /* Closing the set ends a pending wait */
+    Status = PollSetUpdate(Set, Server2, AFD_EVENT_DISCONNECT);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    Wait.Timeout.QuadPart = -100000000;
+    Status = PollSetIoctl(Set, IOCTL_AFD_POLL_SET_WAIT, &Wait, sizeof(Wait), sizeof(Wait), Event, &Iosb);
+    ok_ntstatus(Status, STATUS_PENDING);
+    closesocket(Set);
+    if (Status == STATUS_PENDING)
+    {
+        ok(WaitForSingleObject(Event, 5000) == WAIT_OBJECT_0, "Wait on a closed set didn't complete\n");
+        ok_ntstatus(Iosb.Status, STATUS_CANCELLED);
+    }
+
+    CloseHandle(Event);
+    closesocket(Client);
+    closesocket(Server2);
+    closesocket(Client2);
+}
+
+START_TEST(select)
+{
+    WSADATA wdata;
+    int err;
+
+    err = WSAStartup(MAKEWORD(2, 2), &wdata);
+    ok(err == 0, "WSAStartup failed, iResult == %d %d\n", err, WSAGetLastError());
+
+    Test_SameSocketInSeveralSets();
+    Test_CloseRegisteredSocket();
+    Test_PollSet();
+
+    WSACleanup();
+}
@@ -3,6 +3,7 @@
 #define STANDALONE
 #include <apitest.h>
 
+extern void func_AcceptEx(void);
 extern void func_bind(void);
 extern void func_close(void);
 extern void func_getaddrinfo(void);
@@ -13,7 +14,9 @@ extern void func_ioctlsocket(void);
 extern void func_nonblocking(void);
 extern void func_nostartup(void);
 extern void func_recv(void);
+extern void func_select(void);
 extern void func_send(void);
+extern void func_TransmitFile(void);
 extern void func_WSAAsync(void);
 extern void func_WSAIoctl(void);
 extern void func_WSARecv(void);
@@ -21,6 +24,7 @@ extern void func_WSAStartup(void);
 
 const struct test winetest_testlist[] =
 {
+    { "AcceptEx", func_AcceptEx },
     { "bind", func_bind },
     { "close", func_close },
     { "getaddrinfo", func_getaddrinfo },
@@ -31,7 +35,9 @@ const struct test winetest_testlist[] =
     { "nonblocking", func_nonblocking },
     { "nostartup", func_nostartup },
     { "recv", func_recv },
+    { "select", func_select },
     { "send", func_send },
+    { "TransmitFile", func_TransmitFile },
     { "WSAAsync", func_WSAAsync },
     { "WSAIoctl", func_WSAIoctl },
     { "WSARecv", func_WSARecv },
@@ -30,6 +30,7 @@
 int CreateSocket(SOCKET* sck);
 int ConnectToReactOSWebsite(SOCKET sck);
 int GetRequestAndWait(SOCKET sck);
+int CreateSocketPair(SOCKET* pAccepted, SOCKET* pConnected);
 
 /* ws2_32.c */
 extern HANDLE g_hHeap;
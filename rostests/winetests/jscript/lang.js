@@ -1814,6 +1814,97 @@ function returnTest() {
 
 ok(returnTest() === undefined, "returnTest = " + returnTest());
 
+/* member expressions remember the last object and property they saw */
+(function() {
+    function getX(o) { return o.x; }
+    function setX(o, v) { o.x = v; }
+    function incX(o) { o.x += 1; return o.x; }
+    function callF(o) { return o.f(); }
+    function C() {}
+    var o, o2, i, r, wrong;
+
+    o = {x: 1};
+    ok(getX(o) === 1, "getX(o) = " + getX(o));
+    ok(getX(o) === 1, "getX(o) = " + getX(o));
+    delete o.x;
+    ok(getX(o) === undefined, "getX(o) after delete = " + getX(o));
+    ok(!("x" in o), "x in o after delete");
+    o.x = 2;
+    ok(getX(o) === 2, "getX(o) after re-adding = " + getX(o));
+    delete o.x;
+    setX(o, 3);
+    ok(o.x === 3, "o.x = " + o.x);
+    ok(getX(o) === 3, "getX(o) = " + getX(o));
+    ok(incX(o) === 4, "incX(o) = " + o.x);
+    delete o.x;
+    r = incX(o);
+    ok(isNaN(r), "incX(o) after delete = " + r);
+
+    /* objects alternating on the same instructions */
+    o = {x: 1};
+    o2 = {y: 0, x: 2};
+    for(i = 0; i < 10; i++) {
+        ok(getX(o) === 1, "getX(o) = " + getX(o));
+        ok(getX(o2) === 2, "getX(o2) = " + getX(o2));
+        ok(getX({}) === undefined, "getX({}) = " + getX({}));
+    }
+
+    /* properties found on the prototype */
+    C.prototype.x = 10;
+    o = new C();
+    ok(getX(o) === 10, "getX(o) = " + getX(o));
+    C.prototype.x = 11;
+    ok(getX(o) === 11, "getX(o) after changing the prototype = " + getX(o));
+    o.x = 12;
+    ok(getX(o) === 12, "getX(o) with an own property = " + getX(o));
+    delete o.x;
+    ok(getX(o) === 11, "getX(o) after deleting the own property = " + getX(o));
+    delete C.prototype.x;
+    ok(getX(o) === undefined, "getX(o) after deleting from the prototype = " + getX(o));
+    C.prototype.x = 13;
+    ok(getX(o) === 13, "getX(o) after re-adding to the prototype = " + getX(o));
+
+    /* writes through a prototype property create an own one */
+    setX(o, 14);
+    ok(o.hasOwnProperty("x"), "o has no own x");
+    ok(C.prototype.x === 13, "C.prototype.x = " + C.prototype.x);
+    ok(getX(new C()) === 13, "getX(new C()) = " + getX(new C()));
+
+    /* replacing the prototype only affects new objects */
+    o = new C();
+    ok(getX(o) === 13, "getX(o) = " + getX(o));
+    C.prototype = {x: 15, f: function() { return 1; }};
+    ok(getX(o) === 13, "getX(o) after replacing the prototype = " + getX(o));
+    o = new C();
+    ok(getX(o) === 15, "getX(new C()) = " + getX(o));
+    ok(callF(o) === 1, "callF(o) = " + callF(o));
+    C.prototype.f = function() { return 2; };
+    ok(callF(o) === 2, "callF(o) after changing the prototype = " + callF(o));
+    o.f = function() { return 3; };
+    ok(callF(o) === 3, "callF(o) with an own method = " + callF(o));
+    delete o.f;
+    ok(callF(o) === 2, "callF(o) after deleting the own method = " + callF(o));
+
+    /* new objects may get the address of ones that are gone */
+    wrong = 0;
+    for(i = 0; i < 1000; i++) {
+        switch(i % 4) {
+        case 0: o = {x: i}; break;
+        case 1: o = {a: 1, b: 2, x: i}; break;
+        case 2: o = {x: -1}; delete o.x; o.y = 0; o.x = i; break;
+        case 3: o = {y: i}; break;
+        }
+        r = getX(o);
+        if(r !== (i % 4 == 3 ? undefined : i))
+            wrong++;
+        setX(o, i + 1);
+        if(o.x !== i + 1)
+            wrong++;
+        o = null;
+    }
+    ok(wrong === 0, "wrong = " + wrong);
+})();
+
 ActiveXObject = 1;
 ok(ActiveXObject === 1, "ActiveXObject = " + ActiveXObject);
 
@@ -12597,6 +12597,346 @@ static void test_merging_text(void)
     free_bstrs();
 }
 
+#define check_child_list(a,b,c) _check_child_list(__LINE__,a,b,c)
+static void _check_child_list(unsigned line, IXMLDOMNodeList *list, const int *ids, LONG count)
+{
+    static const LONG order[] = {0, 1, 2, 7, 150, 149, 3, 199, 100, 101, 99, 40, 180};
+    char expected[16], name[16];
+    IXMLDOMNode *node;
+    LONG len, i, idx;
+    HRESULT hr;
+    BSTR str;
+
+    hr = IXMLDOMNodeList_get_length(list, &len);
+    ok_(__FILE__,line)(hr == S_OK, "get_length failed 0x%08x\n", hr);
+    ok_(__FILE__,line)(len == count, "got length %d, expected %d\n", len, count);
+
+    /* forwards, backwards and jumping around the list, so that every
+     * lookup starts from a different place */
+    for (i = 0; i < 2 * count + (LONG)(sizeof(order)/sizeof(order[0])); i++)
+    {
+        if (i < count)
+            idx = i;
+        else if (i < 2 * count)
+            idx = 2 * count - 1 - i;
+        else
+            idx = order[i - 2 * count];
+        if (idx >= count)
+            continue;
+
+        hr = IXMLDOMNodeList_get_item(list, idx, &node);
+        ok_(__FILE__,line)(hr == S_OK, "get_item(%d) failed 0x%08x\n", idx, hr);
+        if (hr != S_OK)
+            return;
+
+        hr = IXMLDOMNode_get_nodeName(node, &str);
+        ok_(__FILE__,line)(hr == S_OK, "get_nodeName failed 0x%08x\n", hr);
+        WideCharToMultiByte(CP_ACP, 0, str, -1, name, sizeof(name), NULL, NULL);
+        SysFreeString(str);
+        IXMLDOMNode_Release(node);
+
+        sprintf(expected, "e%d", ids[idx]);
+        if (strcmp(name, expected))
+        {
+            ok_(__FILE__,line)(0, "item(%d) is %s, expected %s\n", idx, name, expected);
+            return;
+        }
+    }
+
+    node = (IXMLDOMNode*)0xdeadbeef;
+    hr = IXMLDOMNodeList_get_item(list, count, &node);
+    ok_(__FILE__,line)(hr == S_FALSE, "get_item(%d) returned 0x%08x\n", count, hr);
+    ok_(__FILE__,line)(node == NULL, "got %p\n", node);
+}
+
+static IXMLDOMNode *create_child(IXMLDOMDocument *doc, int id)
+{
+    IXMLDOMElement *elem;
+    char name[16];
+    HRESULT hr;
+    BSTR str;
+
+    sprintf(name, "e%d", id);
+    str = alloc_str_from_narrow(name);
+    hr = IXMLDOMDocument_createElement(doc, str, &elem);
+    ok(hr == S_OK, "createElement failed 0x%08x\n", hr);
+    SysFreeString(str);
+    return (IXMLDOMNode*)elem;
+}
+
+static void test_childNodes_changes(void)
+{
+    IXMLDOMNode *node, *child, *removed;
+    IXMLDOMNodeList *list;
+    IXMLDOMElement *root;
+    IXMLDOMDocument *doc;
+    DOMNodeType type;
+    int ids[256];
+    LONG count, i;
+    HRESULT hr;
+    VARIANT v;
+
+    doc = create_document(&IID_IXMLDOMDocument);
+
+    hr = IXMLDOMDocument_createElement(doc, _bstr_("root"), &root);
+    EXPECT_HR(hr, S_OK);
+    hr = IXMLDOMDocument_appendChild(doc, (IXMLDOMNode*)root, NULL);
+    EXPECT_HR(hr, S_OK);
+
+    /* the list is live, it follows the changes made after getting it */
+    hr = IXMLDOMElement_get_childNodes(root, &list);
+    EXPECT_HR(hr, S_OK);
+    check_child_list(list, ids, 0);
+
+    for (count = 0; count < 200; count++)
+    {
+        child = create_child(doc, count);
+        hr = IXMLDOMElement_appendChild(root, child, NULL);
+        EXPECT_HR(hr, S_OK);
+        IXMLDOMNode_Release(child);
+        ids[count] = count;
+
+        if (count % 37 == 0)
+            check_child_list(list, ids, count + 1);
+    }
+    check_child_list(list, ids, count);
+
+    /* remove the node item() returned last, and ones before and after it */
+    hr = IXMLDOMNodeList_get_item(list, 120, &node);
+    EXPECT_HR(hr, S_OK);
+    hr = IXMLDOMElement_removeChild(root, node, &removed);
+    EXPECT_HR(hr, S_OK);
+    ok(removed == node, "got %p, expected %p\n", removed, node);
+    IXMLDOMNode_Release(removed);
+    IXMLDOMNode_Release(node);
+    memmove(ids + 120, ids + 121, (--count - 120) * sizeof(ids[0]));
+    check_child_list(list, ids, count);
+
+    for (i = 0; i < 2; i++)
+    {
+        hr = IXMLDOMNodeList_get_item(list, 100, &node);
+        EXPECT_HR(hr, S_OK);
+        IXMLDOMNode_Release(node);
+
+        hr = IXMLDOMNodeList_get_item(list, i ? 150 : 50, &node);
+        EXPECT_HR(hr, S_OK);
+        hr = IXMLDOMElement_removeChild(root, node, NULL);
+        EXPECT_HR(hr, S_OK);
+        IXMLDOMNode_Release(node);
+        memmove(ids + (i ? 150 : 50), ids + (i ? 151 : 51), (--count - (i ? 150 : 50)) * sizeof(ids[0]));
+        check_child_list(list, ids, count);
+    }
+
+    /* the first and the last child */
+    hr = IXMLDOMElement_get_firstChild(root, &node);
+    EXPECT_HR(hr, S_OK);
+    hr = IXMLDOMElement_removeChild(root, node, NULL);
+    EXPECT_HR(hr, S_OK);
+    IXMLDOMNode_Release(node);
+    memmove(ids, ids + 1, --count * sizeof(ids[0]));
+    check_child_list(list, ids, count);
+
+    hr = IXMLDOMElement_get_lastChild(root, &node);
+    EXPECT_HR(hr, S_OK);
+    hr = IXMLDOMElement_removeChild(root, node, NULL);
+    EXPECT_HR(hr, S_OK);
+    IXMLDOMNode_Release(node);
+    count--;
+    check_child_list(list, ids, count);
+
+    /* replace the node item() returned last, and one far from it */
+    for (i = 0; i < 2; i++)
+    {
+        LONG idx = i ? 3 : 80;
+
+        hr = IXMLDOMNodeList_get_item(list, 80, &node);
+        EXPECT_HR(hr, S_OK);
+
+        if (i)
+        {
+            IXMLDOMNode_Release(node);
+            hr = IXMLDOMNodeList_get_item(list, idx, &node);
+            EXPECT_HR(hr, S_OK);
+        }
+
+        child = create_child(doc, 1000 + i);
+        hr = IXMLDOMElement_replaceChild(root, child, node, &removed);
+        EXPECT_HR(hr, S_OK);
+        ok(removed == node, "got %p, expected %p\n", removed, node);
+        IXMLDOMNode_Release(removed);
+        IXMLDOMNode_Release(child);
+        IXMLDOMNode_Release(node);
+        ids[idx] = 1000 + i;
+        check_child_list(list, ids, count);
+    }
+
+    /* appending a node that is already a child moves it to the end */
+    hr = IXMLDOMNodeList_get_item(list, 10, &node);
+    EXPECT_HR(hr, S_OK);
+    hr = IXMLDOMElement_appendChild(root, node, NULL);
+    EXPECT_HR(hr, S_OK);
+    IXMLDOMNode_Release(node);
+    i = ids[10];
+    memmove(ids + 10, ids + 11, (count - 11) * sizeof(ids[0]));
+    ids[count - 1] = i;
+    check_child_list(list, ids, count);
+
+    /* and inserting one in front shifts everything */
+    hr = IXMLDOMNodeList_get_item(list, 0, &node);
+    EXPECT_HR(hr, S_OK);
+    child = create_child(doc, 2000);
+    V_VT(&v) = VT_DISPATCH;
+    V_DISPATCH(&v) = (IDispatch*)node;
+    hr = IXMLDOMElement_insertBefore(root, child, v, NULL);
+    EXPECT_HR(hr, S_OK);
+    IXMLDOMNode_Release(child);
+    IXMLDOMNode_Release(node);
+    memmove(ids + 1, ids, count++ * sizeof(ids[0]));
+    ids[0] = 2000;
+    check_child_list(list, ids, count);
+
+    /* put_text replaces all the children with a single text node */
+    hr = IXMLDOMNodeList_get_item(list, count - 1, &node);
+    EXPECT_HR(hr, S_OK);
+    IXMLDOMNode_Release(node);
+
+    hr = IXMLDOMElement_put_text(root, _bstr_("text"));
+    EXPECT_HR(hr, S_OK);
+
+    hr = IXMLDOMNodeList_get_length(list, &count);
+    EXPECT_HR(hr, S_OK);
+    ok(count == 1, "got length %d\n", count);
+
+    hr = IXMLDOMNodeList_get_item(list, 0, &node);
+    EXPECT_HR(hr, S_OK);
+    hr = IXMLDOMNode_get_nodeType(node, &type);
+    EXPECT_HR(hr, S_OK);
+    ok(type == NODE_TEXT, "got type %d\n", type);
+    IXMLDOMNode_Release(node);
+
+    node = (IXMLDOMNode*)0xdeadbeef;
+    hr = IXMLDOMNodeList_get_item(list, 1, &node);
+    EXPECT_HR(hr, S_FALSE);
+    ok(node == NULL, "got %p\n", node);
+
+    /* and the list grows again from there */
+    child = create_child(doc, 3000);
+    hr = IXMLDOMElement_appendChild(root, child, NULL);
+    EXPECT_HR(hr, S_OK);
+    IXMLDOMNode_Release(child);
+
+    hr = IXMLDOMNodeList_get_length(list, &count);
+    EXPECT_HR(hr, S_OK);
+    ok(count == 2, "got length %d\n", count);
+    hr = IXMLDOMNodeList_get_item(list, 1, &node);
+    EXPECT_HR(hr, S_OK);
+    IXMLDOMNode_Release(node);
+
+    IXMLDOMNodeList_Release(list);
+    IXMLDOMElement_Release(root);
+    IXMLDOMDocument_Release(doc);
+
+    free_bstrs();
+}
+
+/* creates a node in a document that is released right away, so the node
+ * holds the last reference to it */
+static IXMLDOMNode *create_stray_child(int id)
+{
+    IXMLDOMDocument *doc;
+    IXMLDOMNode *child;
+    LONG ref;
+
+    doc = create_document(&IID_IXMLDOMDocument);
+    child = create_child(doc, id);
+    ref = IXMLDOMDocument_Release(doc);
+    ok(ref == 0, "got %d\n", ref);
+    return child;
+}
+
+static void test_move_between_docs(void)
+{
+    IXMLDOMNode *node, *child, *removed;
+    IXMLDOMElement *root, *elem;
+    IXMLDOMNodeList *list;
+    IXMLDOMDocument *doc;
+    int ids[4];
+    HRESULT hr;
+    VARIANT v;
+    BSTR str;
+
+    doc = create_document(&IID_IXMLDOMDocument);
+
+    hr = IXMLDOMDocument_createElement(doc, _bstr_("root"), &root);
+    EXPECT_HR(hr, S_OK);
+    hr = IXMLDOMDocument_appendChild(doc, (IXMLDOMNode*)root, NULL);
+    EXPECT_HR(hr, S_OK);
+    hr = IXMLDOMElement_get_childNodes(root, &list);
+    EXPECT_HR(hr, S_OK);
+
+    /* the source document goes away once the node has left it */
+    child = create_stray_child(0);
+    hr = IXMLDOMElement_appendChild(root, child, NULL);
+    EXPECT_HR(hr, S_OK);
+    IXMLDOMNode_Release(child);
+    ids[0] = 0;
+    check_child_list(list, ids, 1);
+
+    hr = IXMLDOMNodeList_get_item(list, 0, &node);
+    EXPECT_HR(hr, S_OK);
+    child = create_stray_child(1);
+    V_VT(&v) = VT_DISPATCH;
+    V_DISPATCH(&v) = (IDispatch*)node;
+    hr = IXMLDOMElement_insertBefore(root, child, v, NULL);
+    EXPECT_HR(hr, S_OK);
+    IXMLDOMNode_Release(child);
+    IXMLDOMNode_Release(node);
+    ids[0] = 1;
+    ids[1] = 0;
+    check_child_list(list, ids, 2);
+
+    hr = IXMLDOMNodeList_get_item(list, 1, &node);
+    EXPECT_HR(hr, S_OK);
+    child = create_stray_child(2);
+    hr = IXMLDOMElement_replaceChild(root, child, node, &removed);
+    EXPECT_HR(hr, S_OK);
+    ok(removed == node, "got %p, expected %p\n", removed, node);
+    IXMLDOMNode_Release(removed);
+    IXMLDOMNode_Release(child);
+    IXMLDOMNode_Release(node);
+    ids[1] = 2;
+    check_child_list(list, ids, 2);
+
+    IXMLDOMNodeList_Release(list);
+
+    /* a new document element, the old one stays usable */
+    child = create_stray_child(3);
+    hr = IXMLDOMNode_QueryInterface(child, &IID_IXMLDOMElement, (void**)&elem);
+    EXPECT_HR(hr, S_OK);
+    IXMLDOMNode_Release(child);
+    hr = IXMLDOMDocument_putref_documentElement(doc, elem);
+    EXPECT_HR(hr, S_OK);
+    IXMLDOMElement_Release(elem);
+
+    hr = IXMLDOMDocument_get_documentElement(doc, &elem);
+    EXPECT_HR(hr, S_OK);
+    hr = IXMLDOMElement_get_tagName(elem, &str);
+    EXPECT_HR(hr, S_OK);
+    ok(!lstrcmpW(str, _bstr_("e3")), "got %s\n", wine_dbgstr_w(str));
+    SysFreeString(str);
+    IXMLDOMElement_Release(elem);
+
+    hr = IXMLDOMElement_get_childNodes(root, &list);
+    EXPECT_HR(hr, S_OK);
+    check_child_list(list, ids, 2);
+    IXMLDOMNodeList_Release(list);
+
+    IXMLDOMElement_Release(root);
+    IXMLDOMDocument_Release(doc);
+
+    free_bstrs();
+}
+
 START_TEST(domdoc)
 {
     HRESULT hr;
@@ -12678,6 +13018,8 @@ START_TEST(domdoc)
     test_xmlns_attribute();
     test_url();
     test_merging_text();
+    test_childNodes_changes();
+    test_move_between_docs();
 
     test_xsltemplate();
     test_xsltext();
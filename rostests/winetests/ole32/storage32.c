@@ -3923,6 +3923,354 @@ static void test_custom_lockbytes(void)
     DeleteTestLockBytes(lockbytes);
 }
 
+static BYTE pattern_byte(ULONG offset, BYTE seed)
+{
+    /* differs between sectors, so blocks read from the wrong place show up */
+    return (BYTE)(offset * 13 + (offset >> 9) + seed);
+}
+
+static void write_pattern(IStream *stm, ULONG offset, ULONG size, BYTE seed)
+{
+    BYTE buffer[5000];
+    LARGE_INTEGER pos;
+    ULONG done, len, written, i;
+    HRESULT r;
+
+    pos.QuadPart = offset;
+    r = IStream_Seek(stm, pos, STREAM_SEEK_SET, NULL);
+    ok(r==S_OK, "IStream->Seek failed %x\n", r);
+
+    /* odd chunks, so that writes start and end in the middle of blocks */
+    for (done = 0; done < size; done += len)
+    {
+        len = min(sizeof(buffer), size - done);
+        for (i = 0; i < len; i++)
+            buffer[i] = pattern_byte(offset + done + i, seed);
+        r = IStream_Write(stm, buffer, len, &written);
+        if (r != S_OK || written != len)
+        {
+            ok(0, "IStream->Write at %u failed %x, wrote %u bytes\n", offset + done, r, written);
+            break;
+        }
+    }
+}
+
+#define check_pattern(a,b,c,d) _check_pattern(__LINE__,a,b,c,d)
+static void _check_pattern(unsigned line, IStream *stm, ULONG offset, ULONG size, BYTE seed)
+{
+    BYTE buffer[7000];
+    LARGE_INTEGER pos;
+    ULONG done, len, bytesread, i;
+    HRESULT r;
+
+    pos.QuadPart = offset;
+    r = IStream_Seek(stm, pos, STREAM_SEEK_SET, NULL);
+    ok_(__FILE__,line)(r==S_OK, "IStream->Seek failed %x\n", r);
+
+    for (done = 0; done < size; done += len)
+    {
+        len = min(sizeof(buffer), size - done);
+        r = IStream_Read(stm, buffer, len, &bytesread);
+        if (r != S_OK || bytesread != len)
+        {
+            ok_(__FILE__,line)(0, "IStream->Read at %u failed %x, read %u bytes\n", offset + done, r, bytesread);
+            return;
+        }
+        for (i = 0; i < len; i++)
+        {
+            if (buffer[i] != pattern_byte(offset + done + i, seed))
+            {
+                ok_(__FILE__,line)(0, "wrong data at %u\n", offset + done + i);
+                return;
+            }
+        }
+    }
+}
+
+#define check_stream_size(a,b) _check_stream_size(__LINE__,a,b)
+static void _check_stream_size(unsigned line, IStream *stm, ULONG size)
+{
+    STATSTG statstg;
+    HRESULT r;
+
+    r = IStream_Stat(stm, &statstg, STATFLAG_NONAME);
+    ok_(__FILE__,line)(r==S_OK, "IStream->Stat failed %x\n", r);
+    ok_(__FILE__,line)(statstg.cbSize.QuadPart == size, "stream is %u bytes, expected %u\n",
+                       (ULONG)statstg.cbSize.QuadPart, size);
+}
+
+static void test_large_streams(void)
+{
+    IStorage *stg = NULL;
+    IStream *stm1 = NULL, *stm2 = NULL, *stm3 = NULL;
+    ULARGE_INTEGER size;
+    HRESULT r;
+    ULONG offset;
+
+    DeleteFileA(filenameA);
+
+    r = StgCreateDocfile(filename, STGM_CREATE | STGM_READWRITE | STGM_SHARE_EXCLUSIVE, 0, &stg);
+    ok(r==S_OK, "StgCreateDocfile failed %x\n", r);
+
+    r = IStorage_CreateStream(stg, strmA_name, STGM_SHARE_EXCLUSIVE | STGM_READWRITE, 0, 0, &stm1);
+    ok(r==S_OK, "IStorage->CreateStream failed %x\n", r);
+    r = IStorage_CreateStream(stg, strmB_name, STGM_SHARE_EXCLUSIVE | STGM_READWRITE, 0, 0, &stm2);
+    ok(r==S_OK, "IStorage->CreateStream failed %x\n", r);
+    r = IStorage_CreateStream(stg, strmC_name, STGM_SHARE_EXCLUSIVE | STGM_READWRITE, 0, 0, &stm3);
+    ok(r==S_OK, "IStorage->CreateStream failed %x\n", r);
+    if (r != S_OK)
+    {
+        if (stm1) IStream_Release(stm1);
+        if (stm2) IStream_Release(stm2);
+        if (stg) IStorage_Release(stg);
+        DeleteFileA(filenameA);
+        return;
+    }
+
+    /* interleave the writes, so that the chains are fragmented, and go past
+     * the 109 depot blocks the header can hold */
+    for (offset = 0; offset < 4 * 1024 * 1024; offset += 65536)
+    {
+        write_pattern(stm1, offset, 65536, 1);
+        write_pattern(stm2, offset, 65536, 2);
+    }
+    write_pattern(stm3, 0, 1000, 3);
+
+    /* read back what may still be cached */
+    check_pattern(stm1, 0, 4 * 1024 * 1024, 1);
+    check_pattern(stm2, 0, 4 * 1024 * 1024, 2);
+    check_pattern(stm3, 0, 1000, 3);
+
+    /* overwrite across block boundaries and give blocks back */
+    write_pattern(stm1, 1000300, 70000, 4);
+    size.QuadPart = 100000;
+    r = IStream_SetSize(stm2, size);
+    ok(r==S_OK, "IStream->SetSize failed %x\n", r);
+
+    IStream_Release(stm1);
+    IStream_Release(stm2);
+    IStream_Release(stm3);
+    IStorage_Release(stg);
+
+    /* everything made it to the file */
+    r = StgOpenStorage(filename, NULL, STGM_READWRITE | STGM_SHARE_EXCLUSIVE, NULL, 0, &stg);
+    ok(r==S_OK, "StgOpenStorage failed %x\n", r);
+    if (r != S_OK)
+    {
+        DeleteFileA(filenameA);
+        return;
+    }
+
+    r = IStorage_OpenStream(stg, strmA_name, NULL, STGM_SHARE_EXCLUSIVE | STGM_READWRITE, 0, &stm1);
+    ok(r==S_OK, "IStorage->OpenStream failed %x\n", r);
+    check_stream_size(stm1, 4 * 1024 * 1024);
+    check_pattern(stm1, 0, 1000300, 1);
+    check_pattern(stm1, 1000300, 70000, 4);
+    check_pattern(stm1, 1070300, 4 * 1024 * 1024 - 1070300, 1);
+
+    r = IStorage_OpenStream(stg, strmB_name, NULL, STGM_SHARE_EXCLUSIVE | STGM_READWRITE, 0, &stm2);
+    ok(r==S_OK, "IStorage->OpenStream failed %x\n", r);
+    check_stream_size(stm2, 100000);
+    check_pattern(stm2, 0, 100000, 2);
+
+    r = IStorage_OpenStream(stg, strmC_name, NULL, STGM_SHARE_EXCLUSIVE | STGM_READWRITE, 0, &stm3);
+    ok(r==S_OK, "IStorage->OpenStream failed %x\n", r);
+    check_stream_size(stm3, 1000);
+    check_pattern(stm3, 0, 1000, 3);
+
+    /* grow the second stream again into the blocks it gave back */
+    write_pattern(stm2, 100000, 2 * 1024 * 1024, 5);
+
+    IStream_Release(stm1);
+    IStream_Release(stm2);
+    IStream_Release(stm3);
+    IStorage_Release(stg);
+
+    r = StgOpenStorage(filename, NULL, STGM_READ | STGM_SHARE_DENY_WRITE, NULL, 0, &stg);
+    ok(r==S_OK, "StgOpenStorage failed %x\n", r);
+    if (r == S_OK)
+    {
+        r = IStorage_OpenStream(stg, strmA_name, NULL, STGM_SHARE_EXCLUSIVE | STGM_READ, 0, &stm1);
+        ok(r==S_OK, "IStorage->OpenStream failed %x\n", r);
+        check_pattern(stm1, 0, 1000300, 1);
+        check_pattern(stm1, 1000300, 70000, 4);
+        check_pattern(stm1, 1070300, 4 * 1024 * 1024 - 1070300, 1);
+        IStream_Release(stm1);
+
+        r = IStorage_OpenStream(stg, strmB_name, NULL, STGM_SHARE_EXCLUSIVE | STGM_READ, 0, &stm2);
+        ok(r==S_OK, "IStorage->OpenStream failed %x\n", r);
+        check_stream_size(stm2, 100000 + 2 * 1024 * 1024);
+        check_pattern(stm2, 0, 100000, 2);
+        check_pattern(stm2, 100000, 2 * 1024 * 1024, 5);
+        IStream_Release(stm2);
+
+        IStorage_Release(stg);
+    }
+
+    DeleteFileA(filenameA);
+}
+
+static void test_large_transacted(void)
+{
+    IStorage *stg = NULL;
+    IStream *stm = NULL;
+    HRESULT r;
+
+    DeleteFileA(filenameA);
+
+    r = StgCreateDocfile(filename, STGM_CREATE | STGM_READWRITE | STGM_TRANSACTED, 0, &stg);
+    ok(r==S_OK, "StgCreateDocfile failed %x\n", r);
+    if (r != S_OK)
+        return;
+
+    r = IStorage_CreateStream(stg, strmA_name, STGM_SHARE_EXCLUSIVE | STGM_READWRITE, 0, 0, &stm);
+    ok(r==S_OK, "IStorage->CreateStream failed %x\n", r);
+    write_pattern(stm, 0, 1024 * 1024, 1);
+    IStream_Release(stm);
+
+    r = IStorage_Commit(stg, STGC_DEFAULT);
+    ok(r==S_OK, "IStorage->Commit failed %x\n", r);
+
+    /* change and grow it, then throw that away */
+    r = IStorage_OpenStream(stg, strmA_name, NULL, STGM_SHARE_EXCLUSIVE | STGM_READWRITE, 0, &stm);
+    ok(r==S_OK, "IStorage->OpenStream failed %x\n", r);
+    write_pattern(stm, 0, 1536 * 1024, 2);
+    check_pattern(stm, 0, 1536 * 1024, 2);
+    IStream_Release(stm);
+
+    r = IStorage_Revert(stg);
+    ok(r==S_OK, "IStorage->Revert failed %x\n", r);
+
+    r = IStorage_OpenStream(stg, strmA_name, NULL, STGM_SHARE_EXCLUSIVE | STGM_READWRITE, 0, &stm);
+    ok(r==S_OK, "IStorage->OpenStream failed %x\n", r);
+    check_stream_size(stm, 1024 * 1024);
+    check_pattern(stm, 0, 1024 * 1024, 1);
+
+    /* now keep a change */
+    write_pattern(stm, 300000, 2 * 1024 * 1024, 3);
+    IStream_Release(stm);
+
+    r = IStorage_Commit(stg, STGC_DEFAULT);
+    ok(r==S_OK, "IStorage->Commit failed %x\n", r);
+
+    IStorage_Release(stg);
+
+    r = StgOpenStorage(filename, NULL, STGM_READ | STGM_SHARE_DENY_WRITE, NULL, 0, &stg);
+    ok(r==S_OK, "StgOpenStorage failed %x\n", r);
+    if (r == S_OK)
+    {
+        r = IStorage_OpenStream(stg, strmA_name, NULL, STGM_SHARE_EXCLUSIVE | STGM_READ, 0, &stm);
+        ok(r==S_OK, "IStorage->OpenStream failed %x\n", r);
+        check_stream_size(stm, 300000 + 2 * 1024 * 1024);
+        check_pattern(stm, 0, 300000, 1);
+        check_pattern(stm, 300000, 2 * 1024 * 1024, 3);
+        IStream_Release(stm);
+
+        IStorage_Release(stg);
+    }
+
+    DeleteFileA(filenameA);
+}
+
+static void test_large_shared(void)
+{
+    IStorage *stg = NULL, *stg1 = NULL, *stg2 = NULL;
+    IStream *stm = NULL;
+    STATSTG statstg;
+    HRESULT r;
+
+    DeleteFileA(filenameA);
+
+    r = StgCreateDocfile(filename, STGM_CREATE | STGM_READWRITE | STGM_SHARE_EXCLUSIVE, 0, &stg);
+    ok(r==S_OK, "StgCreateDocfile failed %x\n", r);
+    if (r != S_OK)
+        return;
+
+    r = IStorage_CreateStream(stg, strmA_name, STGM_SHARE_EXCLUSIVE | STGM_READWRITE, 0, 0, &stm);
+    ok(r==S_OK, "IStorage->CreateStream failed %x\n", r);
+    write_pattern(stm, 0, 1024 * 1024, 1);
+    IStream_Release(stm);
+
+    r = IStorage_CreateStream(stg, strmB_name, STGM_SHARE_EXCLUSIVE | STGM_READWRITE, 0, 0, &stm);
+    ok(r==S_OK, "IStorage->CreateStream failed %x\n", r);
+    write_pattern(stm, 0, 300000, 2);
+    IStream_Release(stm);
+
+    IStorage_Release(stg);
+
+    /* two instances sharing the file */
+    r = StgOpenStorage(filename, NULL, STGM_READWRITE | STGM_TRANSACTED | STGM_SHARE_DENY_NONE, NULL, 0, &stg1);
+    ok(r==S_OK, "StgOpenStorage failed %x\n", r);
+    r = StgOpenStorage(filename, NULL, STGM_READWRITE | STGM_TRANSACTED | STGM_SHARE_DENY_NONE, NULL, 0, &stg2);
+    ok(r==S_OK, "StgOpenStorage failed %x\n", r);
+    if (!stg1 || !stg2)
+    {
+        if (stg1) IStorage_Release(stg1);
+        if (stg2) IStorage_Release(stg2);
+        DeleteFileA(filenameA);
+        return;
+    }
+
+    /* the second instance reads everything, so it knows the old layout */
+    r = IStorage_OpenStream(stg2, strmA_name, NULL, STGM_SHARE_EXCLUSIVE | STGM_READWRITE, 0, &stm);
+    ok(r==S_OK, "IStorage->OpenStream failed %x\n", r);
+    check_pattern(stm, 0, 1024 * 1024, 1);
+    IStream_Release(stm);
+
+    /* the first one rewrites the file under it */
+    r = IStorage_OpenStream(stg1, strmA_name, NULL, STGM_SHARE_EXCLUSIVE | STGM_READWRITE, 0, &stm);
+    ok(r==S_OK, "IStorage->OpenStream failed %x\n", r);
+    write_pattern(stm, 0, 1200 * 1024, 3);
+    IStream_Release(stm);
+
+    r = IStorage_Commit(stg1, STGC_ONLYIFCURRENT);
+    ok(r==S_OK, "IStorage->Commit failed %x\n", r);
+
+    /* the second one then has to forget what it knew before it can commit */
+    r = IStorage_OpenStream(stg2, strmB_name, NULL, STGM_SHARE_EXCLUSIVE | STGM_READWRITE, 0, &stm);
+    ok(r==S_OK, "IStorage->OpenStream failed %x\n", r);
+    write_pattern(stm, 0, 500000, 4);
+    IStream_Release(stm);
+
+    r = IStorage_Commit(stg2, STGC_ONLYIFCURRENT);
+    ok(r==STG_E_NOTCURRENT, "IStorage->Commit failed %x\n", r);
+
+    r = IStorage_Commit(stg2, STGC_DEFAULT);
+    ok(r==S_OK, "IStorage->Commit failed %x\n", r);
+
+    IStorage_Release(stg1);
+    IStorage_Release(stg2);
+
+    /* whichever version of the first stream won, the file is consistent */
+    r = StgOpenStorage(filename, NULL, STGM_READ | STGM_SHARE_DENY_WRITE, NULL, 0, &stg);
+    ok(r==S_OK, "StgOpenStorage failed %x\n", r);
+    if (r == S_OK)
+    {
+        r = IStorage_OpenStream(stg, strmA_name, NULL, STGM_SHARE_EXCLUSIVE | STGM_READ, 0, &stm);
+        ok(r==S_OK, "IStorage->OpenStream failed %x\n", r);
+        r = IStream_Stat(stm, &statstg, STATFLAG_NONAME);
+        ok(r==S_OK, "IStream->Stat failed %x\n", r);
+        if (statstg.cbSize.QuadPart == 1024 * 1024)
+            check_pattern(stm, 0, 1024 * 1024, 1);
+        else
+        {
+            check_stream_size(stm, 1200 * 1024);
+            check_pattern(stm, 0, 1200 * 1024, 3);
+        }
+        IStream_Release(stm);
+
+        r = IStorage_OpenStream(stg, strmB_name, NULL, STGM_SHARE_EXCLUSIVE | STGM_READ, 0, &stm);
+        ok(r==S_OK, "IStorage->OpenStream failed %x\n", r);
+        check_stream_size(stm, 500000);
+        check_pattern(stm, 0, 500000, 4);
+        IStream_Release(stm);
+
+        IStorage_Release(stg);
+    }
+
+    DeleteFileA(filenameA);
+}
+
 START_TEST(storage32)
 {
     CHAR temp[MAX_PATH];
@@ -3972,4 +4320,7 @@ START_TEST(storage32)
     test_transacted_shared();
     test_overwrite();
     test_custom_lockbytes();
+    test_large_streams();
+    test_large_transacted();
+    test_large_shared();
 }
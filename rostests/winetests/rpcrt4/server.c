@@ -835,6 +835,17 @@ void __cdecl s_stop(void)
   ok(SetEvent(stop_event), "SetEvent\n");
 }
 
+void __cdecl s_hang(void)
+{
+  HANDLE event = OpenEventA(EVENT_MODIFY_STATE, FALSE, "wine_rpcrt4_test_hang");
+
+  ok(event != NULL, "OpenEvent failed with error %d\n", GetLastError());
+  ok(SetEvent(event), "SetEvent\n");
+  CloseHandle(event);
+  /* the client kills the process before this returns */
+  Sleep(30000);
+}
+
 static void
 make_cmdline(char buffer[MAX_PATH], const char *test)
 {
@@ -1555,6 +1566,35 @@ void __cdecl s_authinfo_test(unsigned int protseq, int secure)
     }
 }
 
+static void
+lrpc_tests(void)
+{
+  /* larger than the section ncalrpc copies big fragments through */
+  const int n = 60000;
+  int *x, i, sum = 0, wrong = 0;
+  pints_t *pn;
+
+  x = HeapAlloc(GetProcessHeap(), 0, n * sizeof(*x));
+  for (i = 0; i < n; i++)
+  {
+    x[i] = i % 1000 - 500;
+    sum += x[i];
+  }
+  ok(sum_conf_array(x, n) == sum, "RPC sum_conf_array\n");
+  HeapFree(GetProcessHeap(), 0, x);
+
+  pn = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, n * sizeof(*pn));
+  get_numbers(n, n, pn);
+  for (i = 0; i < n; i++)
+  {
+    if (!pn[i].pi || *pn[i].pi != i)
+      wrong++;
+    MIDL_user_free(pn[i].pi);
+  }
+  ok(wrong == 0, "RPC get_numbers returned %d wrong numbers\n", wrong);
+  HeapFree(GetProcessHeap(), 0, pn);
+}
+
 static void
 run_tests(void)
 {
@@ -1645,6 +1685,7 @@ client(const char *test)
     ok(RPC_S_OK == RpcBindingFromStringBindingA(binding, &IServer_IfHandle), "RpcBindingFromStringBinding\n");
 
     run_tests(); /* can cause RPC_X_BAD_STUB_DATA exception */
+    lrpc_tests();
     authinfo_test(RPC_PROTSEQ_LRPC, 0);
     test_is_server_listening(IServer_IfHandle, RPC_S_OK);
 
@@ -1790,6 +1831,164 @@ static void test_server_listening(void)
     ok(status == RPC_S_NOT_LISTENING, "RpcMgmtWaitServerListening failed with status %d\n", status);
 }
 
+static DWORD WINAPI lrpc_client_thread(void *arg)
+{
+    DWORD ret = RPC_S_OK;
+
+    RpcTryExcept
+    {
+        ok(int_return() == INT_CODE, "RPC int_return\n");
+    }
+    RpcExcept(TRUE)
+    {
+        ret = RpcExceptionCode();
+    }
+    RpcEndExcept
+    return ret;
+}
+
+static void test_lrpc_listening(void)
+{
+    static unsigned char ncalrpc[] = "ncalrpc";
+    static unsigned char endpoint[] = "wine_rpcrt4_test_listen";
+    unsigned char *binding;
+    RPC_STATUS status;
+    HANDLE thread;
+    DWORD ret;
+
+    status = RpcServerUseProtseqEpA(ncalrpc, 0, endpoint, NULL);
+    ok(status == RPC_S_OK, "RpcServerUseProtseqEp(ncalrpc) failed with status %d\n", status);
+
+    status = RpcServerRegisterIf(s_IServer_v0_0_s_ifspec, NULL, NULL);
+    ok(status == RPC_S_OK, "RpcServerRegisterIf failed with status %d\n", status);
+
+    ok(RPC_S_OK == RpcStringBindingComposeA(NULL, ncalrpc, NULL, endpoint, NULL, &binding), "RpcStringBindingCompose\n");
+    ok(RPC_S_OK == RpcBindingFromStringBindingA(binding, &IServer_IfHandle), "RpcBindingFromStringBinding\n");
+    test_is_server_listening2(IServer_IfHandle, RPC_S_NOT_LISTENING, RPC_S_SERVER_UNAVAILABLE);
+
+    /* a client connecting before the server listens is accepted once it does */
+    thread = CreateThread(NULL, 0, lrpc_client_thread, NULL, 0, NULL);
+    ok(thread != NULL, "CreateThread failed with error %d\n", GetLastError());
+    ret = WaitForSingleObject(thread, 500);
+    if (ret == WAIT_OBJECT_0)
+    {
+        GetExitCodeThread(thread, &ret);
+        win_skip("the call failed before the server listened, status %u\n", ret);
+    }
+    else
+        ok(ret == WAIT_TIMEOUT, "WaitForSingleObject returned %u\n", ret);
+
+    status = RpcServerListen(1, 20, TRUE);
+    ok(status == RPC_S_OK, "RpcServerListen failed with status %d\n", status);
+    ok(WaitForSingleObject(thread, 10000) == WAIT_OBJECT_0, "the call didn't finish\n");
+    GetExitCodeThread(thread, &ret);
+    ok(ret == RPC_S_OK, "the call failed with status %u\n", ret);
+    CloseHandle(thread);
+
+    /* and a client connecting now is served right away */
+    ok(lrpc_client_thread(NULL) == RPC_S_OK, "the second call failed\n");
+    test_is_server_listening(IServer_IfHandle, RPC_S_OK);
+
+    status = RpcMgmtStopServerListening(NULL);
+    ok(status == RPC_S_OK, "RpcMgmtStopServerListening\n");
+    test_is_server_listening2(IServer_IfHandle, RPC_S_NOT_LISTENING, RPC_S_SERVER_UNAVAILABLE);
+
+    status = RpcMgmtWaitServerListen();
+    ok(status == RPC_S_OK, "RpcMgmtWaitServerListening failed with status %d\n", status);
+
+    ok(RPC_S_OK == RpcStringFreeA(&binding), "RpcStringFree\n");
+    ok(RPC_S_OK == RpcBindingFree(&IServer_IfHandle), "RpcBindingFree\n");
+}
+
+static unsigned char lrpc_died_endpoint[] = "wine_rpcrt4_test_died";
+
+static void lrpc_hang_server(void)
+{
+    static unsigned char ncalrpc[] = "ncalrpc";
+    RPC_STATUS status;
+    HANDLE ready;
+
+    ready = OpenEventA(EVENT_MODIFY_STATE, FALSE, "wine_rpcrt4_test_ready");
+    ok(ready != NULL, "OpenEvent failed with error %d\n", GetLastError());
+
+    status = RpcServerUseProtseqEpA(ncalrpc, 0, lrpc_died_endpoint, NULL);
+    ok(status == RPC_S_OK, "RpcServerUseProtseqEp(ncalrpc) failed with status %d\n", status);
+    status = RpcServerRegisterIf(s_IServer_v0_0_s_ifspec, NULL, NULL);
+    ok(status == RPC_S_OK, "RpcServerRegisterIf failed with status %d\n", status);
+    status = RpcServerListen(1, 20, TRUE);
+    ok(status == RPC_S_OK, "RpcServerListen failed with status %d\n", status);
+
+    ok(SetEvent(ready), "SetEvent\n");
+    CloseHandle(ready);
+    Sleep(30000);
+}
+
+static DWORD WINAPI lrpc_hang_thread(void *arg)
+{
+    DWORD ret = RPC_S_OK;
+
+    RpcTryExcept
+    {
+        hang();
+    }
+    RpcExcept(TRUE)
+    {
+        ret = RpcExceptionCode();
+    }
+    RpcEndExcept
+    return ret;
+}
+
+static void test_lrpc_server_died(void)
+{
+    static unsigned char ncalrpc[] = "ncalrpc";
+    char cmdline[MAX_PATH];
+    PROCESS_INFORMATION info;
+    STARTUPINFOA startup;
+    unsigned char *binding;
+    HANDLE ready, hang_event, thread;
+    DWORD ret;
+
+    ready = CreateEventA(NULL, FALSE, FALSE, "wine_rpcrt4_test_ready");
+    ok(ready != NULL, "CreateEvent failed with error %d\n", GetLastError());
+    hang_event = CreateEventA(NULL, FALSE, FALSE, "wine_rpcrt4_test_hang");
+    ok(hang_event != NULL, "CreateEvent failed with error %d\n", GetLastError());
+
+    memset(&startup, 0, sizeof startup);
+    startup.cb = sizeof startup;
+    make_cmdline(cmdline, "test lrpc_hang");
+    ok(CreateProcessA(NULL, cmdline, NULL, NULL, FALSE, 0L, NULL, NULL, &startup, &info), "CreateProcess\n");
+    ok(WaitForSingleObject(ready, 10000) == WAIT_OBJECT_0, "the server didn't start listening\n");
+
+    ok(RPC_S_OK == RpcStringBindingComposeA(NULL, ncalrpc, NULL, lrpc_died_endpoint, NULL, &binding), "RpcStringBindingCompose\n");
+    ok(RPC_S_OK == RpcBindingFromStringBindingA(binding, &IServer_IfHandle), "RpcBindingFromStringBinding\n");
+
+    /* kill the server in the middle of a call, the client must not wait forever */
+    thread = CreateThread(NULL, 0, lrpc_hang_thread, NULL, 0, NULL);
+    ok(thread != NULL, "CreateThread failed with error %d\n", GetLastError());
+    ok(WaitForSingleObject(hang_event, 10000) == WAIT_OBJECT_0, "the call didn't reach the server\n");
+    ok(TerminateProcess(info.hProcess, 1), "TerminateProcess failed with error %d\n", GetLastError());
+    ok(WaitForSingleObject(info.hProcess, 10000) == WAIT_OBJECT_0, "the server didn't exit\n");
+
+    ret = WaitForSingleObject(thread, 20000);
+    ok(ret == WAIT_OBJECT_0, "the call didn't fail after the server died\n");
+    if (ret == WAIT_OBJECT_0)
+    {
+        GetExitCodeThread(thread, &ret);
+        ok(ret == RPC_S_CALL_FAILED, "the call failed with status %u\n", ret);
+    }
+    else
+        TerminateThread(thread, 0);
+    CloseHandle(thread);
+
+    ok(RPC_S_OK == RpcStringFreeA(&binding), "RpcStringFree\n");
+    ok(RPC_S_OK == RpcBindingFree(&IServer_IfHandle), "RpcBindingFree\n");
+    CloseHandle(info.hProcess);
+    CloseHandle(info.hThread);
+    CloseHandle(hang_event);
+    CloseHandle(ready);
+}
+
 static BOOL is_process_elevated(void)
 {
     HANDLE token;
@@ -1947,7 +2146,14 @@ START_TEST(server)
   }
   else if (argc == 4)
   {
-    test_server_listening();
+    if (!strcmp(argv[3], "lrpc_listen"))
+      test_lrpc_listening();
+    else if (!strcmp(argv[3], "lrpc_died"))
+      test_lrpc_server_died();
+    else if (!strcmp(argv[3], "lrpc_hang"))
+      lrpc_hang_server();
+    else
+      test_server_listening();
   }
   else
   {
@@ -1963,6 +2169,8 @@ START_TEST(server)
     }
     server();
     run_client("test listen");
+    run_client("test lrpc_listen");
+    run_client("test lrpc_died");
     if (firewall_enabled) set_firewall(APP_REMOVE);
   }
 